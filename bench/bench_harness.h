@@ -0,0 +1,152 @@
+#ifndef HELIX_BENCH_HARNESS_H
+#define HELIX_BENCH_HARNESS_H
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace helix::bench {
+
+// Keep the optimizer from discarding a value the benchmark computed
+template <typename T>
+inline void keep(const T& value) {
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Spread of a set of samples
+struct Summary {
+    double min = 0, median = 0, mean = 0, stddev = 0;
+};
+
+inline Summary summarise(const std::vector<double>& samples) {
+    Summary out;
+    if (samples.empty()) return out;
+    std::vector<double> sorted = samples;
+    std::sort(sorted.begin(), sorted.end());
+    size_t n = sorted.size();
+    out.min = sorted.front();
+    out.median = n % 2 ? sorted[n / 2] : (sorted[n / 2 - 1] + sorted[n / 2]) / 2;
+    double sum = 0;
+    for (double s : sorted) sum += s;
+    out.mean = sum / static_cast<double>(n);
+    double var = 0;
+    for (double s : sorted) var += (s - out.mean) * (s - out.mean);
+    out.stddev = n > 1 ? std::sqrt(var / static_cast<double>(n - 1)) : 0;
+    return out;
+}
+
+// s as the inside of a JSON string (control characters dropped)
+inline std::string jsonEscape(const std::string& s) {
+    std::string out;
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) < 0x20) continue;
+        out += c;
+    }
+    return out;
+}
+
+// Benchmark - one named hot path
+// body(iterations) runs the operation that many times; setup, if given,
+// runs once before calibration (warm caches, build inputs)
+struct Benchmark {
+    std::string name;
+    std::function<void(uint64_t iterations)> body;
+    std::function<void()> setup;
+};
+
+// Timings for one benchmark, all in nanoseconds per operation
+struct BenchmarkResult {
+    std::string name;
+    uint64_t iterations = 0;         // Operations per sample
+    std::vector<double> samples;
+    double min = 0, median = 0, mean = 0, stddev = 0;
+};
+
+// BenchmarkRunner - calibrates, samples and reports benchmarks
+// Responsibilities:
+// - Grow the iteration count until one sample takes at least min_time, so
+//   microsecond and millisecond operations are both measured accurately
+// - Take `repeat` samples and summarise them (min/median/mean/stddev)
+// - Emit results as JSON so they can be stored and compared across commits
+class BenchmarkRunner {
+public:
+    std::chrono::nanoseconds min_time = std::chrono::milliseconds(50);
+    int repeat = 7;
+
+    BenchmarkResult run(const Benchmark& bench) const {
+        using clock = std::chrono::steady_clock;
+        if (bench.setup) bench.setup();
+
+        auto time = [&](uint64_t n) {
+            auto start = clock::now();
+            bench.body(n);
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+        };
+
+        // Calibrate: the first call doubles as a warm-up
+        uint64_t n = 1;
+        for (auto elapsed = time(n); elapsed < min_time && n < (1ull << 40);) {
+            double scale = elapsed.count() > 0
+                ? static_cast<double>(min_time.count()) / static_cast<double>(elapsed.count())
+                : 10.0;
+            n = std::max<uint64_t>(n + 1, static_cast<uint64_t>(n * std::min(scale * 1.2, 10.0)));
+            elapsed = time(n);
+        }
+
+        BenchmarkResult result;
+        result.name = bench.name;
+        result.iterations = n;
+        for (int i = 0; i < std::max(repeat, 1); ++i) {
+            result.samples.push_back(static_cast<double>(time(n).count()) / static_cast<double>(n));
+        }
+        summarise(result);
+        return result;
+    }
+
+    // JSON document describing a suite run
+    static void writeJson(FILE* out, const std::vector<BenchmarkResult>& results,
+                          const std::string& suite, int repeat, std::chrono::nanoseconds min_time) {
+        std::fprintf(out, "{\n  \"suite\": \"%s\",\n", jsonEscape(suite).c_str());
+        std::fprintf(out, "  \"unit\": \"ns/op\",\n");
+        std::fprintf(out, "  \"timestamp\": %lld,\n",
+                     static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(
+                         std::chrono::system_clock::now().time_since_epoch()).count()));
+        std::fprintf(out, "  \"repeat\": %d,\n  \"min_time_ms\": %lld,\n", repeat,
+                     static_cast<long long>(
+                         std::chrono::duration_cast<std::chrono::milliseconds>(min_time).count()));
+        std::fprintf(out, "  \"benchmarks\": [");
+        for (size_t i = 0; i < results.size(); ++i) {
+            const auto& r = results[i];
+            std::fprintf(out, "%s\n    {\"name\": \"%s\", \"iterations\": %llu, "
+                              "\"min\": %.1f, \"median\": %.1f, \"mean\": %.1f, \"stddev\": %.1f, "
+                              "\"samples\": [",
+                         i ? "," : "", jsonEscape(r.name).c_str(),
+                         static_cast<unsigned long long>(r.iterations),
+                         r.min, r.median, r.mean, r.stddev);
+            for (size_t s = 0; s < r.samples.size(); ++s) {
+                std::fprintf(out, "%s%.1f", s ? ", " : "", r.samples[s]);
+            }
+            std::fprintf(out, "]}");
+        }
+        std::fprintf(out, "\n  ]\n}\n");
+    }
+
+private:
+    static void summarise(BenchmarkResult& r) {
+        Summary summary = bench::summarise(r.samples);
+        r.min = summary.min;
+        r.median = summary.median;
+        r.mean = summary.mean;
+        r.stddev = summary.stddev;
+    }
+};
+
+} // namespace helix::bench
+
+#endif // HELIX_BENCH_HARNESS_H
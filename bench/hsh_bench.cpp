@@ -0,0 +1,291 @@
+// hsh_bench - micro-benchmarks for Helix's hot paths
+// Prints one JSON document (see bench_harness.h) so runs can be archived and
+// compared between commits:
+//   hsh_bench [--filter SUBSTR] [--repeat N] [--min-time-ms N] [--output FILE] [--list]
+// End-to-end cases run a real Shell with HOME pointed at a scratch
+// directory, so ~/.helixrc and history do not influence the numbers.
+
+#include "bench_harness.h"
+#include "shell.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "script_parser.h"
+#include "executor/environment_expander.h"
+#include "executor/executable_resolver.h"
+#include "executor/path_cache.h"
+#include "executor/glob_engine.h"
+#include "executor/arithmetic.h"
+#include "readline_support.h"
+#include "shell/variable_store.h"
+#include "shell/script_cache.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace helix;
+using helix::bench::Benchmark;
+using helix::bench::BenchmarkResult;
+using helix::bench::BenchmarkRunner;
+using helix::bench::keep;
+
+namespace {
+
+// Inputs shared by the front-end benchmarks
+const std::string kCommandLine =
+    "grep -v '^#' \"$HOME/config files/app.conf\" | sort -u | head -n 20 > /tmp/out.txt 2>&1";
+
+const std::string kScript =
+    "count=0\n"
+    "for f in a b c d e f g h; do\n"
+    "    case \"$f\" in\n"
+    "        a|b) count=$((count + 1)) ;;\n"
+    "        *) echo \"other $f\" >> /tmp/log ;;\n"
+    "    esac\n"
+    "done\n"
+    "while [ \"$count\" -lt 10 ]; do count=$((count + 1)); done\n"
+    "greet() { local name=\"$1\"; echo \"hello ${name:-world}\"; }\n"
+    "if greet x | grep -q hello && [ -n \"$HOME\" ]; then echo ok; else echo no; fi\n"
+    "cat <<EOF\n"
+    "count is $count\n"
+    "EOF\n";
+
+// An xargs-style line: one command with thousands of file arguments
+const std::string kLongLine = [] {
+    std::string line = "rm -f";
+    for (int i = 0; i < 5000; ++i) line += " build/obj/module_" + std::to_string(i) + ".o";
+    return line;
+}();
+
+const std::string kExpandInput = "$HOME/src/${USER}/build-$BENCH_A-$BENCH_B ~/x";
+
+// Process-wide Shell for the end-to-end cases, created on first use
+Shell& benchShell() {
+    static std::unique_ptr<Shell> shell;
+    if (!shell) {
+        char dir[] = "/tmp/hsh_bench.XXXXXX";
+        if (mkdtemp(dir)) VariableStore::global().set("HOME", dir, true);
+        shell = std::make_unique<Shell>();
+    }
+    return *shell;
+}
+
+Benchmark shellCase(const std::string& name, const std::string& source) {
+    return {name,
+            [source](uint64_t n) {
+                Shell& shell = benchShell();
+                for (uint64_t i = 0; i < n; ++i) shell.processInputString(source);
+                std::cout.flush();
+            },
+            [] { benchShell(); }};
+}
+
+// A function library of a few hundred lines in the bench HOME, dated in
+// the past so ScriptCache trusts its mtime; returns its path
+std::string benchLibrary() {
+    benchShell();
+    const std::string* home = VariableStore::global().find("HOME");
+    std::string path = (home ? *home : std::string("/tmp")) + "/lib.sh";
+    std::ofstream lib(path);
+    for (int i = 0; i < 100; ++i) {
+        lib << "lib_fn" << i << "() {\n"
+            << "    if [ -n \"$1\" ]; then echo \"fn" << i << " $1\"; else return 1; fi\n"
+            << "}\n";
+    }
+    lib.close();
+    struct timespec old_times[2] = {{1000000000, 0}, {1000000000, 0}};
+    utimensat(AT_FDCWD, path.c_str(), old_times, 0);
+    return path;
+}
+
+Benchmark sourceCase(const std::string& name, bool cold) {
+    auto path = std::make_shared<std::string>();
+    return {name,
+            [path, cold](uint64_t n) {
+                Shell& shell = benchShell();
+                for (uint64_t i = 0; i < n; ++i) {
+                    if (cold) ScriptCache::global().clear();
+                    shell.processInputString(". " + *path);
+                }
+            },
+            [path] { *path = benchLibrary(); }};
+}
+
+std::vector<Benchmark> allBenchmarks() {
+    std::vector<Benchmark> list;
+
+    list.push_back({"tokenizer/tokenize", [](uint64_t n) {
+        Tokenizer tokenizer;
+        for (uint64_t i = 0; i < n; ++i) keep(tokenizer.tokenize(kCommandLine));
+    }, nullptr});
+
+    list.push_back({"tokenizer/tokenize_script", [](uint64_t n) {
+        Tokenizer tokenizer;
+        for (uint64_t i = 0; i < n; ++i) keep(tokenizer.tokenizeScript(kScript));
+    }, nullptr});
+
+    list.push_back({"tokenizer/script_long_line", [](uint64_t n) {
+        Tokenizer tokenizer;
+        for (uint64_t i = 0; i < n; ++i) keep(tokenizer.tokenizeScriptView(kLongLine));
+    }, nullptr});
+
+    list.push_back({"parser/parse", [](uint64_t n) {
+        Tokenizer tokenizer;
+        Parser parser;
+        auto tokens = tokenizer.tokenize(kCommandLine);
+        for (uint64_t i = 0; i < n; ++i) keep(parser.parse(tokens));
+    }, nullptr});
+
+    list.push_back({"script_parser/parse", [](uint64_t n) {
+        ScriptParser parser;
+        for (uint64_t i = 0; i < n; ++i) keep(parser.parse(kScript));
+    }, nullptr});
+
+    list.push_back({"expander/expand_with_state", [](uint64_t n) {
+        EnvironmentVariableExpander expander;
+        ShellState state;
+        for (uint64_t i = 0; i < n; ++i) keep(expander.expandWithState(kExpandInput, &state));
+    }, [] {
+        VariableStore::global().set("BENCH_A", "alpha");
+        VariableStore::global().set("BENCH_B", "beta");
+    }});
+
+    list.push_back({"arith/increment", [](uint64_t n) {
+        long value = 0;
+        for (uint64_t i = 0; i < n; ++i) ArithmeticEngine::global().evaluate("BENCH_I = BENCH_I + 1", nullptr, value);
+        keep(value);
+    }, [] { VariableStore::global().set("BENCH_I", "0"); }});
+
+    list.push_back({"brace/expand", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            keep(ScriptParser::braceExpand("src/{core,io,net}/file{1..8}.{cpp,h}"));
+        }
+    }, nullptr});
+
+    list.push_back({"resolver/find_executable", [](uint64_t n) {
+        ExecutableResolver resolver(false);
+        for (uint64_t i = 0; i < n; ++i) keep(resolver.findExecutable("sh"));
+    }, nullptr});
+
+    list.push_back({"resolver/find_executable_cold", [](uint64_t n) {
+        ExecutableResolver resolver(false);
+        for (uint64_t i = 0; i < n; ++i) {
+            PathCache::global().clear();
+            keep(resolver.findExecutable("sh"));
+        }
+    }, nullptr});
+
+    list.push_back({"completion/command_prefix", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) keep(ReadlineSupport::commandCompletions("gi"));
+    }, nullptr});
+
+    // A system tree that rarely changes, so cached listings stay valid
+    list.push_back({"glob/recursive", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            std::vector<std::string> out;
+            GlobEngine::global().expand("/usr/include/**/*.h", out);
+            keep(out);
+        }
+    }, nullptr});
+
+    list.push_back({"glob/recursive_cold", [](uint64_t n) {
+        for (uint64_t i = 0; i < n; ++i) {
+            GlobEngine::global().clear();
+            std::vector<std::string> out;
+            GlobEngine::global().expand("/usr/include/**/*.h", out);
+            keep(out);
+        }
+    }, nullptr});
+
+    list.push_back(shellCase("e2e/builtin", "echo hello"));
+    list.push_back(shellCase("e2e/fork_exec", "/bin/true"));
+    list.push_back(shellCase("e2e/path_exec", "cat /dev/null"));
+    list.push_back(shellCase("e2e/pipeline3", "/bin/echo x | /bin/cat | /bin/cat"));
+    list.push_back(shellCase("e2e/command_substitution", "v=$(echo hi)"));
+    list.push_back(shellCase("e2e/script_loop",
+        "i=0; while [ $i -lt 100 ]; do i=$((i + 1)); done"));
+    list.push_back(shellCase("e2e/function_calls",
+        "f() { local a=$1; }; for k in 1 2 3 4 5 6 7 8 9 10; do f $k; done"));
+    list.push_back(sourceCase("e2e/source_library", false));
+    list.push_back(sourceCase("e2e/source_library_cold", true));
+    return list;
+}
+
+bool parsePositive(const char* text, long& out) {
+    char* end = nullptr;
+    out = std::strtol(text, &end, 10);
+    return end && *end == '\0' && out > 0;
+}
+
+void usage() {
+    std::cerr << "Usage: hsh_bench [--filter SUBSTR] [--repeat N] [--min-time-ms N]\n"
+                 "                 [--output FILE] [--list]\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    BenchmarkRunner runner;
+    std::string filter;
+    std::string output;
+    bool list_only = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long value = 0;
+        if (arg == "--list") {
+            list_only = true;
+        } else if (i + 1 < argc && arg == "--filter") {
+            filter = argv[++i];
+        } else if (i + 1 < argc && arg == "--output") {
+            output = argv[++i];
+        } else if (i + 1 < argc && arg == "--repeat" && parsePositive(argv[i + 1], value)) {
+            runner.repeat = static_cast<int>(value);
+            ++i;
+        } else if (i + 1 < argc && arg == "--min-time-ms" && parsePositive(argv[i + 1], value)) {
+            runner.min_time = std::chrono::milliseconds(value);
+            ++i;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<Benchmark> selected;
+    for (auto& b : allBenchmarks()) {
+        if (filter.empty() || b.name.find(filter) != std::string::npos) selected.push_back(std::move(b));
+    }
+    if (list_only) {
+        for (const auto& b : selected) std::cout << b.name << '\n';
+        return 0;
+    }
+
+    // The report keeps the real stdout; everything the shell cases print
+    // goes to /dev/null
+    FILE* report = output.empty() ? fdopen(fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3), "w") : std::fopen(output.c_str(), "w");
+    if (!report) {
+        std::cerr << "hsh_bench: cannot open " << (output.empty() ? "stdout" : output) << ": "
+                  << std::strerror(errno) << '\n';
+        return 1;
+    }
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    if (devnull != -1) {
+        dup2(devnull, STDOUT_FILENO);
+        close(devnull);
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const auto& b : selected) {
+        results.push_back(runner.run(b));
+        std::cerr << b.name << ": " << results.back().median << " ns/op\n";
+    }
+
+    BenchmarkRunner::writeJson(report, results, "hsh_bench", runner.repeat, runner.min_time);
+    std::fclose(report);
+    return 0;
+}
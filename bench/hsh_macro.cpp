@@ -0,0 +1,443 @@
+// hsh_macro - cross-shell macro-benchmarks
+// Runs the workload scripts in bench/macro under helix, bash and dash and
+// prints one JSON document: wall, user and sys time, peak RSS and forks per
+// workload and shell, each over --repeat runs:
+//   hsh_macro [--helix PATH] [--shells LIST] [--corpus DIR] [--filter SUBSTR]
+//             [--repeat N] [--quick] [--output FILE] [--list]
+// A script gets $BENCH_DATA (inputs generated once into a scratch
+// directory), $BENCH_N (its size) and $BENCH_SHELL (the shell running it),
+// with HOME pointed at an empty directory so no rc file is read. The first
+// run of each pair is an untimed warm-up whose output is compared with the
+// first shell's: a shell that fails or prints something else makes the exit
+// status 1, so a --quick run doubles as a compatibility test (ctest).
+
+#include "bench_harness.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+#ifndef HELIX_BENCH_CORPUS
+#define HELIX_BENCH_CORPUS "bench/macro"
+#endif
+
+using helix::bench::jsonEscape;
+using helix::bench::Summary;
+using helix::bench::summarise;
+
+namespace {
+
+namespace fs = std::filesystem;
+
+// Input sizes; --quick runs every workload on the small ones
+constexpr long kLines = 1000000, kQuickLines = 10000;
+constexpr int kTreeDirs = 100, kQuickTreeDirs = 10;
+constexpr int kHeredocLines = 20000, kQuickHeredocLines = 1000;
+
+// Workload - one script of the corpus and the $BENCH_N it runs with
+struct Workload {
+    const char* name;  // bench/macro/<name>.sh
+    long n;
+    long quick_n;
+};
+
+// Recursion stays under dash's limit of 1000 nested calls
+const Workload kWorkloads[] = {
+    {"read_loop", kLines, kQuickLines},
+    {"recursion", 500, 100},
+    {"command_subst", 5000, 200},
+    {"pipeline20", 100, 5},
+    {"startup", 500, 20},
+    {"heredoc", 50, 3},
+    {"glob", 50, 2},
+};
+
+struct ShellUnderTest {
+    std::string name;
+    std::string path;
+};
+
+// What one run of a script used; forks is -1 where the system does not say
+struct RunSample {
+    double wall_ms = 0, user_ms = 0, sys_ms = 0, max_rss_kb = 0, forks = -1;
+    int status = 0;
+};
+
+struct RunResult {
+    std::string shell;
+    int status = 0;
+    bool output_matches = true;
+    std::vector<RunSample> samples;
+};
+
+struct WorkloadResult {
+    std::string name;
+    long n = 0;
+    std::vector<RunResult> runs;
+};
+
+// Processes created since boot (fork, vfork and clone), from /proc/stat.
+// The count is system-wide, so a busy machine inflates it; the minimum
+// over the repeats is the one to trust
+long long processesCreated() {
+    std::ifstream stat("/proc/stat");
+    std::string key;
+    long long value = 0;
+    while (stat >> key) {
+        if (key == "processes" && stat >> value) return value;
+        stat.ignore(1 << 20, '\n');
+    }
+    return -1;
+}
+
+std::string readFile(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+// First line of text, for messages
+std::string firstLine(const std::string& text) {
+    std::string line = text.substr(0, text.find('\n'));
+    return line.size() > 120 ? line.substr(0, 120) + "..." : line;
+}
+
+// The inputs the scripts read: lines.txt for read_loop, small.txt for
+// pipeline20, tree/ for glob and heredoc.sh for heredoc
+bool generateData(const fs::path& dir, bool quick) {
+    std::error_code error;
+    fs::create_directories(dir / "tree", error);
+    if (error) return false;
+
+    std::ofstream lines(dir / "lines.txt");
+    for (long i = 0, n = quick ? kQuickLines : kLines; i < n; ++i) {
+        lines << "line " << i << " of the input, some words to read\n";
+    }
+    std::ofstream small(dir / "small.txt");
+    for (int i = 0; i < 100; ++i) small << "row " << i << "\n";
+
+    for (int d = 0, dirs = quick ? kQuickTreeDirs : kTreeDirs; d < dirs; ++d) {
+        fs::path sub = dir / "tree" / ("d" + std::to_string(d));
+        fs::create_directory(sub, error);
+        for (int f = 0; f < 50; ++f) {
+            std::ofstream(sub / ("f" + std::to_string(f) + ".txt"));
+            std::ofstream(sub / ("f" + std::to_string(f) + ".dat"));
+        }
+    }
+
+    std::ofstream heredoc(dir / "heredoc.sh");
+    heredoc << "i=0\nwhile [ \"$i\" -lt \"$BENCH_N\" ]; do\n    cat <<EOF | wc -l\n";
+    for (int i = 0, n = quick ? kQuickHeredocLines : kHeredocLines; i < n; ++i) {
+        heredoc << "row " << i << " of pass $i, home ${HOME}\n";
+    }
+    heredoc << "EOF\n    i=$((i + 1))\ndone\n";
+    return lines.good() && small.good() && heredoc.good();
+}
+
+// name on $PATH, or empty
+std::string findOnPath(const std::string& name) {
+    const char* path = std::getenv("PATH");
+    std::stringstream dirs(path ? path : "/usr/bin:/bin");
+    std::string dir;
+    while (std::getline(dirs, dir, ':')) {
+        std::string candidate = (dir.empty() ? "." : dir) + "/" + name;
+        if (access(candidate.c_str(), X_OK) == 0) return candidate;
+    }
+    return "";
+}
+
+// Run script under shell once, stdout and stderr into out and err
+RunSample runOnce(const ShellUnderTest& shell, const fs::path& script, long n, const fs::path& scratch,
+                  std::string& out, std::string& err) {
+    RunSample sample;
+    fs::path out_path = scratch / "out", err_path = scratch / "err";
+    int out_fd = open(out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int err_fd = open(err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int in_fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+
+    long long forks_before = processesCreated();
+    auto started = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0) {
+        dup2(in_fd, STDIN_FILENO);
+        dup2(out_fd, STDOUT_FILENO);
+        dup2(err_fd, STDERR_FILENO);
+        if (chdir((scratch / "data").c_str()) == -1) _exit(126);
+        setenv("BENCH_DATA", (scratch / "data").c_str(), 1);
+        setenv("BENCH_N", std::to_string(n).c_str(), 1);
+        setenv("BENCH_SHELL", shell.path.c_str(), 1);
+        setenv("HOME", (scratch / "home").c_str(), 1);
+        // Nothing the caller's environment sets up may run in the shells
+        for (const char* name : {"HELIX_SERVER", "HELIX_ENV", "HELIX_TRACE", "BASH_ENV", "ENV"}) unsetenv(name);
+        execl(shell.path.c_str(), shell.path.c_str(), script.c_str(), static_cast<char*>(nullptr));
+        _exit(127);
+    }
+    for (int fd : {out_fd, err_fd, in_fd}) {
+        if (fd != -1) close(fd);
+    }
+    if (pid == -1) {
+        err = std::string("fork: ") + std::strerror(errno);
+        sample.status = -1;
+        return sample;
+    }
+
+    int status = 0;
+    struct rusage usage {};
+    while (wait4(pid, &status, 0, &usage) == -1 && errno == EINTR) {}
+    auto elapsed = std::chrono::steady_clock::now() - started;
+    long long forks_after = processesCreated();
+
+    // The shell with every process it waited for
+    sample.wall_ms = std::chrono::duration<double, std::milli>(elapsed).count();
+    sample.user_ms = usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3;
+    sample.sys_ms = usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3;
+#if defined(__APPLE__)
+    sample.max_rss_kb = static_cast<double>(usage.ru_maxrss) / 1024;  // Bytes there
+#else
+    sample.max_rss_kb = static_cast<double>(usage.ru_maxrss);
+#endif
+    // Not counting the fork that started the shell
+    if (forks_before != -1 && forks_after != -1) sample.forks = static_cast<double>(forks_after - forks_before - 1);
+    sample.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    out = readFile(out_path);
+    err = readFile(err_path);
+    return sample;
+}
+
+void writeSummary(FILE* out, const char* key, const std::vector<RunSample>& samples, double RunSample::*field) {
+    std::vector<double> values;
+    for (const auto& s : samples) {
+        if (s.*field >= 0) values.push_back(s.*field);
+    }
+    if (values.empty()) {
+        std::fprintf(out, "\"%s\": null", key);
+        return;
+    }
+    Summary summary = summarise(values);
+    std::fprintf(out, "\"%s\": {\"min\": %.1f, \"median\": %.1f, \"mean\": %.1f, \"stddev\": %.1f, \"samples\": [",
+                 key, summary.min, summary.median, summary.mean, summary.stddev);
+    for (size_t i = 0; i < values.size(); ++i) std::fprintf(out, "%s%.1f", i ? ", " : "", values[i]);
+    std::fprintf(out, "]}");
+}
+
+void writeJson(FILE* out, const std::vector<WorkloadResult>& results, const std::vector<ShellUnderTest>& shells,
+               const std::vector<std::string>& skipped, int repeat, bool quick) {
+    std::fprintf(out, "{\n  \"suite\": \"hsh_macro\",\n");
+    std::fprintf(out, "  \"timestamp\": %lld,\n",
+                 static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(
+                     std::chrono::system_clock::now().time_since_epoch()).count()));
+    std::fprintf(out, "  \"repeat\": %d,\n  \"quick\": %s,\n", repeat, quick ? "true" : "false");
+    std::fprintf(out, "  \"units\": {\"wall\": \"ms\", \"user\": \"ms\", \"sys\": \"ms\", \"max_rss\": \"KiB\"},\n");
+    std::fprintf(out, "  \"shells\": [");
+    for (size_t i = 0; i < shells.size(); ++i) {
+        std::fprintf(out, "%s{\"name\": \"%s\", \"path\": \"%s\"}", i ? ", " : "", jsonEscape(shells[i].name).c_str(),
+                     jsonEscape(shells[i].path).c_str());
+    }
+    std::fprintf(out, "],\n  \"skipped\": [");
+    for (size_t i = 0; i < skipped.size(); ++i) {
+        std::fprintf(out, "%s\"%s\"", i ? ", " : "", jsonEscape(skipped[i]).c_str());
+    }
+    std::fprintf(out, "],\n  \"workloads\": [");
+    for (size_t w = 0; w < results.size(); ++w) {
+        const WorkloadResult& workload = results[w];
+        std::fprintf(out, "%s\n    {\"name\": \"%s\", \"n\": %ld, \"runs\": [", w ? "," : "",
+                     jsonEscape(workload.name).c_str(), workload.n);
+        for (size_t r = 0; r < workload.runs.size(); ++r) {
+            const RunResult& run = workload.runs[r];
+            std::fprintf(out, "%s\n      {\"shell\": \"%s\", \"status\": %d, \"output_matches\": %s, ", r ? "," : "",
+                         jsonEscape(run.shell).c_str(), run.status, run.output_matches ? "true" : "false");
+            writeSummary(out, "wall", run.samples, &RunSample::wall_ms);
+            std::fprintf(out, ", ");
+            writeSummary(out, "user", run.samples, &RunSample::user_ms);
+            std::fprintf(out, ", ");
+            writeSummary(out, "sys", run.samples, &RunSample::sys_ms);
+            std::fprintf(out, ", ");
+            writeSummary(out, "max_rss", run.samples, &RunSample::max_rss_kb);
+            std::fprintf(out, ", ");
+            writeSummary(out, "forks", run.samples, &RunSample::forks);
+            std::fprintf(out, "}");
+        }
+        std::fprintf(out, "\n    ]}");
+    }
+    std::fprintf(out, "\n  ]\n}\n");
+}
+
+// One line per workload and shell on stderr, medians, with the wall time
+// relative to the first shell's
+void printLine(const std::string& workload, const RunResult& run, double reference_wall) {
+    auto median = [&](double RunSample::*field) {
+        std::vector<double> values;
+        for (const auto& s : run.samples) values.push_back(s.*field);
+        return summarise(values).median;
+    };
+    double wall = median(&RunSample::wall_ms);
+    double forks = median(&RunSample::forks);
+    std::fprintf(stderr, "%-14s %-8s wall %9.1f ms  user %9.1f  sys %8.1f  rss %7.0fK", workload.c_str(),
+                 run.shell.c_str(), wall, median(&RunSample::user_ms), median(&RunSample::sys_ms),
+                 median(&RunSample::max_rss_kb));
+    if (forks >= 0) std::fprintf(stderr, "  forks %7.0f", forks);
+    if (reference_wall > 0) std::fprintf(stderr, "  %5.2fx", wall / reference_wall);
+    std::fprintf(stderr, "\n");
+}
+
+bool parsePositive(const char* text, long& out) {
+    char* end = nullptr;
+    out = std::strtol(text, &end, 10);
+    return end && *end == '\0' && out > 0;
+}
+
+void usage() {
+    std::cerr << "Usage: hsh_macro [--helix PATH] [--shells LIST] [--corpus DIR] [--filter SUBSTR]\n"
+                 "                 [--repeat N] [--quick] [--output FILE] [--list]\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    std::string helix_path;
+    std::string shell_list = "helix,bash,dash";
+    std::string corpus = HELIX_BENCH_CORPUS;
+    std::string filter;
+    std::string output;
+    long repeat = 5;
+    bool quick = false;
+    bool list_only = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        long value = 0;
+        if (arg == "--list") {
+            list_only = true;
+        } else if (arg == "--quick") {
+            quick = true;
+        } else if (i + 1 < argc && arg == "--helix") {
+            helix_path = argv[++i];
+        } else if (i + 1 < argc && arg == "--shells") {
+            shell_list = argv[++i];
+        } else if (i + 1 < argc && arg == "--corpus") {
+            corpus = argv[++i];
+        } else if (i + 1 < argc && arg == "--filter") {
+            filter = argv[++i];
+        } else if (i + 1 < argc && arg == "--output") {
+            output = argv[++i];
+        } else if (i + 1 < argc && arg == "--repeat" && parsePositive(argv[i + 1], value)) {
+            repeat = value;
+            ++i;
+        } else {
+            usage();
+            return 2;
+        }
+    }
+
+    std::vector<Workload> selected;
+    for (const Workload& w : kWorkloads) {
+        if (filter.empty() || std::string(w.name).find(filter) != std::string::npos) selected.push_back(w);
+    }
+    if (list_only) {
+        for (const Workload& w : selected) std::cout << w.name << '\n';
+        return 0;
+    }
+
+    // helix is the binary next to this one unless --helix says otherwise;
+    // a shell that is not installed is left out of the report
+    if (helix_path.empty()) {
+        fs::path sibling = fs::path(argv[0]).parent_path() / "helix";
+        helix_path = access(sibling.c_str(), X_OK) == 0 ? sibling.string() : findOnPath("helix");
+    }
+    std::vector<ShellUnderTest> shells;
+    std::vector<std::string> skipped;
+    std::stringstream names(shell_list);
+    for (std::string name; std::getline(names, name, ',');) {
+        if (name.empty()) continue;
+        std::string path = name == "helix" ? helix_path : name.find('/') != std::string::npos ? name : findOnPath(name);
+        if (path.empty() || access(path.c_str(), X_OK) != 0) {
+            std::cerr << "hsh_macro: " << name << ": not found, skipped\n";
+            skipped.push_back(name);
+            continue;
+        }
+        shells.push_back({fs::path(name).filename().string(), path});
+    }
+    if (shells.empty()) {
+        std::cerr << "hsh_macro: no shell to run\n";
+        return 1;
+    }
+
+    std::string scratch_template = (fs::temp_directory_path() / "hsh_macro.XXXXXX").string();
+    if (!mkdtemp(scratch_template.data())) {
+        std::cerr << "hsh_macro: cannot make a scratch directory: " << std::strerror(errno) << '\n';
+        return 1;
+    }
+    fs::path scratch = scratch_template;
+    std::error_code error;
+    fs::create_directory(scratch / "home", error);
+    if (error || !generateData(scratch / "data", quick)) {
+        std::cerr << "hsh_macro: cannot write the inputs to " << scratch << '\n';
+        fs::remove_all(scratch, error);
+        return 1;
+    }
+
+    bool ok = true;
+    std::vector<WorkloadResult> results;
+    for (const Workload& w : selected) {
+        WorkloadResult workload;
+        workload.name = w.name;
+        workload.n = quick ? w.quick_n : w.n;
+        fs::path script = fs::absolute(fs::path(corpus) / (workload.name + ".sh"));
+        std::string reference;
+        double reference_wall = 0;
+
+        for (size_t s = 0; s < shells.size(); ++s) {
+            const ShellUnderTest& shell = shells[s];
+            RunResult run;
+            run.shell = shell.name;
+
+            // Warm-up: page cache, PATH lookups; its output is the one compared
+            std::string out, err;
+            run.status = runOnce(shell, script, workload.n, scratch, out, err).status;
+            if (s == 0) reference = out;
+            run.output_matches = out == reference;
+            if (run.status != 0) {
+                std::cerr << "hsh_macro: " << workload.name << ": " << shell.name << " exited with status "
+                          << run.status << ": " << firstLine(err) << '\n';
+                ok = false;
+            } else if (!run.output_matches) {
+                std::cerr << "hsh_macro: " << workload.name << ": " << shell.name << " printed \"" << firstLine(out)
+                          << "\", " << shells[0].name << " \"" << firstLine(reference) << "\"\n";
+                ok = false;
+            }
+
+            for (long i = 0; i < repeat && run.status == 0; ++i) {
+                run.samples.push_back(runOnce(shell, script, workload.n, scratch, out, err));
+            }
+            if (!run.samples.empty()) {
+                std::vector<double> walls;
+                for (const auto& sample : run.samples) walls.push_back(sample.wall_ms);
+                if (s == 0) reference_wall = summarise(walls).median;
+                printLine(workload.name, run, s == 0 ? 0 : reference_wall);
+            }
+            workload.runs.push_back(std::move(run));
+        }
+        results.push_back(std::move(workload));
+    }
+    fs::remove_all(scratch, error);
+
+    FILE* report = output.empty() ? stdout : std::fopen(output.c_str(), "w");
+    if (!report) {
+        std::cerr << "hsh_macro: cannot open " << output << ": " << std::strerror(errno) << '\n';
+        return 1;
+    }
+    writeJson(report, results, shells, skipped, static_cast<int>(repeat), quick);
+    if (report != stdout) std::fclose(report);
+    return ok ? 0 : 1;
+}
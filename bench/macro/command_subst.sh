@@ -0,0 +1,9 @@
+# $(...) in a loop: one command substitution per iteration
+i=0
+sum=0
+while [ "$i" -lt "$BENCH_N" ]; do
+    v=$(echo "$i")
+    sum=$((sum + v))
+    i=$((i + 1))
+done
+echo "$sum"
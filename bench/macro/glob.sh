@@ -0,0 +1,14 @@
+# Globs over a wide directory tree: matching, sorting, word lists
+i=0
+while [ "$i" -lt "$BENCH_N" ]; do
+    n=0
+    for f in "$BENCH_DATA"/tree/*/*.txt; do
+        n=$((n + 1))
+    done
+    m=0
+    for f in "$BENCH_DATA"/tree/d1*/*[05].dat; do
+        m=$((m + 1))
+    done
+    i=$((i + 1))
+done
+echo "$n $m"
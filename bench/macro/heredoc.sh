@@ -0,0 +1,3 @@
+# Large here-documents with expansions in every line (the script is made
+# by hsh_macro: $BENCH_DATA/heredoc.sh)
+. "$BENCH_DATA/heredoc.sh"
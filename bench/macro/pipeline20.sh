@@ -0,0 +1,8 @@
+# 20-stage pipelines: process and pipe setup per stage
+i=0
+while [ "$i" -lt "$BENCH_N" ]; do
+    out=$(cat "$BENCH_DATA/small.txt" | cat | cat | cat | cat | cat | cat | cat | cat | cat |
+        cat | cat | cat | cat | cat | cat | cat | cat | cat | wc -l)
+    i=$((i + 1))
+done
+echo "$out"
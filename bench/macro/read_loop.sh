@@ -0,0 +1,8 @@
+# while read over a large file: the read builtin and the loop around it
+n=0
+bytes=0
+while IFS= read -r line; do
+    n=$((n + 1))
+    bytes=$((bytes + ${#line}))
+done < "$BENCH_DATA/lines.txt"
+echo "$n lines, $bytes bytes"
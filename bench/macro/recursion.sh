@@ -0,0 +1,14 @@
+# Deep function recursion: call frames, positional parameters, arithmetic
+depth() {
+    if [ "$1" -gt 0 ]; then
+        depth $(($1 - 1))
+    else
+        echo bottom
+    fi
+}
+i=0
+while [ "$i" -lt 10 ]; do
+    depth "$BENCH_N" > /dev/null
+    i=$((i + 1))
+done
+depth "$BENCH_N"
@@ -0,0 +1,7 @@
+# -c startup storm: the shell under test starting itself over and over
+i=0
+while [ "$i" -lt "$BENCH_N" ]; do
+    "$BENCH_SHELL" -c 'x=1; [ "$x" = 1 ]' || exit 1
+    i=$((i + 1))
+done
+echo "$i"
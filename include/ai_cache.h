@@ -0,0 +1,60 @@
+#ifndef HELIX_AI_CACHE_H
+#define HELIX_AI_CACHE_H
+
+#include "ai_provider.h"
+#include <chrono>
+#include <optional>
+#include <string>
+
+namespace helix {
+
+// AiResponseCache - On-disk cache of `ai` replies
+// Responsibilities:
+// - Turn a query (provider, model, endpoint, token limit, system prompt and
+//   user message, which carries the context) into a key, and the key into a
+//   128-bit file name, so equal queries share one file across shells
+// - Keep the whole key in the file, so a digest collision is a miss rather
+//   than somebody else's answer
+// - Treat entries older than the TTL as missing, and remove expired ones at
+//   most once an hour
+// Files are written under a temporary name and renamed into place, so a
+// concurrent reader sees either the old entry or the new one, never half.
+class AiResponseCache {
+public:
+    // $HELIX_AI_CACHE_DIR, else $XDG_CACHE_HOME/helix/ai, else ~/.cache/helix/ai
+    static std::string defaultDirectory();
+
+    // $HELIX_AI_CACHE_TTL in seconds (default one day); 0 turns caching off
+    static std::chrono::seconds defaultTtl();
+
+    // Everything that decides the reply, in one string
+    static std::string keyFor(const AiProvider& provider, const std::string& system_prompt,
+                              const std::string& user_message, int max_tokens);
+
+    // File name for key: 32 hex digits
+    static std::string digest(const std::string& key);
+
+    explicit AiResponseCache(std::string directory, std::chrono::seconds ttl = defaultTtl())
+        : directory_(std::move(directory)), ttl_(ttl) {}
+
+    bool enabled() const { return ttl_.count() > 0 && !directory_.empty(); }
+
+    // The stored reply for key, if one exists and has not expired
+    std::optional<std::string> lookup(const std::string& key) const;
+
+    // Remember reply for key; false if the directory is not writable
+    bool store(const std::string& key, const std::string& reply);
+
+    // Remove every expired entry; returns how many were removed
+    size_t prune();
+
+private:
+    std::string pathFor(const std::string& key) const;
+
+    std::string directory_;
+    std::chrono::seconds ttl_;
+};
+
+} // namespace helix
+
+#endif // HELIX_AI_CACHE_H
@@ -0,0 +1,68 @@
+#ifndef HELIX_AI_CONTEXT_H
+#define HELIX_AI_CONTEXT_H
+
+#include <ctime>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace helix {
+
+// AiContext - What `ai` tells the model about where the user is
+// Responsibilities:
+// - Gather a snapshot of a directory: its path, a listing of its entries and
+//   the git branch it is on (read from .git/HEAD; git is not run)
+// - Gather it on a background worker while the prompt waits for input, so a
+//   query finds it ready; a query with nothing usable gathers it inline
+// - Revalidate a snapshot with two stat() calls: directory mtime (an entry
+//   was added or removed) and HEAD mtime (a checkout)
+// - Render a snapshot plus recent history as text for the prompt
+// The worker starts with the first query, so shells that never use `ai`
+// never list a directory or create a thread.
+class AiContext {
+public:
+    struct Snapshot {
+        std::string directory;
+        std::string listing;   // Entry names, one per line, dirs with '/'
+        std::string branch;    // Empty outside a repository
+        std::string head_path; // .git/HEAD the branch came from
+        struct timespec directory_mtime {};
+        struct timespec head_mtime {};
+    };
+
+    // The context shared by the whole shell process
+    static AiContext& global();
+
+    AiContext();
+    ~AiContext();
+
+    AiContext(const AiContext&) = delete;
+    AiContext& operator=(const AiContext&) = delete;
+
+    // Refresh directory's snapshot in the background if it is missing or
+    // stale; does nothing until get() has been called once
+    void prefetch(const std::string& directory);
+
+    // Snapshot of directory: the prefetched one while it is still valid,
+    // otherwise gathered now (a worker still busy with it is waited for)
+    Snapshot get(const std::string& directory);
+
+    // Gather a snapshot without any caching
+    static Snapshot gather(const std::string& directory);
+
+    // The snapshot as prompt text; history is the user's recent commands,
+    // oldest first (may be empty)
+    static std::string describe(const Snapshot& snapshot, const std::vector<std::string>& history);
+
+    // Entries listed by name; a larger directory is summarized by count
+    static constexpr size_t kMaxListed = 60;
+
+private:
+    struct Shared;                   // State shared with the worker thread
+    std::shared_ptr<Shared> shared_;
+};
+
+} // namespace helix
+
+#endif // HELIX_AI_CONTEXT_H
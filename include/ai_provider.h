@@ -1,7 +1,9 @@
 #ifndef HELIX_AI_PROVIDER_H
 #define HELIX_AI_PROVIDER_H
 
+#include <functional>
 #include <string>
+#include <string_view>
 
 namespace helix {
 
@@ -12,11 +14,31 @@ struct AiProvider {
     std::string base_url;
 };
 
+struct AiResponse {
+    std::string text;        // Whole reply (empty on failure)
+    std::string error;       // Why there is no reply
+    bool cancelled = false;  // Ctrl-C stopped it
+};
+
+// Called with each piece of the reply as it streams in
+using AiTextFn = std::function<void(std::string_view)>;
+
 // Detect provider from environment. Priority:
 //   HELIX_AI_PROVIDER (explicit) > first set key (auto) > ollama (local fallback)
-// Override model with HELIX_AI_MODEL.
+// Override model with HELIX_AI_MODEL and the endpoint with HELIX_AI_URL;
+// ollama's host comes from OLLAMA_HOST.
 AiProvider detectAiProvider();
 
+// Ask the provider, streaming the reply to on_text (may be empty) as it
+// arrives. Requests go through HttpClient::global(), so the connection to
+// a provider is reused by the next query. Ctrl-C cancels. Falls back to
+// curl when https is unavailable in-process or a proxy is configured
+AiResponse queryAiProvider(const AiProvider& provider,
+                           const std::string& system_prompt,
+                           const std::string& user_message,
+                           int max_tokens = 512,
+                           const AiTextFn& on_text = {});
+
 // Call the provider and return the plain-text response.
 // Returns empty string on failure.
 std::string callAiProvider(const AiProvider& provider,
@@ -0,0 +1,155 @@
+#ifndef HELIX_AST_H
+#define HELIX_AST_H
+
+#include "brace_sequence.h"
+#include "types.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace helix {
+
+// Script AST - compiled form of shell source produced by ScriptParser
+// Words are stored raw (quotes and $-constructs intact) so the Shell's
+// tree-walking evaluator only has to expand them on each execution; a loop
+// body is lexed and parsed once no matter how many times it runs.
+
+enum class NodeKind {
+    SIMPLE,        // name args... with assignments and redirections
+    PIPELINE,      // [!] cmd | cmd ...
+    AND_OR,        // pipeline && pipeline || ...
+    LIST,          // and-or lists separated by ; & or newlines
+    IF,            // if / elif / else / fi
+    LOOP,          // while / until
+    FOR,           // for NAME [in words], for ((init; cond; update))
+    CASE,          // case WORD in pattern) ... ;; esac
+    GROUP,         // { list; }
+    SUBSHELL,      // ( list )
+    FUNCTION_DEF,  // name() compound-command
+    COPROC         // coproc [NAME] command
+};
+
+struct AstNode {
+    explicit AstNode(NodeKind k) : kind(k) {}
+    virtual ~AstNode() = default;
+
+    NodeKind kind;
+
+    // Redirections attached to a compound command ("done < file"), raw words
+    std::unique_ptr<Command> redirects;
+};
+
+using AstNodePtr = std::unique_ptr<AstNode>;
+
+struct SimpleCommandNode : AstNode {
+    SimpleCommandNode() : AstNode(NodeKind::SIMPLE) {}
+    std::vector<std::string> assignments;  // Leading NAME=value words (raw)
+    Command command;                       // args and redirection targets (raw)
+    std::string text;                      // Source text, for jobs and traces
+};
+
+struct PipelineNode : AstNode {
+    PipelineNode() : AstNode(NodeKind::PIPELINE) {}
+    std::vector<AstNodePtr> stages;
+    bool negate = false;                   // Leading !
+    bool timed = false;                    // Leading `time`
+    bool time_posix = false;               // time -p: POSIX output format
+    bool time_stages = false;              // time -v: a usage line per stage too
+    std::string text;
+};
+
+struct AndOrNode : AstNode {
+    AndOrNode() : AstNode(NodeKind::AND_OR) {}
+    struct Link {
+        bool is_and;                       // && (true) or || (false)
+        AstNodePtr node;
+    };
+    AstNodePtr first;
+    std::vector<Link> rest;
+};
+
+struct ListNode : AstNode {
+    ListNode() : AstNode(NodeKind::LIST) {}
+    struct Item {
+        AstNodePtr node;
+        bool background = false;           // Terminated by &
+    };
+    std::vector<Item> items;
+};
+
+struct IfNode : AstNode {
+    IfNode() : AstNode(NodeKind::IF) {}
+    struct Clause {
+        AstNodePtr condition;
+        AstNodePtr body;
+    };
+    std::vector<Clause> clauses;           // if + elif clauses in order
+    AstNodePtr else_body;                  // May be null
+};
+
+struct LoopNode : AstNode {
+    LoopNode() : AstNode(NodeKind::LOOP) {}
+    bool until = false;
+    AstNodePtr condition;
+    AstNodePtr body;
+};
+
+struct ForNode : AstNode {
+    ForNode() : AstNode(NodeKind::FOR) {}
+    std::string variable;
+    bool has_in = false;                   // false: iterate over "$@"
+    std::vector<std::string> words;        // Raw words after "in", brace-expanded
+    std::string jobs;                      // Raw operand of `for -P N`; empty: sequential
+    AstNodePtr body;
+
+    // A word that is only a sequence between literal text ({1..1000000},
+    // f{001..100}.txt) is not expanded into words: its terms are made one
+    // iteration at a time. It stands just before words[index]
+    struct Range {
+        size_t index = 0;
+        std::string prefix;
+        BraceSequence sequence;
+        std::string suffix;
+    };
+    std::vector<Range> ranges;
+
+    // for ((init; condition; update)): raw arithmetic, each part may be
+    // empty (an empty condition is true); variable and words are unused
+    bool arithmetic = false;
+    std::string init;
+    std::string condition;
+    std::string update;
+};
+
+struct CaseNode : AstNode {
+    CaseNode() : AstNode(NodeKind::CASE) {}
+    struct Arm {
+        std::vector<std::string> patterns; // Raw patterns separated by |
+        AstNodePtr body;                   // May be null for an empty arm
+    };
+    std::string subject;                   // Raw word after "case"
+    std::vector<Arm> arms;
+};
+
+struct GroupNode : AstNode {
+    explicit GroupNode(NodeKind k) : AstNode(k) {}  // GROUP or SUBSHELL
+    AstNodePtr body;
+};
+
+struct FunctionDefNode : AstNode {
+    FunctionDefNode() : AstNode(NodeKind::FUNCTION_DEF) {}
+    std::string name;
+    std::shared_ptr<const AstNode> body;   // Handed to ShellFunction as-is
+    std::string body_text;                 // Source of the body command
+};
+
+struct CoprocNode : AstNode {
+    CoprocNode() : AstNode(NodeKind::COPROC) {}
+    std::string name = "COPROC";           // Array holding the descriptors
+    AstNodePtr body;                       // Simple or compound command
+    std::string text;                      // Source after `coproc`, for jobs
+};
+
+} // namespace helix
+
+#endif // HELIX_AST_H
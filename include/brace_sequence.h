@@ -0,0 +1,45 @@
+#ifndef HELIX_BRACE_SEQUENCE_H
+#define HELIX_BRACE_SEQUENCE_H
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace helix {
+
+// BraceSequence - A brace expansion sequence {x..y} or {x..y..step}
+// Responsibilities:
+// - Parse the text between the braces: integer endpoints (zero-padded to a
+//   common width when either is written with a leading zero, as in
+//   {01..10}) or single letters, and an optional step whose sign is ignored
+//   (the direction always runs from x to y, as in bash)
+// - Produce term k on demand, so a for loop over {1..1000000} holds one
+//   term at a time instead of a million strings
+// Terms are computed from the first one and the step; nothing is
+// allocated until a caller asks for a term or for the whole list.
+class BraceSequence {
+public:
+    // Parse inner ("1..10", "a..z..2", "001..100..5"); false when it is not
+    // a sequence, which brace expansion then leaves as literal text
+    static bool parse(std::string_view inner, BraceSequence& out);
+
+    size_t size() const { return count_; }
+
+    // Append term k (k < size()) to out
+    void append(size_t k, std::string& out) const;
+
+    // Every term, in order
+    std::vector<std::string> materialize() const;
+
+private:
+    bool letters_ = false;
+    long first_ = 0;
+    long step_ = 1;           // Signed: negative when counting down
+    size_t count_ = 0;
+    size_t width_ = 0;        // Zero-padded width; 0 when not padded
+};
+
+} // namespace helix
+
+#endif // HELIX_BRACE_SEQUENCE_H
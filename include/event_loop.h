@@ -0,0 +1,62 @@
+#ifndef HELIX_EVENT_LOOP_H
+#define HELIX_EVENT_LOOP_H
+
+#include <functional>
+#include <map>
+
+namespace helix {
+
+// EventLoop - What the REPL waits on while the user is typing
+// Responsibilities:
+// - Wait on several descriptors at once (epoll on Linux, poll() elsewhere)
+//   and call each one's handler when it becomes readable
+// - Turn signals into events: a handler calls wake(), which writes a byte
+//   to a self-pipe, and the loop runs the wake handlers outside the signal
+//   context (SIGCHLD becomes "a job may have finished", with no polling)
+// The loop's own descriptors are close-on-exec and kept at 10 or above, out
+// of the way of user redirections such as `exec 3>file`.
+class EventLoop {
+public:
+    using Handler = std::function<void()>;
+
+    // The loop shared by the whole shell process (created on first use)
+    static EventLoop& global();
+
+    EventLoop();
+    ~EventLoop();
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+
+    // Call on_readable whenever fd has input (or hangs up); a second watch
+    // of the same fd replaces its handler. Returns false if fd can't be waited on
+    bool watch(int fd, Handler on_readable);
+    void unwatch(int fd);
+
+    // Run on_wake after every wake(), in the order added; the returned
+    // token removes it again
+    int onWake(Handler on_wake);
+    void removeWake(int token);
+
+    // Async-signal-safe and thread-safe: make the loop's current (or next)
+    // wait return and run the wake handlers. A no-op before global() exists
+    static void wake();
+
+    // Wait up to timeout_ms (-1: no limit) and dispatch what is ready.
+    // A signal interrupting the wait counts as nothing ready. Returns false
+    // only if the wait itself failed
+    bool runOnce(int timeout_ms);
+
+private:
+    void drainWakePipe();
+
+    int poll_fd_ = -1;                 // epoll instance (Linux only)
+    int wake_pipe_[2] = {-1, -1};
+    std::map<int, Handler> watched_;
+    std::map<int, Handler> wake_handlers_;
+    int next_token_ = 1;
+};
+
+} // namespace helix
+
+#endif // HELIX_EVENT_LOOP_H
@@ -6,6 +6,7 @@
 #include <string>
 #include <vector>
 #include <memory>
+#include <functional>
 
 namespace helix {
 
@@ -16,17 +17,21 @@ namespace helix {
 // - IEnvironmentExpander for variable substitution
 // - IFileDescriptorManager for FD redirections
 // - IPipelineManager for multi-command pipelines
+// - IProcessSpawner for starting programs without fork() where possible
 class Executor {
 public:
     // Constructor with default implementations (can be swapped for testing)
     Executor();
 
     // Constructor with dependency injection (for testing/flexibility)
+    // Without a spawner every command is forked, so the injected fd manager
+    // sees all redirections
     Executor(
         std::unique_ptr<IExecutableResolver> resolver,
         std::unique_ptr<IEnvironmentExpander> expander,
         std::unique_ptr<IFileDescriptorManager> fd_mgr,
-        std::unique_ptr<IPipelineManager> pipe_mgr);
+        std::unique_ptr<IPipelineManager> pipe_mgr,
+        std::unique_ptr<IProcessSpawner> spawner = nullptr);
 
     ~Executor();
 
@@ -34,17 +39,67 @@ public:
     // Returns exit status or error information
     int execute(const ParsedCommand& cmd);
 
+    // Pipeline stages the shell evaluates itself (builtins, functions,
+    // compound commands): forked like any stage, but never exec'd
+    struct ShellStages {
+        std::vector<bool> in_shell;          // Per stage: run through run() instead of exec
+        // Evaluate stage i in the forked child and _exit; owns its redirections
+        std::function<void(size_t)> run;
+        // If set, the last stage runs in the calling process instead, with
+        // stdin on the pipe (lastpipe); returns its status
+        std::function<int()> last;
+    };
+
+    // Execute a pipeline in which some stages are shell code
+    int execute(const ParsedCommand& cmd, const ShellStages& stages);
+
+    // Replace the calling process with cmd (exec elision for the shell's
+    // last command): redirections are applied here and the program is
+    // exec'd without a fork. Returns false, with nothing changed, when cmd
+    // cannot be run that way (argv still to be expanded, program not on
+    // PATH); once started it does not return; a failed redirection or
+    // exec ends the process with status 1, as it would end the child
+    bool execInPlace(const Command& cmd);
+
     // Get the PID of the last background job (if any)
     // Returns 0 if no background job was started
     pid_t getLastBackgroundPid() const { return last_background_pid; }
 
+    // Every process of the last background job, in pipeline order
+    // (the first one leads the job's process group)
+    const std::vector<pid_t>& getLastBackgroundPids() const { return last_background_pids; }
+
+    // Exit status of each stage of the last foreground command (PIPESTATUS)
+    const std::vector<int>& getLastPipeStatus() const { return last_pipe_status; }
+
+    // Resources each of those stages used, in the same order
+    const std::vector<ResourceUsage>& getLastPipeUsage() const { return last_pipe_usage; }
+
 private:
     // Execute a single command (may be part of a pipeline)
     // If background=true, doesn't wait for process and returns 0
     int executeSingleCommand(const Command& cmd, int input_fd = -1, int output_fd = -1, bool background = false);
 
     // Execute command directly in child process (no fork, for pipelines)
-    void executeCommandInChild(const Command& cmd);
+    // resolved: executable path looked up by the parent, or empty to resolve here
+    void executeCommandInChild(const Command& cmd, const std::string& resolved = "");
+
+    // Start cmd through the spawner when its argv is already final
+    // Returns the child's pid, or -1 if it has to be forked instead
+    // process_group: -1 the shell's, 0 a new group, >0 join that group
+    pid_t trySpawn(const Command& cmd, const std::string& resolved,
+                   int input_fd, int output_fd, pid_t process_group);
+
+    // Look up cmd.args[0] before fork() when it needs no expansion
+    // Returns empty string if the child has to resolve it
+    std::string resolveInParent(const Command& cmd) const;
+
+    // Start every stage of a pipeline without waiting; shell stages are
+    // forked and handed to stages.run, the rest spawned or exec'd
+    PipelineLaunch startStages(const ParsedCommand& cmd, const ShellStages& stages, bool own_group);
+
+    // lastpipe: start stages 0..n-2 writing into a pipe, run the last here
+    int executeWithLastStageHere(const ParsedCommand& cmd, const ShellStages& stages);
 
     // Convert command args to C-style array for exec
     std::vector<char*> buildArgv(const std::vector<std::string>& args);
@@ -57,9 +112,14 @@ private:
     std::unique_ptr<IEnvironmentExpander> env_expander;
     std::unique_ptr<IFileDescriptorManager> fd_manager;
     std::unique_ptr<IPipelineManager> pipeline_manager;
+    std::unique_ptr<IProcessSpawner> process_spawner;  // May be null: always fork
 
     // Track last background job PID
     pid_t last_background_pid = 0;
+    std::vector<pid_t> last_background_pids;
+    std::vector<int> last_pipe_status;
+    std::vector<ResourceUsage> last_pipe_usage;
+    ResourceUsage last_usage;   // Of the last command executeSingleCommand() waited for
 };
 
 } // namespace helix
@@ -0,0 +1,79 @@
+#ifndef HELIX_ARITHMETIC_H
+#define HELIX_ARITHMETIC_H
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace helix {
+
+struct ShellState;
+
+// ArithmeticEngine - Compiled shell arithmetic for $(( )), let and declare -i
+// Responsibilities:
+// - Compile an expression once into postfix bytecode for a small stack
+//   machine and cache it by its text, so a loop re-evaluating `$((i + 1))`
+//   neither re-lexes nor re-parses it
+// - Bind each variable reference to its VariableStore entry; a binding is
+//   re-resolved only after some variable has been removed
+// - Read $name, $1, $#, $? and bare names while running, so the text (and
+//   the cache key) stays the same between evaluations
+// - Implement bash's C operators with bash precedence: assignment and
+//   compound assignment, ++/--, ?:, short-circuit && and ||, ** and the
+//   bitwise, shift and comparison operators, in wrapping 64-bit arithmetic
+// Text holding $(...), `...` or ${...} with a modifier, and $name whose
+// value is not a plain integer, is expanded as a word first (bash pastes
+// such values in as text) and evaluated without being cached.
+class ArithmeticEngine {
+public:
+    struct Stats {
+        unsigned long compiled = 0;  // Expressions parsed
+        unsigned long hits = 0;      // Evaluations that reused a cached program
+    };
+
+    // The engine shared by the whole shell process
+    static ArithmeticEngine& global();
+
+    ~ArithmeticEngine();
+
+    // Evaluate expr into result. state supplies positional and special
+    // parameters and the readonly set, and may be null. On a syntax or
+    // runtime error (division by 0, readonly target) the message goes to
+    // stderr, result is 0 and false is returned
+    bool evaluate(std::string_view expr, const ShellState* state, long& result);
+
+    // Drop every cached program
+    void clear();
+
+    Stats stats() const { return stats_; }
+
+private:
+    struct Program;
+    enum class Outcome { Value, Error, Textual };
+
+    ArithmeticEngine() = default;
+
+    // Cached program for text, compiling it on a miss
+    const Program& program(std::string_view text);
+
+    bool evaluateAt(std::string_view expr, const ShellState* state, long& result, int depth);
+    Outcome run(const Program& prog, const ShellState* state, long& result, int depth);
+
+    // Arithmetic value of a variable: its integer, or its text evaluated
+    bool valueOf(const std::string& text, const ShellState* state, long& out, int depth);
+
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    std::unordered_map<std::string, std::unique_ptr<Program>, Hash, std::equal_to<>> programs_;
+    int running_ = 0;                // Nesting depth of run(); the cache is not flushed under it
+    Stats stats_;
+};
+
+} // namespace helix
+
+#endif // HELIX_ARITHMETIC_H
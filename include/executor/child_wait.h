@@ -0,0 +1,30 @@
+#ifndef HELIX_CHILD_WAIT_H
+#define HELIX_CHILD_WAIT_H
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+namespace helix {
+
+// Foreground waits
+// The shell holds SIGCHLD while it waits for a foreground command, so the
+// handler's wait4(-1) cannot take the command's processes. Background jobs
+// still exit during that time: waitForeground() wakes on each SIGCHLD and
+// lets the installed reaper collect the job table's own members then, so
+// `jobs -v` dates their exits when they happened, not when the foreground
+// command finished. The signals it consumed are raised again on return and
+// the handler sweeps up anything else once SIGCHLD is let through
+
+// Called on each SIGCHLD during a foreground wait; must only collect
+// specific pids (never wait4(-1)). nullptr: plain blocking waits
+using BackgroundReaper = void (*)();
+void setBackgroundReaper(BackgroundReaper reaper);
+
+// wait4(pid, status, options, usage), retrying EINTR
+// Without a reaper, or with SIGCHLD not held by the caller, this is the
+// blocking wait4() itself
+pid_t waitForeground(pid_t pid, int* status, int options, struct rusage* usage);
+
+} // namespace helix
+
+#endif // HELIX_CHILD_WAIT_H
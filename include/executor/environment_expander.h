@@ -3,11 +3,14 @@
 
 #include "executor/interfaces.h"
 #include <string>
+#include <string_view>
+#include <vector>
 #include <pwd.h>
 
 namespace helix {
 
 struct ShellState;
+struct ShellArray;
 
 class EnvironmentVariableExpander : public IEnvironmentExpander {
 public:
@@ -17,7 +20,84 @@ public:
     std::string expand(const std::string& input) const override;
     std::string expandWithState(const std::string& input, const ShellState* state) const;
 
+    // Expand one raw (still-quoted) shell word the way the script evaluator
+    // needs it: tilde, parameter/command/arithmetic/process substitution,
+    // quote removal, IFS field splitting of unquoted results, "$@" and pathname
+    // expansion (skipped under set -f). May return zero or many fields.
+    std::vector<std::string> expandWord(const std::string& word, const ShellState* state) const;
+
+    // expandWord() appending the fields to out (an argv being built)
+    void expandWordInto(const std::string& word, const ShellState* state,
+                        std::vector<std::string>& out) const {
+        expandWordInto(word, state, WordMode::FIELDS, out);
+    }
+
+    // Same expansions without field splitting or globbing - always one
+    // string (assignment values, redirection targets, case subjects)
+    std::string expandString(const std::string& word, const ShellState* state) const;
+
+    // Expansion for pattern contexts (case arms): quoted glob characters
+    // come back backslash-escaped so fnmatch() matches them literally
+    std::string expandPattern(const std::string& word, const ShellState* state) const;
+
+    // True if expandPattern() would return word unchanged (no quotes,
+    // escapes, tilde or substitutions), so it can be used as it stands
+    static bool isPlainPattern(std::string_view word) {
+        return word.find_first_of("~'\"\\$`") == std::string_view::npos;
+    }
+
+    // Variables computed from the shell state rather than stored: PIPESTATUS
+    // and the per-stage HELIX_PIPE_REAL/USER/SYS/RSS lists
+    static bool isStateList(std::string_view name);
+
+    // Fill array name from the text between the parentheses of a compound
+    // assignment, a=(one "two three" [5]=six): items are expanded as words,
+    // [key]=value items go to their key, and an associative array pairs
+    // plain items up as key and value. append (a+=(...)) keeps the existing
+    // elements. A new variable is associative if asked; an existing array
+    // keeps its kind. false, after a message, on a bad subscript
+    bool assignArray(const std::string& name, std::string_view list, bool append,
+                     bool associative, const ShellState* state) const;
+
+    // name[subscript]=value (or +=); subscript is unexpanded text. A scalar
+    // or unset name becomes an indexed array
+    bool assignElement(const std::string& name, std::string_view subscript, std::string value,
+                       bool append, const ShellState* state) const;
+
+    // unset name[subscript]
+    bool unsetElement(const std::string& name, std::string_view subscript, const ShellState* state) const;
+
+    // Indexed array subscript: arithmetic, a negative value counting back
+    // from end; false (after a message) on an error
+    static bool arrayIndex(std::string_view subscript, size_t end, const ShellState* state, size_t& index);
+
 private:
+    enum class WordMode { FIELDS, STRING, PATTERN };
+
+    // What an array reference ${a[...]} expanded to
+    enum class ArrayRef {
+        None,       // Not one: no subscript
+        Single,     // One value: ${a[i]}, ${#a[@]}, ${#a[i]}
+        AtList,     // ${a[@]}, ${!a[@]}: one field per element when quoted
+        StarList,   // ${a[*]}, ${!a[*]}: joined with the first IFS character
+    };
+
+    // Expand ${inner} if it refers to an array element or list, into values
+    ArrayRef expandArrayRef(std::string_view inner, const ShellState* state, std::vector<std::string>& values) const;
+    const std::string* element(const ShellArray& array, std::string_view subscript, const ShellState* state) const;
+    // ${a[@]:offset[:length]}: bounds is "offset[:length]"
+    void sliceElements(const ShellArray& array, std::string_view inner, std::string_view bounds,
+                       const ShellState* state, std::vector<std::string>& values) const;
+    static std::string joinElements(const std::vector<std::string>& values, ArrayRef ref);
+
+    // The items of state list name (see isStateList)
+    static std::vector<std::string> stateList(std::string_view name, const ShellState& state);
+    void expandWordInto(const std::string& word, const ShellState* state,
+                        WordMode mode, std::vector<std::string>& out) const;
+
+    // Expand the $-construct at input[i] and advance i past it
+    std::string expandDollar(const std::string& input, size_t& i, const ShellState* state) const;
+
     std::string getVariableValue(const std::string& name) const;
     std::string getVariableValueWithState(const std::string& name, const ShellState* state) const;
 };
@@ -12,9 +12,12 @@ namespace helix {
 // - Search for executables in PATH directories
 // - Validate file permissions and executability
 // - Handle absolute and relative paths
+// - Memoize PATH lookups through the shared PathCache
 class ExecutableResolver : public IExecutableResolver {
 public:
-    ExecutableResolver() = default;
+    // record_hits: count lookups in `hash -l` (the executor does, queries
+    // such as type/which do not)
+    explicit ExecutableResolver(bool record_hits = true) : record_hits_(record_hits) {}
     ~ExecutableResolver() override = default;
 
     // Find executable by searching PATH or validating direct path
@@ -22,11 +25,7 @@ public:
     std::string findExecutable(const std::string& command) const override;
 
 private:
-    // Check if a file is a regular executable
-    bool isExecutable(const std::string& path) const;
-
-    // Search for command in PATH environment variable
-    std::string searchInPath(const std::string& command) const;
+    bool record_hits_;
 };
 
 } // namespace helix
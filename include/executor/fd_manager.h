@@ -10,7 +10,7 @@ namespace helix {
 // Implements IFileDescriptorManager interface (Dependency Inversion Principle)
 // Responsibilities:
 // - Save and restore original file descriptors
-// - Setup input/output/error redirections for commands
+// - Setup input/output/error redirections for commands, in source order
 // - Handle file opening with appropriate flags (append, truncate, etc.)
 class FileDescriptorManager : public IFileDescriptorManager {
 public:
@@ -32,10 +32,17 @@ public:
     void restoreFileDescriptors() override;
 
 private:
-    // Setup individual redirection types
-    bool setupInputRedirection(const Command& cmd, int& input_fd);
-    bool setupOutputRedirection(const Command& cmd, int& output_fd);
-    bool setupErrorRedirection(const Command& cmd);
+    // Open path and move it onto target; what names the stream in errors
+    bool redirectFile(const std::string& path, int flags, int target, const char* what);
+
+    // Make target a copy of the descriptor source names (>&N, <&N)
+    bool duplicateFd(const std::string& source, int target);
+
+    // Replace stdin with a descriptor that reads back content
+    // (here-doc/here-string); see openInputFd()
+    bool feedStdin(const std::string& content);
+
+    static int writeFlags(bool append);
 
     // Original file descriptors for restoration
     int original_stdin;
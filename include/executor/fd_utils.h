@@ -0,0 +1,73 @@
+#ifndef HELIX_FD_UTILS_H
+#define HELIX_FD_UTILS_H
+
+#include <cstddef>
+#include <string_view>
+
+namespace helix {
+
+// Descriptor hygiene shared by the executor components and the shell
+// Every descriptor the shell opens for its own use is close-on-exec from
+// birth, so nothing leaks into programs it runs; markInheritedFdsCloexec()
+// is the backstop for descriptors created by libraries (readline, streams)
+
+// pipe() whose ends are both close-on-exec (pipe2 where available)
+// Returns false with errno set on failure
+bool makeCloexecPipe(int fds[2]);
+
+// Flag every descriptor >= first as close-on-exec, just before an exec
+// Uses close_range(CLOSE_RANGE_CLOEXEC) when the kernel has it, otherwise
+// walks /proc/self/fd (/dev/fd on macOS); unlike a fixed 3..1024 loop this
+// also covers descriptors above 1024 when `ulimit -n` is raised
+// Inherited shareFd() descriptors are the exception: they stay open
+void markInheritedFdsCloexec(int first = 3);
+
+// Descriptors above 2 that belong to the script rather than the shell: the
+// ends of process substitution pipes and coprocesses. Only these (and 0-2)
+// can be named by >&N and <&N; the shell's private descriptors cannot.
+// inherited: programs are meant to keep it across exec (a process
+// substitution's /dev/fd/N, which the program opens itself), so FD_CLOEXEC
+// is cleared and ProcessSpawner leaves commands to the fork path while any
+// such descriptor exists (its closefrom() would close them)
+void shareFd(int fd, bool inherited = true);
+// Close a shared descriptor and forget it
+void closeSharedFd(int fd);
+// Close every shared descriptor (a forked helper drops the others' ends)
+void closeSharedFds();
+bool isSharedFd(int fd);
+bool hasInheritedFds();
+
+// Write all of content, retrying short writes and EINTR
+bool writeAll(int fd, std::string_view content);
+
+// Seekable, already-unlinked, close-on-exec file: a memfd on Linux, else a
+// file in $TMPDIR. Returns -1 with errno set on failure
+int openAnonymousFile();
+
+// Bodies up to this size fit in any pipe buffer, so writing them never blocks
+constexpr size_t kInlineInputMax = 4096;
+
+// Close-on-exec descriptor that reads back content from the start, for
+// here-docs and here-strings. Small bodies go into a preloaded pipe; larger
+// ones into an anonymous memfd (Linux) or an unlinked file in $TMPDIR, so
+// the size is never limited by pipe capacity and nobody has to keep writing
+// while the reader runs
+// Returns -1 with errno set on failure
+int openInputFd(std::string_view content);
+
+// Grow the pipe behind fd to at least bytes (F_SETPIPE_SZ on Linux; the
+// kernel caps it at /proc/sys/fs/pipe-max-size and per-user quotas). A pipe
+// is never shrunk. Best effort: false when it was left as it was
+bool setPipeSize(int fd, int bytes);
+
+// The descriptor a >&N or <&N redirection names: decimal digits only.
+// -1 for anything else
+int parseFdNumber(std::string_view text);
+
+// A pipe size as $HELIX_PIPE_SIZE spells it: bytes, or with a K or M
+// suffix ("1M"). 0 when text is empty or not a size
+int parsePipeSize(std::string_view text);
+
+} // namespace helix
+
+#endif // HELIX_FD_UTILS_H
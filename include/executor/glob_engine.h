@@ -0,0 +1,87 @@
+#ifndef HELIX_GLOB_ENGINE_H
+#define HELIX_GLOB_ENGINE_H
+
+#include <cstddef>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <sys/types.h>
+
+namespace helix {
+
+// GlobEngine - Process-wide pathname expansion with a directory-listing cache
+// Replaces libc glob() for word expansion, in the shell process itself.
+// Responsibilities:
+// - Match a pattern one path component at a time: literal components are
+//   looked up in the parent's listing, wildcard ones matched against it by
+//   a compiled Pattern
+// - Keep each directory's sorted listing (name + d_type) keyed by the
+//   directory's device/inode and revalidate it with a single stat() (mtime),
+//   so repeating a pattern does not re-read unchanged directories
+// - Expand `**` (a whole component) to every directory below, walking large
+//   trees with a pool of work-stealing threads; hidden and symlinked
+//   directories are not entered
+// - Return results sorted (byte order, as in the C locale) without stat'ing
+//   matched entries, honouring `*/` (directories only)
+// A directory modified within the last second is not trusted from the cache:
+// its mtime may not have ticked yet for a change made right after the read.
+class GlobEngine {
+public:
+    struct Stats {
+        unsigned long hits = 0;      // Listings served from the cache
+        unsigned long reads = 0;     // Directories read with readdir()
+    };
+
+    // The engine shared by the whole shell process
+    static GlobEngine& global();
+
+    // Append the paths matching pattern to out, sorted
+    // Backslash escapes a metacharacter; a leading '.' must be matched
+    // explicitly. Returns false (out untouched) when nothing matches
+    bool expand(std::string_view pattern, std::vector<std::string>& out);
+
+    // True if word contains an unescaped *, ? or [
+    static bool hasMeta(std::string_view word);
+
+    // Drop every cached listing
+    void clear();
+
+    Stats stats() const;
+
+private:
+    struct Entry {
+        std::string name;
+        unsigned char type;          // DT_* from readdir (DT_UNKNOWN if not provided)
+    };
+    struct Listing {
+        struct timespec mtime {};
+        bool trusted = false;        // Old enough to be reused on an equal mtime
+        std::vector<Entry> entries;  // Sorted by name, without "." and ".."
+    };
+    using ListingPtr = std::shared_ptr<const Listing>;
+
+    GlobEngine() = default;
+
+    // Listing of dir ("" is the current directory), or nullptr if unreadable
+    ListingPtr listing(const std::string& dir);
+
+    // Is entry (found in dir) a directory? follow: resolve symlinks
+    static bool isDirectory(const std::string& path, const Entry& entry, bool follow);
+
+    // Every directory at or below each root, for `**`
+    std::vector<std::string> walk(const std::vector<std::string>& roots);
+
+    mutable std::mutex mutex_;       // Guards the members below (walker threads)
+    std::map<std::pair<dev_t, ino_t>, ListingPtr> listings_;
+    size_t cached_names_ = 0;        // Total entries held, to bound memory
+    Stats stats_;
+};
+
+} // namespace helix
+
+#endif // HELIX_GLOB_ENGINE_H
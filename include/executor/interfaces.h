@@ -4,6 +4,7 @@
 #include "types.h"
 #include <string>
 #include <vector>
+#include <chrono>
 #include <functional>
 #include <utility>
 #include <sys/types.h>
@@ -68,6 +69,16 @@ public:
     virtual void restoreFileDescriptors() = 0;
 };
 
+/**
+ * PipelineLaunch - Processes started for one pipeline
+ */
+struct PipelineLaunch {
+    pid_t pgid = -1;              // Own process group, or -1 (shell's group)
+    std::vector<pid_t> pids;      // One per stage, in pipeline order
+    std::chrono::steady_clock::time_point started;  // Before the first stage
+    bool ok() const { return !pids.empty(); }
+};
+
 /**
  * IPipelineManager - Interface for pipeline execution
  * Abstracts multi-command pipeline coordination
@@ -85,6 +96,92 @@ public:
     virtual int executePipeline(
         const ParsedCommand& cmd,
         std::function<void(const Command&)> executor_func) = 0;
+
+    /**
+     * Starts one stage without forking the shell
+     * Receives the stage, the pipe ends for stdin/stdout (-1 when not piped)
+     * and the process group to join (-1 none, 0 new); returns the child's
+     * pid, or -1 to fork instead
+     */
+    using StageSpawner = std::function<pid_t(const Command&, int, int, pid_t)>;
+
+    /**
+     * Start every stage of a pipeline without waiting for any of them
+     * @param cmd Parsed command with pipeline
+     * @param executor_func Function to execute a stage in a forked child
+     * @param spawn_func Fast path tried before fork() for each stage (may be empty)
+     * @param own_group Put the stages in a new process group led by the first
+     * @return Started processes; empty pids on failure
+     */
+    virtual PipelineLaunch startPipeline(
+        const ParsedCommand& cmd,
+        std::function<void(const Command&)> executor_func,
+        StageSpawner spawn_func,
+        bool own_group) = 0;
+
+    /**
+     * Reap every stage of a started pipeline, in whatever order they exit
+     * @param launch Processes returned by startPipeline
+     * @param stage_status Output: exit status of each stage (PIPESTATUS)
+     * @param stage_usage Output: resources each stage used, from wait4()
+     * @return Exit status of last command
+     */
+    virtual int waitForPipeline(const PipelineLaunch& launch, std::vector<int>& stage_status,
+                                std::vector<ResourceUsage>& stage_usage) = 0;
+};
+
+/**
+ * IProcessSpawner - Interface for starting external programs
+ * Abstracts posix_spawn()-style process creation that avoids copying the
+ * shell's address space the way fork() does
+ */
+class IProcessSpawner {
+public:
+    virtual ~IProcessSpawner() = default;
+
+    /**
+     * Start a program with the command's redirections applied
+     * @param path Resolved executable path
+     * @param args Final argv (args[0] is passed through as the program name)
+     * @param cmd Command whose redirections are applied in the child
+     * @param input_fd Pipe read end for stdin, or -1
+     * @param output_fd Pipe write end for stdout, or -1
+     * @param process_group Group to join: -1 the shell's, 0 a new one led
+     *        by the child, or an existing pipeline's pgid
+     * @return Child pid, or -1 when the caller has to fall back to fork()
+     */
+    virtual pid_t spawn(const std::string& path, const std::vector<std::string>& args,
+                        const Command& cmd, int input_fd, int output_fd,
+                        pid_t process_group) = 0;
+};
+
+/**
+ * ICommandSubstitution - Interface for running $(...), `...`, <(...) and
+ * >(...) bodies
+ * Lets the expander hand substitutions back to the shell that owns
+ * functions, aliases and builtins instead of starting /bin/sh
+ */
+class ICommandSubstitution {
+public:
+    virtual ~ICommandSubstitution() = default;
+
+    /**
+     * Run shell source and capture its standard output
+     * @param source Text between the substitution delimiters
+     * @return Output with trailing newlines removed
+     */
+    virtual std::string capture(const std::string& source) = 0;
+
+    /**
+     * Start shell source on a pipe for process substitution, running
+     * alongside the command the word belongs to
+     * @param source Text between <( or >( and the closing parenthesis
+     * @param output true for >(...): the source reads what the command
+     *        writes; false for <(...): the command reads the source's output
+     * @return /dev/fd/N naming the command's end of the pipe, or an empty
+     *         string when the process could not be started
+     */
+    virtual std::string substituteProcess(const std::string& source, bool output) = 0;
 };
 
 } // namespace helix
@@ -0,0 +1,92 @@
+#ifndef HELIX_PATH_CACHE_H
+#define HELIX_PATH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <ctime>
+
+namespace helix {
+
+// PathCache - Process-wide memo of command name -> executable path
+// Shared by the executor, `hash`, `type`/`which`/`command` and completion so
+// a PATH walk happens once per command rather than once per exec.
+// Responsibilities:
+// - Keep the split PATH directory list, re-parsed only when PATH changes
+// - Remember resolved paths keyed by name (the whole cache is tied to the
+//   PATH value it was built from and is dropped when that value changes)
+// - Revalidate an entry with a single stat() of its directory (mtime) instead
+//   of re-walking every PATH entry
+// - Record real hit counts for `hash -l`
+// - List each PATH directory's executables once for tab completion,
+//   re-reading a directory only when its mtime changes
+class PathCache {
+public:
+    struct Entry {
+        std::string path;        // Full path to the executable
+        std::string dir;         // PATH directory it was found in
+        struct timespec dir_mtime {};
+        unsigned long hits = 0;  // Times the executor resolved it from the cache
+    };
+
+    // The cache instance shared by the whole shell process
+    static PathCache& global();
+
+    // Resolve a bare command name through PATH, consulting and filling the cache
+    // record_hit: bump the hit counter (executor) or not (type/which/hash)
+    // Returns full path, or empty string if not found
+    std::string lookup(const std::string& name, bool record_hit = true);
+
+    // Cached path for name without searching PATH (nullptr if not cached)
+    const Entry* find(const std::string& name);
+
+    // Drop one entry (hash -d) or everything (hash -r, PATH assignment)
+    void forget(const std::string& name);
+    void clear();
+
+    // Snapshot of the cache sorted by command name (for `hash` listing)
+    std::vector<std::pair<std::string, Entry>> entries();
+
+    // PATH split into directories (empty components mean ".")
+    const std::vector<std::string>& directories();
+
+    // Every executable name found on PATH, sorted and unique
+    // Costs one stat() per PATH directory when nothing changed
+    const std::vector<std::string>& commandNames();
+
+    // True if path names a regular file with an execute bit set
+    static bool isExecutable(const std::string& path);
+
+private:
+    PathCache() = default;
+
+    // Re-read PATH and invalidate everything if it changed
+    void syncPath();
+
+    // True if the directory's mtime still matches the one recorded in entry
+    static bool stillValid(const Entry& entry);
+
+    // Executables in one directory, as of its mtime when it was read
+    struct Listing {
+        bool valid = false;
+        struct timespec mtime {};
+        std::vector<std::string> names;
+    };
+
+    // Re-read dir into listing if its mtime moved; returns true if it changed
+    static bool refreshListing(const std::string& dir, Listing& listing);
+
+    bool have_path_ = false;
+    std::string path_value_;
+    std::vector<std::string> dirs_;
+    std::unordered_map<std::string, Entry> entries_;
+
+    // Kept across PATH changes: a directory's contents do not depend on PATH
+    std::unordered_map<std::string, Listing> listings_;
+    std::vector<std::string> command_names_;
+    bool names_stale_ = true;   // PATH changed since command_names_ was merged
+};
+
+} // namespace helix
+
+#endif // HELIX_PATH_CACHE_H
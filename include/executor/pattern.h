@@ -0,0 +1,123 @@
+#ifndef HELIX_PATTERN_H
+#define HELIX_PATTERN_H
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace helix {
+
+// Pattern - One shell glob pattern, compiled
+// Responsibilities:
+// - Parse `*`, `?`, `[...]` (ranges, `!`/`^` negation, [:class:]) and
+//   backslash escapes once, into the runs of fixed-width atoms between stars
+// - Match a whole string as fnmatch() does in the C locale (flags 0 or
+//   FNM_PERIOD), without backtracking: the first run is anchored at the
+//   start, the last at the end, and each one between is taken leftmost
+// - Recognise the common shapes - `lit`, `lit*`, `*lit`, `*lit*` and `*` -
+//   and answer them with one compare or one substring search
+// - Find the shortest or longest matching prefix or suffix, for ${v#p},
+//   ${v##p}, ${v%p} and ${v%%p}
+class Pattern {
+public:
+    enum Flags : unsigned {
+        kNone = 0,
+        kPeriod = 1,   // A leading '.' only matches a literal '.' (FNM_PERIOD)
+    };
+
+    explicit Pattern(std::string_view text, unsigned flags = kNone);
+
+    bool matches(std::string_view s) const;
+
+    // Length of the shortest (or longest) prefix of s that matches, or npos
+    size_t matchPrefix(std::string_view s, bool longest) const;
+
+    // Start of the shortest (or longest) suffix of s that matches, or npos
+    size_t matchSuffix(std::string_view s, bool longest) const;
+
+    // No wildcards: the pattern only matches its unescaped text
+    bool isLiteral() const { return shape_ == Shape::Literal; }
+
+private:
+    enum class Shape { Literal, Prefix, Suffix, Contains, Anything, General };
+
+    struct Atom {
+        enum Type : uint8_t { Char, Any, Set } type;
+        unsigned char c = 0;       // Char
+        uint16_t set = 0;          // Set: index into sets_
+    };
+    // Atoms between two stars; plain runs (literal characters only) keep
+    // their text for memcmp()/find()
+    struct Run {
+        std::vector<Atom> atoms;
+        std::string text;
+        bool plain = true;
+    };
+
+    // Parse a bracket expression at text[i] == '['; false if unterminated
+    bool parseSet(std::string_view text, size_t& i);
+
+    bool matchAt(const Run& run, std::string_view s, size_t pos) const;
+    size_t find(const Run& run, std::string_view s, size_t begin, size_t end) const;
+    bool matchGeneral(std::string_view s) const;
+
+    Shape shape_ = Shape::General;
+    std::vector<Run> runs_;
+    std::vector<std::bitset<256>> sets_;
+    bool leading_star_ = false;
+    bool trailing_star_ = false;
+    bool period_ = false;          // kPeriod was given
+    bool starts_with_dot_ = false; // First atom is a literal '.'
+    size_t min_length_ = 0;        // Atoms outside the stars
+};
+
+// PatternMatcher - Process-wide cache of compiled patterns
+// Responsibilities:
+// - Compile each pattern text once and keep it (up to a bound), so a `case`
+//   arm or a parameter trim in a loop is a hash lookup plus the match
+// - Back `case`, `[[ == ]]`, ${v#p} and friends, and GlobEngine's
+//   wildcard components, so they all agree on what a pattern means
+// Used from the main thread only, like ArithmeticEngine.
+class PatternMatcher {
+public:
+    struct Stats {
+        unsigned long compiled = 0;  // Patterns parsed
+        unsigned long hits = 0;      // Lookups served from the cache
+    };
+
+    // The matcher shared by the whole shell process
+    static PatternMatcher& global();
+
+    // The compiled form of text; valid until the next compile() call
+    const Pattern& compile(std::string_view text, unsigned flags = Pattern::kNone);
+
+    bool matches(std::string_view pattern, std::string_view s, unsigned flags = Pattern::kNone) {
+        return compile(pattern, flags).matches(s);
+    }
+
+    // Drop every compiled pattern
+    void clear();
+
+    Stats stats() const { return stats_; }
+
+private:
+    PatternMatcher() = default;
+
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    using Map = std::unordered_map<std::string, std::unique_ptr<Pattern>, Hash, std::equal_to<>>;
+    Map patterns_[2];                // By flags: kNone, kPeriod
+    Stats stats_;
+};
+
+} // namespace helix
+
+#endif // HELIX_PATTERN_H
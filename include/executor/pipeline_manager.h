@@ -14,9 +14,11 @@ namespace helix {
 // Implements IPipelineManager interface (Dependency Inversion Principle)
 // Responsibilities:
 // - Create pipes between commands
-// - Fork processes for each command in pipeline
+// - Start each command, spawning when possible and forking otherwise
 // - Setup proper pipe connections
-// - Wait for all pipeline processes to complete
+// - Optionally place the stages in their own process group (background jobs)
+// - Reap the stages in completion order with wait4(), recording each
+//   status (PIPESTATUS) and resource usage
 // - Return exit status of last command
 class PipelineManager : public IPipelineManager {
 public:
@@ -30,6 +32,19 @@ public:
         const ParsedCommand& cmd,
         std::function<void(const Command&)> executor_func) override;
 
+    // Start all stages, spawning through spawn_func where it accepts and
+    // forking otherwise; with own_group they share a new process group
+    PipelineLaunch startPipeline(
+        const ParsedCommand& cmd,
+        std::function<void(const Command&)> executor_func,
+        StageSpawner spawn_func,
+        bool own_group) override;
+
+    // Reap all stages in completion order and record each one's status
+    // and usage. Returns exit status of last command
+    int waitForPipeline(const PipelineLaunch& launch, std::vector<int>& stage_status,
+                        std::vector<ResourceUsage>& stage_usage) override;
+
 private:
     // Create pipes for pipeline
     std::vector<std::pair<int, int>> createPipes(size_t count);
@@ -37,8 +52,9 @@ private:
     // Clean up all pipes
     void cleanupPipes(std::vector<std::pair<int, int>>& pipes);
 
-    // Wait for all child processes and return exit status of last command
-    int waitForPipeline(const std::vector<pid_t>& pids);
+    // Reap whichever unreaped stage finishes next (shell's process group)
+    pid_t waitAnyOf(const std::vector<pid_t>& pids,
+                    const std::vector<int>& stage_status, int& status, struct rusage& usage);
 };
 
 } // namespace helix
@@ -0,0 +1,44 @@
+#ifndef HELIX_PROCESS_SPAWNER_H
+#define HELIX_PROCESS_SPAWNER_H
+
+#include "executor/interfaces.h"
+#include "types.h"
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+namespace helix {
+
+// ProcessSpawner - Starts external programs with posix_spawn()
+// Implements IProcessSpawner interface (Dependency Inversion Principle)
+// Responsibilities:
+// - Translate a Command's redirections into posix_spawn file actions, in the
+//   same order FileDescriptorManager applies them
+// - Open redirection targets in the parent (close-on-exec) so failures are
+//   detected before anything is started; here-doc bodies of any size are
+//   staged there too (openInputFd)
+// - Keep the shell's own descriptors out of the child (closefrom / Apple's
+//   POSIX_SPAWN_CLOEXEC_DEFAULT)
+// - Decline (return -1) anything it cannot reproduce exactly, so the
+//   executor's fork() path stays the single source of error messages;
+//   that includes any command started while process substitution pipes
+//   are open for programs to inherit (shareFd()), which closefrom would
+//   take away
+// glibc and Apple implement posix_spawn with vfork-style clones, so the
+// cost no longer grows with the shell's resident size.
+class ProcessSpawner : public IProcessSpawner {
+public:
+    ProcessSpawner() = default;
+    ~ProcessSpawner() override = default;
+
+    pid_t spawn(const std::string& path, const std::vector<std::string>& args,
+                const Command& cmd, int input_fd, int output_fd,
+                pid_t process_group) override;
+
+    // True when this platform can spawn without leaking the shell's fds
+    static bool supported();
+};
+
+} // namespace helix
+
+#endif // HELIX_PROCESS_SPAWNER_H
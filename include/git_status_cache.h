@@ -0,0 +1,54 @@
+#ifndef HELIX_GIT_STATUS_CACHE_H
+#define HELIX_GIT_STATUS_CACHE_H
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+
+namespace helix {
+
+// GitStatusCache - `git status` markers for the prompt, computed off-thread
+// Responsibilities:
+// - Run `git status --porcelain` on a background worker, one repo at a time
+// - Cache the result per repository root, keyed on the mtimes of
+//   .git/index and .git/HEAD (plus a short max age, since editing a tracked
+//   file does not touch the index until git refreshes it)
+// - Hand back the last known value immediately; only a repository seen for
+//   the first time waits, and never longer than the caller's budget
+// The worker starts lazily, so shells that never show a prompt in a git
+// repository never create a thread.
+class GitStatusCache {
+public:
+    struct Markers {
+        bool staged = false;     // Changes in the index
+        bool dirty = false;      // Unstaged changes in the work tree
+        bool untracked = false;  // Untracked files
+    };
+
+    GitStatusCache();
+    ~GitStatusCache();
+
+    GitStatusCache(const GitStatusCache&) = delete;
+    GitStatusCache& operator=(const GitStatusCache&) = delete;
+
+    // Markers for the repository whose work tree is root
+    // Schedules a refresh when the cached value is missing or stale
+    // budget: how long to wait when nothing is known yet (0 = don't wait)
+    // Returns nullopt when no value is available within the budget
+    std::optional<Markers> get(const std::string& root, std::chrono::milliseconds budget);
+
+    // Interpret `git status --porcelain` output
+    static Markers parsePorcelain(const std::string& output);
+
+    // Cached values older than this are refreshed in the background
+    static constexpr std::chrono::seconds kMaxAge{3};
+
+private:
+    struct Shared;                   // State shared with the worker thread
+    std::shared_ptr<Shared> shared_; // Outlives us if git is still running
+};
+
+} // namespace helix
+
+#endif // HELIX_GIT_STATUS_CACHE_H
@@ -0,0 +1,84 @@
+#ifndef HELIX_HTTP_CLIENT_H
+#define HELIX_HTTP_CLIENT_H
+
+#include <csignal>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace helix {
+
+// HttpClient - In-process HTTP/1.1 client with kept-alive connections
+// Responsibilities:
+// - Send a request and hand the body to a callback as it arrives (chunked
+//   or Content-Length framing), so a streamed response can be shown live
+// - Keep each connection open after a complete response and reuse it for
+//   the next request to the same scheme, host and port, which skips the TCP
+//   and TLS handshakes; a kept connection found dead is replaced once
+// - Wait with poll() in short slices so a caller's cancel flag (set from a
+//   SIGINT handler) stops a connect or a read promptly
+// https uses libssl, dlopen()ed on first use like readline; without it
+// https requests fail with tlsAvailable() false, and callers fall back to
+// another transport.
+class HttpClient {
+public:
+    struct Request {
+        std::string method = "POST";
+        std::string url;                                          // http:// or https://
+        std::vector<std::pair<std::string, std::string>> headers;
+        std::string body;
+    };
+
+    struct Response {
+        int status = 0;           // HTTP status; 0 if none was received
+        bool cancelled = false;   // The cancel flag stopped it
+        std::string error;        // Transport failure, empty on success
+    };
+
+    struct Stats {
+        unsigned long connects = 0;  // New connections opened
+        unsigned long reuses = 0;    // Requests sent on a kept connection
+    };
+
+    // Called with each piece of the body; return false to stop reading
+    using BodyFn = std::function<bool(std::string_view)>;
+
+    // The client shared by the whole shell process
+    static HttpClient& global();
+
+    // Whether https can be used (libssl found and initialized)
+    static bool tlsAvailable();
+
+    ~HttpClient();
+
+    // Send request and stream the response body to on_body. cancel may be
+    // null; when it becomes non-zero the request is abandoned and its
+    // connection closed
+    Response send(const Request& request, const BodyFn& on_body,
+                  const volatile std::sig_atomic_t* cancel = nullptr);
+
+    // Close every kept connection
+    void closeIdle();
+
+    Stats stats() const { return stats_; }
+
+private:
+    struct Connection;
+    using ConnectionPtr = std::unique_ptr<Connection>;
+
+    HttpClient() = default;
+
+    Response attempt(const Request& request, ConnectionPtr& conn, const BodyFn& on_body,
+                     const volatile std::sig_atomic_t* cancel, bool& retry);
+
+    std::map<std::string, ConnectionPtr> idle_;  // scheme://host:port -> connection
+    Stats stats_;
+};
+
+} // namespace helix
+
+#endif // HELIX_HTTP_CLIENT_H
@@ -0,0 +1,66 @@
+#ifndef HELIX_JSON_H
+#define HELIX_JSON_H
+
+#include <cstddef>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace helix {
+
+// JsonValue - A parsed JSON document (RFC 8259)
+// Responsibilities:
+// - Parse text into a tree: objects keep their members in order, strings
+//   are unescaped (\uXXXX and surrogate pairs become UTF-8)
+// - Look members and elements up by path without copying
+// - Escape text for a JSON string literal
+// Numbers are kept as double. Anything past the first value other than
+// whitespace is an error, so a truncated or concatenated document is
+// rejected rather than half-read.
+class JsonValue {
+public:
+    enum class Type { Null, Bool, Number, String, Array, Object };
+
+    // Parse text into out; on failure out is Null and false is returned
+    static bool parse(std::string_view text, JsonValue& out);
+
+    // text as the body of a JSON string literal (quotes not included)
+    static std::string escape(std::string_view text);
+
+    Type type() const { return type_; }
+    bool isNull() const { return type_ == Type::Null; }
+    bool isString() const { return type_ == Type::String; }
+    bool isObject() const { return type_ == Type::Object; }
+    bool isArray() const { return type_ == Type::Array; }
+
+    bool boolean() const { return bool_; }
+    double number() const { return number_; }
+    // Text of a string (empty for other types)
+    const std::string& string() const { return string_; }
+
+    // Member of an object, or nullptr
+    const JsonValue* get(std::string_view key) const;
+    // Element of an array, or nullptr
+    const JsonValue* at(size_t index) const;
+    size_t size() const { return type_ == Type::Object ? members_.size() : elements_.size(); }
+
+    // Follow object keys and array indexes ("choices", "0", "delta"); the
+    // string at the end, or empty when any step is missing
+    const std::string& find(std::initializer_list<std::string_view> path) const;
+
+private:
+    class Reader;
+
+    Type type_ = Type::Null;
+    bool bool_ = false;
+    double number_ = 0;
+    std::string string_;
+    std::vector<JsonValue> elements_;
+    std::vector<std::pair<std::string, JsonValue>> members_;
+};
+
+} // namespace helix
+
+#endif // HELIX_JSON_H
@@ -0,0 +1,67 @@
+#ifndef HELIX_LIBHELIX_H
+#define HELIX_LIBHELIX_H
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace helix {
+
+// Interpreter - Helix as a library (libhelix.a / libhelix.so)
+// Responsibilities:
+// - Set up a Shell for a host program: no readline, history file, prompt
+//   identity, rc files or SIGCHLD handler, and only the shell's own
+//   children are ever reaped, so the host's signals and processes are left
+//   alone
+// - Run source text, or a Script compiled once and run many times, with
+//   the output of builtins and of the programs they start captured into
+//   caller strings (descriptors 1 and 2 point at a reusable memfd for the
+//   duration of the run)
+// - Read and set shell variables between runs; functions, aliases and
+//   variables persist from one run to the next
+// The shell's state (variables, job table, current directory) belongs to
+// the process, so there is one Interpreter at a time, used from one thread.
+// This header is the whole public API: nothing of the tree-walking
+// evaluator behind it is exposed.
+class Interpreter {
+public:
+    struct Options {
+        bool load_rc = false;  // Read ~/.helixrc, as `helix --rc` does
+    };
+
+    // A parsed program, shared and immutable; run it with run(script)
+    class Script;
+    using ScriptPtr = std::shared_ptr<const Script>;
+
+    Interpreter();
+    explicit Interpreter(const Options& options);
+    ~Interpreter();
+
+    Interpreter(const Interpreter&) = delete;
+    Interpreter& operator=(const Interpreter&) = delete;
+
+    // Run source and return its exit status (2 for a syntax error). out and
+    // err receive what was written to stdout and stderr; a null pointer
+    // leaves that stream where the host has it
+    int run(std::string_view source, std::string* out = nullptr, std::string* err = nullptr);
+
+    // Parse source for repeated runs; nullptr with the message in error
+    // when it does not parse
+    ScriptPtr compile(std::string_view source, std::string* error = nullptr);
+    int run(const Script& script, std::string* out = nullptr, std::string* err = nullptr);
+
+    // Value of a variable (element 0 of an array); nullopt when unset
+    std::optional<std::string> get(std::string_view name) const;
+    // exported: also in the environment of the programs it runs
+    void set(const std::string& name, std::string value, bool exported = false);
+    bool unset(std::string_view name);
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl_;
+};
+
+} // namespace helix
+
+#endif // HELIX_LIBHELIX_H
@@ -14,9 +14,12 @@ public:
     // Handles pipelines, redirections, and command arguments
     ParsedCommand parse(const std::vector<Token>& tokens);
 
+    // Parse one simple command (words and redirections, in any order)
+    // starting at pos; stops at the first operator token
+    Command parseSingleCommand(size_t& pos, const std::vector<Token>& tokens);
+
 private:
     // Helper methods for parsing different parts
-    Command parseSingleCommand(size_t& pos, const std::vector<Token>& tokens);
     void parseArguments(size_t& pos, const std::vector<Token>& tokens, Command& cmd);
     void parseRedirections(size_t& pos, const std::vector<Token>& tokens, Command& cmd);
     std::string extractFilename(const Token& token);
@@ -1,8 +1,11 @@
 #ifndef HELIX_PROMPT_H
 #define HELIX_PROMPT_H
 
+#include "git_status_cache.h"
 #include <string>
 #include <chrono>
+#include <unordered_map>
+#include <ctime>
 
 namespace helix {
 
@@ -30,6 +33,10 @@ public:
     void setLastExitStatus(int status);
     void setLastCommandDuration(std::chrono::milliseconds ms);
 
+    // Longest the prompt waits for the git markers of a repository it has
+    // no value for yet; 0 shows the branch alone until the worker finishes
+    void setGitStatusBudget(std::chrono::milliseconds budget);
+
     std::string generate() const;
 
     // Exposed for testing
@@ -41,6 +48,15 @@ public:
     std::string getDurationDisplay() const;
 
 private:
+    // Repository enclosing a directory, memoized per directory
+    struct RepoLocation {
+        std::string root;                 // Work tree root; empty: not in a repo
+        std::string branch;               // Parsed from HEAD
+        struct timespec head_mtime {};    // HEAD is re-read only when this moves
+        std::chrono::steady_clock::time_point checked_at;
+    };
+
+    const RepoLocation& locateRepo() const;
     std::string getGitBranch() const;
     std::string getGitStatus() const;   // dirty / staged / untracked indicators
     std::string shortenPath(const std::string& path) const;
@@ -51,6 +67,10 @@ private:
     std::string home_directory_;
     int last_exit_status_ = 0;
     std::chrono::milliseconds last_duration_{0};
+    std::chrono::milliseconds git_budget_{50};
+
+    mutable std::unordered_map<std::string, RepoLocation> repo_by_dir_;
+    mutable GitStatusCache git_status_;
 };
 
 } // namespace helix
@@ -1,29 +1,61 @@
 #ifndef HELIX_READLINE_SUPPORT_H
 #define HELIX_READLINE_SUPPORT_H
 
+#include <optional>
 #include <string>
 #include <vector>
 
 namespace helix {
 
+class EventLoop;
+struct ShellState;
+
 // Readline-based autocompletion support
+// Command names come from a completion index: the builtins the dispatcher
+// registered, the shell's aliases and functions, and PathCache's cached
+// directory listings, each kept sorted so a prefix is a range lookup
+// libreadline itself is loaded by initialize() (interactive shells only);
+// until then, or if it cannot be found, input is read as plain lines
 class ReadlineSupport {
 public:
     static void initialize();
     static void cleanup();
+    static bool available();
     static std::string readLineWithCompletion(const std::string& prompt);
 
+    // Read a line through readline's callback interface while loop runs
+    // its other sources (job notifications, ...). shown: what the caller
+    // printed before the line, drawn again when the edit is interrupted.
+    // Ctrl-C discards the line and starts over. nullopt at EOF
+    static std::optional<std::string> readLine(const std::string& prompt, EventLoop& loop,
+                                               const std::string& shown = "");
+
+    // Print text above the line being edited by readLine() and redraw the
+    // line; plain output when no line is being read
+    static void printAbove(const std::string& text);
+
+    // Readline's in-memory history (arrow keys, Ctrl-R); no-ops when not loaded
+    static void addHistory(const std::string& line);
+    static void stifleHistory(int max);
+
     // Completion callbacks
     static char** completionCallback(const char* text, int start, int end);
     static char* commandGenerator(const char* text, int state);
     static char* pathGenerator(const char* text, int state);
 
-    // Set available commands for completion
+    // Set available commands for completion (the builtin names; sorted here)
     static void setCommands(const std::vector<std::string>& commands);
 
+    // Shell whose aliases and functions are completed (nullptr to detach)
+    static void setShellState(const ShellState* state);
+
+    // Sorted, unique command names starting with prefix
+    static std::vector<std::string> commandCompletions(const std::string& prefix);
+
     // Public for friend functions
     static std::vector<std::string> available_commands;
     static int completion_index;
+    static const ShellState* shell_state;
 };
 
 } // namespace helix
@@ -0,0 +1,92 @@
+#ifndef HELIX_SCRIPT_PARSER_H
+#define HELIX_SCRIPT_PARSER_H
+
+#include "ast.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace helix {
+
+// ScriptParser - compiles shell source into an AST (see ast.h)
+// Responsibilities:
+// - Recursive-descent parsing of lists, pipelines, && / ||, if, while/until,
+//   for, case, { } groups, ( ) subshells and function definitions
+// - Alias expansion in command position and brace expansion of arguments,
+//   both done once at compile time
+// - Reporting input that is merely unfinished (INCOMPLETE) separately from
+//   syntax errors so interactive/multi-line callers can ask for more lines
+// Simple commands are delegated to Parser::parseSingleCommand over tokens
+// from Tokenizer::tokenizeScript.
+class ScriptParser {
+public:
+    enum class Status { OK, INCOMPLETE, ERROR };
+
+    struct Result {
+        Status status = Status::OK;
+        std::unique_ptr<ListNode> program;  // Set when status == OK
+        std::string error;                  // Message when status == ERROR
+        bool used_aliases = false;          // An alias was expanded into the program
+    };
+
+    // Parse a complete chunk of source
+    // aliases: alias table consulted for command words (may be nullptr)
+    Result parse(std::string_view source,
+                 const std::map<std::string, std::string>* aliases = nullptr);
+
+    // Brace expansion of one raw word: a{b,c}d -> abd acd, {1..3}, {a..e}
+    // Quoted braces and ${...}/$(...) contents are left alone
+    static std::vector<std::string> braceExpand(const std::string& word);
+
+private:
+    // Grammar productions - return nullptr after recording an error
+    std::unique_ptr<ListNode> parseList();
+    AstNodePtr parseAndOr();
+    AstNodePtr parsePipeline();
+    AstNodePtr parseCommand();
+    AstNodePtr parseSimpleCommand();
+    AstNodePtr parseIf();
+    AstNodePtr parseLoop(bool until);
+    AstNodePtr parseFor();
+    AstNodePtr parseCase();
+    AstNodePtr parseGroup();
+    AstNodePtr parseSubshell();
+    AstNodePtr parseFunction(const std::string& name, size_t body_start);
+    AstNodePtr parseCoproc();
+    bool parseCompoundRedirects(AstNode& node);
+
+    // Token helpers
+    const Token& peek(size_t ahead = 0) const;
+    void advance();
+    bool atWord(const char* word) const;
+    bool atListTerminator() const;
+    bool isCommandTerminator(size_t index) const;
+    void skipNewlines();
+    bool expect(const char* word);
+    void expandAliasAt(size_t index);
+    void fail(const std::string& message);
+
+    Tokenizer tokenizer_;
+    Parser parser_;
+
+    std::string source_;
+    std::vector<Token> tokens_;
+    size_t pos_ = 0;
+    size_t last_end_ = 0;      // Source offset just past the last consumed token
+    int brace_depth_ = 0;      // Open { } groups (lenient "}" handling)
+    int paren_depth_ = 0;      // Open ( ) subshells
+
+    const std::map<std::string, std::string>* aliases_ = nullptr;
+    bool used_aliases_ = false;
+
+    bool failed_ = false;
+    bool incomplete_ = false;
+    std::string error_;
+};
+
+} // namespace helix
+
+#endif // HELIX_SCRIPT_PARSER_H
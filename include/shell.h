@@ -2,72 +2,186 @@
 #define HELIX_SHELL_H
 
 #include "types.h"
-#include "tokenizer.h"
-#include "parser.h"
+#include "ast.h"
+#include "script_parser.h"
 #include "executor.h"
+#include "executor/environment_expander.h"
 #include "readline_support.h"
 #include "prompt.h"
 #include "shell/shell_state.h"
 #include "shell/builtin_handler.h"
 #include "shell/job_manager.h"
-#include <readline/history.h>
+#include "shell/history_store.h"
+#include "shell/shell_server.h"
 #include <string>
+#include <string_view>
 #include <vector>
 #include <memory>
 #include <chrono>
 
 namespace helix {
 
-class Shell {
+// How much of the interactive environment a Shell sets up
+// `helix -c`, `-s` and scripts start without readline, the history file or
+// the prompt's user/host lookup; tests and the REPL get all of it
+struct StartupOptions {
+    bool interactive = true;   // Readline, history file, prompt identity
+    bool load_rc = true;       // ~/.helixrc
+    bool trace = false;        // --startup-trace: time each phase on stderr
+    // Off for a shell embedded in another program (libhelix): no SIGCHLD
+    // handler, and only the shell's own children are reaped
+    bool signals = true;
+    bool load_env = true;      // Non-interactive shells read $HELIX_ENV
+};
+
+// Shell - REPL and script evaluator
+// Also serves command substitution for the expander (ICommandSubstitution)
+// so $(...) runs with Helix functions, aliases and builtins
+class Shell : public ICommandSubstitution {
 public:
-    Shell();
-    ~Shell();
+    explicit Shell(const StartupOptions& options = {});
+    ~Shell() override;
 
     int run();
     int runCommand(const std::string& cmd);
     int runStdin();
     int runScript(const char* path, int argc, char* argv[]);
 
-    bool processInputString(const std::string& input) { return processInput(input); }
+    // helix --server: run each request from the socket at socket_path in a
+    // fork of this shell until SIGINT or SIGTERM (see ShellServer)
+    int serve(const std::string& socket_path);
+
+    // Embedding (libhelix): parse source once with this shell's aliases,
+    // then run the tree as often as needed. Each run starts afresh after
+    // an `exit` or `set -e` stop in the previous one
+    ScriptParser::Result compile(std::string_view source);
+    int runProgram(const ListNode& program);
+
+    // One line as if typed at the prompt (recorded in history)
+    bool processInputString(const std::string& input) { return processInput(input, true); }
+
+    // ICommandSubstitution: output-only builtins run in-process with
+    // std::cout captured; anything else runs in a forked copy of the shell
+    std::string capture(const std::string& source) override;
+    // ICommandSubstitution: <(...) and >(...) run in a forked copy of the
+    // shell; the command's end of the pipe stays open until the command
+    // that named it has finished
+    std::string substituteProcess(const std::string& source, bool output) override;
 
 private:
     void showPrompt();
     std::string readInput();
-    bool processInput(const std::string& input);
-    bool runSingleCommand(const std::string& trimmed);
-
-    int runBlock(const std::vector<std::string>& lines);
-    bool invokeFunction(const std::string& name, const std::vector<std::string>& args);
-    int executeIf(const std::vector<std::string>& lines);
-    int executeWhile(const std::vector<std::string>& lines, bool until = false);
-    int executeFor(const std::vector<std::string>& lines);
-    int executeCase(const std::vector<std::string>& lines);
+    // record: add the line to history (interactive input only)
+    bool processInput(const std::string& input, bool record);
+    void flushPendingInput();
+
+    // Parse a complete chunk of source (rc file, eval, source, traps) and run it
+    bool runSource(const std::string& source);
+    // Run a `source`d file from its cached AST
+    bool sourceFile(const std::string& path);
+    // Run the whole text of a script file (see runScript)
+    int runScriptText(std::string_view text);
+    // Run -c's or a script's program; its final command may be exec'd in
+    // place of the shell (see canExecInPlace)
+    int runFinal(const ListNode& program);
+    // Nothing is left for the shell to do after the final command: no
+    // traps, jobs, coprocesses or process substitutions, no trace to write
+    bool canExecInPlace();
+    // A server worker's request, in the forked child
+    int runRequest(const ShellServer::Request& request);
+    bool invokeFunction(const std::string& name, std::vector<std::string> args);
+
+    // Tree-walking evaluator over the AST built by ScriptParser
+    // Each returns the exit status, which is also stored in state/$?
+    int execNode(const AstNode* node);
+    int execList(const ListNode& list);
+    int execAndOr(const AndOrNode& node);
+    int execPipeline(const PipelineNode& node, bool background);
+    int execInStage(const AstNode& node, bool background);
+    int execSimple(const SimpleCommandNode& node, bool background);
+    int runSimple(const SimpleCommandNode& node, ParsedCommand& parsed, bool background);
+    int runPipelineStage(const AstNode& stage, Command& expanded);
+    int execInBackground(const AstNode& node);
+    int execIf(const IfNode& node);
+    int execLoop(const LoopNode& node);
+    int execFor(const ForNode& node);
+    int execArithmeticFor(const ForNode& node);
+    static std::vector<std::string> rangeTerms(const ForNode::Range& range);
+    int execParallelFor(const ForNode& node, const std::vector<std::string>& values);
+    int execCase(const CaseNode& node);
+    int execSubshell(const GroupNode& node);
+    int execCoproc(const CoprocNode& node);
+    // Close the pipes of coprocesses that have exited and unset their NAME
+    // and NAME_PID; output still queued in a pipe is left to be read first
+    void reapCoprocs();
+
+    // Per-execution word expansion of a compiled simple command
+    bool expandSimple(const SimpleCommandNode& node, Command& out);
+    void expandRedirections(const Command& raw, Command& out);
+
+    void runDeferredBuiltinWork();
+    bool finishIteration();
+    bool interrupted() const;
+    void checkErrexit();
+    int setStatus(int status);
+    void assignVariable(const std::string& name, const std::string& value);
+    bool assignWord(const std::string& word);
 
-    std::string expandAliases(const std::string& line) const;
     std::string expandHistory(const std::string& line) const;
 
     void loadHistory();
-    void saveHistory();
-    void loadRcFile();
-
-    static std::string trimWhitespace(const std::string& s);
+    void seedReadlineHistory();
+    void loadRcFile(const std::string& path);
+    void initPromptIdentity();
 
+    StartupOptions options_;
     ShellState state;
-    Tokenizer tokenizer;
-    Parser parser;
+    ScriptParser script_parser;
+    EnvironmentVariableExpander expander;
     Executor executor;
     Prompt prompt;
 
     std::unique_ptr<IBuiltinDispatcher> builtin_dispatcher;
     std::unique_ptr<IJobManager> job_manager;
 
-    std::vector<std::string> session_history_;
+    HistoryStore history_;
     std::chrono::milliseconds last_duration_{0};
-
-    // Multi-line block accumulation
-    std::vector<std::string> block_stack_;  // stack of opener keywords
-    std::vector<std::string> block_lines_;  // accumulated lines
-    std::string pending_func_name_;         // function name being defined
+    // The prompt as last printed, redrawn under a job notification
+    std::string shown_prompt_;
+
+    // Lines of a compound command that is not finished yet
+    std::string pending_input_;
+    // > 0 while evaluating an if/while condition or a non-final && / ||
+    // operand - set -e does not apply there
+    int condition_depth_ = 0;
+    // Set when a command substitution ran; its status becomes the status
+    // of a bare assignment (x=$(false))
+    bool substituted_ = false;
+    // std::cout's buffer at startup, for forked substitution children
+    std::streambuf* stdout_buf_ = nullptr;
+    // The shell's ends of process substitution pipes, oldest first; each
+    // command closes the ones its words opened (see SubstitutionScope)
+    std::vector<int> substitution_fds_;
+    // Running coprocesses: the shell's ends of their pipes, -1 once closed
+    struct Coproc {
+        std::string name;
+        pid_t pid;
+        int read_fd;   // ${NAME[0]}: the coprocess's stdout
+        int write_fd;  // ${NAME[1]}: its stdin
+    };
+    std::vector<Coproc> coprocs_;
+    // The command that ends the program runFinal() is running, if nothing
+    // can run after it; null otherwise
+    const SimpleCommandNode* final_command_ = nullptr;
+    // In a forked pipeline stage, the stage's own command: a program there
+    // replaces the stage process instead of being forked once more
+    const SimpleCommandNode* stage_command_ = nullptr;
+    // Cleared VarFrames kept for reuse by the next function call
+    std::vector<VarFrame> frame_pool_;
+    // Expanded commands kept for reuse, one per nesting level in use: a loop
+    // body's argv and redirection vectors keep their capacity between
+    // iterations instead of being reallocated for every command
+    std::vector<ParsedCommand> command_pool_;
 };
 
 } // namespace helix
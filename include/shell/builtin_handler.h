@@ -4,9 +4,10 @@
 #include "shell/interfaces.h"
 #include "types.h"
 #include "shell/shell_state.h"
+#include "shell/builtin_table.h"
+#include <array>
 #include <string>
 #include <memory>
-#include <map>
 
 namespace helix {
 
@@ -133,6 +134,14 @@ public:
     bool canHandle(const std::string& command) const override;
 };
 
+// MapfileCommandHandler - Handles 'mapfile' and 'readarray': the lines of
+// the input, read in bulk, into an indexed array
+class MapfileCommandHandler : public BuiltinCommandHandler {
+public:
+    bool handle(const ParsedCommand& cmd, ShellState& state) override;
+    bool canHandle(const std::string& command) const override;
+};
+
 // PushdCommandHandler - Handles 'pushd' command
 class PushdCommandHandler : public BuiltinCommandHandler {
 public:
@@ -334,6 +343,25 @@ public:
     bool canHandle(const std::string& command) const override;
 };
 
+// CatCommandHandler - Handles 'cat': each file (or stdin) copied to
+// stdout by StreamCopy, inside the kernel wherever the descriptors allow.
+// Options other than -u, and a terminal on either side, go to the cat
+// program instead
+class CatCommandHandler : public BuiltinCommandHandler {
+public:
+    bool handle(const ParsedCommand& cmd, ShellState& state) override;
+    bool canHandle(const std::string& command) const override;
+};
+
+// TeeCommandHandler - Handles 'tee [-a] [-i] [file...]' through StreamCopy
+// (tee() between pipes); other options and a terminal on stdin go to the
+// tee program
+class TeeCommandHandler : public BuiltinCommandHandler {
+public:
+    bool handle(const ParsedCommand& cmd, ShellState& state) override;
+    bool canHandle(const std::string& command) const override;
+};
+
 // WhichCommandHandler - Handles 'which' command
 class WhichCommandHandler : public BuiltinCommandHandler {
 public:
@@ -355,8 +383,15 @@ public:
     // Check if a command is a builtin
     bool isBuiltin(const std::string& command) const override;
 
+    // Sorted builtin names
+    std::vector<std::string> names() const override;
+
 private:
-    std::map<std::string, std::unique_ptr<BuiltinCommandHandler>> handlers;
+    // Handler for id, constructed on first use
+    BuiltinCommandHandler& handler(builtins::Handler id);
+
+    std::array<std::unique_ptr<BuiltinCommandHandler>,
+               static_cast<size_t>(builtins::Handler::Count)> handlers;
 };
 
 } // namespace helix
@@ -0,0 +1,89 @@
+#ifndef HELIX_BUILTIN_OUTPUT_H
+#define HELIX_BUILTIN_OUTPUT_H
+
+#include "types.h"
+#include <memory>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace helix {
+
+// FdStreambuf - std::streambuf that writes straight to a descriptor
+// Output collects in a buffer of up to kCapacity bytes; when a write would
+// overflow it, the buffer and the new data go out together in one writev(),
+// so a large argument is never copied. No stdio underneath, no sync with it
+class FdStreambuf : public std::streambuf {
+public:
+    static constexpr size_t kCapacity = 64 * 1024;
+
+    explicit FdStreambuf(int fd) : fd_(fd) {}
+    ~FdStreambuf() override { flush(); }
+
+    FdStreambuf(const FdStreambuf&) = delete;
+    FdStreambuf& operator=(const FdStreambuf&) = delete;
+
+    // Write out what is buffered; false once any write has failed
+    bool flush();
+
+    // errno of the first failed write, 0 if none
+    int error() const { return error_; }
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* s, std::streamsize n) override;
+    int sync() override { return flush() ? 0 : -1; }
+
+private:
+    // Write the buffer followed by extra (may be empty), retrying short writes
+    bool writeOut(const char* extra, size_t extra_len);
+
+    int fd_;
+    int error_ = 0;
+    std::string pending_;
+};
+
+// BuiltinOutput - A builtin's output redirections, applied to its streams
+// Responsibilities:
+// - Open the files of `>`, `>>`, `2>`, `2>>`, `&>` and `&>>` and point
+//   std::cout / std::cerr at FdStreambufs over them; `2>&1` and `>&2` share the
+//   other stream's buffer. Applied left to right, as FileDescriptorManager does
+// - Put the streams back, flush and close the files when it goes out of scope
+// The shell's own descriptors 1 and 2 are never touched: no dup()/dup2()
+// to save and restore them, and no stdio flush around the builtin. That is
+// only correct for builtins that do all their I/O through the streams (see
+// builtins::streamsOnly()); input redirections are left to ScopedRedirect.
+class BuiltinOutput {
+public:
+    // Whether cmd's redirections can all be applied this way
+    static bool handles(const Command& cmd);
+
+    explicit BuiltinOutput(const Command& cmd);
+    ~BuiltinOutput();
+
+    BuiltinOutput(const BuiltinOutput&) = delete;
+    BuiltinOutput& operator=(const BuiltinOutput&) = delete;
+
+    // False if a file could not be opened (already reported)
+    bool ok() const { return ok_; }
+
+    // Restore the streams and flush; false (and errno set) if a write to a
+    // redirected file failed. The destructor does this if nobody did
+    bool finish();
+
+private:
+    std::streambuf* open(const std::string& path, bool append);
+    // A buffer on a copy of the descriptor target names (>&N)
+    std::streambuf* duplicate(const std::string& target);
+
+    std::streambuf* saved_out_;
+    std::streambuf* saved_err_;
+    std::vector<int> fds_;
+    std::vector<std::unique_ptr<FdStreambuf>> buffers_;
+    bool ok_ = true;
+    bool finished_ = false;
+};
+
+} // namespace helix
+
+#endif // HELIX_BUILTIN_OUTPUT_H
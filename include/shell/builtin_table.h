@@ -0,0 +1,183 @@
+#ifndef HELIX_BUILTIN_TABLE_H
+#define HELIX_BUILTIN_TABLE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace helix::builtins {
+
+// Builtin table - The one list of builtin names, fixed at compile time
+// Responsibilities:
+// - Name every builtin once, sorted, with the handler that implements it
+//   (aliases such as `.`/`source` and `[`/`test` share a handler)
+// - Look a name up in O(1) through a perfect hash whose seed is searched
+//   at compile time, so dispatch neither allocates nor compares strings
+//   beyond the one candidate
+// The dispatcher, type/which, the executor's shell-only check, command
+// substitution and completion all read this table; nothing else keeps a
+// list of builtins.
+
+// Handler implementations; the dispatcher constructs each on first use
+enum class Handler : uint8_t {
+    Cd, Exit, History, Jobs, Fg, Bg, Pwd, Export, Echo, Help, Alias, Unalias,
+    Unset, Type, Ai, Source, Which, Read, Pushd, Popd, Dirs, Wait, True, False,
+    Set, Test, Printf, Kill, Trap, Umask, Ulimit, Declare, Readonly, Getopts,
+    Shift, Command, Builtin, Exec, Eval, Times, Hash, Suspend, Disown, Let,
+    Return, Break, Continue, Local, Mapfile, Cat, Tee,
+    Count
+};
+
+struct Entry {
+    std::string_view name;
+    Handler handler;
+    bool shell_only;   // Changes shell state; the Executor refuses to run it
+    bool output_only;  // Only prints: $(...) may run it in-process
+};
+
+inline constexpr std::array kTable{
+    Entry{".",        Handler::Source,   false, false},
+    Entry{":",        Handler::True,     false, true},
+    Entry{"[",        Handler::Test,     false, true},
+    Entry{"[[",       Handler::Test,     false, true},
+    Entry{"ai",       Handler::Ai,       false, false},
+    Entry{"alias",    Handler::Alias,    false, false},
+    Entry{"bg",       Handler::Bg,       true,  false},
+    Entry{"break",    Handler::Break,    false, false},
+    Entry{"builtin",  Handler::Builtin,  false, false},
+    Entry{"cat",      Handler::Cat,      false, false},
+    Entry{"cd",       Handler::Cd,       true,  false},
+    Entry{"command",  Handler::Command,  false, false},
+    Entry{"continue", Handler::Continue, false, false},
+    Entry{"declare",  Handler::Declare,  false, false},
+    Entry{"dirs",     Handler::Dirs,     false, false},
+    Entry{"disown",   Handler::Disown,   false, false},
+    Entry{"echo",     Handler::Echo,     false, true},
+    Entry{"eval",     Handler::Eval,     false, false},
+    Entry{"exec",     Handler::Exec,     false, false},
+    Entry{"exit",     Handler::Exit,     true,  false},
+    Entry{"export",   Handler::Export,   true,  false},
+    Entry{"false",    Handler::False,    false, true},
+    Entry{"fg",       Handler::Fg,       true,  false},
+    Entry{"getopts",  Handler::Getopts,  false, false},
+    Entry{"hash",     Handler::Hash,     false, false},
+    Entry{"help",     Handler::Help,     false, false},
+    Entry{"history",  Handler::History,  true,  false},
+    Entry{"jobs",     Handler::Jobs,     true,  false},
+    Entry{"kill",     Handler::Kill,     false, false},
+    Entry{"let",      Handler::Let,      false, false},
+    Entry{"local",    Handler::Local,    false, false},
+    Entry{"mapfile",  Handler::Mapfile,  false, false},
+    Entry{"popd",     Handler::Popd,     false, false},
+    Entry{"printf",   Handler::Printf,   false, true},
+    Entry{"pushd",    Handler::Pushd,    false, false},
+    Entry{"pwd",      Handler::Pwd,      true,  true},
+    Entry{"read",     Handler::Read,     false, false},
+    Entry{"readarray", Handler::Mapfile, false, false},
+    Entry{"readonly", Handler::Readonly, false, false},
+    Entry{"return",   Handler::Return,   false, false},
+    Entry{"set",      Handler::Set,      false, false},
+    Entry{"shift",    Handler::Shift,    false, false},
+    Entry{"source",   Handler::Source,   false, false},
+    Entry{"suspend",  Handler::Suspend,  false, false},
+    Entry{"tee",      Handler::Tee,      false, false},
+    Entry{"test",     Handler::Test,     false, true},
+    Entry{"times",    Handler::Times,    false, false},
+    Entry{"trap",     Handler::Trap,     false, false},
+    Entry{"true",     Handler::True,     false, true},
+    Entry{"type",     Handler::Type,     false, true},
+    Entry{"typeset",  Handler::Declare,  false, false},
+    Entry{"ulimit",   Handler::Ulimit,   false, false},
+    Entry{"umask",    Handler::Umask,    false, false},
+    Entry{"unalias",  Handler::Unalias,  false, false},
+    Entry{"unset",    Handler::Unset,    false, false},
+    Entry{"wait",     Handler::Wait,     false, false},
+    Entry{"which",    Handler::Which,    false, true},
+};
+
+static_assert(std::is_sorted(kTable.begin(), kTable.end(),
+                             [](const Entry& a, const Entry& b) { return a.name < b.name; }),
+              "builtin table must stay sorted (names() and completion rely on it)");
+
+namespace detail {
+
+constexpr size_t kSlots = 256;          // Power of two, > 4x the table size
+constexpr uint8_t kEmpty = 0xFF;
+static_assert(kTable.size() < kEmpty);
+
+// FNV-1a with a seed, then a final avalanche so the low bits are usable
+constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (char c : s) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 16777619u;
+    }
+    h ^= h >> 15;
+    h *= 0x2c1b3c6du;
+    h ^= h >> 12;
+    return h;
+}
+
+struct PerfectHash {
+    uint32_t seed = 0;
+    std::array<uint8_t, kSlots> slots{};
+};
+
+// First seed under which no two names share a slot
+consteval PerfectHash build() {
+    for (uint32_t seed = 1; seed < 100000; ++seed) {
+        PerfectHash ph;
+        ph.seed = seed;
+        ph.slots.fill(kEmpty);
+        bool collision = false;
+        for (size_t i = 0; i < kTable.size() && !collision; ++i) {
+            uint8_t& slot = ph.slots[hash(kTable[i].name, seed) & (kSlots - 1)];
+            if (slot != kEmpty) collision = true;
+            else slot = static_cast<uint8_t>(i);
+        }
+        if (!collision) return ph;
+    }
+    return PerfectHash{};
+}
+
+inline constexpr PerfectHash kHash = build();
+static_assert(kHash.seed != 0, "no collision-free seed for the builtin table");
+
+} // namespace detail
+
+// Table entry for name, or nullptr if it is not a builtin
+constexpr const Entry* find(std::string_view name) {
+    uint8_t i = detail::kHash.slots[detail::hash(name, detail::kHash.seed) & (detail::kSlots - 1)];
+    if (i == detail::kEmpty || kTable[i].name != name) return nullptr;
+    return &kTable[i];
+}
+
+constexpr bool isBuiltin(std::string_view name) { return find(name) != nullptr; }
+
+// Builtins whose only I/O is through std::cout and std::cerr: they read no
+// input, start no process and leave nothing to run later under their
+// redirections, so `echo x >> log` needs only its streams pointed at the
+// file (BuiltinOutput), not the shell's descriptors swapped
+constexpr bool streamsOnly(Handler handler) {
+    switch (handler) {
+    case Handler::Echo:    case Handler::Printf:   case Handler::Pwd:
+    case Handler::True:    case Handler::False:    case Handler::Test:
+    case Handler::Type:    case Handler::Which:    case Handler::History:
+    case Handler::Jobs:    case Handler::Alias:    case Handler::Dirs:
+    case Handler::Help:    case Handler::Times:    case Handler::Hash:
+    case Handler::Declare: case Handler::Export:   case Handler::Readonly:
+    case Handler::Set:     case Handler::Umask:    case Handler::Ulimit:
+    case Handler::Let:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static_assert(isBuiltin("cd") && isBuiltin("[") && !isBuiltin("ls") && !isBuiltin(""));
+
+} // namespace helix::builtins
+
+#endif // HELIX_BUILTIN_TABLE_H
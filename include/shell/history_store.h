@@ -0,0 +1,104 @@
+#ifndef HELIX_HISTORY_STORE_H
+#define HELIX_HISTORY_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace helix {
+
+// HistoryStore - Command history backed by an append-only file
+// Responsibilities:
+// - Map the history file read-only instead of copying it: entries loaded
+//   from disk are views into the mapping, so a 500k-line file costs page
+//   cache, not heap
+// - Append every recorded command to the file immediately with a single
+//   O_APPEND write(), so a crash loses nothing and concurrent shells
+//   interleave whole lines
+// - Apply HISTCONTROL (ignoredups, ignorespace, ignoreboth, erasedups);
+//   erasedups tombstones the older copy found through a hash index instead
+//   of rewriting the list
+// - Answer `!prefix` from an index keyed on an entry's first two bytes and
+//   `!?text` with a newest-first scan
+// The line index, the prefix index and the dedup index are each built on
+// first use; opening the file only maps it, and tail() reads the newest
+// lines backwards from the end.
+class HistoryStore {
+public:
+    HistoryStore() = default;
+    ~HistoryStore();
+
+    HistoryStore(const HistoryStore&) = delete;
+    HistoryStore& operator=(const HistoryStore&) = delete;
+
+    // Map path (a missing file is an empty history) and append to it from now on
+    // Returns false if the file exists but cannot be read
+    bool open(const std::string& path);
+
+    // Record a command, writing it to the file unless HISTCONTROL skips it
+    // control: the HISTCONTROL value (colon-separated)
+    // Returns false if the entry was skipped
+    bool add(std::string_view line, std::string_view control = {});
+
+    // Number of entries; entries are numbered 1..size() as `history` shows them
+    size_t size() const;
+
+    // Entry number n (1-based), or nullopt if out of range
+    std::optional<std::string_view> at(size_t n) const;
+
+    // Most recent entry
+    std::optional<std::string_view> last() const;
+
+    // Most recent entry that starts with prefix / contains text
+    std::optional<std::string_view> findPrefix(std::string_view prefix) const;
+    std::optional<std::string_view> findSubstring(std::string_view text) const;
+
+    // The newest count entries, oldest first (seeds readline's own list)
+    std::vector<std::string_view> tail(size_t count) const;
+
+    // Call fn(number, entry) for every entry, oldest first
+    void forEach(const std::function<void(size_t, std::string_view)>& fn) const;
+
+private:
+    // Slot i: the i-th line of the mapped file, then the session's entries
+    std::string_view slot(size_t i) const;
+    size_t slotCount() const { return indexed_ ? starts_.size() + session_.size() : 0; }
+
+    // Build the line index over the mapping (first call only)
+    void ensureIndexed() const;
+    void ensurePrefixIndex() const;
+    void ensureDedupIndex() const;
+    void indexSlot(size_t i) const;   // Add one slot to the built indexes
+
+    // Slot index of the n-th (1-based) live entry
+    std::optional<size_t> slotOfEntry(size_t n) const;
+
+    static uint16_t prefixKey(std::string_view line);
+
+    const char* map_ = nullptr;      // Read-only mapping of the file as opened
+    size_t map_size_ = 0;
+    int append_fd_ = -1;
+    std::string path_;
+
+    std::deque<std::string> session_;  // Entries added since open(); stable addresses
+
+    // Lazily built indexes (const lookups fill them in)
+    mutable bool indexed_ = false;
+    mutable std::vector<size_t> starts_;   // Offset of each non-empty line in the mapping
+    mutable std::vector<bool> dead_;       // Erased by erasedups
+    mutable size_t dead_count_ = 0;
+    mutable bool prefix_indexed_ = false;
+    mutable std::unordered_map<uint16_t, std::vector<uint32_t>> by_prefix_;
+    mutable bool dedup_indexed_ = false;
+    mutable std::unordered_map<std::string_view, uint32_t> latest_;  // Text -> newest slot
+};
+
+} // namespace helix
+
+#endif // HELIX_HISTORY_STORE_H
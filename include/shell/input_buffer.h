@@ -0,0 +1,66 @@
+#ifndef HELIX_INPUT_BUFFER_H
+#define HELIX_INPUT_BUFFER_H
+
+#include <cstddef>
+#include <string>
+#include <sys/types.h>
+
+namespace helix {
+
+// InputBuffer - The shell's own reads from a descriptor (read, piped scripts)
+// Responsibilities:
+// - Read a record up to a delimiter (or a byte count) without taking any
+//   byte past it away from whoever reads the descriptor next: a child such
+//   as `cat` in `while read -r x; do cat; done < f` starts exactly after
+//   the line `read` consumed
+// - On seekable input, read ahead in large pread()s and keep the bytes
+//   between calls; the descriptor's offset is moved (one lseek()) to just
+//   past what was consumed, so it is always correct for children
+// - On pipes and terminals, where nothing can be put back, read one byte
+//   at a time, as POSIX requires of read
+// - Read all the rest in bulk for mapfile
+// Kept per descriptor number and checked against the descriptor's offset on
+// every call, so a child moving it simply makes the buffer start over.
+// Redirections that swap the descriptor itself call discard().
+class InputBuffer {
+public:
+    enum class Status {
+        Ok,     // Stopped at the delimiter (consumed, not stored)
+        Full,   // Read max bytes without meeting the delimiter
+        Eof,    // Input ended first; out holds whatever was read
+        Error,  // read() failed; errno is set
+    };
+
+    // The buffer of descriptor fd, created on first use
+    static InputBuffer& forFd(int fd);
+
+    // Forget fd's read-ahead: the descriptor now refers to something else
+    static void discard(int fd);
+
+    // Append the bytes before the next delim (-1: none) to out, reading at
+    // most max bytes (delimiter included)
+    Status read(std::string& out, int delim, size_t max = std::string::npos);
+
+    // Append everything up to the end of input to out, in large reads
+    // (nothing is left for anyone else to read, so no care is needed);
+    // returns Eof, or Error with errno set
+    Status readAll(std::string& out);
+
+private:
+    explicit InputBuffer(int fd) : fd_(fd) {}
+
+    // Bytes `pread` pulls in at a time on seekable input
+    static constexpr size_t kChunk = 16 * 1024;
+
+    Status readSeekable(std::string& out, int delim, size_t max);
+    Status readBytewise(std::string& out, int delim, size_t max);
+
+    int fd_;
+    off_t offset_ = -1;        // Descriptor offset of buffer_[pos_]; -1 when unknown
+    std::string buffer_;       // Read ahead, not yet consumed from pos_ on
+    size_t pos_ = 0;
+};
+
+} // namespace helix
+
+#endif // HELIX_INPUT_BUFFER_H
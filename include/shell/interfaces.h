@@ -61,6 +61,12 @@ public:
      * @return true if builtin
      */
     virtual bool isBuiltin(const std::string& command) const = 0;
+
+    /**
+     * Names of all builtins
+     * @return names in sorted order (completion, `help`)
+     */
+    virtual std::vector<std::string> names() const = 0;
 };
 
 /**
@@ -75,8 +81,25 @@ public:
      * Add a new job
      * @param pid Process ID
      * @param command Command string
+     * @return Job ID
+     */
+    virtual int addJob(int pid, const std::string& command) = 0;
+
+    /**
+     * Add a job made of several processes (a background pipeline)
+     * @param pgid Process group shared by the members
+     * @param pids Member processes in pipeline order
+     * @param command Command string
+     * @return Job ID
+     */
+    virtual int addJob(pid_t pgid, const std::vector<pid_t>& pids, const std::string& command) = 0;
+
+    /**
+     * Track a process the shell started for its own use (the producer of a
+     * process substitution): reaped like a job member, never listed
+     * @param pid The process
      */
-    virtual void addJob(int pid, const std::string& command) = 0;
+    virtual void addHelper(pid_t pid) = 0;
 
     /**
      * Remove a job
@@ -86,8 +109,9 @@ public:
 
     /**
      * Print all jobs
+     * @param verbose Also print each member's status and resource usage (jobs -v)
      */
-    virtual void printJobs() const = 0;
+    virtual void printJobs(bool verbose) const = 0;
 
     /**
      * Bring job to foreground
@@ -101,6 +125,34 @@ public:
      */
     virtual void resumeInBackground(int job_id) = 0;
 
+    /**
+     * Apply child exits and stops queued since the last call
+     * Call before reading job state (jobs, fg, bg, notifications)
+     */
+    virtual void reapPending() = 0;
+
+    /**
+     * Job a process belongs to
+     * @param pid Member process
+     * @return Job ID, or 0 if pid is not part of a job
+     */
+    virtual int findJob(pid_t pid) const = 0;
+
+    /**
+     * Block until a job has exited or stopped; an exited job is removed
+     * @param job_id Job ID
+     * @return Status of its last member (128+n for signal n), -1 if no such job
+     */
+    virtual int waitForJob(int job_id) = 0;
+
+    /**
+     * Block until one of several jobs exits or stops; an exited job is removed
+     * @param job_ids Jobs to wait for
+     * @param status Set to the job's status, as for waitForJob()
+     * @return ID of that job, or 0 if none of job_ids exists
+     */
+    virtual int waitForAnyJob(const std::vector<int>& job_ids, int& status) = 0;
+
     /**
      * Get jobs map (read-only access)
      * @return Reference to jobs map
@@ -3,14 +3,23 @@
 
 #include "shell/interfaces.h"
 #include "types.h"
+#include <iostream>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <cstdint>
 
 namespace helix {
 
 // JobManager - Manages background and foreground jobs
 // Implements IJobManager interface (Dependency Inversion Principle)
 // Responsibilities:
-// - Track active jobs
+// - Track active jobs, including every process of a background pipeline
+// - Record each member's exit status as the SIGCHLD reaper collects it
+// - Reap the shell's helper processes (process substitutions) out of sight
+// - Keep the signal handler to waitpid() + a lock-free ring; the job table
+//   is only touched from the main loop
 // - Bring jobs to foreground
 // - Resume jobs in background
 // - Print job status
@@ -20,13 +29,19 @@ public:
     ~JobManager() override = default;
 
     // Add a new job
-    void addJob(int pid, const std::string& command) override;
+    int addJob(int pid, const std::string& command) override;
+
+    // Add a multi-process job (background pipeline) sharing one process group
+    int addJob(pid_t pgid, const std::vector<pid_t>& pids, const std::string& command) override;
+
+    // Reap pid (a process substitution) without a job table entry
+    void addHelper(pid_t pid) override;
 
     // Remove a job
     void removeJob(int job_id) override;
 
-    // Print all jobs
-    void printJobs() const override;
+    // Print all jobs; verbose adds each member's resource usage
+    void printJobs(bool verbose) const override;
 
     // Bring a job to foreground
     void bringToForeground(int job_id) override;
@@ -37,19 +52,98 @@ public:
     // Get jobs map (for direct access)
     const std::map<int, Job>& getJobs() const override { return jobs; }
 
-    // Update job status based on PID (for SIGCHLD handler)
+    // Update the status of the job owning pid (main loop only)
     void updateJobStatus(pid_t pid, JobStatus status);
 
-    // Check and reap completed jobs (called from signal handler)
-    void checkCompletedJobs();
+    // SIGCHLD handler entry point: reaps children and queues (pid, status)
+    // records in a fixed-size lock-free ring. Async-signal-safe: it only
+    // calls waitpid() and touches atomics, never the job table
+    void onSigchld();
+
+    // Apply queued child events to the job table (main loop only)
+    void reapPending() override;
+
+    int findJob(pid_t pid) const override;
+
+    // Blocking waits: SIGCHLD is held while the queue is drained and the
+    // remaining members are collected with waitpid(), so every exit goes
+    // through applyChildEvent() like the handler's
+    int waitForJob(int job_id) override;
+    int waitForAnyJob(const std::vector<int>& job_ids, int& status) override;
 
-    // Print notifications for completed jobs and clean them up
+    // Print notifications for completed jobs to out and clean them up
     // This should be called from the main loop (not signal handler)
-    void printAndCleanCompletedJobs();
+    void printAndCleanCompletedJobs(std::ostream& out = std::cout);
+
+    // Collect only the job table's own pids, never wait4(-1): for a shell
+    // sharing its process with a host (libhelix) whose children are not
+    // ours to reap. There is no SIGCHLD handler then, so blocking waits
+    // poll the members every millisecond
+    void setReapOwnChildrenOnly(bool own) { own_children_only_ = own; }
+
+    // One WNOHANG pass over the members of every job but the one in the
+    // foreground and the helpers; false when none of them is still
+    // running. Also what a foreground wait holding SIGCHLD runs on each
+    // SIGCHLD (waitForeground())
+    bool reapOwnChildren();
 
 private:
+    // Store a reaped member's exit status; completes the job when it was
+    // the last one still running
+    void recordExit(Job& job, size_t index, int wait_status, const ResourceUsage& usage);
+
+    // Route one wait4() result to its job through pid_index_
+    // reaped_us: CLOCK_MONOTONIC time it was collected
+    void applyChildEvent(pid_t pid, int wait_status, const struct rusage& usage, long long reaped_us);
+
+    // Wait (SIGCHLD held) until done() is true or no children are left
+    template <typename Done>
+    void waitUntil(Done&& done);
+
+    // Status of a finished or stopped job; an exited one is erased
+    int takeStatus(std::map<int, Job>::iterator it);
+
+    // Drop a job together with its pid index entries
+    std::map<int, Job>::iterator eraseJob(std::map<int, Job>::iterator it);
+
     std::map<int, Job> jobs;
-    int next_job_id = 1;
+
+    // Member pid -> job id, so each event is resolved in O(1)
+    std::unordered_map<pid_t, int> pid_index_;
+
+    // Exits of pids that were not in a job yet: a child can be reaped
+    // between fork() and addJob(). The next addJob() claims its members'
+    // entries and discards the rest
+    struct Unclaimed {
+        int status;
+        ResourceUsage usage;
+    };
+    std::unordered_map<pid_t, Unclaimed> unclaimed_;
+
+    // Helper processes still running; their exits are only collected
+    std::unordered_set<pid_t> helpers_;
+
+    bool own_children_only_ = false;
+
+    // The job fg is waiting for: reapOwnChildren() leaves its members to
+    // that wait, which also has to see them stop
+    int foreground_job_ = 0;
+
+    // Single-producer (signal handler) / single-consumer (main loop) ring.
+    // When it is full the handler stops reaping; reapPending() collects the
+    // rest itself, so no exit is lost, only delayed
+    struct ChildEvent {
+        pid_t pid;
+        int status;
+        struct rusage usage;
+        long long reaped_us;
+    };
+    static constexpr uint32_t kRingSize = 256;  // Power of two
+    ChildEvent ring_[kRingSize] = {};
+    std::atomic<uint32_t> ring_head_{0};        // Next slot the handler writes
+    std::atomic<uint32_t> ring_tail_{0};        // Next slot the main loop reads
+    static_assert(std::atomic<uint32_t>::is_always_lock_free,
+                  "the SIGCHLD ring needs lock-free atomics");
 };
 
 } // namespace helix
@@ -0,0 +1,75 @@
+#ifndef HELIX_SCRIPT_CACHE_H
+#define HELIX_SCRIPT_CACHE_H
+
+#include "ast.h"
+#include "script_parser.h"
+#include <cstddef>
+#include <ctime>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <sys/types.h>
+
+namespace helix {
+
+// ScriptCache - Script files loaded in one piece and parsed once
+// Responsibilities:
+// - Read a whole file with a single mmap() (read() for pipes and other
+//   non-regular files) instead of a getline() per line
+// - Parse `source`d files into an AST once and keep it keyed by path,
+//   revalidated with one stat(): the same device/inode, size and mtime reuse
+//   the tree, so a library sourced again (or by every subshell script) is
+//   neither re-read nor re-parsed
+// A parse that expanded an alias is not kept (the alias table may change),
+// nor is a file modified within the last second, whose mtime may not have
+// ticked yet for a change made right after the read.
+class ScriptCache {
+public:
+    struct Stats {
+        unsigned long parsed = 0;    // Files read and parsed
+        unsigned long hits = 0;      // Loads served from the cache
+    };
+
+    struct Script {
+        ScriptParser::Status status = ScriptParser::Status::OK;
+        std::shared_ptr<const ListNode> program;  // Set when status == OK
+        std::string error;                        // Message when status == ERROR
+    };
+    using ScriptPtr = std::shared_ptr<const Script>;
+
+    // The cache shared by the whole shell process
+    static ScriptCache& global();
+
+    // Whole contents of path into out; false if it cannot be opened or read
+    static bool readFile(const std::string& path, std::string& out);
+
+    // Parsed contents of path, from the cache when the file is unchanged.
+    // aliases: alias table for command words (may be nullptr). Returns
+    // nullptr if the file cannot be read
+    ScriptPtr load(const std::string& path, const std::map<std::string, std::string>* aliases);
+
+    // Drop every cached script
+    void clear();
+
+    Stats stats() const { return stats_; }
+
+private:
+    struct Entry {
+        dev_t device = 0;
+        ino_t inode = 0;
+        off_t size = 0;
+        struct timespec mtime {};
+        ScriptPtr script;
+    };
+
+    ScriptCache() = default;
+
+    ScriptParser parser_;
+    std::unordered_map<std::string, Entry> entries_;
+    Stats stats_;
+};
+
+} // namespace helix
+
+#endif // HELIX_SCRIPT_CACHE_H
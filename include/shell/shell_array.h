@@ -0,0 +1,138 @@
+#ifndef HELIX_SHELL_ARRAY_H
+#define HELIX_SHELL_ARRAY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace helix {
+
+// IndexedArray - Storage of an indexed array variable (a=(x y z), a[3]=w)
+// Responsibilities:
+// - Keep the elements in one contiguous vector indexed by subscript, with
+//   a bit per slot for the ones that are set, so ${a[i]} is a bounds check
+//   and a load and "${a[@]}" a linear walk
+// - Allow holes (unset a[1], a[10]=x) like bash's sparse arrays, but refuse
+//   an index more than kMaxGap past the end, which would only allocate
+//   empty slots
+// Unset slots past the last element are trimmed, so end() is always one
+// past the highest element and a+=(...) appends right after it.
+class IndexedArray {
+public:
+    // Largest run of empty slots one assignment may open past the end
+    static constexpr size_t kMaxGap = size_t(1) << 16;
+
+    // Element at index, or nullptr when it is not set
+    const std::string* get(size_t index) const {
+        return index < values_.size() && present_[index] ? &values_[index] : nullptr;
+    }
+
+    // Assign element index; false (nothing stored) past end() + kMaxGap
+    bool set(size_t index, std::string value);
+
+    // Assign the element after the last one
+    void append(std::string value) { set(values_.size(), std::move(value)); }
+
+    // Remove element index; returns false if it was not set
+    bool unset(size_t index);
+
+    size_t size() const { return count_; }     // Elements set
+    size_t end() const { return values_.size(); } // One past the last set index
+
+    void clear();
+
+    // Call f(index, value) for each element in index order
+    template <typename F>
+    void forEach(F&& f) const {
+        for (size_t i = 0; i < values_.size(); ++i) {
+            if (present_[i]) f(i, values_[i]);
+        }
+    }
+
+private:
+    std::vector<std::string> values_;
+    std::vector<bool> present_;
+    size_t count_ = 0;
+};
+
+// AssocArray - Storage of an associative array variable (declare -A m)
+// Responsibilities:
+// - Keep entries densely in insertion order and find them through an
+//   open-addressing table of 32-bit entry numbers (linear probing, at most
+//   3/4 full), so a lookup hashes once and compares one or two keys
+// - Leave a removed entry in place, flagged dead, so probe chains stay
+//   intact; assigning the key again revives it, and the entries are
+//   compacted once the dead outnumber the live
+// "${!m[@]}" lists keys in insertion order (bash's order is unspecified).
+class AssocArray {
+public:
+    // Value stored under key, or nullptr
+    const std::string* get(std::string_view key) const;
+
+    void set(std::string_view key, std::string value);
+
+    // Remove key; returns false if it was not set
+    bool unset(std::string_view key);
+
+    size_t size() const { return live_; }
+
+    void clear();
+
+    // Call f(key, value) for each entry in insertion order
+    template <typename F>
+    void forEach(F&& f) const {
+        for (const Entry& e : entries_) {
+            if (e.live) f(e.key, e.value);
+        }
+    }
+
+private:
+    struct Entry {
+        std::string key;
+        std::string value;
+        size_t hash;
+        bool live;
+    };
+
+    static constexpr uint32_t kEmpty = 0;  // slots_ hold entry number + 1
+
+    // Slot holding key's entry, or the empty slot where it would go
+    size_t probe(std::string_view key, size_t hash) const;
+
+    // Rebuild the slot table with room for n, dropping dead entries
+    void rebuild(size_t n);
+
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> slots_;   // Size is zero or a power of two
+    size_t live_ = 0;
+};
+
+// ShellArray - The value of an array variable, indexed or associative
+struct ShellArray {
+    explicit ShellArray(bool assoc = false) : associative(assoc) {}
+
+    bool associative;
+    IndexedArray indexed;   // Used unless associative
+    AssocArray assoc;       // Used if associative
+
+    // $a alone: element 0 (key "0" of an associative array)
+    const std::string* first() const { return associative ? assoc.get("0") : indexed.get(0); }
+
+    size_t size() const { return associative ? assoc.size() : indexed.size(); }
+
+    // Call f(key, value) for each element; indexed keys are the decimal index
+    template <typename F>
+    void forEach(F&& f) const {
+        if (associative) {
+            assoc.forEach(f);
+        } else {
+            indexed.forEach([&f](size_t i, const std::string& value) { f(std::to_string(i), value); });
+        }
+    }
+};
+
+} // namespace helix
+
+#endif // HELIX_SHELL_ARRAY_H
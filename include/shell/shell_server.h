@@ -0,0 +1,58 @@
+#ifndef HELIX_SHELL_SERVER_H
+#define HELIX_SHELL_SERVER_H
+
+#include <optional>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+namespace helix {
+
+// ShellServer - The wire side of `helix --server SOCKET`
+// Responsibilities:
+// - Listen on a UNIX stream socket only its owner can reach (created
+//   under umask 077, and the peer's uid checked on every connection where
+//   the OS can tell)
+// - Carry one request per connection: the command, the client's working
+//   directory and environment, and its stdin, stdout and stderr passed as
+//   SCM_RIGHTS descriptors, so the worker writes straight to the client's
+//   terminal, pipe or file
+// - Answer with the worker's pid when it starts and its exit status when
+//   it ends; the client forwards SIGINT, SIGTERM, SIGHUP and SIGQUIT to
+//   the worker's process group and exits with the status
+// The daemon loop itself (a warm Shell forking a worker per request) is
+// Shell::serve(); this class has no shell state.
+class ShellServer {
+public:
+    struct Request {
+        std::string command;
+        std::string cwd;
+        std::vector<std::string> environment;  // NAME=value
+        int fds[3] = {-1, -1, -1};             // The client's 0, 1 and 2
+    };
+
+    // Bind and listen at path, replacing a stale socket that nobody answers
+    // on. The descriptor is close-on-exec and non-blocking; -1 after
+    // printing why
+    static int listen(const std::string& path);
+
+    // Next connection from the owner, close-on-exec and blocking; -1 when
+    // none is pending (or it came from another user)
+    static int accept(int listener);
+
+    // Read the request of connection fd; false (nothing kept open) when
+    // it is malformed or incomplete
+    static bool receive(int fd, Request& request);
+
+    // Replies, 4 bytes each: the worker's pid, then its status
+    static bool sendPid(int fd, pid_t pid);
+    static bool sendStatus(int fd, int status);
+
+    // Client: run command on the server at path and return its status;
+    // nullopt when no server answers there, so the caller runs it locally
+    static std::optional<int> runClient(const std::string& path, const std::string& command);
+};
+
+} // namespace helix
+
+#endif // HELIX_SHELL_SERVER_H
@@ -2,45 +2,80 @@
 #define HELIX_SHELL_STATE_H
 
 #include "prompt.h"
+#include "shell/variable_store.h"
+#include "types.h"
 #include <string>
 #include <vector>
 #include <map>
 #include <set>
 #include <functional>
 #include <chrono>
+#include <memory>
+#include <cstdlib>
+#include <optional>
+#include <sys/types.h>
 
 namespace helix {
 
 // Forward declarations
 class IJobManager;
+class ICommandSubstitution;
 class Prompt;
+class HistoryStore;
+struct AstNode;
 
 // Scoped variable frame for functions
+// A local is written straight into the VariableStore; the frame only keeps
+// what it shadowed so the value is restored when the function returns.
+// Locals are kept in a flat vector: functions declare only a handful, and
+// a cleared frame keeps its capacity when the shell reuses it for the
+// next call (see Shell's frame pool)
 struct VarFrame {
-    std::map<std::string, std::string> locals;
+    struct Local {
+        std::string name;
+        std::optional<VariableStore::Variable> saved; // nullopt: was unset before
+    };
+    std::vector<Local> locals;
+
+    bool declares(const std::string& name) const {
+        for (const auto& l : locals) {
+            if (l.name == name) return true;
+        }
+        return false;
+    }
+
+    // Declare a local; the first declaration remembers the shadowed
+    // variable. The caller then assigns the value through the store
+    void declare(const std::string& name, const VariableStore& vars) {
+        if (!declares(name)) locals.push_back({name, vars.save(name)});
+    }
 };
 
 // Defined shell function
 struct ShellFunction {
     std::string name;
-    std::vector<std::string> body; // lines
+    std::shared_ptr<const AstNode> body; // Compiled once when defined; shared
+                                         // so a running call survives redefinition
+    std::string text;                    // Source of the body, for `type`
 };
 
 // ShellState - Encapsulates all shell state
 struct ShellState {
     std::string current_directory;
     std::string home_directory;
-    int last_exit_status = 0;
+    int last_exit_status = 0;       // $? (computed from this on read)
+    pid_t last_background_pid = 0;  // $! (likewise)
+    std::vector<int> pipe_status;   // $PIPESTATUS: each stage of the last foreground pipeline
+    std::vector<ResourceUsage> pipe_usage;  // $HELIX_PIPE_*: what those stages used (wait4)
     bool running = true;
 
-    std::vector<std::string> command_history;
     std::vector<std::string> dir_stack;   // pushd/popd stack
-    std::map<std::string, std::string> environment;
     std::map<std::string, std::string> aliases;
     std::map<std::string, ShellFunction> functions;
     std::set<std::string> readonly_vars;
     std::set<std::string> integer_vars;
-    // Variable stack frames for nested function calls
+    // Variables themselves live in VariableStore::global(); these are the
+    // shadowed values of each active function call's locals
     std::vector<VarFrame> var_frames;
 
     // Trap handlers: signal name -> command string
@@ -51,8 +86,8 @@ struct ShellState {
     // Set by `ai run` — shell REPL picks this up and executes it
     std::string pending_command;
 
-    // Set by `source` — shell REPL executes these lines
-    std::vector<std::string> source_lines;
+    // Set by `source` — the evaluator runs this file (see ScriptCache)
+    std::string source_path;
     bool sourcing = false;
 
     // set -e: exit on non-zero exit status
@@ -65,6 +100,9 @@ struct ShellState {
     bool noexec = false;
     // set -f: disable globbing
     bool noglob = false;
+    // set -o lastpipe: run a builtin/function/compound last pipeline stage
+    // in the shell itself instead of a forked child
+    bool lastpipe = false;
 
     // Control flow flags (set by break/continue/return)
     bool breaking = false;
@@ -84,18 +122,18 @@ struct ShellState {
     int optopt = 0;
     std::string optarg;
 
-    // HISTCONTROL: "ignoredups" | "erasedups" | ""
-    std::string histcontrol;
-    std::string last_histentry;
-
-    // Hash table: command -> full path
-    std::map<std::string, std::string> cmd_hash;
-
     // Job management (uses interface - Dependency Inversion Principle)
     IJobManager* job_manager = nullptr;
 
     // Prompt
     Prompt* prompt = nullptr;
+
+    // Command history (owned by Shell)
+    HistoryStore* history = nullptr;
+
+    // Runs $(...) in-process or in a forked Helix (set by Shell; when null
+    // the expander falls back to /bin/sh)
+    ICommandSubstitution* command_substitution = nullptr;
 };
 
 } // namespace helix
@@ -0,0 +1,39 @@
+#ifndef HELIX_STREAM_COPY_H
+#define HELIX_STREAM_COPY_H
+
+#include <vector>
+
+namespace helix {
+
+// StreamCopy - The data path of the cat and tee builtins
+// Responsibilities:
+// - Move bytes between descriptors inside the kernel where their kinds
+//   allow it: copy_file_range() file to file, splice() when either side is
+//   a pipe, sendfile() from a file to anything else; read()/write() through
+//   one buffer otherwise (and on systems without those calls)
+// - Duplicate a pipe into another pipe with tee() for the tee builtin, so
+//   `producer | tee copy | consumer` never copies the stream into user space
+//   on its way to the consumer
+// - Grow the pipes it moves data through (F_SETPIPE_SZ, see setPipeSize()),
+//   so a shipping stage is not throttled to 64 KiB per wake-up
+// File offsets advance as with read() and write(): `{ read line; cat; } < f`
+// still starts cat after the line.
+class StreamCopy {
+public:
+    // Everything from in to out; false with errno set when a read or write
+    // fails (EPIPE included)
+    static bool copy(int in, int out);
+
+    // Everything from in to out and to each of files. A file whose write
+    // fails is dropped, with its errno in errors (parallel to files, 0 for
+    // the rest); out failing stops the copy and returns false
+    static bool tee(int in, int out, const std::vector<int>& files, std::vector<int>& errors);
+
+    // Pipe size the builtins ask for on pipes they splice through when
+    // $HELIX_PIPE_SIZE does not say otherwise (the default pipe-max-size)
+    static constexpr int kPipeSize = 1 << 20;
+};
+
+} // namespace helix
+
+#endif // HELIX_STREAM_COPY_H
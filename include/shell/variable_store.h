@@ -0,0 +1,130 @@
+#ifndef HELIX_VARIABLE_STORE_H
+#define HELIX_VARIABLE_STORE_H
+
+#include "shell/shell_array.h"
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace helix {
+
+// VariableStore - Process-wide table of shell variables
+// The single source of truth for $NAME: the expander, builtins, function
+// locals and exec all go through it instead of getenv()/setenv().
+// Responsibilities:
+// - Hash name -> value with an export flag per variable; variables imported
+//   from the initial environment start out exported
+// - Count changes to exported state in a generation counter, so envp() is
+//   rebuilt only when something a child would see has changed
+// - Mirror exported changes into the process environment on request, for
+//   in-process library code (readline, popen) that still calls getenv()
+// - Hold array variables too: their elements live in a ShellArray owned by
+//   the entry, $name reads element 0, and they are never exported
+// Assigning a plain shell variable (loop counters, $REPLY, ...) touches
+// neither the process environment nor envp.
+class VariableStore {
+public:
+    struct Variable {
+        std::string value;
+        bool exported = false;
+        std::unique_ptr<ShellArray> array;   // Set for array variables; value is unused
+
+        Variable(std::string v = {}, bool e = false) : value(std::move(v)), exported(e) {}
+        Variable(const Variable& other)
+            : value(other.value), exported(other.exported),
+              array(other.array ? std::make_unique<ShellArray>(*other.array) : nullptr) {}
+        Variable(Variable&&) = default;
+        Variable& operator=(const Variable& other) {
+            if (this != &other) *this = Variable(other);
+            return *this;
+        }
+        Variable& operator=(Variable&&) = default;
+    };
+
+    // The store shared by the whole shell process, seeded from environ
+    static VariableStore& global();
+
+    // Value of name, or nullptr when it is unset (element 0 of an array)
+    const std::string* find(std::string_view name) const;
+
+    // Whole entry (value and flags), or nullptr when unset
+    const Variable* lookup(std::string_view name) const;
+
+    // Assign, keeping the export flag of an existing variable (an array
+    // gets value as element 0)
+    void set(const std::string& name, std::string value);
+
+    // Assign and set the export flag explicitly
+    void set(const std::string& name, std::string value, bool exported);
+
+    // Elements of name, or nullptr when it is unset or a scalar
+    const ShellArray* findArray(std::string_view name) const;
+
+    // Elements of name for modification. An unset name becomes an empty
+    // array of the kind asked for, a scalar element 0 (key "0") of one;
+    // nullptr if name is already an array of the other kind
+    ShellArray* makeArray(const std::string& name, bool associative);
+
+    // Mark name for export; an unset name is created empty
+    void exportVariable(const std::string& name);
+
+    // Remove name; returns false if it was not set
+    bool unset(std::string_view name);
+
+    // Make entries (NAME=value) the whole exported set: every exported
+    // variable is dropped and each entry set exported; shell variables
+    // stay (a server worker taking on its client's environment)
+    void replaceEnvironment(const std::vector<std::string>& entries);
+
+    // Snapshot of name for a later restore() (prefix assignments, locals)
+    std::optional<Variable> save(std::string_view name) const;
+    void restore(const std::string& name, std::optional<Variable> saved);
+
+    // Every variable sorted by name, exported only if requested (listings)
+    std::vector<std::pair<std::string, Variable>> sorted(bool exported_only = false) const;
+
+    // Bumped whenever the exported set or an exported value changes
+    uint64_t generation() const { return generation_; }
+
+    // NULL-terminated NAME=value array of exported variables for exec
+    // Valid until the next change to exported state
+    char* const* envp();
+
+    // Apply exported changes since the last call to the process environment
+    void syncProcessEnvironment();
+
+    // Bumped by every removal: until it moves, pointers from lookup() stay
+    // valid (assignments keep an entry in place)
+    uint64_t removals() const { return removals_; }
+
+    size_t size() const { return vars_.size(); }
+
+private:
+    VariableStore();
+
+    // Record that exported state changed for name
+    void touch(std::string_view name);
+
+    struct Hash {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+    std::unordered_map<std::string, Variable, Hash, std::equal_to<>> vars_;
+
+    uint64_t generation_ = 0;
+    uint64_t removals_ = 0;
+    uint64_t envp_generation_ = UINT64_MAX;      // Generation envp_ was built for
+    std::vector<std::string> env_strings_;       // Backing storage for envp_
+    std::vector<char*> envp_;
+    std::unordered_set<std::string> unsynced_;   // Exported names changed since syncProcessEnvironment()
+};
+
+} // namespace helix
+
+#endif // HELIX_VARIABLE_STORE_H
@@ -4,6 +4,7 @@
 #include "types.h" // Includes type definitions: Token, TokenType enum for token classification and tokenizer states.
 #include <vector> // Provides std::vector for storing the sequence of parsed tokens.
 #include <string> // Provides std::string for storing token values and manipulating substrings during tokenization.
+#include <string_view> // Provides std::string_view for zero-copy token spans.
 
 namespace helix {
 
@@ -22,18 +23,63 @@ public:
     // Returns vector of Token objects
     std::vector<Token> tokenize(const std::string& input);
 
+    // Zero-copy form of tokenize(): values are spans into input; only words
+    // that lose quotes or backslashes are copied, into a scratch buffer the
+    // tokenizer owns. input must outlive the result, which is overwritten by
+    // the next call.
+    const std::vector<TokenView>& tokenizeView(std::string_view input);
+
+    // Tokenize shell source for ScriptParser
+    // Unlike tokenize(), WORD values keep their quotes, backslashes and
+    // $(...)/${...}/`...` text verbatim - expansion removes them later, so a
+    // compiled block can be re-expanded on every run. Also emits &&, ||, ;;,
+    // ( and ), skips # comments and collects here-doc bodies into a
+    // HEREDOC_BODY token right after each delimiter word.
+    std::vector<Token> tokenizeScript(const std::string& input);
+
+    // Same, reusing out's storage (a parser that keeps its token vector
+    // between calls stops allocating once it has seen its largest input)
+    void tokenizeScript(std::string_view input, std::vector<Token>& out);
+
+    // Zero-copy form of tokenizeScript(), with the same lifetime rules as
+    // tokenizeView(); words are raw, so only a word split by a line
+    // continuation or a <<- body loses contiguity and is copied
+    const std::vector<TokenView>& tokenizeScriptView(std::string_view input);
+
+    // True if the last tokenizeScript() input ended inside a quote,
+    // substitution, line continuation or here-doc (more lines are needed)
+    bool incomplete() const { return incomplete_; }
+
+    // Given input[i] is one of ' " ` ( {, return the index just past its
+    // matching closer (nesting and inner quotes respected), or npos if the
+    // construct is unterminated. Shared with the word expander.
+    static size_t findConstructEnd(std::string_view input, size_t i);
+
+    // The items of a compound assignment list - the text between the
+    // parentheses of a=(...) - split at unquoted blanks and newlines, with
+    // # comments dropped; each keeps its quotes
+    static std::vector<std::string_view> splitList(std::string_view list);
+
 private:
-    // Main processing methods for each state
-    size_t processNormalState(const std::string& input, size_t i, std::vector<Token>& tokens,
-                             std::string& current, TokenizerState& state);
-    size_t processDoubleQuoteState(const std::string& input, size_t i,
-                                  std::string& current, TokenizerState& state);
-    size_t processSingleQuoteState(const std::string& input, size_t i,
-                                  std::string& current, TokenizerState& state);
-
-    // Helper methods for token handling
-    bool handleSpecialTokens(const std::string& input, size_t i, std::vector<Token>& tokens, std::string& current);
-    size_t getTokenLength(const std::string& input, size_t i);
+    // Script tokenizer helpers - each returns the index just past the
+    // construct, or std::string::npos if the input ends first
+    size_t scanScriptWord(std::string_view input, size_t i, std::string_view& word);
+    size_t scanScriptOperator(std::string_view input, size_t i);
+    size_t readHeredocBodies(std::string_view input, size_t i);
+
+    // Copy of text in the scratch buffer; reserve() in the entry points
+    // sizes it so that earlier views stay valid
+    std::string_view keep(std::string_view text);
+
+    struct PendingHeredoc {
+        size_t body_index;      // Index of the HEREDOC_BODY placeholder token
+        std::string delimiter;  // Delimiter with quotes removed
+        bool strip_tabs;        // <<- form
+    };
+    std::vector<PendingHeredoc> pending_heredocs_;
+    std::vector<TokenView> views_;
+    std::string scratch_;
+    bool incomplete_ = false;
 };
 
 } // namespace helix
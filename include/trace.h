@@ -0,0 +1,117 @@
+#ifndef HELIX_TRACE_H
+#define HELIX_TRACE_H
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+
+namespace helix {
+
+// Extra fields of a trace event; -1 leaves a field out
+struct TraceArgs {
+    long child = -1;     // Pid of the process forked, spawned or waited for
+    int stage = -1;      // Pipeline stage index
+    int status = -1;     // Exit status
+    long parent = -1;    // Pid of the parent, for a forked child
+};
+
+// Tracer - Opt-in timeline of what the shell spends its time on
+// Responsibilities:
+// - Record timestamped spans for the shell's own phases (history and alias
+//   expansion, tokenizing, parsing, brace and word expansion, builtin and
+//   function dispatch) and for process handling (fork, spawn, exec, wait)
+// - Record each program a stage ran as a span on the child's own pid, so a
+//   trace separates shell overhead from time spent in the commands
+// - Buffer events in a fixed per-process array, written out in one batch
+//   whenever it fills, as Chrome trace event JSON ("JSON Array Format")
+// Turned on by HELIX_TRACE=<file> in the environment. Every process appends
+// to the same file: forked children (pipeline stages, subshells) drop the
+// events inherited from the parent and buffer their own, and helix scripts
+// started from the shell inherit the variable. The file is left without its
+// closing bracket, which Chrome's about:tracing and ui.perfetto.dev accept.
+// When tracing is off a Span costs one test of a static flag.
+class Tracer {
+public:
+    // The tracer shared by the whole shell process
+    static Tracer& global();
+
+    static bool enabled() { return enabled_; }
+
+    // Monotonic clock in microseconds, the same in every process
+    static long long now();
+
+    // Start appending events to path; false if it cannot be opened
+    bool open(const std::string& path);
+
+    // Write out what is buffered and stop recording
+    void close();
+
+    // Write out what is buffered
+    void flush();
+
+    // A finished span of this process ("X" event)
+    void complete(const char* name, long long begin_us, long long end_us,
+                  std::string_view detail = {}, const TraceArgs& args = {});
+
+    // A span shown on another process's row, e.g. a program run by a stage
+    void completeFor(pid_t pid, const char* name, long long begin_us, long long end_us,
+                     std::string_view detail = {}, const TraceArgs& args = {});
+
+    // A point in time ("i" event)
+    void instant(const char* name, std::string_view detail = {}, const TraceArgs& args = {});
+
+    // Name pid's row in the viewer ("M" process_name event)
+    void nameProcess(pid_t pid, std::string_view name);
+
+    // RAII span: records [construction, destruction) when tracing is on
+    class Span {
+    public:
+        explicit Span(const char* name, std::string_view detail = {})
+            : name_(enabled_ ? name : nullptr), detail_(detail), begin_(name_ ? now() : 0) {}
+        ~Span() {
+            if (name_) global().complete(name_, begin_, now(), detail_, args_);
+        }
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+        // Fields filled in once known (the pid after a fork, a status)
+        TraceArgs& args() { return args_; }
+        void rename(const char* name) {
+            if (name_) name_ = name;
+        }
+        // Record nothing (in a forked child, whose parent owns the span)
+        void drop() { name_ = nullptr; }
+
+    private:
+        const char* name_;
+        std::string_view detail_;  // Must outlive the span
+        long long begin_;
+        TraceArgs args_;
+    };
+
+private:
+    struct Event;
+
+    Tracer() = default;
+    ~Tracer();
+
+    void push(char phase, pid_t pid, const char* name, long long ts, long long dur,
+              std::string_view detail, const TraceArgs& args);
+
+    // pthread_atfork child handler: the parent writes what it buffered
+    static void afterFork();
+    static void flushAtExit();
+
+    static inline bool enabled_ = false;
+
+    int fd_ = -1;
+    pid_t pid_ = 0;
+    std::unique_ptr<Event[]> events_;  // Allocated by open()
+    size_t used_ = 0;
+};
+
+} // namespace helix
+
+#endif // HELIX_TRACE_H
@@ -3,7 +3,9 @@
 
 #include <vector> // Provides std::vector for storing command arguments in Command struct and sequence of commands in pipelines.
 #include <string> // Provides std::string for storing token values, filenames, job commands, and other string data.
+#include <string_view> // Provides std::string_view for TokenView spans into the tokenized input.
 #include <map> // Provides std::map for storing key-value pairs in shell environment variables (though currently not used directly here).
+#include <sys/resource.h> // Provides struct rusage, filled in by wait4() for every reaped child.
 
 namespace helix {
 
@@ -15,22 +17,84 @@ enum class JobStatus {
     TERMINATED
 };
 
+// One redirection operator and its target
+struct Redirection {
+    enum class Kind {
+        INPUT,          // < file
+        OUTPUT,         // > file (also >| and 1>)
+        APPEND,         // >> file
+        ERROR,          // 2> file
+        ERROR_APPEND,   // 2>> file
+        ERR_TO_OUT,     // 2>&1
+        OUT_TO_ERR,     // >&2 or 1>&2
+        BOTH,           // &> file
+        BOTH_APPEND,    // &>> file
+        HEREDOC,        // << delimiter
+        HEREDOC_STRIP,  // <<- delimiter
+        HERESTRING,     // <<< word
+    DUP_OUT,        // >&N: stdout becomes a copy of descriptor N
+    DUP_IN          // <&N: stdin becomes a copy of descriptor N
+    };
+
+    Kind kind;
+    std::string target;             // File name, here-doc delimiter or here-string word
+    std::string body;               // Here-doc content (HEREDOC / HEREDOC_STRIP)
+
+    bool isHeredoc() const { return kind == Kind::HEREDOC || kind == Kind::HEREDOC_STRIP; }
+};
+
 // Command structure representing a single command with redirections
+// Redirections live in a side list in source order and are applied in that
+// order, so a command without any (the common case) carries an empty vector
+// instead of a dozen inline strings and flags
 struct Command {
     std::vector<std::string> args;  // Command arguments, args[0] is the binary
-    std::string input_file;         // Input redirection file (<)
-    std::string output_file;        // Output redirection file (> or >>)
-    bool append_mode = false;       // True if using >> (append), false if > (overwrite)
-    std::string error_file;         // Error redirection file (2>)
-    bool error_append_mode = false; // True if using 2>> (append error)
-    bool stderr_to_stdout = false;  // True if 2>&1
-    bool both_to_file = false;      // True if &> or &>>
-    bool both_append = false;       // True if &>>
-    std::string heredoc_delim;      // Here-doc delimiter (if used)
-    std::string heredoc_content;    // Accumulated here-doc content
-    bool heredoc_strip = false;     // True if <<-
-    std::string herestring;         // Here-string content <<<
+    std::vector<Redirection> redirections;
     bool background = false;        // True if command should run in background (&)
+    bool pre_expanded = false;      // True if the shell already expanded and globbed args
+
+    void redirect(Redirection::Kind kind, std::string target = {}, std::string body = {}) {
+        redirections.push_back({kind, std::move(target), std::move(body)});
+    }
+
+    // Last redirection of the given kind, or nullptr
+    const Redirection* findRedirection(Redirection::Kind kind) const {
+        for (auto it = redirections.rbegin(); it != redirections.rend(); ++it) {
+            if (it->kind == kind) return &*it;
+        }
+        return nullptr;
+    }
+};
+
+// Resources one child used, from the rusage wait4() returns with it
+// Times are in microseconds; real is the wall time from start to reap, 0
+// when it was not measured
+struct ResourceUsage {
+    long long real_us = 0;
+    long long user_us = 0;
+    long long sys_us = 0;
+    long max_rss_kb = 0;             // Peak resident set size
+    long voluntary_switches = 0;     // Gave up the CPU (I/O, sleeping)
+    long involuntary_switches = 0;   // Preempted
+    long blocks_in = 0;              // Block input operations
+    long blocks_out = 0;             // Block output operations
+
+    static ResourceUsage from(const struct rusage& ru, long long real_us = 0) {
+        ResourceUsage u;
+        u.real_us = real_us;
+        u.user_us = ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec;
+        u.sys_us = ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+#ifdef __APPLE__
+        u.max_rss_kb = ru.ru_maxrss / 1024;  // Bytes on macOS
+#else
+        u.max_rss_kb = ru.ru_maxrss;
+#endif
+        u.voluntary_switches = ru.ru_nvcsw;
+        u.involuntary_switches = ru.ru_nivcsw;
+        u.blocks_in = ru.ru_inblock;
+        u.blocks_out = ru.ru_oublock;
+        return u;
+    }
 };
 
 // Job structure for tracking background/foreground processes
@@ -39,6 +103,10 @@ struct Job {
     pid_t pgid = 0;                // Process group ID
     std::string command;            // Original command string
     JobStatus status = JobStatus::RUNNING;
+    std::vector<pid_t> pids;        // Member processes in pipeline order
+    std::vector<int> stage_status;  // Exit status per member, -1 while running
+    std::vector<ResourceUsage> stage_usage;  // Per member, filled in as each is reaped
+    long long started_us = 0;       // CLOCK_MONOTONIC when the job was added
 };
 
 // Pipeline structure for a sequence of commands connected by pipes
@@ -63,13 +131,22 @@ enum class TokenType {
     REDIRECT_ERR,         // 2>
     REDIRECT_ERR_APPEND,  // 2>>
     REDIRECT_ERR_TO_OUT,  // 2>&1
+    REDIRECT_OUT_TO_ERR,  // >&2 or 1>&2
     REDIRECT_BOTH,        // &>
     REDIRECT_BOTH_APPEND, // &>>
+    REDIRECT_OUT_DUP,     // >& (script tokenizer only; the descriptor is the next word)
+    REDIRECT_IN_DUP,      // <& (script tokenizer only)
     HEREDOC,              // <<
     HEREDOC_STRIP,        // <<-
     HERESTRING,           // <<<
+    HEREDOC_BODY,         // collected here-doc text (follows the delimiter word)
     BACKGROUND,           // &
     SEMICOLON,            // ;
+    AND_IF,               // && (script tokenizer only)
+    OR_IF,                // || (script tokenizer only)
+    DSEMI,                // ;; case arm terminator (script tokenizer only)
+    LPAREN,               // ( (script tokenizer only)
+    RPAREN,               // ) (script tokenizer only)
     NEWLINE,              // newline inside multi-line input
     END_OF_INPUT          // End of input marker
 };
@@ -78,6 +155,16 @@ enum class TokenType {
 struct Token {
     TokenType type;
     std::string value;
+    size_t offset = 0;              // Byte offset in the source (script tokenizer)
+};
+
+// Token whose value is a span into the tokenized input, or into the
+// tokenizer's scratch buffer for words that needed unquoting; valid until
+// the next call on the same Tokenizer (see Tokenizer::tokenizeView)
+struct TokenView {
+    TokenType type;
+    std::string_view value;
+    size_t offset = 0;              // Byte offset in the source
 };
 
 } // namespace helix
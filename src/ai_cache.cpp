@@ -0,0 +1,193 @@
+#include "ai_cache.h"
+#include "shell/variable_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// First line of every entry; bump it when the layout changes
+constexpr std::string_view kMagic = "helix-ai-cache 1\n";
+
+// Stamp file whose mtime records the last prune
+constexpr const char* kPruneStamp = ".pruned";
+constexpr time_t kPruneInterval = 3600;
+
+uint64_t fnv1a(const std::string& text, uint64_t basis) {
+    uint64_t h = basis;
+    for (char c : text) {
+        h ^= static_cast<unsigned char>(c);
+        h *= 1099511628211ull;
+    }
+    // Final avalanche, so entries spread over the whole name
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    return h;
+}
+
+void appendHex(std::string& out, uint64_t value) {
+    static const char digits[] = "0123456789abcdef";
+    for (int shift = 60; shift >= 0; shift -= 4) out += digits[(value >> shift) & 0xF];
+}
+
+// mkdir -p, private to the user: replies may quote their files
+bool makeDirectories(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0) return S_ISDIR(st.st_mode);
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0 && !makeDirectories(path.substr(0, slash))) return false;
+    return mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+bool readFile(const std::string& path, std::string& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    char buf[16384];
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof buf)) > 0) out.append(buf, static_cast<size_t>(n));
+    close(fd);
+    return n == 0;
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t n = write(fd, data.data() + done, data.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        done += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool expired(const struct stat& st, std::chrono::seconds ttl) {
+    return time(nullptr) - st.st_mtime >= ttl.count();
+}
+
+} // namespace
+
+// ── Configuration ────────────────────────────────────────────────────────────
+
+std::string AiResponseCache::defaultDirectory() {
+    VariableStore& vars = VariableStore::global();
+    if (const std::string* dir = vars.find("HELIX_AI_CACHE_DIR"); dir && !dir->empty()) return *dir;
+    if (const std::string* xdg = vars.find("XDG_CACHE_HOME"); xdg && !xdg->empty()) return *xdg + "/helix/ai";
+    if (const std::string* home = vars.find("HOME"); home && !home->empty()) return *home + "/.cache/helix/ai";
+    return "";
+}
+
+std::chrono::seconds AiResponseCache::defaultTtl() {
+    const std::string* ttl = VariableStore::global().find("HELIX_AI_CACHE_TTL");
+    if (!ttl || ttl->empty()) return std::chrono::hours(24);
+    return std::chrono::seconds(std::max(0L, std::atol(ttl->c_str())));
+}
+
+// ── Keys ─────────────────────────────────────────────────────────────────────
+
+std::string AiResponseCache::keyFor(const AiProvider& provider, const std::string& system_prompt,
+                                    const std::string& user_message, int max_tokens) {
+    // NUL-separated: none of the parts can contain one, so no two
+    // different queries produce the same key
+    std::string key;
+    for (const std::string* part : {&provider.name, &provider.model, &provider.base_url,
+                                    &system_prompt, &user_message}) {
+        key += *part;
+        key += '\0';
+    }
+    key += std::to_string(max_tokens);
+    return key;
+}
+
+std::string AiResponseCache::digest(const std::string& key) {
+    std::string name;
+    name.reserve(32);
+    appendHex(name, fnv1a(key, 14695981039346656037ull));
+    appendHex(name, fnv1a(key, 0x6c62272e07bb0142ull));
+    return name;
+}
+
+std::string AiResponseCache::pathFor(const std::string& key) const {
+    return directory_ + "/" + digest(key);
+}
+
+// ── Entries ──────────────────────────────────────────────────────────────────
+
+// An entry: kMagic, the key's length and a newline, the key, the reply
+std::optional<std::string> AiResponseCache::lookup(const std::string& key) const {
+    if (!enabled()) return std::nullopt;
+    std::string path = pathFor(key);
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return std::nullopt;
+    if (expired(st, ttl_)) {
+        unlink(path.c_str());
+        return std::nullopt;
+    }
+
+    std::string data;
+    if (!readFile(path, data) || data.compare(0, kMagic.size(), kMagic) != 0) return std::nullopt;
+    size_t eol = data.find('\n', kMagic.size());
+    if (eol == std::string::npos) return std::nullopt;
+    size_t length = std::strtoul(data.c_str() + kMagic.size(), nullptr, 10);
+    if (data.size() - eol - 1 < length || data.compare(eol + 1, length, key) != 0) return std::nullopt;
+    return data.substr(eol + 1 + length);
+}
+
+bool AiResponseCache::store(const std::string& key, const std::string& reply) {
+    if (!enabled() || !makeDirectories(directory_)) return false;
+
+    std::string data(kMagic);
+    data += std::to_string(key.size());
+    data += '\n';
+    data += key;
+    data += reply;
+
+    std::string path = pathFor(key);
+    std::string temp = path + ".tmp." + std::to_string(getpid());
+    int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return false;
+    bool ok = writeAll(fd, data);
+    ok = close(fd) == 0 && ok;
+    if (!ok || rename(temp.c_str(), path.c_str()) != 0) {
+        unlink(temp.c_str());
+        return false;
+    }
+
+    // Sweep expired entries now and then; the stamp's mtime says when
+    std::string stamp = directory_ + "/" + kPruneStamp;
+    struct stat st;
+    if (stat(stamp.c_str(), &st) != 0 || time(nullptr) - st.st_mtime >= kPruneInterval) {
+        int stamp_fd = open(stamp.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0600);
+        if (stamp_fd >= 0) {
+            futimens(stamp_fd, nullptr);
+            close(stamp_fd);
+        }
+        prune();
+    }
+    return true;
+}
+
+size_t AiResponseCache::prune() {
+    DIR* dir = opendir(directory_.c_str());
+    if (!dir) return 0;
+    size_t removed = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode)) continue;
+        // Leftover temporaries of a crashed writer go too, once expired
+        if (expired(st, ttl_) && unlinkat(dirfd(dir), entry->d_name, 0) == 0) ++removed;
+    }
+    closedir(dir);
+    return removed;
+}
+
+} // namespace helix
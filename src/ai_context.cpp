@@ -0,0 +1,226 @@
+#include "ai_context.h"
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <mutex>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unordered_map>
+
+namespace helix {
+
+namespace {
+
+// Snapshots kept before the map is cleared; one per directory visited
+constexpr size_t kMaxSnapshots = 32;
+
+struct timespec mtimeOf(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return {};
+#if defined(__APPLE__)
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+bool sameTime(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// .git/HEAD of the repository containing directory, or empty; a .git file
+// (worktrees, submodules) names the real git directory
+std::string findHead(const std::string& directory) {
+    std::string dir = directory;
+    while (!dir.empty()) {
+        std::string dot_git = dir + "/.git";
+        struct stat st;
+        if (stat(dot_git.c_str(), &st) == 0) {
+            if (S_ISDIR(st.st_mode)) return dot_git + "/HEAD";
+            std::ifstream file(dot_git);
+            std::string line;
+            if (std::getline(file, line) && line.rfind("gitdir: ", 0) == 0) {
+                std::string git_dir = line.substr(8);
+                if (!git_dir.empty() && git_dir[0] != '/') git_dir = dir + "/" + git_dir;
+                return git_dir + "/HEAD";
+            }
+            return "";
+        }
+        size_t slash = dir.find_last_of('/');
+        if (slash == std::string::npos) break;
+        dir.resize(slash);
+    }
+    return "";
+}
+
+// Branch name, or the short hash of a detached HEAD
+std::string readBranch(const std::string& head_path) {
+    std::ifstream file(head_path);
+    std::string line;
+    if (!file || !std::getline(file, line)) return "";
+    if (line.rfind("ref: refs/heads/", 0) == 0) return line.substr(16);
+    return line.substr(0, 7);
+}
+
+bool stillValid(const AiContext::Snapshot& snapshot) {
+    if (!sameTime(mtimeOf(snapshot.directory), snapshot.directory_mtime)) return false;
+    return snapshot.head_path.empty() || sameTime(mtimeOf(snapshot.head_path), snapshot.head_mtime);
+}
+
+} // namespace
+
+struct AiContext::Shared {
+    std::mutex mutex;
+    std::condition_variable work;   // Prompt -> worker: queued is set
+    std::condition_variable done;   // Worker -> query: a snapshot is stored
+    std::string queued;             // Directory to gather next
+    std::string gathering;          // Directory being gathered now
+    std::unordered_map<std::string, Snapshot> snapshots;
+    bool active = false;            // A query has been made
+    bool started = false;
+    bool stopping = false;
+
+    // Empty strings mean "nothing queued"; an unknown cwd is never waited on
+    bool busyWith(const std::string& directory) const {
+        return !directory.empty() && (queued == directory || gathering == directory);
+    }
+
+    void keep(Snapshot snapshot) {
+        if (snapshots.size() >= kMaxSnapshots) snapshots.clear();
+        std::string key = snapshot.directory;
+        snapshots[key] = std::move(snapshot);
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            work.wait(lock, [this] { return stopping || !queued.empty(); });
+            if (stopping) return;
+            gathering = std::move(queued);
+            queued.clear();
+
+            lock.unlock();
+            Snapshot snapshot = gather(gathering);
+            lock.lock();
+
+            keep(std::move(snapshot));
+            gathering.clear();
+            done.notify_all();
+        }
+    }
+};
+
+AiContext& AiContext::global() {
+    static AiContext context;
+    return context;
+}
+
+AiContext::AiContext() : shared_(std::make_shared<Shared>()) {}
+
+AiContext::~AiContext() {
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->stopping = true;
+    }
+    shared_->work.notify_all();
+    // The worker keeps Shared alive and exits after its current listing
+}
+
+// ── Gathering ────────────────────────────────────────────────────────────────
+
+AiContext::Snapshot AiContext::gather(const std::string& directory) {
+    Snapshot snapshot;
+    snapshot.directory = directory;
+    // mtimes first: a change made while listing shows up as stale later
+    snapshot.directory_mtime = mtimeOf(directory);
+    snapshot.head_path = findHead(directory);
+    if (!snapshot.head_path.empty()) {
+        snapshot.head_mtime = mtimeOf(snapshot.head_path);
+        snapshot.branch = readBranch(snapshot.head_path);
+    }
+
+    DIR* dir = opendir(directory.c_str());
+    if (!dir) return snapshot;
+    std::vector<std::string> names;
+    while (struct dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') continue;
+        std::string name = entry->d_name;
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat st;
+            is_dir = fstatat(dirfd(dir), entry->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+        if (is_dir) name += '/';
+        names.push_back(std::move(name));
+    }
+    closedir(dir);
+
+    // Sorted, so the same directory always renders (and caches) the same
+    size_t shown = std::min(names.size(), kMaxListed);
+    std::partial_sort(names.begin(), names.begin() + static_cast<std::ptrdiff_t>(shown), names.end());
+    for (size_t i = 0; i < shown; ++i) {
+        snapshot.listing += names[i];
+        snapshot.listing += '\n';
+    }
+    if (names.size() > shown) {
+        snapshot.listing += "(" + std::to_string(names.size() - shown) + " more)\n";
+    }
+    return snapshot;
+}
+
+// ── Prefetch ─────────────────────────────────────────────────────────────────
+
+void AiContext::prefetch(const std::string& directory) {
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    if (directory.empty() || !shared_->active || shared_->stopping || shared_->busyWith(directory)) return;
+    auto it = shared_->snapshots.find(directory);
+    if (it != shared_->snapshots.end() && stillValid(it->second)) return;
+
+    shared_->queued = directory;
+    if (!shared_->started) {
+        shared_->started = true;
+        auto shared = shared_;
+        // Signals stay with the main thread (readline, SIGCHLD, SIGINT)
+        sigset_t all, saved;
+        sigfillset(&all);
+        pthread_sigmask(SIG_BLOCK, &all, &saved);
+        std::thread([shared] { shared->run(); }).detach();
+        pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+    }
+    shared_->work.notify_one();
+}
+
+AiContext::Snapshot AiContext::get(const std::string& directory) {
+    {
+        std::unique_lock<std::mutex> lock(shared_->mutex);
+        shared_->active = true;
+        // Half a listing is no use; a prefetch under way finishes first
+        shared_->done.wait(lock, [&] { return !shared_->busyWith(directory); });
+        auto it = shared_->snapshots.find(directory);
+        if (it != shared_->snapshots.end() && stillValid(it->second)) return it->second;
+    }
+
+    Snapshot snapshot = gather(directory);
+    std::lock_guard<std::mutex> lock(shared_->mutex);
+    shared_->keep(snapshot);
+    return snapshot;
+}
+
+// ── Rendering ────────────────────────────────────────────────────────────────
+
+std::string AiContext::describe(const Snapshot& snapshot, const std::vector<std::string>& history) {
+    std::string text = "Current directory: " + snapshot.directory + "\n";
+    if (!snapshot.branch.empty()) text += "Git branch: " + snapshot.branch + "\n";
+    if (!snapshot.listing.empty()) text += "Files:\n" + snapshot.listing;
+    if (!history.empty()) {
+        text += "Recent commands:\n";
+        for (const std::string& line : history) text += line + "\n";
+    }
+    return text;
+}
+
+} // namespace helix
@@ -1,170 +1,352 @@
 #include "ai_provider.h"
-#include <array>
-#include <cstdlib>
-#include <memory>
+#include "http_client.h"
+#include "json.h"
+#include "shell/variable_store.h"
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
 
 namespace helix {
 
-static std::string runCurl(const std::string& cmd) {
-    std::array<char, 256> buf;
-    std::string out;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
-    if (!pipe) return "";
-    while (fgets(buf.data(), buf.size(), pipe.get())) out += buf.data();
-    return out;
+namespace {
+
+// Bytes of a response kept to explain a failure
+constexpr size_t kMaxErrorBody = 64 * 1024;
+
+// ── Ctrl-C ───────────────────────────────────────────────────────────────────
+
+volatile std::sig_atomic_t g_cancel = 0;
+
+void onInterrupt(int) {
+    g_cancel = 1;
 }
 
-static std::string jsonEscape(const std::string& s) {
-    std::string out;
-    for (char c : s) {
-        if      (c == '"')  out += "\\\"";
-        else if (c == '\\') out += "\\\\";
-        else if (c == '\n') out += "\\n";
-        else if (c == '\t') out += "\\t";
-        else                out += c;
+// SIGINT sets g_cancel while a query runs, instead of killing the shell;
+// no SA_RESTART, so a blocked poll() returns at once
+class InterruptScope {
+public:
+    InterruptScope() {
+        g_cancel = 0;
+        struct sigaction sa {};
+        sa.sa_handler = onInterrupt;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGINT, &sa, &saved_);
     }
-    return out;
+    ~InterruptScope() { sigaction(SIGINT, &saved_, nullptr); }
+    InterruptScope(const InterruptScope&) = delete;
+    InterruptScope& operator=(const InterruptScope&) = delete;
+
+private:
+    struct sigaction saved_ {};
+};
+
+// ── Streams ──────────────────────────────────────────────────────────────────
+
+// Splits a streamed body into events as bytes arrive: server-sent events
+// ("data:" lines up to a blank line) or one JSON document per line
+class EventStream {
+public:
+    EventStream(bool sse, std::function<void(std::string_view)> on_event)
+        : sse_(sse), on_event_(std::move(on_event)) {}
+
+    void feed(std::string_view bytes) {
+        pending_.append(bytes);
+        size_t start = 0, eol;
+        while ((eol = pending_.find('\n', start)) != std::string::npos) {
+            line(std::string_view(pending_).substr(start, eol - start));
+            start = eol + 1;
+        }
+        pending_.erase(0, start);
+    }
+
+    // End of the body: whatever is left is the last event
+    void finish() {
+        if (!pending_.empty()) line(pending_);
+        pending_.clear();
+        line({});
+    }
+
+private:
+    void line(std::string_view text) {
+        if (!text.empty() && text.back() == '\r') text.remove_suffix(1);
+        if (!sse_) {
+            if (!text.empty()) on_event_(text);
+            return;
+        }
+        if (text.empty()) {
+            if (!data_.empty()) on_event_(data_);
+            data_.clear();
+        } else if (text.rfind("data:", 0) == 0) {
+            text.remove_prefix(5);
+            if (!text.empty() && text.front() == ' ') text.remove_prefix(1);
+            if (!data_.empty()) data_ += '\n';
+            data_.append(text);
+        }
+    }
+
+    bool sse_;
+    std::function<void(std::string_view)> on_event_;
+    std::string pending_;  // Bytes after the last newline
+    std::string data_;     // The SSE event being assembled
+};
+
+// ── Providers ────────────────────────────────────────────────────────────────
+
+// Provider-specific streaming request for one question
+HttpClient::Request buildRequest(const AiProvider& p, const std::string& system_prompt,
+                                 const std::string& user_msg, int max_tokens) {
+    HttpClient::Request request;
+    request.url = p.base_url;
+    request.headers.emplace_back("content-type", "application/json");
+    std::string tokens = std::to_string(max_tokens);
+    std::string system = JsonValue::escape(system_prompt);
+    std::string user = JsonValue::escape(user_msg);
+
+    if (p.name == "anthropic") {
+        request.headers.emplace_back("anthropic-version", "2023-06-01");
+        request.headers.emplace_back("x-api-key", p.api_key);
+        request.body = "{\"model\":\"" + JsonValue::escape(p.model) + "\",\"max_tokens\":" + tokens +
+                       ",\"stream\":true,\"system\":\"" + system +
+                       "\",\"messages\":[{\"role\":\"user\",\"content\":\"" + user + "\"}]}";
+    } else if (p.name == "google") {
+        request.headers.emplace_back("x-goog-api-key", p.api_key);
+        request.body = "{\"contents\":[{\"parts\":[{\"text\":\"" +
+                       JsonValue::escape(system_prompt + "\n" + user_msg) + "\"}]}],"
+                       "\"generationConfig\":{\"maxOutputTokens\":" + tokens + "}}";
+    } else {
+        // openai, groq and ollama share the chat format
+        if (p.name != "ollama") request.headers.emplace_back("Authorization", "Bearer " + p.api_key);
+        request.body = "{\"model\":\"" + JsonValue::escape(p.model) + "\"," +
+                       (p.name == "ollama" ? std::string() : "\"max_tokens\":" + tokens + ",") +
+                       "\"stream\":true,\"messages\":["
+                       "{\"role\":\"system\",\"content\":\"" + system + "\"},"
+                       "{\"role\":\"user\",\"content\":\"" + user + "\"}]}";
+    }
+    return request;
+}
+
+// The text an event adds to the reply (empty for other events)
+const std::string& eventText(const AiProvider& p, const JsonValue& event) {
+    if (p.name == "anthropic") return event.find({"delta", "text"});
+    if (p.name == "google") return event.find({"candidates", "0", "content", "parts", "0", "text"});
+    if (p.name == "ollama") return event.find({"message", "content"});
+    return event.find({"choices", "0", "delta", "content"});
+}
+
+// The message of an error document, in any provider's shape
+std::string errorMessage(const JsonValue& doc) {
+    if (const std::string& m = doc.find({"error", "message"}); !m.empty()) return m;
+    if (const std::string& m = doc.find({"error"}); !m.empty()) return m;
+    return doc.find({"message"});
 }
 
-static std::string extractJsonString(const std::string& json, const std::string& key) {
-    std::string needle = "\"" + key + "\":\"";
-    size_t pos = json.find(needle);
-    if (pos == std::string::npos) return "";
-    pos += needle.size();
-    size_t end = pos;
-    while (end < json.size()) {
-        if (json[end] == '"' && (end == 0 || json[end-1] != '\\')) break;
-        ++end;
-    }
-    std::string raw = json.substr(pos, end - pos);
-    std::string clean;
-    for (size_t i = 0; i < raw.size(); ++i) {
-        if (raw[i] == '\\' && i+1 < raw.size()) {
-            switch (raw[i+1]) {
-                case 'n':  clean += '\n'; ++i; break;
-                case 't':  clean += '\t'; ++i; break;
-                case '"':  clean += '"';  ++i; break;
-                case '\\': clean += '\\'; ++i; break;
-                default:   clean += raw[i]; break;
-            }
-        } else {
-            clean += raw[i];
+bool proxyConfigured(bool tls) {
+    const char* const names[] = {"all_proxy", "ALL_PROXY", tls ? "https_proxy" : "http_proxy",
+                                 tls ? "HTTPS_PROXY" : "http_proxy"};
+    for (const char* name : names) {
+        const std::string* value = VariableStore::global().find(name);
+        if (value && !value->empty()) return true;
+    }
+    return false;
+}
+
+// The request through curl(1), streaming its stdout to on_body; for https
+// without libssl, and for proxies (which curl reads from the environment)
+bool sendWithCurl(const HttpClient::Request& request, const HttpClient::BodyFn& on_body, std::string& error) {
+    std::vector<std::string> args = {"curl", "-sSN", "-X", request.method, request.url};
+    for (const auto& [name, value] : request.headers) {
+        args.push_back("-H");
+        args.push_back(name + ": " + value);
+    }
+    args.push_back("--data-binary");
+    args.push_back(request.body);
+    std::vector<char*> argv;
+    for (auto& a : args) argv.push_back(a.data());
+    argv.push_back(nullptr);
+
+    int out[2];
+    if (pipe(out) != 0) {
+        error = "pipe failed";
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, out[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, out[0]);
+    posix_spawn_file_actions_addclose(&actions, out[1]);
+    VariableStore::global().syncProcessEnvironment();  // curl reads proxy settings from environ
+    pid_t pid;
+    int rc = posix_spawnp(&pid, "curl", &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(out[1]);
+    if (rc != 0) {
+        close(out[0]);
+        error = "curl not found";
+        return false;
+    }
+
+    char buf[16 * 1024];
+    for (;;) {
+        if (g_cancel) {
+            kill(pid, SIGTERM);
+            break;
         }
+        struct pollfd p = {out[0], POLLIN, 0};
+        if (poll(&p, 1, 100) <= 0) continue;
+        ssize_t n = read(out[0], buf, sizeof buf);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        if (!on_body(std::string_view(buf, static_cast<size_t>(n)))) break;
     }
-    return clean;
+    close(out[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR) {}
+    if (!g_cancel && WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+        error = "curl failed (exit " + std::to_string(WEXITSTATUS(status)) + ")";
+    }
+    return error.empty();
+}
+
+} // namespace
+
+// Shell variable by name (nullptr when unset); keys need not be exported
+static const char* variable(const char* name) {
+    const std::string* value = VariableStore::global().find(name);
+    return value ? value->c_str() : nullptr;
 }
 
 AiProvider detectAiProvider() {
     AiProvider p;
 
-    const char* provider_env = getenv("HELIX_AI_PROVIDER");
+    const char* provider_env = variable("HELIX_AI_PROVIDER");
     std::string provider = provider_env ? provider_env : "";
 
     if (provider.empty()) {
-        if      (getenv("ANTHROPIC_API_KEY"))                          provider = "anthropic";
-        else if (getenv("OPENAI_API_KEY"))                             provider = "openai";
-        else if (getenv("GOOGLE_API_KEY") || getenv("GEMINI_API_KEY")) provider = "google";
-        else if (getenv("GROQ_API_KEY"))                               provider = "groq";
+        if      (variable("ANTHROPIC_API_KEY"))                          provider = "anthropic";
+        else if (variable("OPENAI_API_KEY"))                             provider = "openai";
+        else if (variable("GOOGLE_API_KEY") || variable("GEMINI_API_KEY")) provider = "google";
+        else if (variable("GROQ_API_KEY"))                               provider = "groq";
         else                                                            provider = "ollama";
     }
 
-    const char* model_env = getenv("HELIX_AI_MODEL");
+    const char* model_env = variable("HELIX_AI_MODEL");
 
     if (provider == "anthropic") {
         p.name    = "anthropic";
         p.model   = model_env ? model_env : "claude-haiku-4-5-20251001";
-        const char* k = getenv("ANTHROPIC_API_KEY");
+        const char* k = variable("ANTHROPIC_API_KEY");
         p.api_key = k ? k : "";
         p.base_url = "https://api.anthropic.com/v1/messages";
 
     } else if (provider == "openai") {
         p.name    = "openai";
         p.model   = model_env ? model_env : "gpt-4o-mini";
-        const char* k = getenv("OPENAI_API_KEY");
+        const char* k = variable("OPENAI_API_KEY");
         p.api_key = k ? k : "";
         p.base_url = "https://api.openai.com/v1/chat/completions";
 
     } else if (provider == "google") {
         p.name    = "google";
         p.model   = model_env ? model_env : "gemini-2.0-flash";
-        const char* k = getenv("GOOGLE_API_KEY");
-        if (!k) k = getenv("GEMINI_API_KEY");
+        const char* k = variable("GOOGLE_API_KEY");
+        if (!k) k = variable("GEMINI_API_KEY");
         p.api_key = k ? k : "";
         p.base_url = "https://generativelanguage.googleapis.com/v1beta/models/"
-                     + p.model + ":generateContent?key=" + p.api_key;
+                     + p.model + ":streamGenerateContent?alt=sse";
 
     } else if (provider == "groq") {
         p.name    = "groq";
         p.model   = model_env ? model_env : "llama3-8b-8192";
-        const char* k = getenv("GROQ_API_KEY");
+        const char* k = variable("GROQ_API_KEY");
         p.api_key = k ? k : "";
         p.base_url = "https://api.groq.com/openai/v1/chat/completions";
 
     } else {
         p.name    = "ollama";
         p.model   = model_env ? model_env : "llama3";
-        p.base_url = "http://localhost:11434/api/chat";
+        // OLLAMA_HOST as ollama itself reads it: host:port or a URL
+        const char* host = variable("OLLAMA_HOST");
+        std::string base = host && *host ? host : "localhost:11434";
+        if (base.find("://") == std::string::npos) base = "http://" + base;
+        while (!base.empty() && base.back() == '/') base.pop_back();
+        p.base_url = base + "/api/chat";
     }
 
+    // An OpenAI-compatible gateway, a self-hosted endpoint, ...
+    if (const char* url = variable("HELIX_AI_URL"); url && *url) p.base_url = url;
     return p;
 }
 
-std::string callAiProvider(const AiProvider& p,
-                             const std::string& system_prompt,
-                             const std::string& user_msg,
-                             int max_tokens) {
-    std::string body, curl_cmd, response;
+AiResponse queryAiProvider(const AiProvider& p,
+                           const std::string& system_prompt,
+                           const std::string& user_msg,
+                           int max_tokens,
+                           const AiTextFn& on_text) {
+    AiResponse out;
+    HttpClient::Request request = buildRequest(p, system_prompt, user_msg, max_tokens);
+    bool tls = request.url.rfind("https://", 0) == 0;
 
-    if (p.name == "anthropic") {
-        body = "{\"model\":\"" + p.model + "\","
-               "\"max_tokens\":" + std::to_string(max_tokens) + ","
-               "\"system\":\"" + jsonEscape(system_prompt) + "\","
-               "\"messages\":[{\"role\":\"user\",\"content\":\""
-               + jsonEscape(user_msg) + "\"}]}";
-        curl_cmd = "curl -s " + p.base_url
-                 + " -H 'content-type: application/json'"
-                   " -H 'anthropic-version: 2023-06-01'"
-                   " -H 'x-api-key: " + p.api_key + "'"
-                   " -d '" + body + "'";
-        response = runCurl(curl_cmd);
-        return extractJsonString(response, "text");
-
-    } else if (p.name == "openai" || p.name == "groq") {
-        body = "{\"model\":\"" + p.model + "\","
-               "\"max_tokens\":" + std::to_string(max_tokens) + ","
-               "\"messages\":["
-               "{\"role\":\"system\",\"content\":\"" + jsonEscape(system_prompt) + "\"},"
-               "{\"role\":\"user\",\"content\":\"" + jsonEscape(user_msg) + "\"}]}";
-        curl_cmd = "curl -s " + p.base_url
-                 + " -H 'content-type: application/json'"
-                   " -H 'Authorization: Bearer " + p.api_key + "'"
-                   " -d '" + body + "'";
-        response = runCurl(curl_cmd);
-        return extractJsonString(response, "content");
+    std::string raw;  // The start of the body, to explain a failure
+    auto on_event = [&](std::string_view data) {
+        JsonValue event;
+        if (data == "[DONE]" || !JsonValue::parse(data, event)) return;
+        const std::string& text = eventText(p, event);
+        if (!text.empty()) {
+            out.text += text;
+            if (on_text) on_text(text);
+        } else if (std::string message = errorMessage(event); !message.empty()) {
+            out.error = message;
+        }
+    };
+    EventStream stream(p.name != "ollama", on_event);
+    auto on_body = [&](std::string_view bytes) {
+        if (raw.size() < kMaxErrorBody) raw.append(bytes.substr(0, kMaxErrorBody - raw.size()));
+        stream.feed(bytes);
+        return true;
+    };
 
-    } else if (p.name == "google") {
-        body = "{\"contents\":[{\"parts\":[{\"text\":\""
-               + jsonEscape(system_prompt + "\n" + user_msg) + "\"}]}],"
-               "\"generationConfig\":{\"maxOutputTokens\":" + std::to_string(max_tokens) + "}}";
-        curl_cmd = "curl -s " + p.base_url
-                 + " -H 'content-type: application/json'"
-                   " -d '" + body + "'";
-        response = runCurl(curl_cmd);
-        return extractJsonString(response, "text");
+    InterruptScope interrupt;
+    int status = 0;
+    std::string transport_error;
+    if ((tls && !HttpClient::tlsAvailable()) || proxyConfigured(tls)) {
+        sendWithCurl(request, on_body, transport_error);
+    } else {
+        HttpClient::Response response = HttpClient::global().send(request, on_body, &g_cancel);
+        status = response.status;
+        transport_error = response.error;
+    }
+    stream.finish();
+
+    if (g_cancel) {
+        out.cancelled = true;
+        out.error = "cancelled";
+        return out;
+    }
+    if (!out.text.empty() && status < 400) return out;
 
+    // No reply: say why, from the error document if there is one
+    JsonValue doc;
+    std::string message = out.error;
+    if (message.empty() && JsonValue::parse(raw, doc)) message = errorMessage(doc);
+    if (status >= 400) {
+        out.error = "HTTP " + std::to_string(status) + (message.empty() ? "" : ": " + message);
     } else {
-        // ollama — local, free
-        body = "{\"model\":\"" + p.model + "\","
-               "\"stream\":false,"
-               "\"messages\":["
-               "{\"role\":\"system\",\"content\":\"" + jsonEscape(system_prompt) + "\"},"
-               "{\"role\":\"user\",\"content\":\"" + jsonEscape(user_msg) + "\"}]}";
-        curl_cmd = "curl -s " + p.base_url
-                 + " -H 'content-type: application/json'"
-                   " -d '" + body + "'";
-        response = runCurl(curl_cmd);
-        return extractJsonString(response, "content");
+        out.error = !message.empty() ? message : !transport_error.empty() ? transport_error : "no response";
     }
+    out.text.clear();
+    return out;
+}
+
+std::string callAiProvider(const AiProvider& p,
+                             const std::string& system_prompt,
+                             const std::string& user_msg,
+                             int max_tokens) {
+    return queryAiProvider(p, system_prompt, user_msg, max_tokens).text;
 }
 
 } // namespace helix
@@ -0,0 +1,95 @@
+#include "brace_sequence.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+
+namespace helix {
+
+namespace {
+
+// A whole integer with an optional sign; from_chars alone rejects '+'
+bool parseInt(std::string_view s, long& out) {
+    std::string_view digits = s;
+    if (!digits.empty() && (digits[0] == '+' || digits[0] == '-')) digits.remove_prefix(1);
+    if (digits.empty() || !std::isdigit(static_cast<unsigned char>(digits[0]))) return false;
+    if (s[0] == '+') s.remove_prefix(1);
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), out);
+    return ec == std::errc() && end == s.data() + s.size();
+}
+
+// Written with a leading zero ("01", "-05"), which asks for padding
+bool zeroPadded(std::string_view s) {
+    if (!s.empty() && (s[0] == '+' || s[0] == '-')) s.remove_prefix(1);
+    return s.size() > 1 && s[0] == '0';
+}
+
+bool isLetter(std::string_view s) {
+    return s.size() == 1 && std::isalpha(static_cast<unsigned char>(s[0]));
+}
+
+} // namespace
+
+bool BraceSequence::parse(std::string_view inner, BraceSequence& out) {
+    size_t dotdot = inner.find("..");
+    if (dotdot == std::string_view::npos) return false;
+    std::string_view a = inner.substr(0, dotdot);
+    std::string_view b = inner.substr(dotdot + 2);
+    long step = 1;
+    if (size_t more = b.find(".."); more != std::string_view::npos) {
+        if (!parseInt(b.substr(more + 2), step)) return false;
+        b = b.substr(0, more);
+    }
+
+    BraceSequence seq;
+    long last;
+    if (isLetter(a) && isLetter(b)) {
+        seq.letters_ = true;
+        seq.first_ = static_cast<unsigned char>(a[0]);
+        last = static_cast<unsigned char>(b[0]);
+    } else if (parseInt(a, seq.first_) && parseInt(b, last)) {
+        if (zeroPadded(a) || zeroPadded(b)) seq.width_ = std::max(a.size(), b.size());
+    } else {
+        return false;
+    }
+
+    // Unsigned arithmetic: the span of {-9223372036854775808..0} still fits
+    unsigned long magnitude = step < 0 ? 0 - static_cast<unsigned long>(step) : static_cast<unsigned long>(step);
+    if (magnitude == 0) magnitude = 1;
+    bool up = seq.first_ <= last;
+    unsigned long span = up ? static_cast<unsigned long>(last) - static_cast<unsigned long>(seq.first_)
+                            : static_cast<unsigned long>(seq.first_) - static_cast<unsigned long>(last);
+    seq.count_ = span / magnitude + 1;
+    if (seq.count_ == 0) return false;  // Every long, which no loop would finish
+    seq.step_ = static_cast<long>(up ? magnitude : 0 - magnitude);
+    out = seq;
+    return true;
+}
+
+void BraceSequence::append(size_t k, std::string& out) const {
+    long n = static_cast<long>(static_cast<unsigned long>(first_) + k * static_cast<unsigned long>(step_));
+    if (letters_) {
+        out += static_cast<char>(n);
+        return;
+    }
+    char buf[24];
+    auto [end, ec] = std::to_chars(buf, buf + sizeof buf, n);
+    (void)ec;
+    std::string_view text(buf, static_cast<size_t>(end - buf));
+    if (text.size() < width_) {
+        // The sign stays in front of the padding: -05, not 0-5
+        if (n < 0) {
+            out += '-';
+            text.remove_prefix(1);
+        }
+        out.append(width_ - (n < 0 ? 1 : 0) - text.size(), '0');
+    }
+    out += text;
+}
+
+std::vector<std::string> BraceSequence::materialize() const {
+    std::vector<std::string> terms(count_);
+    for (size_t k = 0; k < count_; ++k) append(k, terms[k]);
+    return terms;
+}
+
+} // namespace helix
@@ -0,0 +1,158 @@
+#include "event_loop.h"
+#include "executor/fd_utils.h"
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <vector>
+#if defined(__linux__)
+#include <sys/epoll.h>
+#endif
+
+namespace helix {
+
+namespace {
+
+// Write end of the global loop's self-pipe, for wake() in signal handlers
+volatile std::sig_atomic_t g_wake_fd = -1;
+
+// Descriptors at or above this are left alone by user redirections
+constexpr int kFirstPrivateFd = 10;
+
+// Move fd to kFirstPrivateFd or above, close-on-exec; -1 on failure
+int moveHigh(int fd) {
+    if (fd < 0 || fd >= kFirstPrivateFd) return fd;
+    int high = fcntl(fd, F_DUPFD_CLOEXEC, kFirstPrivateFd);
+    close(fd);
+    return high;
+}
+
+} // namespace
+
+EventLoop& EventLoop::global() {
+    static EventLoop loop;
+    g_wake_fd = loop.wake_pipe_[1];
+    return loop;
+}
+
+EventLoop::EventLoop() {
+    if (makeCloexecPipe(wake_pipe_)) {
+        for (int& fd : wake_pipe_) {
+            fd = moveHigh(fd);
+            if (fd >= 0) fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+        }
+    }
+#if defined(__linux__)
+    poll_fd_ = moveHigh(epoll_create1(EPOLL_CLOEXEC));
+    if (poll_fd_ >= 0 && wake_pipe_[0] >= 0) {
+        struct epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.fd = wake_pipe_[0];
+        epoll_ctl(poll_fd_, EPOLL_CTL_ADD, wake_pipe_[0], &event);
+    }
+#endif
+}
+
+EventLoop::~EventLoop() {
+    if (g_wake_fd == wake_pipe_[1]) g_wake_fd = -1;
+    for (int fd : wake_pipe_) {
+        if (fd >= 0) close(fd);
+    }
+    if (poll_fd_ >= 0) close(poll_fd_);
+}
+
+// ── Sources ──────────────────────────────────────────────────────────────────
+
+bool EventLoop::watch(int fd, Handler on_readable) {
+#if defined(__linux__)
+    struct epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    int op = watched_.count(fd) ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    // Regular files can't be waited on (EPERM): they are always readable
+    if (poll_fd_ < 0 || epoll_ctl(poll_fd_, op, fd, &event) != 0) return false;
+#endif
+    watched_[fd] = std::move(on_readable);
+    return true;
+}
+
+void EventLoop::unwatch(int fd) {
+    if (!watched_.erase(fd)) return;
+#if defined(__linux__)
+    epoll_ctl(poll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+#endif
+}
+
+int EventLoop::onWake(Handler on_wake) {
+    wake_handlers_[next_token_] = std::move(on_wake);
+    return next_token_++;
+}
+
+void EventLoop::removeWake(int token) {
+    wake_handlers_.erase(token);
+}
+
+void EventLoop::wake() {
+    int fd = g_wake_fd;
+    if (fd < 0) return;
+    int saved_errno = errno;
+    char byte = 1;
+    // A full pipe already holds a wake-up; nothing is lost
+    ssize_t ignored = write(fd, &byte, 1);
+    (void)ignored;
+    errno = saved_errno;
+}
+
+void EventLoop::drainWakePipe() {
+    char buf[64];
+    while (read(wake_pipe_[0], buf, sizeof buf) > 0) {}
+}
+
+// ── Waiting ──────────────────────────────────────────────────────────────────
+
+bool EventLoop::runOnce(int timeout_ms) {
+    std::vector<int> ready;
+    bool woken = false;
+
+#if defined(__linux__)
+    struct epoll_event events[16];
+    int n = epoll_wait(poll_fd_, events, 16, timeout_ms);
+    if (n < 0) return errno == EINTR;
+    for (int i = 0; i < n; ++i) {
+        if (events[i].data.fd == wake_pipe_[0]) woken = true;
+        else ready.push_back(events[i].data.fd);
+    }
+#else
+    std::vector<struct pollfd> fds;
+    fds.push_back({wake_pipe_[0], POLLIN, 0});
+    for (const auto& [fd, handler] : watched_) fds.push_back({fd, POLLIN, 0});
+    int n = ::poll(fds.data(), fds.size(), timeout_ms);
+    if (n < 0) return errno == EINTR;
+    for (const struct pollfd& p : fds) {
+        if (!(p.revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        if (p.fd == wake_pipe_[0]) woken = true;
+        else ready.push_back(p.fd);
+    }
+#endif
+
+    if (woken) drainWakePipe();
+    for (int fd : ready) {
+        // A handler may unwatch any descriptor, itself included
+        auto it = watched_.find(fd);
+        if (it == watched_.end()) continue;
+        Handler handler = it->second;
+        handler();
+    }
+    if (woken) {
+        for (auto it = wake_handlers_.begin(); it != wake_handlers_.end();) {
+            Handler handler = it->second;
+            int next = it->first + 1;
+            handler();
+            it = wake_handlers_.lower_bound(next);
+        }
+    }
+    return true;
+}
+
+} // namespace helix
@@ -3,12 +3,25 @@
 #include "executor/environment_expander.h"
 #include "executor/fd_manager.h"
 #include "executor/pipeline_manager.h"
+#include "executor/process_spawner.h"
+#include "executor/child_wait.h"
+#include "executor/fd_utils.h"
+#include "executor/glob_engine.h"
+#include "shell/builtin_table.h"
+#include "shell/variable_store.h"
+#include "trace.h"
 #include <iostream>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <fcntl.h>
 #include <cstring>
 #include <glob.h>
+#include <csignal>
+#include <optional>
+#include <chrono>
+
+extern char** environ;
 
 namespace helix {
 
@@ -17,7 +30,8 @@ Executor::Executor()
     : exe_resolver(std::make_unique<ExecutableResolver>()),
       env_expander(std::make_unique<EnvironmentVariableExpander>()),
       fd_manager(std::make_unique<FileDescriptorManager>()),
-      pipeline_manager(std::make_unique<PipelineManager>()) {
+      pipeline_manager(std::make_unique<PipelineManager>()),
+      process_spawner(std::make_unique<ProcessSpawner>()) {
 }
 
 // Dependency injection constructor - allows custom implementations (for testing)
@@ -25,40 +39,116 @@ Executor::Executor(
     std::unique_ptr<IExecutableResolver> resolver,
     std::unique_ptr<IEnvironmentExpander> expander,
     std::unique_ptr<IFileDescriptorManager> fd_mgr,
-    std::unique_ptr<IPipelineManager> pipe_mgr)
+    std::unique_ptr<IPipelineManager> pipe_mgr,
+    std::unique_ptr<IProcessSpawner> spawner)
     : exe_resolver(std::move(resolver)),
       env_expander(std::move(expander)),
       fd_manager(std::move(fd_mgr)),
-      pipeline_manager(std::move(pipe_mgr)) {
+      pipeline_manager(std::move(pipe_mgr)),
+      process_spawner(std::move(spawner)) {
 }
 
 Executor::~Executor() = default;
 
+// Holds SIGCHLD off while a foreground command runs so the shell's reaper
+// (waitpid(-1)) cannot collect its processes before we wait for them
+namespace {
+class SigchldBlock {
+public:
+    SigchldBlock() {
+        sigset_t block;
+        sigemptyset(&block);
+        sigaddset(&block, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &block, &saved_);
+    }
+    ~SigchldBlock() { sigprocmask(SIG_SETMASK, &saved_, nullptr); }
+    SigchldBlock(const SigchldBlock&) = delete;
+    SigchldBlock& operator=(const SigchldBlock&) = delete;
+
+private:
+    sigset_t saved_;
+};
+} // namespace
+
 int Executor::execute(const ParsedCommand& cmd) {
+    return execute(cmd, ShellStages{});
+}
+
+int Executor::execute(const ParsedCommand& cmd, const ShellStages& stages) {
     size_t num_commands = cmd.pipeline.commands.size();
 
-    // Reset background PID
+    // Reset background PID and per-stage statuses
     last_background_pid = 0;
+    last_background_pids.clear();
+    last_pipe_status.clear();
+    last_pipe_usage.clear();
 
     // Handle empty command
     if (num_commands == 0) {
         return 0;
     }
 
+    // Background jobs are left to the job manager's reaper
+    std::optional<SigchldBlock> hold_sigchld;
+    if (!cmd.background) hold_sigchld.emplace();
+
     // Handle single command (no pipeline)
     if (num_commands == 1) {
-        return executeSingleCommand(cmd.pipeline.commands[0], -1, -1, cmd.background);
+        last_usage = ResourceUsage{};
+        int status = executeSingleCommand(cmd.pipeline.commands[0], -1, -1, cmd.background);
+        if (!cmd.background) {
+            last_pipe_status.assign(1, status);
+            last_pipe_usage.assign(1, last_usage);
+        }
+        return status;
     }
 
-    // Handle pipeline
+    if (stages.last && !cmd.background) return executeWithLastStageHere(cmd, stages);
+
+    // A background pipeline gets its own process group and is not waited
+    // for; the job manager reaps its members as they exit
+    PipelineLaunch launch = startStages(cmd, stages, cmd.background);
+    if (!launch.ok()) return -1;
+
     if (cmd.background) {
-        reportError("Background execution (&) not supported for pipelines yet");
-        return -1;
+        last_background_pid = launch.pgid;
+        last_background_pids = launch.pids;
+        std::cout << "[Background job started with PID " << launch.pgid << "]\n";
+        return 0;
+    }
+    return pipeline_manager->waitForPipeline(launch, last_pipe_status, last_pipe_usage);
+}
+
+PipelineLaunch Executor::startStages(const ParsedCommand& cmd, const ShellStages& stages, bool own_group) {
+    size_t num_commands = cmd.pipeline.commands.size();
+    auto inShell = [&stages](size_t index) {
+        return index < stages.in_shell.size() && stages.in_shell[index];
+    };
+
+    // Resolve every stage in the parent so PATH cache hits are recorded once
+    // and the forked children inherit the warm cache
+    std::vector<std::string> executables;
+    executables.reserve(num_commands);
+    for (size_t i = 0; i < num_commands; ++i) {
+        executables.push_back(inShell(i) ? std::string() : resolveInParent(cmd.pipeline.commands[i]));
     }
 
     // Use PipelineManager to execute pipeline
     // The lambda handles file redirections before executing each command
-    auto executor_func = [this](const Command& command) {
+    auto executor_func = [this, &cmd, &executables, &stages, &inShell](const Command& command) {
+        size_t index = static_cast<size_t>(&command - cmd.pipeline.commands.data());
+
+        // Shell code is evaluated by the forked copy of the shell, which
+        // applies its redirections itself
+        if (inShell(index)) {
+            sigset_t sigchld;
+            sigemptyset(&sigchld);
+            sigaddset(&sigchld, SIGCHLD);
+            sigprocmask(SIG_UNBLOCK, &sigchld, nullptr);
+            stages.run(index);
+            exit(1);
+        }
+
         // Setup file redirections for this pipeline command
         int file_input_fd = -1, file_output_fd = -1;
         if (!fd_manager->setupRedirections(command, file_input_fd, file_output_fd)) {
@@ -66,10 +156,78 @@ int Executor::execute(const ParsedCommand& cmd) {
         }
 
         // Execute the command
-        this->executeCommandInChild(command);
+        this->executeCommandInChild(command, index < executables.size() ? executables[index] : std::string());
     };
 
-    return pipeline_manager->executePipeline(cmd, executor_func);
+    // Stages whose argv is final are spawned; the rest fall back to fork
+    // (shell stages have no resolved executable, so they always fork)
+    IPipelineManager::StageSpawner spawn_func;
+    if (process_spawner) {
+        spawn_func = [this, &cmd, &executables](const Command& command, int in_fd, int out_fd, pid_t group) {
+            size_t index = static_cast<size_t>(&command - cmd.pipeline.commands.data());
+            if (index >= executables.size()) return pid_t(-1);
+            return trySpawn(command, executables[index], in_fd, out_fd, group);
+        };
+    }
+
+    return pipeline_manager->startPipeline(cmd, executor_func, spawn_func, own_group);
+}
+
+int Executor::executeWithLastStageHere(const ParsedCommand& cmd, const ShellStages& stages) {
+    int pipefd[2];
+    if (!makeCloexecPipe(pipefd)) {
+        reportError("Failed to create pipe");
+        return -1;
+    }
+
+    // Every stage but the last is started with the shell's stdout on the
+    // pipe; spawned and forked stages alike inherit descriptor 1
+    ParsedCommand head;
+    head.pipeline.commands.assign(cmd.pipeline.commands.begin(), cmd.pipeline.commands.end() - 1);
+    head.pipeline.original_command = cmd.pipeline.original_command;
+
+    std::cout.flush();
+    int saved_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    if (saved_stdout == -1 || dup2(pipefd[1], STDOUT_FILENO) == -1) {
+        reportError("Failed to redirect stdout to pipe");
+        if (saved_stdout != -1) close(saved_stdout);
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+    close(pipefd[1]);
+    PipelineLaunch launch = startStages(head, stages, false);
+    dup2(saved_stdout, STDOUT_FILENO);
+    close(saved_stdout);
+    if (!launch.ok()) {
+        close(pipefd[0]);
+        return -1;
+    }
+
+    // The last stage reads the pipe from this process; the head sees EOF
+    // on its own or SIGPIPE once it is done
+    int saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+    dup2(pipefd[0], STDIN_FILENO);
+    close(pipefd[0]);
+    int status = stages.last();
+    std::cout.flush();
+    if (saved_stdin != -1) {
+        dup2(saved_stdin, STDIN_FILENO);
+        close(saved_stdin);
+    }
+
+    // The last stage may have run commands of its own, which reset the
+    // per-command results; these are the pipeline's
+    std::vector<int> stage_status;
+    std::vector<ResourceUsage> stage_usage;
+    pipeline_manager->waitForPipeline(launch, stage_status, stage_usage);
+    stage_status.push_back(status);
+    stage_usage.emplace_back();  // Ran in this process
+    last_background_pid = 0;
+    last_background_pids.clear();
+    last_pipe_status = std::move(stage_status);
+    last_pipe_usage = std::move(stage_usage);
+    return status;
 }
 
 int Executor::executeSingleCommand(const Command& cmd, int input_fd, int output_fd, bool background) {
@@ -79,16 +237,29 @@ int Executor::executeSingleCommand(const Command& cmd, int input_fd, int output_
     }
 
     // Handle built-in commands (should be handled at shell level)
-    if (cmd.args[0] == "cd" || cmd.args[0] == "jobs" ||
-        cmd.args[0] == "fg" || cmd.args[0] == "bg" ||
-        cmd.args[0] == "pwd" || cmd.args[0] == "export" ||
-        cmd.args[0] == "exit" || cmd.args[0] == "history") {
+    if (const builtins::Entry* entry = builtins::find(cmd.args[0]); entry && entry->shell_only) {
         reportError("Built-in commands should be handled at shell level");
         return -1;
     }
 
-    // Fork child process
-    pid_t pid = fork();
+    // Resolve before forking so the lookup lands in the parent's PATH cache
+    std::string executable = resolveInParent(cmd);
+
+    // Spawn when the argv is final, otherwise fork and finish in the child
+    auto started = std::chrono::steady_clock::now();
+    pid_t pid;
+    bool spawned;
+    {
+        Tracer::Span trace_launch("spawn", cmd.args[0]);
+        pid = trySpawn(cmd, executable, input_fd, output_fd, background ? 0 : -1);
+        spawned = pid != -1;
+        if (!spawned) {
+            trace_launch.rename("fork");
+            pid = fork();
+        }
+        trace_launch.args().child = pid;
+        if (pid == 0) trace_launch.drop();
+    }
     if (pid == -1) {
         reportError("Fork failed");
         return -1;
@@ -119,7 +290,7 @@ int Executor::executeSingleCommand(const Command& cmd, int input_fd, int output_
         }
 
         // Execute the command
-        executeCommandInChild(cmd);
+        executeCommandInChild(cmd, executable);
         exit(1); // Should never reach here if exec succeeds
     } else { // Parent process
         // Close the input/output fds that we provided to the child
@@ -129,27 +300,51 @@ int Executor::executeSingleCommand(const Command& cmd, int input_fd, int output_
         // Handle background vs foreground execution
         if (background) {
             // For background jobs, create a new process group and don't wait
-            if (setpgid(pid, 0) == -1) {
+            // (a spawned child was already placed in one by the spawner)
+            if (!spawned && setpgid(pid, 0) == -1) {
                 std::cerr << "Warning: Failed to create process group for background job\n";
             }
             last_background_pid = pid;
+            last_background_pids.assign(1, pid);
             std::cout << "[Background job started with PID " << pid << "]\n";
             return 0;
         } else {
             // Wait for child process completion (foreground)
             // ECHILD means SIGCHLD handler already reaped it — not an error
             int status;
-            if (waitpid(pid, &status, 0) == -1) {
+            struct rusage usage;
+            pid_t reaped;
+            {
+                Tracer::Span trace_wait("wait", cmd.args[0]);
+                trace_wait.args().child = pid;
+                reaped = waitForeground(pid, &status, 0, &usage);
+            }
+            if (reaped == -1) {
                 if (errno == ECHILD) return 0;
                 reportError("Wait failed");
                 return -1;
             }
+            auto real = std::chrono::steady_clock::now() - started;
+            last_usage = ResourceUsage::from(
+                usage, std::chrono::duration_cast<std::chrono::microseconds>(real).count());
+            if (Tracer::enabled()) {
+                // The program's own lifetime, on its row
+                long long end = Tracer::now();
+                TraceArgs args;
+                args.status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                Tracer::global().nameProcess(pid, cmd.args[0]);
+                Tracer::global().completeFor(pid, "run", end - last_usage.real_us, end, cmd.args[0], args);
+            }
 
             // Return exit status
             if (WIFEXITED(status)) {
                 return WEXITSTATUS(status);
             } else if (WIFSIGNALED(status)) {
-                std::cerr << "Command terminated by signal " << WTERMSIG(status) << "\n";
+                // A reader that went away (head, a process substitution's
+                // consumer) is not worth a message, as in other shells
+                if (WTERMSIG(status) != SIGPIPE) {
+                    std::cerr << "Command terminated by signal " << WTERMSIG(status) << "\n";
+                }
                 return 128 + WTERMSIG(status);
             }
 
@@ -158,32 +353,80 @@ int Executor::executeSingleCommand(const Command& cmd, int input_fd, int output_
     }
 }
 
+bool Executor::execInPlace(const Command& cmd) {
+    if (cmd.args.empty() || !cmd.pre_expanded) return false;
+    if (const builtins::Entry* entry = builtins::find(cmd.args[0]); entry && entry->shell_only) return false;
+    // Not found: the usual path reports it
+    std::string executable = resolveInParent(cmd);
+    if (executable.empty()) return false;
+
+    int file_input_fd = -1, file_output_fd = -1;
+    if (!fd_manager->setupRedirections(cmd, file_input_fd, file_output_fd)) exit(1);
+    executeCommandInChild(cmd, executable);
+    exit(1);
+}
+
 // Expand globs in a single argument — returns 1+ args (or the original if no match)
 static std::vector<std::string> expandGlob(const std::string& arg) {
     // Only bother if the arg contains a glob metacharacter
-    if (arg.find_first_of("*?[") == std::string::npos) return {arg};
+    if (!GlobEngine::hasMeta(arg)) return {arg};
 
-    glob_t g;
-    int rc = glob(arg.c_str(), GLOB_TILDE | GLOB_NOCHECK, nullptr, &g);
     std::vector<std::string> result;
-    if (rc == 0) {
-        for (size_t i = 0; i < g.gl_pathc; ++i)
-            result.emplace_back(g.gl_pathv[i]);
+    if (arg[0] == '~') {
+        // Tilde prefixes are left to libc here
+        glob_t g;
+        if (glob(arg.c_str(), GLOB_TILDE, nullptr, &g) == 0) {
+            for (size_t i = 0; i < g.gl_pathc; ++i) result.emplace_back(g.gl_pathv[i]);
+        }
+        globfree(&g);
     } else {
-        result.push_back(arg); // no match — pass through unchanged
+        GlobEngine::global().expand(arg, result);
     }
-    globfree(&g);
+    if (result.empty()) result.push_back(arg); // no match — pass through unchanged
     return result;
 }
 
-void Executor::executeCommandInChild(const Command& cmd) {
+std::string Executor::resolveInParent(const Command& cmd) const {
+    if (cmd.args.empty()) return "";
+    // Names that still need expansion are resolved in the child after expanding
+    const std::string& name = cmd.args[0];
+    if (!cmd.pre_expanded && name.find_first_of("$`~*?[") != std::string::npos) return "";
+    return exe_resolver->findExecutable(name);
+}
+
+pid_t Executor::trySpawn(const Command& cmd, const std::string& resolved,
+                         int input_fd, int output_fd, pid_t process_group) {
+    if (!process_spawner || resolved.empty()) return -1;
+
+    // Words the child would still expand or glob need the fork path
+    if (!cmd.pre_expanded) {
+        for (const auto& arg : cmd.args) {
+            if (arg.find_first_of("$`~*?[\\") != std::string::npos) return -1;
+        }
+    }
+
+    std::vector<std::string> exec_args = cmd.args;
+    exec_args[0] = resolved;
+    return process_spawner->spawn(resolved, exec_args, cmd, input_fd, output_fd, process_group);
+}
+
+void Executor::executeCommandInChild(const Command& cmd, const std::string& resolved) {
     if (cmd.args.empty()) {
         exit(1);
     }
 
+    // The parent may be holding SIGCHLD for its wait; the program must not
+    // inherit that
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    sigprocmask(SIG_UNBLOCK, &sigchld, nullptr);
+
     // Expand environment variables (including $(...) command substitution)
+    // unless the shell's word expansion already produced the final argv
     std::vector<std::string> expanded_args;
-    for (size_t i = 0; i < cmd.args.size(); ++i) {
+    if (cmd.pre_expanded) expanded_args = cmd.args;
+    for (size_t i = 0; !cmd.pre_expanded && i < cmd.args.size(); ++i) {
         std::string arg = env_expander->expand(cmd.args[i]);
         if (i == 0) {
             // Don't glob-expand the command name
@@ -194,8 +437,8 @@ void Executor::executeCommandInChild(const Command& cmd) {
         }
     }
 
-    // Find executable using ExecutableResolver
-    std::string executable = exe_resolver->findExecutable(expanded_args[0]);
+    // Find executable using ExecutableResolver (unless the parent already did)
+    std::string executable = resolved.empty() ? exe_resolver->findExecutable(expanded_args[0]) : resolved;
     if (executable.empty()) {
         std::cerr << "Command not found: " << expanded_args[0] << "\n";
         exit(127); // Command not found exit code
@@ -205,12 +448,18 @@ void Executor::executeCommandInChild(const Command& cmd) {
     std::vector<std::string> exec_args = expanded_args;
     exec_args[0] = executable;
 
-    // Close extra file descriptors that might be from pipes
-    for (int fd = 3; fd < 1024; ++fd) {
-        close(fd);
-    }
+    // Keep pipe ends and the shell's own descriptors out of the program
+    markInheritedFdsCloexec();
 
+    // execvp() keeps its ENOEXEC fallback to /bin/sh; it takes the
+    // environment from environ, so point that at the exported variables
     std::vector<char*> argv = buildArgv(exec_args);
+    environ = const_cast<char**>(VariableStore::global().envp());
+    if (Tracer::enabled()) {
+        // The image is replaced: write out this process's events first
+        Tracer::global().instant("exec", executable);
+        Tracer::global().flush();
+    }
     execvp(executable.c_str(), &argv[0]);
 
     // If we reach here, exec failed
@@ -0,0 +1,646 @@
+#include "executor/arithmetic.h"
+#include "executor/environment_expander.h"
+#include "shell/shell_state.h"
+#include "shell/variable_store.h"
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <climits>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// Programs kept before the cache is flushed (expressions are short)
+constexpr size_t kMaxPrograms = 4096;
+
+// Variables whose values are expressions themselves, nested this deep
+constexpr int kMaxDepth = 64;
+
+// Stack slots that live on the C++ stack; deeper programs allocate
+constexpr size_t kInlineStack = 32;
+
+enum class Code : uint8_t {
+    Push,           // value
+    Load,           // Bare name: its value is evaluated as arithmetic
+    LoadText,       // $name / ${name}: must hold an integer, else Textual
+    Param,          // $1 ... ${10}: likewise
+    Special,        // $# $? $$ $!
+    Neg, Not, BitNot, Bool,
+    Mul, Div, Mod, Pow, Add, Sub, Shl, Shr,
+    Lt, Le, Gt, Ge, Eq, Ne, BitAnd, BitXor, BitOr,
+    Assign,         // Top of stack into slot; binary is the compound operator
+    PreInc, PreDec, PostInc, PostDec,
+    Jump, JumpIfZero, JumpIfNonZero,   // Conditional jumps pop their operand
+    Pop,
+};
+
+struct Op {
+    Code code;
+    Code binary = Code::Pop;   // Assign: operator of `op=`, Pop for plain `=`
+    uint32_t arg = 0;          // Slot, parameter number, special char or jump target
+    long value = 0;            // Push
+};
+
+bool isNameStart(char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+bool isNameChar(char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+long wrap(unsigned long v) { return static_cast<long>(v); }
+
+// a op b for the binary codes; false with err set on a runtime error
+bool applyBinary(Code code, long a, long b, long& out, const char*& err) {
+    unsigned long ua = static_cast<unsigned long>(a), ub = static_cast<unsigned long>(b);
+    switch (code) {
+    case Code::Mul:    out = wrap(ua * ub); return true;
+    case Code::Add:    out = wrap(ua + ub); return true;
+    case Code::Sub:    out = wrap(ua - ub); return true;
+    case Code::Div:
+    case Code::Mod:
+        if (b == 0) { err = "division by 0"; return false; }
+        if (a == LONG_MIN && b == -1) out = code == Code::Div ? a : 0;
+        else out = code == Code::Div ? a / b : a % b;
+        return true;
+    case Code::Pow: {
+        if (b < 0) { err = "exponent less than 0"; return false; }
+        unsigned long r = 1;
+        for (unsigned long base = ua, e = ub; e; e >>= 1, base *= base) {
+            if (e & 1) r *= base;
+        }
+        out = wrap(r);
+        return true;
+    }
+    case Code::Shl:    out = wrap(ua << (ub & 63)); return true;
+    case Code::Shr:    out = a >> (ub & 63); return true;
+    case Code::Lt:     out = a < b; return true;
+    case Code::Le:     out = a <= b; return true;
+    case Code::Gt:     out = a > b; return true;
+    case Code::Ge:     out = a >= b; return true;
+    case Code::Eq:     out = a == b; return true;
+    case Code::Ne:     out = a != b; return true;
+    case Code::BitAnd: out = a & b; return true;
+    case Code::BitXor: out = a ^ b; return true;
+    case Code::BitOr:  out = a | b; return true;
+    default:           err = "bad operator"; return false;
+    }
+}
+
+// Whole text as a plain decimal integer (what variables normally hold)
+// A leading zero means octal to the evaluator, so that is left to it
+bool plainInteger(std::string_view text, long& out) {
+    std::string_view digits = text.starts_with('-') ? text.substr(1) : text;
+    if (digits.empty() || (digits[0] == '0' && digits.size() > 1)) return false;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), out);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+} // namespace
+
+// ── Compiler ──────────────────────────────────────────────────────────────────
+
+namespace {
+
+// Recursive descent over the text, emitting postfix code as it goes
+// Precedence, loosest first: , = ?: || && | ^ & ==/!= </> <</>> +/- * / % ** unary postfix
+class Compiler {
+public:
+    Compiler(std::string_view text, std::vector<Op>& code, std::vector<std::string>& names)
+        : s_(text), code_(code), names_(names) {}
+
+    // Compile the whole text; false when it failed (error() or dynamic())
+    bool compile() {
+        skipSpaces();
+        if (pos_ < s_.size()) comma();
+        skipSpaces();
+        if (ok() && pos_ < s_.size()) fail("syntax error in expression");
+        return ok();
+    }
+
+    const std::string& error() const { return error_; }
+    bool dynamic() const { return dynamic_; }
+    size_t maxStack() const { return static_cast<size_t>(max_depth_); }
+
+private:
+    bool ok() const { return error_.empty() && !dynamic_; }
+
+    void fail(std::string_view message) {
+        if (!ok()) return;
+        error_.assign(message);
+        if (pos_ < s_.size()) error_.append(" (error token is \"").append(s_.substr(pos_)).append("\")");
+    }
+
+    void skipSpaces() {
+        while (pos_ < s_.size() && std::isspace(static_cast<unsigned char>(s_[pos_]))) ++pos_;
+    }
+
+    bool at(std::string_view token) { skipSpaces(); return s_.substr(pos_).starts_with(token); }
+
+    void emit(Op op) {
+        switch (op.code) {
+        case Code::Push: case Code::Load: case Code::LoadText: case Code::Param: case Code::Special:
+        case Code::PreInc: case Code::PreDec: case Code::PostInc: case Code::PostDec:
+            ++depth_;
+            break;
+        case Code::Neg: case Code::Not: case Code::BitNot: case Code::Bool:
+        case Code::Assign: case Code::Jump:
+            break;
+        default:
+            --depth_;   // Binary operators, conditional jumps, Pop
+        }
+        if (depth_ > max_depth_) max_depth_ = depth_;
+        code_.push_back(op);
+    }
+
+    size_t emitJump(Code code) { emit({code}); return code_.size() - 1; }
+    void patch(size_t jump) { code_[jump].arg = static_cast<uint32_t>(code_.size()); }
+
+    uint32_t slot(std::string_view name) {
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == name) return static_cast<uint32_t>(i);
+        }
+        names_.emplace_back(name);
+        return static_cast<uint32_t>(names_.size() - 1);
+    }
+
+    std::string_view name() {
+        size_t start = pos_;
+        while (pos_ < s_.size() && isNameChar(s_[pos_])) ++pos_;
+        return s_.substr(start, pos_ - start);
+    }
+
+    void comma() {
+        assignment();
+        while (ok() && at(",")) {
+            ++pos_;
+            emit({Code::Pop});
+            assignment();
+        }
+    }
+
+    // name op= expr (right-associative), otherwise a conditional
+    void assignment() {
+        skipSpaces();
+        size_t start = pos_;
+        if (pos_ < s_.size() && isNameStart(s_[pos_])) {
+            std::string_view target = name();
+            skipSpaces();
+            static constexpr std::pair<std::string_view, Code> kOps[] = {
+                {"<<=", Code::Shl}, {">>=", Code::Shr}, {"*=", Code::Mul}, {"/=", Code::Div},
+                {"%=", Code::Mod}, {"+=", Code::Add}, {"-=", Code::Sub}, {"&=", Code::BitAnd},
+                {"^=", Code::BitXor}, {"|=", Code::BitOr}, {"=", Code::Pop},
+            };
+            for (const auto& [token, binary] : kOps) {
+                if (!s_.substr(pos_).starts_with(token)) continue;
+                if (token == "=" && s_.substr(pos_).starts_with("==")) break;
+                pos_ += token.size();
+                uint32_t target_slot = slot(target);
+                assignment();
+                emit({Code::Assign, binary, target_slot});
+                return;
+            }
+            pos_ = start;
+        }
+        conditional();
+    }
+
+    void conditional() {
+        binary(1);
+        if (!ok() || !at("?")) return;
+        ++pos_;
+        size_t to_else = emitJump(Code::JumpIfZero);
+        comma();
+        if (!ok()) return;
+        if (!at(":")) { fail("`:' expected for conditional expression"); return; }
+        ++pos_;
+        size_t to_end = emitJump(Code::Jump);
+        --depth_;   // The else branch starts from the condition's depth
+        patch(to_else);
+        assignment();
+        patch(to_end);
+    }
+
+    // Binary operator at pos_ (spaces skipped); false if none
+    // prec: 1 ||, 2 &&, 3 |, 4 ^, 5 &, 6 ==/!=, 7 relational, 8 shift, 9 additive, 10 multiplicative
+    bool peekBinary(Code& code, int& prec, size_t& len) {
+        skipSpaces();
+        std::string_view rest = s_.substr(pos_);
+        auto is = [&rest](std::string_view t) { return rest.starts_with(t); };
+        len = 1;
+        if (is("||"))      { code = Code::JumpIfNonZero; prec = 1; len = 2; }
+        else if (is("&&")) { code = Code::JumpIfZero; prec = 2; len = 2; }
+        else if (is("|=") || is("&=") || is("^=") || is("+=") || is("-=") ||
+                 is("*=") || is("/=") || is("%=") || is("<<=") || is(">>=")) return false;
+        else if (is("|"))  { code = Code::BitOr; prec = 3; }
+        else if (is("^"))  { code = Code::BitXor; prec = 4; }
+        else if (is("&"))  { code = Code::BitAnd; prec = 5; }
+        else if (is("==")) { code = Code::Eq; prec = 6; len = 2; }
+        else if (is("!=")) { code = Code::Ne; prec = 6; len = 2; }
+        else if (is("<<")) { code = Code::Shl; prec = 8; len = 2; }
+        else if (is(">>")) { code = Code::Shr; prec = 8; len = 2; }
+        else if (is("<=")) { code = Code::Le; prec = 7; len = 2; }
+        else if (is(">=")) { code = Code::Ge; prec = 7; len = 2; }
+        else if (is("<"))  { code = Code::Lt; prec = 7; }
+        else if (is(">"))  { code = Code::Gt; prec = 7; }
+        else if (is("+"))  { code = Code::Add; prec = 9; }
+        else if (is("-"))  { code = Code::Sub; prec = 9; }
+        else if (is("*"))  { code = Code::Mul; prec = 10; }
+        else if (is("/"))  { code = Code::Div; prec = 10; }
+        else if (is("%"))  { code = Code::Mod; prec = 10; }
+        else return false;
+        return true;
+    }
+
+    // Precedence climbing over the left-associative binary levels
+    void binary(int min_prec) {
+        power();
+        Code code;
+        int prec;
+        size_t len;
+        while (ok() && peekBinary(code, prec, len) && prec >= min_prec) {
+            pos_ += len;
+            if (code == Code::JumpIfZero || code == Code::JumpIfNonZero) {
+                // a && b: b runs only when a is true; the result is 0 or 1
+                size_t to_short = emitJump(code);
+                binary(prec + 1);
+                emit({Code::Bool});
+                size_t to_end = emitJump(Code::Jump);
+                --depth_;
+                patch(to_short);
+                emit({Code::Push, Code::Pop, 0, code == Code::JumpIfNonZero ? 1 : 0});
+                patch(to_end);
+            } else {
+                binary(prec + 1);
+                emit({code});
+            }
+        }
+    }
+
+    // ** is right-associative and binds looser than unary minus (-2**2 is 4)
+    void power() {
+        unary();
+        if (ok() && at("**")) {
+            pos_ += 2;
+            power();
+            emit({Code::Pow});
+        }
+    }
+
+    void unary() {
+        skipSpaces();
+        if (pos_ >= s_.size()) { fail("syntax error: operand expected"); return; }
+        char c = s_[pos_];
+        if ((c == '+' || c == '-') && pos_ + 1 < s_.size() && s_[pos_ + 1] == c) {
+            // ++name / --name; otherwise two signs
+            size_t after = pos_ + 2;
+            while (after < s_.size() && std::isspace(static_cast<unsigned char>(s_[after]))) ++after;
+            if (after < s_.size() && isNameStart(s_[after])) {
+                pos_ = after;
+                emit({c == '+' ? Code::PreInc : Code::PreDec, Code::Pop, slot(name())});
+                return;
+            }
+        }
+        switch (c) {
+        case '-': ++pos_; unary(); emit({Code::Neg}); return;
+        case '+': ++pos_; unary(); return;
+        case '!': ++pos_; unary(); emit({Code::Not}); return;
+        case '~': ++pos_; unary(); emit({Code::BitNot}); return;
+        default:  primary();
+        }
+    }
+
+    void primary() {
+        char c = s_[pos_];
+        if (c == '(') {
+            ++pos_;
+            comma();
+            if (!ok()) return;
+            if (!at(")")) { fail("missing `)'"); return; }
+            ++pos_;
+        } else if (std::isdigit(static_cast<unsigned char>(c))) {
+            number();
+        } else if (isNameStart(c)) {
+            uint32_t id = slot(name());
+            if (at("++") || at("--")) {
+                emit({s_[pos_] == '+' ? Code::PostInc : Code::PostDec, Code::Pop, id});
+                pos_ += 2;
+            } else {
+                emit({Code::Load, Code::Pop, id});
+            }
+        } else if (c == '$') {
+            parameter();
+        } else if (c == '`') {
+            dynamic_ = true;
+        } else {
+            fail("syntax error: operand expected");
+        }
+    }
+
+    // $name ${name} $1 ${10} $# $? $$ $!; anything else needs the expander
+    void parameter() {
+        ++pos_;
+        std::string_view inner;
+        if (pos_ < s_.size() && s_[pos_] == '{') {
+            size_t close = s_.find('}', pos_);
+            if (close == std::string_view::npos) { dynamic_ = true; return; }
+            inner = s_.substr(pos_ + 1, close - pos_ - 1);
+            pos_ = close + 1;
+        } else if (pos_ < s_.size() && isNameStart(s_[pos_])) {
+            inner = name();
+        } else if (pos_ < s_.size()) {
+            inner = s_.substr(pos_++, 1);
+        }
+
+        if (inner.size() == 1 && (inner == "#" || inner == "?" || inner == "$" || inner == "!")) {
+            emit({Code::Special, Code::Pop, static_cast<uint32_t>(inner[0])});
+        } else if (!inner.empty() && inner != "0" &&
+                   std::all_of(inner.begin(), inner.end(), [](char d) { return std::isdigit(static_cast<unsigned char>(d)); })) {
+            uint32_t n = 0;
+            std::from_chars(inner.data(), inner.data() + inner.size(), n);
+            emit({Code::Param, Code::Pop, n});
+        } else if (!inner.empty() && isNameStart(inner[0]) && !EnvironmentVariableExpander::isStateList(inner) &&
+                   std::all_of(inner.begin(), inner.end(), isNameChar)) {
+            emit({Code::LoadText, Code::Pop, slot(inner)});
+        } else {
+            dynamic_ = true;   // $(...), ${x:-y}, $@, $0 ...
+        }
+    }
+
+    // Decimal, 0x hex, 0 octal or base#digits (base 2..64)
+    void number() {
+        unsigned long value = 0;
+        unsigned base = 10;
+        auto digit = [&base](char d) -> int {
+            int v = -1;
+            if (std::isdigit(static_cast<unsigned char>(d))) v = d - '0';
+            else if (d >= 'a' && d <= 'z') v = d - 'a' + 10;
+            else if (d >= 'A' && d <= 'Z') v = base <= 36 ? d - 'A' + 10 : d - 'A' + 36;
+            else if (d == '@') v = 62;
+            else if (d == '_') v = 63;
+            return v;
+        };
+
+        size_t start = pos_;
+        while (pos_ < s_.size() && std::isdigit(static_cast<unsigned char>(s_[pos_]))) ++pos_;
+        std::string_view lead = s_.substr(start, pos_ - start);
+        if (pos_ < s_.size() && s_[pos_] == '#') {
+            std::from_chars(lead.data(), lead.data() + lead.size(), base);
+            if (base < 2 || base > 64) { pos_ = start; fail("invalid arithmetic base"); return; }
+            ++pos_;
+        } else if (lead == "0" && pos_ < s_.size() && (s_[pos_] == 'x' || s_[pos_] == 'X')) {
+            base = 16;
+            ++pos_;
+        } else {
+            if (lead.size() > 1 && lead[0] == '0') base = 8;
+            pos_ = start;
+        }
+
+        size_t digits = pos_;
+        while (pos_ < s_.size() && (isNameChar(s_[pos_]) || s_[pos_] == '@')) {
+            int v = digit(s_[pos_]);
+            if (v < 0 || static_cast<unsigned>(v) >= base) { fail("value too great for base"); return; }
+            value = value * base + static_cast<unsigned>(v);
+            ++pos_;
+        }
+        if (pos_ == digits) { fail("invalid integer constant"); return; }
+        emit({Code::Push, Code::Pop, 0, wrap(value)});
+    }
+
+    std::string_view s_;
+    size_t pos_ = 0;
+    std::vector<Op>& code_;
+    std::vector<std::string>& names_;
+    int depth_ = 0;
+    int max_depth_ = 0;
+    std::string error_;
+    bool dynamic_ = false;
+};
+
+} // namespace
+
+struct ArithmeticEngine::Program {
+    struct Slot {
+        std::string name;
+        const VariableStore::Variable* var = nullptr;  // Valid while removals matches
+        uint64_t removals = 0;
+    };
+
+    explicit Program(std::string_view source) : text(source) {
+        std::vector<std::string> names;
+        Compiler compiler(text, code, names);
+        if (!compiler.compile()) {
+            code.clear();
+            dynamic = compiler.dynamic();
+            error = compiler.error();
+        }
+        max_stack = compiler.maxStack();
+        for (auto& name : names) slots.push_back({std::move(name)});
+    }
+
+    std::string text;
+    std::vector<Op> code;
+    mutable std::vector<Slot> slots;   // Bindings are refreshed while running
+    size_t max_stack = 0;
+    bool dynamic = false;              // Needs word expansion before it can run
+    std::string error;                 // Syntax error, reported on every run
+};
+
+// ── Engine ────────────────────────────────────────────────────────────────────
+
+ArithmeticEngine& ArithmeticEngine::global() {
+    static ArithmeticEngine engine;
+    return engine;
+}
+
+ArithmeticEngine::~ArithmeticEngine() = default;
+
+void ArithmeticEngine::clear() {
+    if (running_ == 0) programs_.clear();
+}
+
+bool ArithmeticEngine::evaluate(std::string_view expr, const ShellState* state, long& result) {
+    return evaluateAt(expr, state, result, 0);
+}
+
+const ArithmeticEngine::Program& ArithmeticEngine::program(std::string_view text) {
+    auto it = programs_.find(text);
+    if (it != programs_.end()) {
+        ++stats_.hits;
+        return *it->second;
+    }
+    // Programs being run are referenced from the stack: never flush under them
+    if (programs_.size() >= kMaxPrograms && running_ == 0) programs_.clear();
+
+    ++stats_.compiled;
+    return *programs_.emplace(std::string(text), std::make_unique<Program>(text)).first->second;
+}
+
+bool ArithmeticEngine::evaluateAt(std::string_view expr, const ShellState* state, long& result, int depth) {
+    result = 0;
+    if (depth > kMaxDepth) {
+        std::cerr << "helix: " << expr << ": expression recursion level exceeded\n";
+        return false;
+    }
+
+    Outcome outcome = run(program(expr), state, result, depth);
+    if (outcome == Outcome::Textual) {
+        // Substitutions bash pastes in as text: expand, then evaluate the
+        // one-off result without caching it
+        std::string expanded = EnvironmentVariableExpander().expandWithState(std::string(expr), state);
+        Program once(expanded);
+        outcome = run(once, state, result, depth);
+        if (outcome == Outcome::Textual) {
+            std::cerr << "helix: " << expanded << ": syntax error: operand expected\n";
+            outcome = Outcome::Error;
+        }
+    }
+    if (outcome != Outcome::Value) result = 0;
+    return outcome == Outcome::Value;
+}
+
+bool ArithmeticEngine::valueOf(const std::string& text, const ShellState* state, long& out, int depth) {
+    if (plainInteger(text, out)) return true;
+    size_t first = text.find_first_not_of(" \t\n");
+    if (first == std::string::npos) { out = 0; return true; }
+    return evaluateAt(text, state, out, depth + 1);
+}
+
+// ── Stack machine ─────────────────────────────────────────────────────────────
+
+ArithmeticEngine::Outcome ArithmeticEngine::run(const Program& prog, const ShellState* state, long& result, int depth) {
+    if (prog.dynamic) return Outcome::Textual;
+    if (!prog.error.empty()) {
+        std::cerr << "helix: " << prog.text << ": " << prog.error << "\n";
+        return Outcome::Error;
+    }
+
+    struct Running {
+        int& count;
+        explicit Running(int& c) : count(c) { ++count; }
+        ~Running() { --count; }
+    } running(running_);
+
+    long inline_stack[kInlineStack];
+    std::vector<long> heap;
+    long* stack = inline_stack;
+    if (prog.max_stack > kInlineStack) {
+        heap.resize(prog.max_stack);
+        stack = heap.data();
+    }
+    size_t sp = 0;
+
+    VariableStore& vars = VariableStore::global();
+    auto bound = [&vars](Program::Slot& s) -> const std::string* {
+        // Only a removal can invalidate an entry's address; a miss is
+        // looked up again since the variable may have been created since
+        if (!s.var || s.removals != vars.removals()) {
+            s.var = vars.lookup(s.name);
+            s.removals = vars.removals();
+        }
+        if (!s.var) return nullptr;
+        return s.var->array ? s.var->array->first() : &s.var->value;
+    };
+    auto unbound = [state](const std::string& name) {
+        if (state && state->nounset) std::cerr << "helix: " << name << ": unbound variable\n";
+    };
+    auto current = [&](Program::Slot& s, long& out) {
+        const std::string* text = bound(s);
+        if (!text) { unbound(s.name); out = 0; return true; }
+        return valueOf(*text, state, out, depth);
+    };
+    auto store = [&](Program::Slot& s, long value) {
+        if (state && state->readonly_vars.count(s.name)) {
+            std::cerr << "helix: " << s.name << ": readonly variable\n";
+            return false;
+        }
+        vars.set(s.name, std::to_string(value));
+        return true;
+    };
+
+    const char* err = nullptr;
+    for (size_t pc = 0; pc < prog.code.size(); ++pc) {
+        const Op& op = prog.code[pc];
+        switch (op.code) {
+        case Code::Push:
+            stack[sp++] = op.value;
+            break;
+        case Code::Load:
+            if (!current(prog.slots[op.arg], stack[sp++])) return Outcome::Error;
+            break;
+        case Code::LoadText: {
+            Program::Slot& s = prog.slots[op.arg];
+            const std::string* text = bound(s);
+            if (!text || !plainInteger(*text, stack[sp++])) return Outcome::Textual;
+            break;
+        }
+        case Code::Param: {
+            if (!state || op.arg == 0 || op.arg > state->positional_params.size()) return Outcome::Textual;
+            if (!plainInteger(state->positional_params[op.arg - 1], stack[sp++])) return Outcome::Textual;
+            break;
+        }
+        case Code::Special: {
+            long v = 0;
+            switch (static_cast<char>(op.arg)) {
+            case '#': v = state ? static_cast<long>(state->positional_params.size()) : 0; break;
+            case '?': v = state ? state->last_exit_status : 0; break;
+            case '$': v = getpid(); break;
+            case '!': v = state ? state->last_background_pid : 0; break;
+            }
+            stack[sp++] = v;
+            break;
+        }
+        case Code::Neg:    stack[sp - 1] = wrap(0ul - static_cast<unsigned long>(stack[sp - 1])); break;
+        case Code::Not:    stack[sp - 1] = !stack[sp - 1]; break;
+        case Code::BitNot: stack[sp - 1] = ~stack[sp - 1]; break;
+        case Code::Bool:   stack[sp - 1] = stack[sp - 1] != 0; break;
+        case Code::Assign: {
+            Program::Slot& s = prog.slots[op.arg];
+            long value = stack[sp - 1];
+            if (op.binary != Code::Pop) {
+                long old;
+                if (!current(s, old)) return Outcome::Error;
+                if (!applyBinary(op.binary, old, value, value, err)) break;
+            }
+            if (!store(s, value)) return Outcome::Error;
+            stack[sp - 1] = value;
+            break;
+        }
+        case Code::PreInc: case Code::PreDec: case Code::PostInc: case Code::PostDec: {
+            Program::Slot& s = prog.slots[op.arg];
+            long old;
+            if (!current(s, old)) return Outcome::Error;
+            bool inc = op.code == Code::PreInc || op.code == Code::PostInc;
+            long value = wrap(static_cast<unsigned long>(old) + (inc ? 1ul : ~0ul));
+            if (!store(s, value)) return Outcome::Error;
+            stack[sp++] = op.code == Code::PreInc || op.code == Code::PreDec ? value : old;
+            break;
+        }
+        case Code::Jump:
+            pc = op.arg - 1;
+            break;
+        case Code::JumpIfZero:
+            if (stack[--sp] == 0) pc = op.arg - 1;
+            break;
+        case Code::JumpIfNonZero:
+            if (stack[--sp] != 0) pc = op.arg - 1;
+            break;
+        case Code::Pop:
+            --sp;
+            break;
+        default: {
+            long b = stack[--sp];
+            applyBinary(op.code, stack[sp - 1], b, stack[sp - 1], err);
+        }
+        }
+        if (err) {
+            std::cerr << "helix: " << prog.text << ": " << err << "\n";
+            return Outcome::Error;
+        }
+    }
+    result = sp ? stack[sp - 1] : 0;
+    return Outcome::Value;
+}
+
+} // namespace helix
@@ -0,0 +1,62 @@
+#include "executor/child_wait.h"
+#include <cerrno>
+#include <csignal>
+#include <ctime>
+#include <sys/wait.h>
+
+namespace helix {
+
+namespace {
+
+BackgroundReaper g_reaper = nullptr;
+
+// A stop (SA_NOCLDSTOP) or a signal someone else took raises no SIGCHLD;
+// the wait looks again at least this often
+constexpr long kBackstopNanos = 100 * 1000 * 1000;
+
+pid_t blockingWait(pid_t pid, int* status, int options, struct rusage* usage) {
+    pid_t r;
+    do {
+        r = wait4(pid, status, options, usage);
+    } while (r == -1 && errno == EINTR);
+    return r;
+}
+
+} // namespace
+
+void setBackgroundReaper(BackgroundReaper reaper) {
+    g_reaper = reaper;
+}
+
+pid_t waitForeground(pid_t pid, int* status, int options, struct rusage* usage) {
+    sigset_t held;
+    if (!g_reaper || sigprocmask(SIG_BLOCK, nullptr, &held) != 0 || !sigismember(&held, SIGCHLD)) {
+        return blockingWait(pid, status, options, usage);
+    }
+
+    sigset_t sigchld;
+    sigemptyset(&sigchld);
+    sigaddset(&sigchld, SIGCHLD);
+    struct timespec backstop = {0, kBackstopNanos};
+    bool consumed = false;
+    pid_t r;
+    for (;;) {
+        r = wait4(pid, status, options | WNOHANG, usage);
+        if (r == -1 && errno == EINTR) continue;
+        if (r != 0) break;
+        if (sigtimedwait(&sigchld, nullptr, &backstop) == SIGCHLD) {
+            consumed = true;
+            g_reaper();
+        }
+    }
+
+    if (consumed) {
+        // Pending again for the handler, without disturbing the caller's errno
+        int saved_errno = errno;
+        raise(SIGCHLD);
+        errno = saved_errno;
+    }
+    return r;
+}
+
+} // namespace helix
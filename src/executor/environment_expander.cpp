@@ -1,8 +1,17 @@
 #include "executor/environment_expander.h"
+#include "executor/arithmetic.h"
+#include "executor/glob_engine.h"
+#include "executor/pattern.h"
 #include "shell/shell_state.h"
+#include "tokenizer.h"
+#include "trace.h"
+#include <algorithm>
 #include <array>
+#include <cstdio>
 #include <cstdlib>
 #include <memory>
+#include <memory_resource>
+#include <optional>
 #include <string>
 #include <sstream>
 #include <iostream>
@@ -11,181 +20,30 @@
 namespace helix {
 
 // Run $(cmd) and return stdout
-static std::string captureSubshell(const std::string& cmd) {
+// The owning shell runs it when attached (Helix functions, aliases and
+// builtins); otherwise /bin/sh does
+static std::string captureSubshell(const std::string& cmd, const ShellState* state) {
+    if (state && state->command_substitution) return state->command_substitution->capture(cmd);
+
     std::string result;
-    std::array<char, 256> buf;
+    VariableStore::global().syncProcessEnvironment();  // popen() passes environ to sh
     std::unique_ptr<FILE, decltype(&pclose)> pipe(popen(cmd.c_str(), "r"), pclose);
     if (!pipe) return "";
-    while (fgets(buf.data(), buf.size(), pipe.get())) result += buf.data();
+    std::array<char, 65536> buf;
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), pipe.get())) > 0) result.append(buf.data(), n);
     while (!result.empty() && result.back() == '\n') result.pop_back();
     return result;
 }
 
-// Simple arithmetic evaluator (handles + - * / % with operator precedence)
-static long evalArith(const std::string& expr);
-
-static long evalAtom(const std::string& expr, size_t& i) {
-    while (i < expr.size() && expr[i] == ' ') ++i;
-    if (i >= expr.size()) return 0;
-
-    bool neg = false;
-    if (expr[i] == '-') { neg = true; ++i; }
-    else if (expr[i] == '+') { ++i; }
-    else if (expr[i] == '!') { ++i; return !evalAtom(expr, i); }
-    else if (expr[i] == '~') { ++i; return ~evalAtom(expr, i); }
-
-    long val = 0;
-    if (i < expr.size() && expr[i] == '(') {
-        ++i;
-        val = evalArith(expr.substr(i));
-        // find matching )
-        int depth = 1;
-        while (i < expr.size() && depth > 0) {
-            if (expr[i] == '(') ++depth;
-            else if (expr[i] == ')') --depth;
-            ++i;
-        }
-    } else if (i < expr.size() && expr[i] == '$') {
-        ++i;
-        std::string vname;
-        while (i < expr.size() && (std::isalnum((unsigned char)expr[i]) || expr[i] == '_'))
-            vname += expr[i++];
-        const char* v = getenv(vname.c_str());
-        val = v ? std::atol(v) : 0;
-    } else if (i < expr.size() && (std::isalpha((unsigned char)expr[i]) || expr[i] == '_')) {
-        // Bare variable name inside arithmetic (bash-compatible)
-        std::string vname;
-        while (i < expr.size() && (std::isalnum((unsigned char)expr[i]) || expr[i] == '_'))
-            vname += expr[i++];
-        const char* v = getenv(vname.c_str());
-        val = v ? std::atol(v) : 0;
-    } else {
-        while (i < expr.size() && std::isdigit((unsigned char)expr[i]))
-            val = val * 10 + (expr[i++] - '0');
-    }
-    return neg ? -val : val;
-}
-
-static long evalMul(const std::string& expr, size_t& i) {
-    long left = evalAtom(expr, i);
-    while (i < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (i < expr.size() && expr[i] == '*') { ++i; left *= evalAtom(expr, i); }
-        else if (i < expr.size() && expr[i] == '/' && (i+1 >= expr.size() || expr[i+1] != '/')) {
-            ++i; long r = evalAtom(expr, i); left = r ? left / r : 0;
-        }
-        else if (i < expr.size() && expr[i] == '%') { ++i; long r = evalAtom(expr, i); left = r ? left % r : 0; }
-        else break;
-    }
-    return left;
-}
-
-static long evalAdd(const std::string& expr, size_t& i) {
-    long left = evalMul(expr, i);
-    while (i < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (i < expr.size() && expr[i] == '+' && (i+1 >= expr.size() || expr[i+1] != '+')) { ++i; left += evalMul(expr, i); }
-        else if (i < expr.size() && expr[i] == '-' && (i+1 >= expr.size() || expr[i+1] != '-')) { ++i; left -= evalMul(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalShift(const std::string& expr, size_t& i) {
-    long left = evalAdd(expr, i);
-    while (i + 1 < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '<' && expr[i+1] == '<') { i += 2; left <<= evalAdd(expr, i); }
-        else if (expr[i] == '>' && expr[i+1] == '>') { i += 2; left >>= evalAdd(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalCmp(const std::string& expr, size_t& i) {
-    long left = evalShift(expr, i);
-    while (i < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (i + 1 < expr.size() && expr[i] == '<' && expr[i+1] == '=') { i += 2; left = left <= evalShift(expr, i); }
-        else if (i + 1 < expr.size() && expr[i] == '>' && expr[i+1] == '=') { i += 2; left = left >= evalShift(expr, i); }
-        else if (expr[i] == '<') { ++i; left = left < evalShift(expr, i); }
-        else if (expr[i] == '>') { ++i; left = left > evalShift(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalEq(const std::string& expr, size_t& i) {
-    long left = evalCmp(expr, i);
-    while (i + 1 < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '=' && expr[i+1] == '=') { i += 2; left = left == evalCmp(expr, i); }
-        else if (expr[i] == '!' && expr[i+1] == '=') { i += 2; left = left != evalCmp(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalBitAnd(const std::string& expr, size_t& i) {
-    long left = evalEq(expr, i);
-    while (i < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '&' && (i+1 >= expr.size() || expr[i+1] != '&')) { ++i; left &= evalEq(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalBitXor(const std::string& expr, size_t& i) {
-    long left = evalBitAnd(expr, i);
-    while (i < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '^') { ++i; left ^= evalBitAnd(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalBitOr(const std::string& expr, size_t& i) {
-    long left = evalBitXor(expr, i);
-    while (i < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '|' && (i+1 >= expr.size() || expr[i+1] != '|')) { ++i; left |= evalBitXor(expr, i); }
-        else break;
-    }
-    return left;
-}
-
-static long evalLogAnd(const std::string& expr, size_t& i) {
-    long left = evalBitOr(expr, i);
-    while (i + 1 < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '&' && expr[i+1] == '&') { i += 2; long r = evalBitOr(expr, i); left = left && r; }
-        else break;
-    }
-    return left;
-}
-
-static long evalLogOr(const std::string& expr, size_t& i) {
-    long left = evalLogAnd(expr, i);
-    while (i + 1 < expr.size()) {
-        while (i < expr.size() && expr[i] == ' ') ++i;
-        if (expr[i] == '|' && expr[i+1] == '|') { i += 2; long r = evalLogAnd(expr, i); left = left || r; }
-        else break;
-    }
-    return left;
-}
-
-static long evalArith(const std::string& expr) {
-    size_t i = 0;
-    return evalLogOr(expr, i);
-}
-
 // Parameter expansion modifiers: ${VAR:-default} etc.
-static std::string applyParamModifier(const std::string& var_name, const std::string& modifier,
-                                       const std::string& word, const ShellState* state) {
-    const char* raw = getenv(var_name.c_str());
-    std::string val = raw ? raw : "";
+// raw is the parameter's value (nullptr: unset); assign(word) stores the
+// word for := and =
+template <typename Assign>
+static std::string applyParamModifier(const std::string& var_name, const std::string* raw,
+                                       const std::string& modifier, const std::string& word,
+                                       Assign&& assign) {
+    std::string val = raw ? *raw : "";
     bool is_set = (raw != nullptr);
     bool is_nonempty = is_set && !val.empty();
 
@@ -195,15 +53,13 @@ static std::string applyParamModifier(const std::string& var_name, const std::st
         return is_set ? val : word;
     } else if (modifier == ":=") {
         if (!is_nonempty) {
-            setenv(var_name.c_str(), word.c_str(), 1);
-            if (state) const_cast<ShellState*>(state)->environment[var_name] = word;
+            assign(word);
             return word;
         }
         return val;
     } else if (modifier == "=") {
         if (!is_set) {
-            setenv(var_name.c_str(), word.c_str(), 1);
-            if (state) const_cast<ShellState*>(state)->environment[var_name] = word;
+            assign(word);
             return word;
         }
         return val;
@@ -225,33 +81,91 @@ static std::string applyParamModifier(const std::string& var_name, const std::st
         return is_nonempty ? word : "";
     } else if (modifier == "+") {
         return is_set ? word : "";
-    } else if (modifier == "#") {
-        // ${VAR#pattern} — strip shortest matching prefix (simplified: literal prefix)
-        if (val.find(word) == 0) return val.substr(word.size());
-        return val;
-    } else if (modifier == "##") {
-        // Longest matching prefix
-        size_t pos = val.rfind(word);
-        if (pos != std::string::npos && pos == 0) return val.substr(word.size());
-        return val;
-    } else if (modifier == "%") {
-        // Strip shortest suffix
-        if (val.size() >= word.size() && val.compare(val.size() - word.size(), word.size(), word) == 0)
-            return val.substr(0, val.size() - word.size());
+    } else if (modifier == "#" || modifier == "##") {
+        // ${VAR#pattern} / ${VAR##pattern} — strip the shortest / longest matching prefix
+        const Pattern& pattern = PatternMatcher::global().compile(word);
+        size_t len = pattern.matchPrefix(val, modifier.size() == 2);
+        if (len != std::string::npos) return val.substr(len);
         return val;
-    } else if (modifier == "%%") {
-        if (val.size() >= word.size() && val.compare(val.size() - word.size(), word.size(), word) == 0)
-            return val.substr(0, val.size() - word.size());
+    } else if (modifier == "%" || modifier == "%%") {
+        // ${VAR%pattern} / ${VAR%%pattern} — strip the shortest / longest matching suffix
+        const Pattern& pattern = PatternMatcher::global().compile(word);
+        size_t start = pattern.matchSuffix(val, modifier.size() == 2);
+        if (start != std::string::npos) val.resize(start);
         return val;
     }
     return val;
 }
 
+static std::string applyParamModifier(const std::string& var_name, const std::string& modifier,
+                                       const std::string& word) {
+    VariableStore& vars = VariableStore::global();
+    return applyParamModifier(var_name, vars.find(var_name), modifier, word,
+                              [&](const std::string& value) { vars.set(var_name, value); });
+}
+
+// $#, $?, $@, $*, $$, $! and the positional parameters, whose one-character
+// names ($10: its digits) would otherwise read as modifiers in ${#} or
+// ${?:-0}
+static bool isSpecialParameter(std::string_view name) {
+    if (name.size() == 1 && std::string_view("#?@*$!").find(name[0]) != std::string_view::npos) return true;
+    return !name.empty() && std::all_of(name.begin(), name.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)); });
+}
+
+// Where a special parameter's name ends in ${inner}
+static size_t specialParameterEnd(std::string_view inner) {
+    if (inner.empty() || !std::isdigit(static_cast<unsigned char>(inner[0]))) return isSpecialParameter(inner.substr(0, 1)) ? 1 : 0;
+    size_t k = 0;
+    while (k < inner.size() && std::isdigit(static_cast<unsigned char>(inner[k]))) ++k;
+    return k;
+}
+
+// Value of a special parameter; nullopt when it is unset (a positional
+// parameter past $#, $@ and $* without any)
+static std::optional<std::string> specialParameter(std::string_view name, const ShellState* state) {
+    size_t count = state ? state->positional_params.size() : 0;
+    switch (name[0]) {
+        case '#': return std::to_string(count);
+        case '?': return std::to_string(state ? state->last_exit_status : 0);
+        case '$': return std::to_string(getpid());
+        case '!': return std::to_string(state ? state->last_background_pid : 0);
+        case '@':
+        case '*': {
+            if (count == 0) return std::nullopt;
+            std::string joined;
+            for (size_t k = 0; k < count; ++k) {
+                if (k) joined += ' ';
+                joined += state->positional_params[k];
+            }
+            return joined;
+        }
+        default: break;
+    }
+    size_t n = std::stoul(std::string(name));
+    if (n == 0) return state ? state->script_name : "";
+    if (n > count) return std::nullopt;
+    return state->positional_params[n - 1];
+}
+
+// Split a modifier off the text after a parameter name ("-x", ":-x",
+// "##p"); returns where its word starts
+static size_t splitModifier(std::string_view text, std::string& mod) {
+    size_t k = 0;
+    if (text[k] == ':' && k + 1 < text.size()) {
+        mod.assign(text.substr(k, 2));
+        return k + 2;
+    }
+    mod.assign(1, text[k++]);
+    if (k < text.size() && (text[k] == '#' || text[k] == '%') && text[k] == mod[0]) mod += text[k++];
+    return k;
+}
+
 std::string EnvironmentVariableExpander::expand(const std::string& input) const {
     return expandWithState(input, nullptr);
 }
 
 std::string EnvironmentVariableExpander::expandWithState(const std::string& input, const ShellState* state) const {
+    Tracer::Span trace_expand("expandWithState");
     std::string result;
     result.reserve(input.size());
     size_t i = 0;
@@ -259,8 +173,8 @@ std::string EnvironmentVariableExpander::expandWithState(const std::string& inpu
     // Leading ~ expansion
     if (!input.empty() && input[0] == '~') {
         if (input.size() == 1 || input[1] == '/') {
-            const char* home = getenv("HOME");
-            if (home) { result += home; i = 1; }
+            const std::string* home = VariableStore::global().find("HOME");
+            if (home) { result += *home; i = 1; }
         } else {
             // ~username expansion
             size_t end = 1;
@@ -272,166 +186,841 @@ std::string EnvironmentVariableExpander::expandWithState(const std::string& inpu
     }
 
     while (i < input.size()) {
-        char c = input[i];
+        if (input[i] == '$') {
+            result += expandDollar(input, i, state);
+        } else {
+            result += input[i++];
+        }
+    }
 
-        if (c == '$') {
-            ++i;
-            if (i >= input.size()) { result += '$'; break; }
-
-            if (input[i] == '(') {
-                if (i + 1 < input.size() && input[i+1] == '(') {
-                    // $(( arithmetic ))
-                    i += 2;
-                    std::string expr;
-                    int depth = 1;
-                    while (i < input.size() && depth > 0) {
-                        if (input[i] == '(') { ++depth; expr += input[i]; }
-                        else if (input[i] == ')') { --depth; if (depth == 0) { ++i; break; } else expr += input[i]; }
-                        else { expr += input[i]; }
-                        ++i;
-                    }
-                    // skip closing )
-                    if (i < input.size() && input[i] == ')') ++i;
-                    // Pre-expand variable names in the arithmetic expression
-                    std::string arith_expanded;
-                    arith_expanded.reserve(expr.size());
-                    for (size_t ai = 0; ai < expr.size(); ) {
-                        if (expr[ai] == '$') {
-                            ++ai;
-                            std::string vn;
-                            while (ai < expr.size() && (std::isalnum((unsigned char)expr[ai]) || expr[ai] == '_'))
-                                vn += expr[ai++];
-                            arith_expanded += getVariableValueWithState(vn, state);
-                        } else {
-                            arith_expanded += expr[ai++];
-                        }
-                    }
-                    result += std::to_string(evalArith(arith_expanded));
-                } else {
-                    // $(...) command substitution
-                    ++i;
-                    int depth = 1;
-                    std::string subcmd;
-                    while (i < input.size() && depth > 0) {
-                        if      (input[i] == '(') { ++depth; subcmd += input[i]; }
-                        else if (input[i] == ')') { --depth; if (depth > 0) subcmd += input[i]; }
-                        else    { subcmd += input[i]; }
-                        ++i;
-                    }
-                    result += captureSubshell(subcmd);
-                }
+    return result;
+}
 
-            } else if (input[i] == '{') {
-                ++i;
-                // Check for #VAR (length)
-                if (i < input.size() && input[i] == '#') {
-                    ++i;
-                    std::string var_name;
-                    while (i < input.size() && input[i] != '}') var_name += input[i++];
-                    if (i < input.size()) ++i;
-                    const char* v = getenv(var_name.c_str());
-                    result += std::to_string(v ? std::string(v).size() : 0);
+std::string EnvironmentVariableExpander::expandDollar(const std::string& input, size_t& i, const ShellState* state) const {
+    std::string result;
+    ++i;
+    if (i >= input.size()) return "$";
+
+    if (input[i] == '(') {
+        size_t end = Tokenizer::findConstructEnd(input, i);
+        if (end == std::string::npos) end = input.size();
+        if (i + 1 < input.size() && input[i+1] == '(' && end >= i + 4 && input[end-2] == ')') {
+            // $(( arithmetic )) - compiled once per expression text and cached
+            long value = 0;
+            ArithmeticEngine::global().evaluate(std::string_view(input).substr(i + 2, end - i - 4), state, value);
+            result += std::to_string(value);
+        } else {
+            // $(...) command substitution
+            size_t len = end - i - 1;
+            if (end <= input.size() && input[end-1] == ')') --len;
+            result += captureSubshell(input.substr(i + 1, len), state);
+        }
+        i = end;
+
+    } else if (input[i] == '{') {
+        size_t end = Tokenizer::findConstructEnd(input, i);
+        if (end == std::string::npos) end = input.size() + 1;
+        std::string inner = input.substr(i + 1, end - i - 2);
+        i = std::min(end, input.size());
+
+        std::vector<std::string> values;
+        if (ArrayRef ref = expandArrayRef(inner, state, values); ref != ArrayRef::None) {
+            result += joinElements(values, ref);
+        } else if (inner.size() > 1 && inner[0] == '#' &&
+                   std::string_view(":%+=").find(inner[1]) == std::string_view::npos &&
+                   (inner.size() == 2 || std::string_view("#-?").find(inner[1]) == std::string_view::npos)) {
+            // ${#VAR} (length); ${#@} and ${#*} count the positional
+            // parameters. ${#:-x}, ${#%0} and ${##0} are $# with a modifier
+            std::string name = inner.substr(1);
+            if (name == "@" || name == "*") {
+                result += std::to_string(state ? state->positional_params.size() : 0);
+            } else if (isSpecialParameter(name)) {
+                result += std::to_string(specialParameter(name, state).value_or("").size());
+            } else {
+                result += std::to_string(getVariableValueWithState(name, state).size());
+            }
+        } else {
+            size_t k = specialParameterEnd(inner);
+            if (k == 0) {
+                while (k < inner.size() && inner[k] != ':' && inner[k] != '#' &&
+                       inner[k] != '%' && inner[k] != '+' && inner[k] != '-' &&
+                       inner[k] != '=' && inner[k] != '?') {
+                    ++k;
+                }
+            }
+            std::string var_name = inner.substr(0, k);
+            bool special = isSpecialParameter(var_name);
+            if (k < inner.size()) {
+                // Modifier
+                std::string mod;
+                k += splitModifier(std::string_view(inner).substr(k), mod);
+                // Trim patterns keep their quoted characters escaped, as case does
+                bool trim = mod[0] == '#' || mod[0] == '%';
+                std::string word = trim ? expandPattern(inner.substr(k), state) : expandString(inner.substr(k), state);
+                if (special) {
+                    // Nothing to assign to: := and = only substitute
+                    std::optional<std::string> value = specialParameter(var_name, state);
+                    result += applyParamModifier(var_name, value ? &*value : nullptr, mod, word,
+                                                 [](const std::string&) {});
                 } else {
-                    std::string var_name;
-                    // collect var name chars
-                    while (i < input.size() && input[i] != '}' &&
-                           input[i] != ':' && input[i] != '#' &&
-                           input[i] != '%' && input[i] != '+' &&
-                           input[i] != '-' && input[i] != '=' &&
-                           input[i] != '?') {
-                        var_name += input[i++];
-                    }
-                    // Check for modifier
-                    if (i < input.size() && input[i] != '}') {
-                        std::string mod;
-                        if (input[i] == ':' && i+1 < input.size()) {
-                            mod += ':';
-                            ++i;
-                            mod += input[i++];
-                        } else {
-                            mod += input[i++];
-                            if (i < input.size() && input[i] == '#') { mod += '#'; ++i; }
-                            else if (i < input.size() && input[i] == '%') { mod += '%'; ++i; }
-                        }
-                        std::string word;
-                        while (i < input.size() && input[i] != '}') word += input[i++];
-                        if (i < input.size()) ++i;
-                        result += applyParamModifier(var_name, mod, word, state);
-                    } else {
-                        if (i < input.size()) ++i;
-                        result += getVariableValueWithState(var_name, state);
-                    }
+                    result += applyParamModifier(var_name, mod, word);
                 }
+            } else if (special) {
+                // ${#} ${?} ${@} ${1} ${10} ...
+                result += specialParameter(var_name, state).value_or("");
+            } else {
+                result += getVariableValueWithState(var_name, state);
+            }
+        }
 
-            } else if (input[i] == '?') {
-                result += std::to_string(state ? state->last_exit_status : 0);
-                ++i;
-            } else if (input[i] == '$') {
-                // $$  — shell PID
-                result += std::to_string(getpid());
-                ++i;
-            } else if (input[i] == '!') {
-                // $! — last background PID
-                const char* v = getenv("!");
-                result += v ? v : "0";
+    } else if (input[i] == '?') {
+        result += std::to_string(state ? state->last_exit_status : 0);
+        ++i;
+    } else if (input[i] == '$') {
+        // $$  — shell PID
+        result += std::to_string(getpid());
+        ++i;
+    } else if (input[i] == '!') {
+        // $! — last background PID
+        result += std::to_string(state ? state->last_background_pid : 0);
+        ++i;
+    } else if (input[i] == '#') {
+        // $# — positional param count
+        result += std::to_string(state ? state->positional_params.size() : 0);
+        ++i;
+    } else if (input[i] == '@' || input[i] == '*') {
+        // $@ / $* — all positional params
+        if (state) {
+            for (size_t k = 0; k < state->positional_params.size(); ++k) {
+                if (k) result += ' ';
+                result += state->positional_params[k];
+            }
+        }
+        ++i;
+    } else if (std::isdigit((unsigned char)input[i])) {
+        int n = input[i] - '0';
+        ++i;
+        if (n == 0) {
+            result += state ? state->script_name : "";
+        } else if (state && n <= (int)state->positional_params.size()) {
+            result += state->positional_params[n - 1];
+        }
+    } else if (std::isalpha(static_cast<unsigned char>(input[i])) || input[i] == '_') {
+        std::string var_name;
+        while (i < input.size() &&
+               (std::isalnum(static_cast<unsigned char>(input[i])) || input[i] == '_')) {
+            var_name += input[i++];
+        }
+        result += getVariableValueWithState(var_name, state);
+    } else {
+        result += '$';
+    }
+    return result;
+}
+
+// ── Word expansion (quote-aware) ─────────────────────────────────────────────
+
+namespace {
+
+// One output field under construction; its strings grow inside the word's
+// arena and only the finished text is copied out
+struct FieldBuilder {
+    explicit FieldBuilder(std::pmr::memory_resource* arena) : text(arena), pattern(arena) {}
+    std::pmr::string text;       // Value after quote removal
+    std::pmr::string pattern;    // Same value as a glob pattern (quoted metachars escaped)
+    bool has_glob = false;  // Contains an unquoted * ? or [
+    bool started = false;   // Field exists even if empty ("" or '')
+};
+
+bool isGlobChar(char c) {
+    return c == '*' || c == '?' || c == '[';
+}
+
+// Decode the body of a $'...' string
+std::string decodeAnsiC(const std::string& s) {
+    std::string out;
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '\\' || i + 1 >= s.size()) { out += s[i]; continue; }
+        char c = s[++i];
+        switch (c) {
+        case 'n': out += '\n'; break;
+        case 't': out += '\t'; break;
+        case 'r': out += '\r'; break;
+        case 'a': out += '\a'; break;
+        case 'b': out += '\b'; break;
+        case 'e': case 'E': out += '\033'; break;
+        case 'f': out += '\f'; break;
+        case 'v': out += '\v'; break;
+        case 'x': {
+            int v = 0, digits = 0;
+            while (digits < 2 && i + 1 < s.size() && std::isxdigit((unsigned char)s[i+1])) {
+                char h = s[++i];
+                v = v * 16 + (std::isdigit((unsigned char)h) ? h - '0' : (std::tolower(h) - 'a' + 10));
+                ++digits;
+            }
+            out += static_cast<char>(v);
+            break;
+        }
+        case '0': case '1': case '2': case '3': case '4': case '5': case '6': case '7': {
+            int v = c - '0', digits = 1;
+            while (digits < 3 && i + 1 < s.size() && s[i+1] >= '0' && s[i+1] <= '7') {
+                v = v * 8 + (s[++i] - '0');
+                ++digits;
+            }
+            out += static_cast<char>(v);
+            break;
+        }
+        default: out += c; break;  // \\ \' \" and unknown escapes
+        }
+    }
+    return out;
+}
+
+} // namespace
+
+void EnvironmentVariableExpander::expandWordInto(const std::string& word, const ShellState* state,
+                                                 WordMode mode, std::vector<std::string>& out) const {
+    // Most words are plain literals: nothing to expand, remove or glob
+    if (word.find_first_of("~'\"\\$`*?[<>") == std::string::npos) {
+        if (!word.empty() || mode != WordMode::FIELDS) out.push_back(word);
+        return;
+    }
+
+    // Per-word arena: building fields character by character never touches
+    // the heap unless the word outgrows the buffer; released on return
+    std::array<std::byte, 1024> buffer;
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+    std::pmr::vector<FieldBuilder> fields(&arena);
+    FieldBuilder cur(&arena);
+
+    auto finish = [&]() {
+        if (cur.started) fields.push_back(std::move(cur));
+        cur = FieldBuilder(&arena);
+    };
+    auto addQuoted = [&](const std::string& str) {
+        for (char c : str) {
+            cur.text += c;
+            if (isGlobChar(c) || c == '\\') cur.pattern += '\\';
+            cur.pattern += c;
+        }
+        cur.started = true;
+    };
+    auto addLiteral = [&](char c) {
+        cur.text += c;
+        if (c == '\\') cur.pattern += '\\';
+        cur.pattern += c;
+        if (isGlobChar(c)) cur.has_glob = true;
+        cur.started = true;
+    };
+    // Unquoted expansion result: IFS field splitting in FIELDS mode
+    auto addExpansion = [&](const std::string& value) {
+        const std::string* ifs_var = VariableStore::global().find("IFS");
+        std::string ifs = ifs_var ? *ifs_var : " \t\n";
+        if (mode != WordMode::FIELDS || ifs.empty()) {
+            for (char c : value) addLiteral(c);
+            return;
+        }
+        bool after_space = false;
+        for (char c : value) {
+            if (ifs.find(c) == std::string::npos) {
+                addLiteral(c);
+                after_space = false;
+                continue;
+            }
+            if (c == ' ' || c == '\t' || c == '\n') {
+                if (cur.started) finish();
+                after_space = true;
+            } else {
+                // Non-whitespace IFS characters delimit exactly one field
+                if (cur.started || !after_space) { cur.started = true; finish(); }
+                after_space = false;
+            }
+        }
+    };
+
+    const size_t n = word.size();
+    size_t i = 0;
+
+    // Tilde prefix: ~ or ~user up to the first slash
+    if (n > 0 && word[0] == '~') {
+        size_t end = word.find('/');
+        if (end == std::string::npos) end = n;
+        std::string user = word.substr(1, end - 1);
+        bool plain = user.find_first_not_of(
+            "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-") == std::string::npos;
+        if (plain) {
+            std::string home;
+            bool found = false;
+            if (user.empty()) {
+                home = getVariableValueWithState("HOME", state);
+                found = true;
+            } else if (struct passwd* pw = getpwnam(user.c_str())) {
+                home = pw->pw_dir;
+                found = true;
+            }
+            if (found) {
+                addQuoted(home);
+                i = end;
+            }
+        }
+    }
+
+    bool in_dq = false;
+    size_t dq_start_len = 0;     // text length when the current "..." opened
+    bool dq_had_empty_at = false; // "$@" with no params inside current "..."
+
+    while (i < n) {
+        char c = word[i];
+
+        if (!in_dq) {
+            if (c == '\'') {
+                size_t close = word.find('\'', i + 1);
+                if (close == std::string::npos) close = n;
+                addQuoted(word.substr(i + 1, close - i - 1));
+                i = close + 1;
+                continue;
+            }
+            if (c == '"') {
+                in_dq = true;
+                dq_start_len = cur.text.size();
+                dq_had_empty_at = false;
                 ++i;
-            } else if (input[i] == '#') {
-                // $# — positional param count
-                result += std::to_string(state ? state->positional_params.size() : 0);
+                continue;
+            }
+            if (c == '\\') {
+                if (i + 1 < n) addQuoted(std::string(1, word[i+1]));
+                i += 2;
+                continue;
+            }
+            if (c == '$' && i + 1 < n && word[i+1] == '\'') {
+                size_t end = Tokenizer::findConstructEnd(word, i + 1);
+                if (end == std::string::npos) end = n + 1;
+                addQuoted(decodeAnsiC(word.substr(i + 2, end - i - 3)));
+                i = std::min(end, n);
+                continue;
+            }
+            // <(cmd) and >(cmd): the word names the pipe to the process
+            if ((c == '<' || c == '>') && i + 1 < n && word[i+1] == '(' && mode != WordMode::PATTERN &&
+                state && state->command_substitution) {
+                size_t end = Tokenizer::findConstructEnd(word, i + 1);
+                if (end == std::string::npos) end = n + 1;
+                addQuoted(state->command_substitution->substituteProcess(word.substr(i + 2, end - i - 3),
+                                                                         c == '>'));
+                i = std::min(end, n);
+                continue;
+            }
+        } else {
+            if (c == '"') {
+                in_dq = false;
+                // "" yields an empty field, but "$@" with no params yields none
+                if (!dq_had_empty_at || cur.text.size() != dq_start_len) cur.started = true;
                 ++i;
-            } else if (input[i] == '@' || input[i] == '*') {
-                // $@ / $* — all positional params
-                if (state) {
-                    for (size_t k = 0; k < state->positional_params.size(); ++k) {
-                        if (k) result += ' ';
-                        result += state->positional_params[k];
-                    }
+                continue;
+            }
+            if (c == '\\' && i + 1 < n &&
+                (word[i+1] == '$' || word[i+1] == '`' || word[i+1] == '"' || word[i+1] == '\\')) {
+                addQuoted(std::string(1, word[i+1]));
+                i += 2;
+                continue;
+            }
+        }
+
+        if (c == '$') {
+            // "$@" expands to one field per positional parameter
+            size_t at_len = word.compare(i, 2, "$@") == 0 ? 2 : (word.compare(i, 4, "${@}") == 0 ? 4 : 0);
+            if (in_dq && at_len && mode != WordMode::PATTERN) {
+                static const std::vector<std::string> no_params;
+                const auto& params = state ? state->positional_params : no_params;
+                if (params.empty()) dq_had_empty_at = true;
+                for (size_t k = 0; k < params.size(); ++k) {
+                    if (k) finish();
+                    addQuoted(params[k]);
                 }
-                ++i;
-            } else if (std::isdigit((unsigned char)input[i])) {
-                int n = input[i] - '0';
-                ++i;
-                if (n == 0) {
-                    result += state ? state->script_name : "";
-                } else if (state && n <= (int)state->positional_params.size()) {
-                    result += state->positional_params[n - 1];
+                i += at_len;
+                continue;
+            }
+            // "${a[@]}" likewise, one per element
+            if (in_dq && mode != WordMode::PATTERN && i + 1 < n && word[i+1] == '{') {
+                size_t end = Tokenizer::findConstructEnd(word, i + 1);
+                std::string_view inner = end == std::string::npos ? std::string_view()
+                                                                  : std::string_view(word).substr(i + 2, end - i - 3);
+                std::vector<std::string> values;
+                ArrayRef ref = inner.find('[') == std::string_view::npos ? ArrayRef::None
+                                                                         : expandArrayRef(inner, state, values);
+                if (ref == ArrayRef::AtList) {
+                    if (values.empty()) dq_had_empty_at = true;
+                    for (size_t k = 0; k < values.size(); ++k) {
+                        if (k) finish();
+                        addQuoted(values[k]);
+                    }
+                    i = end;
+                    continue;
                 }
-            } else if (std::isalpha(static_cast<unsigned char>(input[i])) || input[i] == '_') {
-                std::string var_name;
-                while (i < input.size() &&
-                       (std::isalnum(static_cast<unsigned char>(input[i])) || input[i] == '_')) {
-                    var_name += input[i++];
+                if (ref != ArrayRef::None) {
+                    addQuoted(joinElements(values, ref));
+                    i = end;
+                    continue;
                 }
-                result += getVariableValueWithState(var_name, state);
-            } else {
-                result += '$';
             }
+            std::string value = expandDollar(word, i, state);
+            if (in_dq) addQuoted(value);
+            else addExpansion(value);
+            continue;
+        }
+
+        if (c == '`') {
+            size_t end = Tokenizer::findConstructEnd(word, i);
+            if (end == std::string::npos) end = n + 1;
+            std::string body;
+            for (size_t k = i + 1; k + 1 < end && k < n; ++k) {
+                if (word[k] == '\\' && k + 2 < end &&
+                    (word[k+1] == '$' || word[k+1] == '`' || word[k+1] == '\\')) ++k;
+                body += word[k];
+            }
+            std::string value = captureSubshell(body, state);
+            if (in_dq) addQuoted(value);
+            else addExpansion(value);
+            i = std::min(end, n);
+            continue;
+        }
+
+        if (in_dq) addQuoted(std::string(1, c));
+        else addLiteral(c);
+        ++i;
+    }
+    finish();
+
+    if (mode == WordMode::STRING) {
+        std::string joined;
+        for (size_t k = 0; k < fields.size(); ++k) {
+            if (k) joined += ' ';
+            joined.append(fields[k].text.data(), fields[k].text.size());
+        }
+        out.push_back(std::move(joined));
+        return;
+    }
+    if (mode == WordMode::PATTERN) {
+        std::string joined;
+        for (size_t k = 0; k < fields.size(); ++k) {
+            if (k) joined += ' ';
+            joined.append(fields[k].pattern.data(), fields[k].pattern.size());
+        }
+        out.push_back(std::move(joined));
+        return;
+    }
+
+    bool noglob = state && state->noglob;
+    for (auto& f : fields) {
+        // `[` with no closing bracket (the test command) is not a pattern
+        if (!f.has_glob || noglob || PatternMatcher::global().compile(f.pattern).isLiteral()) {
+            out.emplace_back(f.text.data(), f.text.size());
+            continue;
+        }
+        if (!GlobEngine::global().expand(f.pattern, out)) {
+            out.emplace_back(f.text.data(), f.text.size());  // no match - keep the word
+        }
+    }
+}
+
+std::vector<std::string> EnvironmentVariableExpander::expandWord(const std::string& word, const ShellState* state) const {
+    std::vector<std::string> out;
+    expandWordInto(word, state, WordMode::FIELDS, out);
+    return out;
+}
+
+std::string EnvironmentVariableExpander::expandString(const std::string& word, const ShellState* state) const {
+    std::vector<std::string> out;
+    expandWordInto(word, state, WordMode::STRING, out);
+    return out.empty() ? std::string() : std::move(out[0]);
+}
+
+std::string EnvironmentVariableExpander::expandPattern(const std::string& word, const ShellState* state) const {
+    std::vector<std::string> out;
+    expandWordInto(word, state, WordMode::PATTERN, out);
+    return out.empty() ? std::string() : std::move(out[0]);
+}
+
+// ── Arrays ───────────────────────────────────────────────────────────────────
+
+namespace {
+
+bool isNameStart(char c) { return std::isalpha(static_cast<unsigned char>(c)) || c == '_'; }
+bool isNameChar(char c) { return std::isalnum(static_cast<unsigned char>(c)) || c == '_'; }
+
+// Index just past the ']' closing the subscript opened at text[open], or npos
+size_t subscriptEnd(std::string_view text, size_t open) {
+    int depth = 0;
+    for (size_t k = open; k < text.size(); ++k) {
+        char c = text[k];
+        if (c == '\\') { ++k; continue; }
+        if (c == '\'' || c == '"' || c == '`' || (c == '$' && k + 1 < text.size() && (text[k+1] == '(' || text[k+1] == '{'))) {
+            size_t end = Tokenizer::findConstructEnd(text, c == '$' ? k + 1 : k);
+            if (end == std::string::npos) return end;
+            k = end - 1;
+            continue;
+        }
+        if (c == '[') ++depth;
+        else if (c == ']' && --depth == 0) return k + 1;
+    }
+    return std::string::npos;
+}
+
+} // namespace
+
+bool EnvironmentVariableExpander::arrayIndex(std::string_view subscript, size_t end, const ShellState* state,
+                                             size_t& index) {
+    long n = 0;
+    if (!ArithmeticEngine::global().evaluate(subscript, state, n)) return false;
+    if (n < 0) n += static_cast<long>(end);
+    if (n < 0) {
+        std::cerr << "helix: " << subscript << ": bad array subscript\n";
+        return false;
+    }
+    index = static_cast<size_t>(n);
+    return true;
+}
+
+bool EnvironmentVariableExpander::assignArray(const std::string& name, std::string_view list, bool append,
+                                              bool associative, const ShellState* state) const {
+    VariableStore& vars = VariableStore::global();
+    if (const ShellArray* existing = vars.findArray(name)) associative = existing->associative;
+
+    // Expand every item before touching the array: a=("${a[@]}" x)
+    struct Item {
+        bool keyed;
+        bool append;           // [key]+=value
+        std::string key;       // Unexpanded subscript
+        std::string value;
+    };
+    std::vector<Item> items;
+    std::vector<std::string> fields;
+    for (std::string_view raw : Tokenizer::splitList(list)) {
+        size_t close = raw.starts_with('[') ? subscriptEnd(raw, 0) : std::string_view::npos;
+        bool plus = close != std::string_view::npos && raw.substr(close).starts_with("+=");
+        if (close != std::string_view::npos && (plus || raw.substr(close).starts_with("="))) {
+            std::string value = expandString(std::string(raw.substr(close + (plus ? 2 : 1))), state);
+            items.push_back({true, plus, std::string(raw.substr(1, close - 2)), std::move(value)});
+            continue;
+        }
+        fields.clear();
+        expandWordInto(std::string(raw), state, WordMode::FIELDS, fields);
+        for (auto& f : fields) items.push_back({false, false, {}, std::move(f)});
+    }
+
+    ShellArray* array = vars.makeArray(name, associative);
+    if (!array) {
+        std::cerr << "helix: " << name << ": cannot convert " << (associative ? "indexed to associative" : "associative to indexed")
+                  << " array\n";
+        return false;
+    }
+    if (!append) {
+        array->indexed.clear();
+        array->assoc.clear();
+    }
+
+    bool ok = true;
+    if (array->associative) {
+        // Plain items pair up as key value (bash 5.1)
+        for (size_t k = 0; k < items.size(); ++k) {
+            Item& item = items[k];
+            std::string key = item.keyed ? expandString(item.key, state) : std::move(item.value);
+            std::string value;
+            if (item.keyed) value = std::move(item.value);
+            else if (k + 1 < items.size() && !items[k + 1].keyed) value = std::move(items[++k].value);
+            if (item.append) {
+                if (const std::string* old = array->assoc.get(key)) value.insert(0, *old);
+            }
+            array->assoc.set(key, std::move(value));
+        }
+        return ok;
+    }
+
+    size_t next = append ? array->indexed.end() : 0;
+    for (Item& item : items) {
+        if (item.keyed && !arrayIndex(item.key, array->indexed.end(), state, next)) {
+            ok = false;
+            continue;
+        }
+        if (item.append) {
+            if (const std::string* old = array->indexed.get(next)) item.value.insert(0, *old);
+        }
+        if (!array->indexed.set(next, std::move(item.value))) {
+            std::cerr << "helix: " << name << "[" << next << "]: array index out of range\n";
+            ok = false;
+            continue;
+        }
+        ++next;
+    }
+    return ok;
+}
+
+bool EnvironmentVariableExpander::assignElement(const std::string& name, std::string_view subscript,
+                                                std::string value, bool append, const ShellState* state) const {
+    VariableStore& vars = VariableStore::global();
+    const ShellArray* existing = vars.findArray(name);
+    if (existing && existing->associative) {
+        std::string key = expandString(std::string(subscript), state);
+        ShellArray* array = vars.makeArray(name, true);
+        if (append) {
+            if (const std::string* old = array->assoc.get(key)) value.insert(0, *old);
+        }
+        array->assoc.set(key, std::move(value));
+        return true;
+    }
+    size_t index = 0;
+    if (!arrayIndex(subscript, existing ? existing->indexed.end() : (vars.find(name) ? 1 : 0), state, index)) {
+        return false;
+    }
+    ShellArray* array = vars.makeArray(name, false);
+    if (append) {
+        if (const std::string* old = array->indexed.get(index)) value.insert(0, *old);
+    }
+    if (!array->indexed.set(index, std::move(value))) {
+        std::cerr << "helix: " << name << "[" << index << "]: array index out of range\n";
+        return false;
+    }
+    return true;
+}
+
+bool EnvironmentVariableExpander::unsetElement(const std::string& name, std::string_view subscript,
+                                               const ShellState* state) const {
+    VariableStore& vars = VariableStore::global();
+    const ShellArray* existing = vars.findArray(name);
+    if (!existing) {
+        // unset s[0] on a scalar removes it, as bash does
+        size_t index = 0;
+        if (vars.find(name) && arrayIndex(subscript, 1, state, index) && index == 0) vars.unset(name);
+        return true;
+    }
+    ShellArray* array = vars.makeArray(name, existing->associative);
+    if (array->associative) {
+        array->assoc.unset(expandString(std::string(subscript), state));
+        return true;
+    }
+    size_t index = 0;
+    if (!arrayIndex(subscript, array->indexed.end(), state, index)) return false;
+    array->indexed.unset(index);
+    return true;
+}
+
+EnvironmentVariableExpander::ArrayRef
+EnvironmentVariableExpander::expandArrayRef(std::string_view inner, const ShellState* state,
+                                            std::vector<std::string>& values) const {
+    size_t k = 0;
+    char prefix = 0;
+    if (inner.size() > 1 && (inner[0] == '#' || inner[0] == '!')) prefix = inner[k++];
+    if (k >= inner.size() || !isNameStart(inner[k])) return ArrayRef::None;
+    size_t name_end = k;
+    while (name_end < inner.size() && isNameChar(inner[name_end])) ++name_end;
+    if (name_end >= inner.size() || inner[name_end] != '[') return ArrayRef::None;
+    size_t close = subscriptEnd(inner, name_end);
+    if (close == std::string_view::npos) return ArrayRef::None;
+
+    std::string name(inner.substr(k, name_end - k));
+    std::string_view subscript = inner.substr(name_end + 1, close - name_end - 2);
+    std::string_view rest = inner.substr(close);
+    bool all = subscript == "@" || subscript == "*";
+    ArrayRef list = subscript == "@" ? ArrayRef::AtList : ArrayRef::StarList;
+
+    // Scalars and the shell's own lists read as one-element and plain arrays
+    VariableStore& vars = VariableStore::global();
+    ShellArray scratch;
+    const ShellArray* array = vars.findArray(name);
+    if (!array) {
+        if (state && isStateList(name)) {
+            for (std::string& item : stateList(name, *state)) scratch.indexed.append(std::move(item));
+        } else if (const std::string* value = vars.find(name)) {
+            scratch.indexed.set(0, *value);
+        }
+        array = &scratch;
+    }
+
+    if (prefix == '#') {
+        // ${#a[@]} counts the elements, ${#a[i]} measures one
+        if (all) {
+            values.push_back(std::to_string(array->size()));
         } else {
-            result += c;
-            ++i;
+            const std::string* value = element(*array, subscript, state);
+            values.push_back(std::to_string(value ? value->size() : 0));
+        }
+        return ArrayRef::Single;
+    }
+    if (prefix == '!') {
+        if (!all) {
+            std::cerr << "helix: ${" << inner << "}: bad substitution\n";
+            return ArrayRef::Single;
         }
+        array->forEach([&values](const std::string& key, const std::string&) { values.push_back(key); });
+        return list;
     }
 
-    return result;
+    if (!all) {
+        const std::string* value = element(*array, subscript, state);
+        if (rest.empty()) {
+            values.push_back(value ? *value : std::string());
+            return ArrayRef::Single;
+        }
+        std::string mod;
+        size_t word_at = splitModifier(rest, mod);
+        bool trim = mod[0] == '#' || mod[0] == '%';
+        std::string text(rest.substr(word_at));
+        std::string word = trim ? expandPattern(text, state) : expandString(text, state);
+        values.push_back(applyParamModifier(name, value, mod, word, [&](const std::string& v) {
+            assignElement(name, subscript, v, false, state);
+        }));
+        return ArrayRef::Single;
+    }
+
+    if (rest.size() > 1 && rest[0] == ':' && std::string_view("-=?+").find(rest[1]) == std::string_view::npos) {
+        sliceElements(*array, inner, rest.substr(1), state, values);
+        return list;
+    }
+
+    array->forEach([&values](const std::string&, const std::string& value) { values.push_back(value); });
+    if (!rest.empty()) {
+        // Trims apply to every element; the other modifiers to the list as a whole
+        std::string mod;
+        size_t word_at = splitModifier(rest, mod);
+        std::string text(rest.substr(word_at));
+        if (mod[0] == '#' || mod[0] == '%') {
+            std::string word = expandPattern(text, state);
+            for (std::string& value : values) value = applyParamModifier(name, &value, mod, word, [](const std::string&) {});
+        } else if (mod.back() == '=' || mod.back() == '?') {
+            std::cerr << "helix: ${" << inner << "}: bad substitution\n";
+            values.clear();
+        } else if (mod == "-" || mod == ":-" || mod == "+" || mod == ":+") {
+            bool set = !values.empty();
+            bool nonempty = set && !(values.size() == 1 && values[0].empty());
+            bool use_word = mod.back() == '-' ? !(mod[0] == ':' ? nonempty : set)
+                                              : (mod[0] == ':' ? nonempty : set);
+            if (use_word) values.assign(1, expandString(text, state));
+            else if (mod.back() == '+') values.clear();
+        }
+    }
+    return list;
+}
+
+void EnvironmentVariableExpander::sliceElements(const ShellArray& array, std::string_view inner,
+                                                std::string_view bounds, const ShellState* state,
+                                                std::vector<std::string>& values) const {
+    // offset[:length], each an arithmetic expression; an empty offset is 0
+    size_t colon = bounds.find(':');
+    auto evaluate = [&](std::string_view text, long& result) {
+        std::string expr = expandString(std::string(text), state);
+        if (expr.find_first_not_of(" \t") == std::string::npos) {
+            result = 0;
+            return true;
+        }
+        return ArithmeticEngine::global().evaluate(expr, state, result);
+    };
+    long offset = 0;
+    long length = -1;
+    if (!evaluate(bounds.substr(0, colon), offset)) return;
+    if (colon != std::string_view::npos) {
+        if (!evaluate(bounds.substr(colon + 1), length)) return;
+        if (length < 0) {
+            std::cerr << "helix: ${" << inner << "}: substring expression < 0\n";
+            return;
+        }
+    }
+    auto take = [&](long position, const std::string& value) {
+        if (position >= offset && (length < 0 || static_cast<long>(values.size()) < length)) values.push_back(value);
+    };
+
+    if (array.associative) {
+        // Keys have no order but the table's: offsets count elements
+        if (offset < 0) offset += static_cast<long>(array.size());
+        if (offset < 0) return;
+        long position = 0;
+        array.assoc.forEach([&](const std::string&, const std::string& value) { take(position++, value); });
+    } else {
+        // Offsets are indices, so a sparse array skips its holes; a negative
+        // one counts back from one past the last element
+        if (offset < 0) offset += static_cast<long>(array.indexed.end());
+        if (offset < 0) return;
+        array.indexed.forEach([&](size_t index, const std::string& value) { take(static_cast<long>(index), value); });
+    }
+}
+
+const std::string* EnvironmentVariableExpander::element(const ShellArray& array, std::string_view subscript,
+                                                        const ShellState* state) const {
+    if (array.associative) return array.assoc.get(expandString(std::string(subscript), state));
+    size_t index = 0;
+    if (!arrayIndex(subscript, array.indexed.end(), state, index)) return nullptr;
+    return array.indexed.get(index);
+}
+
+std::string EnvironmentVariableExpander::joinElements(const std::vector<std::string>& values, ArrayRef ref) {
+    // "${a[*]}" joins with the first character of IFS, like "$*"
+    std::string sep = " ";
+    if (ref == ArrayRef::StarList) {
+        const std::string* ifs = VariableStore::global().find("IFS");
+        if (ifs) sep = ifs->substr(0, 1);
+    }
+    std::string joined;
+    for (size_t k = 0; k < values.size(); ++k) {
+        if (k) joined += sep;
+        joined += values[k];
+    }
+    return joined;
 }
 
 std::string EnvironmentVariableExpander::getVariableValue(const std::string& name) const {
     return getVariableValueWithState(name, nullptr);
 }
 
+bool EnvironmentVariableExpander::isStateList(std::string_view name) {
+    return name == "PIPESTATUS" || name == "HELIX_PIPE_REAL" || name == "HELIX_PIPE_USER" ||
+           name == "HELIX_PIPE_SYS" || name == "HELIX_PIPE_RSS";
+}
+
+// "1.234": seconds with millisecond precision
+static std::string secondsText(long long us) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%lld.%03lld", us / 1000000, (us % 1000000) / 1000);
+    return buf;
+}
+
+std::vector<std::string> EnvironmentVariableExpander::stateList(std::string_view name, const ShellState& state) {
+    std::vector<std::string> items;
+    if (name == "PIPESTATUS") {
+        for (int status : state.pipe_status) items.push_back(std::to_string(status));
+        return items;
+    }
+    for (const ResourceUsage& u : state.pipe_usage) {
+        if (name == "HELIX_PIPE_REAL") items.push_back(secondsText(u.real_us));
+        else if (name == "HELIX_PIPE_USER") items.push_back(secondsText(u.user_us));
+        else if (name == "HELIX_PIPE_SYS") items.push_back(secondsText(u.sys_us));
+        else items.push_back(std::to_string(u.max_rss_kb));
+    }
+    return items;
+}
+
 std::string EnvironmentVariableExpander::getVariableValueWithState(const std::string& name, const ShellState* state) const {
-    // Check function-local variable frames first
-    if (state && !state->var_frames.empty()) {
-        for (int f = (int)state->var_frames.size() - 1; f >= 0; --f) {
-            auto it = state->var_frames[f].locals.find(name);
-            if (it != state->var_frames[f].locals.end()) return it->second;
+    // PIPESTATUS and the per-stage usage live in the shell state; $NAME
+    // joins the stages with spaces, ${NAME[i]} picks one
+    if (state && isStateList(name)) {
+        std::string joined;
+        for (const std::string& item : stateList(name, *state)) {
+            if (!joined.empty()) joined += ' ';
+            joined += item;
         }
+        return joined;
+    }
+
+    // $? and $! are computed from the state, never stored as variables
+    if (state && name.size() == 1) {
+        if (name[0] == '?') return std::to_string(state->last_exit_status);
+        if (name[0] == '!') return std::to_string(state->last_background_pid);
     }
-    const char* val = getenv(name.c_str());
+
+    // Function locals are in the store too; their frames only hold the
+    // shadowed values
+    const std::string* val = VariableStore::global().find(name);
     if (!val && state && state->nounset && !name.empty()) {
         std::cerr << "helix: " << name << ": unbound variable\n";
     }
-    return val ? val : "";
+    return val ? *val : "";
 }
 
 } // namespace helix
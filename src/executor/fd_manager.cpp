@@ -1,4 +1,5 @@
 #include "executor/fd_manager.h"
+#include "executor/fd_utils.h"
 #include <iostream>
 #include <unistd.h>
 #include <fcntl.h>
@@ -8,9 +9,10 @@ namespace helix {
 
 FileDescriptorManager::FileDescriptorManager() {
     // Save original file descriptors
-    original_stdin = dup(STDIN_FILENO);
-    original_stdout = dup(STDOUT_FILENO);
-    original_stderr = dup(STDERR_FILENO);
+    // Saved copies are close-on-exec so commands never inherit them
+    original_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3);
+    original_stdout = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 3);
+    original_stderr = fcntl(STDERR_FILENO, F_DUPFD_CLOEXEC, 3);
 
     if (original_stdin == -1 || original_stdout == -1 || original_stderr == -1) {
         std::cerr << "FD Manager: Failed to save original file descriptors\n";
@@ -28,120 +30,119 @@ FileDescriptorManager::~FileDescriptorManager() {
 }
 
 bool FileDescriptorManager::setupRedirections(const Command& cmd, int& input_fd, int& output_fd) {
-    // Here-string: wire a pipe containing the string to stdin
-    if (!cmd.herestring.empty()) {
-        int pipefd[2];
-        if (pipe(pipefd) == 0) {
-            std::string content = cmd.herestring + "\n";
-            write(pipefd[1], content.c_str(), content.size());
-            close(pipefd[1]);
-            dup2(pipefd[0], STDIN_FILENO);
-            close(pipefd[0]);
+    using Kind = Redirection::Kind;
+    // Applied left to right, so "> out 2>&1" and "2>&1 > out" differ as in sh
+    for (const auto& r : cmd.redirections) {
+        switch (r.kind) {
+        case Kind::INPUT:
+            if (!redirectFile(r.target, O_RDONLY, STDIN_FILENO, "input")) return false;
+            input_fd = STDIN_FILENO;
+            break;
+        case Kind::OUTPUT:
+        case Kind::APPEND:
+            if (!redirectFile(r.target, writeFlags(r.kind == Kind::APPEND), STDOUT_FILENO, "output")) {
+                return false;
+            }
+            output_fd = STDOUT_FILENO;
+            break;
+        case Kind::ERROR:
+        case Kind::ERROR_APPEND:
+            if (!redirectFile(r.target, writeFlags(r.kind == Kind::ERROR_APPEND), STDERR_FILENO, "error")) {
+                return false;
+            }
+            break;
+        case Kind::BOTH:
+        case Kind::BOTH_APPEND:
+            // &> redirects both stdout and stderr to the same file
+            if (!redirectFile(r.target, writeFlags(r.kind == Kind::BOTH_APPEND), STDOUT_FILENO, "output")) {
+                return false;
+            }
+            dup2(STDOUT_FILENO, STDERR_FILENO);
+            output_fd = STDOUT_FILENO;
+            break;
+        case Kind::ERR_TO_OUT:
+            // 2>&1 — redirect stderr to current stdout
+            dup2(STDOUT_FILENO, STDERR_FILENO);
+            break;
+        case Kind::OUT_TO_ERR:
+            // >&2 — redirect stdout to current stderr
+            dup2(STDERR_FILENO, STDOUT_FILENO);
+            break;
+        case Kind::DUP_OUT:
+            if (!duplicateFd(r.target, STDOUT_FILENO)) return false;
+            output_fd = STDOUT_FILENO;
+            break;
+        case Kind::DUP_IN:
+            if (!duplicateFd(r.target, STDIN_FILENO)) return false;
+            input_fd = STDIN_FILENO;
+            break;
+        case Kind::HEREDOC:
+        case Kind::HEREDOC_STRIP:
+            // Body was collected (and expanded) by the shell layer
+            if (!feedStdin(r.body)) return false;
+            break;
+        case Kind::HERESTRING:
+            if (!feedStdin(r.target + "\n")) return false;
+            break;
         }
     }
-    // Here-doc: content should be pre-filled by shell layer into heredoc_content
-    if (!cmd.heredoc_content.empty()) {
-        int pipefd[2];
-        if (pipe(pipefd) == 0) {
-            write(pipefd[1], cmd.heredoc_content.c_str(), cmd.heredoc_content.size());
-            close(pipefd[1]);
-            dup2(pipefd[0], STDIN_FILENO);
-            close(pipefd[0]);
-        }
-    }
-
-    if (!setupInputRedirection(cmd, input_fd)) return false;
-    if (!setupOutputRedirection(cmd, output_fd)) return false;
-    if (!setupErrorRedirection(cmd)) return false;
-
-    // &> redirects both stdout and stderr to the same file
-    if (cmd.both_to_file && !cmd.output_file.empty()) {
-        int flags = O_WRONLY | O_CREAT | (cmd.both_append ? O_APPEND : O_TRUNC);
-        int fd = open(cmd.output_file.c_str(), flags, 0644);
-        if (fd != -1) {
-            dup2(fd, STDOUT_FILENO);
-            dup2(fd, STDERR_FILENO);
-            close(fd);
-        }
-    }
-
-    // 2>&1 — redirect stderr to current stdout
-    if (cmd.stderr_to_stdout) {
-        dup2(STDOUT_FILENO, STDERR_FILENO);
-    }
-
     return true;
 }
 
-bool FileDescriptorManager::setupInputRedirection(const Command& cmd, int& input_fd) {
-    if (cmd.input_file.empty()) {
-        return true;
-    }
+int FileDescriptorManager::writeFlags(bool append) {
+    return O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+}
 
-    input_fd = open(cmd.input_file.c_str(), O_RDONLY);
-    if (input_fd == -1) {
-        std::cerr << "Failed to open input file: " << cmd.input_file
+bool FileDescriptorManager::redirectFile(const std::string& path, int flags, int target,
+                                         const char* what) {
+    int fd = open(path.c_str(), flags | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to open " << what << " file: " << path
                   << " - " << strerror(errno) << "\n";
         return false;
     }
 
-    if (dup2(input_fd, STDIN_FILENO) == -1) {
-        std::cerr << "Failed to redirect stdin: " << strerror(errno) << "\n";
-        close(input_fd);
+    if (dup2(fd, target) == -1) {
+        std::cerr << "Failed to redirect " << (target == STDIN_FILENO ? "stdin" :
+                                               target == STDOUT_FILENO ? "stdout" : "stderr")
+                  << ": " << strerror(errno) << "\n";
+        close(fd);
         return false;
     }
 
-    close(input_fd);
+    close(fd);
     return true;
 }
 
-bool FileDescriptorManager::setupOutputRedirection(const Command& cmd, int& output_fd) {
-    if (cmd.output_file.empty()) {
-        return true;
-    }
-
-    int flags = O_WRONLY | O_CREAT;
-    flags |= cmd.append_mode ? O_APPEND : O_TRUNC;
-
-    output_fd = open(cmd.output_file.c_str(), flags, 0644);
-    if (output_fd == -1) {
-        std::cerr << "Failed to open output file: " << cmd.output_file
-                  << " - " << strerror(errno) << "\n";
+bool FileDescriptorManager::duplicateFd(const std::string& source, int target) {
+    int fd = parseFdNumber(source);
+    if (fd == -1) {
+        std::cerr << "helix: " << source << ": ambiguous redirect\n";
         return false;
     }
-
-    if (dup2(output_fd, STDOUT_FILENO) == -1) {
-        std::cerr << "Failed to redirect stdout: " << strerror(errno) << "\n";
-        close(output_fd);
+    // Above 2 only the script's own (coprocesses, process substitutions),
+    // never the descriptors the shell keeps for itself
+    if ((fd > STDERR_FILENO && !isSharedFd(fd)) || fcntl(fd, F_GETFD) == -1 || dup2(fd, target) == -1) {
+        std::cerr << "helix: " << fd << ": Bad file descriptor\n";
         return false;
     }
-
-    close(output_fd);
     return true;
 }
 
-bool FileDescriptorManager::setupErrorRedirection(const Command& cmd) {
-    if (cmd.error_file.empty()) {
-        return true;
-    }
-
-    int flags = O_WRONLY | O_CREAT;
-    flags |= cmd.error_append_mode ? O_APPEND : O_TRUNC;
-
-    int error_fd = open(cmd.error_file.c_str(), flags, 0644);
-    if (error_fd == -1) {
-        std::cerr << "Failed to open error file: " << cmd.error_file
-                  << " - " << strerror(errno) << "\n";
+bool FileDescriptorManager::feedStdin(const std::string& content) {
+    int fd = openInputFd(content);
+    if (fd == -1) {
+        std::cerr << "Failed to create here-document: " << strerror(errno) << "\n";
         return false;
     }
 
-    if (dup2(error_fd, STDERR_FILENO) == -1) {
-        std::cerr << "Failed to redirect stderr: " << strerror(errno) << "\n";
-        close(error_fd);
+    if (dup2(fd, STDIN_FILENO) == -1) {
+        std::cerr << "Failed to redirect stdin: " << strerror(errno) << "\n";
+        close(fd);
         return false;
     }
 
-    close(error_fd);
+    close(fd);
     return true;
 }
 
@@ -0,0 +1,200 @@
+#include "executor/fd_utils.h"
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace helix {
+
+bool makeCloexecPipe(int fds[2]) {
+#if defined(__linux__)
+    return pipe2(fds, O_CLOEXEC) == 0;
+#else
+    if (pipe(fds) == -1) return false;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#endif
+}
+
+static void setCloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags != -1 && !(flags & FD_CLOEXEC)) fcntl(fd, F_SETFD, flags | FD_CLOEXEC);
+}
+
+// See shareFd(); a handful at most, so a vector searched linearly
+struct SharedFd {
+    int fd;
+    bool inherited;
+};
+
+static std::vector<SharedFd>& sharedFds() {
+    static std::vector<SharedFd> fds;
+    return fds;
+}
+
+static void clearCloexec(int fd) {
+    int flags = fcntl(fd, F_GETFD);
+    if (flags != -1 && (flags & FD_CLOEXEC)) fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC);
+}
+
+static void markAllCloexec(int first) {
+#if defined(CLOSE_RANGE_CLOEXEC)
+    // Linux 5.11+: one syscall regardless of how many descriptors are open
+    if (close_range(static_cast<unsigned>(first), ~0U, CLOSE_RANGE_CLOEXEC) == 0) return;
+#endif
+
+#if defined(__APPLE__)
+    const char* fd_dir = "/dev/fd";
+#else
+    const char* fd_dir = "/proc/self/fd";
+#endif
+    // Only descriptors that are actually open are touched; the directory's
+    // own descriptor is flagged too, which is harmless
+    if (DIR* dir = opendir(fd_dir)) {
+        while (struct dirent* entry = readdir(dir)) {
+            if (entry->d_name[0] < '0' || entry->d_name[0] > '9') continue;
+            int fd = atoi(entry->d_name);
+            if (fd >= first) setCloexec(fd);
+        }
+        closedir(dir);
+        return;
+    }
+
+    // No procfs (chroot, early boot): fall back to the descriptor limit
+    long max_fd = sysconf(_SC_OPEN_MAX);
+    if (max_fd < 0 || max_fd > 65536) max_fd = 65536;
+    for (int fd = first; fd < max_fd; ++fd) setCloexec(fd);
+}
+
+void markInheritedFdsCloexec(int first) {
+    markAllCloexec(first);
+    for (const SharedFd& shared : sharedFds()) {
+        if (shared.inherited) clearCloexec(shared.fd);
+    }
+}
+
+void shareFd(int fd, bool inherited) {
+    if (inherited) clearCloexec(fd);
+    sharedFds().push_back({fd, inherited});
+}
+
+void closeSharedFd(int fd) {
+    auto& fds = sharedFds();
+    for (auto it = fds.begin(); it != fds.end(); ++it) {
+        if (it->fd == fd) {
+            fds.erase(it);
+            close(fd);
+            return;
+        }
+    }
+}
+
+void closeSharedFds() {
+    for (const SharedFd& shared : sharedFds()) close(shared.fd);
+    sharedFds().clear();
+}
+
+bool isSharedFd(int fd) {
+    for (const SharedFd& shared : sharedFds()) {
+        if (shared.fd == fd) return true;
+    }
+    return false;
+}
+
+bool hasInheritedFds() {
+    for (const SharedFd& shared : sharedFds()) {
+        if (shared.inherited) return true;
+    }
+    return false;
+}
+
+bool writeAll(int fd, std::string_view content) {
+    const char* p = content.data();
+    size_t left = content.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+int openAnonymousFile() {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    int mfd = memfd_create("helix-buffer", MFD_CLOEXEC);
+    if (mfd != -1 || errno != ENOSYS) return mfd;
+#endif
+    const char* tmpdir = getenv("TMPDIR");
+    std::string path = std::string(tmpdir && *tmpdir ? tmpdir : "/tmp") + "/helix-buffer.XXXXXX";
+    int fd = mkstemp(path.data());
+    if (fd == -1) return -1;
+    unlink(path.c_str());
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    return fd;
+}
+
+int openInputFd(std::string_view content) {
+    if (content.size() <= kInlineInputMax) {
+        int pipefd[2];
+        if (!makeCloexecPipe(pipefd)) return -1;
+        bool ok = writeAll(pipefd[1], content);
+        close(pipefd[1]);
+        if (ok) return pipefd[0];
+        close(pipefd[0]);
+        return -1;
+    }
+
+    int fd = openAnonymousFile();
+    if (fd == -1) return -1;
+    if (!writeAll(fd, content) || lseek(fd, 0, SEEK_SET) == -1) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+bool setPipeSize(int fd, int bytes) {
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+    int current = fcntl(fd, F_GETPIPE_SZ);
+    if (current == -1 || current >= bytes) return false;
+    return fcntl(fd, F_SETPIPE_SZ, bytes) != -1;
+#else
+    (void)fd;
+    (void)bytes;
+    return false;
+#endif
+}
+
+int parseFdNumber(std::string_view text) {
+    int fd = -1;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), fd);
+    if (text.empty() || ec != std::errc() || end != text.data() + text.size() || fd < 0) return -1;
+    return fd;
+}
+
+int parsePipeSize(std::string_view text) {
+    long long size = 0;
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), size);
+    if (ec != std::errc() || size <= 0) return 0;
+    if (size > INT_MAX) size = INT_MAX;
+    std::string_view suffix(end, static_cast<size_t>(text.data() + text.size() - end));
+    if (suffix == "K" || suffix == "k") size <<= 10;
+    else if (suffix == "M" || suffix == "m") size <<= 20;
+    else if (!suffix.empty()) return 0;
+    return size > INT_MAX ? INT_MAX : static_cast<int>(size);
+}
+
+} // namespace helix
@@ -0,0 +1,320 @@
+#include "executor/glob_engine.h"
+#include "executor/pattern.h"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <thread>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// Directories found before the walk is handed to the thread pool
+constexpr size_t kParallelThreshold = 64;
+
+// Listings beyond this many names in total flush the cache
+constexpr size_t kMaxCachedNames = 4'000'000;
+
+struct timespec statMtime(const struct stat& st) {
+#ifdef __APPLE__
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+bool sameTime(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// prefix joined with name; "" is the current directory
+std::string child(const std::string& prefix, const std::string& name) {
+    if (prefix.empty()) return name;
+    if (prefix.back() == '/') return prefix + name;
+    std::string path;
+    path.reserve(prefix.size() + 1 + name.size());
+    path.append(prefix).append(1, '/').append(name);
+    return path;
+}
+
+std::string unescape(std::string_view component) {
+    std::string out;
+    out.reserve(component.size());
+    for (size_t i = 0; i < component.size(); ++i) {
+        if (component[i] == '\\' && i + 1 < component.size()) ++i;
+        out += component[i];
+    }
+    return out;
+}
+
+} // namespace
+
+GlobEngine& GlobEngine::global() {
+    static GlobEngine engine;
+    return engine;
+}
+
+bool GlobEngine::hasMeta(std::string_view word) {
+    for (size_t i = 0; i < word.size(); ++i) {
+        char c = word[i];
+        if (c == '\\') ++i;
+        else if (c == '*' || c == '?' || c == '[') return true;
+    }
+    return false;
+}
+
+bool GlobEngine::expand(std::string_view pattern, std::vector<std::string>& out) {
+    if (pattern.empty()) return false;
+
+    // "dir/*/" matches directories only and keeps the slash
+    bool dirs_only = pattern.size() > 1 && pattern.back() == '/';
+    std::vector<std::string_view> components;
+    for (size_t pos = 0; pos < pattern.size();) {
+        size_t slash = pattern.find('/', pos);
+        if (slash == std::string_view::npos) slash = pattern.size();
+        if (slash > pos) components.push_back(pattern.substr(pos, slash - pos));
+        pos = slash + 1;
+    }
+
+    std::vector<std::string> current{pattern.front() == '/' ? "/" : ""};
+    for (size_t c = 0; c < components.size() && !current.empty(); ++c) {
+        std::string_view component = components[c];
+        bool last = c + 1 == components.size();
+        bool need_dir = !last || dirs_only;
+        std::vector<std::string> next;
+
+        if (component == "**") {
+            std::vector<std::string> dirs = walk(current);
+            if (!last) {
+                next = std::move(dirs);                 // Zero or more directories
+            } else if (dirs_only) {
+                for (auto& dir : dirs) {
+                    if (std::find(current.begin(), current.end(), dir) == current.end()) {
+                        next.push_back(std::move(dir));
+                    }
+                }
+            } else {
+                // A final ** is everything below, files included, plus the
+                // named directory itself ("d/**" yields "d/" first)
+                for (const auto& root : current) {
+                    if (!root.empty()) next.push_back(root.back() == '/' ? root : root + '/');
+                }
+                for (const auto& dir : dirs) {
+                    ListingPtr list = listing(dir);
+                    if (!list) continue;
+                    for (const auto& entry : list->entries) {
+                        if (entry.name[0] != '.') next.push_back(child(dir, entry.name));
+                    }
+                }
+            }
+        } else if (!hasMeta(component)) {
+            std::string name = unescape(component);
+            for (const auto& prefix : current) {
+                if (!last) {
+                    next.push_back(child(prefix, name));  // Checked when it is listed
+                    continue;
+                }
+                // A literal last component must exist; the listing answers
+                // that without a stat, unless the directory is unreadable
+                std::string path = child(prefix, name);
+                ListingPtr list = listing(prefix);
+                bool found = false;
+                if (list) {
+                    auto it = std::lower_bound(list->entries.begin(), list->entries.end(), name,
+                                               [](const Entry& e, const std::string& n) { return e.name < n; });
+                    found = it != list->entries.end() && it->name == name &&
+                            (!need_dir || isDirectory(path, *it, true));
+                } else {
+                    struct stat st;
+                    found = lstat(path.c_str(), &st) == 0 && (!need_dir || S_ISDIR(st.st_mode));
+                }
+                if (found) next.push_back(std::move(path));
+            }
+        } else {
+            const Pattern& compiled = PatternMatcher::global().compile(component, Pattern::kPeriod);
+            for (const auto& prefix : current) {
+                ListingPtr list = listing(prefix);
+                if (!list) continue;
+                for (const auto& entry : list->entries) {
+                    if (!compiled.matches(entry.name)) continue;
+                    std::string path = child(prefix, entry.name);
+                    if (need_dir && !isDirectory(path, entry, true)) continue;
+                    next.push_back(std::move(path));
+                }
+            }
+        }
+        current = std::move(next);
+    }
+
+    if (current.empty() || (current.size() == 1 && (current[0].empty() || current[0] == "/"))) {
+        return false;
+    }
+    std::sort(current.begin(), current.end());
+    for (auto& path : current) {
+        if (dirs_only && path.back() != '/') path += '/';
+        out.push_back(std::move(path));
+    }
+    return true;
+}
+
+void GlobEngine::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    listings_.clear();
+    cached_names_ = 0;
+}
+
+GlobEngine::Stats GlobEngine::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+}
+
+// ── Listings ──────────────────────────────────────────────────────────────────
+
+GlobEngine::ListingPtr GlobEngine::listing(const std::string& dir) {
+    const char* path = dir.empty() ? "." : dir.c_str();
+    struct stat st;
+    if (stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) return nullptr;
+    auto key = std::make_pair(st.st_dev, st.st_ino);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = listings_.find(key);
+        if (it != listings_.end() && it->second->trusted && sameTime(it->second->mtime, statMtime(st))) {
+            ++stats_.hits;
+            return it->second;
+        }
+    }
+
+    DIR* d = opendir(path);
+    if (!d) return nullptr;
+    auto list = std::make_shared<Listing>();
+    // The mtime is taken before reading, so a change during the scan is
+    // caught by the next comparison
+    list->mtime = fstat(dirfd(d), &st) == 0 ? statMtime(st) : timespec{};
+    while (struct dirent* e = readdir(d)) {
+        const char* name = e->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+        list->entries.push_back({name, e->d_type});
+    }
+    closedir(d);
+    std::sort(list->entries.begin(), list->entries.end(),
+              [](const Entry& a, const Entry& b) { return a.name < b.name; });
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    list->trusted = now.tv_sec - list->mtime.tv_sec > 1;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.reads;
+    auto& slot = listings_[key];
+    if (slot) cached_names_ -= slot->entries.size();
+    if (cached_names_ + list->entries.size() > kMaxCachedNames) {
+        listings_.clear();
+        cached_names_ = 0;
+    }
+    listings_[key] = list;
+    cached_names_ += list->entries.size();
+    return list;
+}
+
+bool GlobEngine::isDirectory(const std::string& path, const Entry& entry, bool follow) {
+    if (entry.type == DT_DIR) return true;
+    if (entry.type != DT_UNKNOWN && (entry.type != DT_LNK || !follow)) return false;
+    struct stat st;
+    int rc = follow ? stat(path.c_str(), &st) : lstat(path.c_str(), &st);
+    return rc == 0 && S_ISDIR(st.st_mode);
+}
+
+// ── Recursive walk (**) ───────────────────────────────────────────────────────
+
+std::vector<std::string> GlobEngine::walk(const std::vector<std::string>& roots) {
+    // Subdirectories of dir that ** descends into, handed to push
+    auto visit = [this](const std::string& dir, auto&& push) {
+        ListingPtr list = listing(dir);
+        if (!list) return;
+        for (const auto& entry : list->entries) {
+            if (entry.name[0] == '.') continue;
+            std::string path = child(dir, entry.name);
+            if (isDirectory(path, entry, false)) push(std::move(path));
+        }
+    };
+
+    // Small trees are walked on this thread
+    std::vector<std::string> found;
+    std::deque<std::string> frontier(roots.begin(), roots.end());
+    while (!frontier.empty() && frontier.size() < kParallelThreshold) {
+        std::string dir = std::move(frontier.front());
+        frontier.pop_front();
+        visit(dir, [&frontier](std::string path) { frontier.push_back(std::move(path)); });
+        found.push_back(std::move(dir));
+    }
+    if (frontier.empty()) return found;
+
+    // Large ones: each worker takes from the back of its own queue and
+    // steals from the front of the others' once it runs dry
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::string> queue;
+        std::vector<std::string> found;
+    };
+    size_t count = std::clamp<size_t>(std::thread::hardware_concurrency(), 2, 8);
+    std::vector<Worker> workers(count);
+    std::atomic<size_t> pending{frontier.size()};
+    for (size_t i = 0; !frontier.empty(); ++i) {
+        workers[i % count].queue.push_back(std::move(frontier.front()));
+        frontier.pop_front();
+    }
+
+    auto run = [&workers, &pending, &visit, count](size_t self) {
+        Worker& me = workers[self];
+        for (;;) {
+            std::string dir;
+            bool got = false;
+            {
+                std::lock_guard<std::mutex> lock(me.mutex);
+                if (!me.queue.empty()) {
+                    dir = std::move(me.queue.back());
+                    me.queue.pop_back();
+                    got = true;
+                }
+            }
+            for (size_t k = 1; !got && k < count; ++k) {
+                Worker& victim = workers[(self + k) % count];
+                std::lock_guard<std::mutex> lock(victim.mutex);
+                if (!victim.queue.empty()) {
+                    dir = std::move(victim.queue.front());
+                    victim.queue.pop_front();
+                    got = true;
+                }
+            }
+            if (!got) {
+                // Empty everywhere: done once nobody is still listing
+                if (pending.load() == 0) return;
+                std::this_thread::yield();
+                continue;
+            }
+            visit(dir, [&me, &pending](std::string path) {
+                pending.fetch_add(1);
+                std::lock_guard<std::mutex> lock(me.mutex);
+                me.queue.push_back(std::move(path));
+            });
+            me.found.push_back(std::move(dir));
+            pending.fetch_sub(1);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(count - 1);
+    for (size_t i = 1; i < count; ++i) threads.emplace_back(run, i);
+    run(0);
+    for (auto& t : threads) t.join();
+
+    for (auto& worker : workers) {
+        for (auto& dir : worker.found) found.push_back(std::move(dir));
+    }
+    return found;
+}
+
+} // namespace helix
@@ -0,0 +1,174 @@
+#include "executor/path_cache.h"
+#include "shell/variable_store.h"
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <cstdlib>
+#include <algorithm>
+
+namespace helix {
+
+static struct timespec statMtime(const struct stat& st) {
+#ifdef __APPLE__
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+PathCache& PathCache::global() {
+    static PathCache cache;
+    return cache;
+}
+
+void PathCache::syncPath() {
+    const std::string* path_env = VariableStore::global().find("PATH");
+    bool have = path_env != nullptr;
+    if (have == have_path_ && (!have || path_value_ == *path_env)) {
+        return;
+    }
+
+    have_path_ = have;
+    path_value_ = have ? *path_env : "";
+    entries_.clear();
+    dirs_.clear();
+    names_stale_ = true;
+
+    if (!have) return;
+    size_t start = 0;
+    while (true) {
+        size_t colon = path_value_.find(':', start);
+        std::string dir = path_value_.substr(start, colon == std::string::npos ? std::string::npos : colon - start);
+        dirs_.push_back(dir.empty() ? "." : dir);
+        if (colon == std::string::npos) break;
+        start = colon + 1;
+    }
+}
+
+bool PathCache::stillValid(const Entry& entry) {
+    struct stat st;
+    if (stat(entry.dir.c_str(), &st) != 0) return false;
+    struct timespec m = statMtime(st);
+    return m.tv_sec == entry.dir_mtime.tv_sec && m.tv_nsec == entry.dir_mtime.tv_nsec;
+}
+
+std::string PathCache::lookup(const std::string& name, bool record_hit) {
+    syncPath();
+
+    if (auto it = entries_.find(name); it != entries_.end()) {
+        if (stillValid(it->second)) {
+            if (record_hit) ++it->second.hits;
+            return it->second.path;
+        }
+        // Directory changed since we cached it - the command may have moved
+        // or an earlier PATH entry may now shadow it
+        entries_.erase(it);
+    }
+
+    for (const auto& dir : dirs_) {
+        std::string full_path = dir + "/" + name;
+        if (!isExecutable(full_path)) continue;
+
+        Entry entry;
+        entry.path = full_path;
+        entry.dir = dir;
+        struct stat st;
+        if (stat(dir.c_str(), &st) == 0) entry.dir_mtime = statMtime(st);
+        entry.hits = record_hit ? 1 : 0;
+        entries_[name] = entry;
+        return full_path;
+    }
+    return "";
+}
+
+const PathCache::Entry* PathCache::find(const std::string& name) {
+    syncPath();
+    auto it = entries_.find(name);
+    return it == entries_.end() ? nullptr : &it->second;
+}
+
+void PathCache::forget(const std::string& name) {
+    entries_.erase(name);
+}
+
+void PathCache::clear() {
+    entries_.clear();
+    have_path_ = false;
+    path_value_.clear();
+    dirs_.clear();
+    listings_.clear();
+    command_names_.clear();
+    names_stale_ = true;
+}
+
+std::vector<std::pair<std::string, PathCache::Entry>> PathCache::entries() {
+    syncPath();
+    std::vector<std::pair<std::string, Entry>> out(entries_.begin(), entries_.end());
+    std::sort(out.begin(), out.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return out;
+}
+
+const std::vector<std::string>& PathCache::directories() {
+    syncPath();
+    return dirs_;
+}
+
+const std::vector<std::string>& PathCache::commandNames() {
+    syncPath();
+    bool changed = names_stale_;
+    for (const auto& dir : dirs_) {
+        changed |= refreshListing(dir, listings_[dir]);
+    }
+    if (!changed) return command_names_;
+
+    command_names_.clear();
+    for (const auto& dir : dirs_) {
+        const auto& names = listings_[dir].names;
+        command_names_.insert(command_names_.end(), names.begin(), names.end());
+    }
+    std::sort(command_names_.begin(), command_names_.end());
+    command_names_.erase(std::unique(command_names_.begin(), command_names_.end()), command_names_.end());
+    names_stale_ = false;
+    return command_names_;
+}
+
+bool PathCache::refreshListing(const std::string& dir, Listing& listing) {
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        bool had = listing.valid;
+        listing = Listing{};
+        return had;
+    }
+    struct timespec m = statMtime(st);
+    if (listing.valid && m.tv_sec == listing.mtime.tv_sec && m.tv_nsec == listing.mtime.tv_nsec) {
+        return false;
+    }
+
+    // The mtime is taken before reading, so a change during the scan is
+    // picked up by the next refresh
+    listing.valid = true;
+    listing.mtime = m;
+    listing.names.clear();
+    DIR* dirp = opendir(dir.c_str());
+    if (!dirp) return true;
+    int dfd = dirfd(dirp);
+    while (struct dirent* entry = readdir(dirp)) {
+        if (entry->d_name[0] == '.' || entry->d_type == DT_DIR) continue;
+        struct stat est;
+        if (fstatat(dfd, entry->d_name, &est, 0) == 0 && S_ISREG(est.st_mode) && (est.st_mode & S_IXUSR)) {
+            listing.names.emplace_back(entry->d_name);
+        }
+    }
+    closedir(dirp);
+    return true;
+}
+
+bool PathCache::isExecutable(const std::string& path) {
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0 &&
+            S_ISREG(st.st_mode) &&
+            (st.st_mode & S_IXUSR));
+}
+
+} // namespace helix
@@ -0,0 +1,291 @@
+#include "executor/pattern.h"
+#include <cctype>
+
+namespace helix {
+
+namespace {
+
+// Compiled patterns kept per flag set before the cache is flushed
+constexpr size_t kMaxPatterns = 4096;
+
+// Members of a [:name:] class in the C locale; false for an unknown name
+bool addClass(std::string_view name, std::bitset<256>& set) {
+    int (*test)(int) = nullptr;
+    if      (name == "alnum")  test = isalnum;
+    else if (name == "alpha")  test = isalpha;
+    else if (name == "blank")  test = isblank;
+    else if (name == "cntrl")  test = iscntrl;
+    else if (name == "digit")  test = isdigit;
+    else if (name == "graph")  test = isgraph;
+    else if (name == "lower")  test = islower;
+    else if (name == "print")  test = isprint;
+    else if (name == "punct")  test = ispunct;
+    else if (name == "space")  test = isspace;
+    else if (name == "upper")  test = isupper;
+    else if (name == "xdigit") test = isxdigit;
+    else return false;
+    for (int c = 0; c < 256; ++c) {
+        if (test(c)) set.set(static_cast<size_t>(c));
+    }
+    return true;
+}
+
+} // namespace
+
+// ── Compiling ────────────────────────────────────────────────────────────────
+
+Pattern::Pattern(std::string_view text, unsigned flags) : period_((flags & kPeriod) != 0) {
+    Run run;
+    auto endRun = [&]() {
+        if (run.atoms.empty()) return;
+        min_length_ += run.atoms.size();
+        runs_.push_back(std::move(run));
+        run = Run();
+    };
+    auto addChar = [&](char c) {
+        run.atoms.push_back({Atom::Char, static_cast<unsigned char>(c), 0});
+        run.text += c;
+    };
+
+    leading_star_ = !text.empty() && text[0] == '*';
+    for (size_t i = 0; i < text.size(); ++i) {
+        char c = text[i];
+        if (c == '*') {
+            endRun();
+            trailing_star_ = true;
+            continue;
+        }
+        trailing_star_ = false;
+        if (c == '\\' && i + 1 < text.size()) {
+            addChar(text[++i]);
+        } else if (c == '?') {
+            run.atoms.push_back({Atom::Any, 0, 0});
+            run.plain = false;
+        } else if (c == '[' && parseSet(text, i)) {
+            run.atoms.push_back({Atom::Set, 0, static_cast<uint16_t>(sets_.size() - 1)});
+            run.plain = false;
+        } else {
+            addChar(c);  // Includes an unterminated '[' and a trailing '\'
+        }
+    }
+    endRun();
+
+    starts_with_dot_ = !leading_star_ && !runs_.empty() &&
+                       runs_[0].atoms[0].type == Atom::Char && runs_[0].atoms[0].c == '.';
+
+    bool plain = runs_.size() <= 1 && (runs_.empty() || runs_[0].plain);
+    if (!plain) shape_ = Shape::General;
+    else if (runs_.empty()) shape_ = leading_star_ ? Shape::Anything : Shape::Literal;
+    else if (!leading_star_ && !trailing_star_) shape_ = Shape::Literal;
+    else if (!leading_star_) shape_ = Shape::Prefix;
+    else if (!trailing_star_) shape_ = Shape::Suffix;
+    else shape_ = Shape::Contains;
+}
+
+bool Pattern::parseSet(std::string_view text, size_t& i) {
+    std::bitset<256> set;
+    size_t j = i + 1;
+    bool negate = j < text.size() && (text[j] == '!' || text[j] == '^');
+    if (negate) ++j;
+
+    // One member at text[j] (advancing j past it); false at the end of text
+    auto member = [&](unsigned char& out) -> bool {
+        if (j >= text.size()) return false;
+        if (text[j] == '\\' && j + 1 < text.size()) ++j;
+        out = static_cast<unsigned char>(text[j++]);
+        return true;
+    };
+
+    for (bool first = true;; first = false) {
+        if (j >= text.size()) return false;
+        char c = text[j];
+        if (c == ']' && !first) break;
+        if (c == '[' && j + 1 < text.size() && (text[j + 1] == ':' || text[j + 1] == '=' || text[j + 1] == '.')) {
+            char kind = text[j + 1];
+            size_t close = text.find(std::string{kind, ']'}, j + 2);
+            if (close == std::string_view::npos) return false;
+            std::string_view name = text.substr(j + 2, close - j - 2);
+            if (kind == ':') {
+                if (!addClass(name, set)) return false;
+            } else {
+                // [=c=] and [.c.]: a single character in the C locale
+                if (name.size() != 1) return false;
+                set.set(static_cast<unsigned char>(name[0]));
+            }
+            j = close + 2;
+            continue;
+        }
+        unsigned char lo;
+        if (!member(lo)) return false;
+        if (j + 1 < text.size() && text[j] == '-' && text[j + 1] != ']') {
+            ++j;
+            unsigned char hi;
+            if (!member(hi)) return false;
+            for (unsigned v = lo; v <= hi; ++v) set.set(v);
+        } else {
+            set.set(lo);
+        }
+    }
+
+    if (negate) set.flip();
+    sets_.push_back(set);
+    i = j;  // At the closing ']'
+    return true;
+}
+
+// ── Matching ─────────────────────────────────────────────────────────────────
+
+bool Pattern::matchAt(const Run& run, std::string_view s, size_t pos) const {
+    if (run.plain) return s.compare(pos, run.text.size(), run.text) == 0;
+    for (const Atom& atom : run.atoms) {
+        unsigned char c = static_cast<unsigned char>(s[pos++]);
+        if (atom.type == Atom::Char ? c != atom.c : atom.type == Atom::Set && !sets_[atom.set][c]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Leftmost position in [begin, end) where run matches entirely, or npos
+size_t Pattern::find(const Run& run, std::string_view s, size_t begin, size_t end) const {
+    size_t width = run.atoms.size();
+    if (end - begin < width) return std::string_view::npos;
+    if (run.plain) return s.substr(0, end).find(run.text, begin);
+    for (size_t pos = begin; pos + width <= end; ++pos) {
+        if (matchAt(run, s, pos)) return pos;
+    }
+    return std::string_view::npos;
+}
+
+bool Pattern::matchGeneral(std::string_view s) const {
+    size_t begin = 0;
+    size_t end = s.size();
+    size_t first = 0;
+    size_t last = runs_.size();
+    if (s.size() < min_length_) return false;
+
+    if (!leading_star_ && !trailing_star_ && last == 1) {
+        return s.size() == runs_[0].atoms.size() && matchAt(runs_[0], s, 0);
+    }
+    if (!leading_star_) {
+        if (!matchAt(runs_[0], s, 0)) return false;
+        begin = runs_[0].atoms.size();
+        first = 1;
+    }
+    if (!trailing_star_) {
+        // A star separates this run from the first one, so they are distinct
+        const Run& run = runs_[last - 1];
+        if (end - begin < run.atoms.size() || !matchAt(run, s, end - run.atoms.size())) return false;
+        end -= run.atoms.size();
+        --last;
+    }
+    // Any stretch a star can cover: the leftmost fit of each run leaves the
+    // most room for the ones after it
+    for (size_t r = first; r < last; ++r) {
+        size_t pos = find(runs_[r], s, begin, end);
+        if (pos == std::string_view::npos) return false;
+        begin = pos + runs_[r].atoms.size();
+    }
+    return true;
+}
+
+bool Pattern::matches(std::string_view s) const {
+    if (period_ && !s.empty() && s[0] == '.' && !starts_with_dot_) return false;
+    switch (shape_) {
+    case Shape::Literal:  return s == (runs_.empty() ? std::string_view() : std::string_view(runs_[0].text));
+    case Shape::Prefix:   return s.starts_with(runs_[0].text);
+    case Shape::Suffix:   return s.ends_with(runs_[0].text);
+    case Shape::Contains: return s.find(runs_[0].text) != std::string_view::npos;
+    case Shape::Anything: return true;
+    case Shape::General:  return matchGeneral(s);
+    }
+    return false;
+}
+
+size_t Pattern::matchPrefix(std::string_view s, bool longest) const {
+    constexpr size_t npos = std::string_view::npos;
+    if (s.size() < min_length_) return npos;
+    std::string_view text = runs_.empty() ? std::string_view() : std::string_view(runs_[0].text);
+    if (!period_) {
+        switch (shape_) {
+        case Shape::Literal:
+            return s.starts_with(text) ? text.size() : npos;
+        case Shape::Prefix:
+            return !s.starts_with(text) ? npos : longest ? s.size() : text.size();
+        case Shape::Suffix: {
+            size_t pos = longest ? s.rfind(text) : s.find(text);
+            return pos == npos ? npos : pos + text.size();
+        }
+        case Shape::Contains: {
+            size_t pos = s.find(text);
+            return pos == npos ? npos : longest ? s.size() : pos + text.size();
+        }
+        case Shape::Anything:
+            return longest ? s.size() : 0;
+        case Shape::General:
+            break;
+        }
+    }
+    // As bash does: try each length in turn, from the short or the long end
+    for (size_t i = 0; i + min_length_ <= s.size(); ++i) {
+        size_t len = longest ? s.size() - i : min_length_ + i;
+        if (matches(s.substr(0, len))) return len;
+    }
+    return npos;
+}
+
+size_t Pattern::matchSuffix(std::string_view s, bool longest) const {
+    constexpr size_t npos = std::string_view::npos;
+    if (s.size() < min_length_) return npos;
+    std::string_view text = runs_.empty() ? std::string_view() : std::string_view(runs_[0].text);
+    if (!period_) {
+        switch (shape_) {
+        case Shape::Literal:
+            return s.ends_with(text) ? s.size() - text.size() : npos;
+        case Shape::Prefix:
+            return longest ? s.find(text) : s.rfind(text);
+        case Shape::Suffix:
+            return !s.ends_with(text) ? npos : longest ? 0 : s.size() - text.size();
+        case Shape::Contains: {
+            size_t pos = s.rfind(text);
+            return pos == npos ? npos : longest ? 0 : pos;
+        }
+        case Shape::Anything:
+            return longest ? 0 : s.size();
+        case Shape::General:
+            break;
+        }
+    }
+    for (size_t i = 0; i + min_length_ <= s.size(); ++i) {
+        size_t start = longest ? i : s.size() - min_length_ - i;
+        if (matches(s.substr(start))) return start;
+    }
+    return npos;
+}
+
+// ── PatternMatcher ───────────────────────────────────────────────────────────
+
+PatternMatcher& PatternMatcher::global() {
+    static PatternMatcher matcher;
+    return matcher;
+}
+
+const Pattern& PatternMatcher::compile(std::string_view text, unsigned flags) {
+    Map& patterns = patterns_[(flags & Pattern::kPeriod) ? 1 : 0];
+    auto it = patterns.find(text);
+    if (it != patterns.end()) {
+        ++stats_.hits;
+        return *it->second;
+    }
+    if (patterns.size() >= kMaxPatterns) patterns.clear();
+    ++stats_.compiled;
+    auto [inserted, added] = patterns.emplace(std::string(text), std::make_unique<Pattern>(text, flags));
+    (void)added;
+    return *inserted->second;
+}
+
+void PatternMatcher::clear() {
+    for (Map& patterns : patterns_) patterns.clear();
+}
+
+} // namespace helix
@@ -1,7 +1,13 @@
 #include "executor/pipeline_manager.h"
+#include "executor/child_wait.h"
+#include "executor/fd_utils.h"
+#include "shell/variable_store.h"
+#include "trace.h"
 #include <iostream>
 #include <unistd.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
+#include <cerrno>
 
 namespace helix {
 
@@ -20,25 +26,65 @@ int PipelineManager::executePipeline(
         return -1;
     }
 
+    PipelineLaunch launch = startPipeline(cmd, std::move(executor_func), nullptr, false);
+    if (!launch.ok()) return -1;
+
+    std::vector<int> stage_status;
+    std::vector<ResourceUsage> stage_usage;
+    return waitForPipeline(launch, stage_status, stage_usage);
+}
+
+PipelineLaunch PipelineManager::startPipeline(
+    const ParsedCommand& cmd,
+    std::function<void(const Command&)> executor_func,
+    StageSpawner spawn_func,
+    bool own_group) {
+
+    PipelineLaunch launch;
+    launch.started = std::chrono::steady_clock::now();
+    size_t num_commands = cmd.pipeline.commands.size();
+    if (num_commands == 0) {
+        return launch;
+    }
+
     // Create pipes between commands
     std::vector<std::pair<int, int>> pipes = createPipes(num_commands - 1);
     if (pipes.size() != num_commands - 1) {
-        return -1;
+        return launch;
     }
 
-    // Fork and execute each command in the pipeline
-    std::vector<pid_t> pids;
+    // Start each command in the pipeline
+    std::vector<pid_t>& pids = launch.pids;
     pids.reserve(num_commands);
 
     for (size_t i = 0; i < num_commands; ++i) {
-        pid_t pid = fork();
+        // Group to join: a new one for the first stage, then the leader's
+        pid_t group = own_group ? (pids.empty() ? 0 : launch.pgid) : -1;
+
+        // Offer the stage to the spawn fast path; it declines with -1 when
+        // the stage needs a forked copy of the shell
+        const std::vector<std::string>& stage_args = cmd.pipeline.commands[i].args;
+        Tracer::Span trace_stage("fork", stage_args.empty() ? std::string_view() : stage_args[0]);
+        pid_t pid = -1;
+        if (spawn_func) {
+            int stage_in = i > 0 ? pipes[i-1].first : -1;
+            int stage_out = i < num_commands - 1 ? pipes[i].second : -1;
+            pid = spawn_func(cmd.pipeline.commands[i], stage_in, stage_out, group);
+        }
+        bool spawned = pid != -1;
+        if (spawned) trace_stage.rename("spawn");
+        else pid = fork();
         if (pid == -1) {
             std::cerr << "Fork failed for pipeline command\n";
             cleanupPipes(pipes);
-            return -1;
+            // Stages already running are left to the SIGCHLD reaper
+            launch.pids.clear();
+            return launch;
         }
 
         if (pid == 0) { // Child process
+            if (group >= 0) setpgid(0, group);
+
             // Setup input redirection for this command
             if (i > 0) {
                 // Read from previous pipe
@@ -69,6 +115,19 @@ int PipelineManager::executePipeline(
         } else {
             // Parent process
             pids.push_back(pid);
+            if (Tracer::enabled()) {
+                trace_stage.args().child = pid;
+                trace_stage.args().stage = static_cast<int>(i);
+                Tracer::global().nameProcess(pid, "stage " + std::to_string(i) + ": " +
+                                                      (stage_args.empty() ? std::string() : stage_args[0]));
+            }
+
+            // Set the group from both sides so neither order of events
+            // leaves a stage outside it (a spawned child already joined)
+            if (group >= 0) {
+                if (group == 0) launch.pgid = pid;
+                if (!spawned) setpgid(pid, launch.pgid);
+            }
 
             // Close pipe ends that are not needed in parent
             if (i > 0) {
@@ -80,18 +139,22 @@ int PipelineManager::executePipeline(
 
     // Close remaining pipe ends in parent
     cleanupPipes(pipes);
-
-    // Wait for all commands in the pipeline to complete
-    return waitForPipeline(pids);
+    return launch;
 }
 
 std::vector<std::pair<int, int>> PipelineManager::createPipes(size_t count) {
     std::vector<std::pair<int, int>> pipes;
     pipes.reserve(count);
 
+    // $HELIX_PIPE_SIZE: bigger buffers between high-throughput stages
+    int pipe_size = 0;
+    if (const std::string* size = VariableStore::global().find("HELIX_PIPE_SIZE")) {
+        pipe_size = parsePipeSize(*size);
+    }
+
     for (size_t i = 0; i < count; ++i) {
         int pipe_fds[2];
-        if (pipe(pipe_fds) == -1) {
+        if (!makeCloexecPipe(pipe_fds)) {
             std::cerr << "Failed to create pipe\n";
             // Clean up already created pipes
             for (auto& p : pipes) {
@@ -100,6 +163,7 @@ std::vector<std::pair<int, int>> PipelineManager::createPipes(size_t count) {
             }
             return {};
         }
+        if (pipe_size > 0) setPipeSize(pipe_fds[1], pipe_size);
         pipes.emplace_back(pipe_fds[0], pipe_fds[1]); // [read_fd, write_fd]
     }
 
@@ -113,28 +177,78 @@ void PipelineManager::cleanupPipes(std::vector<std::pair<int, int>>& pipes) {
     }
 }
 
-int PipelineManager::waitForPipeline(const std::vector<pid_t>& pids) {
-    int exit_status = -1;
-
-    for (size_t i = 0; i < pids.size(); ++i) {
+int PipelineManager::waitForPipeline(const PipelineLaunch& launch, std::vector<int>& stage_status,
+                                     std::vector<ResourceUsage>& stage_usage) {
+    const std::vector<pid_t>& pids = launch.pids;
+    stage_status.assign(pids.size(), -1);
+    stage_usage.assign(pids.size(), ResourceUsage{});
+    size_t remaining = pids.size();
+    Tracer::Span trace_wait("wait");
+
+    // Reap stages as they finish rather than in pipeline order, so a slow
+    // head never delays collecting the others
+    while (remaining > 0) {
         int status;
-        if (waitpid(pids[i], &status, 0) == -1) {
-            std::cerr << "Wait failed for pipeline process " << i << "\n";
-            continue;
+        struct rusage usage;
+        pid_t pid = launch.pgid > 0 ? waitForeground(-launch.pgid, &status, 0, &usage)
+                                    : waitAnyOf(pids, stage_status, status, usage);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            // The SIGCHLD handler got there first (ECHILD)
+            break;
         }
 
-        if (i == pids.size() - 1) { // Last command
-            if (WIFEXITED(status)) {
-                exit_status = WEXITSTATUS(status);
-            } else if (WIFSIGNALED(status)) {
+        size_t i = 0;
+        while (i < pids.size() && pids[i] != pid) ++i;
+        if (i == pids.size() || stage_status[i] != -1) continue;
+        --remaining;
+        auto real = std::chrono::steady_clock::now() - launch.started;
+        stage_usage[i] = ResourceUsage::from(
+            usage, std::chrono::duration_cast<std::chrono::microseconds>(real).count());
+
+        if (WIFEXITED(status)) {
+            stage_status[i] = WEXITSTATUS(status);
+        } else if (WIFSIGNALED(status)) {
+            stage_status[i] = 128 + WTERMSIG(status);
+            if (i == pids.size() - 1) {
                 std::cerr << "Pipeline last command terminated by signal "
                          << WTERMSIG(status) << "\n";
-                exit_status = 128 + WTERMSIG(status);
             }
         }
+        if (Tracer::enabled()) {
+            // What the stage itself ran, on its own row
+            long long end = Tracer::now();
+            TraceArgs args;
+            args.stage = static_cast<int>(i);
+            args.status = stage_status[i];
+            Tracer::global().completeFor(pid, "run", end - stage_usage[i].real_us, end, {}, args);
+        }
+    }
+
+    for (size_t i = 0; i < pids.size(); ++i) {
+        if (stage_status[i] == -1) {
+            std::cerr << "Wait failed for pipeline process " << i << "\n";
+        }
     }
+    return stage_status.empty() ? -1 : stage_status.back();
+}
 
-    return exit_status;
+pid_t PipelineManager::waitAnyOf(const std::vector<pid_t>& pids,
+                                 const std::vector<int>& stage_status, int& status,
+                                 struct rusage& usage) {
+    // Stages share the shell's process group, so waitpid(-pgid) would also
+    // catch unrelated children: poll our own pids, then block on the first
+    // that is still running
+    for (size_t i = 0; i < pids.size(); ++i) {
+        if (stage_status[i] != -1) continue;
+        pid_t pid = wait4(pids[i], &status, WNOHANG, &usage);
+        if (pid != 0) return pid;
+    }
+    for (size_t i = 0; i < pids.size(); ++i) {
+        if (stage_status[i] == -1) return waitForeground(pids[i], &status, 0, &usage);
+    }
+    errno = ECHILD;
+    return -1;
 }
 
 } // namespace helix
@@ -0,0 +1,175 @@
+#include "executor/process_spawner.h"
+#include "executor/fd_utils.h"
+#include "shell/variable_store.h"
+#include <spawn.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <csignal>
+
+namespace helix {
+
+namespace {
+
+// Descriptors the parent opened for one spawn; the child has its own copies
+// once posix_spawn() returns, so they are always closed on the way out
+class ParentFds {
+public:
+    ParentFds() = default;
+    ~ParentFds() {
+        for (int fd : fds_) close(fd);
+    }
+    ParentFds(const ParentFds&) = delete;
+    ParentFds& operator=(const ParentFds&) = delete;
+
+    int open(const std::string& path, int flags) {
+        int fd = ::open(path.c_str(), flags | O_CLOEXEC, 0644);
+        if (fd != -1) fds_.push_back(fd);
+        return fd;
+    }
+
+    // Descriptor holding body (pipe or memfd, see openInputFd)
+    int preload(std::string_view body) {
+        int fd = openInputFd(body);
+        if (fd != -1) fds_.push_back(fd);
+        return fd;
+    }
+
+private:
+    std::vector<int> fds_;
+};
+
+// RAII wrappers so every early return releases the spawn objects
+struct FileActions {
+    posix_spawn_file_actions_t actions;
+    FileActions() { posix_spawn_file_actions_init(&actions); }
+    ~FileActions() { posix_spawn_file_actions_destroy(&actions); }
+    void dup(int fd, int target) { posix_spawn_file_actions_adddup2(&actions, fd, target); }
+};
+
+struct SpawnAttributes {
+    posix_spawnattr_t attr;
+    SpawnAttributes() { posix_spawnattr_init(&attr); }
+    ~SpawnAttributes() { posix_spawnattr_destroy(&attr); }
+};
+
+int outputFlags(bool append) {
+    return O_WRONLY | O_CREAT | (append ? O_APPEND : O_TRUNC);
+}
+
+} // namespace
+
+bool ProcessSpawner::supported() {
+#if defined(__APPLE__)
+    return true;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 34))
+    return true;  // posix_spawn_file_actions_addclosefrom_np
+#else
+    return false;
+#endif
+}
+
+pid_t ProcessSpawner::spawn(const std::string& path, const std::vector<std::string>& args,
+                            const Command& cmd, int input_fd, int output_fd,
+                            pid_t process_group) {
+    if (!supported() || path.empty() || args.empty() || hasInheritedFds()) return -1;
+
+    ParentFds opened;
+    FileActions fa;
+
+#if defined(__APPLE__)
+    // Under POSIX_SPAWN_CLOEXEC_DEFAULT only listed descriptors survive
+    for (int fd = STDIN_FILENO; fd <= STDERR_FILENO; ++fd) {
+        posix_spawn_file_actions_addinherit_np(&fa.actions, fd);
+    }
+#endif
+
+    // Pipes first; the command's own redirections override them, exactly as
+    // in a forked pipeline stage
+    if (input_fd != -1) fa.dup(input_fd, STDIN_FILENO);
+    if (output_fd != -1) fa.dup(output_fd, STDOUT_FILENO);
+
+    // Then each redirection in source order, as FileDescriptorManager does;
+    // any open failure is left to the fork path, which reports it
+    using Kind = Redirection::Kind;
+    for (const auto& r : cmd.redirections) {
+        int fd = -1;
+        switch (r.kind) {
+        case Kind::INPUT:
+            if ((fd = opened.open(r.target, O_RDONLY)) == -1) return -1;
+            fa.dup(fd, STDIN_FILENO);
+            break;
+        case Kind::OUTPUT:
+        case Kind::APPEND:
+            if ((fd = opened.open(r.target, outputFlags(r.kind == Kind::APPEND))) == -1) return -1;
+            fa.dup(fd, STDOUT_FILENO);
+            break;
+        case Kind::ERROR:
+        case Kind::ERROR_APPEND:
+            if ((fd = opened.open(r.target, outputFlags(r.kind == Kind::ERROR_APPEND))) == -1) return -1;
+            fa.dup(fd, STDERR_FILENO);
+            break;
+        case Kind::BOTH:
+        case Kind::BOTH_APPEND:
+            if ((fd = opened.open(r.target, outputFlags(r.kind == Kind::BOTH_APPEND))) == -1) return -1;
+            fa.dup(fd, STDOUT_FILENO);
+            fa.dup(fd, STDERR_FILENO);
+            break;
+        case Kind::ERR_TO_OUT:
+            fa.dup(STDOUT_FILENO, STDERR_FILENO);
+            break;
+        case Kind::OUT_TO_ERR:
+            fa.dup(STDERR_FILENO, STDOUT_FILENO);
+            break;
+        case Kind::DUP_OUT:
+        case Kind::DUP_IN:
+            // A descriptor that is not open fails the spawn; fork reports it
+            fd = parseFdNumber(r.target);
+            if (fd == -1 || (fd > STDERR_FILENO && !isSharedFd(fd))) return -1;
+            fa.dup(fd, r.kind == Kind::DUP_OUT ? STDOUT_FILENO : STDIN_FILENO);
+            break;
+        case Kind::HEREDOC:
+        case Kind::HEREDOC_STRIP:
+        case Kind::HERESTRING:
+            fd = opened.preload(r.isHeredoc() ? r.body : r.target + "\n");
+            if (fd == -1) return -1;
+            fa.dup(fd, STDIN_FILENO);
+            break;
+        }
+    }
+
+    SpawnAttributes sa;
+    short flags = POSIX_SPAWN_SETSIGMASK;
+
+    // Start the program with SIGCHLD unblocked even while the shell holds it
+    sigset_t mask;
+    sigprocmask(SIG_BLOCK, nullptr, &mask);
+    sigdelset(&mask, SIGCHLD);
+    posix_spawnattr_setsigmask(&sa.attr, &mask);
+#if defined(__APPLE__)
+    flags |= POSIX_SPAWN_CLOEXEC_DEFAULT;
+#else
+    posix_spawn_file_actions_addclosefrom_np(&fa.actions, STDERR_FILENO + 1);
+#endif
+    if (process_group >= 0) {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&sa.attr, process_group);
+    }
+    posix_spawnattr_setflags(&sa.attr, flags);
+
+    std::vector<char*> argv;
+    argv.reserve(args.size() + 1);
+    for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+    argv.push_back(nullptr);
+
+    // A failed exec (ENOENT, ENOEXEC scripts, ...) is retried via fork() and
+    // execvp(), which handles and reports those cases
+    pid_t pid = -1;
+    char* const* envp = VariableStore::global().envp();
+    if (posix_spawnp(&pid, path.c_str(), &fa.actions, &sa.attr, argv.data(), envp) != 0) {
+        return -1;
+    }
+    return pid;
+}
+
+} // namespace helix
@@ -0,0 +1,175 @@
+#include "git_status_cache.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+#include <array>
+#include <cstdio>
+#include <csignal>
+#include <pthread.h>
+#include <sys/stat.h>
+
+namespace helix {
+
+namespace {
+
+// Cache key: a new commit, checkout or `git add` changes one of these
+struct RepoKey {
+    struct timespec index_mtime {};
+    struct timespec head_mtime {};
+
+    bool operator==(const RepoKey& other) const {
+        return index_mtime.tv_sec == other.index_mtime.tv_sec &&
+               index_mtime.tv_nsec == other.index_mtime.tv_nsec &&
+               head_mtime.tv_sec == other.head_mtime.tv_sec &&
+               head_mtime.tv_nsec == other.head_mtime.tv_nsec;
+    }
+};
+
+struct timespec mtimeOf(const std::string& path) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return {};
+#if defined(__APPLE__)
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+RepoKey keyFor(const std::string& root) {
+    return {mtimeOf(root + "/.git/index"), mtimeOf(root + "/.git/HEAD")};
+}
+
+// Single-quote a path for popen()'s /bin/sh
+std::string shellQuote(const std::string& s) {
+    std::string quoted = "'";
+    for (char c : s) {
+        if (c == '\'') quoted += "'\\''";
+        else quoted += c;
+    }
+    return quoted + "'";
+}
+
+std::string runGitStatus(const std::string& root) {
+    std::string command = "git -C " + shellQuote(root) + " status --porcelain 2>/dev/null";
+    FILE* pipe = popen(command.c_str(), "r");
+    if (!pipe) return "";
+    std::string output;
+    std::array<char, 4096> buf;
+    size_t n;
+    while ((n = fread(buf.data(), 1, buf.size(), pipe)) > 0) output.append(buf.data(), n);
+    pclose(pipe);
+    return output;
+}
+
+} // namespace
+
+struct GitStatusCache::Shared {
+    struct Entry {
+        bool known = false;      // markers holds a computed value
+        bool pending = false;    // Queued or being computed
+        RepoKey key;             // Key the markers were computed under
+        std::chrono::steady_clock::time_point computed_at;
+        Markers markers;
+    };
+
+    std::mutex mutex;
+    std::condition_variable changed;   // Worker -> prompt: an entry is known
+    std::condition_variable work;      // Prompt -> worker: queue not empty
+    std::deque<std::string> queue;
+    std::unordered_map<std::string, Entry> entries;
+    bool started = false;
+    bool stopping = false;
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            work.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping) return;
+            std::string root = std::move(queue.front());
+            queue.pop_front();
+
+            lock.unlock();
+            Markers markers = parsePorcelain(runGitStatus(root));
+            // Read the key afterwards: `git status` may itself rewrite the
+            // index, which must not look like a change next time
+            RepoKey key = keyFor(root);
+            lock.lock();
+
+            Entry& entry = entries[root];
+            entry.known = true;
+            entry.pending = false;
+            entry.key = key;
+            entry.computed_at = std::chrono::steady_clock::now();
+            entry.markers = markers;
+            changed.notify_all();
+        }
+    }
+};
+
+GitStatusCache::GitStatusCache() : shared_(std::make_shared<Shared>()) {}
+
+GitStatusCache::~GitStatusCache() {
+    {
+        std::lock_guard<std::mutex> lock(shared_->mutex);
+        shared_->stopping = true;
+    }
+    shared_->work.notify_all();
+    // A git status in a huge repository may still be running; the worker
+    // keeps Shared alive and exits after it, so there is nothing to join
+}
+
+std::optional<GitStatusCache::Markers> GitStatusCache::get(const std::string& root,
+                                                           std::chrono::milliseconds budget) {
+    RepoKey key = keyFor(root);
+    auto now = std::chrono::steady_clock::now();
+
+    std::unique_lock<std::mutex> lock(shared_->mutex);
+    Shared::Entry& entry = shared_->entries[root];
+    bool fresh = entry.known && entry.key == key && now - entry.computed_at < kMaxAge;
+
+    if (!fresh && !entry.pending) {
+        entry.pending = true;
+        shared_->queue.push_back(root);
+        if (!shared_->started) {
+            shared_->started = true;
+            auto shared = shared_;
+            // Signals stay with the main thread (readline, SIGCHLD, SIGINT)
+            sigset_t all, saved;
+            sigfillset(&all);
+            pthread_sigmask(SIG_BLOCK, &all, &saved);
+            std::thread([shared] { shared->run(); }).detach();
+            pthread_sigmask(SIG_SETMASK, &saved, nullptr);
+        }
+        shared_->work.notify_one();
+    }
+
+    // Last known value, even if a refresh is under way
+    if (entry.known) return entry.markers;
+
+    if (budget.count() > 0) {
+        shared_->changed.wait_for(lock, budget, [&] { return shared_->entries[root].known; });
+        const Shared::Entry& updated = shared_->entries[root];
+        if (updated.known) return updated.markers;
+    }
+    return std::nullopt;
+}
+
+GitStatusCache::Markers GitStatusCache::parsePorcelain(const std::string& output) {
+    Markers markers;
+    std::istringstream ss(output);
+    std::string line;
+    while (std::getline(ss, line)) {
+        if (line.size() < 2) continue;
+        char index = line[0];
+        char work  = line[1];
+        if (index == '?' && work == '?') { markers.untracked = true; continue; }
+        if (index != ' ' && index != '?') markers.staged = true;
+        if (work  != ' ' && work  != '?') markers.dirty  = true;
+    }
+    return markers;
+}
+
+} // namespace helix
@@ -0,0 +1,523 @@
+#include "http_client.h"
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// Waits are sliced so a cancel flag is seen within this many milliseconds
+constexpr int kPollSliceMs = 100;
+
+// Give up on a connect, or on a response that stops arriving, after this long
+constexpr int kConnectTimeoutMs = 10000;
+constexpr int kReadTimeoutMs = 60000;
+
+// Largest response head accepted
+constexpr size_t kMaxHead = 64 * 1024;
+
+// ── libssl ───────────────────────────────────────────────────────────────────
+// Opened on the first https request, so shells that never make one never
+// map libssl and libcrypto. Only the stable entry points of OpenSSL 1.1 and
+// 3 are used; the constants below are part of their ABI.
+
+constexpr int kSslVerifyPeer = 1;               // SSL_VERIFY_PEER
+constexpr int kSslCtrlSetTlsextHostname = 55;   // SSL_CTRL_SET_TLSEXT_HOSTNAME
+constexpr long kTlsextNametypeHostName = 0;     // TLSEXT_NAMETYPE_host_name
+constexpr int kSslErrorWantRead = 2;            // SSL_ERROR_WANT_READ
+constexpr int kSslErrorWantWrite = 3;           // SSL_ERROR_WANT_WRITE
+constexpr int kSslErrorZeroReturn = 6;          // SSL_ERROR_ZERO_RETURN
+
+struct SslApi {
+    int (*init_ssl)(uint64_t, const void*) = nullptr;
+    const void* (*client_method)() = nullptr;
+    void* (*ctx_new)(const void*) = nullptr;
+    int (*ctx_set_default_verify_paths)(void*) = nullptr;
+    void (*ctx_set_verify)(void*, int, void*) = nullptr;
+    void* (*ssl_new)(void*) = nullptr;
+    int (*set_fd)(void*, int) = nullptr;
+    long (*ctrl)(void*, int, long, void*) = nullptr;
+    int (*set1_host)(void*, const char*) = nullptr;
+    int (*connect)(void*) = nullptr;
+    int (*read)(void*, void*, int) = nullptr;
+    int (*write)(void*, const void*, int) = nullptr;
+    int (*get_error)(const void*, int) = nullptr;
+    int (*shutdown)(void*) = nullptr;
+    void (*free)(void*) = nullptr;
+};
+
+SslApi g_ssl;
+void* g_ssl_ctx = nullptr;
+
+template <typename T>
+bool resolve(void* lib, const char* name, T& out) {
+    out = reinterpret_cast<T>(dlsym(lib, name));
+    return out != nullptr;
+}
+
+bool loadSsl() {
+    static int state = 0;  // 0 not tried, 1 loaded, -1 unavailable
+    if (state != 0) return state > 0;
+    state = -1;
+
+    static const char* const kCandidates[] = {
+#ifdef HELIX_SSL_LIBRARY
+        HELIX_SSL_LIBRARY,
+#endif
+        "libssl.so.3", "libssl.so.1.1", "libssl.so",
+        "libssl.3.dylib", "libssl.dylib",
+    };
+    void* lib = nullptr;
+    for (const char* name : kCandidates) {
+        if ((lib = dlopen(name, RTLD_NOW | RTLD_LOCAL))) break;
+    }
+    if (!lib) return false;
+
+    SslApi api;
+    bool ok = resolve(lib, "OPENSSL_init_ssl", api.init_ssl) &&
+              resolve(lib, "TLS_client_method", api.client_method) &&
+              resolve(lib, "SSL_CTX_new", api.ctx_new) &&
+              resolve(lib, "SSL_CTX_set_default_verify_paths", api.ctx_set_default_verify_paths) &&
+              resolve(lib, "SSL_CTX_set_verify", api.ctx_set_verify) &&
+              resolve(lib, "SSL_new", api.ssl_new) &&
+              resolve(lib, "SSL_set_fd", api.set_fd) &&
+              resolve(lib, "SSL_ctrl", api.ctrl) &&
+              resolve(lib, "SSL_set1_host", api.set1_host) &&
+              resolve(lib, "SSL_connect", api.connect) &&
+              resolve(lib, "SSL_read", api.read) &&
+              resolve(lib, "SSL_write", api.write) &&
+              resolve(lib, "SSL_get_error", api.get_error) &&
+              resolve(lib, "SSL_shutdown", api.shutdown) &&
+              resolve(lib, "SSL_free", api.free);
+    if (!ok || api.init_ssl(0, nullptr) != 1) {
+        dlclose(lib);
+        return false;
+    }
+    void* ctx = api.ctx_new(api.client_method());
+    if (!ctx || api.ctx_set_default_verify_paths(ctx) != 1) {
+        dlclose(lib);
+        return false;
+    }
+    api.ctx_set_verify(ctx, kSslVerifyPeer, nullptr);
+    g_ssl = api;
+    g_ssl_ctx = ctx;
+    state = 1;
+    return true;
+}
+
+// ── URLs ─────────────────────────────────────────────────────────────────────
+
+struct Url {
+    bool tls = false;
+    std::string host;
+    std::string port;
+    std::string target;  // Path and query
+
+    std::string key() const { return (tls ? "https://" : "http://") + host + ":" + port; }
+};
+
+bool parseUrl(const std::string& url, Url& out) {
+    size_t rest;
+    if (url.rfind("https://", 0) == 0) {
+        out.tls = true;
+        rest = 8;
+    } else if (url.rfind("http://", 0) == 0) {
+        rest = 7;
+    } else {
+        return false;
+    }
+    size_t slash = url.find('/', rest);
+    std::string authority = url.substr(rest, slash == std::string::npos ? std::string::npos : slash - rest);
+    out.target = slash == std::string::npos ? "/" : url.substr(slash);
+    size_t colon = authority.rfind(':');
+    if (colon != std::string::npos && authority.find(']', colon) == std::string::npos) {
+        out.host = authority.substr(0, colon);
+        out.port = authority.substr(colon + 1);
+    } else {
+        out.host = authority;
+        out.port = out.tls ? "443" : "80";
+    }
+    if (out.host.size() > 2 && out.host.front() == '[' && out.host.back() == ']') {
+        out.host = out.host.substr(1, out.host.size() - 2);
+    }
+    return !out.host.empty() && !out.port.empty();
+}
+
+bool cancelled(const volatile std::sig_atomic_t* cancel) {
+    return cancel && *cancel;
+}
+
+// Wait until fd is ready for events; 1 ready, 0 timed out, -1 cancelled
+// or failed
+int waitFor(int fd, short events, int timeout_ms, const volatile std::sig_atomic_t* cancel) {
+    for (int waited = 0; waited < timeout_ms; waited += kPollSliceMs) {
+        if (cancelled(cancel)) return -1;
+        struct pollfd p = {fd, events, 0};
+        int r = poll(&p, 1, std::min(kPollSliceMs, timeout_ms - waited));
+        if (r > 0) return 1;
+        if (r < 0 && errno != EINTR) return -1;
+    }
+    return 0;
+}
+
+bool equalsIgnoreCase(std::string_view a, std::string_view b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+        return std::tolower(static_cast<unsigned char>(x)) == std::tolower(static_cast<unsigned char>(y));
+    });
+}
+
+} // namespace
+
+// ── Connection ───────────────────────────────────────────────────────────────
+
+// One non-blocking socket, with a TLS session on top for https
+struct HttpClient::Connection {
+    int fd = -1;
+    void* ssl = nullptr;
+
+    ~Connection() {
+        if (ssl) {
+            g_ssl.shutdown(ssl);
+            g_ssl.free(ssl);
+        }
+        if (fd >= 0) close(fd);
+    }
+
+    // Open a connection to url; error describes a failure
+    static ConnectionPtr open(const Url& url, const volatile std::sig_atomic_t* cancel, std::string& error) {
+        struct addrinfo hints {};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* found = nullptr;
+        int rc = getaddrinfo(url.host.c_str(), url.port.c_str(), &hints, &found);
+        if (rc != 0) {
+            error = url.host + ": " + gai_strerror(rc);
+            return nullptr;
+        }
+        auto conn = std::make_unique<Connection>();
+        error = url.host + ": connection failed";
+        for (struct addrinfo* ai = found; ai; ai = ai->ai_next) {
+            int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, ai->ai_protocol);
+            if (fd < 0) continue;
+            if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0 ||
+                (errno == EINPROGRESS && waitFor(fd, POLLOUT, kConnectTimeoutMs, cancel) == 1)) {
+                int so_error = 0;
+                socklen_t len = sizeof so_error;
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+                if (so_error == 0) {
+                    conn->fd = fd;
+                    break;
+                }
+                error = url.host + ": " + std::strerror(so_error);
+            }
+            close(fd);
+            if (cancelled(cancel)) break;
+        }
+        freeaddrinfo(found);
+        if (conn->fd < 0) return nullptr;
+
+        int one = 1;
+        setsockopt(conn->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+        if (url.tls && !conn->handshake(url.host, cancel, error)) return nullptr;
+        error.clear();
+        return conn;
+    }
+
+    bool handshake(const std::string& host, const volatile std::sig_atomic_t* cancel, std::string& error) {
+        if (!loadSsl()) {
+            error = "https needs libssl, which was not found";
+            return false;
+        }
+        ssl = g_ssl.ssl_new(g_ssl_ctx);
+        if (!ssl) return false;
+        g_ssl.set_fd(ssl, fd);
+        g_ssl.ctrl(ssl, kSslCtrlSetTlsextHostname, kTlsextNametypeHostName, const_cast<char*>(host.c_str()));
+        g_ssl.set1_host(ssl, host.c_str());
+        for (;;) {
+            int r = g_ssl.connect(ssl);
+            if (r == 1) return true;
+            int err = g_ssl.get_error(ssl, r);
+            short events = err == kSslErrorWantRead ? POLLIN : err == kSslErrorWantWrite ? POLLOUT : 0;
+            if (events == 0 || waitFor(fd, events, kConnectTimeoutMs, cancel) != 1) {
+                error = host + ": TLS handshake failed (certificate not trusted?)";
+                return false;
+            }
+        }
+    }
+
+    // Bytes read into buf; 0 at end of stream, -1 on error, timeout or cancel
+    ssize_t read(char* buf, size_t size, const volatile std::sig_atomic_t* cancel) {
+        for (;;) {
+            if (cancelled(cancel)) return -1;
+            if (ssl) {
+                int r = g_ssl.read(ssl, buf, static_cast<int>(size));
+                if (r > 0) return r;
+                int err = g_ssl.get_error(ssl, r);
+                if (err == kSslErrorZeroReturn) return 0;
+                short events = err == kSslErrorWantRead ? POLLIN : err == kSslErrorWantWrite ? POLLOUT : 0;
+                if (events == 0) return r == 0 ? 0 : -1;
+                if (waitFor(fd, events, kReadTimeoutMs, cancel) != 1) return -1;
+            } else {
+                ssize_t r = ::read(fd, buf, size);
+                if (r >= 0) return r;
+                if (errno == EINTR) continue;
+                if (errno != EAGAIN && errno != EWOULDBLOCK) return -1;
+                if (waitFor(fd, POLLIN, kReadTimeoutMs, cancel) != 1) return -1;
+            }
+        }
+    }
+
+    bool write(std::string_view data, const volatile std::sig_atomic_t* cancel) {
+        while (!data.empty()) {
+            if (cancelled(cancel)) return false;
+            ssize_t n;
+            short events = POLLOUT;
+            if (ssl) {
+                int r = g_ssl.write(ssl, data.data(), static_cast<int>(data.size()));
+                n = r;
+                if (r <= 0) {
+                    int err = g_ssl.get_error(ssl, r);
+                    if (err != kSslErrorWantRead && err != kSslErrorWantWrite) return false;
+                    events = err == kSslErrorWantRead ? POLLIN : POLLOUT;
+                }
+            } else {
+                n = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) return false;
+            }
+            if (n > 0) {
+                data.remove_prefix(static_cast<size_t>(n));
+            } else if (waitFor(fd, events, kReadTimeoutMs, cancel) != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // A kept connection the server has since closed shows up as readable
+    bool stillOpen() const {
+        struct pollfd p = {fd, POLLIN, 0};
+        return poll(&p, 1, 0) == 0;
+    }
+};
+
+// ── HttpClient ───────────────────────────────────────────────────────────────
+
+HttpClient& HttpClient::global() {
+    static HttpClient client;
+    return client;
+}
+
+bool HttpClient::tlsAvailable() {
+    return loadSsl();
+}
+
+HttpClient::~HttpClient() = default;
+
+void HttpClient::closeIdle() {
+    idle_.clear();
+}
+
+HttpClient::Response HttpClient::send(const Request& request, const BodyFn& on_body,
+                                      const volatile std::sig_atomic_t* cancel) {
+    Response response;
+    Url url;
+    if (!parseUrl(request.url, url)) {
+        response.error = "unsupported URL: " + request.url;
+        return response;
+    }
+    if (url.tls && !tlsAvailable()) {
+        response.error = "https needs libssl, which was not found";
+        return response;
+    }
+
+    std::string key = url.key();
+    ConnectionPtr conn;
+    auto it = idle_.find(key);
+    if (it != idle_.end()) {
+        conn = std::move(it->second);
+        idle_.erase(it);
+        if (!conn->stillOpen()) conn.reset();
+    }
+
+    // A kept connection may have been closed just as it was reused: if it
+    // fails before any response byte, the request goes out once more on a
+    // fresh one
+    for (int tries = 0; tries < 2; ++tries) {
+        bool reused = conn != nullptr;
+        if (!conn) {
+            std::string error;
+            conn = Connection::open(url, cancel, error);
+            if (!conn) {
+                response.cancelled = cancelled(cancel);
+                response.error = response.cancelled ? "cancelled" : error;
+                return response;
+            }
+            ++stats_.connects;
+        } else {
+            ++stats_.reuses;
+        }
+        bool retry = false;
+        response = attempt(request, conn, on_body, cancel, retry);
+        if (!retry || !reused) break;
+        conn.reset();
+    }
+    if (conn) idle_[key] = std::move(conn);
+    return response;
+}
+
+// One request on conn. conn is reset unless it can be kept; retry is set
+// when it failed before the response began
+HttpClient::Response HttpClient::attempt(const Request& request, ConnectionPtr& conn, const BodyFn& on_body,
+                                         const volatile std::sig_atomic_t* cancel, bool& retry) {
+    Response response;
+    Url url;
+    parseUrl(request.url, url);
+
+    std::string head = request.method + " " + url.target + " HTTP/1.1\r\n";
+    head += "Host: " + url.host + "\r\n";
+    head += "Connection: keep-alive\r\n";
+    head += "Content-Length: " + std::to_string(request.body.size()) + "\r\n";
+    for (const auto& [name, value] : request.headers) head += name + ": " + value + "\r\n";
+    head += "\r\n";
+
+    auto fail = [&](const std::string& error) {
+        response.cancelled = cancelled(cancel);
+        response.error = response.cancelled ? "cancelled" : error;
+        conn.reset();
+        return response;
+    };
+
+    if (!conn->write(head, cancel) || !conn->write(request.body, cancel)) {
+        retry = !cancelled(cancel);
+        return fail("write failed");
+    }
+
+    // Response head
+    std::string buffer;
+    char chunk[16 * 1024];
+    size_t head_end;
+    while ((head_end = buffer.find("\r\n\r\n")) == std::string::npos) {
+        if (buffer.size() > kMaxHead) return fail("response head too large");
+        ssize_t n = conn->read(chunk, sizeof chunk, cancel);
+        if (n <= 0) {
+            retry = buffer.empty() && !cancelled(cancel);
+            return fail(n == 0 ? "connection closed" : "read failed");
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+    }
+
+    std::string_view lines(buffer.data(), head_end);
+    size_t eol = lines.find("\r\n");
+    std::string_view status_line = lines.substr(0, eol);
+    if (status_line.rfind("HTTP/1.", 0) != 0 || status_line.size() < 12) return fail("malformed response");
+    response.status = std::atoi(std::string(status_line.substr(9, 3)).c_str());
+    bool keep = status_line.substr(0, 8) == "HTTP/1.1";
+    bool chunked = false;
+    long long length = -1;
+    while (eol != std::string_view::npos) {
+        size_t next = lines.find("\r\n", eol + 2);
+        std::string_view line = lines.substr(eol + 2, next == std::string_view::npos ? std::string_view::npos : next - eol - 2);
+        eol = next;
+        size_t colon = line.find(':');
+        if (colon == std::string_view::npos) continue;
+        std::string_view name = line.substr(0, colon);
+        std::string_view value = line.substr(colon + 1);
+        while (!value.empty() && value.front() == ' ') value.remove_prefix(1);
+        if (equalsIgnoreCase(name, "content-length")) {
+            length = std::atoll(std::string(value).c_str());
+        } else if (equalsIgnoreCase(name, "transfer-encoding")) {
+            chunked = value.find("chunked") != std::string_view::npos;
+        } else if (equalsIgnoreCase(name, "connection") && equalsIgnoreCase(value, "close")) {
+            keep = false;
+        }
+    }
+    buffer.erase(0, head_end + 4);
+    if (response.status == 204 || response.status == 304) length = 0;
+    if (!chunked && length < 0) keep = false;  // Body ends when the server closes
+
+    // Make at least one more byte available in buffer; false at end/failure
+    bool eof = false;
+    auto more = [&]() {
+        ssize_t n = conn->read(chunk, sizeof chunk, cancel);
+        if (n <= 0) {
+            eof = n == 0;
+            return false;
+        }
+        buffer.append(chunk, static_cast<size_t>(n));
+        return true;
+    };
+    bool stopped = false;
+    auto deliver = [&](std::string_view data) {
+        if (!stopped && !data.empty() && !on_body(data)) stopped = true;
+        return !stopped;
+    };
+
+    if (chunked) {
+        for (;;) {
+            size_t line_end;
+            while ((line_end = buffer.find("\r\n")) == std::string::npos) {
+                if (!more()) return fail("response cut short");
+            }
+            unsigned long long size = std::strtoull(buffer.c_str(), nullptr, 16);
+            buffer.erase(0, line_end + 2);
+            if (size == 0) {
+                // Trailers, up to the blank line
+                while (buffer.find("\r\n") != 0) {
+                    size_t trailer_end = buffer.find("\r\n");
+                    if (trailer_end != std::string::npos) {
+                        buffer.erase(0, trailer_end + 2);
+                        continue;
+                    }
+                    if (!more()) return fail("response cut short");
+                }
+                buffer.erase(0, 2);
+                break;
+            }
+            while (buffer.size() < size + 2) {
+                if (buffer.size() > 0 && buffer.size() <= size) {
+                    // Pass on what arrived so far of a large chunk
+                    if (!deliver(buffer)) return fail("stopped");
+                    size -= buffer.size();
+                    buffer.clear();
+                }
+                if (!more()) return fail("response cut short");
+            }
+            if (!deliver(std::string_view(buffer).substr(0, size))) return fail("stopped");
+            buffer.erase(0, size + 2);
+        }
+    } else if (length >= 0) {
+        unsigned long long remaining = static_cast<unsigned long long>(length);
+        for (;;) {
+            size_t take = static_cast<size_t>(std::min<unsigned long long>(remaining, buffer.size()));
+            if (!deliver(std::string_view(buffer).substr(0, take))) return fail("stopped");
+            remaining -= take;
+            buffer.erase(0, take);
+            if (remaining == 0) break;
+            if (!more()) return fail("response cut short");
+        }
+    } else {
+        for (;;) {
+            if (!deliver(buffer)) return fail("stopped");
+            buffer.clear();
+            if (!more()) break;
+        }
+        if (!eof) return fail("read failed");
+    }
+
+    if (!keep || !buffer.empty()) conn.reset();
+    return response;
+}
+
+} // namespace helix
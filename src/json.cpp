@@ -0,0 +1,256 @@
+#include "json.h"
+#include <cstdio>
+#include <cstdlib>
+
+namespace helix {
+
+// ── Reader ───────────────────────────────────────────────────────────────────
+
+class JsonValue::Reader {
+public:
+    explicit Reader(std::string_view text) : text_(text) {}
+
+    bool document(JsonValue& out) {
+        if (!value(out, 0)) return false;
+        skipSpace();
+        return pos_ == text_.size();
+    }
+
+private:
+    // Deeper nesting is rejected rather than risking the stack
+    static constexpr int kMaxDepth = 256;
+
+    void skipSpace() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    bool literal(std::string_view word) {
+        if (text_.substr(pos_, word.size()) != word) return false;
+        pos_ += word.size();
+        return true;
+    }
+
+    bool value(JsonValue& out, int depth) {
+        if (depth > kMaxDepth) return false;
+        skipSpace();
+        if (pos_ >= text_.size()) return false;
+        char c = text_[pos_];
+        if (c == '{') return object(out, depth);
+        if (c == '[') return array(out, depth);
+        if (c == '"') {
+            out.type_ = Type::String;
+            return string(out.string_);
+        }
+        if (c == 't' || c == 'f') {
+            out.type_ = Type::Bool;
+            out.bool_ = c == 't';
+            return literal(c == 't' ? "true" : "false");
+        }
+        if (c == 'n') return literal("null");
+        return number(out);
+    }
+
+    bool object(JsonValue& out, int depth) {
+        out.type_ = Type::Object;
+        ++pos_;
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == '}') {
+            ++pos_;
+            return true;
+        }
+        for (;;) {
+            skipSpace();
+            if (pos_ >= text_.size() || text_[pos_] != '"') return false;
+            out.members_.emplace_back();
+            auto& member = out.members_.back();
+            if (!string(member.first)) return false;
+            skipSpace();
+            if (pos_ >= text_.size() || text_[pos_++] != ':') return false;
+            if (!value(member.second, depth + 1)) return false;
+            skipSpace();
+            if (pos_ >= text_.size()) return false;
+            char c = text_[pos_++];
+            if (c == '}') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool array(JsonValue& out, int depth) {
+        out.type_ = Type::Array;
+        ++pos_;
+        skipSpace();
+        if (pos_ < text_.size() && text_[pos_] == ']') {
+            ++pos_;
+            return true;
+        }
+        for (;;) {
+            out.elements_.emplace_back();
+            if (!value(out.elements_.back(), depth + 1)) return false;
+            skipSpace();
+            if (pos_ >= text_.size()) return false;
+            char c = text_[pos_++];
+            if (c == ']') return true;
+            if (c != ',') return false;
+        }
+    }
+
+    bool hex4(unsigned& out) {
+        if (pos_ + 4 > text_.size()) return false;
+        out = 0;
+        for (int i = 0; i < 4; ++i) {
+            char c = text_[pos_++];
+            out <<= 4;
+            if (c >= '0' && c <= '9') out |= static_cast<unsigned>(c - '0');
+            else if (c >= 'a' && c <= 'f') out |= static_cast<unsigned>(c - 'a' + 10);
+            else if (c >= 'A' && c <= 'F') out |= static_cast<unsigned>(c - 'A' + 10);
+            else return false;
+        }
+        return true;
+    }
+
+    static void appendUtf8(std::string& out, unsigned cp) {
+        if (cp < 0x80) {
+            out += static_cast<char>(cp);
+        } else if (cp < 0x800) {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else if (cp < 0x10000) {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+        }
+    }
+
+    bool string(std::string& out) {
+        ++pos_;  // Opening quote
+        for (;;) {
+            // Copy the run up to the next quote or escape in one go
+            size_t run = text_.find_first_of("\"\\", pos_);
+            if (run == std::string_view::npos) return false;
+            out.append(text_.data() + pos_, run - pos_);
+            pos_ = run + 1;
+            if (text_[run] == '"') return true;
+            if (pos_ >= text_.size()) return false;
+            char c = text_[pos_++];
+            switch (c) {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    unsigned cp;
+                    if (!hex4(cp)) return false;
+                    if (cp >= 0xD800 && cp < 0xDC00 && text_.substr(pos_, 2) == "\\u") {
+                        size_t save = pos_;
+                        pos_ += 2;
+                        unsigned low;
+                        if (hex4(low) && low >= 0xDC00 && low < 0xE000) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                        } else {
+                            pos_ = save;
+                        }
+                    }
+                    appendUtf8(out, cp);
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+    }
+
+    bool number(JsonValue& out) {
+        size_t start = pos_;
+        if (pos_ < text_.size() && text_[pos_] == '-') ++pos_;
+        while (pos_ < text_.size() && std::string_view("0123456789.eE+-").find(text_[pos_]) != std::string_view::npos) {
+            ++pos_;
+        }
+        if (pos_ == start) return false;
+        std::string digits(text_.substr(start, pos_ - start));
+        char* end = nullptr;
+        out.type_ = Type::Number;
+        out.number_ = std::strtod(digits.c_str(), &end);
+        return end == digits.c_str() + digits.size();
+    }
+
+    std::string_view text_;
+    size_t pos_ = 0;
+};
+
+// ── JsonValue ────────────────────────────────────────────────────────────────
+
+bool JsonValue::parse(std::string_view text, JsonValue& out) {
+    out = JsonValue();
+    if (Reader(text).document(out)) return true;
+    out = JsonValue();
+    return false;
+}
+
+std::string JsonValue::escape(std::string_view text) {
+    std::string out;
+    out.reserve(text.size() + 8);
+    for (char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof buf, "\\u%04x", static_cast<unsigned>(c));
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+const JsonValue* JsonValue::get(std::string_view key) const {
+    if (type_ != Type::Object) return nullptr;
+    for (const auto& member : members_) {
+        if (member.first == key) return &member.second;
+    }
+    return nullptr;
+}
+
+const JsonValue* JsonValue::at(size_t index) const {
+    if (type_ != Type::Array || index >= elements_.size()) return nullptr;
+    return &elements_[index];
+}
+
+const std::string& JsonValue::find(std::initializer_list<std::string_view> path) const {
+    static const std::string kEmpty;
+    const JsonValue* node = this;
+    for (std::string_view step : path) {
+        if (node->isArray()) {
+            size_t index = 0;
+            for (char c : step) {
+                if (c < '0' || c > '9') return kEmpty;
+                index = index * 10 + static_cast<size_t>(c - '0');
+            }
+            node = node->at(index);
+        } else {
+            node = node->get(step);
+        }
+        if (!node) return kEmpty;
+    }
+    return node->string();
+}
+
+} // namespace helix
@@ -0,0 +1,170 @@
+#include "libhelix.h"
+#include "shell.h"
+#include "executor/fd_utils.h"
+#include "shell/variable_store.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helix {
+
+class Interpreter::Script {
+public:
+    explicit Script(std::unique_ptr<ListNode> program) : program(std::move(program)) {}
+    std::unique_ptr<ListNode> program;
+};
+
+namespace {
+
+StartupOptions embedded(const Interpreter::Options& options) {
+    StartupOptions startup;
+    startup.interactive = false;
+    startup.load_rc = options.load_rc;
+    startup.signals = false;
+    startup.load_env = false;
+    return startup;
+}
+
+void flushStreams() {
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    std::fflush(stderr);
+}
+
+// Message for a source that did not parse, as runSource() prints it
+std::string parseError(const ScriptParser::Result& result) {
+    if (result.status == ScriptParser::Status::INCOMPLETE) return "syntax error: unexpected end of file";
+    return result.error;
+}
+
+} // namespace
+
+// ── Output capture ───────────────────────────────────────────────────────────
+
+struct Interpreter::Impl {
+    explicit Impl(const Options& options) : shell(embedded(options)) {}
+
+    ~Impl() {
+        for (int fd : buffers) {
+            if (fd != -1) close(fd);
+        }
+    }
+
+    // Run fn with descriptor 1 on a buffer read back into out, and 2 into
+    // err (the same buffer when out == err, so the order is kept). The
+    // buffers are emptied, not closed, for the next run
+    template <typename Fn>
+    int captured(std::string* out, std::string* err, Fn&& fn) {
+        std::string* targets[2] = {out, err};
+        int saved[2] = {-1, -1};
+        bool redirected[2] = {false, false};
+        flushStreams();
+        for (int i = 0; i < 2; ++i) {
+            if (!targets[i]) continue;
+            int& buffer = buffers[i == 1 && err == out ? 0 : i];
+            if (buffer == -1 && (buffer = openAnonymousFile()) == -1) {
+                std::cerr << "helix: cannot capture output: " << std::strerror(errno) << "\n";
+                continue;
+            }
+            // Kept above 10, out of the way of the script's own redirections;
+            // -1 when the host has the descriptor closed
+            saved[i] = fcntl(i + 1, F_DUPFD_CLOEXEC, 10);
+            if (dup2(buffer, i + 1) != -1) redirected[i] = true;
+        }
+
+        int status = fn();
+
+        flushStreams();
+        for (int i = 0; i < 2; ++i) {
+            if (!redirected[i]) continue;
+            if (saved[i] != -1) {
+                dup2(saved[i], i + 1);
+                close(saved[i]);
+            } else {
+                close(i + 1);
+            }
+        }
+        for (int i = 0; i < 2; ++i) {
+            if (!redirected[i] || (i == 1 && err == out)) continue;
+            readBack(buffers[i], *targets[i]);
+        }
+        return status;
+    }
+
+    static void readBack(int buffer, std::string& into) {
+        into.clear();
+        struct stat st;
+        if (fstat(buffer, &st) == 0 && st.st_size > 0) {
+            into.resize(static_cast<size_t>(st.st_size));
+            size_t got = 0;
+            while (got < into.size()) {
+                ssize_t n = pread(buffer, into.data() + got, into.size() - got, static_cast<off_t>(got));
+                if (n < 0 && errno == EINTR) continue;
+                if (n <= 0) break;
+                got += static_cast<size_t>(n);
+            }
+            into.resize(got);
+        }
+        if (ftruncate(buffer, 0) == 0) lseek(buffer, 0, SEEK_SET);
+    }
+
+    Shell shell;
+    int buffers[2] = {-1, -1};
+};
+
+// ── Interpreter ──────────────────────────────────────────────────────────────
+
+Interpreter::Interpreter() : Interpreter(Options{}) {}
+
+Interpreter::Interpreter(const Options& options) : impl_(std::make_unique<Impl>(options)) {}
+
+Interpreter::~Interpreter() = default;
+
+int Interpreter::run(std::string_view source, std::string* out, std::string* err) {
+    return impl_->captured(out, err, [&] {
+        ScriptParser::Result result = impl_->shell.compile(source);
+        if (result.status != ScriptParser::Status::OK) {
+            std::cerr << "helix: " << parseError(result) << "\n";
+            return 2;
+        }
+        return impl_->shell.runProgram(*result.program);
+    });
+}
+
+Interpreter::ScriptPtr Interpreter::compile(std::string_view source, std::string* error) {
+    ScriptParser::Result result = impl_->shell.compile(source);
+    if (result.status != ScriptParser::Status::OK) {
+        if (error) *error = parseError(result);
+        return nullptr;
+    }
+    return std::make_shared<const Script>(std::move(result.program));
+}
+
+int Interpreter::run(const Script& script, std::string* out, std::string* err) {
+    return impl_->captured(out, err, [&] { return impl_->shell.runProgram(*script.program); });
+}
+
+std::optional<std::string> Interpreter::get(std::string_view name) const {
+    const std::string* value = VariableStore::global().find(name);
+    if (!value) return std::nullopt;
+    return *value;
+}
+
+void Interpreter::set(const std::string& name, std::string value, bool exported) {
+    if (exported) {
+        VariableStore::global().set(name, std::move(value), true);
+    } else {
+        VariableStore::global().set(name, std::move(value));
+    }
+}
+
+bool Interpreter::unset(std::string_view name) {
+    return VariableStore::global().unset(name);
+}
+
+} // namespace helix
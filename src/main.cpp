@@ -1,18 +1,33 @@
 #include "shell.h"
+#include "shell/shell_server.h"
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <unistd.h>
 
 static void usage() {
     std::cerr <<
         "Usage: helix [options] [script [args...]]\n"
-        "  -c <cmd>       execute CMD and exit\n"
-        "  -s             read commands from stdin (default when no args)\n"
-        "  --version      print version and exit\n"
-        "  --help         print this message\n";
+        "  -c <cmd>          execute CMD and exit\n"
+        "  -s                read commands from stdin (default when stdin is not a terminal)\n"
+        "  -i                interactive shell, even when stdin is not a terminal\n"
+        "  --rc              also read ~/.helixrc for -c, -s and scripts\n"
+        "  --server <socket> keep a warm shell and run each request at SOCKET in a fork\n"
+        "                    of it; -c goes there when $HELIX_SERVER names the socket\n"
+        "  --startup-trace   print how long each startup phase took\n"
+        "  --version         print version and exit\n"
+        "  --help            print this message\n";
 }
 
 int main(int argc, char* argv[]) {
     try {
+        // -c, -s and scripts skip readline, history and the rc file
+        helix::StartupOptions batch;
+        batch.interactive = false;
+        batch.load_rc = false;
+        helix::StartupOptions interactive;
+        bool force_interactive = false;
+
         for (int i = 1; i < argc; ++i) {
             if (std::strcmp(argv[i], "--version") == 0) {
                 std::cout << "helix 1.0.0\n";
@@ -22,25 +37,59 @@ int main(int argc, char* argv[]) {
                 usage();
                 return 0;
             }
+            if (std::strcmp(argv[i], "--startup-trace") == 0) {
+                batch.trace = interactive.trace = true;
+                continue;
+            }
+            if (std::strcmp(argv[i], "--rc") == 0) {
+                batch.load_rc = true;
+                continue;
+            }
+            if (std::strcmp(argv[i], "-i") == 0) {
+                force_interactive = true;
+                continue;
+            }
+            if (std::strcmp(argv[i], "--server") == 0) {
+                if (i + 1 >= argc) {
+                    std::cerr << "helix: --server requires a socket path\n";
+                    return 2;
+                }
+                // The rc file is the point of keeping the shell warm
+                batch.load_rc = true;
+                helix::Shell shell(batch);
+                return shell.serve(argv[i + 1]);
+            }
             if (std::strcmp(argv[i], "-c") == 0) {
                 if (i + 1 >= argc) {
                     std::cerr << "helix: -c requires an argument\n";
                     return 2;
                 }
-                helix::Shell shell;
+                // A server is reached without building a Shell at all; when
+                // none answers the command runs here as usual
+                const char* server = std::getenv("HELIX_SERVER");
+                if (server && *server && !batch.trace) {
+                    if (auto status = helix::ShellServer::runClient(server, argv[i + 1])) return *status;
+                }
+                helix::Shell shell(batch);
                 return shell.runCommand(argv[i + 1]);
             }
             if (std::strcmp(argv[i], "-s") == 0) {
-                helix::Shell shell;
+                helix::Shell shell(batch);
                 return shell.runStdin();
             }
             // Positional: treat as script file
-            helix::Shell shell;
+            helix::Shell shell(batch);
             return shell.runScript(argv[i], argc - i - 1, argv + i + 1);
         }
 
+        // Commands piped in (`echo ls | helix`) are read like -s
+        if (!force_interactive && !isatty(STDIN_FILENO)) {
+            helix::Shell shell(batch);
+            return shell.runStdin();
+        }
+
         // Interactive REPL
-        helix::Shell shell;
+        helix::Shell shell(interactive);
         return shell.run();
     } catch (const std::exception& e) {
         std::cerr << "Fatal error: " << e.what() << '\n';
@@ -13,8 +13,7 @@ ParsedCommand Parser::parse(const std::vector<Token>& tokens) {
             ++pos; continue;
         }
 
-        Command cmd = parseSingleCommand(pos, tokens);
-        result.pipeline.commands.push_back(cmd);
+        result.pipeline.commands.push_back(parseSingleCommand(pos, tokens));
 
         if (pos < tokens.size() && tokens[pos].type == TokenType::PIPE) {
             ++pos;
@@ -33,8 +32,13 @@ ParsedCommand Parser::parse(const std::vector<Token>& tokens) {
 
 Command Parser::parseSingleCommand(size_t& pos, const std::vector<Token>& tokens) {
     Command cmd;
-    parseArguments(pos, tokens, cmd);
-    parseRedirections(pos, tokens, cmd);
+    // Words and redirections may interleave: "echo a > out b"
+    while (pos < tokens.size()) {
+        size_t start = pos;
+        parseArguments(pos, tokens, cmd);
+        parseRedirections(pos, tokens, cmd);
+        if (pos == start) break;
+    }
     return cmd;
 }
 
@@ -56,6 +60,7 @@ void Parser::parseArguments(size_t& pos, const std::vector<Token>& tokens, Comma
 }
 
 void Parser::parseRedirections(size_t& pos, const std::vector<Token>& tokens, Command& cmd) {
+    using Kind = Redirection::Kind;
     while (pos < tokens.size()) {
         TokenType type = tokens[pos].type;
 
@@ -63,46 +68,63 @@ void Parser::parseRedirections(size_t& pos, const std::vector<Token>& tokens, Co
             ++pos;
             return pos < tokens.size() && tokens[pos].type == TokenType::WORD;
         };
+        // Operator followed by a file name
+        auto toFile = [&](Kind kind, const char* op) -> bool {
+            if (!needWord()) {
+                std::cerr << "Parse error: expected filename after " << op << "\n";
+                return false;
+            }
+            cmd.redirect(kind, tokens[pos].value);
+            ++pos;
+            return true;
+        };
 
         if (type == TokenType::REDIRECT_IN) {
-            if (needWord()) { cmd.input_file = tokens[pos].value; ++pos; }
-            else { std::cerr << "Parse error: expected filename after <\n"; break; }
+            if (!toFile(Kind::INPUT, "<")) break;
 
         } else if (type == TokenType::REDIRECT_OUT) {
-            if (needWord()) { cmd.output_file = tokens[pos].value; cmd.append_mode = false; ++pos; }
-            else { std::cerr << "Parse error: expected filename after >\n"; break; }
+            if (!toFile(Kind::OUTPUT, ">")) break;
 
         } else if (type == TokenType::REDIRECT_OUT_APPEND) {
-            if (needWord()) { cmd.output_file = tokens[pos].value; cmd.append_mode = true; ++pos; }
-            else { std::cerr << "Parse error: expected filename after >>\n"; break; }
+            if (!toFile(Kind::APPEND, ">>")) break;
 
         } else if (type == TokenType::REDIRECT_ERR) {
-            if (needWord()) { cmd.error_file = tokens[pos].value; cmd.error_append_mode = false; ++pos; }
-            else { std::cerr << "Parse error: expected filename after 2>\n"; break; }
+            if (!toFile(Kind::ERROR, "2>")) break;
 
         } else if (type == TokenType::REDIRECT_ERR_APPEND) {
-            if (needWord()) { cmd.error_file = tokens[pos].value; cmd.error_append_mode = true; ++pos; }
-            else { std::cerr << "Parse error: expected filename after 2>>\n"; break; }
+            if (!toFile(Kind::ERROR_APPEND, "2>>")) break;
 
         } else if (type == TokenType::REDIRECT_ERR_TO_OUT) {
-            cmd.stderr_to_stdout = true;
+            cmd.redirect(Kind::ERR_TO_OUT);
             ++pos;
 
+        } else if (type == TokenType::REDIRECT_OUT_TO_ERR) {
+            cmd.redirect(Kind::OUT_TO_ERR);
+            ++pos;
+
+        } else if (type == TokenType::REDIRECT_OUT_DUP) {
+            if (!toFile(Kind::DUP_OUT, ">&")) break;
+
+        } else if (type == TokenType::REDIRECT_IN_DUP) {
+            if (!toFile(Kind::DUP_IN, "<&")) break;
+
         } else if (type == TokenType::REDIRECT_BOTH) {
-            if (needWord()) { cmd.output_file = tokens[pos].value; cmd.both_to_file = true; cmd.both_append = false; ++pos; }
-            else { std::cerr << "Parse error: expected filename after &>\n"; break; }
+            if (!toFile(Kind::BOTH, "&>")) break;
 
         } else if (type == TokenType::REDIRECT_BOTH_APPEND) {
-            if (needWord()) { cmd.output_file = tokens[pos].value; cmd.both_to_file = true; cmd.both_append = true; ++pos; }
-            else { std::cerr << "Parse error: expected filename after &>>\n"; break; }
+            if (!toFile(Kind::BOTH_APPEND, "&>>")) break;
 
         } else if (type == TokenType::HEREDOC || type == TokenType::HEREDOC_STRIP) {
-            bool strip = (type == TokenType::HEREDOC_STRIP);
+            Kind kind = type == TokenType::HEREDOC_STRIP ? Kind::HEREDOC_STRIP : Kind::HEREDOC;
             ++pos;
             if (pos < tokens.size() && tokens[pos].type == TokenType::WORD) {
-                cmd.heredoc_delim = tokens[pos].value;
-                cmd.heredoc_strip = strip;
+                cmd.redirect(kind, tokens[pos].value);
                 ++pos;
+                // The script tokenizer attaches the collected body
+                if (pos < tokens.size() && tokens[pos].type == TokenType::HEREDOC_BODY) {
+                    cmd.redirections.back().body = tokens[pos].value;
+                    ++pos;
+                }
             } else {
                 std::cerr << "Parse error: expected delimiter after <<\n"; break;
             }
@@ -110,7 +132,7 @@ void Parser::parseRedirections(size_t& pos, const std::vector<Token>& tokens, Co
         } else if (type == TokenType::HERESTRING) {
             ++pos;
             if (pos < tokens.size() && tokens[pos].type == TokenType::WORD) {
-                cmd.herestring = tokens[pos].value;
+                cmd.redirect(Kind::HERESTRING, tokens[pos].value);
                 ++pos;
             } else {
                 std::cerr << "Parse error: expected word after <<<\n"; break;
@@ -3,9 +3,6 @@
 #include <sstream>
 #include <sys/stat.h>
 #include <unistd.h>
-#include <array>
-#include <memory>
-#include <cstdio>
 
 namespace helix {
 
@@ -32,6 +29,10 @@ void Prompt::setLastCommandDuration(std::chrono::milliseconds ms) {
     last_duration_ = ms;
 }
 
+void Prompt::setGitStatusBudget(std::chrono::milliseconds budget) {
+    git_budget_ = budget;
+}
+
 std::string Prompt::generate() const {
     std::string right;
     std::string dur = getDurationDisplay();
@@ -92,60 +93,82 @@ std::string Prompt::getPromptCharacter() const {
     return Colors::BRIGHT_GREEN + "❯" + Colors::RESET + " ";
 }
 
-std::string Prompt::getGitBranch() const {
-    std::string dir = current_directory_;
+static struct timespec headMtime(const std::string& head_path) {
     struct stat st;
+    if (stat(head_path.c_str(), &st) != 0) return {};
+#if defined(__APPLE__)
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
 
+static std::string readBranch(const std::string& head_path) {
+    std::ifstream file(head_path);
+    std::string line;
+    if (file && std::getline(file, line)) {
+        if (line.find("ref: refs/heads/") == 0) return line.substr(16);
+        if (line.length() >= 7) return line.substr(0, 7);
+    }
+    return "";
+}
+
+const Prompt::RepoLocation& Prompt::locateRepo() const {
+    auto now = std::chrono::steady_clock::now();
+    RepoLocation& memo = repo_by_dir_[current_directory_];
+    struct stat st;
+
+    if (!memo.root.empty()) {
+        // One stat revalidates the memo; HEAD is only re-read when it moved
+        std::string head = memo.root + "/.git/HEAD";
+        struct timespec mtime = headMtime(head);
+        if (mtime.tv_sec != 0 || mtime.tv_nsec != 0) {
+            if (mtime.tv_sec != memo.head_mtime.tv_sec || mtime.tv_nsec != memo.head_mtime.tv_nsec) {
+                memo.head_mtime = mtime;
+                memo.branch = readBranch(head);
+            }
+            return memo;
+        }
+        memo = RepoLocation{};  // Repository went away
+    } else if (memo.checked_at != std::chrono::steady_clock::time_point{} &&
+               now - memo.checked_at < std::chrono::seconds(5)) {
+        return memo;  // Recently found not to be inside a repository
+    }
+
+    memo.checked_at = now;
+    std::string dir = current_directory_;
     while (!dir.empty()) {
         std::string git_dir = dir + "/.git";
         if (stat(git_dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
-            std::ifstream file(git_dir + "/HEAD");
-            std::string line;
-            if (file && std::getline(file, line)) {
-                if (line.find("ref: refs/heads/") == 0) return line.substr(16);
-                if (line.length() >= 7) return line.substr(0, 7);
-            }
-            return "";
+            memo.root = dir;
+            memo.head_mtime = headMtime(git_dir + "/HEAD");
+            memo.branch = readBranch(git_dir + "/HEAD");
+            return memo;
         }
         size_t slash = dir.rfind('/');
         if (slash == std::string::npos || slash == 0) break;
         dir = dir.substr(0, slash);
     }
+    return memo;
+}
 
-    return "";
+std::string Prompt::getGitBranch() const {
+    return locateRepo().branch;
 }
 
-// Parse `git status --porcelain` output to show dirty/staged/untracked icons
+// Dirty/staged/untracked icons from the background `git status` worker;
+// left out when no value is available within the budget
 std::string Prompt::getGitStatus() const {
-    // Use popen so we don't need to fork/exec ourselves
-    std::array<char, 512> buf;
-    std::string output;
-    std::unique_ptr<FILE, decltype(&pclose)> pipe(
-        popen("git -C . status --porcelain 2>/dev/null", "r"), pclose);
-    if (!pipe) return "";
-
-    while (fgets(buf.data(), buf.size(), pipe.get())) {
-        output += buf.data();
-    }
+    const RepoLocation& repo = locateRepo();
+    if (repo.root.empty()) return "";
 
-    if (output.empty()) return "";
-
-    bool staged = false, dirty = false, untracked = false;
-    std::istringstream ss(output);
-    std::string line;
-    while (std::getline(ss, line)) {
-        if (line.size() < 2) continue;
-        char index = line[0];
-        char work  = line[1];
-        if (index == '?' && work == '?') { untracked = true; continue; }
-        if (index != ' ' && index != '?') staged = true;
-        if (work  != ' ' && work  != '?') dirty  = true;
-    }
+    auto markers = git_status_.get(repo.root, git_budget_);
+    if (!markers) return "";
 
     std::string result;
-    if (staged)    result += " " + Colors::GREEN    + "●" + Colors::RESET;
-    if (dirty)     result += " " + Colors::ORANGE   + "●" + Colors::RESET;
-    if (untracked) result += " " + Colors::BRIGHT_BLACK + "●" + Colors::RESET;
+    if (markers->staged)    result += " " + Colors::GREEN    + "●" + Colors::RESET;
+    if (markers->dirty)     result += " " + Colors::ORANGE   + "●" + Colors::RESET;
+    if (markers->untracked) result += " " + Colors::BRIGHT_BLACK + "●" + Colors::RESET;
     return result;
 }
 
@@ -1,9 +1,16 @@
 #include "readline_support.h"
+#include "event_loop.h"
+#include "executor/path_cache.h"
+#include "shell/variable_store.h"
+#include "shell/shell_state.h"
 #include <readline/readline.h>
 #include <readline/history.h>
+#include <csignal>
 #include <cstring>
 #include <algorithm>
+#include <iostream>
 #include <dirent.h>
+#include <dlfcn.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -12,58 +19,299 @@ namespace helix {
 // Static member initialization
 std::vector<std::string> ReadlineSupport::available_commands;
 int ReadlineSupport::completion_index = 0;
+const ShellState* ReadlineSupport::shell_state = nullptr;
 
 // Forward declarations for readline callbacks
 static char** completion_function(const char* text, int start, int end);
 static char* command_generator(const char* text, int state);
 static char* path_generator(const char* text, int state);
 
+// ── Library loading ──────────────────────────────────────────────────────────
+// libreadline (and libtinfo behind it) is opened on first interactive use
+// rather than linked: mapping and relocating them is most of the startup
+// time of `helix -c`, `-s` and scripts, which never edit a line
+
+namespace {
+
+struct ReadlineApi {
+    char* (*readline)(const char*) = nullptr;
+    void (*add_history)(const char*) = nullptr;
+    void (*clear_history)() = nullptr;
+    void (*stifle_history)(int) = nullptr;
+    int (*bind_key)(int, rl_command_func_t*) = nullptr;
+    rl_command_func_t* complete = nullptr;
+    char** (*completion_matches)(const char*, rl_compentry_func_t*) = nullptr;
+    rl_completion_func_t** attempted_completion_function = nullptr;
+    int* completion_append_character = nullptr;
+    int* filename_completion_desired = nullptr;
+
+    // Callback interface: the REPL's event loop feeds keystrokes
+    void (*callback_handler_install)(const char*, rl_vcpfunc_t*) = nullptr;
+    void (*callback_read_char)() = nullptr;
+    void (*callback_handler_remove)() = nullptr;
+    int (*on_new_line)() = nullptr;
+    void (*redisplay)() = nullptr;
+    void (*replace_line)(const char*, int) = nullptr;
+    int* point = nullptr;
+    // Optional (readline 7+ / 4+): used when present
+    void (*callback_sigcleanup)() = nullptr;
+    void (*resize_terminal)() = nullptr;
+};
+
+ReadlineApi g_api;
+bool g_loaded = false;
+
+template <typename T>
+bool resolve(void* lib, const char* name, T& out) {
+    out = reinterpret_cast<T>(dlsym(lib, name));
+    return out != nullptr;
+}
+
+bool loadReadline() {
+    static const char* const kCandidates[] = {
+#ifdef HELIX_READLINE_LIBRARY
+        HELIX_READLINE_LIBRARY,
+#endif
+        "libreadline.so.8", "libreadline.so.7", "libreadline.so",
+        "libreadline.8.dylib", "libreadline.dylib",
+    };
+    void* lib = nullptr;
+    for (const char* name : kCandidates) {
+        if ((lib = dlopen(name, RTLD_NOW | RTLD_LOCAL))) break;
+    }
+    if (!lib) return false;
+
+    ReadlineApi api;
+    bool ok = resolve(lib, "readline", api.readline) &&
+              resolve(lib, "add_history", api.add_history) &&
+              resolve(lib, "clear_history", api.clear_history) &&
+              resolve(lib, "stifle_history", api.stifle_history) &&
+              resolve(lib, "rl_bind_key", api.bind_key) &&
+              resolve(lib, "rl_complete", api.complete) &&
+              resolve(lib, "rl_completion_matches", api.completion_matches) &&
+              resolve(lib, "rl_attempted_completion_function", api.attempted_completion_function) &&
+              resolve(lib, "rl_completion_append_character", api.completion_append_character) &&
+              resolve(lib, "rl_filename_completion_desired", api.filename_completion_desired) &&
+              resolve(lib, "rl_callback_handler_install", api.callback_handler_install) &&
+              resolve(lib, "rl_callback_read_char", api.callback_read_char) &&
+              resolve(lib, "rl_callback_handler_remove", api.callback_handler_remove) &&
+              resolve(lib, "rl_on_new_line", api.on_new_line) &&
+              resolve(lib, "rl_redisplay", api.redisplay) &&
+              resolve(lib, "rl_replace_line", api.replace_line) &&
+              resolve(lib, "rl_point", api.point);
+    resolve(lib, "rl_callback_sigcleanup", api.callback_sigcleanup);
+    resolve(lib, "rl_resize_terminal", api.resize_terminal);
+    if (!ok) {
+        dlclose(lib);
+        return false;
+    }
+    g_api = api;
+    return true;
+}
+
+} // namespace
+
+bool ReadlineSupport::available() {
+    return g_loaded;
+}
+
 void ReadlineSupport::initialize() {
+    if (g_loaded) return;
+    if (!loadReadline()) {
+        std::cerr << "helix: readline not available, line editing disabled\n";
+        return;
+    }
+    g_loaded = true;
+
     // Set up readline completion
-    rl_attempted_completion_function = completion_function;
-
-    // Set default commands (built-ins)
-    available_commands = {
-        "cd", "pwd", "echo", "export", "unset",
-        "alias", "unalias", "type", "which", "source",
-        "history", "jobs", "fg", "bg",
-        "read", "pushd", "popd", "dirs", "wait",
-        "true", "false", "exit", "help", "ai"
-    };
+    *g_api.attempted_completion_function = completion_function;
 
     // Enable tab completion
-    rl_bind_key('\t', rl_complete);
+    g_api.bind_key('\t', g_api.complete);
 
     // Configure readline behavior
-    rl_completion_append_character = ' ';
-    rl_filename_completion_desired = 1;
+    *g_api.completion_append_character = ' ';
+    *g_api.filename_completion_desired = 1;
 }
 
 void ReadlineSupport::cleanup() {
     // Clean up readline history
-    clear_history();
+    if (g_loaded) g_api.clear_history();
+    shell_state = nullptr;
 }
 
 std::string ReadlineSupport::readLineWithCompletion(const std::string& prompt) {
-    char* line = readline(prompt.c_str());
+    if (!g_loaded) {
+        std::cout << prompt << std::flush;
+        std::string line;
+        std::getline(std::cin, line);
+        return line;
+    }
+
+    char* line = g_api.readline(prompt.c_str());
 
     if (!line) {
         return "";  // EOF
     }
 
+    // The shell adds the line to history once HISTCONTROL has been applied
     std::string result(line);
+    free(line);
+    return result;
+}
 
-    // Add non-empty lines to history
-    if (!result.empty() && result != " ") {
-        add_history(line);
+// ── Event-driven input ───────────────────────────────────────────────────────
+// readLine() installs a callback handler and lets the event loop wait on
+// stdin together with everything else; readline only runs when a key
+// arrives. Between keys the loop may run other handlers, which print with
+// printAbove()
+
+namespace {
+
+struct CallbackRead {
+    bool active = false;       // A readLine() is waiting for its line
+    bool done = false;
+    std::optional<std::string> line;
+    std::string shown;         // Printed by the caller before the line
+};
+
+CallbackRead g_read;
+
+// Between keystrokes readline's own signal handlers are not installed, so
+// these come to us; outside the wait the previous handlers are back
+volatile std::sig_atomic_t g_interrupted = 0;
+volatile std::sig_atomic_t g_resized = 0;
+
+void onInputSignal(int sig) {
+    if (sig == SIGINT) g_interrupted = 1;
+    else g_resized = 1;
+    EventLoop::wake();
+}
+
+void onLine(char* line) {
+    if (line) {
+        g_read.line = std::string(line);
+        free(line);
+    } else {
+        g_read.line.reset();  // EOF
+    }
+    g_read.done = true;
+    // Removed here so readline does not print the prompt again for the
+    // next line before we are ready for it
+    g_api.callback_handler_remove();
+}
+
+void redrawLine() {
+    std::cout << g_read.shown << std::flush;
+    g_api.on_new_line();
+    g_api.redisplay();
+}
+
+} // namespace
+
+std::optional<std::string> ReadlineSupport::readLine(const std::string& prompt, EventLoop& loop,
+                                                     const std::string& shown) {
+    if (!g_loaded) {
+        std::string line = readLineWithCompletion(prompt);
+        if (line.empty() && std::cin.eof()) return std::nullopt;
+        return line;
     }
 
-    free(line);
-    return result;
+    g_read = CallbackRead{};
+    g_read.active = true;
+    g_read.shown = shown;
+    g_interrupted = 0;
+    g_resized = 0;
+
+    struct sigaction sa {}, saved_int {}, saved_winch {};
+    sa.sa_handler = onInputSignal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &saved_int);
+    sigaction(SIGWINCH, &sa, &saved_winch);
+
+    g_api.callback_handler_install(prompt.c_str(), onLine);
+    bool watching = loop.watch(STDIN_FILENO, [] { g_api.callback_read_char(); });
+    while (!g_read.done) {
+        if (!watching) {
+            g_api.callback_read_char();  // stdin can't be waited on: block in read()
+        } else if (!loop.runOnce(-1)) {
+            break;
+        }
+        if (g_resized) {
+            g_resized = 0;
+            if (g_api.resize_terminal) g_api.resize_terminal();
+        }
+        if (g_interrupted && !g_read.done) {
+            // Ctrl-C drops the line being typed and starts a fresh one
+            g_interrupted = 0;
+            if (g_api.callback_sigcleanup) g_api.callback_sigcleanup();
+            g_api.replace_line("", 0);
+            *g_api.point = 0;
+            std::cout << "\n";
+            redrawLine();
+        }
+    }
+    if (watching) loop.unwatch(STDIN_FILENO);
+    if (!g_read.done) g_api.callback_handler_remove();
+
+    sigaction(SIGINT, &saved_int, nullptr);
+    sigaction(SIGWINCH, &saved_winch, nullptr);
+    g_read.active = false;
+    return std::move(g_read.line);
+}
+
+void ReadlineSupport::printAbove(const std::string& text) {
+    if (!g_read.active || g_read.done) {
+        std::cout << text << std::flush;
+        return;
+    }
+    // Clear the line being edited, print, then draw prompt and line again
+    // below; the edit itself (text, cursor) is untouched
+    std::cout << "\r\033[K" << text;
+    redrawLine();
+}
+
+void ReadlineSupport::addHistory(const std::string& line) {
+    if (g_loaded) g_api.add_history(line.c_str());
+}
+
+void ReadlineSupport::stifleHistory(int max) {
+    if (g_loaded) g_api.stifle_history(max);
 }
 
 void ReadlineSupport::setCommands(const std::vector<std::string>& commands) {
     available_commands = commands;
+    std::sort(available_commands.begin(), available_commands.end());
+}
+
+void ReadlineSupport::setShellState(const ShellState* state) {
+    shell_state = state;
+}
+
+std::vector<std::string> ReadlineSupport::commandCompletions(const std::string& prefix) {
+    std::vector<std::string> out;
+    auto fromSorted = [&](const std::vector<std::string>& names) {
+        for (auto it = std::lower_bound(names.begin(), names.end(), prefix);
+             it != names.end() && it->starts_with(prefix); ++it) {
+            out.push_back(*it);
+        }
+    };
+    auto fromMap = [&](const auto& map) {
+        for (auto it = map.lower_bound(prefix); it != map.end() && it->first.starts_with(prefix); ++it) {
+            out.push_back(it->first);
+        }
+    };
+
+    fromSorted(available_commands);
+    if (shell_state) {
+        fromMap(shell_state->aliases);
+        fromMap(shell_state->functions);
+    }
+    fromSorted(PathCache::global().commandNames());
+
+    std::sort(out.begin(), out.end());
+    out.erase(std::unique(out.begin(), out.end()), out.end());
+    return out;
 }
 
 // Completion callback - called by readline
@@ -72,75 +320,27 @@ char** completion_function(const char* text, int start, int /* end */) {
 
     // If at the beginning of the line, complete commands
     if (start == 0) {
-        matches = rl_completion_matches(text, command_generator);
+        matches = g_api.completion_matches(text, command_generator);
     } else {
         // Otherwise, complete file paths
-        matches = rl_completion_matches(text, path_generator);
+        matches = g_api.completion_matches(text, path_generator);
     }
 
     return matches;
 }
 
 // Generate command completions
+// The matches are computed once per completion (state == 0) from the index
 char* command_generator(const char* text, int state) {
-    static size_t list_index, len;
+    static std::vector<std::string> matches;
 
     if (!state) {
-        list_index = 0;
-        len = strlen(text);
-    }
-
-    // Check built-in commands
-    while (list_index < ReadlineSupport::available_commands.size()) {
-        const std::string& cmd = ReadlineSupport::available_commands[list_index++];
-        if (cmd.substr(0, len) == text) {
-            return strdup(cmd.c_str());
-        }
-    }
-
-    // Check PATH commands
-    static std::vector<std::string> path_commands;
-    if (state == 0) {
-        path_commands.clear();
-
-        const char* path_env = getenv("PATH");
-        if (path_env) {
-            std::string path_str(path_env);
-            size_t start_pos = 0;
-
-            while (start_pos < path_str.length()) {
-                size_t colon = path_str.find(':', start_pos);
-                if (colon == std::string::npos) {
-                    colon = path_str.length();
-                }
-
-                std::string dir = path_str.substr(start_pos, colon - start_pos);
-                DIR* dirp = opendir(dir.c_str());
-
-                if (dirp) {
-                    struct dirent* entry;
-                    while ((entry = readdir(dirp)) != nullptr) {
-                        std::string name(entry->d_name);
-                        if (name[0] != '.' && name.substr(0, len) == text) {
-                            std::string full_path = dir + "/" + name;
-                            struct stat st;
-                            if (stat(full_path.c_str(), &st) == 0 && (st.st_mode & S_IXUSR)) {
-                                path_commands.push_back(name);
-                            }
-                        }
-                    }
-                    closedir(dirp);
-                }
-
-                start_pos = colon + 1;
-            }
-        }
-
+        matches = ReadlineSupport::commandCompletions(text);
         ReadlineSupport::completion_index = 0;
     }
 
-    if (ReadlineSupport::completion_index < static_cast<int>(path_commands.size())) {
-        return strdup(path_commands[ReadlineSupport::completion_index++].c_str());
+    if (ReadlineSupport::completion_index < static_cast<int>(matches.size())) {
+        return strdup(matches[ReadlineSupport::completion_index++].c_str());
     }
 
     return nullptr;
@@ -171,9 +371,9 @@ char* path_generator(const char* text, int state) {
 
         // Handle ~ expansion
         if (!dir_path.empty() && dir_path[0] == '~') {
-            const char* home = getenv("HOME");
+            const std::string* home = VariableStore::global().find("HOME");
             if (home) {
-                dir_path = std::string(home) + dir_path.substr(1);
+                dir_path = *home + dir_path.substr(1);
             }
         }
 
@@ -0,0 +1,827 @@
+#include "script_parser.h"
+#include "trace.h"
+#include "brace_sequence.h"
+#include <algorithm>
+#include <cctype>
+#include <set>
+
+namespace helix {
+
+// ── Token classification ─────────────────────────────────────────────────────
+
+static bool isRedirectToken(TokenType type) {
+    switch (type) {
+        case TokenType::REDIRECT_IN:
+        case TokenType::REDIRECT_OUT:
+        case TokenType::REDIRECT_OUT_APPEND:
+        case TokenType::REDIRECT_ERR:
+        case TokenType::REDIRECT_ERR_APPEND:
+        case TokenType::REDIRECT_ERR_TO_OUT:
+        case TokenType::REDIRECT_OUT_TO_ERR:
+        case TokenType::REDIRECT_BOTH:
+        case TokenType::REDIRECT_BOTH_APPEND:
+        case TokenType::REDIRECT_OUT_DUP:
+        case TokenType::REDIRECT_IN_DUP:
+        case TokenType::HEREDOC:
+        case TokenType::HEREDOC_STRIP:
+        case TokenType::HERESTRING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Redirections that take no target word (2>&1, >&2)
+static bool redirectTakesWord(TokenType type) {
+    return type != TokenType::REDIRECT_ERR_TO_OUT && type != TokenType::REDIRECT_OUT_TO_ERR;
+}
+
+static bool isControlToken(TokenType type) {
+    switch (type) {
+        case TokenType::PIPE:
+        case TokenType::AND_IF:
+        case TokenType::OR_IF:
+        case TokenType::SEMICOLON:
+        case TokenType::BACKGROUND:
+        case TokenType::NEWLINE:
+        case TokenType::DSEMI:
+        case TokenType::LPAREN:
+        case TokenType::RPAREN:
+        case TokenType::END_OF_INPUT:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isName(const std::string& s) {
+    if (s.empty() || (!std::isalpha(static_cast<unsigned char>(s[0])) && s[0] != '_')) return false;
+    for (char c : s) {
+        if (!std::isalnum(static_cast<unsigned char>(c)) && c != '_') return false;
+    }
+    return true;
+}
+
+// NAME=value, NAME+=value or NAME[subscript]=value with an unquoted NAME
+static bool isAssignmentWord(const std::string& word) {
+    size_t eq = word.find('=');
+    if (eq == std::string::npos || eq == 0) return false;
+    size_t end = word[eq - 1] == '+' ? eq - 1 : eq;
+    if (end > 0 && word[end - 1] == ']') {
+        size_t open = word.find('[');
+        if (open == std::string::npos || open >= end) return false;
+        end = open;
+    }
+    return isName(word.substr(0, end));
+}
+
+// NAME=(...) or NAME+=(...): a compound (array) assignment
+static bool isCompoundAssignment(const std::string& word) {
+    size_t eq = word.find('=');
+    if (eq == std::string::npos || eq + 1 >= word.size() || word[eq + 1] != '(' || word.back() != ')') return false;
+    size_t end = eq > 0 && word[eq - 1] == '+' ? eq - 1 : eq;
+    return isName(word.substr(0, end));
+}
+
+// Brace expansion is done per item inside a compound assignment,
+// a=(x{1..3}) being a=(x1 x2 x3), never on the word as a whole
+static std::string braceExpandItems(const std::string& word) {
+    if (word.find('{') == std::string::npos) return word;
+    size_t open = word.find('(');
+    std::string_view list = std::string_view(word).substr(open + 1, word.size() - open - 2);
+    std::string out = word.substr(0, open + 1);
+    for (std::string_view item : Tokenizer::splitList(list)) {
+        for (auto& e : ScriptParser::braceExpand(std::string(item))) {
+            if (out.size() > open + 1) out += ' ';
+            out += e;
+        }
+    }
+    out += ')';
+    return out;
+}
+
+// A word made of literal text around one sequence, whose terms then need
+// no further expansion: a for loop can generate them as it goes
+static bool lazyRange(const std::string& word, ForNode::Range& range) {
+    constexpr std::string_view kSpecial = "$`'\"\\{}*?[~";
+    size_t open = word.find('{');
+    size_t close = open == std::string::npos ? open : word.find('}', open);
+    if (close == std::string::npos) return false;
+    std::string_view prefix = std::string_view(word).substr(0, open);
+    std::string_view inner = std::string_view(word).substr(open + 1, close - open - 1);
+    std::string_view suffix = std::string_view(word).substr(close + 1);
+    if (prefix.find_first_of(kSpecial) != std::string_view::npos ||
+        suffix.find_first_of(kSpecial) != std::string_view::npos ||
+        !BraceSequence::parse(inner, range.sequence)) {
+        return false;
+    }
+    range.prefix = prefix;
+    range.suffix = suffix;
+    return true;
+}
+
+// Function names: anything a plain unquoted word can spell except expansions
+static bool isFunctionName(const std::string& s) {
+    return !s.empty() && s.find_first_of("'\"\\$`=") == std::string::npos;
+}
+
+// Variable names: a letter or _, then letters, digits and _
+static bool isVariableName(const std::string& s) {
+    if (s.empty() || std::isdigit(static_cast<unsigned char>(s[0]))) return false;
+    return std::all_of(s.begin(), s.end(), [](char c) {
+        return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+    });
+}
+
+static bool isReservedWord(const std::string& s) {
+    static const std::set<std::string> reserved = {
+        "then", "elif", "else", "fi", "do", "done", "esac", "}", "in"
+    };
+    return reserved.count(s) > 0;
+}
+
+static std::string describeToken(const Token& token) {
+    if (token.type == TokenType::NEWLINE) return "newline";
+    if (token.type == TokenType::END_OF_INPUT) return "end of file";
+    return token.value;
+}
+
+// ── Entry point ──────────────────────────────────────────────────────────────
+
+ScriptParser::Result ScriptParser::parse(std::string_view source,
+                                         const std::map<std::string, std::string>* aliases) {
+    Tracer::Span trace_parse("parse", source.substr(0, source.find('\n')));
+    source_ = source;
+    {
+        Tracer::Span trace_tokenize("tokenize");
+        tokenizer_.tokenizeScript(source_, tokens_);
+    }
+    pos_ = 0;
+    last_end_ = 0;
+    brace_depth_ = 0;
+    paren_depth_ = 0;
+    aliases_ = aliases;
+    used_aliases_ = false;
+    failed_ = false;
+    incomplete_ = false;
+    error_.clear();
+
+    Result result;
+    if (tokenizer_.incomplete()) {
+        result.status = Status::INCOMPLETE;
+        return result;
+    }
+
+    auto program = parseList();
+    if (!failed_ && peek().type != TokenType::END_OF_INPUT) {
+        fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+    }
+
+    if (failed_) {
+        result.status = incomplete_ ? Status::INCOMPLETE : Status::ERROR;
+        result.error = error_;
+        return result;
+    }
+    result.program = std::move(program);
+    result.used_aliases = used_aliases_;
+    return result;
+}
+
+// ── Token helpers ────────────────────────────────────────────────────────────
+
+const Token& ScriptParser::peek(size_t ahead) const {
+    size_t i = pos_ + ahead;
+    return i < tokens_.size() ? tokens_[i] : tokens_.back();
+}
+
+void ScriptParser::advance() {
+    if (pos_ >= tokens_.size()) return;
+    const Token& t = tokens_[pos_];
+    if (t.type == TokenType::END_OF_INPUT) return;
+    if (t.type != TokenType::HEREDOC_BODY && t.type != TokenType::NEWLINE) {
+        last_end_ = t.offset + t.value.size();
+    }
+    ++pos_;
+}
+
+bool ScriptParser::atWord(const char* word) const {
+    return peek().type == TokenType::WORD && peek().value == word;
+}
+
+bool ScriptParser::atListTerminator() const {
+    const Token& t = peek();
+    switch (t.type) {
+        case TokenType::END_OF_INPUT:
+        case TokenType::RPAREN:
+        case TokenType::DSEMI:
+            return true;
+        case TokenType::WORD:
+            if (t.value == "}") return brace_depth_ > 0;
+            return t.value == "then" || t.value == "elif" || t.value == "else" ||
+                   t.value == "fi" || t.value == "do" || t.value == "done" ||
+                   t.value == "esac";
+        default:
+            return false;
+    }
+}
+
+bool ScriptParser::isCommandTerminator(size_t index) const {
+    const Token& t = tokens_[index];
+    if (isControlToken(t.type)) return true;
+    // "{ echo hi }" - accept a closing brace that ends the line even
+    // without the ';' POSIX requires
+    if (brace_depth_ > 0 && t.type == TokenType::WORD && t.value == "}" &&
+        index + 1 < tokens_.size() && isControlToken(tokens_[index + 1].type)) {
+        return true;
+    }
+    return false;
+}
+
+void ScriptParser::skipNewlines() {
+    while (peek().type == TokenType::NEWLINE) advance();
+}
+
+bool ScriptParser::expect(const char* word) {
+    if (atWord(word)) {
+        advance();
+        return true;
+    }
+    if (peek().type == TokenType::END_OF_INPUT) {
+        fail(std::string("syntax error: expected `") + word + "'");
+    } else {
+        fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+    }
+    return false;
+}
+
+void ScriptParser::fail(const std::string& message) {
+    if (failed_) return;
+    failed_ = true;
+    incomplete_ = peek().type == TokenType::END_OF_INPUT;
+    error_ = message;
+}
+
+void ScriptParser::expandAliasAt(size_t index) {
+    if (!aliases_ || aliases_->empty()) return;
+
+    std::set<std::string> seen;  // An alias is never expanded inside itself
+    while (index < tokens_.size() && tokens_[index].type == TokenType::WORD) {
+        const std::string word = tokens_[index].value;
+        if (word.find_first_of("'\"\\") != std::string::npos) return;
+        auto it = aliases_->find(word);
+        if (it == aliases_->end() || seen.count(word)) return;
+        seen.insert(word);
+        used_aliases_ = true;
+        Tracer::Span trace_alias("expandAliases", word);
+
+        Tokenizer alias_tokenizer;
+        std::vector<Token> replacement = alias_tokenizer.tokenizeScript(it->second);
+        replacement.pop_back();  // END_OF_INPUT
+        size_t offset = tokens_[index].offset;
+        for (auto& t : replacement) t.offset = offset;
+
+        tokens_.erase(tokens_.begin() + static_cast<long>(index));
+        tokens_.insert(tokens_.begin() + static_cast<long>(index), replacement.begin(), replacement.end());
+        if (replacement.empty()) return;
+    }
+}
+
+// ── Lists ────────────────────────────────────────────────────────────────────
+
+std::unique_ptr<ListNode> ScriptParser::parseList() {
+    auto list = std::make_unique<ListNode>();
+    while (true) {
+        while (peek().type == TokenType::NEWLINE || peek().type == TokenType::SEMICOLON) advance();
+        if (atListTerminator()) break;
+
+        auto node = parseAndOr();
+        if (!node) return nullptr;
+
+        ListNode::Item item{std::move(node), false};
+        TokenType sep = peek().type;
+        if (sep == TokenType::BACKGROUND) {
+            item.background = true;
+            advance();
+        } else if (sep == TokenType::SEMICOLON || sep == TokenType::NEWLINE) {
+            advance();
+        } else if (!atListTerminator()) {
+            fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+            return nullptr;
+        }
+        list->items.push_back(std::move(item));
+    }
+    return list;
+}
+
+AstNodePtr ScriptParser::parseAndOr() {
+    auto first = parsePipeline();
+    if (!first) return nullptr;
+    if (peek().type != TokenType::AND_IF && peek().type != TokenType::OR_IF) return first;
+
+    auto node = std::make_unique<AndOrNode>();
+    node->first = std::move(first);
+    while (peek().type == TokenType::AND_IF || peek().type == TokenType::OR_IF) {
+        bool is_and = peek().type == TokenType::AND_IF;
+        advance();
+        skipNewlines();
+        auto next = parsePipeline();
+        if (!next) return nullptr;
+        node->rest.push_back({is_and, std::move(next)});
+    }
+    return node;
+}
+
+AstNodePtr ScriptParser::parsePipeline() {
+    // [!] time [-p] [-v] [!] pipeline: the keyword times the whole pipeline
+    std::unique_ptr<PipelineNode> node;
+    bool negate = false;
+    size_t start = peek().offset;
+    if (atWord("!")) {
+        negate = true;
+        advance();
+        start = peek().offset;
+    }
+    if (atWord("time")) {
+        node = std::make_unique<PipelineNode>();
+        node->timed = true;
+        advance();
+        while (atWord("-p") || atWord("-v")) {
+            (atWord("-p") ? node->time_posix : node->time_stages) = true;
+            advance();
+        }
+        start = peek().offset;
+        if (atWord("!")) {
+            negate = !negate;
+            advance();
+        }
+        // A bare `time` reports an empty pipeline
+        if (peek().type != TokenType::WORD && peek().type != TokenType::LPAREN) {
+            node->negate = negate;
+            return node;
+        }
+    }
+
+    auto stage = parseCommand();
+    if (!stage) return nullptr;
+    if (!negate && !node && peek().type != TokenType::PIPE) return stage;
+
+    if (!node) node = std::make_unique<PipelineNode>();
+    node->negate = negate;
+    node->stages.push_back(std::move(stage));
+    while (peek().type == TokenType::PIPE) {
+        advance();
+        skipNewlines();
+        stage = parseCommand();
+        if (!stage) return nullptr;
+        node->stages.push_back(std::move(stage));
+    }
+    node->text = source_.substr(start, last_end_ - start);
+    return node;
+}
+
+// ── Commands ─────────────────────────────────────────────────────────────────
+
+AstNodePtr ScriptParser::parseCommand() {
+    if (peek().type == TokenType::WORD) expandAliasAt(pos_);
+    const Token& t = peek();
+
+    AstNodePtr node;
+    if (t.type == TokenType::LPAREN) {
+        node = parseSubshell();
+    } else if (t.type == TokenType::WORD) {
+        const std::string& w = t.value;
+        if (w == "if") node = parseIf();
+        else if (w == "while") node = parseLoop(false);
+        else if (w == "until") node = parseLoop(true);
+        else if (w == "for") node = parseFor();
+        else if (w == "case") node = parseCase();
+        else if (w == "{") node = parseGroup();
+        else if (w == "coproc") return parseCoproc();
+        else if (w == "function") {
+            advance();
+            if (peek().type != TokenType::WORD || !isFunctionName(peek().value)) {
+                fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+                return nullptr;
+            }
+            std::string name = peek().value;
+            advance();
+            if (peek().type == TokenType::LPAREN && peek(1).type == TokenType::RPAREN) {
+                advance();
+                advance();
+            }
+            skipNewlines();
+            return parseFunction(name, peek().offset);
+        } else if (peek(1).type == TokenType::LPAREN && peek(2).type == TokenType::RPAREN &&
+                   isFunctionName(w)) {
+            std::string name = w;
+            advance();
+            advance();
+            advance();
+            skipNewlines();
+            return parseFunction(name, peek().offset);
+        } else if (isReservedWord(w)) {
+            fail("syntax error near unexpected token `" + w + "'");
+            return nullptr;
+        } else {
+            return parseSimpleCommand();
+        }
+    } else if (isRedirectToken(t.type)) {
+        return parseSimpleCommand();
+    } else {
+        fail("syntax error near unexpected token `" + describeToken(t) + "'");
+        return nullptr;
+    }
+
+    if (!node) return nullptr;
+    if (!parseCompoundRedirects(*node)) return nullptr;
+    return node;
+}
+
+AstNodePtr ScriptParser::parseSimpleCommand() {
+    size_t start = pos_;
+    size_t end = pos_;
+    while (!isCommandTerminator(end)) {
+        // A redirection needs its target before the command ends
+        if (isRedirectToken(tokens_[end].type) && redirectTakesWord(tokens_[end].type)) {
+            pos_ = end + 1;
+            if (peek().type != TokenType::WORD) {
+                fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+                return nullptr;
+            }
+        }
+        ++end;
+    }
+
+    std::vector<Token> slice(tokens_.begin() + static_cast<long>(start),
+                             tokens_.begin() + static_cast<long>(end));
+    slice.push_back({TokenType::END_OF_INPUT, "", 0});
+
+    auto node = std::make_unique<SimpleCommandNode>();
+    size_t k = 0;
+    while (slice[k].type == TokenType::WORD && isAssignmentWord(slice[k].value)) {
+        const std::string& word = slice[k].value;
+        node->assignments.push_back(isCompoundAssignment(word) ? braceExpandItems(word) : word);
+        ++k;
+    }
+    node->command = parser_.parseSingleCommand(k, slice);
+
+    // Brace expansion is purely textual, so it is done once here
+    Tracer::Span trace_brace("braceExpand");
+    std::vector<std::string> args;
+    args.reserve(node->command.args.size());
+    for (const auto& arg : node->command.args) {
+        if (isCompoundAssignment(arg)) {
+            args.push_back(braceExpandItems(arg));  // declare a=(...)
+            continue;
+        }
+        auto expanded = braceExpand(arg);
+        for (auto& e : expanded) args.push_back(std::move(e));
+    }
+    node->command.args = std::move(args);
+
+    pos_ = start;
+    while (pos_ < end) advance();
+    size_t text_start = tokens_[start].offset;
+    node->text = source_.substr(text_start, last_end_ > text_start ? last_end_ - text_start : 0);
+    return node;
+}
+
+bool ScriptParser::parseCompoundRedirects(AstNode& node) {
+    if (!isRedirectToken(peek().type)) return true;
+
+    size_t start = pos_;
+    size_t end = pos_;
+    while (isRedirectToken(tokens_[end].type)) {
+        ++end;
+        if (redirectTakesWord(tokens_[end - 1].type)) {
+            if (tokens_[end].type != TokenType::WORD) {
+                pos_ = end;
+                fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+                return false;
+            }
+            ++end;
+            if (tokens_[end].type == TokenType::HEREDOC_BODY) ++end;
+        }
+    }
+
+    std::vector<Token> slice(tokens_.begin() + static_cast<long>(start),
+                             tokens_.begin() + static_cast<long>(end));
+    slice.push_back({TokenType::END_OF_INPUT, "", 0});
+    size_t k = 0;
+    node.redirects = std::make_unique<Command>(parser_.parseSingleCommand(k, slice));
+
+    while (pos_ < end) advance();
+    return true;
+}
+
+// ── Compound commands ────────────────────────────────────────────────────────
+
+AstNodePtr ScriptParser::parseIf() {
+    advance();  // if
+    auto node = std::make_unique<IfNode>();
+    while (true) {
+        auto condition = parseList();
+        if (!condition) return nullptr;
+        if (condition->items.empty()) {
+            fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+            return nullptr;
+        }
+        if (!expect("then")) return nullptr;
+        auto body = parseList();
+        if (!body) return nullptr;
+        node->clauses.push_back({std::move(condition), std::move(body)});
+
+        if (atWord("elif")) {
+            advance();
+            continue;
+        }
+        if (atWord("else")) {
+            advance();
+            node->else_body = parseList();
+            if (!node->else_body) return nullptr;
+        }
+        if (!expect("fi")) return nullptr;
+        return node;
+    }
+}
+
+AstNodePtr ScriptParser::parseLoop(bool until) {
+    advance();  // while / until
+    auto node = std::make_unique<LoopNode>();
+    node->until = until;
+    auto condition = parseList();
+    if (!condition) return nullptr;
+    if (!expect("do")) return nullptr;
+    auto body = parseList();
+    if (!body) return nullptr;
+    if (!expect("done")) return nullptr;
+    node->condition = std::move(condition);
+    node->body = std::move(body);
+    return node;
+}
+
+AstNodePtr ScriptParser::parseFor() {
+    advance();  // for
+    auto node = std::make_unique<ForNode>();
+    // for -P N name ...: iterations run as parallel jobs (-PN works too)
+    if (peek().type == TokenType::WORD && peek().value.rfind("-P", 0) == 0) {
+        node->jobs = peek().value.substr(2);
+        advance();
+        if (node->jobs.empty() && peek().type == TokenType::WORD) {
+            node->jobs = peek().value;
+            advance();
+        }
+        if (node->jobs.empty()) {
+            fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+            return nullptr;
+        }
+    }
+    if (node->jobs.empty() && peek().type == TokenType::WORD && peek().value.starts_with("((")) {
+        // for ((init; condition; update)), one word from the tokenizer
+        const std::string& word = peek().value;
+        std::string_view inner = std::string_view(word).substr(2, word.size() - 4);
+        size_t first = inner.find(';');
+        size_t second = first == std::string_view::npos ? first : inner.find(';', first + 1);
+        if (!word.ends_with("))") || second == std::string_view::npos || inner.find(';', second + 1) != std::string_view::npos) {
+            fail("syntax error: arithmetic expression required in `" + word + "'");
+            return nullptr;
+        }
+        node->arithmetic = true;
+        node->init = inner.substr(0, first);
+        node->condition = inner.substr(first + 1, second - first - 1);
+        node->update = inner.substr(second + 1);
+        advance();
+        if (peek().type == TokenType::SEMICOLON) advance();
+        skipNewlines();
+        if (!expect("do")) return nullptr;
+        auto body = parseList();
+        if (!body) return nullptr;
+        if (!expect("done")) return nullptr;
+        node->body = std::move(body);
+        return node;
+    }
+    if (peek().type != TokenType::WORD || !isName(peek().value)) {
+        fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+        return nullptr;
+    }
+    node->variable = peek().value;
+    advance();
+
+    if (peek().type == TokenType::SEMICOLON) {
+        advance();
+    } else {
+        skipNewlines();
+        if (atWord("in")) {
+            advance();
+            node->has_in = true;
+            while (peek().type == TokenType::WORD) {
+                ForNode::Range range;
+                if (lazyRange(peek().value, range)) {
+                    range.index = node->words.size();
+                    node->ranges.push_back(std::move(range));
+                } else {
+                    for (auto& w : braceExpand(peek().value)) node->words.push_back(std::move(w));
+                }
+                advance();
+            }
+            if (peek().type != TokenType::SEMICOLON && peek().type != TokenType::NEWLINE) {
+                fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+                return nullptr;
+            }
+            advance();
+        }
+    }
+    skipNewlines();
+
+    if (!expect("do")) return nullptr;
+    auto body = parseList();
+    if (!body) return nullptr;
+    if (!expect("done")) return nullptr;
+    node->body = std::move(body);
+    return node;
+}
+
+AstNodePtr ScriptParser::parseCase() {
+    advance();  // case
+    if (peek().type != TokenType::WORD) {
+        fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+        return nullptr;
+    }
+    auto node = std::make_unique<CaseNode>();
+    node->subject = peek().value;
+    advance();
+    skipNewlines();
+    if (!expect("in")) return nullptr;
+    skipNewlines();
+
+    while (!atWord("esac")) {
+        CaseNode::Arm arm;
+        if (peek().type == TokenType::LPAREN) advance();
+        while (true) {
+            if (peek().type != TokenType::WORD) {
+                fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+                return nullptr;
+            }
+            arm.patterns.push_back(peek().value);
+            advance();
+            if (peek().type != TokenType::PIPE) break;
+            advance();
+        }
+        if (peek().type != TokenType::RPAREN) {
+            fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+            return nullptr;
+        }
+        advance();
+
+        auto body = parseList();
+        if (!body) return nullptr;
+        if (!body->items.empty()) arm.body = std::move(body);
+        node->arms.push_back(std::move(arm));
+
+        if (peek().type == TokenType::DSEMI) {
+            advance();
+            skipNewlines();
+        } else if (!atWord("esac")) {
+            fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+            return nullptr;
+        }
+    }
+    advance();  // esac
+    return node;
+}
+
+AstNodePtr ScriptParser::parseGroup() {
+    advance();  // {
+    ++brace_depth_;
+    auto body = parseList();
+    if (!body || !expect("}")) return nullptr;
+    --brace_depth_;
+    auto node = std::make_unique<GroupNode>(NodeKind::GROUP);
+    node->body = std::move(body);
+    return node;
+}
+
+AstNodePtr ScriptParser::parseSubshell() {
+    advance();  // (
+    ++paren_depth_;
+    auto body = parseList();
+    if (!body) return nullptr;
+    if (peek().type != TokenType::RPAREN) {
+        fail("syntax error near unexpected token `" + describeToken(peek()) + "'");
+        return nullptr;
+    }
+    advance();
+    --paren_depth_;
+    auto node = std::make_unique<GroupNode>(NodeKind::SUBSHELL);
+    node->body = std::move(body);
+    return node;
+}
+
+AstNodePtr ScriptParser::parseFunction(const std::string& name, size_t body_start) {
+    auto body = parseCommand();
+    if (!body) return nullptr;
+    auto node = std::make_unique<FunctionDefNode>();
+    node->name = name;
+    node->body = std::move(body);
+    node->body_text = source_.substr(body_start, last_end_ > body_start ? last_end_ - body_start : 0);
+    return node;
+}
+
+// coproc [NAME] command: as in bash, a NAME is only taken in front of a
+// compound command, so `coproc bc -l` runs bc as COPROC
+AstNodePtr ScriptParser::parseCoproc() {
+    advance();  // coproc
+    auto node = std::make_unique<CoprocNode>();
+    static const std::set<std::string> compound = {"{", "if", "while", "until", "for", "case"};
+    if (peek().type == TokenType::WORD && isVariableName(peek().value) && !compound.count(peek().value)) {
+        const Token& next = peek(1);
+        if (next.type == TokenType::LPAREN || (next.type == TokenType::WORD && compound.count(next.value))) {
+            node->name = peek().value;
+            advance();
+        }
+    }
+    size_t start = peek().offset;
+    node->body = parseCommand();
+    if (!node->body) return nullptr;
+    node->text = source_.substr(start, last_end_ > start ? last_end_ - start : 0);
+    return node;
+}
+
+// ── Brace expansion {a,b,c} and {1..5} ───────────────────────────────────────
+
+// If word[i] starts a quoted or $-construct, return the index just past it;
+// otherwise return i unchanged
+static size_t skipQuotedConstruct(const std::string& word, size_t i) {
+    char c = word[i];
+    if (c == '\\') return std::min(i + 2, word.size());
+    if (c == '\'' || c == '"' || c == '`') {
+        size_t end = Tokenizer::findConstructEnd(word, i);
+        return end == std::string::npos ? word.size() : end;
+    }
+    if (c == '$' && i + 1 < word.size() && (word[i + 1] == '{' || word[i + 1] == '(')) {
+        size_t end = Tokenizer::findConstructEnd(word, i + 1);
+        return end == std::string::npos ? word.size() : end;
+    }
+    return i;
+}
+
+std::vector<std::string> ScriptParser::braceExpand(const std::string& word) {
+    if (word.find('{') == std::string::npos) return {word};
+
+    for (size_t open = 0; open < word.size(); ++open) {
+        size_t skipped = skipQuotedConstruct(word, open);
+        if (skipped != open) {
+            open = skipped - 1;
+            continue;
+        }
+        if (word[open] != '{') continue;
+
+        // Find the matching close brace and the top-level commas
+        std::vector<size_t> commas;
+        size_t close = std::string::npos;
+        int depth = 0;
+        for (size_t i = open; i < word.size(); ++i) {
+            size_t s = skipQuotedConstruct(word, i);
+            if (s != i) {
+                i = s - 1;
+                continue;
+            }
+            if (word[i] == '{') {
+                ++depth;
+            } else if (word[i] == '}') {
+                if (--depth == 0) {
+                    close = i;
+                    break;
+                }
+            } else if (word[i] == ',' && depth == 1) {
+                commas.push_back(i);
+            }
+        }
+        if (close == std::string::npos) return {word};
+
+        std::vector<std::string> items;
+        if (!commas.empty()) {
+            size_t from = open + 1;
+            for (size_t comma : commas) {
+                items.push_back(word.substr(from, comma - from));
+                from = comma + 1;
+            }
+            items.push_back(word.substr(from, close - from));
+        } else if (BraceSequence seq; BraceSequence::parse(std::string_view(word).substr(open + 1, close - open - 1), seq)) {
+            items = seq.materialize();
+        } else {
+            continue;  // "{}" or "{x}" stays literal; look for a later brace
+        }
+
+        std::string pre = word.substr(0, open);
+        std::string post = word.substr(close + 1);
+        std::vector<std::string> result;
+        for (const auto& item : items) {
+            for (auto& e : braceExpand(pre + item + post)) result.push_back(std::move(e));
+        }
+        return result;
+    }
+    return {word};
+}
+
+} // namespace helix
@@ -1,20 +1,47 @@
 #include "shell.h"
 #include "tokenizer.h"
+#include "ai_context.h"
+#include "event_loop.h"
+#include "trace.h"
 #include "parser.h"
 #include "readline_support.h"
 #include "executor/environment_expander.h"
+#include "executor/arithmetic.h"
+#include "executor/pattern.h"
+#include "shell/script_cache.h"
+#include "shell/builtin_output.h"
+#include "shell/builtin_table.h"
+#include "shell/input_buffer.h"
+#include "executor/path_cache.h"
+#include "executor/child_wait.h"
+#include "executor/fd_manager.h"
+#include "executor/fd_utils.h"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <unistd.h>
+#include <fcntl.h>
 #include <pwd.h>
 #include <cstring>
 #include <cstdlib>
 #include <csignal>
 #include <chrono>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
-#include <fnmatch.h>
+#include <algorithm>
+#include <map>
+#include <optional>
+#include <utility>
+#include <iterator>
+#include <cstdio>
+#include <climits>
+#include <string_view>
+#include <thread>
+#if defined(__linux__)
+#include <stdio_ext.h>
+#endif
 
 namespace helix {
 
@@ -23,155 +50,236 @@ static IJobManager* g_job_manager = nullptr;
 static void sigchld_handler(int /* sig */) {
     int saved_errno = errno;
     if (g_job_manager) {
-        static_cast<JobManager*>(g_job_manager)->checkCompletedJobs();
+        static_cast<JobManager*>(g_job_manager)->onSigchld();
     }
+    // A REPL waiting for input announces the job right away
+    EventLoop::wake();
     errno = saved_errno;
 }
 
-Shell::Shell()
-    : builtin_dispatcher(std::make_unique<BuiltinCommandDispatcher>()),
-      job_manager(std::make_unique<JobManager>()) {
+// Background members that exit during a foreground wait (waitForeground())
+static void reap_background() {
+    if (g_job_manager) static_cast<JobManager*>(g_job_manager)->reapOwnChildren();
+}
 
-    state.running = true;
-    state.job_manager = job_manager.get();
-    state.prompt = &prompt;
+namespace {
+
+// --startup-trace: wall time of each constructor phase, one line each
+class StartupTrace {
+public:
+    explicit StartupTrace(bool enabled) : enabled_(enabled), start_(Clock::now()) {
+        if (!enabled_) return;
+        // Dynamic loading and static initialisation, before main() ran
+        struct timespec cpu;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+        report("process cpu before Shell", static_cast<double>(cpu.tv_sec) * 1e3 + static_cast<double>(cpu.tv_nsec) / 1e6);
+    }
 
-    g_job_manager = job_manager.get();
+    ~StartupTrace() {
+        if (enabled_) report("total", elapsed(start_));
+    }
 
-    struct sigaction sa;
-    sa.sa_handler = sigchld_handler;
-    sigemptyset(&sa.sa_mask);
-    sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
-    if (sigaction(SIGCHLD, &sa, nullptr) == -1) {
-        std::cerr << "Warning: Failed to set up SIGCHLD handler\n";
+    template <typename Fn>
+    void phase(const char* name, Fn&& fn) {
+        if (!enabled_) { fn(); return; }
+        auto t0 = Clock::now();
+        fn();
+        report(name, elapsed(t0));
     }
 
-    ReadlineSupport::initialize();
+private:
+    using Clock = std::chrono::steady_clock;
 
-    char* home = getenv("HOME");
-    if (home) {
-        state.home_directory = home;
-    } else {
-        struct passwd* pw = getpwuid(getuid());
-        if (pw) state.home_directory = pw->pw_dir;
+    static double elapsed(Clock::time_point since) {
+        return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
     }
 
-    char cwd[1024];
-    if (getcwd(cwd, sizeof(cwd))) state.current_directory = cwd;
+    static void report(const char* name, double ms) {
+        std::fprintf(stderr, "helix: startup: %-26s %8.3f ms\n", name, ms);
+    }
 
-    char* user = getenv("USER");
-    if (!user) user = getenv("LOGNAME");
-    if (!user && getpwuid(getuid())) user = getpwuid(getuid())->pw_name;
+    bool enabled_;
+    Clock::time_point start_;
+};
 
-    char hostname[256];
-    if (gethostname(hostname, sizeof(hostname)) == 0) {
-        prompt.setUserHost(user ? user : "user", hostname);
+} // namespace
+
+Shell::Shell(const StartupOptions& options)
+    : options_(options),
+      builtin_dispatcher(std::make_unique<BuiltinCommandDispatcher>()),
+      job_manager(std::make_unique<JobManager>()) {
+    StartupTrace trace(options_.trace);
+
+    state.running = true;
+    state.job_manager = job_manager.get();
+    state.prompt = &prompt;
+    state.history = &history_;
+    state.command_substitution = this;
+    stdout_buf_ = std::cout.rdbuf();
+
+    if (options_.signals) {
+        g_job_manager = job_manager.get();
+        setBackgroundReaper(reap_background);
+        trace.phase("signals", [] {
+            struct sigaction sa;
+            sa.sa_handler = sigchld_handler;
+            sigemptyset(&sa.sa_mask);
+            sa.sa_flags = SA_RESTART | SA_NOCLDSTOP;
+            if (sigaction(SIGCHLD, &sa, nullptr) == -1) {
+                std::cerr << "Warning: Failed to set up SIGCHLD handler\n";
+            }
+        });
     } else {
-        prompt.setUserHost(user ? user : "user", "helix");
+        // The host's SIGCHLD disposition and its children are left alone;
+        // a handler some other Shell installed does not reap for this one
+        static_cast<JobManager*>(job_manager.get())->setReapOwnChildrenOnly(true);
     }
 
-    prompt.setHomeDirectory(state.home_directory);
-    prompt.setCurrentDirectory(state.current_directory);
-    prompt.setLastExitStatus(state.last_exit_status);
+    trace.phase("environment", [this] {
+        VariableStore& vars = VariableStore::global();
+        if (const std::string* home = vars.find("HOME")) {
+            state.home_directory = *home;
+        } else {
+            struct passwd* pw = getpwuid(getuid());
+            if (pw) state.home_directory = pw->pw_dir;
+        }
+        char cwd[1024];
+        if (getcwd(cwd, sizeof(cwd))) state.current_directory = cwd;
+        prompt.setHomeDirectory(state.home_directory);
+        prompt.setCurrentDirectory(state.current_directory);
+        prompt.setLastExitStatus(state.last_exit_status);
+    });
+
+    // HELIX_TRACE=<file>: record a Chrome trace of this process and its children
+    const std::string* trace_file = VariableStore::global().find("HELIX_TRACE");
+    if (trace_file && !trace_file->empty() && !Tracer::enabled() &&
+        !Tracer::global().open(*trace_file)) {
+        std::cerr << "helix: HELIX_TRACE: " << *trace_file << ": " << std::strerror(errno) << "\n";
+    }
 
-    // HISTCONTROL from environment
-    const char* hc = getenv("HISTCONTROL");
-    if (hc) state.histcontrol = hc;
+    if (options_.interactive) {
+        trace.phase("readline", [this] {
+            ReadlineSupport::initialize();
+            ReadlineSupport::setCommands(builtin_dispatcher->names());
+            ReadlineSupport::setShellState(&state);
+        });
+        trace.phase("prompt identity", [this] { initPromptIdentity(); });
+        trace.phase("history", [this] { loadHistory(); });
+    }
 
-    loadHistory();
-    loadRcFile();
+    if (options_.load_rc) {
+        trace.phase("rc file", [this] { loadRcFile(state.home_directory + "/.helixrc"); });
+    }
+    if (!options_.interactive && options_.load_env) {
+        // The BASH_ENV convention: scripts opt in to a startup file
+        const std::string* env_file = VariableStore::global().find("HELIX_ENV");
+        if (env_file && !env_file->empty()) {
+            trace.phase("$HELIX_ENV", [this, path = *env_file] { loadRcFile(path); });
+        }
+    }
 }
 
 Shell::~Shell() {
     // Run EXIT trap if set
     if (!state.exit_trap.empty()) {
-        runSingleCommand(state.exit_trap);
+        runSource(state.exit_trap);
+    }
+    if (g_job_manager == job_manager.get()) g_job_manager = nullptr;
+    if (options_.interactive) ReadlineSupport::cleanup();
+    Tracer::global().flush();
+}
+
+// \u and \h for the prompt: a passwd lookup and gethostname(), which
+// nothing but the prompt needs
+void Shell::initPromptIdentity() {
+    VariableStore& vars = VariableStore::global();
+    const std::string* user_var = vars.find("USER");
+    if (!user_var) user_var = vars.find("LOGNAME");
+    const char* user = user_var ? user_var->c_str() : nullptr;
+    if (!user && getpwuid(getuid())) user = getpwuid(getuid())->pw_name;
+
+    char hostname[256];
+    if (gethostname(hostname, sizeof(hostname)) == 0) {
+        prompt.setUserHost(user ? user : "user", hostname);
+    } else {
+        prompt.setUserHost(user ? user : "user", "helix");
     }
-    saveHistory();
-    g_job_manager = nullptr;
-    ReadlineSupport::cleanup();
 }
 
 // ── History persistence ──────────────────────────────────────────────────────
 
+// The file is only mapped here; each command is appended as it is entered
 void Shell::loadHistory() {
     std::string path = state.home_directory + "/.helix_history";
-    std::ifstream f(path);
-    std::string line;
-    while (std::getline(f, line)) {
-        if (!line.empty()) {
-            state.command_history.push_back(line);
-            add_history(line.c_str());
-        }
+    if (!history_.open(path)) {
+        std::cerr << "helix: cannot read history file " << path << ": " << strerror(errno) << "\n";
     }
 }
 
-void Shell::saveHistory() {
-    std::string path = state.home_directory + "/.helix_history";
-    std::ofstream f(path, std::ios::app);
-    for (const auto& cmd : session_history_) {
-        f << cmd << '\n';
+// Interactive sessions give readline the newest $HISTSIZE entries (default
+// 1000) for arrow keys and Ctrl-R; everything older stays on disk and is
+// reached through `history`, !prefix and !?text
+void Shell::seedReadlineHistory() {
+    long size = 1000;
+    if (const std::string* hs = VariableStore::global().find("HISTSIZE")) {
+        size = std::max(0L, std::atol(hs->c_str()));
+    }
+    for (std::string_view entry : history_.tail(static_cast<size_t>(size))) {
+        ReadlineSupport::addHistory(std::string(entry));
     }
+    ReadlineSupport::stifleHistory(static_cast<int>(std::min<long>(size, INT_MAX)));
 }
 
 // ── RC file ──────────────────────────────────────────────────────────────────
 
-void Shell::loadRcFile() {
-    std::string path = state.home_directory + "/.helixrc";
-    std::ifstream f(path);
-    if (!f.is_open()) return;
-
-    std::string line;
-    while (std::getline(f, line)) {
-        std::string trimmed = trimWhitespace(line);
-        if (trimmed.empty() || trimmed[0] == '#') continue;
-        runSingleCommand(trimmed);
-    }
+void Shell::loadRcFile(const std::string& path) {
+    std::string contents;
+    if (!ScriptCache::readFile(path, contents)) return;
+    runSource(contents);
 }
 
 // ── REPL ─────────────────────────────────────────────────────────────────────
 
 int Shell::run() {
     std::cout << "Helix Shell v1.0.0  (type 'help' for commands, 'ai <query>' for AI assist)\n";
+    seedReadlineHistory();
+
+    // While a line is being typed, SIGCHLD wakes the event loop and a
+    // finished background job is reported at once, above the line
+    EventLoop& loop = EventLoop::global();
+    int notifier = loop.onWake([this] {
+        std::ostringstream notices;
+        static_cast<JobManager*>(job_manager.get())->printAndCleanCompletedJobs(notices);
+        if (!notices.str().empty()) ReadlineSupport::printAbove(notices.str());
+    });
 
     while (state.running) {
-        if (job_manager) {
-            static_cast<JobManager*>(job_manager.get())->printAndCleanCompletedJobs();
-        }
+        // Continuation lines of an unfinished block get only the "> " prompt
+        if (pending_input_.empty()) {
+            if (job_manager) {
+                static_cast<JobManager*>(job_manager.get())->printAndCleanCompletedJobs();
+            }
 
-        // PROMPT_COMMAND — run a command before showing prompt
-        const char* pc = getenv("PROMPT_COMMAND");
-        if (pc && *pc) {
-            runSingleCommand(std::string(pc));
-        }
+            // PROMPT_COMMAND — run a command before showing prompt
+            const std::string* pc = VariableStore::global().find("PROMPT_COMMAND");
+            if (pc && !pc->empty()) {
+                runSource(*pc);
+            }
 
-        showPrompt();
+            showPrompt();
+        }
 
         std::string input = readInput();
 
         auto t0 = std::chrono::steady_clock::now();
-        bool ok = processInput(input);
+        bool ok = processInput(input, true);
         auto t1 = std::chrono::steady_clock::now();
         last_duration_ = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0);
 
-        if (state.sourcing) {
-            state.sourcing = false;
-            for (const auto& line : state.source_lines) {
-                if (!runSingleCommand(line)) break;
-                if (!state.running) break;
-            }
-            state.source_lines.clear();
-        }
-
-        if (!state.pending_command.empty()) {
-            std::string pending = state.pending_command;
-            state.pending_command.clear();
-            runSingleCommand(pending);
-        }
-
         if (!ok) break;
     }
 
+    loop.removeWake(notifier);
     std::cout << "Goodbye!\n";
     return state.last_exit_status;
 }
@@ -180,160 +288,133 @@ void Shell::showPrompt() {
     prompt.setCurrentDirectory(state.current_directory);
     prompt.setLastExitStatus(state.last_exit_status);
     prompt.setLastCommandDuration(last_duration_);
-    std::cout << prompt.generate();
+    VariableStore& vars = VariableStore::global();
+    if (const std::string* budget = vars.find("HELIX_GIT_TIMEOUT_MS")) {
+        prompt.setGitStatusBudget(std::chrono::milliseconds(std::atol(budget->c_str())));
+    }
+    // The git status worker runs git via popen(), which reads environ
+    vars.syncProcessEnvironment();
+    shown_prompt_ = prompt.generate();
+    std::cout << shown_prompt_;
     std::cout.flush();
+    // Gathered while the user types, for a possible `ai` query (a no-op
+    // until the first one)
+    AiContext::global().prefetch(state.current_directory);
 }
 
 std::string Shell::readInput() {
     // Check if we're inside a multi-line block (accumulating lines)
-    if (!block_stack_.empty()) {
-        std::string line = ReadlineSupport::readLineWithCompletion("> ");
-        if (line.empty() && std::cin.eof()) {
+    if (!pending_input_.empty()) {
+        std::optional<std::string> line = ReadlineSupport::readLine("> ", EventLoop::global());
+        if (!line) {
             state.running = false;
             return "";
         }
-        return line;
+        return *line;
     }
 
-    std::string line = ReadlineSupport::readLineWithCompletion("");
-    if (line.empty() && std::cin.eof()) {
+    std::optional<std::string> line = ReadlineSupport::readLine("", EventLoop::global(), shown_prompt_);
+    if (!line) {
         state.running = false;
         return "exit";
     }
-    return line;
+    return *line;
 }
 
 // ── Input helpers ────────────────────────────────────────────────────────────
 
-std::string Shell::trimWhitespace(const std::string& s) {
-    size_t a = s.find_first_not_of(" \t");
-    if (a == std::string::npos) return "";
-    size_t b = s.find_last_not_of(" \t");
-    return s.substr(a, b - a + 1);
+namespace {
+
+// An assignment word taken apart: NAME[SUBSCRIPT]+=VALUE
+struct AssignmentWord {
+    std::string_view name;
+    std::string_view subscript;   // Between the brackets, when has_subscript
+    std::string_view value;       // After the '=', unexpanded
+    bool has_subscript = false;
+    bool append = false;          // +=
+    bool compound = false;        // value is a (...) list
+};
+
+bool splitAssignment(std::string_view word, AssignmentWord& out) {
+    size_t k = 0;
+    while (k < word.size() && (std::isalnum(static_cast<unsigned char>(word[k])) || word[k] == '_')) ++k;
+    if (k == 0) return false;
+    out.name = word.substr(0, k);
+    if (k < word.size() && word[k] == '[') {
+        size_t close = word.find("]=", k);
+        size_t close_append = word.find("]+=", k);
+        close = std::min(close, close_append);
+        if (close == std::string_view::npos) return false;
+        out.subscript = word.substr(k + 1, close - k - 1);
+        out.has_subscript = true;
+        k = close + 1;
+    }
+    out.append = k < word.size() && word[k] == '+';
+    if (out.append) ++k;
+    if (k >= word.size() || word[k] != '=') return false;
+    out.value = word.substr(k + 1);
+    out.compound = out.value.size() >= 2 && out.value.front() == '(' && out.value.back() == ')';
+    return true;
 }
 
-enum class SplitOp { SEQ, AND, OR };
-struct Fragment { std::string text; SplitOp op; };
-
-static std::vector<Fragment> splitLogical(const std::string& input) {
-    std::vector<Fragment> frags;
-    std::string current;
-    bool in_single = false, in_double = false;
-    int brace_depth = 0; // {} depth — don't split inside function bodies
-    size_t i = 0;
+// Builtins whose NAME=(...) arguments are compound assignments
+bool isDeclarationBuiltin(std::string_view name) {
+    return name == "declare" || name == "typeset" || name == "local" || name == "readonly" || name == "export";
+}
 
-    auto push = [&](SplitOp op) {
-        frags.push_back({current, op});
-        current.clear();
-    };
+} // namespace
+
+// NAME=value: locals already live in the store (their frame only holds
+// the shadowed value), so the innermost declaration is the one assigned
+void Shell::assignVariable(const std::string& name, const std::string& value) {
+    // declare -i: the value is an arithmetic expression
+    if (!state.integer_vars.empty() && state.integer_vars.count(name)) {
+        long n = 0;
+        ArithmeticEngine::global().evaluate(value, &state, n);
+        VariableStore::global().set(name, std::to_string(n));
+        return;
+    }
+    VariableStore::global().set(name, value);
+}
 
-    while (i < input.size()) {
-        char c = input[i];
-        if      (c == '\'' && !in_double) { in_single = !in_single; current += c; ++i; }
-        else if (c == '"'  && !in_single) { in_double = !in_double; current += c; ++i; }
-        else if (!in_single && !in_double && c == '{') { ++brace_depth; current += c; ++i; }
-        else if (!in_single && !in_double && c == '}') { --brace_depth; if (brace_depth < 0) brace_depth = 0; current += c; ++i; }
-        else if (!in_single && !in_double && brace_depth == 0 && c == '&' && i+1 < input.size() && input[i+1] == '&') {
-            push(SplitOp::AND); i += 2;
-        } else if (!in_single && !in_double && brace_depth == 0 && c == '|' && i+1 < input.size() && input[i+1] == '|') {
-            push(SplitOp::OR); i += 2;
-        } else if (!in_single && !in_double && brace_depth == 0 && c == ';') {
-            push(SplitOp::SEQ); ++i;
-        } else {
-            current += c; ++i;
+// One assignment word, from a bare assignment or a declaration builtin's
+// argument: NAME=value, NAME+=value, NAME[i]=value, NAME=(...), NAME+=(...)
+bool Shell::assignWord(const std::string& word) {
+    AssignmentWord parts;
+    if (!splitAssignment(word, parts)) return false;
+    std::string name(parts.name);
+    if (parts.compound) {
+        if (parts.has_subscript) {
+            std::cerr << "helix: " << name << "[" << parts.subscript << "]: cannot assign list to array member\n";
+            return false;
         }
+        return expander.assignArray(name, parts.value.substr(1, parts.value.size() - 2), parts.append, false, &state);
     }
-    frags.push_back({current, SplitOp::SEQ});
-    return frags;
-}
-
-// ── Brace expansion {a,b,c} and {1..5} ───────────────────────────────────────
-
-static std::vector<std::string> braceExpand(const std::string& word) {
-    // Find outermost unquoted { ... }
-    size_t open = std::string::npos;
-    int depth = 0;
-    bool in_sq = false, in_dq = false;
-    for (size_t i = 0; i < word.size(); ++i) {
-        char c = word[i];
-        if (c == '\'' && !in_dq) { in_sq = !in_sq; continue; }
-        if (c == '"' && !in_sq) { in_dq = !in_dq; continue; }
-        if (in_sq || in_dq) continue;
-        if (c == '{') { if (depth == 0) open = i; ++depth; }
-        else if (c == '}') { --depth; if (depth == 0 && open != std::string::npos) break; }
-    }
-    if (open == std::string::npos || depth != 0) return {word};
-
-    size_t close = std::string::npos;
-    depth = 0;
-    in_sq = in_dq = false;
-    for (size_t i = open; i < word.size(); ++i) {
-        char c = word[i];
-        if (c == '\'' && !in_dq) { in_sq = !in_sq; continue; }
-        if (c == '"' && !in_sq) { in_dq = !in_dq; continue; }
-        if (in_sq || in_dq) continue;
-        if (c == '{') ++depth;
-        else if (c == '}') { --depth; if (depth == 0) { close = i; break; } }
-    }
-    if (close == std::string::npos) return {word};
-
-    std::string pre  = word.substr(0, open);
-    std::string inner = word.substr(open + 1, close - open - 1);
-    std::string post = word.substr(close + 1);
-
-    // Check for sequence {a..b} or {1..5}
-    size_t dotdot = inner.find("..");
-    if (dotdot != std::string::npos) {
-        std::string a = inner.substr(0, dotdot);
-        std::string b = inner.substr(dotdot + 2);
-        std::vector<std::string> result;
-        if (a.size() == 1 && b.size() == 1 && std::isalpha((unsigned char)a[0]) && std::isalpha((unsigned char)b[0])) {
-            char ca = a[0], cb = b[0];
-            int dir = ca <= cb ? 1 : -1;
-            for (char c = ca; c != cb + dir; c += dir)
-                result.push_back(pre + c + post);
-        } else {
-            try {
-                long ia = std::stol(a), ib = std::stol(b);
-                int dir = ia <= ib ? 1 : -1;
-                for (long n = ia; n != ib + dir; n += dir)
-                    result.push_back(pre + std::to_string(n) + post);
-            } catch (...) { return {word}; }
+    std::string value = expander.expandString(std::string(parts.value), &state);
+    if (parts.has_subscript) return expander.assignElement(name, parts.subscript, std::move(value), parts.append, &state);
+    if (parts.append) {
+        const std::string* old = VariableStore::global().find(name);
+        // declare -i: n+=2 adds
+        if (!state.integer_vars.empty() && state.integer_vars.count(name)) {
+            value = (old && !old->empty() ? *old : std::string("0")) + "+(" + value + ")";
+        } else if (old) {
+            value.insert(0, *old);
         }
-        return result;
-    }
-
-    // Split on unquoted commas inside inner
-    std::vector<std::string> parts;
-    std::string cur;
-    depth = 0;
-    in_sq = in_dq = false;
-    for (size_t i = 0; i < inner.size(); ++i) {
-        char c = inner[i];
-        if (c == '\'' && !in_dq) { in_sq = !in_sq; cur += c; continue; }
-        if (c == '"' && !in_sq) { in_dq = !in_dq; cur += c; continue; }
-        if (in_sq || in_dq) { cur += c; continue; }
-        if (c == '{') { ++depth; cur += c; }
-        else if (c == '}') { --depth; cur += c; }
-        else if (c == ',' && depth == 0) { parts.push_back(cur); cur.clear(); }
-        else cur += c;
     }
-    parts.push_back(cur);
-
-    if (parts.size() == 1) return {word}; // no comma — not a list
+    assignVariable(name, value);
+    return true;
+}
 
-    std::vector<std::string> result;
-    for (const auto& p : parts) {
-        auto expanded = braceExpand(pre + p + post);
-        for (auto& e : expanded) result.push_back(e);
-    }
-    return result;
+int Shell::setStatus(int status) {
+    state.last_exit_status = status;
+    return status;
 }
 
 // ── History expansion ─────────────────────────────────────────────────────────
 
 std::string Shell::expandHistory(const std::string& line) const {
     if (line.empty()) return line;
+    Tracer::Span trace_history("expandHistory");
 
     // ^old^new substitution on previous command
     if (line[0] == '^') {
@@ -344,10 +425,11 @@ std::string Shell::expandHistory(const std::string& line) const {
         std::string new_str = (third == std::string::npos)
             ? line.substr(second + 1)
             : line.substr(second + 1, third - second - 1);
-        if (state.command_history.empty()) {
+        auto last = history_.last();
+        if (!last) {
             std::cerr << "helix: no previous command\n"; return "";
         }
-        std::string prev = state.command_history.back();
+        std::string prev(*last);
         size_t pos = prev.find(old_str);
         if (pos == std::string::npos) { std::cerr << "helix: substitution failed\n"; return ""; }
         std::string result = prev.substr(0, pos) + new_str + prev.substr(pos + old_str.size());
@@ -358,930 +440,1552 @@ std::string Shell::expandHistory(const std::string& line) const {
     if (line[0] != '!') return line;
 
     if (line == "!!") {
-        if (state.command_history.empty()) {
+        auto prev = history_.last();
+        if (!prev) {
             std::cerr << "helix: !!: no previous command\n"; return "";
         }
-        const std::string& prev = state.command_history.back();
-        std::cout << prev << "\n";
-        return prev;
+        std::cout << *prev << "\n";
+        return std::string(*prev);
     }
 
     if (line.size() > 1 && std::isdigit(static_cast<unsigned char>(line[1]))) {
         try {
             size_t n = std::stoul(line.substr(1));
-            if (n == 0 || n > state.command_history.size()) {
+            auto cmd = history_.at(n);
+            if (!cmd) {
                 std::cerr << "helix: !" << n << ": event not found\n"; return "";
             }
-            const std::string& cmd = state.command_history[n - 1];
-            std::cout << cmd << "\n";
-            return cmd;
+            std::cout << *cmd << "\n";
+            return std::string(*cmd);
         } catch (...) {}
     }
 
-    // !string — find last command matching prefix
+    // !?string[?] — last command containing string; !string — last command
+    // starting with it
     if (line.size() > 1) {
-        std::string prefix = line.substr(1);
-        for (int i = (int)state.command_history.size() - 1; i >= 0; --i) {
-            if (state.command_history[i].find(prefix) == 0) {
-                std::cout << state.command_history[i] << "\n";
-                return state.command_history[i];
-            }
+        bool contains = line[1] == '?';
+        std::string text = line.substr(contains ? 2 : 1);
+        if (contains && !text.empty() && text.back() == '?') text.pop_back();
+        auto found = contains ? history_.findSubstring(text) : history_.findPrefix(text);
+        if (found) {
+            std::cout << *found << "\n";
+            return std::string(*found);
         }
-        std::cerr << "helix: !" << prefix << ": event not found\n";
+        std::cerr << "helix: " << line << ": event not found\n";
         return "";
     }
 
     return line;
 }
 
-// ── Alias expansion ───────────────────────────────────────────────────────────
-
-std::string Shell::expandAliases(const std::string& line) const {
-    if (state.aliases.empty()) return line;
 
-    size_t word_end = line.find_first_of(" \t");
-    std::string cmd = (word_end == std::string::npos) ? line : line.substr(0, word_end);
-    std::string rest = (word_end == std::string::npos) ? "" : line.substr(word_end);
+// ── Redirections applied to the shell process ─────────────────────────────────
 
-    auto it = state.aliases.find(cmd);
-    if (it == state.aliases.end()) return line;
-    return it->second + rest;
+static bool hasRedirections(const Command& cmd) {
+    return !cmd.redirections.empty();
 }
 
-// ── Block execution helpers ───────────────────────────────────────────────────
+// Drop anything stdio read ahead from a descriptor that is no longer stdin
+static void discardStdinBuffer() {
+#if defined(__APPLE__)
+    fpurge(stdin);
+#elif defined(__linux__)
+    __fpurge(stdin);
+#endif
+    clearerr(stdin);
+}
 
-// Run a sequence of lines as a sub-block, returns exit status of last command
-int Shell::runBlock(const std::vector<std::string>& lines) {
-    for (const auto& line : lines) {
-        std::string trimmed = trimWhitespace(line);
-        if (trimmed.empty() || trimmed[0] == '#') continue;
-        if (!runSingleCommand(trimmed)) break;
-        if (!state.running) break;
-        if (state.breaking || state.continuing || state.returning) break;
+// Drop read's look-ahead on the descriptors cmd's redirections replace
+static void discardReadAhead(const Command& cmd) {
+    using Kind = Redirection::Kind;
+    for (const Redirection& r : cmd.redirections) {
+        switch (r.kind) {
+        case Kind::OUTPUT: case Kind::APPEND: case Kind::OUT_TO_ERR: case Kind::DUP_OUT:
+            InputBuffer::discard(STDOUT_FILENO);
+            break;
+        case Kind::ERROR: case Kind::ERROR_APPEND: case Kind::ERR_TO_OUT:
+            InputBuffer::discard(STDERR_FILENO);
+            break;
+        case Kind::BOTH: case Kind::BOTH_APPEND:
+            InputBuffer::discard(STDOUT_FILENO);
+            InputBuffer::discard(STDERR_FILENO);
+            break;
+        default:
+            InputBuffer::discard(STDIN_FILENO);
+            break;
+        }
     }
-    return state.last_exit_status;
 }
 
-// ── Function invocation ───────────────────────────────────────────────────────
+// ScopedRedirect - applies a command's redirections to the shell itself for
+// the duration of a builtin, function or compound command, restoring the
+// original descriptors (via FileDescriptorManager) when it goes out of scope
+class ScopedRedirect {
+public:
+    explicit ScopedRedirect(const Command& cmd) {
+        if (!hasRedirections(cmd)) return;
+        std::cout.flush();
+        std::fflush(stdout);
+        fds_ = std::make_unique<FileDescriptorManager>();
+        cmd_ = &cmd;
+        discardReadAhead(cmd);
+        int input_fd = -1, output_fd = -1;
+        ok_ = fds_->setupRedirections(cmd, input_fd, output_fd);
+    }
 
-bool Shell::invokeFunction(const std::string& name, const std::vector<std::string>& callArgs) {
-    auto it = state.functions.find(name);
-    if (it == state.functions.end()) return false;
+    ~ScopedRedirect() {
+        if (!fds_) return;
+        std::cout.flush();
+        std::cerr.flush();
+        std::fflush(stdout);
+        fds_.reset();
+        // Drop anything stdio or read buffered from the redirected input
+        std::cin.clear();
+        discardStdinBuffer();
+        discardReadAhead(*cmd_);
+    }
 
-    // Push a new variable frame
-    state.var_frames.push_back(VarFrame{});
+    ScopedRedirect(const ScopedRedirect&) = delete;
+    ScopedRedirect& operator=(const ScopedRedirect&) = delete;
 
-    // Save and replace positional params
-    auto saved_params = state.positional_params;
-    auto saved_script  = state.script_name;
-    state.positional_params = callArgs;
-    state.script_name = name;
+    bool ok() const { return ok_; }
 
-    bool saved_returning = state.returning;
-    state.returning = false;
+private:
+    std::unique_ptr<FileDescriptorManager> fds_;
+    const Command* cmd_ = nullptr;
+    bool ok_ = true;
+};
 
-    runBlock(it->second.body);
+// ── Child processes ───────────────────────────────────────────────────────────
 
-    // Restore
-    state.positional_params = saved_params;
-    state.script_name = saved_script;
-    state.var_frames.pop_back();
+// fork() with SIGCHLD blocked so the job manager's handler cannot reap a
+// child the caller is about to wait for; the child gets the old mask back
+static pid_t forkBlockingSigchld(sigset_t& saved) {
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    sigset_t block;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &saved);
+    Tracer::Span trace_fork("fork");
+    pid_t pid = fork();
+    if (pid <= 0) sigprocmask(SIG_SETMASK, &saved, nullptr);
+    if (pid == 0) trace_fork.drop();
+    if (pid > 0 && Tracer::enabled()) {
+        trace_fork.args().child = pid;
+        Tracer::global().nameProcess(pid, "helix subshell");
+    }
+    return pid;
+}
 
-    if (state.returning) {
-        state.returning = false;
-        state.last_exit_status = state.return_value;
+static int waitForChild(pid_t pid, const sigset_t& saved) {
+    int status = 0;
+    pid_t r;
+    {
+        Tracer::Span trace_wait("wait");
+        trace_wait.args().child = pid;
+        r = waitForeground(pid, &status, 0, nullptr);
     }
-    state.returning = saved_returning && !state.returning;
+    sigprocmask(SIG_SETMASK, &saved, nullptr);
+    if (r == -1) return 0;
+    if (WIFEXITED(status)) return WEXITSTATUS(status);
+    if (WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+    return 1;
+}
 
-    return true;
+// Leave a forked evaluator child without running Shell's destructor
+// (no EXIT trap, no history write)
+[[noreturn]] static void exitChild(int status) {
+    std::cout.flush();
+    std::cerr.flush();
+    std::fflush(stdout);
+    Tracer::global().flush();
+    _exit(status & 0xff);
 }
 
-// ── If/elif/else/fi execution ─────────────────────────────────────────────────
+// ── Script evaluation ─────────────────────────────────────────────────────────
 
-int Shell::executeIf(const std::vector<std::string>& lines) {
-    // lines[0] is "if condition; then" or "if condition"
-    // We need to find then/elif/else/fi sections
+bool Shell::runSource(const std::string& source) {
+    auto result = script_parser.parse(source, &state.aliases);
+    if (result.status == ScriptParser::Status::INCOMPLETE) {
+        std::cerr << "helix: syntax error: unexpected end of file\n";
+        setStatus(2);
+        return state.running;
+    }
+    if (result.status == ScriptParser::Status::ERROR) {
+        std::cerr << "helix: " << result.error << "\n";
+        setStatus(2);
+        return state.running;
+    }
+    execList(*result.program);
+    return state.running;
+}
 
-    struct Clause { std::string cond; std::vector<std::string> body; bool is_else = false; };
-    std::vector<Clause> clauses;
-    std::string else_body_lines;
-    std::vector<std::string> else_body;
+bool Shell::sourceFile(const std::string& path) {
+    Tracer::Span trace_source("source", path);
+    // Held here: the file may be sourced again (and re-parsed) while it runs
+    ScriptCache::ScriptPtr script = ScriptCache::global().load(path, &state.aliases);
+    if (!script) {
+        std::cerr << "helix: " << path << ": " << std::strerror(errno) << "\n";
+        setStatus(1);
+        return state.running;
+    }
+    if (script->status == ScriptParser::Status::INCOMPLETE) {
+        std::cerr << "helix: syntax error: unexpected end of file\n";
+        setStatus(2);
+        return state.running;
+    }
+    if (script->status == ScriptParser::Status::ERROR) {
+        std::cerr << "helix: " << script->error << "\n";
+        setStatus(2);
+        return state.running;
+    }
+    execList(*script->program);
+    return state.running;
+}
 
-    std::string cond_acc;
-    std::vector<std::string> body_acc;
-    bool in_body = false;
-    bool in_else = false;
-    int depth = 0; // nested if depth
+void Shell::checkErrexit() {
+    if (state.exit_on_error && state.last_exit_status != 0 && condition_depth_ == 0) {
+        state.running = false;
+    }
+}
 
-    for (const auto& raw_line : lines) {
-        std::string line = trimWhitespace(raw_line);
-        if (line.empty() || line[0] == '#') continue;
+bool Shell::interrupted() const {
+    return !state.running || state.breaking || state.continuing || state.returning;
+}
 
-        // Split on semicolons to handle "if cond; then"
-        // We use the first word to detect keywords
-        std::string first_word;
-        size_t sp = line.find_first_of(" \t;");
-        first_word = (sp == std::string::npos) ? line : line.substr(0, sp);
+// SubstitutionScope - closes the process substitution pipes opened while
+// one command's words were expanded, once that command has finished: a <(...)
+// producer then sees EPIPE if nobody read it to the end, and a >(...)
+// consumer sees end of file
+class SubstitutionScope {
+public:
+    explicit SubstitutionScope(std::vector<int>& fds) : fds_(fds), mark_(fds.size()) {}
+    ~SubstitutionScope() {
+        while (fds_.size() > mark_) {
+            closeSharedFd(fds_.back());
+            fds_.pop_back();
+        }
+    }
 
-        if (first_word == "if" && depth > 0) { ++depth; }
-        else if (first_word == "fi" && depth > 0) { --depth; }
+    SubstitutionScope(const SubstitutionScope&) = delete;
+    SubstitutionScope& operator=(const SubstitutionScope&) = delete;
+
+private:
+    std::vector<int>& fds_;
+    size_t mark_;
+};
+
+int Shell::execNode(const AstNode* node) {
+    if (!node) return state.last_exit_status;
+    SubstitutionScope substitutions(substitution_fds_);
+
+    // Compound commands carry their own redirections ("done < file")
+    std::unique_ptr<ScopedRedirect> redirect;
+    if (node->redirects && node->kind != NodeKind::SIMPLE) {
+        Command expanded;
+        expandRedirections(*node->redirects, expanded);
+        redirect = std::make_unique<ScopedRedirect>(expanded);
+        if (!redirect->ok()) return setStatus(1);
+    }
 
-        if (depth > 0) {
-            if (in_body) body_acc.push_back(line);
-            else if (in_else) else_body.push_back(line);
-            continue;
+    switch (node->kind) {
+        case NodeKind::SIMPLE:
+            execSimple(static_cast<const SimpleCommandNode&>(*node), false);
+            state.pipe_status.assign(1, state.last_exit_status);
+            checkErrexit();
+            break;
+        case NodeKind::PIPELINE: {
+            const auto& pipeline = static_cast<const PipelineNode&>(*node);
+            execPipeline(pipeline, false);
+            if (!pipeline.negate) checkErrexit();
+            break;
+        }
+        case NodeKind::AND_OR:
+            execAndOr(static_cast<const AndOrNode&>(*node));
+            break;
+        case NodeKind::LIST:
+            execList(static_cast<const ListNode&>(*node));
+            break;
+        case NodeKind::IF:
+            execIf(static_cast<const IfNode&>(*node));
+            break;
+        case NodeKind::LOOP:
+            execLoop(static_cast<const LoopNode&>(*node));
+            break;
+        case NodeKind::FOR:
+            execFor(static_cast<const ForNode&>(*node));
+            break;
+        case NodeKind::CASE:
+            execCase(static_cast<const CaseNode&>(*node));
+            break;
+        case NodeKind::GROUP:
+            execNode(static_cast<const GroupNode&>(*node).body.get());
+            break;
+        case NodeKind::SUBSHELL:
+            execSubshell(static_cast<const GroupNode&>(*node));
+            checkErrexit();
+            break;
+        case NodeKind::COPROC:
+            execCoproc(static_cast<const CoprocNode&>(*node));
+            break;
+        case NodeKind::FUNCTION_DEF: {
+            const auto& def = static_cast<const FunctionDefNode&>(*node);
+            ShellFunction& fn = state.functions[def.name];
+            fn.name = def.name;
+            fn.body = def.body;  // Shares the compiled subtree; no re-parse per call
+            fn.text = def.body_text;
+            setStatus(0);
+            break;
         }
+    }
+    return state.last_exit_status;
+}
 
-        if (first_word == "if" && depth == 0 && !in_body) {
-            // Extract condition after "if " and before "then" or ";"
-            std::string rest = (sp == std::string::npos) ? "" : line.substr(sp + 1);
-            // strip leading/trailing whitespace from rest
-            size_t ts = rest.find_first_not_of(" \t");
-            if (ts != std::string::npos) rest = rest.substr(ts);
-            // remove trailing ; then
-            size_t semi = rest.rfind(';');
-            if (semi != std::string::npos) rest = rest.substr(0, semi);
-            // remove "then" suffix
-            if (rest.size() >= 4 && rest.substr(rest.size() - 4) == "then") {
-                rest = rest.substr(0, rest.size() - 4);
-            }
-            cond_acc = trimWhitespace(rest);
-            in_body = true;
-            continue;
+int Shell::execList(const ListNode& list) {
+    for (const auto& item : list.items) {
+        if (item.background) {
+            execInBackground(*item.node);
+            // Scripts never reach the prompt's notification pass; keep the
+            // SIGCHLD ring from filling up behind a long run of & jobs
+            if (job_manager) job_manager->reapPending();
+        } else {
+            execNode(item.node.get());
         }
-        if (first_word == "then") {
-            in_body = true;
-            // Handle "then cmd" inline
-            if (sp != std::string::npos) {
-                std::string rest = trimWhitespace(line.substr(sp + 1));
-                if (!rest.empty() && rest != "fi" && rest != "else") body_acc.push_back(rest);
-            }
-            continue;
+        if (!coprocs_.empty()) reapCoprocs();
+        if (interrupted()) break;
+    }
+    return state.last_exit_status;
+}
+
+int Shell::execAndOr(const AndOrNode& node) {
+    // Only the last pipeline of the chain can trigger set -e
+    auto runLink = [this](const AstNode* link, bool last) {
+        if (!last) ++condition_depth_;
+        execNode(link);
+        if (!last) --condition_depth_;
+    };
+
+    runLink(node.first.get(), node.rest.empty());
+    for (size_t i = 0; i < node.rest.size(); ++i) {
+        if (interrupted()) break;
+        const auto& link = node.rest[i];
+        bool ok = state.last_exit_status == 0;
+        if (link.is_and != ok) continue;
+        runLink(link.node.get(), i + 1 == node.rest.size());
+    }
+    return state.last_exit_status;
+}
+
+int Shell::execInBackground(const AstNode& node) {
+    SubstitutionScope substitutions(substitution_fds_);
+    if (node.kind == NodeKind::SIMPLE) {
+        return execSimple(static_cast<const SimpleCommandNode&>(node), true);
+    }
+    if (node.kind == NodeKind::PIPELINE) {
+        return execPipeline(static_cast<const PipelineNode&>(node), true);
+    }
+
+    // Compound command: evaluate it in a forked copy of the shell
+    std::cout.flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+        return setStatus(1);
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        execNode(&node);
+        exitChild(state.last_exit_status);
+    }
+    setpgid(pid, pid);
+    std::cout << "[Background job started with PID " << pid << "]\n";
+    state.last_background_pid = pid;
+    if (job_manager) job_manager->addJob(pid, "(compound command)");
+    return setStatus(0);
+}
+
+int Shell::execSubshell(const GroupNode& node) {
+    sigset_t saved;
+    pid_t pid = forkBlockingSigchld(saved);
+    if (pid == -1) {
+        std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+        return setStatus(1);
+    }
+    if (pid == 0) {
+        execNode(node.body.get());
+        exitChild(state.last_exit_status);
+    }
+    return setStatus(waitForChild(pid, saved));
+}
+
+// ── Coprocesses ───────────────────────────────────────────────────────────────
+
+// coproc [NAME] command: the command runs as a background job on two pipes;
+// ${NAME[0]} reads its stdout and ${NAME[1]} writes its stdin for as long as
+// it runs, so a helper (bc, jq, a database client) is started once per
+// script instead of once per question
+int Shell::execCoproc(const CoprocNode& node) {
+    reapCoprocs();
+    for (auto it = coprocs_.begin(); it != coprocs_.end(); ++it) {
+        if (it->name != node.name) continue;
+        if (it->read_fd != -1 || it->write_fd != -1) {
+            std::cerr << "helix: warning: coproc [" << it->pid << ":" << it->name << "] still exists\n";
         }
-        if (first_word == "elif") {
-            // save previous clause
-            clauses.push_back({cond_acc, body_acc, false});
-            body_acc.clear();
-            std::string rest = line.substr(4);
-            size_t ts2 = rest.find_first_not_of(" \t");
-            if (ts2 != std::string::npos) rest = rest.substr(ts2);
-            size_t semi = rest.rfind(';');
-            if (semi != std::string::npos) rest = rest.substr(0, semi);
-            if (rest.size() >= 4 && rest.substr(rest.size() - 4) == "then")
-                rest = rest.substr(0, rest.size() - 4);
-            cond_acc = trimWhitespace(rest);
-            in_body = true;
+        if (it->read_fd != -1) closeSharedFd(it->read_fd);
+        if (it->write_fd != -1) closeSharedFd(it->write_fd);
+        coprocs_.erase(it);
+        break;
+    }
+
+    int to_child[2], from_child[2];
+    if (!makeCloexecPipe(to_child)) {
+        std::cerr << "helix: pipe failed: " << strerror(errno) << "\n";
+        return setStatus(1);
+    }
+    if (!makeCloexecPipe(from_child)) {
+        std::cerr << "helix: pipe failed: " << strerror(errno) << "\n";
+        close(to_child[0]);
+        close(to_child[1]);
+        return setStatus(1);
+    }
+
+    std::cout.flush();
+    std::cerr.flush();
+    pid_t pid = fork();
+    if (pid == -1) {
+        std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+        for (int fd : {to_child[0], to_child[1], from_child[0], from_child[1]}) close(fd);
+        return setStatus(1);
+    }
+    if (pid == 0) {
+        setpgid(0, 0);
+        // Other coprocesses' and substitutions' ends would keep their pipes open
+        closeSharedFds();
+        coprocs_.clear();
+        substitution_fds_.clear();
+        dup2(to_child[0], STDIN_FILENO);
+        dup2(from_child[1], STDOUT_FILENO);
+        for (int fd : {to_child[0], to_child[1], from_child[0], from_child[1]}) close(fd);
+        std::cout.rdbuf(stdout_buf_);
+        execNode(node.body.get());
+        exitChild(state.last_exit_status);
+    }
+    setpgid(pid, pid);
+    close(to_child[0]);
+    close(from_child[1]);
+
+    // Above 9, out of the way of the script's redirections, as bash does
+    Coproc coproc{node.name, pid, fcntl(from_child[0], F_DUPFD_CLOEXEC, 10),
+                  fcntl(to_child[1], F_DUPFD_CLOEXEC, 10)};
+    close(from_child[0]);
+    close(to_child[1]);
+    for (int fd : {coproc.read_fd, coproc.write_fd}) {
+        if (fd != -1) shareFd(fd, false);
+    }
+
+    VariableStore& vars = VariableStore::global();
+    vars.unset(node.name);
+    if (ShellArray* fds = vars.makeArray(node.name, false)) {
+        fds->indexed.set(0, std::to_string(coproc.read_fd));
+        fds->indexed.set(1, std::to_string(coproc.write_fd));
+    }
+    vars.set(node.name + "_PID", std::to_string(pid));
+    coprocs_.push_back(std::move(coproc));
+
+    if (options_.interactive) std::cout << "[Coprocess " << node.name << " started with PID " << pid << "]\n";
+    state.last_background_pid = pid;
+    if (job_manager) job_manager->addJob(pid, "coproc " + node.name + " " + node.text);
+    return setStatus(0);
+}
+
+void Shell::reapCoprocs() {
+    if (!job_manager) return;
+    job_manager->reapPending();
+    const auto& jobs = job_manager->getJobs();
+    for (auto it = coprocs_.begin(); it != coprocs_.end();) {
+        auto job = jobs.find(job_manager->findJob(it->pid));
+        if (job != jobs.end() &&
+            (job->second.status == JobStatus::RUNNING || job->second.status == JobStatus::STOPPED)) {
+            ++it;
             continue;
         }
-        if (first_word == "else") {
-            clauses.push_back({cond_acc, body_acc, false});
-            body_acc.clear();
-            in_else = true; in_body = false;
+        if (it->write_fd != -1) {
+            closeSharedFd(it->write_fd);
+            it->write_fd = -1;
+        }
+        // What it wrote before exiting is still there to be read
+        int queued = 0;
+        if (it->read_fd != -1 && ioctl(it->read_fd, FIONREAD, &queued) == 0 && queued > 0) {
+            ++it;
             continue;
         }
-        if (first_word == "fi") {
-            if (in_else) {
-                // nothing else to do
-            } else {
-                clauses.push_back({cond_acc, body_acc, false});
-            }
-            break;
+        if (it->read_fd != -1) {
+            closeSharedFd(it->read_fd);
+            it->read_fd = -1;
+            VariableStore::global().unset(it->name);
         }
-
-        if (in_body)  body_acc.push_back(line);
-        else if (in_else) else_body.push_back(line);
-        else cond_acc += " " + line;
+        // NAME_PID lasts until the job is collected: kill $P; wait $P
+        if (job != jobs.end()) {
+            ++it;
+            continue;
+        }
+        VariableStore::global().unset(it->name + "_PID");
+        it = coprocs_.erase(it);
     }
+}
 
-    // Execute
-    for (const auto& clause : clauses) {
-        if (clause.cond.empty()) continue;
-        runSingleCommand(clause.cond);
-        if (state.last_exit_status == 0) {
-            runBlock(clause.body);
-            return state.last_exit_status;
+// ── Simple commands and pipelines ─────────────────────────────────────────────
+
+void Shell::expandRedirections(const Command& raw, Command& out) {
+    out.redirections.clear();
+    for (const auto& r : raw.redirections) {
+        out.redirections.push_back({r.kind, {}, {}});
+        Redirection& e = out.redirections.back();
+        if (r.isHeredoc()) {
+            // A quoted delimiter (<<'EOF') keeps the body literal
+            e.target = r.target;
+            e.body = r.target.find_first_of("'\"\\") == std::string::npos
+                ? expander.expandWithState(r.body, &state) : r.body;
+        } else if (!r.target.empty()) {
+            e.target = expander.expandString(r.target, &state);
         }
     }
-    if (!else_body.empty()) runBlock(else_body);
-    return state.last_exit_status;
 }
 
-// ── While/until loop ──────────────────────────────────────────────────────────
-
-int Shell::executeWhile(const std::vector<std::string>& lines, bool until) {
-    // lines[0]: "while condition" / "until condition"
-    // body between do/done
-    std::string cond;
-    std::vector<std::string> body;
-    bool in_cond = true;
-    bool in_body = false;
-
-    for (const auto& raw : lines) {
-        std::string line = trimWhitespace(raw);
-        if (line.empty() || line[0] == '#') continue;
-        std::string first;
-        size_t sp = line.find_first_of(" \t;");
-        first = (sp == std::string::npos) ? line : line.substr(0, sp);
-
-        if ((first == "while" || first == "until") && in_cond && cond.empty()) {
-            std::string rest = sp == std::string::npos ? "" : line.substr(sp + 1);
-            size_t ts = rest.find_first_not_of(" \t");
-            if (ts != std::string::npos) rest = rest.substr(ts);
-            size_t semi = rest.rfind(';');
-            if (semi != std::string::npos) rest = rest.substr(0, semi);
-            if (rest.size() >= 2 && rest.substr(rest.size() - 2) == "do")
-                rest = rest.substr(0, rest.size() - 2);
-            cond = trimWhitespace(rest);
-            continue;
+bool Shell::expandSimple(const SimpleCommandNode& node, Command& out) {
+    Tracer::Span trace_expand("expand", node.text);
+    expandRedirections(node.command, out);
+    out.args.clear();
+    const auto& words = node.command.args;
+    if (!words.empty() && words[0] == "[[") {
+        // No field splitting or globbing inside [[ ]]; the right side of
+        // ==, = and != is a pattern, its quoted characters literal
+        for (size_t i = 0; i < words.size(); ++i) {
+            bool pattern = i > 0 && (words[i - 1] == "==" || words[i - 1] == "=" || words[i - 1] == "!=");
+            out.args.push_back(pattern ? expander.expandPattern(words[i], &state)
+                                       : expander.expandString(words[i], &state));
         }
-        if (first == "do") {
-            in_cond = false; in_body = true;
-            // inline body after do
-            if (sp != std::string::npos) {
-                std::string rest = trimWhitespace(line.substr(sp + 1));
-                if (!rest.empty() && rest != "done") body.push_back(rest);
+    } else if (!words.empty() && isDeclarationBuiltin(words[0])) {
+        // declare a=(...): the builtin sees the name, runSimple assigns the list
+        AssignmentWord parts;
+        for (const auto& word : words) {
+            if (splitAssignment(word, parts) && parts.compound && !parts.has_subscript) {
+                out.args.emplace_back(parts.name);
+            } else {
+                expander.expandWordInto(word, &state, out.args);
             }
-            continue;
         }
-        if (first == "done") break;
-        if (in_cond) { cond += " " + line; continue; }
-        if (in_body) body.push_back(line);
+    } else {
+        for (const auto& word : words) expander.expandWordInto(word, &state, out.args);
     }
+    out.background = false;
+    out.pre_expanded = true;
+    return true;
+}
 
-    while (state.running) {
-        if (!cond.empty()) {
-            runSingleCommand(cond);
+// CommandLease - borrows a ParsedCommand from Shell::command_pool_ for one
+// execution and hands it back (capacity intact) when the command finishes;
+// nested executions (functions, substitutions) each take their own
+class CommandLease {
+public:
+    CommandLease(std::vector<ParsedCommand>& pool, size_t commands) : pool_(pool) {
+        if (!pool_.empty()) {
+            parsed_ = std::move(pool_.back());
+            pool_.pop_back();
         }
-        bool cond_ok = (state.last_exit_status == 0);
-        if (until ? cond_ok : !cond_ok) break;
+        parsed_.pipeline.commands.resize(commands);
+        parsed_.background = false;
+    }
+    ~CommandLease() { pool_.push_back(std::move(parsed_)); }
 
-        runBlock(body);
+    CommandLease(const CommandLease&) = delete;
+    CommandLease& operator=(const CommandLease&) = delete;
 
-        if (state.breaking) {
-            --state.break_depth;
-            state.breaking = (state.break_depth > 0);
-            break;
+    ParsedCommand& get() { return parsed_; }
+
+private:
+    std::vector<ParsedCommand>& pool_;
+    ParsedCommand parsed_;
+};
+
+int Shell::execSimple(const SimpleCommandNode& node, bool background) {
+    if (state.noexec) return state.last_exit_status;
+
+    substituted_ = false;
+    CommandLease lease(command_pool_, 1);
+    ParsedCommand& parsed = lease.get();
+    expandSimple(node, parsed.pipeline.commands[0]);
+    return runSimple(node, parsed, background);
+}
+
+// Everything after word expansion: assignments, then function, builtin or
+// program; parsed holds the expanded command
+int Shell::runSimple(const SimpleCommandNode& node, ParsedCommand& parsed, bool background) {
+    Command& cmd = parsed.pipeline.commands[0];
+    AssignmentWord parts;
+    for (const auto& word : node.assignments) {
+        splitAssignment(word, parts);
+        if (state.readonly_vars.count(std::string(parts.name))) {
+            std::cerr << parts.name << ": readonly variable\n";
+            return setStatus(1);
         }
-        if (state.continuing) {
-            --state.continue_depth;
-            state.continuing = (state.continue_depth > 0);
-            if (state.continuing) break;
-            // continue this loop
+    }
+
+    // Bare assignments (and/or redirections): update the shell's variables,
+    // left to right
+    if (cmd.args.empty()) {
+        bool assigned = true;
+        for (const auto& word : node.assignments) assigned = assignWord(word) && assigned;
+        state.pipe_usage.assign(1, ResourceUsage{});
+        ScopedRedirect redirect(cmd);
+        if (!redirect.ok() || !assigned) return setStatus(1);
+        return setStatus(substituted_ ? state.last_exit_status : 0);
+    }
+
+    if (state.xtrace) {
+        std::cerr << "+";
+        for (const auto& a : cmd.args) std::cerr << " " << a;
+        std::cerr << "\n";
+    }
+
+    // Prefix assignments only last for this command, and are exported to it
+    VariableStore& vars = VariableStore::global();
+    std::vector<std::pair<std::string, std::optional<VariableStore::Variable>>> saved;
+    for (const auto& word : node.assignments) {
+        splitAssignment(word, parts);
+        std::string var_name(parts.name);
+        saved.emplace_back(var_name, vars.save(var_name));
+        if (parts.compound || parts.has_subscript) {
+            assignWord(word);  // Arrays are not exported
             continue;
         }
-        if (state.returning) break;
+        std::string value = expander.expandString(std::string(parts.value), &state);
+        if (parts.append) {
+            if (const std::string* old = vars.find(var_name)) value.insert(0, *old);
+        }
+        vars.set(var_name, std::move(value), true);
     }
-    return state.last_exit_status;
-}
+    state.pipe_usage.assign(1, ResourceUsage{});
+    auto restore = [&saved, &vars]() {
+        for (auto it = saved.rbegin(); it != saved.rend(); ++it) {
+            vars.restore(it->first, std::move(it->second));
+        }
+    };
 
-// ── For loop ──────────────────────────────────────────────────────────────────
-
-int Shell::executeFor(const std::vector<std::string>& lines) {
-    // "for VAR in word1 word2 ...; do ... done"
-    std::string varname;
-    std::vector<std::string> words;
-    std::vector<std::string> body;
-    bool in_body = false;
-
-    for (const auto& raw : lines) {
-        std::string line = trimWhitespace(raw);
-        if (line.empty() || line[0] == '#') continue;
-        std::string first;
-        size_t sp = line.find_first_of(" \t;");
-        first = (sp == std::string::npos) ? line : line.substr(0, sp);
-
-        if (first == "for" && varname.empty()) {
-            // for VAR in w1 w2 ...
-            std::string rest = sp == std::string::npos ? "" : trimWhitespace(line.substr(sp + 1));
-            size_t sp2 = rest.find_first_of(" \t");
-            varname = sp2 == std::string::npos ? rest : rest.substr(0, sp2);
-            rest = sp2 == std::string::npos ? "" : trimWhitespace(rest.substr(sp2 + 1));
-            // strip "in "
-            if (rest.size() >= 3 && rest.substr(0, 3) == "in ") rest = trimWhitespace(rest.substr(3));
-            // strip trailing "; do" or "do"
-            size_t semi = rest.rfind(';');
-            if (semi != std::string::npos) rest = trimWhitespace(rest.substr(0, semi));
-            if (rest.size() >= 2 && rest.substr(rest.size() - 2) == "do")
-                rest = trimWhitespace(rest.substr(0, rest.size() - 2));
-            // Split words
-            std::istringstream iss(rest);
-            std::string w;
-            while (iss >> w) words.push_back(w);
-            continue;
+    const std::string& name = cmd.args[0];
+    int status = 0;
+    ResourceUsage usage;  // A program's, from wait4(); shell code has none
+
+    if (state.functions.count(name)) {
+        // $1..$n are moved, not copied; args[0] stays for the lookup
+        std::vector<std::string> call_args(std::make_move_iterator(cmd.args.begin() + 1),
+                                           std::make_move_iterator(cmd.args.end()));
+        if (background) {
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid == 0) {
+                setpgid(0, 0);
+                ScopedRedirect redirect(cmd);
+                if (redirect.ok()) invokeFunction(name, std::move(call_args));
+                exitChild(state.last_exit_status);
+            }
+            if (pid > 0) {
+                setpgid(pid, pid);
+                std::cout << "[Background job started with PID " << pid << "]\n";
+                state.last_background_pid = pid;
+                if (job_manager) job_manager->addJob(pid, node.text);
+            }
+            status = pid > 0 ? 0 : 1;
+        } else {
+            Tracer::Span trace_function("function", name);
+            ScopedRedirect redirect(cmd);
+            if (redirect.ok()) {
+                invokeFunction(name, std::move(call_args));
+                status = state.last_exit_status;
+            } else {
+                status = 1;
+            }
         }
-        if (first == "do") {
-            in_body = true;
-            // "do cmd" on same line
-            if (sp != std::string::npos) {
-                std::string rest = trimWhitespace(line.substr(sp + 1));
-                if (!rest.empty() && rest != "done") body.push_back(rest);
+    } else if (builtin_dispatcher->isBuiltin(name)) {
+        parsed.pipeline.original_command = node.text;
+        // Handlers only record failures; exit and return read the old status
+        if (name != "exit" && name != "return") state.last_exit_status = 0;
+        {
+            Tracer::Span trace_builtin("builtin", name);
+            // The handler's return value only says whether the REPL should
+            // keep going (exit, return, break); the status lives in state
+            const builtins::Entry* entry = builtins::find(name);
+            if (hasRedirections(cmd) && entry && builtins::streamsOnly(entry->handler) &&
+                BuiltinOutput::handles(cmd)) {
+                // Output to files goes straight to them; fds 1 and 2 stay put
+                BuiltinOutput output(cmd);
+                if (output.ok()) builtin_dispatcher->dispatch(parsed, state);
+                else state.last_exit_status = 1;
+                if (!output.finish() && output.ok()) {
+                    std::cerr << "helix: " << name << ": write error: " << strerror(errno) << "\n";
+                    state.last_exit_status = 1;
+                }
+            } else {
+                ScopedRedirect redirect(cmd);
+                if (redirect.ok()) builtin_dispatcher->dispatch(parsed, state);
+                else state.last_exit_status = 1;
             }
-            continue;
         }
-        if (first == "done") break;
-        if (!in_body && varname.empty()) continue;
-        if (!in_body) { continue; }
-        body.push_back(line);
-    }
+        if (isDeclarationBuiltin(name) && state.last_exit_status == 0) {
+            // Lists go to the variables the builtin has just declared (local,
+            // declare -A ...), so they take its scope and kind
+            for (const auto& word : node.command.args) {
+                if (!splitAssignment(word, parts) || !parts.compound || parts.has_subscript) continue;
+                if (state.readonly_vars.count(std::string(parts.name)) && name != "readonly") {
+                    std::cerr << parts.name << ": readonly variable\n";
+                    state.last_exit_status = 1;
+                } else if (!assignWord(word)) {
+                    state.last_exit_status = 1;
+                }
+            }
+        }
+        status = state.last_exit_status;
+        restore();
+        saved.clear();
+        setStatus(status);
+        runDeferredBuiltinWork();
+        return state.last_exit_status;
+    } else {
+        cmd.background = background;
+        parsed.pipeline.original_command = node.text;
+        parsed.background = background;
+        std::cout.flush();  // Builtin output must precede the child's
+        if (!background && (&node == stage_command_ || (&node == final_command_ && canExecInPlace()))) {
+            // Returns only if the program cannot take over the process
+            std::fflush(stdout);
+            executor.execInPlace(cmd);
+        }
+        status = executor.execute(parsed);
+        if (!executor.getLastPipeUsage().empty()) usage = executor.getLastPipeUsage().front();
 
-    // Expand each word (glob, env)
-    EnvironmentVariableExpander expander;
-    std::vector<std::string> expanded_words;
-    for (const auto& w : words) {
-        std::string ew = expander.expandWithState(w, &state);
-        auto be = braceExpand(ew);
-        for (const auto& b : be) expanded_words.push_back(b);
+        pid_t bg_pid = executor.getLastBackgroundPid();
+        if (bg_pid > 0) {
+            state.last_background_pid = bg_pid;
+            if (job_manager) job_manager->addJob(bg_pid, node.text);
+        }
     }
 
-    for (const auto& val : expanded_words) {
-        setenv(varname.c_str(), val.c_str(), 1);
-        state.environment[varname] = val;
-
-        runBlock(body);
+    restore();
+    state.pipe_usage.assign(1, usage);
+    return setStatus(status);
+}
 
-        if (state.breaking) {
-            --state.break_depth;
-            state.breaking = (state.break_depth > 0);
-            break;
-        }
-        if (state.continuing) {
-            --state.continue_depth;
-            state.continuing = (state.continue_depth > 0);
-            if (state.continuing) break;
+// ── time ─────────────────────────────────────────────────────────────────────
+
+namespace {
+
+// Wall clock plus the CPU time of this process and of every child it has
+// waited for; `time` reports the difference of two samples
+struct TimeSample {
+    std::chrono::steady_clock::time_point wall;
+    long long user_us = 0;
+    long long sys_us = 0;
+
+    static TimeSample take() {
+        TimeSample s;
+        s.wall = std::chrono::steady_clock::now();
+        for (int who : {RUSAGE_SELF, RUSAGE_CHILDREN}) {
+            struct rusage ru;
+            if (getrusage(who, &ru) != 0) continue;
+            ResourceUsage u = ResourceUsage::from(ru);
+            s.user_us += u.user_us;
+            s.sys_us += u.sys_us;
         }
-        if (state.returning || !state.running) break;
+        return s;
     }
-    return state.last_exit_status;
+};
+
+// One TIMEFORMAT-style conversion: %[p][l]R|U|S with p digits (default 3)
+// after the point; l gives "1m2.345s" instead of "62.345"
+std::string formatSeconds(long long us, int precision, bool longform) {
+    long long scale = 1;
+    for (int i = precision; i < 6; ++i) scale *= 10;
+    long long units = us / scale;  // Truncated, as bash does
+    long long per_second = 1000000 / scale;
+    long long whole = units / per_second;
+    std::string out;
+    if (longform) {
+        out = std::to_string(whole / 60) + "m";
+        whole %= 60;
+    }
+    out += std::to_string(whole);
+    if (precision > 0) {
+        std::string frac = std::to_string(units % per_second);
+        out += "." + std::string(static_cast<size_t>(precision) - frac.size(), '0') + frac;
+    }
+    if (longform) out += "s";
+    return out;
 }
 
-// ── Case/esac ─────────────────────────────────────────────────────────────────
-
-int Shell::executeCase(const std::vector<std::string>& lines) {
-    // "case WORD in"
-    // "pattern1|pattern2) body ;;"
-    // "esac"
-    std::string word;
-    bool in_body = false;
-    std::string cur_pattern;
-    std::vector<std::string> cur_body;
-    bool matched = false;
-
-    EnvironmentVariableExpander expander;
-
-    for (const auto& raw : lines) {
-        std::string line = trimWhitespace(raw);
-        if (line.empty() || line[0] == '#') continue;
-        std::string first;
-        size_t sp = line.find_first_of(" \t");
-        first = (sp == std::string::npos) ? line : line.substr(0, sp);
-
-        if (first == "case" && word.empty()) {
-            std::string rest = sp == std::string::npos ? "" : trimWhitespace(line.substr(sp + 1));
-            // strip " in"
-            if (rest.size() >= 3 && rest.substr(rest.size() - 3) == " in")
-                rest = trimWhitespace(rest.substr(0, rest.size() - 3));
-            else if (rest.size() >= 2 && rest.substr(rest.size() - 2) == "in")
-                rest = trimWhitespace(rest.substr(0, rest.size() - 2));
-            word = expander.expandWithState(rest, &state);
-            in_body = false;
+// Expand a TIMEFORMAT string, as in bash: %R %U %S, %P (CPU percentage)
+// and %%; anything else is copied
+std::string formatTimes(const std::string& format, long long real_us, long long user_us, long long sys_us) {
+    std::string out;
+    for (size_t i = 0; i < format.size(); ++i) {
+        if (format[i] != '%' || i + 1 == format.size()) {
+            out += format[i];
             continue;
         }
-        if (line == "esac") break;
-
-        if (!in_body) {
-            // Expect "pattern)" line
-            size_t paren = line.find(')');
-            if (paren == std::string::npos) continue;
-            cur_pattern = trimWhitespace(line.substr(0, paren));
-            in_body = true;
-            cur_body.clear();
-            // Handle single-line: "pattern) cmd ;;"
-            std::string rest = trimWhitespace(line.substr(paren + 1));
-            if (rest == ";;") { in_body = false; }
-            else if (!rest.empty()) {
-                if (rest.size() >= 2 && rest.substr(rest.size() - 2) == ";;") {
-                    cur_body.push_back(rest.substr(0, rest.size() - 2));
-                    in_body = false;
-                } else {
-                    cur_body.push_back(rest);
-                }
-            }
+        size_t j = i + 1;
+        if (format[j] == '%') {
+            out += '%';
+            i = j;
+            continue;
+        }
+        if (format[j] == 'P') {
+            char buf[32];
+            double pct = real_us > 0 ? 100.0 * static_cast<double>(user_us + sys_us) / static_cast<double>(real_us) : 0.0;
+            std::snprintf(buf, sizeof buf, "%.2f", pct);
+            out += buf;
+            i = j;
+            continue;
+        }
+        int precision = 3;
+        if (std::isdigit(static_cast<unsigned char>(format[j]))) precision = std::min(format[j++] - '0', 6);
+        bool longform = j < format.size() && format[j] == 'l';
+        if (longform) ++j;
+        if (j < format.size() && (format[j] == 'R' || format[j] == 'U' || format[j] == 'S')) {
+            long long us = format[j] == 'R' ? real_us : format[j] == 'U' ? user_us : sys_us;
+            out += formatSeconds(us, precision, longform);
+            i = j;
         } else {
-            if (line == ";;" || (line.size() >= 2 && line.substr(line.size() - 2) == ";;")) {
-                if (line != ";;") cur_body.push_back(line.substr(0, line.size() - 2));
-                in_body = false;
+            out += format[i];
+        }
+    }
+    return out;
+}
+
+// `time`: print what the pipeline took since before, per TIMEFORMAT (or
+// POSIX format for -p), then one line per stage for -v
+void reportTime(const PipelineNode& node, const TimeSample& before, const ShellState& state) {
+    TimeSample after = TimeSample::take();
+    long long real_us = std::chrono::duration_cast<std::chrono::microseconds>(after.wall - before.wall).count();
+    long long user_us = after.user_us - before.user_us;
+    long long sys_us = after.sys_us - before.sys_us;
+
+    std::string format = "\nreal\t%3lR\nuser\t%3lU\nsys\t%3lS";
+    if (node.time_posix) {
+        format = "real %2R\nuser %2U\nsys %2S";
+    } else if (const std::string* custom = VariableStore::global().find("TIMEFORMAT")) {
+        format = *custom;
+    }
+    std::cout.flush();
+    if (!format.empty()) std::cerr << formatTimes(format, real_us, user_us, sys_us) << "\n";
+
+    // time -v: what each stage used, to find the slow one
+    if (!node.time_stages) return;
+    for (size_t i = 0; i < state.pipe_usage.size() && i < node.stages.size(); ++i) {
+        const ResourceUsage& u = state.pipe_usage[i];
+        const AstNode& stage = *node.stages[i];
+        std::cerr << "  " << i + 1 << ": status " << (i < state.pipe_status.size() ? state.pipe_status[i] : 0)
+                  << "  real " << formatSeconds(u.real_us, 3, false)
+                  << "  user " << formatSeconds(u.user_us, 3, false)
+                  << "  sys " << formatSeconds(u.sys_us, 3, false)
+                  << "  rss " << u.max_rss_kb << "K"
+                  << "  csw " << u.voluntary_switches << "/" << u.involuntary_switches
+                  << "  io " << u.blocks_in << "/" << u.blocks_out;
+        if (stage.kind == NodeKind::SIMPLE) std::cerr << "  " << static_cast<const SimpleCommandNode&>(stage).text;
+        std::cerr << "\n";
+    }
+}
+
+} // namespace
+
+int Shell::execPipeline(const PipelineNode& node, bool background) {
+    Tracer::Span trace_pipeline("pipeline", node.text);
+    std::optional<TimeSample> timer;
+    if (node.timed && !background) timer = TimeSample::take();
+
+    // ! and every stage but the last are exempt from set -e
+    if (node.negate) ++condition_depth_;
+
+    if (node.stages.empty()) {
+        // A bare `time`
+        state.pipe_status.assign(1, state.last_exit_status);
+        state.pipe_usage.assign(1, ResourceUsage{});
+    } else if (node.stages.size() == 1) {
+        execInStage(*node.stages[0], background);
+        state.pipe_status.assign(1, state.last_exit_status);
+        if (node.stages[0]->kind != NodeKind::SIMPLE) state.pipe_usage.assign(1, ResourceUsage{});
+    } else {
+        CommandLease lease(command_pool_, node.stages.size());
+        ParsedCommand& parsed = lease.get();
+        parsed.pipeline.original_command = node.text;
+        parsed.background = background;
+
+        // Builtins, functions and compound commands are shell code: their
+        // stages are forked copies of the shell that evaluate them without
+        // an exec; so are programs with prefix assignments, which runSimple()
+        // exports before the program replaces the stage. Everything else is
+        // spawned as usual
+        Executor::ShellStages stages;
+        stages.in_shell.assign(node.stages.size(), false);
+        bool any_in_shell = false;
+        for (size_t i = 0; i < node.stages.size(); ++i) {
+            const AstNode& stage = *node.stages[i];
+            Command& command = parsed.pipeline.commands[i];
+            if (stage.kind == NodeKind::SIMPLE) {
+                const auto& simple = static_cast<const SimpleCommandNode&>(stage);
+                expandSimple(simple, command);
+                stages.in_shell[i] = command.args.empty() || !simple.assignments.empty() ||
+                                     state.functions.count(command.args[0]) || builtins::isBuiltin(command.args[0]);
             } else {
-                cur_body.push_back(line);
+                command.args.clear();
+                command.redirections.clear();
+                stages.in_shell[i] = true;
             }
+            any_in_shell = any_in_shell || stages.in_shell[i];
         }
 
-        if (!in_body && !matched) {
-            // Check if word matches any pattern (| separated)
-            std::istringstream pss(cur_pattern);
-            std::string pat;
-            while (std::getline(pss, pat, '|')) {
-                pat = trimWhitespace(pat);
-                if (pat == "*" || fnmatch(pat.c_str(), word.c_str(), 0) == 0) {
-                    matched = true;
-                    runBlock(cur_body);
-                    break;
+        std::cout.flush();
+        if (any_in_shell) {
+            stages.run = [this, &node, &parsed](size_t i) {
+                if (node.stages[i]->kind == NodeKind::SIMPLE) {
+                    stage_command_ = static_cast<const SimpleCommandNode*>(node.stages[i].get());
                 }
+                runPipelineStage(*node.stages[i], parsed.pipeline.commands[i]);
+                exitChild(state.last_exit_status);
+            };
+            // set -o lastpipe: a shell-code last stage runs in this process,
+            // so "producer | while read x; do ...; done" keeps its variables
+            if (state.lastpipe && !background && stages.in_shell.back()) {
+                stages.last = [this, &node, &parsed]() {
+                    std::cin.clear();
+                    return runPipelineStage(*node.stages.back(), parsed.pipeline.commands.back());
+                };
             }
         }
+        int status = any_in_shell ? executor.execute(parsed, stages) : executor.execute(parsed);
+        if (stages.last) {
+            // Drop whatever stdio buffered from the pipe
+            std::cin.clear();
+            discardStdinBuffer();
+        }
+        setStatus(status);
+        state.pipe_status = executor.getLastPipeStatus();
+        if (state.pipe_status.empty()) state.pipe_status.assign(1, state.last_exit_status);
+        state.pipe_usage = executor.getLastPipeUsage();
+        state.pipe_usage.resize(state.pipe_status.size());
+        pid_t bg_pid = executor.getLastBackgroundPid();
+        if (bg_pid > 0) {
+            // $! is the last stage; the job is the whole process group
+            const auto& pids = executor.getLastBackgroundPids();
+            state.last_background_pid = pids.back();
+            if (job_manager) job_manager->addJob(bg_pid, pids, node.text);
+        }
     }
+
+    if (node.negate) {
+        --condition_depth_;
+        setStatus(state.last_exit_status == 0 ? 1 : 0);
+    }
+    if (timer) reportTime(node, *timer, state);
     return state.last_exit_status;
 }
 
-// ── VAR=value assignment detection ────────────────────────────────────────────
-
-static bool isAssignment(const std::string& token) {
-    if (token.empty()) return false;
-    if (!std::isalpha((unsigned char)token[0]) && token[0] != '_') return false;
-    size_t eq = token.find('=');
-    if (eq == std::string::npos) return false;
-    for (size_t i = 0; i < eq; ++i) {
-        if (!std::isalnum((unsigned char)token[i]) && token[i] != '_') return false;
-    }
-    return true;
+// A single-stage pipeline ("! cmd") is just the command itself
+int Shell::execInStage(const AstNode& node, bool background) {
+    if (background) return execInBackground(node);
+    return execNode(&node);
 }
 
-// ── processInput / runSingleCommand ──────────────────────────────────────────
+// One shell-code stage of a pipeline, with stdin/stdout already on its
+// pipes; expanded is the simple command's words as the parent expanded them
+int Shell::runPipelineStage(const AstNode& stage, Command& expanded) {
+    if (stage.kind != NodeKind::SIMPLE) return execNode(&stage);
+    CommandLease lease(command_pool_, 1);
+    ParsedCommand& parsed = lease.get();
+    parsed.pipeline.commands[0] = std::move(expanded);
+    return runSimple(static_cast<const SimpleCommandNode&>(stage), parsed, false);
+}
 
-bool Shell::processInput(const std::string& input) {
-    if (input.empty()) return true;
+// ── Command substitution ──────────────────────────────────────────────────────
 
-    std::string expanded_hist = expandHistory(input);
-    if (expanded_hist.empty() && !input.empty() && (input[0] == '!' || input[0] == '^')) return true;
-    const std::string& effective = (input[0] == '!' || input[0] == '^') ? expanded_hist : input;
+// Builtins that only print: safe to run in the shell itself with stdout
+// captured, since they cannot change shell state a subshell would discard
+static bool isOutputOnlyBuiltin(const ListNode& program, const ShellState& state) {
+    if (program.items.size() != 1 || program.items[0].background) return false;
+    const AstNode* node = program.items[0].node.get();
+    if (node->kind != NodeKind::SIMPLE) return false;
+    const auto& simple = static_cast<const SimpleCommandNode&>(*node);
+    if (!simple.assignments.empty() || simple.command.args.empty() || hasRedirections(simple.command)) {
+        return false;
+    }
+    const std::string& name = simple.command.args[0];
+    const builtins::Entry* entry = builtins::find(name);
+    return entry && entry->output_only && !state.functions.count(name);
+}
 
-    // HISTCONTROL
-    bool skip_hist = false;
-    if (state.histcontrol == "ignoredups" && effective == state.last_histentry) skip_hist = true;
-    if (state.histcontrol == "erasedups") {
-        auto& h = state.command_history;
-        h.erase(std::remove(h.begin(), h.end(), effective), h.end());
+std::string Shell::capture(const std::string& source) {
+    auto result = script_parser.parse(source, &state.aliases);
+    if (result.status != ScriptParser::Status::OK) {
+        std::cerr << "helix: " << (result.error.empty() ? "syntax error: unexpected end of file" : result.error)
+                  << "\n";
+        setStatus(2);
+        return "";
     }
-    if (!skip_hist) {
-        state.command_history.push_back(effective);
-        session_history_.push_back(effective);
-        add_history(effective.c_str());
-        state.last_histentry = effective;
+
+    std::string output;
+    if (isOutputOnlyBuiltin(*result.program, state)) {
+        std::cout.flush();
+        std::ostringstream buffer;
+        std::streambuf* saved = std::cout.rdbuf(buffer.rdbuf());
+        execList(*result.program);
+        std::cout.rdbuf(saved);
+        output = std::move(buffer).str();
+    } else {
+        int fds[2];
+        if (!makeCloexecPipe(fds)) {
+            std::cerr << "helix: pipe failed: " << strerror(errno) << "\n";
+            setStatus(1);
+            return "";
+        }
+        sigset_t saved;
+        pid_t pid = forkBlockingSigchld(saved);
+        if (pid == -1) {
+            std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+            close(fds[0]);
+            close(fds[1]);
+            setStatus(1);
+            return "";
+        }
+        if (pid == 0) {
+            close(fds[0]);
+            dup2(fds[1], STDOUT_FILENO);
+            close(fds[1]);
+            // An enclosing in-process capture may have swapped std::cout's buffer
+            std::cout.rdbuf(stdout_buf_);
+            execList(*result.program);
+            exitChild(state.last_exit_status);
+        }
+        close(fds[1]);
+
+        // Read straight into the result, doubling the buffer as needed
+        constexpr size_t kInitialCapacity = 4096;
+        size_t used = 0;
+        output.resize(kInitialCapacity);
+        while (true) {
+            if (used == output.size()) output.resize(output.size() * 2);
+            ssize_t n = read(fds[0], output.data() + used, output.size() - used);
+            if (n > 0) used += static_cast<size_t>(n);
+            else if (n == 0 || errno != EINTR) break;
+        }
+        output.resize(used);
+        close(fds[0]);
+        setStatus(waitForChild(pid, saved));
     }
 
-    // ── Check if compound statement spans the full line (semicolon-separated) ──
-    // e.g. "X=0; while ...; do ...; done" — run prefix assignments then block
-    {
-        // Quick pre-scan: does effective contain a block opener AND closer?
-        auto hasWord = [&](const std::string& s, const std::string& w) {
-            size_t pos = s.find(w);
-            while (pos != std::string::npos) {
-                bool before_ok = (pos == 0 || !std::isalnum((unsigned char)s[pos-1]));
-                bool after_ok  = (pos + w.size() >= s.size() || !std::isalnum((unsigned char)s[pos + w.size()]));
-                if (before_ok && after_ok) return true;
-                pos = s.find(w, pos + 1);
-            }
-            return false;
-        };
-        bool has_for   = hasWord(effective, "for");
-        bool has_while = hasWord(effective, "while");
-        bool has_until = hasWord(effective, "until");
-        bool has_if    = hasWord(effective, "if");
-        bool has_case  = hasWord(effective, "case");
-        bool has_done  = hasWord(effective, "done");
-        bool has_fi    = hasWord(effective, "fi");
-        bool has_esac  = hasWord(effective, "esac");
-
-        bool needs_block = (has_for && has_done) || (has_while && has_done) ||
-                           (has_until && has_done) || (has_if && has_fi) ||
-                           (has_case && has_esac);
-
-        if (needs_block) {
-            // Split by semicolons into "lines" and execute as block
-            std::vector<std::string> seg_lines;
-            std::string seg;
-            bool in_sq = false, in_dq = false;
-            for (size_t ci = 0; ci <= effective.size(); ++ci) {
-                if (ci == effective.size()) {
-                    seg = trimWhitespace(seg);
-                    if (!seg.empty()) seg_lines.push_back(seg);
-                    break;
-                }
-                char ch = effective[ci];
-                if (ch == '\'' && !in_dq) { in_sq = !in_sq; seg += ch; continue; }
-                if (ch == '"' && !in_sq) { in_dq = !in_dq; seg += ch; continue; }
-                if (ch == ';' && !in_sq && !in_dq) {
-                    seg = trimWhitespace(seg);
-                    if (!seg.empty()) seg_lines.push_back(seg);
-                    seg.clear();
-                } else {
-                    seg += ch;
-                }
-            }
+    substituted_ = true;  // After execList(), which resets it for inner commands
+    while (!output.empty() && output.back() == '\n') output.pop_back();
+    return output;
+}
 
-            // Find the first block opener in seg_lines
-            size_t block_start = 0;
-            for (; block_start < seg_lines.size(); ++block_start) {
-                std::string fw;
-                size_t fsp = seg_lines[block_start].find_first_of(" \t;");
-                fw = fsp == std::string::npos ? seg_lines[block_start] : seg_lines[block_start].substr(0, fsp);
-                if (fw == "for" || fw == "while" || fw == "until" || fw == "if" || fw == "case") break;
-            }
+// ── Process substitution ───────────────────────────────────────────────────────
 
-            // Run prefix assignments/commands
-            for (size_t pi = 0; pi < block_start; ++pi) {
-                runSingleCommand(seg_lines[pi]);
-            }
+std::string Shell::substituteProcess(const std::string& source, bool output) {
+    auto result = script_parser.parse(source, &state.aliases);
+    if (result.status != ScriptParser::Status::OK) {
+        std::cerr << "helix: " << (result.error.empty() ? "syntax error: unexpected end of file" : result.error)
+                  << "\n";
+        setStatus(2);
+        return "";
+    }
 
-            // Execute the block
-            std::vector<std::string> block_only(seg_lines.begin() + block_start, seg_lines.end());
-            std::string opener_fw;
-            if (!block_only.empty()) {
-                size_t fsp = block_only[0].find_first_of(" \t;");
-                opener_fw = fsp == std::string::npos ? block_only[0] : block_only[0].substr(0, fsp);
-            }
-            if (opener_fw == "for") executeFor(block_only);
-            else if (opener_fw == "while") executeWhile(block_only, false);
-            else if (opener_fw == "until") executeWhile(block_only, true);
-            else if (opener_fw == "if") executeIf(block_only);
-            else if (opener_fw == "case") executeCase(block_only);
+    int fds[2];
+    if (!makeCloexecPipe(fds)) {
+        std::cerr << "helix: pipe failed: " << strerror(errno) << "\n";
+        setStatus(1);
+        return "";
+    }
+    // The command's end goes above 9, clear of the descriptors its own
+    // redirections use; the producer's end goes to its stdin or stdout
+    int ours = fcntl(output ? fds[1] : fds[0], F_DUPFD_CLOEXEC, 10);
+    int theirs = output ? fds[0] : fds[1];
+    close(output ? fds[1] : fds[0]);
+    if (ours == -1) {
+        std::cerr << "helix: pipe failed: " << strerror(errno) << "\n";
+        close(theirs);
+        setStatus(1);
+        return "";
+    }
 
-            return state.running;
-        }
+    sigset_t saved;
+    pid_t pid = forkBlockingSigchld(saved);
+    if (pid == -1) {
+        std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+        close(ours);
+        close(theirs);
+        setStatus(1);
+        return "";
+    }
+    if (pid == 0) {
+        // Earlier substitutions' ends would keep their pipes open
+        close(ours);
+        closeSharedFds();
+        substitution_fds_.clear();
+        dup2(theirs, output ? STDIN_FILENO : STDOUT_FILENO);
+        close(theirs);
+        std::cout.rdbuf(stdout_buf_);
+        execList(*result.program);
+        exitChild(state.last_exit_status);
     }
+    close(theirs);
+    // Runs alongside the command; the job manager only collects its exit
+    if (job_manager) job_manager->addHelper(pid);
+    sigprocmask(SIG_SETMASK, &saved, nullptr);
+
+    shareFd(ours);
+    substitution_fds_.push_back(ours);
+    return "/dev/fd/" + std::to_string(ours);
+}
 
-    // ── Multi-line block accumulation ────────────────────────────────────────
-    // Keywords that open blocks: if, while, until, for, case, { (function)
-    // Keywords that close them: fi, done, esac, }
+// eval and source queue work for the evaluator instead of running it
+void Shell::runDeferredBuiltinWork() {
+    if (!state.pending_command.empty()) {
+        std::string pending = std::move(state.pending_command);
+        state.pending_command.clear();
+        runSource(pending);
+    }
+    if (state.sourcing) {
+        state.sourcing = false;
+        std::string path = std::move(state.source_path);
+        state.source_path.clear();
+        sourceFile(path);
+    }
+}
 
-    std::string trimmed = trimWhitespace(effective);
+// ── Compound commands ─────────────────────────────────────────────────────────
 
-    // Check if we're already accumulating a block
-    if (!block_stack_.empty()) {
-        block_lines_.push_back(trimmed);
+// Consume one level of break/continue after a loop body.
+// Returns true if the enclosing loop has to stop.
+bool Shell::finishIteration() {
+    if (state.breaking) {
+        --state.break_depth;
+        state.breaking = (state.break_depth > 0);
+        return true;
+    }
+    if (state.continuing) {
+        --state.continue_depth;
+        state.continuing = (state.continue_depth > 0);
+        return state.continuing;
+    }
+    return state.returning || !state.running;
+}
 
-        // Check for keywords that increment nesting depth
-        std::string first;
-        size_t sp = trimmed.find_first_of(" \t;");
-        first = (sp == std::string::npos) ? trimmed : trimmed.substr(0, sp);
+int Shell::execIf(const IfNode& node) {
+    for (const auto& clause : node.clauses) {
+        ++condition_depth_;
+        execNode(clause.condition.get());
+        --condition_depth_;
+        if (interrupted()) return state.last_exit_status;
+        if (state.last_exit_status == 0) return execNode(clause.body.get());
+    }
+    if (node.else_body) return execNode(node.else_body.get());
+    return setStatus(0);
+}
 
-        if (first == "if" || first == "while" || first == "until" ||
-            first == "for" || first == "case") {
-            block_stack_.push_back(first);
-        }
-        if (first == "fi") {
-            if (!block_stack_.empty()) block_stack_.pop_back();
-            if (block_stack_.empty()) {
-                auto lines = block_lines_; block_lines_.clear();
-                executeIf(lines);
-                return state.running;
-            }
+int Shell::execLoop(const LoopNode& node) {
+    int status = 0;
+    while (state.running) {
+        ++condition_depth_;
+        execNode(node.condition.get());
+        --condition_depth_;
+        if (interrupted()) break;
+        bool ok = (state.last_exit_status == 0);
+        if (node.until ? ok : !ok) break;
+
+        execNode(node.body.get());
+        status = state.last_exit_status;
+        if (finishIteration()) break;
+    }
+    return setStatus(status);
+}
+
+int Shell::execFor(const ForNode& node) {
+    if (node.arithmetic) return execArithmeticFor(node);
+
+    // Words are all expanded before the first iteration; a range's terms
+    // are constant and made one at a time, at their place among them
+    std::vector<std::string> values;
+    std::vector<std::pair<size_t, const ForNode::Range*>> ranges;  // Values before each range
+    if (node.has_in) {
+        auto range = node.ranges.begin();
+        for (size_t w = 0; w <= node.words.size(); ++w) {
+            for (; range != node.ranges.end() && range->index == w; ++range) ranges.emplace_back(values.size(), &*range);
+            if (w == node.words.size()) break;
+            auto fields = expander.expandWord(node.words[w], &state);
+            for (auto& f : fields) values.push_back(std::move(f));
         }
-        if (first == "done") {
-            if (!block_stack_.empty()) {
-                std::string opener = block_stack_.back();
-                block_stack_.pop_back();
-                if (block_stack_.empty()) {
-                    auto lines = block_lines_; block_lines_.clear();
-                    if (opener == "for") executeFor(lines);
-                    else executeWhile(lines, opener == "until");
-                    return state.running;
-                }
-            }
+    } else {
+        values = state.positional_params;
+    }
+    if (!node.jobs.empty() && job_manager) {
+        // Every iteration is a job with its own output buffer anyway
+        for (auto it = ranges.rbegin(); it != ranges.rend(); ++it) {
+            auto terms = rangeTerms(*it->second);
+            values.insert(values.begin() + static_cast<std::ptrdiff_t>(it->first), terms.begin(), terms.end());
         }
-        if (first == "esac") {
-            if (!block_stack_.empty()) block_stack_.pop_back();
-            if (block_stack_.empty()) {
-                auto lines = block_lines_; block_lines_.clear();
-                executeCase(lines);
-                return state.running;
-            }
+        return execParallelFor(node, values);
+    }
+
+    int status = 0;
+    auto iterate = [&](const std::string& value) {
+        assignVariable(node.variable, value);
+        execNode(node.body.get());
+        status = state.last_exit_status;
+        return finishIteration();
+    };
+    size_t next = 0;
+    std::string term;
+    for (const auto& [before, range] : ranges) {
+        for (; next < before; ++next) {
+            if (iterate(values[next])) return setStatus(status);
         }
-        if (trimmed == "}") {
-            if (!block_stack_.empty()) block_stack_.pop_back();
-            if (block_stack_.empty()) {
-                // Function definition complete
-                auto lines = block_lines_; block_lines_.clear();
-                // lines[0] is "name() {" or "function name {", rest is body
-                if (!pending_func_name_.empty()) {
-                    ShellFunction fn;
-                    fn.name = pending_func_name_;
-                    fn.body.assign(lines.begin() + 1, lines.end());
-                    if (!fn.body.empty() && trimWhitespace(fn.body.back()) == "}")
-                        fn.body.pop_back();
-                    state.functions[fn.name] = fn;
-                    pending_func_name_.clear();
-                }
-                return state.running;
-            }
+        for (size_t k = 0; k < range->sequence.size(); ++k) {
+            term.assign(range->prefix);
+            range->sequence.append(k, term);
+            term += range->suffix;
+            if (iterate(term)) return setStatus(status);
         }
-        return true; // still accumulating
     }
+    for (; next < values.size(); ++next) {
+        if (iterate(values[next])) break;
+    }
+    return setStatus(status);
+}
 
-    // ── Detect block openers ─────────────────────────────────────────────────
-    {
-        std::string first;
-        size_t sp = trimmed.find_first_of(" \t;");
-        first = (sp == std::string::npos) ? trimmed : trimmed.substr(0, sp);
-
-        // Single-line for: "for x in ...; do ...; done"
-        if (first == "for" && trimmed.find("done") != std::string::npos) {
-            std::vector<std::string> lines;
-            std::string seg;
-            for (size_t ci = 0; ci <= trimmed.size(); ++ci) {
-                if (ci == trimmed.size() || trimmed[ci] == ';') {
-                    seg = trimWhitespace(seg);
-                    if (!seg.empty()) lines.push_back(seg);
-                    seg.clear();
-                } else {
-                    seg += trimmed[ci];
-                }
-            }
-            executeFor(lines);
-            return state.running;
-        }
-        // Single-line while/until: "while cond; do ...; done"
-        if ((first == "while" || first == "until") && trimmed.find("done") != std::string::npos) {
-            std::vector<std::string> lines;
-            std::string seg;
-            for (size_t ci = 0; ci <= trimmed.size(); ++ci) {
-                if (ci == trimmed.size() || trimmed[ci] == ';') {
-                    seg = trimWhitespace(seg);
-                    if (!seg.empty()) lines.push_back(seg);
-                    seg.clear();
-                } else {
-                    seg += trimmed[ci];
-                }
-            }
-            executeWhile(lines, first == "until");
-            return state.running;
+std::vector<std::string> Shell::rangeTerms(const ForNode::Range& range) {
+    std::vector<std::string> terms = range.sequence.materialize();
+    for (auto& term : terms) term = range.prefix + term + range.suffix;
+    return terms;
+}
+
+// for ((init; condition; update)) on the compiled ArithmeticEngine: each
+// part is compiled on its first evaluation and reused by every iteration.
+// An arithmetic error ends the loop with status 1
+int Shell::execArithmeticFor(const ForNode& node) {
+    ArithmeticEngine& arithmetic = ArithmeticEngine::global();
+    long value = 0;
+    auto evaluate = [&](const std::string& expr) {
+        return expr.find_first_not_of(" \t\n") == std::string::npos || arithmetic.evaluate(expr, &state, value);
+    };
+
+    value = 1;
+    if (!evaluate(node.init)) return setStatus(1);
+    int status = 0;
+    for (;;) {
+        value = 1;
+        if (!evaluate(node.condition)) return setStatus(1);
+        if (value == 0 || interrupted()) break;
+
+        execNode(node.body.get());
+        status = state.last_exit_status;
+        if (finishIteration()) break;
+        if (!evaluate(node.update)) return setStatus(1);
+    }
+    return setStatus(status);
+}
+
+// Copy what an iteration wrote to its buffer file out to stdout, then close it
+static void drainIterationOutput(int fd) {
+    if (fd == -1) return;
+    char buf[64 * 1024];
+    if (lseek(fd, 0, SEEK_SET) == 0) {
+        for (;;) {
+            ssize_t n = read(fd, buf, sizeof buf);
+            if (n == -1 && errno == EINTR) continue;
+            if (n <= 0 || !writeAll(STDOUT_FILENO, std::string_view(buf, static_cast<size_t>(n)))) break;
         }
+    }
+    close(fd);
+}
 
-        // Function definition: "name() {" or "name()" or "function name {"
-        if (first == "function") {
-            // Multi-line "function NAME {": accumulate; single-line falls through to splitLogical
-            std::string rest = trimmed.size() > 8 ? trimWhitespace(trimmed.substr(8)) : "";
-            size_t sp2 = rest.find_first_of(" \t({");
-            std::string fname = (sp2 == std::string::npos) ? rest : rest.substr(0, sp2);
-            size_t open_brace = trimmed.rfind('{');
-            size_t close_brace = trimmed.rfind('}');
-            if (open_brace != std::string::npos && (close_brace == std::string::npos || close_brace <= open_brace)) {
-                pending_func_name_ = fname;
-                block_stack_.push_back("function");
-                block_lines_.push_back(trimmed);
-                return true;
-            }
-            // Single-line complete "function f { body }": fall through to splitLogical
+// for -P N: every iteration runs in a forked shell, at most N at once (0:
+// one per CPU), registered as a job and reaped through the JobManager.
+// Each iteration's stdout is buffered in an anonymous file and copied out
+// in iteration order, so output never interleaves; stderr stays live.
+// break/continue only end their own iteration. The status is the highest
+// iteration status
+int Shell::execParallelFor(const ForNode& node, const std::vector<std::string>& values) {
+    std::string operand = expander.expandString(node.jobs, &state);
+    char* end = nullptr;
+    long limit = std::strtol(operand.c_str(), &end, 10);
+    if (operand.empty() || *end != '\0' || limit < 0) {
+        std::cerr << "helix: for: -P " << operand << ": invalid job count\n";
+        return setStatus(2);
+    }
+    if (limit == 0) limit = std::max(1u, std::thread::hardware_concurrency());
+
+    struct Iteration {
+        int job = 0;
+        int output = -1;     // Buffer file; -1 when it writes to stdout directly
+        bool done = false;
+    };
+    std::vector<Iteration> iterations(values.size());
+    std::vector<int> running;
+    size_t next_output = 0;
+    int worst = 0;
+
+    auto collect = [&] {
+        int status = 0;
+        int job = job_manager->waitForAnyJob(running, status);
+        running.erase(std::remove(running.begin(), running.end(), job), running.end());
+        if (!job) {
+            running.clear();
+            return;
         }
-        // "name() {" multi-line only; single-line falls through to splitLogical
-        if (trimmed.find("()") != std::string::npos) {
-            size_t paren = trimmed.find("()");
-            if (paren > 0 && std::isalnum((unsigned char)trimmed[paren-1])) {
-                std::string fname = trimmed.substr(0, paren);
-                size_t ns = fname.find_first_not_of(" \t");
-                if (ns != std::string::npos) fname = fname.substr(ns);
-                if (!fname.empty()) {
-                    size_t open_brace = trimmed.find('{', paren + 2);
-                    size_t close_brace = trimmed.rfind('}');
-                    if (open_brace != std::string::npos && (close_brace == std::string::npos || close_brace <= open_brace)) {
-                        // Multi-line: open brace only
-                        pending_func_name_ = fname;
-                        block_stack_.push_back("function");
-                        block_lines_.push_back(trimmed);
-                        return true;
-                    }
-                    // Single-line or bare "name()": fall through to splitLogical
-                }
-            }
+        worst = std::max(worst, status);
+        for (auto& it : iterations) {
+            if (it.job == job) it.done = true;
         }
-        if (first == "if") {
-            block_stack_.push_back("if");
-            block_lines_.push_back(trimmed);
-            // Check for single-line "if cond; then cmd; fi"
-            if (trimmed.find("fi") != std::string::npos) {
-                auto lines = block_lines_; block_lines_.clear(); block_stack_.clear();
-                executeIf(lines);
-                return state.running;
-            }
-            return true;
+        std::cout.flush();
+        while (next_output < iterations.size() && iterations[next_output].done) {
+            drainIterationOutput(iterations[next_output++].output);
         }
-        if (first == "while" || first == "until") {
-            block_stack_.push_back(first);
-            block_lines_.push_back(trimmed);
-            return true;
+    };
+
+    size_t started = 0;
+    for (; started < values.size() && !interrupted(); ++started) {
+        while (running.size() >= static_cast<size_t>(limit)) collect();
+
+        Iteration& it = iterations[started];
+        it.output = openAnonymousFile();
+        sigset_t saved;
+        pid_t pid = forkBlockingSigchld(saved);
+        if (pid == -1) {
+            std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+            if (it.output != -1) close(it.output);
+            it.output = -1;
+            worst = std::max(worst, 1);
+            break;
         }
-        if (first == "for") {
-            block_stack_.push_back("for");
-            block_lines_.push_back(trimmed);
-            return true;
+        if (pid == 0) {
+            if (it.output != -1) dup2(it.output, STDOUT_FILENO);
+            assignVariable(node.variable, values[started]);
+            execNode(node.body.get());
+            exitChild(state.last_exit_status);
         }
-        if (first == "case") {
-            block_stack_.push_back("case");
-            block_lines_.push_back(trimmed);
-            return true;
+        // Registered before SIGCHLD is let through, so the exit is not missed
+        it.job = job_manager->addJob(pid, "for " + node.variable + "=" + values[started]);
+        sigprocmask(SIG_SETMASK, &saved, nullptr);
+        running.push_back(it.job);
+    }
+    while (!running.empty()) collect();
+    // Iterations never started (interrupted, fork failure) leave a gap
+    for (size_t i = next_output; i < started; ++i) drainIterationOutput(iterations[i].output);
+
+    if (started > 0) assignVariable(node.variable, values[started - 1]);
+    return setStatus(worst);
+}
+
+int Shell::execCase(const CaseNode& node) {
+    std::string subject = expander.expandString(node.subject, &state);
+    PatternMatcher& matcher = PatternMatcher::global();
+    for (const auto& arm : node.arms) {
+        for (const auto& raw : arm.patterns) {
+            bool matched = EnvironmentVariableExpander::isPlainPattern(raw)
+                ? matcher.matches(raw, subject)
+                : matcher.matches(expander.expandPattern(raw, &state), subject);
+            if (matched) {
+                if (!arm.body) return setStatus(0);
+                return execNode(arm.body.get());
+            }
         }
     }
+    return setStatus(0);
+}
 
-    auto frags = splitLogical(effective);
-    for (const auto& frag : frags) {
-        std::string t = trimWhitespace(frag.text);
-        if (t.empty()) continue;
+// ── Function invocation ───────────────────────────────────────────────────────
+
+bool Shell::invokeFunction(const std::string& name, std::vector<std::string> callArgs) {
+    auto it = state.functions.find(name);
+    if (it == state.functions.end()) return false;
 
-        if (!runSingleCommand(t)) return false;
-        if (!state.running) return false;
+    // Hold a reference: the body may redefine or unset the function while it runs
+    std::shared_ptr<const AstNode> body = it->second.body;
 
-        if (frag.op == SplitOp::AND && state.last_exit_status != 0) break;
-        if (frag.op == SplitOp::OR  && state.last_exit_status == 0) break;
+    // Push a variable frame from the pool (keeps its capacity between calls)
+    if (frame_pool_.empty()) {
+        state.var_frames.emplace_back();
+    } else {
+        state.var_frames.push_back(std::move(frame_pool_.back()));
+        frame_pool_.pop_back();
     }
 
-    return true;
-}
+    // Swap in positional params and $0 instead of copying them
+    std::vector<std::string> saved_params = std::exchange(state.positional_params, std::move(callArgs));
+    std::string saved_script = std::exchange(state.script_name, name);
 
-bool Shell::runSingleCommand(const std::string& input) {
-    if (state.noexec) return true;
+    bool saved_returning = state.returning;
+    state.returning = false;
 
-    std::string trimmed_input = trimWhitespace(input);
-    if (trimmed_input.empty()) return true;
+    execNode(body.get());
 
-    // ── Function definition in a single fragment ─────────────────────────────
-    // "name() { body }" or "function name { body }"
-    {
-        std::string first;
-        size_t sp = trimmed_input.find_first_of(" \t;");
-        first = (sp == std::string::npos) ? trimmed_input : trimmed_input.substr(0, sp);
-
-        if (first == "function" || (trimmed_input.find("()") != std::string::npos &&
-            trimmed_input.find('{') != std::string::npos &&
-            trimmed_input.find('}') != std::string::npos)) {
-            // Let processInput handle function definition
-            std::string fname;
-            std::string body_str;
-            size_t open_brace  = trimmed_input.rfind('{');
-            size_t close_brace = trimmed_input.rfind('}');
-            if (open_brace != std::string::npos && close_brace != std::string::npos && close_brace > open_brace) {
-                if (first == "function") {
-                    std::string rest = trimmed_input.size() > 8 ? trimWhitespace(trimmed_input.substr(8)) : "";
-                    size_t sp2 = rest.find_first_of(" \t({");
-                    fname = (sp2 == std::string::npos) ? rest : rest.substr(0, sp2);
-                } else {
-                    size_t paren = trimmed_input.find("()");
-                    if (paren != std::string::npos) {
-                        fname = trimmed_input.substr(0, paren);
-                        size_t ns = fname.find_first_not_of(" \t");
-                        if (ns != std::string::npos) fname = fname.substr(ns);
-                    }
-                }
-                body_str = trimWhitespace(trimmed_input.substr(open_brace + 1, close_brace - open_brace - 1));
-                if (!fname.empty()) {
-                    ShellFunction fn; fn.name = fname;
-                    std::string bseg;
-                    for (size_t ci = 0; ci <= body_str.size(); ++ci) {
-                        if (ci == body_str.size() || body_str[ci] == ';') {
-                            bseg = trimWhitespace(bseg);
-                            if (!bseg.empty()) fn.body.push_back(bseg);
-                            bseg.clear();
-                        } else { bseg += body_str[ci]; }
-                    }
-                    state.functions[fname] = fn;
-                    return true;
-                }
-            }
-        }
+    // Restore
+    state.positional_params = std::move(saved_params);
+    state.script_name = std::move(saved_script);
+    auto& locals = state.var_frames.back().locals;
+    for (auto l = locals.rbegin(); l != locals.rend(); ++l) {
+        VariableStore::global().restore(l->name, std::move(l->saved));
     }
+    locals.clear();
+    frame_pool_.push_back(std::move(state.var_frames.back()));
+    state.var_frames.pop_back();
 
-    std::string expanded = expandAliases(trimmed_input);
-    const std::string& trimmed = trimmed_input;
-
-    if (state.xtrace) std::cerr << "+ " << expanded << "\n";
+    if (state.returning) {
+        state.returning = false;
+        setStatus(state.return_value);
+    }
+    state.returning = saved_returning && !state.returning;
 
-    // Check for VAR=value assignment (possibly prefixed before a command)
-    // e.g. "FOO=bar" or "FOO=bar cmd args"
-    {
-        EnvironmentVariableExpander expander;
-        std::istringstream iss(expanded);
-        std::string first_tok;
-        iss >> first_tok;
-        if (!first_tok.empty() && isAssignment(first_tok)) {
-            // Apply all leading assignments
-            std::string rest_of_line;
-            std::getline(iss, rest_of_line);
-            rest_of_line = trimWhitespace(rest_of_line);
-
-            // Apply this assignment
-            size_t eq = first_tok.find('=');
-            std::string vname = first_tok.substr(0, eq);
-            std::string vval  = expander.expandWithState(first_tok.substr(eq + 1), &state);
-
-            if (state.readonly_vars.count(vname)) {
-                std::cerr << vname << ": readonly variable\n";
-                state.last_exit_status = 1;
-                return true;
-            }
+    return true;
+}
 
-            state.environment[vname] = vval;
-            setenv(vname.c_str(), vval.c_str(), 1);
+// ── processInput ──────────────────────────────────────────────────────────────
 
-            if (!rest_of_line.empty() && !isAssignment(rest_of_line.substr(0, rest_of_line.find(' ')))) {
-                // There's a command after the assignment(s) — re-run with it
-                return runSingleCommand(rest_of_line);
-            } else if (!rest_of_line.empty()) {
-                return runSingleCommand(first_tok + " " + rest_of_line);
-            }
+bool Shell::processInput(const std::string& input, bool record) {
+    if (input.empty() && pending_input_.empty()) return true;
 
-            state.last_exit_status = 0;
-            // Update $? env
-            setenv("?", "0", 1);
-            return true;
-        }
+    // History expansion, like history itself, is for typed input only
+    std::string effective = input;
+    if (record && !input.empty() && (input[0] == '!' || input[0] == '^')) {
+        effective = expandHistory(input);
+        if (effective.empty()) return true;
     }
 
-    // Check for function invocation
-    {
-        std::string first_word;
-        size_t sp = expanded.find_first_of(" \t");
-        first_word = (sp == std::string::npos) ? expanded : expanded.substr(0, sp);
-
-        if (state.functions.count(first_word)) {
-            std::vector<std::string> call_args;
-            if (sp != std::string::npos) {
-                // tokenize args
-                EnvironmentVariableExpander expander;
-                std::istringstream iss(expanded.substr(sp + 1));
-                std::string w;
-                while (iss >> w) call_args.push_back(expander.expandWithState(w, &state));
-            }
-            invokeFunction(first_word, call_args);
-            setenv("?", std::to_string(state.last_exit_status).c_str(), 1);
-            return state.running;
+    // Written to the history file before it runs; HISTCONTROL may skip it
+    if (record && !effective.empty()) {
+        const std::string* control = VariableStore::global().find("HISTCONTROL");
+        if (history_.add(effective, control ? *control : std::string())) {
+            ReadlineSupport::addHistory(effective);
         }
     }
 
-    // Pre-expand the whole line before tokenizing so $(()), $(), ${}, $VAR
-    // are resolved before the tokenizer sees them (avoids glob-splitting inside $(()))
-    {
-        EnvironmentVariableExpander pre_exp;
-        expanded = pre_exp.expandWithState(expanded, &state);
-    }
+    // Lines accumulate until they form complete commands (open if/while/
+    // quotes/here-docs make the parser report INCOMPLETE)
+    if (!pending_input_.empty()) pending_input_ += '\n';
+    pending_input_ += effective;
 
-    auto tokens = tokenizer.tokenize(expanded);
-    ParsedCommand parsed_cmd = parser.parse(tokens);
+    auto result = script_parser.parse(pending_input_, &state.aliases);
+    if (result.status == ScriptParser::Status::INCOMPLETE) return true;
+    pending_input_.clear();
 
-    // Brace-expand args
-    for (auto& cmd_entry : parsed_cmd.pipeline.commands) {
-        std::vector<std::string> expanded_args;
-        for (auto& arg : cmd_entry.args) {
-            auto be = braceExpand(arg);
-            for (auto& b : be) expanded_args.push_back(std::move(b));
-        }
-        cmd_entry.args = std::move(expanded_args);
+    if (result.status == ScriptParser::Status::ERROR) {
+        std::cerr << "helix: " << result.error << "\n";
+        setStatus(2);
+        return true;
     }
 
-    bool handled = builtin_dispatcher->dispatch(parsed_cmd, state);
+    execList(*result.program);
+    return state.running;
+}
 
-    // Update $? env var
-    setenv("?", std::to_string(state.last_exit_status).c_str(), 1);
+// Input that ended in the middle of a compound command
+void Shell::flushPendingInput() {
+    if (pending_input_.empty()) return;
+    pending_input_.clear();
+    std::cerr << "helix: syntax error: unexpected end of file\n";
+    setStatus(2);
+}
 
-    if (!state.running) return false;
-    if (!handled) {
-        state.last_exit_status = executor.execute(parsed_cmd);
-        setenv("?", std::to_string(state.last_exit_status).c_str(), 1);
+// ── Non-interactive entry points ─────────────────────────────────────────────
 
-        pid_t bg_pid = executor.getLastBackgroundPid();
-        if (bg_pid > 0) {
-            setenv("!", std::to_string(bg_pid).c_str(), 1);
-            if (job_manager) job_manager->addJob(bg_pid, trimmed);
-        }
+namespace {
+
+// The simple command a program ends with, when nothing can run after it:
+// the last item of the top-level list, or the last link of the and-or list
+// that ends it. A loop, function call or compound command does not qualify
+const SimpleCommandNode* finalCommand(const ListNode& program) {
+    if (program.items.empty() || program.items.back().background) return nullptr;
+    const AstNode* node = program.items.back().node.get();
+    if (node && node->kind == NodeKind::AND_OR) {
+        const auto& chain = static_cast<const AndOrNode&>(*node);
+        node = chain.rest.empty() ? chain.first.get() : chain.rest.back().node.get();
     }
-
-    if (state.exit_on_error && state.last_exit_status != 0) {
-        state.running = false;
-        return false;
+    if (node && node->kind == NodeKind::PIPELINE) {
+        const auto& pipeline = static_cast<const PipelineNode&>(*node);
+        if (pipeline.negate || pipeline.timed || pipeline.stages.size() != 1) return nullptr;
+        node = pipeline.stages[0].get();
     }
+    if (!node || node->kind != NodeKind::SIMPLE) return nullptr;
+    return static_cast<const SimpleCommandNode*>(node);
+}
+
+} // namespace
+
+int Shell::runCommand(const std::string& cmd) {
+    // Parsed here rather than by processInput(), so its last command is known
+    auto result = script_parser.parse(cmd, &state.aliases);
+    if (result.status == ScriptParser::Status::OK) return runFinal(*result.program);
+    processInput(cmd, false);
+    flushPendingInput();
+    return state.last_exit_status;
+}
 
+// A program external to the shell that ends -c or a script is exec'd in
+// its place, as dash and bash do: one fork and one wait fewer for every
+// wrapper-style `helix -c 'tool args'`
+int Shell::runFinal(const ListNode& program) {
+    final_command_ = options_.interactive ? nullptr : finalCommand(program);
+    execList(program);
+    final_command_ = nullptr;
+    return state.last_exit_status;
+}
+
+bool Shell::canExecInPlace() {
+    if (!state.traps.empty() || !state.exit_trap.empty()) return false;
+    if (!coprocs_.empty() || !substitution_fds_.empty() || Tracer::enabled()) return false;
+    if (job_manager) {
+        job_manager->reapPending();
+        if (!job_manager->getJobs().empty()) return false;
+    }
     return true;
 }
 
-// ── Non-interactive entry points ─────────────────────────────────────────────
+ScriptParser::Result Shell::compile(std::string_view source) {
+    return script_parser.parse(source, &state.aliases);
+}
 
-int Shell::runCommand(const std::string& cmd) {
-    processInput(cmd);
+int Shell::runProgram(const ListNode& program) {
+    state.running = true;
+    execList(program);
     return state.last_exit_status;
 }
 
 int Shell::runStdin() {
+    // A file redirected to stdin is a script like any other; a pipe or
+    // terminal is run as it arrives
+    struct stat st;
+    if (fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode)) {
+        std::string text;
+        if (ScriptCache::readFile("/dev/stdin", text)) return runScriptText(text);
+    }
+
+    // Through read's buffer, so a command reading stdin (read, cat) gets
+    // the lines after its own, not whatever was read ahead
+    InputBuffer& input = InputBuffer::forFd(STDIN_FILENO);
     std::string line;
-    while (std::getline(std::cin, line)) {
-        std::string trimmed = trimWhitespace(line);
-        if (trimmed.empty() || trimmed[0] == '#') continue;
-        if (!processInput(trimmed)) break;
+    for (;;) {
+        line.clear();
+        InputBuffer::Status status = input.read(line, '\n');
+        if (status != InputBuffer::Status::Ok && (status != InputBuffer::Status::Eof || line.empty())) break;
+        if (!processInput(line, false)) break;
         if (!state.running) break;
-        if (state.exit_on_error && state.last_exit_status != 0) break;
     }
+    flushPendingInput();
     return state.last_exit_status;
 }
 
 int Shell::runScript(const char* path, int argc, char* argv[]) {
-    std::ifstream f(path);
-    if (!f.is_open()) {
+    std::string text;
+    if (!ScriptCache::readFile(path, text)) {
         std::cerr << "helix: " << path << ": No such file or directory\n";
         return 127;
     }
@@ -1290,15 +1994,173 @@ int Shell::runScript(const char* path, int argc, char* argv[]) {
     for (int i = 0; i < argc; ++i)
         state.positional_params.push_back(argv[i]);
 
-    std::string line;
-    while (std::getline(f, line)) {
-        std::string trimmed = trimWhitespace(line);
-        if (trimmed.empty() || trimmed[0] == '#') continue;
-        if (!processInput(trimmed)) break;
-        if (!state.running) break;
-        if (state.exit_on_error && state.last_exit_status != 0) break;
+    return runScriptText(text);
+}
+
+// The whole script is parsed up front and run from the tree. Text that
+// mentions `alias`, or does not parse, goes line by line instead: an alias
+// applies only to lines read after its definition, and the commands before
+// a syntax error still run, as in bash
+int Shell::runScriptText(std::string_view text) {
+    if (text.find("alias") == std::string_view::npos) {
+        auto result = script_parser.parse(text, &state.aliases);
+        if (result.status == ScriptParser::Status::OK) return runFinal(*result.program);
+    }
+
+    for (size_t pos = 0; pos < text.size() && state.running;) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string_view::npos) end = text.size();
+        if (!processInput(std::string(text.substr(pos, end - pos)), false)) break;
+        pos = end + 1;
     }
+    flushPendingInput();
     return state.last_exit_status;
 }
 
+// ── Server mode ──────────────────────────────────────────────────────────────
+
+namespace {
+
+// Set by SIGINT/SIGTERM to the server: stop taking requests
+volatile std::sig_atomic_t g_server_stop = 0;
+
+void stopServer(int /* sig */) {
+    g_server_stop = 1;
+    EventLoop::wake();
+}
+
+} // namespace
+
+// helix --server: this shell is set up once (rc file, functions, PATH
+// lookups) and every request runs in a fork of it. Workers are jobs in the
+// job table, so the SIGCHLD reaper collects them, and the event loop's wake
+// handler sends each status back. On SIGINT or SIGTERM the socket goes away
+// at once and the server exits when the running requests have finished
+int Shell::serve(const std::string& socket_path) {
+    int listener = ShellServer::listen(socket_path);
+    if (listener == -1) return 1;
+
+    // Resolve every command on PATH now, so no worker walks PATH for one
+    PathCache& paths = PathCache::global();
+    std::vector<std::string> names = paths.commandNames();
+    for (const auto& name : names) paths.lookup(name, false);
+
+    struct sigaction sa {};
+    sa.sa_handler = stopServer;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, nullptr);
+    sigaction(SIGTERM, &sa, nullptr);
+    signal(SIGPIPE, SIG_IGN);
+
+    struct Worker {
+        pid_t pid;
+        int connection;
+    };
+    std::map<int, Worker> workers;  // By job id
+    EventLoop& loop = EventLoop::global();
+
+    auto finish = [&](std::map<int, Worker>::iterator it, int status) {
+        ShellServer::sendStatus(it->second.connection, status);
+        loop.unwatch(it->second.connection);
+        close(it->second.connection);
+        return workers.erase(it);
+    };
+
+    loop.watch(listener, [&] {
+        for (int connection; (connection = ShellServer::accept(listener)) != -1;) {
+            ShellServer::Request request;
+            if (!ShellServer::receive(connection, request)) {
+                close(connection);
+                continue;
+            }
+            sigset_t saved;
+            pid_t pid = forkBlockingSigchld(saved);
+            if (pid == 0) {
+                close(listener);
+                close(connection);
+                for (const auto& [job, worker] : workers) close(worker.connection);
+                exitChild(runRequest(request));
+            }
+            for (int fd : request.fds) close(fd);
+            if (pid == -1) {
+                std::cerr << "helix: fork failed: " << strerror(errno) << "\n";
+                close(connection);
+                continue;
+            }
+            int job = job_manager->addJob(pid, "serve " + request.command);
+            sigprocmask(SIG_SETMASK, &saved, nullptr);
+            ShellServer::sendPid(connection, pid);
+            workers[job] = {pid, connection};
+            // The client sends nothing more: input means it has gone away
+            loop.watch(connection, [&loop, pid, connection] {
+                if (kill(-pid, SIGHUP) == -1) kill(pid, SIGHUP);
+                loop.unwatch(connection);
+            });
+        }
+    });
+
+    int reaper = loop.onWake([&] {
+        job_manager->reapPending();
+        const auto& jobs = job_manager->getJobs();
+        for (auto it = workers.begin(); it != workers.end();) {
+            auto job = jobs.find(it->first);
+            if (job == jobs.end()) {
+                it = finish(it, 127);
+            } else if (job->second.status == JobStatus::DONE || job->second.status == JobStatus::TERMINATED) {
+                it = finish(it, job_manager->waitForJob(it->first));
+            } else {
+                ++it;
+            }
+        }
+    });
+
+    bool listening = true;
+    while (listening || !workers.empty()) {
+        if (listening && g_server_stop) {
+            loop.unwatch(listener);
+            close(listener);
+            unlink(socket_path.c_str());
+            listening = false;
+            continue;
+        }
+        if (!loop.runOnce(-1)) break;
+    }
+    loop.removeWake(reaper);
+    return 0;
+}
+
+// In the forked worker: take on the client's descriptors, environment and
+// directory, then run the command as `helix -c` would (EXIT trap included)
+int Shell::runRequest(const ShellServer::Request& request) {
+    int fds[3];
+    for (int i = 0; i < 3; ++i) {
+        // Out of the way of the dup2()s below first
+        fds[i] = request.fds[i] < 3 ? fcntl(request.fds[i], F_DUPFD_CLOEXEC, 3) : request.fds[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        dup2(fds[i], i);
+        close(fds[i]);
+    }
+    InputBuffer::discard(STDIN_FILENO);
+    // A session (and process group) of its own: the client's signals reach
+    // its children too, and a terminal passed as stdin is read without the
+    // background-group SIGTTIN of the server's session
+    setsid();
+    for (int sig : {SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGPIPE}) signal(sig, SIG_DFL);
+
+    VariableStore& vars = VariableStore::global();
+    vars.replaceEnvironment(request.environment);
+    vars.syncProcessEnvironment();
+    if (const std::string* home = vars.find("HOME")) state.home_directory = *home;
+    if (chdir(request.cwd.c_str()) == -1) {
+        std::cerr << "helix: " << request.cwd << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    state.current_directory = request.cwd;
+
+    int status = runCommand(request.command);
+    if (!state.exit_trap.empty()) runSource(state.exit_trap);
+    return status;
+}
+
 } // namespace helix
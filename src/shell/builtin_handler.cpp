@@ -1,12 +1,24 @@
 #include "shell/builtin_handler.h"
+#include "executor/child_wait.h"
 #include "executor/executable_resolver.h"
+#include "executor/path_cache.h"
 #include "executor/environment_expander.h"
+#include "executor/arithmetic.h"
+#include "executor/pattern.h"
+#include "ai_cache.h"
+#include "ai_context.h"
 #include "ai_provider.h"
+#include "shell/history_store.h"
+#include "shell/input_buffer.h"
+#include "shell/stream_copy.h"
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/times.h>
@@ -18,7 +30,9 @@
 #include <cstdio>
 #include <cerrno>
 #include <climits>
-#include <readline/history.h>
+#include "readline_support.h"
+
+extern char** environ;
 
 namespace helix {
 
@@ -31,9 +45,9 @@ bool CdCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
 
         // Handle cd -
         if (new_dir == "-") {
-            char* oldpwd = getenv("OLDPWD");
+            const std::string* oldpwd = VariableStore::global().find("OLDPWD");
             if (oldpwd) {
-                new_dir = oldpwd;
+                new_dir = *oldpwd;
             } else {
                 std::cerr << "cd: OLDPWD not set\n";
                 return true;
@@ -56,9 +70,10 @@ bool CdCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
             state.current_directory = cwd;
         }
 
-        // Update environment variables
-        setenv("OLDPWD", old_cwd.c_str(), 1);
-        setenv("PWD", state.current_directory.c_str(), 1);
+        // Update the directory variables (exported, as other shells do)
+        VariableStore& vars = VariableStore::global();
+        vars.set("OLDPWD", old_cwd, true);
+        vars.set("PWD", state.current_directory, true);
 
         // For cd -, print the directory we changed to
         if (cmd.pipeline.commands[0].args.size() > 1 &&
@@ -93,12 +108,26 @@ bool ExitCommandHandler::canHandle(const std::string& command) const {
 }
 
 // HistoryCommandHandler implementation
+// history [N]: every entry, or only the newest N
 bool HistoryCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
-    (void)cmd; // Unused parameter
-    for (size_t i = 0; i < state.command_history.size(); ++i) {
-        std::cout << std::setw(4) << std::setfill(' ') << (i + 1)
-                  << "  " << state.command_history[i] << "\n";
+    if (!state.history) return true;
+    const auto& args = cmd.pipeline.commands[0].args;
+    size_t first = 1;
+    if (args.size() > 1) {
+        char* end = nullptr;
+        long count = std::strtol(args[1].c_str(), &end, 10);
+        if (!end || *end != '\0' || count < 0) {
+            std::cerr << "history: " << args[1] << ": numeric argument required\n";
+            state.last_exit_status = 1;
+            return true;
+        }
+        size_t size = state.history->size();
+        first = static_cast<size_t>(count) >= size ? 1 : size - static_cast<size_t>(count) + 1;
     }
+    state.history->forEach([first](size_t number, std::string_view entry) {
+        if (number < first) return;
+        std::cout << std::setw(4) << std::setfill(' ') << number << "  " << entry << "\n";
+    });
     return true;
 }
 
@@ -107,10 +136,13 @@ bool HistoryCommandHandler::canHandle(const std::string& command) const {
 }
 
 // JobsCommandHandler implementation
+// jobs -v also lists every member with its exit status and resource usage
 bool JobsCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
-    (void)cmd; // Unused parameter
+    const auto& args = cmd.pipeline.commands[0].args;
+    bool verbose = std::find(args.begin() + 1, args.end(), "-v") != args.end();
     if (state.job_manager) {
-        state.job_manager->printJobs();
+        state.job_manager->reapPending();
+        state.job_manager->printJobs(verbose);
     }
     return true;
 }
@@ -165,32 +197,29 @@ bool PwdCommandHandler::canHandle(const std::string& command) const {
 
 // ExportCommandHandler implementation
 bool ExportCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
-    if (cmd.pipeline.commands[0].args.size() < 2) {
-        // No arguments - print all environment variables
-        for (const auto& pair : state.environment) {
-            std::cout << "export " << pair.first << "=" << pair.second << "\n";
+    const auto& args = cmd.pipeline.commands[0].args;
+    VariableStore& vars = VariableStore::global();
+    if (args.size() < 2) {
+        // No arguments - print all exported variables
+        for (const auto& [name, var] : vars.sorted(true)) {
+            std::cout << "export " << name << "=" << var.value << "\n";
         }
         return true;
     }
 
-    // Parse VAR=VALUE format
-    const std::string& arg = cmd.pipeline.commands[0].args[1];
-    size_t eq_pos = arg.find('=');
-
-    if (eq_pos == std::string::npos) {
-        std::cerr << "export: invalid format. Use: export VAR=VALUE\n";
-        return true;
+    // export VAR=VALUE or export VAR (mark an existing variable)
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        size_t eq_pos = arg.find('=');
+        std::string var_name = arg.substr(0, eq_pos);
+        if (state.readonly_vars.count(var_name) && eq_pos != std::string::npos) {
+            std::cerr << var_name << ": readonly variable\n";
+            state.last_exit_status = 1;
+            continue;
+        }
+        if (eq_pos == std::string::npos) vars.exportVariable(var_name);
+        else vars.set(var_name, arg.substr(eq_pos + 1), true);
     }
-
-    std::string var_name = arg.substr(0, eq_pos);
-    std::string var_value = arg.substr(eq_pos + 1);
-
-    // Set in shell's environment map
-    state.environment[var_name] = var_value;
-
-    // Also set in actual environment for child processes
-    setenv(var_name.c_str(), var_value.c_str(), 1);
-
     return true;
 }
 
@@ -284,8 +313,21 @@ bool UnaliasCommandHandler::canHandle(const std::string& command) const {
 bool UnsetCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
     for (size_t i = 1; i < args.size(); ++i) {
-        state.environment.erase(args[i]);
-        unsetenv(args[i].c_str());
+        // unset a[i] removes one element
+        size_t open = args[i].find('[');
+        bool element = open != std::string::npos && open > 0 && args[i].back() == ']';
+        std::string name = element ? args[i].substr(0, open) : args[i];
+        if (state.readonly_vars.count(name)) {
+            std::cerr << "unset: " << name << ": cannot unset: readonly variable\n";
+            state.last_exit_status = 1;
+            continue;
+        }
+        if (!element) {
+            VariableStore::global().unset(name);
+        } else if (!EnvironmentVariableExpander().unsetElement(
+                       name, std::string_view(args[i]).substr(open + 1, args[i].size() - open - 2), &state)) {
+            state.last_exit_status = 1;
+        }
     }
     return true;
 }
@@ -301,11 +343,6 @@ bool TypeCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         std::cerr << "type: usage: type NAME\n";
         return true;
     }
-    static const std::vector<std::string> builtins = {
-        "cd","pwd","echo","export","unset","history","jobs","fg","bg",
-        "exit","help","alias","unalias","type","ai","set","test","[",
-        "source",".","which","read","pushd","popd","dirs","wait","true","false"
-    };
     for (size_t i = 1; i < args.size(); ++i) {
         const std::string& name = args[i];
         // alias?
@@ -313,17 +350,22 @@ bool TypeCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
             std::cout << name << " is aliased to '" << it->second << "'\n";
             continue;
         }
-        // builtin?
-        bool is_builtin = false;
-        for (const auto& b : builtins) {
-            if (b == name) { is_builtin = true; break; }
+        // function?
+        if (auto it = state.functions.find(name); it != state.functions.end()) {
+            std::cout << name << " is a function\n" << name << " () " << it->second.text << "\n";
+            continue;
         }
-        if (is_builtin) {
+        // builtin?
+        if (builtins::isBuiltin(name)) {
             std::cout << name << " is a shell builtin\n";
             continue;
         }
         // external?
-        ExecutableResolver resolver;
+        if (const auto* entry = PathCache::global().find(name)) {
+            std::cout << name << " is hashed (" << entry->path << ")\n";
+            continue;
+        }
+        ExecutableResolver resolver(false);
         std::string path = resolver.findExecutable(name);
         if (!path.empty()) {
             std::cout << name << " is " << path << "\n";
@@ -339,54 +381,195 @@ bool TypeCommandHandler::canHandle(const std::string& command) const {
 }
 
 // ── ReadCommandHandler ────────────────────────────────────────────────────────
+// read [-r] [-d delim] [-n count] [-u fd] [-p prompt] [name ...]
+
+namespace {
+
+// How IFS classifies each byte for read's field splitting; rebuilt only
+// when IFS changes
+struct IfsTable {
+    static constexpr unsigned char kField = 0, kWhite = 1, kDelim = 2;
+    std::array<unsigned char, 256> cls{};
+    std::string ifs;
+    bool built = false;
+
+    void use(const std::string& value) {
+        if (built && value == ifs) return;
+        ifs = value;
+        built = true;
+        cls.fill(kField);
+        for (char c : ifs) {
+            cls[static_cast<unsigned char>(c)] = (c == ' ' || c == '\t' || c == '\n') ? kWhite : kDelim;
+        }
+    }
+};
+
+} // namespace
 
 bool ReadCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
 
+    bool raw = false;
+    int delim = '\n';
+    size_t max = std::string::npos;
+    int fd = STDIN_FILENO;
+    const std::string* prompt = nullptr;
+    size_t first = 1;
+    for (; first < args.size() && args[first].size() > 1 && args[first][0] == '-'; ++first) {
+        const std::string& opt = args[first];
+        if (opt == "--") {
+            ++first;
+            break;
+        }
+        for (size_t j = 1; j < opt.size(); ++j) {
+            char flag = opt[j];
+            if (flag == 'r') {
+                raw = true;
+                continue;
+            }
+            if (flag != 'd' && flag != 'n' && flag != 'u' && flag != 'p') {
+                std::cerr << "read: -" << flag << ": invalid option\n";
+                state.last_exit_status = 2;
+                return true;
+            }
+            // The value is the rest of this word, or the next word
+            const std::string* value;
+            std::string rest;
+            if (j + 1 < opt.size()) {
+                rest = opt.substr(j + 1);
+                value = &rest;
+            } else if (first + 1 < args.size()) {
+                value = &args[++first];
+            } else {
+                std::cerr << "read: -" << flag << ": option requires an argument\n";
+                state.last_exit_status = 2;
+                return true;
+            }
+            j = opt.size();
+
+            long number = 0;
+            bool numeric = false;
+            if (flag == 'n' || flag == 'u') {
+                char* end = nullptr;
+                number = std::strtol(value->c_str(), &end, 10);
+                numeric = !value->empty() && *end == '\0' && number >= 0;
+            }
+            if (flag == 'd') {
+                delim = value->empty() ? 0 : static_cast<unsigned char>((*value)[0]);
+            } else if (flag == 'p') {
+                prompt = value;
+            } else if (!numeric) {
+                std::cerr << "read: " << *value << ": invalid " << (flag == 'n' ? "number" : "file descriptor specification") << "\n";
+                state.last_exit_status = 1;
+                return true;
+            } else if (flag == 'n') {
+                max = static_cast<size_t>(number);
+            } else if (fcntl(static_cast<int>(number), F_GETFD) == -1) {
+                std::cerr << "read: " << number << ": invalid file descriptor: " << strerror(errno) << "\n";
+                state.last_exit_status = 1;
+                return true;
+            } else {
+                fd = static_cast<int>(number);
+            }
+        }
+    }
+
+    // Output written so far (a prompt printed with printf) comes first
+    std::cout.flush();
+    if (prompt && isatty(fd)) std::cerr << *prompt << std::flush;
+
+    // One record; without -r a backslash before the delimiter continues it
+    InputBuffer& input = InputBuffer::forFd(fd);
     std::string line;
-    if (!std::getline(std::cin, line)) {
+    InputBuffer::Status status;
+    for (;;) {
+        status = input.read(line, delim, max == std::string::npos ? max : max - std::min(max, line.size()));
+        if (raw || status != InputBuffer::Status::Ok) break;
+        size_t slashes = 0;
+        while (slashes < line.size() && line[line.size() - 1 - slashes] == '\\') ++slashes;
+        if (slashes % 2 == 0) break;
+        line.pop_back();
+    }
+    if (status == InputBuffer::Status::Error) {
+        std::cerr << "read: read error: " << fd << ": " << strerror(errno) << "\n";
         state.last_exit_status = 1;
         return true;
     }
 
-    if (args.size() < 2) {
-        // No variable name — store in REPLY
-        setenv("REPLY", line.c_str(), 1);
-        state.environment["REPLY"] = line;
+    // Without -r a backslash quotes the next character: it is kept (never a
+    // field separator) and the backslash goes
+    std::string text;
+    std::vector<bool> quoted;
+    if (raw || line.find('\\') == std::string::npos) {
+        text = std::move(line);
+    } else {
+        text.reserve(line.size());
+        quoted.reserve(line.size());
+        for (size_t k = 0; k < line.size(); ++k) {
+            bool escape = line[k] == '\\';
+            if (escape && ++k == line.size()) break;
+            text += line[k];
+            quoted.push_back(escape);
+        }
+    }
+
+    VariableStore& vars = VariableStore::global();
+    auto assign = [&](const std::string& name, std::string value) {
+        if (state.readonly_vars.count(name)) {
+            std::cerr << "read: " << name << ": readonly variable\n";
+            return false;
+        }
+        vars.set(name, std::move(value));
+        return true;
+    };
+    int result = (status == InputBuffer::Status::Eof) ? 1 : 0;
+
+    if (first >= args.size()) {
+        // No names: the whole record goes to REPLY, unsplit
+        if (!assign("REPLY", std::move(text))) result = 1;
+        state.last_exit_status = result;
         return true;
     }
 
-    // Split line by IFS (default: space/tab) and assign to variables
-    const char* ifs_env = getenv("IFS");
-    std::string ifs = ifs_env ? ifs_env : " \t";
-
-    std::vector<std::string> words;
-    size_t i = 0;
-    while (i < line.size()) {
-        // Skip leading IFS
-        while (i < line.size() && ifs.find(line[i]) != std::string::npos) ++i;
-        if (i >= line.size()) break;
-        size_t start = i;
-        while (i < line.size() && ifs.find(line[i]) == std::string::npos) ++i;
-        words.push_back(line.substr(start, i - start));
-    }
-
-    for (size_t v = 1; v < args.size(); ++v) {
-        std::string val;
-        if (v - 1 < words.size()) {
-            if (v == args.size() - 1) {
-                // Last variable gets the rest of the line
-                val = words[v - 1];
-                for (size_t w = v; w < words.size(); ++w)
-                    val += " " + words[w];
-            } else {
-                val = words[v - 1];
-            }
+    static IfsTable table;
+    const std::string* ifs_var = vars.find("IFS");
+    table.use(ifs_var ? *ifs_var : " \t\n");
+    const size_t n = text.size();
+    auto cls = [&](size_t k) {
+        return !quoted.empty() && quoted[k] ? IfsTable::kField : table.cls[static_cast<unsigned char>(text[k])];
+    };
+    // Past one field separator: IFS whitespace around at most one other IFS character
+    auto skipSeparator = [&](size_t k) {
+        while (k < n && cls(k) == IfsTable::kWhite) ++k;
+        if (k < n && cls(k) == IfsTable::kDelim) {
+            ++k;
+            while (k < n && cls(k) == IfsTable::kWhite) ++k;
+        }
+        return k;
+    };
+
+    size_t k = 0;
+    while (k < n && cls(k) == IfsTable::kWhite) ++k;
+    for (size_t v = first; v < args.size(); ++v) {
+        size_t start = k;
+        size_t end;
+        if (v + 1 < args.size()) {
+            while (k < n && cls(k) == IfsTable::kField) ++k;
+            end = k;
+            k = skipSeparator(k);
+        } else {
+            // The last name takes the rest, less trailing IFS whitespace and
+            // the separator after a lone final field
+            end = n;
+            while (end > start && cls(end - 1) == IfsTable::kWhite) --end;
+            size_t field = start;
+            while (field < end && cls(field) == IfsTable::kField) ++field;
+            if (field < end && skipSeparator(field) >= end) end = field;
         }
-        setenv(args[v].c_str(), val.c_str(), 1);
-        state.environment[args[v]] = val;
+        if (!assign(args[v], text.substr(start, end - start))) result = 1;
     }
 
+    state.last_exit_status = result;
     return true;
 }
 
@@ -394,6 +577,137 @@ bool ReadCommandHandler::canHandle(const std::string& command) const {
     return command == "read";
 }
 
+// ── MapfileCommandHandler ─────────────────────────────────────────────────────
+
+bool MapfileCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
+    const auto& args = cmd.pipeline.commands[0].args;
+    const std::string& self = args[0];
+
+    bool strip = false;
+    int delim = '\n';
+    size_t count = 0;       // 0: every record
+    size_t skip = 0;
+    size_t origin = 0;
+    bool keep = false;      // -O: assign from origin on without clearing
+    int fd = STDIN_FILENO;
+    size_t first = 1;
+    for (; first < args.size() && args[first].size() > 1 && args[first][0] == '-'; ++first) {
+        const std::string& opt = args[first];
+        if (opt == "--") {
+            ++first;
+            break;
+        }
+        for (size_t j = 1; j < opt.size(); ++j) {
+            char flag = opt[j];
+            if (flag == 't') {
+                strip = true;
+                continue;
+            }
+            if (flag != 'd' && flag != 'n' && flag != 's' && flag != 'O' && flag != 'u') {
+                std::cerr << self << ": -" << flag << ": invalid option\n";
+                state.last_exit_status = 2;
+                return true;
+            }
+            std::string value;
+            if (j + 1 < opt.size()) {
+                value = opt.substr(j + 1);
+            } else if (first + 1 < args.size()) {
+                value = args[++first];
+            } else {
+                std::cerr << self << ": -" << flag << ": option requires an argument\n";
+                state.last_exit_status = 2;
+                return true;
+            }
+            j = opt.size();
+
+            if (flag == 'd') {
+                delim = value.empty() ? 0 : static_cast<unsigned char>(value[0]);
+                continue;
+            }
+            char* end = nullptr;
+            long number = std::strtol(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || number < 0) {
+                std::cerr << self << ": " << value << ": invalid "
+                          << (flag == 'u' ? "file descriptor specification" : "number") << "\n";
+                state.last_exit_status = 1;
+                return true;
+            }
+            if (flag == 'n') count = static_cast<size_t>(number);
+            else if (flag == 's') skip = static_cast<size_t>(number);
+            else if (flag == 'O') { origin = static_cast<size_t>(number); keep = true; }
+            else if (fcntl(static_cast<int>(number), F_GETFD) == -1) {
+                std::cerr << self << ": " << number << ": invalid file descriptor: " << strerror(errno) << "\n";
+                state.last_exit_status = 1;
+                return true;
+            } else {
+                fd = static_cast<int>(number);
+            }
+        }
+    }
+
+    std::string name = first < args.size() ? args[first] : "MAPFILE";
+    if (state.readonly_vars.count(name)) {
+        std::cerr << self << ": " << name << ": readonly variable\n";
+        state.last_exit_status = 1;
+        return true;
+    }
+    VariableStore& vars = VariableStore::global();
+    if (const ShellArray* existing = vars.findArray(name); existing && existing->associative) {
+        std::cerr << self << ": " << name << ": not an indexed array\n";
+        state.last_exit_status = 1;
+        return true;
+    }
+    if (!keep) vars.unset(name);
+    IndexedArray& array = vars.makeArray(name, false)->indexed;
+
+    // Every record wanted: take the rest of the input in a few large reads
+    // and split it here. With -n only as many records as asked are read,
+    // the input left where the last one ends
+    InputBuffer& input = InputBuffer::forFd(fd);
+    size_t index = origin;
+    size_t seen = 0;
+    auto take = [&](std::string record, bool delimited) {
+        if (seen++ < skip) return true;
+        if (delimited && !strip) record += static_cast<char>(delim);
+        if (!array.set(index++, std::move(record))) {
+            std::cerr << self << ": " << name << "[" << index - 1 << "]: array index out of range\n";
+            return false;
+        }
+        return count == 0 || seen - skip < count;
+    };
+    InputBuffer::Status status = InputBuffer::Status::Eof;
+    if (count == 0) {
+        std::string data;
+        status = input.readAll(data);
+        size_t start = 0;
+        while (start < data.size()) {
+            size_t end = data.find(static_cast<char>(delim), start);
+            bool delimited = end != std::string::npos;
+            if (!delimited) end = data.size();
+            if (!take(data.substr(start, end - start), delimited)) break;
+            start = end + 1;
+        }
+    } else {
+        for (;;) {
+            std::string record;
+            status = input.read(record, delim);
+            if (status == InputBuffer::Status::Error) break;
+            bool delimited = status == InputBuffer::Status::Ok;
+            if (!delimited && record.empty()) break;
+            if (!take(std::move(record), delimited) || !delimited) break;
+        }
+    }
+    if (status == InputBuffer::Status::Error) {
+        std::cerr << self << ": read error: " << fd << ": " << strerror(errno) << "\n";
+        state.last_exit_status = 1;
+    }
+    return true;
+}
+
+bool MapfileCommandHandler::canHandle(const std::string& command) const {
+    return command == "mapfile" || command == "readarray";
+}
+
 // ── PushdCommandHandler ───────────────────────────────────────────────────────
 
 bool PushdCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
@@ -419,7 +733,7 @@ bool PushdCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     char cwd[1024];
     if (getcwd(cwd, sizeof(cwd))) {
         state.current_directory = cwd;
-        setenv("PWD", cwd, 1);
+        VariableStore::global().set("PWD", cwd, true);
     }
 
     // Print stack
@@ -454,7 +768,7 @@ bool PopdCommandHandler::handle(const ParsedCommand& /* cmd */, ShellState& stat
     char cwd[1024];
     if (getcwd(cwd, sizeof(cwd))) {
         state.current_directory = cwd;
-        setenv("PWD", cwd, 1);
+        VariableStore::global().set("PWD", cwd, true);
     }
 
     std::cout << state.current_directory;
@@ -485,31 +799,68 @@ bool DirsCommandHandler::canHandle(const std::string& command) const {
 
 // ── WaitCommandHandler ────────────────────────────────────────────────────────
 
+// Jobs are waited for through the job manager, which reaps them from its
+// SIGCHLD queue; only a pid outside every job is waited for directly
 bool WaitCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
+    IJobManager* jobs = state.job_manager;
 
-    if (args.size() < 2) {
-        // wait for all children
-        int status;
-        while (waitpid(-1, &status, 0) > 0) {}
+    if (args.size() < 2 || args[1] == "-n") {
+        std::vector<int> ids;
+        if (jobs) {
+            for (const auto& pair : jobs->getJobs()) {
+                if (pair.second.status != JobStatus::STOPPED) ids.push_back(pair.first);
+            }
+        }
         state.last_exit_status = 0;
+        if (args.size() >= 2) {
+            // wait -n: the next job to finish gives the status
+            int status = 127;
+            if (ids.empty() || !jobs->waitForAnyJob(ids, status)) status = 127;
+            state.last_exit_status = status;
+            return true;
+        }
+        for (int id : ids) jobs->waitForJob(id);
         return true;
     }
 
-    try {
-        pid_t pid = std::stoi(args[1]);
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        char* end = nullptr;
+        long number = std::strtol(arg.c_str() + (arg[0] == '%' ? 1 : 0), &end, 10);
+        if (arg.empty() || *end != '\0' || number <= 0 || number > INT_MAX) {
+            std::cerr << "wait: `" << arg << "': not a pid or valid job spec\n";
+            state.last_exit_status = 2;
+            continue;
+        }
+
+        int job_id = !jobs ? 0 : arg[0] == '%' ? static_cast<int>(number)
+                                               : jobs->findJob(static_cast<pid_t>(number));
+        if (job_id) {
+            int status = jobs->waitForJob(job_id);
+            if (status != -1) {
+                state.last_exit_status = status;
+                continue;
+            }
+        }
+        if (arg[0] == '%') {
+            std::cerr << "wait: " << arg << ": no such job\n";
+            state.last_exit_status = 127;
+            continue;
+        }
+
         int status;
-        if (waitpid(pid, &status, 0) == -1) {
-            std::cerr << "wait: " << strerror(errno) << "\n";
-            state.last_exit_status = 1;
+        pid_t r;
+        do {
+            r = waitpid(static_cast<pid_t>(number), &status, 0);
+        } while (r == -1 && errno == EINTR);
+        if (r == -1) {
+            std::cerr << "wait: pid " << number << " is not a child of this shell\n";
+            state.last_exit_status = 127;
         } else {
-            state.last_exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+            state.last_exit_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
         }
-    } catch (...) {
-        std::cerr << "wait: invalid pid\n";
-        state.last_exit_status = 1;
     }
-
     return true;
 }
 
@@ -542,8 +893,8 @@ bool SetCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
 
     if (args.size() == 1) {
         // `set` with no args: print all variables
-        for (const auto& p : state.environment)
-            std::cout << p.first << "=" << p.second << "\n";
+        for (const auto& [name, var] : VariableStore::global().sorted())
+            std::cout << name << "=" << var.value << "\n";
         return true;
     }
 
@@ -554,11 +905,31 @@ bool SetCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
             continue;
         }
         bool enable = (opt[0] == '-');
+        if (opt.size() == 2 && opt[1] == 'o') {
+            // set -o NAME / set +o NAME
+            if (++i >= args.size()) {
+                std::cerr << "set: " << opt << ": option name required\n";
+                state.last_exit_status = 2;
+                break;
+            }
+            const std::string& name = args[i];
+            if (name == "errexit")       state.exit_on_error = enable;
+            else if (name == "xtrace")   state.xtrace = enable;
+            else if (name == "nounset")  state.nounset = enable;
+            else if (name == "noglob")   state.noglob = enable;
+            else if (name == "lastpipe") state.lastpipe = enable;
+            else {
+                std::cerr << "set: " << name << ": invalid option name\n";
+                state.last_exit_status = 2;
+            }
+            continue;
+        }
         for (size_t j = 1; j < opt.size(); ++j) {
             switch (opt[j]) {
                 case 'e': state.exit_on_error = enable; break;
                 case 'x': state.xtrace        = enable; break;
                 case 'u': state.nounset        = enable; break;
+                case 'f': state.noglob         = enable; break;
                 default:
                     std::cerr << "set: unknown flag: " << opt[j] << "\n";
             }
@@ -576,6 +947,7 @@ bool SetCommandHandler::canHandle(const std::string& command) const {
 //   Unary:   -e, -f, -d, -r, -w, -x, -z, -n, -L
 //   Binary:  = != -eq -ne -lt -le -gt -ge
 //   Logical: ! (negation, only as first arg)
+// In [[ ]] the right side of = / == / != is a glob pattern (PatternMatcher)
 
 bool TestCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& raw = cmd.pipeline.commands[0].args;
@@ -584,10 +956,12 @@ bool TestCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     std::vector<std::string> args;
     size_t start = 1;
     size_t end   = raw.size();
-    if (!raw.empty() && raw[0] == "[") {
-        if (raw.back() == "]") end--;
+    bool extended = !raw.empty() && raw[0] == "[[";
+    if (!raw.empty() && (raw[0] == "[" || extended)) {
+        const char* close = extended ? "]]" : "]";
+        if (raw.size() > 1 && raw.back() == close) end--;
         else {
-            std::cerr << "test: missing ']'\n";
+            std::cerr << "test: missing '" << close << "'\n";
             state.last_exit_status = 2;
             return true;
         }
@@ -638,8 +1012,8 @@ bool TestCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         const std::string& op = args[1];
         const std::string& b  = args[2];
         long la, lb;
-        if      (op == "="  || op == "==") result = (a == b);
-        else if (op == "!=")               result = (a != b);
+        if      (op == "="  || op == "==") result = extended ? PatternMatcher::global().matches(b, a) : a == b;
+        else if (op == "!=")               result = extended ? !PatternMatcher::global().matches(b, a) : a != b;
         else if (op == "-eq" && asLong(a, la) && asLong(b, lb)) result = (la == lb);
         else if (op == "-ne" && asLong(a, la) && asLong(b, lb)) result = (la != lb);
         else if (op == "-lt" && asLong(a, la) && asLong(b, lb)) result = (la <  lb);
@@ -662,7 +1036,7 @@ bool TestCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
 }
 
 bool TestCommandHandler::canHandle(const std::string& command) const {
-    return command == "test" || command == "[";
+    return command == "test" || command == "[" || command == "[[";
 }
 
 bool AiCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
@@ -674,7 +1048,8 @@ bool AiCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
             "  ai <description>          suggest a shell command\n"
             "  ai explain <command>      explain what a command does\n"
             "  ai fix <error message>    suggest a fix for an error\n"
-            "  ai run <description>      suggest AND run after confirmation\n";
+            "  ai run <description>      suggest AND run after confirmation\n"
+            "  ai --no-cache ...         ask again instead of reusing a cached reply\n";
         return true;
     }
 
@@ -689,16 +1064,28 @@ bool AiCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         return true;
     }
 
-    std::string subcommand = args[1];
+    // --no-cache: ask the provider even if a cached reply exists
+    size_t first = 1;
+    bool use_cache = true;
+    if (args[1] == "--no-cache") {
+        use_cache = false;
+        first = 2;
+        if (args.size() < 3) {
+            std::cerr << "ai: empty query\n";
+            return true;
+        }
+    }
+
+    std::string subcommand = args[first];
     std::string query;
-    size_t start = 2;
+    size_t start = first + 1;
 
     bool mode_explain = (subcommand == "explain");
     bool mode_fix     = (subcommand == "fix");
     bool mode_run     = (subcommand == "run");
     bool mode_suggest = !mode_explain && !mode_fix && !mode_run;
 
-    if (mode_suggest) { query = subcommand; start = 2; }
+    if (mode_suggest) query = subcommand;
     for (size_t i = start; i < args.size(); ++i) {
         if (!query.empty()) query += ' ';
         query += args[i];
@@ -708,34 +1095,73 @@ bool AiCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         return true;
     }
 
-    std::string system_prompt, result;
+    // Where the user is: usually gathered while they were typing. The
+    // history is left out of `explain`, whose answer does not depend on it,
+    // so repeating one hits the cache even after other commands
+    AiContext::Snapshot where = AiContext::global().get(state.current_directory);
+    constexpr size_t kAiHistoryLines = 5;
+    std::vector<std::string> recent;
+    if (!mode_explain && state.history) {
+        for (std::string_view line : state.history->tail(kAiHistoryLines * 2)) {
+            if (line.rfind("ai ", 0) != 0) recent.emplace_back(line);
+        }
+        if (recent.size() > kAiHistoryLines) recent.erase(recent.begin(), recent.end() - kAiHistoryLines);
+    }
+    std::string message = "Context:\n" + AiContext::describe(where, recent) + "\n" + query;
+
+    std::string system_prompt;
+    AiResponseCache cache(AiResponseCache::defaultDirectory());
+
+    // The reply is printed as it streams in; Ctrl-C stops it. A cached
+    // reply is printed the same way, in one piece
+    auto ask = [&](const char* color, const char* prefix, int max_tokens, bool one_line) {
+        bool started = false;
+        auto show = [&](std::string_view text) {
+            if (!started) std::cout << color << prefix;
+            started = true;
+            for (char c : text) {
+                if (!one_line || c != '\n') std::cout << c;
+            }
+            std::cout.flush();
+        };
+
+        std::string key = AiResponseCache::keyFor(provider, system_prompt, message, max_tokens);
+        AiResponse reply;
+        if (std::optional<std::string> cached = use_cache ? cache.lookup(key) : std::nullopt) {
+            reply.text = std::move(*cached);
+            show(reply.text);
+        } else {
+            reply = queryAiProvider(provider, system_prompt, message, max_tokens, show);
+            if (!reply.cancelled && !reply.text.empty()) cache.store(key, reply.text);
+        }
+        if (started) std::cout << "\033[0m\n";
+        if (reply.cancelled) std::cerr << "ai: cancelled\n";
+        else if (reply.text.empty()) std::cerr << "ai: " << reply.error << "\n";
+        return reply;
+    };
 
     if (mode_explain) {
         system_prompt = "You are a shell expert. Explain what the given shell command does in plain English. "
                         "Be concise (3-5 sentences). Cover what it does, flags used, and any risks.";
-        result = callAiProvider(provider, system_prompt, query, 256);
-        if (result.empty()) { std::cerr << "ai: no response\n"; return true; }
-        std::cout << "\033[96m" << result << "\033[0m\n";
+        ask("\033[96m", "", 256, false);
 
     } else if (mode_fix) {
         system_prompt = "You are a shell expert. The user got this error from their terminal. "
                         "Suggest the most likely fix as a shell command or brief explanation. "
                         "Output the fix command first, then a one-sentence explanation.";
-        result = callAiProvider(provider, system_prompt, query, 256);
-        if (result.empty()) { std::cerr << "ai: no response\n"; return true; }
-        std::cout << "\033[93m" << result << "\033[0m\n";
+        ask("\033[93m", "", 256, false);
 
     } else {
         // suggest or run
         system_prompt = "Convert the user's description to a single shell command. "
                         "Output ONLY the command — no explanation, no markdown, no backticks, no newlines.";
-        result = callAiProvider(provider, system_prompt, query, 128);
+        AiResponse reply = ask("\033[90m", "→ ", 128, true);
+        if (reply.cancelled) return true;
+        std::string result = reply.text;
         while (!result.empty() && (result.back() == '\n' || result.back() == ' ')) {
             result.pop_back();
         }
-        if (result.empty()) { std::cerr << "ai: no response\n"; return true; }
-
-        std::cout << "\033[90m→ " << result << "\033[0m\n";
+        if (result.empty()) return true;
 
         if (mode_run) {
             std::cout << "Run this command? [y/N] ";
@@ -744,9 +1170,9 @@ bool AiCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
             std::getline(std::cin, answer);
             if (!answer.empty() && (answer[0] == 'y' || answer[0] == 'Y')) {
                 // Pre-fill readline so user can edit before running
-                add_history(result.c_str());
+                ReadlineSupport::addHistory(result);
                 // Put command into readline's editing buffer and execute
-                state.command_history.push_back(result);
+                if (state.history) state.history->add(result);
                 // Execute it directly
                 std::cout << "\033[90mRunning: " << result << "\033[0m\n";
                 // We'd need access to shell's runSingleCommand — use a sentinel instead
@@ -778,25 +1204,15 @@ bool SourceCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         path = state.home_directory + path.substr(1);
     }
 
-    std::ifstream f(path);
-    if (!f.is_open()) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode) || access(path.c_str(), R_OK) != 0) {
         std::cerr << "source: " << args[1] << ": no such file\n";
         return true;
     }
 
-    // Store lines and execute via pending_source
-    std::vector<std::string> lines;
-    std::string line;
-    while (std::getline(f, line)) {
-        std::string trimmed;
-        size_t a = line.find_first_not_of(" \t");
-        if (a == std::string::npos) continue;
-        size_t b = line.find_last_not_of(" \t");
-        trimmed = line.substr(a, b - a + 1);
-        if (trimmed.empty() || trimmed[0] == '#') continue;
-        lines.push_back(trimmed);
-    }
-    state.source_lines = std::move(lines);
+    // The shell reads and parses the file once it is back in the
+    // evaluator; an unchanged file reuses its cached AST
+    state.source_path = std::move(path);
     state.sourcing = true;
     return true;
 }
@@ -813,7 +1229,7 @@ bool WhichCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         std::cerr << "which: usage: which <command>\n";
         return true;
     }
-    ExecutableResolver resolver;
+    ExecutableResolver resolver(false);
     bool found_any = false;
     for (size_t i = 1; i < args.size(); ++i) {
         // Check alias first
@@ -822,6 +1238,11 @@ bool WhichCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
             found_any = true;
             continue;
         }
+        if (builtins::isBuiltin(args[i])) {
+            std::cout << args[i] << ": shell built-in command\n";
+            found_any = true;
+            continue;
+        }
         std::string path = resolver.findExecutable(args[i]);
         if (!path.empty()) {
             std::cout << path << "\n";
@@ -857,6 +1278,8 @@ bool HelpCommandHandler::handle(const ParsedCommand& /* cmd */, ShellState& /* s
         "  source <file>        execute commands from a file\n"
         "  which <cmd>         show path or alias for a command\n"
         "  read [var ...]      read a line from stdin into variables\n"
+        "  cat [file ...]      copy files (or stdin) to stdout\n"
+        "  tee [-a] [file ...] copy stdin to stdout and to files\n"
         "  pushd <dir>         push dir onto directory stack and cd to it\n"
         "  popd                pop directory stack and cd to top\n"
         "  dirs                print directory stack\n"
@@ -895,78 +1318,91 @@ bool PrintfCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     size_t ai = 2; // arg index
     std::string out;
 
-    for (size_t fi = 0; fi < fmt.size(); ++fi) {
-        if (fmt[fi] == '\\') {
-            if (fi+1 < fmt.size()) {
-                switch (fmt[++fi]) {
-                    case 'n': out += '\n'; break;
-                    case 't': out += '\t'; break;
-                    case 'r': out += '\r'; break;
-                    case '\\': out += '\\'; break;
-                    case '0': out += '\0'; break;
-                    case 'a': out += '\a'; break;
-                    case 'b': out += '\b'; break;
-                    default: out += '\\'; out += fmt[fi]; break;
+    // As in sh, the format is reused until every argument is consumed
+    size_t pass_start;
+    do {
+        pass_start = ai;
+        for (size_t fi = 0; fi < fmt.size(); ++fi) {
+            if (fmt[fi] == '\\') {
+                if (fi+1 < fmt.size()) {
+                    switch (fmt[++fi]) {
+                        case 'n': out += '\n'; break;
+                        case 't': out += '\t'; break;
+                        case 'r': out += '\r'; break;
+                        case '\\': out += '\\'; break;
+                        case '0': out += '\0'; break;
+                        case 'a': out += '\a'; break;
+                        case 'b': out += '\b'; break;
+                        default: out += '\\'; out += fmt[fi]; break;
+                    }
                 }
+                continue;
             }
-            continue;
-        }
-        if (fmt[fi] != '%') { out += fmt[fi]; continue; }
-        // Collect full format spec: %[flags][width][.precision]type
-        std::string spec = "%";
-        ++fi;
-        if (fi >= fmt.size()) { out += '%'; break; }
-        // flags
-        while (fi < fmt.size() && (fmt[fi] == '-' || fmt[fi] == '+' || fmt[fi] == ' ' || fmt[fi] == '0' || fmt[fi] == '#'))
-            spec += fmt[fi++];
-        // width
-        while (fi < fmt.size() && std::isdigit((unsigned char)fmt[fi]))
-            spec += fmt[fi++];
-        // precision
-        if (fi < fmt.size() && fmt[fi] == '.') {
-            spec += fmt[fi++];
+            if (fmt[fi] != '%') { out += fmt[fi]; continue; }
+            // Collect full format spec: %[flags][width][.precision]type
+            std::string spec = "%";
+            ++fi;
+            if (fi >= fmt.size()) { out += '%'; break; }
+            // flags
+            while (fi < fmt.size() && (fmt[fi] == '-' || fmt[fi] == '+' || fmt[fi] == ' ' || fmt[fi] == '0' || fmt[fi] == '#'))
+                spec += fmt[fi++];
+            // width
             while (fi < fmt.size() && std::isdigit((unsigned char)fmt[fi]))
                 spec += fmt[fi++];
-        }
-        if (fi >= fmt.size()) { out += spec; break; }
-        char type = fmt[fi];
-        spec += type;
-
-        std::string val = (ai < args.size()) ? args[ai++] : "";
-        char buf[256];
-        switch (type) {
-            case 'd': case 'i': {
-                long n = 0; try { n = std::stol(val); } catch (...) {}
-                spec.pop_back(); spec += "ld";
-                snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
-            }
-            case 'u': {
-                unsigned long n = 0; try { n = std::stoul(val); } catch (...) {}
-                spec.pop_back(); spec += "lu";
-                snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
-            }
-            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
-                double d = 0; try { d = std::stod(val); } catch (...) {}
-                snprintf(buf, sizeof(buf), spec.c_str(), d); out += buf; break;
-            }
-            case 's': {
-                snprintf(buf, sizeof(buf), spec.c_str(), val.c_str()); out += buf; break;
-            }
-            case 'x': case 'X': {
-                long n = 0; try { n = std::stol(val); } catch (...) {}
-                spec.pop_back(); spec += std::string("l") + type;
-                snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
+            // precision
+            if (fi < fmt.size() && fmt[fi] == '.') {
+                spec += fmt[fi++];
+                while (fi < fmt.size() && std::isdigit((unsigned char)fmt[fi]))
+                    spec += fmt[fi++];
             }
-            case 'o': {
-                long n = 0; try { n = std::stol(val); } catch (...) {}
-                spec.pop_back(); spec += "lo";
-                snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
+            if (fi >= fmt.size()) { out += spec; break; }
+            char type = fmt[fi];
+            spec += type;
+            if (type == '%') { out += '%'; continue; }
+
+            std::string val = (ai < args.size()) ? args[ai++] : "";
+            char buf[256];
+            switch (type) {
+                case 'd': case 'i': {
+                    long n = 0; try { n = std::stol(val); } catch (...) {}
+                    spec.pop_back(); spec += "ld";
+                    snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
+                }
+                case 'u': {
+                    unsigned long n = 0; try { n = std::stoul(val); } catch (...) {}
+                    spec.pop_back(); spec += "lu";
+                    snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
+                }
+                case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                    double d = 0; try { d = std::stod(val); } catch (...) {}
+                    snprintf(buf, sizeof(buf), spec.c_str(), d); out += buf; break;
+                }
+                case 's': {
+                    if (spec == "%s") { out += val; break; }
+                    int n = snprintf(nullptr, 0, spec.c_str(), val.c_str());
+                    if (n > 0) {
+                        std::string padded(static_cast<size_t>(n) + 1, '\0');
+                        snprintf(padded.data(), padded.size(), spec.c_str(), val.c_str());
+                        padded.pop_back();
+                        out += padded;
+                    }
+                    break;
+                }
+                case 'x': case 'X': {
+                    long n = 0; try { n = std::stol(val); } catch (...) {}
+                    spec.pop_back(); spec += std::string("l") + type;
+                    snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
+                }
+                case 'o': {
+                    long n = 0; try { n = std::stol(val); } catch (...) {}
+                    spec.pop_back(); spec += "lo";
+                    snprintf(buf, sizeof(buf), spec.c_str(), n); out += buf; break;
+                }
+                case 'c': out += (val.empty() ? '\0' : val[0]); break;
+                default: out += spec; --ai; break;
             }
-            case 'c': out += (val.empty() ? '\0' : val[0]); break;
-            case '%': out += '%'; --ai; break;
-            default: out += spec; --ai; break;
         }
-    }
+    } while (ai > pass_start && ai < args.size());
     std::cout << out;
     return true;
 }
@@ -974,6 +1410,48 @@ bool PrintfCommandHandler::canHandle(const std::string& command) const { return
 
 // ── KillCommandHandler ────────────────────────────────────────────────────────
 
+// kill %N, %% or %+ (the latest job): the job's process group, or each
+// member still running when the job has no group of its own (for -P
+// iterations share the shell's)
+static bool killJob(const std::string& spec, int sig, const ShellState& state) {
+    IJobManager* jobs = state.job_manager;
+    if (jobs) jobs->reapPending();
+    int job_id = 0;
+    if (jobs && (spec == "%%" || spec == "%+")) {
+        if (!jobs->getJobs().empty()) job_id = jobs->getJobs().rbegin()->first;
+    } else {
+        char* end = nullptr;
+        long number = std::strtol(spec.c_str() + 1, &end, 10);
+        if (spec.size() > 1 && *end == '\0' && number > 0 && number <= INT_MAX) job_id = static_cast<int>(number);
+    }
+    const Job* found = nullptr;
+    if (jobs && job_id) {
+        auto it = jobs->getJobs().find(job_id);
+        if (it != jobs->getJobs().end()) found = &it->second;
+    }
+    if (!found) {
+        std::cerr << "kill: " << spec << ": no such job\n";
+        return false;
+    }
+
+    const Job& job = *found;
+    bool sent = job.pgid > 0 && kill(-job.pgid, sig) == 0;
+    if (!sent) {
+        for (size_t i = 0; i < job.pids.size(); ++i) {
+            if (job.stage_status[i] == -1 && kill(job.pids[i], sig) == 0) sent = true;
+        }
+    }
+    if (!sent) {
+        std::cerr << "kill: " << spec << ": " << strerror(errno) << "\n";
+        return false;
+    }
+    // A stopped job has to run to act on the signal, as in bash
+    if (job.status == JobStatus::STOPPED && sig != SIGKILL && sig != SIGCONT && sig != SIGSTOP) {
+        kill(-job.pgid, SIGCONT);
+    }
+    return true;
+}
+
 bool KillCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
     int sig = SIGTERM;
@@ -1006,16 +1484,24 @@ bool KillCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         ++start;
     }
 
+    bool failed = false;
     for (size_t i = start; i < args.size(); ++i) {
+        if (!args[i].empty() && args[i][0] == '%') {
+            failed = !killJob(args[i], sig, state) || failed;
+            continue;
+        }
         try {
             pid_t pid = std::stoi(args[i]);
-            if (kill(pid, sig) == -1)
+            if (kill(pid, sig) == -1) {
                 std::cerr << "kill: " << strerror(errno) << ": " << args[i] << "\n";
+                failed = true;
+            }
         } catch (...) {
             std::cerr << "kill: invalid pid: " << args[i] << "\n";
+            failed = true;
         }
     }
-    state.last_exit_status = 0;
+    state.last_exit_status = failed ? 1 : 0;
     return true;
 }
 bool KillCommandHandler::canHandle(const std::string& command) const { return command == "kill"; }
@@ -1135,11 +1621,43 @@ bool UlimitCommandHandler::canHandle(const std::string& command) const { return
 
 // ── DeclareCommandHandler ─────────────────────────────────────────────────────
 
+// declare -p form of one variable: declare -a a=([0]="x" [1]="y")
+static std::string describeVariable(const std::string& name, const VariableStore::Variable& var,
+                                    const ShellState& state) {
+    auto quoted = [](const std::string& value) {
+        std::string out = "\"";
+        for (char c : value) {
+            if (c == '"' || c == '\\' || c == '$' || c == '`') out += '\\';
+            out += c;
+        }
+        return out + "\"";
+    };
+    std::string flags;
+    if (var.array) flags += var.array->associative ? 'A' : 'a';
+    if (state.integer_vars.count(name)) flags += 'i';
+    if (state.readonly_vars.count(name)) flags += 'r';
+    if (var.exported) flags += 'x';
+    std::string out = "declare -" + (flags.empty() ? std::string("-") : flags) + " " + name;
+    if (!var.array) return out + "=" + quoted(var.value);
+    // Spaced as bash prints them: a space after each associative entry
+    out += "=(";
+    bool assoc = var.array->associative;
+    var.array->forEach([&](const std::string& key, const std::string& value) {
+        if (!assoc && out.back() != '(') out += ' ';
+        out += "[" + key + "]=" + quoted(value);
+        if (assoc) out += ' ';
+    });
+    return out + ")";
+}
+
 bool DeclareCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
     bool is_integer = false;
     bool is_readonly = false;
     bool is_export = false;
+    bool is_indexed = false;
+    bool is_assoc = false;
+    bool print = false;
 
     size_t start = 1;
     for (; start < args.size() && !args[start].empty() && args[start][0] == '-'; ++start) {
@@ -1147,13 +1665,33 @@ bool DeclareCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
             if (f == 'i') is_integer = true;
             else if (f == 'r') is_readonly = true;
             else if (f == 'x') is_export = true;
+            else if (f == 'a') is_indexed = true;
+            else if (f == 'A') is_assoc = true;
+            else if (f == 'p') print = true;
         }
     }
 
+    VariableStore& vars = VariableStore::global();
     if (start == args.size()) {
-        // Print all variables
-        for (const auto& p : state.environment)
-            std::cout << "declare -- " << p.first << "=" << p.second << "\n";
+        // Print all variables (declare -a / -A: only the arrays of that kind)
+        for (const auto& [name, var] : vars.sorted()) {
+            if ((is_indexed || is_assoc) &&
+                (!var.array || (var.array->associative ? !is_assoc : !is_indexed))) continue;
+            if (print || var.array) std::cout << describeVariable(name, var, state) << "\n";
+            else std::cout << (var.exported ? "declare -x " : "declare -- ") << name << "=" << var.value << "\n";
+        }
+        return true;
+    }
+    if (print) {
+        for (size_t i = start; i < args.size(); ++i) {
+            const VariableStore::Variable* var = vars.lookup(args[i]);
+            if (var) {
+                std::cout << describeVariable(args[i], *var, state) << "\n";
+            } else {
+                std::cerr << "declare: " << args[i] << ": not found\n";
+                state.last_exit_status = 1;
+            }
+        }
         return true;
     }
 
@@ -1166,20 +1704,20 @@ bool DeclareCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
         if (is_integer) {
             state.integer_vars.insert(vname);
             if (eq != std::string::npos) {
-                // evaluate as arithmetic
                 long n = 0;
-                try { n = std::stol(vval); } catch (...) {}
+                ArithmeticEngine::global().evaluate(vval, &state, n);
                 vval = std::to_string(n);
             }
         }
-        if (is_readonly) state.readonly_vars.insert(vname);
-        if (eq != std::string::npos) {
-            state.environment[vname] = vval;
-            setenv(vname.c_str(), vval.c_str(), 1);
-        }
-        if (is_export) {
-            setenv(vname.c_str(), getenv(vname.c_str()) ? getenv(vname.c_str()) : "", 1);
+        if ((is_indexed || is_assoc) && !vars.makeArray(vname, is_assoc)) {
+            std::cerr << "declare: " << vname << ": cannot convert "
+                      << (is_assoc ? "indexed to associative" : "associative to indexed") << " array\n";
+            state.last_exit_status = 1;
+            continue;
         }
+        if (is_readonly) state.readonly_vars.insert(vname);
+        if (eq != std::string::npos) vars.set(vname, std::move(vval));
+        if (is_export) vars.exportVariable(vname);
     }
     return true;
 }
@@ -1200,9 +1738,7 @@ bool ReadonlyCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
         size_t eq = args[i].find('=');
         std::string vname = eq == std::string::npos ? args[i] : args[i].substr(0, eq);
         if (eq != std::string::npos) {
-            std::string vval = args[i].substr(eq + 1);
-            state.environment[vname] = vval;
-            setenv(vname.c_str(), vval.c_str(), 1);
+            VariableStore::global().set(vname, args[i].substr(eq + 1));
         }
         state.readonly_vars.insert(vname);
     }
@@ -1241,15 +1777,14 @@ bool GetoptsCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
     if (pos == std::string::npos) {
         // Unknown option
         state.optopt = opt;
-        state.environment[varname] = "?";
-        setenv(varname.c_str(), "?", 1);
+        VariableStore::global().set(varname, "?");
         ++state.optind;
         state.last_exit_status = 0;
         return true;
     }
 
-    state.environment[varname] = std::string(1, opt);
-    setenv(varname.c_str(), std::string(1, opt).c_str(), 1);
+    VariableStore& vars = VariableStore::global();
+    vars.set(varname, std::string(1, opt));
 
     if (pos + 1 < optstring.size() && optstring[pos+1] == ':') {
         // Requires argument
@@ -1260,13 +1795,11 @@ bool GetoptsCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
             if (state.optind <= (int)state.positional_params.size())
                 state.optarg = state.positional_params[state.optind - 1];
         }
-        setenv("OPTARG", state.optarg.c_str(), 1);
-        state.environment["OPTARG"] = state.optarg;
+        vars.set("OPTARG", state.optarg);
     }
 
     ++state.optind;
-    setenv("OPTIND", std::to_string(state.optind).c_str(), 1);
-    state.environment["OPTIND"] = std::to_string(state.optind);
+    vars.set("OPTIND", std::to_string(state.optind));
     state.last_exit_status = 0;
     return true;
 }
@@ -1301,7 +1834,7 @@ bool CommandCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
 
     if (start >= args.size()) return true;
 
-    ExecutableResolver resolver;
+    ExecutableResolver resolver(!verbose);
     std::string path = resolver.findExecutable(args[start]);
     if (verbose) {
         if (!path.empty()) std::cout << path << "\n";
@@ -1320,6 +1853,7 @@ bool CommandCommandHandler::handle(const ParsedCommand& cmd, ShellState& state)
         for (size_t i = start; i < args.size(); ++i)
             argv.push_back(const_cast<char*>(args[i].c_str()));
         argv.push_back(nullptr);
+        environ = const_cast<char**>(VariableStore::global().envp());
         execvp(path.c_str(), argv.data());
         exit(127);
     }
@@ -1358,7 +1892,11 @@ bool ExecCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     for (size_t i = 1; i < args.size(); ++i)
         argv.push_back(const_cast<char*>(args[i].c_str()));
     argv.push_back(nullptr);
+    // envp() is rebuilt on the next export, so environ must not keep it
+    char** saved_environ = environ;
+    environ = const_cast<char**>(VariableStore::global().envp());
     execvp(path.c_str(), argv.data());
+    environ = saved_environ;
     std::cerr << "exec: " << strerror(errno) << "\n";
     state.last_exit_status = 1;
     return true;
@@ -1405,20 +1943,56 @@ bool TimesCommandHandler::canHandle(const std::string& command) const { return c
 
 bool HashCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
+    PathCache& cache = PathCache::global();
+    state.last_exit_status = 0;
+
+    // hash / hash -l: list remembered commands with their hit counts
     if (args.size() == 1 || (args.size() == 2 && args[1] == "-l")) {
-        for (const auto& p : state.cmd_hash)
-            std::cout << "hits\tcommand\n1\t" << p.second << "\n";
+        auto entries = cache.entries();
+        if (entries.empty()) {
+            std::cout << "hash: hash table empty\n";
+            return true;
+        }
+        if (args.size() == 2) {
+            for (const auto& [name, entry] : entries)
+                std::cout << "builtin hash -p " << entry.path << " " << name << "\n";
+            return true;
+        }
+        std::cout << "hits\tcommand\n";
+        for (const auto& [name, entry] : entries)
+            std::cout << std::setw(4) << entry.hits << "\t" << entry.path << "\n";
         return true;
     }
     if (args.size() == 2 && args[1] == "-r") {
-        state.cmd_hash.clear();
+        cache.clear();
         return true;
     }
-    ExecutableResolver resolver;
-    for (size_t i = 1; i < args.size(); ++i) {
-        std::string path = resolver.findExecutable(args[i]);
-        if (!path.empty()) state.cmd_hash[args[i]] = path;
-        else std::cerr << "hash: " << args[i] << ": not found\n";
+
+    // hash -d NAME...: forget; hash -t NAME...: print remembered path
+    size_t start = 1;
+    bool forget = false, print = false;
+    if (args[1] == "-d") { forget = true; ++start; }
+    else if (args[1] == "-t") { print = true; ++start; }
+
+    ExecutableResolver resolver(false);
+    for (size_t i = start; i < args.size(); ++i) {
+        if (forget) {
+            if (!cache.find(args[i])) {
+                std::cerr << "hash: " << args[i] << ": not found\n";
+                state.last_exit_status = 1;
+            }
+            cache.forget(args[i]);
+            continue;
+        }
+        std::string path = print && cache.find(args[i]) ? cache.find(args[i])->path
+                                                        : resolver.findExecutable(args[i]);
+        if (path.empty()) {
+            std::cerr << "hash: " << args[i] << ": not found\n";
+            state.last_exit_status = 1;
+        } else if (print) {
+            if (args.size() - start > 1) std::cout << args[i] << "\t";
+            std::cout << path << "\n";
+        }
     }
     return true;
 }
@@ -1451,27 +2025,17 @@ bool DisownCommandHandler::canHandle(const std::string& command) const { return
 
 bool LetCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
     const auto& args = cmd.pipeline.commands[0].args;
+    if (args.size() < 2) {
+        std::cerr << "let: expression expected\n";
+        state.last_exit_status = 1;
+        return true;
+    }
+    // Each argument is one expression; assignments (i=i+1, i++) happen in it
     long result = 0;
     for (size_t i = 1; i < args.size(); ++i) {
-        // Simple: eval arithmetic expression, allow VAR=expr
-        std::string expr = args[i];
-        size_t eq = expr.find('=');
-        if (eq != std::string::npos) {
-            std::string vname = expr.substr(0, eq);
-            std::string vexpr = expr.substr(eq + 1);
-            // expand vars in vexpr
-            EnvironmentVariableExpander expander;
-            std::string expanded = expander.expandWithState(vexpr, &state);
-            // eval arithmetic
-            long n = 0;
-            try { n = std::stol(expanded); } catch (...) {}
-            state.environment[vname] = std::to_string(n);
-            setenv(vname.c_str(), std::to_string(n).c_str(), 1);
-            result = n;
-        } else {
-            EnvironmentVariableExpander expander;
-            std::string expanded = expander.expandWithState(expr, &state);
-            try { result = std::stol(expanded); } catch (...) { result = 0; }
+        if (!ArithmeticEngine::global().evaluate(args[i], &state, result)) {
+            state.last_exit_status = 1;
+            return true;
         }
     }
     state.last_exit_status = (result == 0) ? 1 : 0;
@@ -1526,74 +2090,262 @@ bool LocalCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
         std::cerr << "local: can only be used in a function\n";
         return true;
     }
-    for (size_t i = 1; i < args.size(); ++i) {
+    VariableStore& vars = VariableStore::global();
+    bool is_indexed = false;
+    bool is_assoc = false;
+    size_t start = 1;
+    for (; start < args.size() && args[start].size() > 1 && args[start][0] == '-'; ++start) {
+        for (char f : args[start].substr(1)) {
+            if (f == 'a') is_indexed = true;
+            else if (f == 'A') is_assoc = true;
+        }
+    }
+    for (size_t i = start; i < args.size(); ++i) {
         size_t eq = args[i].find('=');
-        if (eq == std::string::npos) {
-            state.var_frames.back().locals[args[i]] = "";
-        } else {
-            std::string vname = args[i].substr(0, eq);
-            std::string vval  = args[i].substr(eq + 1);
-            state.var_frames.back().locals[vname] = vval;
-            setenv(vname.c_str(), vval.c_str(), 1);
+        std::string vname = args[i].substr(0, eq);
+        state.var_frames.back().declare(vname, vars);
+        // A local array starts empty; the shadowed one waits in the frame
+        const VariableStore::Variable* var = vars.lookup(vname);
+        if (is_indexed || is_assoc || (var && var->array)) vars.unset(vname);
+        if (is_indexed || is_assoc) vars.makeArray(vname, is_assoc);
+        if (eq != std::string::npos || !(is_indexed || is_assoc)) {
+            vars.set(vname, eq == std::string::npos ? std::string() : args[i].substr(eq + 1));
         }
     }
     return true;
 }
 bool LocalCommandHandler::canHandle(const std::string& command) const { return command == "local"; }
 
+// ── CatCommandHandler / TeeCommandHandler ─────────────────────────────────────
+
+// The program of the same name, for what the builtin leaves to it. SIGCHLD
+// is held until it has been waited for, so the job reaper cannot take it
+static void runExternal(const std::vector<std::string>& args, ShellState& state) {
+    std::string path = ExecutableResolver().findExecutable(args[0]);
+    if (path.empty()) {
+        std::cerr << "helix: " << args[0] << ": command not found\n";
+        state.last_exit_status = 127;
+        return;
+    }
+    std::cout.flush();
+    sigset_t block, saved;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &saved);
+    pid_t pid = fork();
+    if (pid == 0) {
+        sigprocmask(SIG_SETMASK, &saved, nullptr);
+        std::vector<char*> argv;
+        for (const auto& arg : args) argv.push_back(const_cast<char*>(arg.c_str()));
+        argv.push_back(nullptr);
+        execve(path.c_str(), argv.data(), VariableStore::global().envp());
+        _exit(126);
+    }
+    int status = 0;
+    if (pid > 0) waitForeground(pid, &status, 0, nullptr);
+    sigprocmask(SIG_SETMASK, &saved, nullptr);
+    if (pid < 0) state.last_exit_status = 1;
+    else state.last_exit_status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+}
+
+bool CatCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
+    const auto& args = cmd.pipeline.commands[0].args;
+    std::vector<const std::string*> files;
+    bool options_done = false;
+    bool reads_stdin = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (!options_done && arg == "--") { options_done = true; continue; }
+        if (!options_done && arg == "-u") continue;  // Never buffered anyway
+        if (!options_done && arg.size() > 1 && arg[0] == '-') {
+            runExternal(args, state);  // -n, -A, --help, ...
+            return true;
+        }
+        files.push_back(&arg);
+        reads_stdin = reads_stdin || arg == "-";
+    }
+    if (files.empty()) reads_stdin = true;
+    // Nothing to gain on a terminal, and the program behaves as users expect there
+    if (isatty(STDOUT_FILENO) || (reads_stdin && isatty(STDIN_FILENO))) {
+        runExternal(args, state);
+        return true;
+    }
+
+    std::cout.flush();
+    struct stat out_st;
+    bool out_regular = fstat(STDOUT_FILENO, &out_st) == 0 && S_ISREG(out_st.st_mode);
+    static const std::string kStdin = "-";
+    if (files.empty()) files.push_back(&kStdin);
+
+    state.last_exit_status = 0;
+    for (const std::string* file : files) {
+        bool is_stdin = *file == "-";
+        int fd = is_stdin ? STDIN_FILENO : open(file->c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            std::cerr << "cat: " << *file << ": " << strerror(errno) << "\n";
+            state.last_exit_status = 1;
+            continue;
+        }
+        struct stat st;
+        const char* problem = nullptr;
+        if (fstat(fd, &st) == 0) {
+            if (S_ISDIR(st.st_mode)) {
+                problem = "Is a directory";
+            } else if (out_regular && S_ISREG(st.st_mode) && st.st_dev == out_st.st_dev &&
+                       st.st_ino == out_st.st_ino && lseek(fd, 0, SEEK_CUR) < st.st_size) {
+                problem = "input file is output file";
+            }
+        }
+        bool ok = true;
+        if (problem) {
+            std::cerr << "cat: " << *file << ": " << problem << "\n";
+            state.last_exit_status = 1;
+        } else if (!StreamCopy::copy(fd, STDOUT_FILENO)) {
+            std::cerr << "cat: " << *file << ": " << strerror(errno) << "\n";
+            state.last_exit_status = 1;
+            ok = errno != EPIPE;
+        }
+        if (!is_stdin) close(fd);
+        if (!ok) break;
+    }
+    return true;
+}
+
+bool CatCommandHandler::canHandle(const std::string& command) const { return command == "cat"; }
+
+bool TeeCommandHandler::handle(const ParsedCommand& cmd, ShellState& state) {
+    const auto& args = cmd.pipeline.commands[0].args;
+    bool append = false;
+    bool ignore_interrupts = false;
+    std::vector<const std::string*> names;
+    bool options_done = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        const std::string& arg = args[i];
+        if (!options_done && arg == "--") { options_done = true; continue; }
+        if (!options_done && arg.size() > 1 && arg[0] == '-' &&
+            arg.find_first_not_of("ai", 1) == std::string::npos) {
+            append = append || arg.find('a') != std::string::npos;
+            ignore_interrupts = ignore_interrupts || arg.find('i') != std::string::npos;
+            continue;
+        }
+        if (!options_done && arg.size() > 1 && arg[0] == '-') {
+            runExternal(args, state);  // -p, --output-error, --help, ...
+            return true;
+        }
+        names.push_back(&arg);
+    }
+    if (isatty(STDIN_FILENO)) {
+        runExternal(args, state);
+        return true;
+    }
+
+    std::cout.flush();
+    state.last_exit_status = 0;
+    std::vector<int> fds;
+    std::vector<const std::string*> opened;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC);
+    for (const std::string* name : names) {
+        int fd = open(name->c_str(), flags, 0666);
+        if (fd == -1) {
+            std::cerr << "tee: " << *name << ": " << strerror(errno) << "\n";
+            state.last_exit_status = 1;
+            continue;
+        }
+        fds.push_back(fd);
+        opened.push_back(name);
+    }
+
+    struct sigaction ignore {}, saved_int {};
+    if (ignore_interrupts) {
+        ignore.sa_handler = SIG_IGN;
+        sigaction(SIGINT, &ignore, &saved_int);
+    }
+    std::vector<int> errors;
+    if (!StreamCopy::tee(STDIN_FILENO, STDOUT_FILENO, fds, errors)) {
+        std::cerr << "tee: 'standard output': " << strerror(errno) << "\n";
+        state.last_exit_status = 1;
+    }
+    if (ignore_interrupts) sigaction(SIGINT, &saved_int, nullptr);
+    for (size_t i = 0; i < fds.size(); ++i) {
+        if (i < errors.size() && errors[i] != 0) {
+            std::cerr << "tee: " << *opened[i] << ": " << strerror(errors[i]) << "\n";
+            state.last_exit_status = 1;
+        }
+        close(fds[i]);
+    }
+    return true;
+}
+
+bool TeeCommandHandler::canHandle(const std::string& command) const { return command == "tee"; }
+
 // BuiltinCommandDispatcher implementation
-BuiltinCommandDispatcher::BuiltinCommandDispatcher() {
-    handlers["cd"]      = std::make_unique<CdCommandHandler>();
-    handlers["exit"]    = std::make_unique<ExitCommandHandler>();
-    handlers["history"] = std::make_unique<HistoryCommandHandler>();
-    handlers["jobs"]    = std::make_unique<JobsCommandHandler>();
-    handlers["fg"]      = std::make_unique<FgCommandHandler>();
-    handlers["bg"]      = std::make_unique<BgCommandHandler>();
-    handlers["pwd"]     = std::make_unique<PwdCommandHandler>();
-    handlers["export"]  = std::make_unique<ExportCommandHandler>();
-    handlers["echo"]    = std::make_unique<EchoCommandHandler>();
-    handlers["help"]    = std::make_unique<HelpCommandHandler>();
-    handlers["alias"]   = std::make_unique<AliasCommandHandler>();
-    handlers["unalias"] = std::make_unique<UnaliasCommandHandler>();
-    handlers["unset"]   = std::make_unique<UnsetCommandHandler>();
-    handlers["type"]    = std::make_unique<TypeCommandHandler>();
-    handlers["ai"]      = std::make_unique<AiCommandHandler>();
-    handlers["source"]  = std::make_unique<SourceCommandHandler>();
-    handlers["."]       = std::make_unique<SourceCommandHandler>();
-    handlers["which"]   = std::make_unique<WhichCommandHandler>();
-    handlers["read"]    = std::make_unique<ReadCommandHandler>();
-    handlers["pushd"]   = std::make_unique<PushdCommandHandler>();
-    handlers["popd"]    = std::make_unique<PopdCommandHandler>();
-    handlers["dirs"]    = std::make_unique<DirsCommandHandler>();
-    handlers["wait"]    = std::make_unique<WaitCommandHandler>();
-    handlers["true"]    = std::make_unique<TrueCommandHandler>();
-    handlers["false"]   = std::make_unique<FalseCommandHandler>();
-    handlers["set"]      = std::make_unique<SetCommandHandler>();
-    handlers["test"]     = std::make_unique<TestCommandHandler>();
-    handlers["["]        = std::make_unique<TestCommandHandler>();
-    handlers["printf"]   = std::make_unique<PrintfCommandHandler>();
-    handlers["kill"]     = std::make_unique<KillCommandHandler>();
-    handlers["trap"]     = std::make_unique<TrapCommandHandler>();
-    handlers["umask"]    = std::make_unique<UmaskCommandHandler>();
-    handlers["ulimit"]   = std::make_unique<UlimitCommandHandler>();
-    handlers["declare"]  = std::make_unique<DeclareCommandHandler>();
-    handlers["typeset"]  = std::make_unique<DeclareCommandHandler>();
-    handlers["readonly"] = std::make_unique<ReadonlyCommandHandler>();
-    handlers["getopts"]  = std::make_unique<GetoptsCommandHandler>();
-    handlers["shift"]    = std::make_unique<ShiftCommandHandler>();
-    handlers["command"]  = std::make_unique<CommandCommandHandler>();
-    handlers["builtin"]  = std::make_unique<BuiltinCommandCommandHandler>();
-    handlers["exec"]     = std::make_unique<ExecCommandHandler>();
-    handlers["eval"]     = std::make_unique<EvalCommandHandler>();
-    handlers["times"]    = std::make_unique<TimesCommandHandler>();
-    handlers["hash"]     = std::make_unique<HashCommandHandler>();
-    handlers["suspend"]  = std::make_unique<SuspendCommandHandler>();
-    handlers["disown"]   = std::make_unique<DisownCommandHandler>();
-    handlers["let"]      = std::make_unique<LetCommandHandler>();
-    handlers["return"]   = std::make_unique<ReturnCommandHandler>();
-    handlers["break"]    = std::make_unique<BreakCommandHandler>();
-    handlers["continue"] = std::make_unique<ContinueCommandHandler>();
-    handlers["local"]    = std::make_unique<LocalCommandHandler>();
+// Handlers are stateless strategies, built the first time their name runs
+// (`helix -c true` constructs one, not fifty)
+static std::unique_ptr<BuiltinCommandHandler> makeHandler(builtins::Handler id) {
+    using H = builtins::Handler;
+    switch (id) {
+    case H::Cd:        return std::make_unique<CdCommandHandler>();
+    case H::Exit:      return std::make_unique<ExitCommandHandler>();
+    case H::History:   return std::make_unique<HistoryCommandHandler>();
+    case H::Jobs:      return std::make_unique<JobsCommandHandler>();
+    case H::Fg:        return std::make_unique<FgCommandHandler>();
+    case H::Bg:        return std::make_unique<BgCommandHandler>();
+    case H::Pwd:       return std::make_unique<PwdCommandHandler>();
+    case H::Export:    return std::make_unique<ExportCommandHandler>();
+    case H::Echo:      return std::make_unique<EchoCommandHandler>();
+    case H::Help:      return std::make_unique<HelpCommandHandler>();
+    case H::Alias:     return std::make_unique<AliasCommandHandler>();
+    case H::Unalias:   return std::make_unique<UnaliasCommandHandler>();
+    case H::Unset:     return std::make_unique<UnsetCommandHandler>();
+    case H::Type:      return std::make_unique<TypeCommandHandler>();
+    case H::Ai:        return std::make_unique<AiCommandHandler>();
+    case H::Source:    return std::make_unique<SourceCommandHandler>();
+    case H::Which:     return std::make_unique<WhichCommandHandler>();
+    case H::Read:      return std::make_unique<ReadCommandHandler>();
+    case H::Pushd:     return std::make_unique<PushdCommandHandler>();
+    case H::Popd:      return std::make_unique<PopdCommandHandler>();
+    case H::Dirs:      return std::make_unique<DirsCommandHandler>();
+    case H::Wait:      return std::make_unique<WaitCommandHandler>();
+    case H::True:      return std::make_unique<TrueCommandHandler>();
+    case H::False:     return std::make_unique<FalseCommandHandler>();
+    case H::Set:       return std::make_unique<SetCommandHandler>();
+    case H::Test:      return std::make_unique<TestCommandHandler>();
+    case H::Printf:    return std::make_unique<PrintfCommandHandler>();
+    case H::Kill:      return std::make_unique<KillCommandHandler>();
+    case H::Trap:      return std::make_unique<TrapCommandHandler>();
+    case H::Umask:     return std::make_unique<UmaskCommandHandler>();
+    case H::Ulimit:    return std::make_unique<UlimitCommandHandler>();
+    case H::Declare:   return std::make_unique<DeclareCommandHandler>();
+    case H::Readonly:  return std::make_unique<ReadonlyCommandHandler>();
+    case H::Getopts:   return std::make_unique<GetoptsCommandHandler>();
+    case H::Shift:     return std::make_unique<ShiftCommandHandler>();
+    case H::Command:   return std::make_unique<CommandCommandHandler>();
+    case H::Builtin:   return std::make_unique<BuiltinCommandCommandHandler>();
+    case H::Exec:      return std::make_unique<ExecCommandHandler>();
+    case H::Eval:      return std::make_unique<EvalCommandHandler>();
+    case H::Times:     return std::make_unique<TimesCommandHandler>();
+    case H::Hash:      return std::make_unique<HashCommandHandler>();
+    case H::Suspend:   return std::make_unique<SuspendCommandHandler>();
+    case H::Disown:    return std::make_unique<DisownCommandHandler>();
+    case H::Let:       return std::make_unique<LetCommandHandler>();
+    case H::Return:    return std::make_unique<ReturnCommandHandler>();
+    case H::Break:     return std::make_unique<BreakCommandHandler>();
+    case H::Continue:  return std::make_unique<ContinueCommandHandler>();
+    case H::Local:     return std::make_unique<LocalCommandHandler>();
+    case H::Mapfile:   return std::make_unique<MapfileCommandHandler>();
+    case H::Cat:       return std::make_unique<CatCommandHandler>();
+    case H::Tee:       return std::make_unique<TeeCommandHandler>();
+    case H::Count:     break;
+    }
+    return nullptr;
+}
+
+BuiltinCommandDispatcher::BuiltinCommandDispatcher() = default;
+
+BuiltinCommandHandler& BuiltinCommandDispatcher::handler(builtins::Handler id) {
+    auto& slot = handlers[static_cast<size_t>(id)];
+    if (!slot) slot = makeHandler(id);
+    return *slot;
 }
 
 bool BuiltinCommandDispatcher::dispatch(const ParsedCommand& cmd, ShellState& state) {
@@ -1601,17 +2353,19 @@ bool BuiltinCommandDispatcher::dispatch(const ParsedCommand& cmd, ShellState& st
         return false;
     }
 
-    const std::string& command = cmd.pipeline.commands[0].args[0];
-    auto it = handlers.find(command);
-    if (it != handlers.end()) {
-        return it->second->handle(cmd, state);
-    }
-
-    return false;
+    const builtins::Entry* entry = builtins::find(cmd.pipeline.commands[0].args[0]);
+    return entry && handler(entry->handler).handle(cmd, state);
 }
 
 bool BuiltinCommandDispatcher::isBuiltin(const std::string& command) const {
-    return handlers.find(command) != handlers.end();
+    return builtins::isBuiltin(command);
+}
+
+std::vector<std::string> BuiltinCommandDispatcher::names() const {
+    std::vector<std::string> out;
+    out.reserve(builtins::kTable.size());
+    for (const auto& entry : builtins::kTable) out.emplace_back(entry.name);
+    return out;
 }
 
 } // namespace helix
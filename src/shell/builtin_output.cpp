@@ -0,0 +1,168 @@
+#include "shell/builtin_output.h"
+#include "executor/fd_utils.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace helix {
+
+// ── FdStreambuf ──────────────────────────────────────────────────────────────
+
+bool FdStreambuf::writeOut(const char* extra, size_t extra_len) {
+    struct iovec iov[2];
+    int count = 0;
+    if (!pending_.empty()) iov[count++] = {pending_.data(), pending_.size()};
+    if (extra_len > 0) iov[count++] = {const_cast<char*>(extra), extra_len};
+
+    while (count > 0 && error_ == 0) {
+        ssize_t n = writev(fd_, iov, count);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            error_ = errno;
+            break;
+        }
+        // Drop what was written from the front of the vector
+        size_t done = static_cast<size_t>(n);
+        int first = 0;
+        while (first < count && done >= iov[first].iov_len) done -= iov[first++].iov_len;
+        if (first < count) {
+            iov[first].iov_base = static_cast<char*>(iov[first].iov_base) + done;
+            iov[first].iov_len -= done;
+        }
+        for (int i = first; i < count; ++i) iov[i - first] = iov[i];
+        count -= first;
+    }
+    pending_.clear();
+    return error_ == 0;
+}
+
+bool FdStreambuf::flush() {
+    if (pending_.empty()) return error_ == 0;
+    return writeOut(nullptr, 0);
+}
+
+FdStreambuf::int_type FdStreambuf::overflow(int_type c) {
+    if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+    if (pending_.size() >= kCapacity && !flush()) return traits_type::eof();
+    pending_ += traits_type::to_char_type(c);
+    return c;
+}
+
+std::streamsize FdStreambuf::xsputn(const char* s, std::streamsize n) {
+    size_t len = static_cast<size_t>(n);
+    if (pending_.size() + len <= kCapacity) {
+        pending_.append(s, len);
+        return n;
+    }
+    return writeOut(s, len) ? n : 0;
+}
+
+// ── BuiltinOutput ────────────────────────────────────────────────────────────
+
+bool BuiltinOutput::handles(const Command& cmd) {
+    for (const Redirection& r : cmd.redirections) {
+        switch (r.kind) {
+        case Redirection::Kind::INPUT:
+        case Redirection::Kind::HEREDOC:
+        case Redirection::Kind::HEREDOC_STRIP:
+        case Redirection::Kind::HERESTRING:
+        case Redirection::Kind::DUP_IN:
+            return false;
+        default:
+            break;
+        }
+    }
+    return true;
+}
+
+BuiltinOutput::BuiltinOutput(const Command& cmd)
+    : saved_out_(std::cout.rdbuf()), saved_err_(std::cerr.rdbuf()) {
+    using Kind = Redirection::Kind;
+    std::streambuf* out = saved_out_;
+    std::streambuf* err = saved_err_;
+    for (const Redirection& r : cmd.redirections) {
+        switch (r.kind) {
+        case Kind::OUTPUT:
+        case Kind::APPEND:
+            out = open(r.target, r.kind == Kind::APPEND);
+            break;
+        case Kind::ERROR:
+        case Kind::ERROR_APPEND:
+            err = open(r.target, r.kind == Kind::ERROR_APPEND);
+            break;
+        case Kind::BOTH:
+        case Kind::BOTH_APPEND:
+            out = err = open(r.target, r.kind == Kind::BOTH_APPEND);
+            break;
+        case Kind::DUP_OUT:
+            out = duplicate(r.target);
+            break;
+        case Kind::ERR_TO_OUT:
+            err = out;
+            break;
+        case Kind::OUT_TO_ERR:
+            // Output already written to stdout must come out first
+            if (out == saved_out_) saved_out_->pubsync();
+            out = err;
+            break;
+        default:
+            break;  // Input: see handles()
+        }
+        if (!ok_) return;
+        // Later opens report failures where the earlier ones point
+        std::cerr.rdbuf(err);
+    }
+    std::cout.rdbuf(out);
+    std::cerr.rdbuf(err);
+}
+
+BuiltinOutput::~BuiltinOutput() {
+    finish();
+}
+
+std::streambuf* BuiltinOutput::open(const std::string& path, bool append) {
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0644);
+    if (fd == -1) {
+        std::cerr << "Failed to open output file: " << path << " - " << strerror(errno) << "\n";
+        ok_ = false;
+        return nullptr;
+    }
+    fds_.push_back(fd);
+    buffers_.push_back(std::make_unique<FdStreambuf>(fd));
+    return buffers_.back().get();
+}
+
+std::streambuf* BuiltinOutput::duplicate(const std::string& target) {
+    int source = parseFdNumber(target);
+    bool named = source != -1 && (source <= STDERR_FILENO || isSharedFd(source));
+    int fd = named ? fcntl(source, F_DUPFD_CLOEXEC, 3) : -1;
+    if (fd == -1) {
+        if (source == -1) std::cerr << "helix: " << target << ": ambiguous redirect\n";
+        else std::cerr << "helix: " << source << ": Bad file descriptor\n";
+        ok_ = false;
+        return nullptr;
+    }
+    fds_.push_back(fd);
+    buffers_.push_back(std::make_unique<FdStreambuf>(fd));
+    return buffers_.back().get();
+}
+
+bool BuiltinOutput::finish() {
+    if (finished_) return true;
+    finished_ = true;
+    // rdbuf() also clears a failbit a failed write left on the stream
+    std::cout.rdbuf(saved_out_);
+    std::cerr.rdbuf(saved_err_);
+    int error = 0;
+    for (auto& buffer : buffers_) {
+        if (!buffer->flush() && !error) error = buffer->error();
+    }
+    for (int fd : fds_) close(fd);
+    if (error) errno = error;
+    return error == 0;
+}
+
+} // namespace helix
@@ -0,0 +1,294 @@
+#include "shell/history_store.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+struct Control {
+    bool ignorespace = false;
+    bool ignoredups = false;
+    bool erasedups = false;
+};
+
+Control parseControl(std::string_view value) {
+    Control c;
+    while (!value.empty()) {
+        size_t colon = value.find(':');
+        std::string_view word = value.substr(0, colon);
+        if (word == "ignorespace" || word == "ignoreboth") c.ignorespace = true;
+        if (word == "ignoredups" || word == "ignoreboth") c.ignoredups = true;
+        if (word == "erasedups") c.erasedups = true;
+        value = colon == std::string_view::npos ? std::string_view() : value.substr(colon + 1);
+    }
+    return c;
+}
+
+// Newest non-empty line of [begin, end) that starts before end; end moves
+// to that line's start so repeated calls walk backwards
+std::optional<std::string_view> previousLine(const char* begin, const char*& end) {
+    while (end > begin) {
+        const char* line_end = end;
+        while (line_end > begin && line_end[-1] == '\n') --line_end;
+        if (line_end == begin) { end = begin; break; }
+        const void* nl = memrchr(begin, '\n', static_cast<size_t>(line_end - begin));
+        const char* start = nl ? static_cast<const char*>(nl) + 1 : begin;
+        end = start;
+        return std::string_view(start, static_cast<size_t>(line_end - start));
+    }
+    return std::nullopt;
+}
+
+} // namespace
+
+HistoryStore::~HistoryStore() {
+    if (map_) munmap(const_cast<char*>(map_), map_size_);
+    if (append_fd_ != -1) close(append_fd_);
+}
+
+bool HistoryStore::open(const std::string& path) {
+    if (map_) munmap(const_cast<char*>(map_), map_size_);
+    if (append_fd_ != -1) close(append_fd_);
+    map_ = nullptr;
+    map_size_ = 0;
+    append_fd_ = -1;
+    path_ = path;
+    session_.clear();
+    indexed_ = prefix_indexed_ = dedup_indexed_ = false;
+    starts_.clear();
+    dead_.clear();
+    dead_count_ = 0;
+    by_prefix_.clear();
+    latest_.clear();
+
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) return errno == ENOENT;
+
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0;
+    if (ok && st.st_size > 0) {
+        void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            ok = false;
+        } else {
+            map_ = static_cast<const char*>(map);
+            map_size_ = static_cast<size_t>(st.st_size);
+        }
+    }
+    close(fd);
+    return ok;
+}
+
+bool HistoryStore::add(std::string_view line, std::string_view control) {
+    if (line.empty()) return false;
+    Control c = parseControl(control);
+    if (c.ignorespace && line.front() == ' ') return false;
+    if (c.ignoredups) {
+        if (auto prev = last(); prev && *prev == line) return false;
+    }
+
+    if (c.erasedups) {
+        ensureDedupIndex();
+        if (auto it = latest_.find(line); it != latest_.end() && !dead_[it->second]) {
+            dead_[it->second] = true;
+            ++dead_count_;
+        }
+    }
+
+    session_.emplace_back(line);
+    if (indexed_) {
+        dead_.push_back(false);
+        indexSlot(slotCount() - 1);
+    }
+
+    if (path_.empty()) return true;
+    if (append_fd_ == -1) {
+        append_fd_ = ::open(path_.c_str(), O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+        if (append_fd_ == -1) { path_.clear(); return true; }  // Keep the in-memory history
+    }
+
+    // One write() per entry: O_APPEND keeps concurrent shells' lines whole.
+    // A file that was left without a final newline gets one first
+    std::string record;
+    record.reserve(line.size() + 2);
+    if (session_.size() == 1 && map_size_ > 0 && map_[map_size_ - 1] != '\n') record += '\n';
+    record.append(line).append(1, '\n');
+    const char* p = record.data();
+    size_t left = record.size();
+    while (left > 0) {
+        ssize_t n = write(append_fd_, p, left);
+        if (n == -1 && errno == EINTR) continue;
+        if (n <= 0) break;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+size_t HistoryStore::size() const {
+    ensureIndexed();
+    return slotCount() - dead_count_;
+}
+
+std::optional<std::string_view> HistoryStore::at(size_t n) const {
+    auto i = slotOfEntry(n);
+    if (!i) return std::nullopt;
+    return slot(*i);
+}
+
+// The newest entry is never a tombstone (erasedups only removes older
+// copies), so this needs no index
+std::optional<std::string_view> HistoryStore::last() const {
+    if (!session_.empty()) return std::string_view(session_.back());
+    const char* end = map_ + map_size_;
+    return map_ ? previousLine(map_, end) : std::nullopt;
+}
+
+std::optional<std::string_view> HistoryStore::findPrefix(std::string_view prefix) const {
+    if (prefix.empty()) return last();
+    ensurePrefixIndex();
+
+    // Newest live slot of a bucket accepted by match
+    auto newest = [this](const std::vector<uint32_t>& bucket, auto match) -> std::optional<size_t> {
+        for (auto it = bucket.rbegin(); it != bucket.rend(); ++it) {
+            if (!dead_[*it] && match(slot(*it))) return *it;
+        }
+        return std::nullopt;
+    };
+
+    std::optional<size_t> best;
+    if (prefix.size() >= 2) {
+        auto it = by_prefix_.find(prefixKey(prefix));
+        if (it != by_prefix_.end()) {
+            best = newest(it->second, [prefix](std::string_view s) { return s.starts_with(prefix); });
+        }
+    } else {
+        // One byte: the newest of the buckets sharing that first byte
+        uint16_t high = static_cast<uint16_t>(static_cast<unsigned char>(prefix[0]) << 8);
+        for (unsigned low = 0; low < 256; ++low) {
+            auto it = by_prefix_.find(static_cast<uint16_t>(high | low));
+            if (it == by_prefix_.end()) continue;
+            auto found = newest(it->second, [](std::string_view) { return true; });
+            if (found && (!best || *found > *best)) best = found;
+        }
+    }
+    if (!best) return std::nullopt;
+    return slot(*best);
+}
+
+std::optional<std::string_view> HistoryStore::findSubstring(std::string_view text) const {
+    ensureIndexed();
+    for (size_t i = slotCount(); i-- > 0;) {
+        if (dead_[i]) continue;
+        std::string_view s = slot(i);
+        if (s.find(text) != std::string_view::npos) return s;
+    }
+    return std::nullopt;
+}
+
+std::vector<std::string_view> HistoryStore::tail(size_t count) const {
+    std::vector<std::string_view> out;
+    if (indexed_) {
+        for (size_t i = slotCount(); i-- > 0 && out.size() < count;) {
+            if (!dead_[i]) out.push_back(slot(i));
+        }
+    } else {
+        // Nothing is erased before the index exists
+        for (auto it = session_.rbegin(); it != session_.rend() && out.size() < count; ++it) {
+            out.push_back(*it);
+        }
+        const char* end = map_ + map_size_;
+        while (map_ && out.size() < count) {
+            auto line = previousLine(map_, end);
+            if (!line) break;
+            out.push_back(*line);
+        }
+    }
+    return {out.rbegin(), out.rend()};
+}
+
+void HistoryStore::forEach(const std::function<void(size_t, std::string_view)>& fn) const {
+    ensureIndexed();
+    size_t number = 0;
+    for (size_t i = 0; i < slotCount(); ++i) {
+        if (!dead_[i]) fn(++number, slot(i));
+    }
+}
+
+// ── Indexes ──────────────────────────────────────────────────────────────────
+
+std::string_view HistoryStore::slot(size_t i) const {
+    if (i >= starts_.size()) return session_[i - starts_.size()];
+    const char* start = map_ + starts_[i];
+    size_t left = map_size_ - starts_[i];
+    const void* nl = std::memchr(start, '\n', left);
+    return {start, nl ? static_cast<size_t>(static_cast<const char*>(nl) - start) : left};
+}
+
+void HistoryStore::ensureIndexed() const {
+    if (indexed_) return;
+    size_t pos = 0;
+    while (pos < map_size_) {
+        const void* nl = std::memchr(map_ + pos, '\n', map_size_ - pos);
+        size_t end = nl ? static_cast<size_t>(static_cast<const char*>(nl) - map_) : map_size_;
+        if (end > pos) starts_.push_back(pos);
+        pos = end + 1;
+    }
+    dead_.assign(starts_.size() + session_.size(), false);
+    indexed_ = true;
+}
+
+void HistoryStore::ensurePrefixIndex() const {
+    ensureIndexed();
+    if (prefix_indexed_) return;
+    prefix_indexed_ = true;
+    for (size_t i = 0; i < slotCount(); ++i) {
+        by_prefix_[prefixKey(slot(i))].push_back(static_cast<uint32_t>(i));
+    }
+}
+
+// Also tombstones duplicates already in the list: with erasedups each
+// command appears once, at its newest position
+void HistoryStore::ensureDedupIndex() const {
+    ensureIndexed();
+    if (dedup_indexed_) return;
+    dedup_indexed_ = true;
+    latest_.reserve(slotCount());
+    for (size_t i = 0; i < slotCount(); ++i) {
+        if (dead_[i]) continue;
+        auto [it, inserted] = latest_.try_emplace(slot(i), static_cast<uint32_t>(i));
+        if (!inserted) {
+            dead_[it->second] = true;
+            ++dead_count_;
+            it->second = static_cast<uint32_t>(i);
+        }
+    }
+}
+
+void HistoryStore::indexSlot(size_t i) const {
+    if (prefix_indexed_) by_prefix_[prefixKey(slot(i))].push_back(static_cast<uint32_t>(i));
+    if (dedup_indexed_) latest_[slot(i)] = static_cast<uint32_t>(i);
+}
+
+std::optional<size_t> HistoryStore::slotOfEntry(size_t n) const {
+    ensureIndexed();
+    if (n == 0 || n > slotCount() - dead_count_) return std::nullopt;
+    if (dead_count_ == 0) return n - 1;
+    for (size_t i = 0; i < slotCount(); ++i) {
+        if (!dead_[i] && --n == 0) return i;
+    }
+    return std::nullopt;
+}
+
+uint16_t HistoryStore::prefixKey(std::string_view line) {
+    unsigned high = line.empty() ? 0 : static_cast<unsigned char>(line[0]);
+    unsigned low = line.size() < 2 ? 0 : static_cast<unsigned char>(line[1]);
+    return static_cast<uint16_t>(high << 8 | low);
+}
+
+} // namespace helix
@@ -0,0 +1,133 @@
+#include "shell/input_buffer.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// One buffer per descriptor number, never freed once made (references to
+// them stay valid), so the map only grows with the descriptors read from
+std::unordered_map<int, std::unique_ptr<InputBuffer>>& buffers() {
+    static std::unordered_map<int, std::unique_ptr<InputBuffer>> map;
+    return map;
+}
+
+} // namespace
+
+InputBuffer& InputBuffer::forFd(int fd) {
+    auto& map = buffers();
+    auto it = map.find(fd);
+    if (it == map.end()) it = map.emplace(fd, std::unique_ptr<InputBuffer>(new InputBuffer(fd))).first;
+    return *it->second;
+}
+
+void InputBuffer::discard(int fd) {
+    auto& map = buffers();
+    auto it = map.find(fd);
+    if (it == map.end()) return;
+    InputBuffer& buffer = *it->second;
+    buffer.offset_ = -1;
+    buffer.buffer_.clear();
+    buffer.pos_ = 0;
+}
+
+InputBuffer::Status InputBuffer::read(std::string& out, int delim, size_t max) {
+    if (max == 0) return Status::Full;
+    return readSeekable(out, delim, max);
+}
+
+InputBuffer::Status InputBuffer::readAll(std::string& out) {
+    // The descriptor's offset is always just past what was consumed, so the
+    // read-ahead can simply go
+    offset_ = -1;
+    buffer_.clear();
+    pos_ = 0;
+    for (;;) {
+        size_t size = out.size();
+        out.resize(size + kChunk * 4);
+        ssize_t n = ::read(fd_, out.data() + size, kChunk * 4);
+        out.resize(size + (n > 0 ? static_cast<size_t>(n) : 0));
+        if (n > 0) continue;
+        if (n == 0) return Status::Eof;
+        if (errno != EINTR) return Status::Error;
+    }
+}
+
+// ── Seekable input ───────────────────────────────────────────────────────────
+
+InputBuffer::Status InputBuffer::readSeekable(std::string& out, int delim, size_t max) {
+    off_t here = lseek(fd_, 0, SEEK_CUR);
+    if (here < 0) return readBytewise(out, delim, max);
+    if (here != offset_) {
+        // First read, or something else moved the offset: start over there
+        buffer_.clear();
+        pos_ = 0;
+        offset_ = here;
+    }
+
+    Status status = Status::Eof;
+    size_t taken = 0;
+    for (;;) {
+        if (pos_ == buffer_.size()) {
+            buffer_.resize(kChunk);
+            pos_ = 0;
+            ssize_t n;
+            do n = pread(fd_, buffer_.data(), kChunk, offset_);
+            while (n < 0 && errno == EINTR);
+            buffer_.resize(n > 0 ? static_cast<size_t>(n) : 0);
+            if (n <= 0) {
+                if (n < 0) status = Status::Error;
+                break;
+            }
+        }
+        const char* start = buffer_.data() + pos_;
+        size_t avail = std::min(buffer_.size() - pos_, max - taken);
+        const void* hit = delim >= 0 ? std::memchr(start, delim, avail) : nullptr;
+        size_t len = hit ? static_cast<size_t>(static_cast<const char*>(hit) - start) : avail;
+        out.append(start, len);
+        size_t used = len + (hit ? 1 : 0);
+        pos_ += used;
+        offset_ += static_cast<off_t>(used);
+        taken += used;
+        if (hit || taken == max) {
+            status = hit ? Status::Ok : Status::Full;
+            break;
+        }
+    }
+
+    // Hand back what was read ahead: the offset ends just past the record
+    if (offset_ != here) {
+        int saved_errno = errno;
+        lseek(fd_, offset_, SEEK_SET);
+        errno = saved_errno;
+    }
+    return status;
+}
+
+// ── Pipes and terminals ──────────────────────────────────────────────────────
+
+InputBuffer::Status InputBuffer::readBytewise(std::string& out, int delim, size_t max) {
+    offset_ = -1;
+    buffer_.clear();
+    pos_ = 0;
+    for (size_t taken = 0; taken < max;) {
+        char c;
+        ssize_t n = ::read(fd_, &c, 1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return Status::Error;
+        }
+        if (n == 0) return Status::Eof;
+        ++taken;
+        if (static_cast<unsigned char>(c) == delim) return Status::Ok;
+        out += c;
+    }
+    return Status::Full;
+}
+
+} // namespace helix
@@ -1,38 +1,123 @@
 #include "shell/job_manager.h"
+#include "executor/child_wait.h"
 #include <iostream>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <unistd.h>
 #include <csignal>
 #include <cerrno>
+#include <cstdio>
 #include <cstring>
+#include <ctime>
 
 namespace helix {
 
-void JobManager::addJob(int pid, const std::string& command) {
+// CLOCK_MONOTONIC in microseconds; async-signal-safe
+static long long monotonicMicros() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+int JobManager::addJob(int pid, const std::string& command) {
+    return addJob(pid, std::vector<pid_t>{pid}, command);
+}
+
+int JobManager::addJob(pid_t pgid, const std::vector<pid_t>& pids, const std::string& command) {
     Job job;
-    job.job_id = next_job_id++;
-    job.pgid = pid;
+    // As in bash: one past the highest job still listed
+    job.job_id = jobs.empty() ? 1 : jobs.rbegin()->first + 1;
+    job.pgid = pgid;
     job.command = command;
     job.status = JobStatus::RUNNING;
-    jobs[job.job_id] = job;
+    job.pids = pids;
+    job.stage_status.assign(pids.size(), -1);
+    job.stage_usage.assign(pids.size(), ResourceUsage{});
+    job.started_us = monotonicMicros();
+
+    for (size_t i = 0; i < job.pids.size(); ++i) {
+        pid_index_[job.pids[i]] = job.job_id;
+        auto early = unclaimed_.find(job.pids[i]);
+        if (early != unclaimed_.end()) recordExit(job, i, early->second.status, early->second.usage);
+    }
+    unclaimed_.clear();
+    int id = job.job_id;
+    jobs[id] = std::move(job);
+    return id;
+}
+
+void JobManager::addHelper(pid_t pid) {
+    // Already collected between fork() and here: nothing left to track
+    if (unclaimed_.erase(pid)) return;
+    helpers_.insert(pid);
+}
+
+void JobManager::recordExit(Job& job, size_t index, int wait_status, const ResourceUsage& usage) {
+    job.stage_status[index] = WIFSIGNALED(wait_status) ? 128 + WTERMSIG(wait_status)
+                                                       : WEXITSTATUS(wait_status);
+    job.stage_usage[index] = usage;
+    for (int status : job.stage_status) {
+        if (status == -1) return;
+    }
+    // Like PIPESTATUS, the job's outcome is that of its last member
+    job.status = job.stage_status.back() > 128 ? JobStatus::TERMINATED : JobStatus::DONE;
 }
 
 void JobManager::removeJob(int job_id) {
-    jobs.erase(job_id);
+    auto it = jobs.find(job_id);
+    if (it != jobs.end()) eraseJob(it);
+}
+
+std::map<int, Job>::iterator JobManager::eraseJob(std::map<int, Job>::iterator it) {
+    for (pid_t pid : it->second.pids) pid_index_.erase(pid);
+    return jobs.erase(it);
+}
+
+// "Done" only for a zero last status; otherwise "Exit N", as in bash
+static std::string statusLabel(const Job& job) {
+    switch (job.status) {
+        case JobStatus::RUNNING: return "Running";
+        case JobStatus::STOPPED: return "Stopped";
+        case JobStatus::TERMINATED: return "Terminated";
+        case JobStatus::DONE: break;
+    }
+    int last = job.stage_status.empty() ? 0 : job.stage_status.back();
+    return last > 0 ? "Exit " + std::to_string(last) : "Done";
+}
+
+static std::string seconds(long long us) {
+    char buf[32];
+    std::snprintf(buf, sizeof buf, "%lld.%03llds", us / 1000000, (us % 1000000) / 1000);
+    return buf;
 }
 
-void JobManager::printJobs() const {
+void JobManager::printJobs(bool verbose) const {
     for (const auto& pair : jobs) {
         const Job& job = pair.second;
-        std::string status_str = "Running";
-        if (job.status == JobStatus::STOPPED) status_str = "Stopped";
-        else if (job.status == JobStatus::DONE) status_str = "Done";
-        else if (job.status == JobStatus::TERMINATED) status_str = "Terminated";
-        std::cout << "[" << job.job_id << "] " << status_str << " " << job.command << "\n";
+        std::cout << "[" << job.job_id << "] " << statusLabel(job) << " " << job.command << "\n";
+        if (!verbose) continue;
+
+        // One line per member: how it ended and what it used (wait4)
+        for (size_t i = 0; i < job.pids.size(); ++i) {
+            std::cout << "    " << job.pids[i];
+            if (job.stage_status[i] == -1) {
+                std::cout << "  running  real " << seconds(monotonicMicros() - job.started_us) << "\n";
+                continue;
+            }
+            const ResourceUsage& u = job.stage_usage[i];
+            std::cout << "  exit " << job.stage_status[i]
+                      << "  real " << seconds(u.real_us)
+                      << "  user " << seconds(u.user_us)
+                      << "  sys " << seconds(u.sys_us)
+                      << "  rss " << u.max_rss_kb << "K"
+                      << "  csw " << u.voluntary_switches << "/" << u.involuntary_switches
+                      << "  io " << u.blocks_in << "/" << u.blocks_out << "\n";
+        }
     }
 }
 
 void JobManager::bringToForeground(int job_id) {
+    reapPending();
     auto it = jobs.find(job_id);
     if (it == jobs.end()) {
         std::cerr << "fg: job " << job_id << " not found\n";
@@ -54,38 +139,59 @@ void JobManager::bringToForeground(int job_id) {
             std::cerr << "fg: failed to resume job\n";
             return;
         }
+        job.status = JobStatus::RUNNING;
     }
 
-    // Update job status to running
-    job.status = JobStatus::RUNNING;
+    // Hold SIGCHLD so the handler cannot reap members out from under the
+    // wait; whatever it queued before that is applied first
+    sigset_t block, saved;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &saved);
+    reapPending();
 
-    // Wait for the job to complete or be stopped
-    int status;
-    pid_t result;
-    do {
-        result = waitpid(-job.pgid, &status, WUNTRACED);
-    } while (result == -1 && errno == EINTR);
+    // Wait until every member has exited or the job is stopped; other jobs
+    // are reaped as they exit meanwhile
+    bool stopped = false;
+    foreground_job_ = job_id;
+    while (job.status == JobStatus::RUNNING) {
+        int status;
+        struct rusage usage;
+        pid_t result = waitForeground(-job.pgid, &status, WUNTRACED, &usage);
+        if (result == -1) {
+            if (errno == EINTR) continue;
+            break;  // Nothing left to wait for
+        }
+        if (WIFSTOPPED(status)) {
+            stopped = true;
+            break;
+        }
+        for (size_t i = 0; i < job.pids.size(); ++i) {
+            if (job.pids[i] == result) {
+                recordExit(job, i, status, ResourceUsage::from(usage, monotonicMicros() - job.started_us));
+            }
+        }
+    }
+    foreground_job_ = 0;
+
+    sigprocmask(SIG_SETMASK, &saved, nullptr);
 
     // Restore terminal control to the shell
     pid_t shell_pgid = getpgrp();
     tcsetpgrp(STDIN_FILENO, shell_pgid);
 
-    // Update job status based on how it terminated
-    if (result > 0) {
-        if (WIFSTOPPED(status)) {
-            // Job was stopped (Ctrl+Z)
-            job.status = JobStatus::STOPPED;
-            std::cout << "\n[" << job.job_id << "] Stopped " << job.command << "\n";
-        } else if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            // Job completed or was terminated
-            job.status = WIFEXITED(status) ? JobStatus::DONE : JobStatus::TERMINATED;
-            // Remove completed job
-            jobs.erase(it);
-        }
+    if (stopped) {
+        // Job was stopped (Ctrl+Z)
+        job.status = JobStatus::STOPPED;
+        std::cout << "\n[" << job.job_id << "] Stopped " << job.command << "\n";
+    } else {
+        // Job completed or was terminated
+        eraseJob(it);
     }
 }
 
 void JobManager::resumeInBackground(int job_id) {
+    reapPending();
     auto it = jobs.find(job_id);
     if (it == jobs.end()) {
         std::cerr << "bg: job " << job_id << " not found\n";
@@ -112,58 +218,202 @@ void JobManager::resumeInBackground(int job_id) {
 }
 
 void JobManager::updateJobStatus(pid_t pid, JobStatus status) {
-    // Find job by PID and update its status
-    // Note: This is called from signal handler, so must be signal-safe (no I/O)
-    for (auto& pair : jobs) {
-        if (pair.second.pgid == pid) {
-            pair.second.status = status;
-            break;
-        }
+    auto index = pid_index_.find(pid);
+    if (index == pid_index_.end()) return;
+    auto it = jobs.find(index->second);
+    if (it != jobs.end()) it->second.status = status;
+}
+
+void JobManager::onSigchld() {
+    // Runs inside the signal handler: wait4(), clock_gettime() and atomics
+    // only. The main loop is the only reader, so a relaxed load of our own
+    // head suffices
+    uint32_t head = ring_head_.load(std::memory_order_relaxed);
+    for (;;) {
+        // Full: leave the remaining children for reapPending()
+        if (head - ring_tail_.load(std::memory_order_acquire) >= kRingSize) break;
+
+        ChildEvent& event = ring_[head % kRingSize];
+        pid_t pid = wait4(-1, &event.status, WNOHANG | WUNTRACED, &event.usage);
+        if (pid <= 0) break;
+        event.pid = pid;
+        event.reaped_us = monotonicMicros();
+        ring_head_.store(++head, std::memory_order_release);
     }
 }
 
-void JobManager::checkCompletedJobs() {
-    // Check for completed background jobs using waitpid with WNOHANG
-    // This is called from SIGCHLD handler, so must be signal-safe
-    // Note: We mark jobs as completed but don't print or erase here
+void JobManager::reapPending() {
+    uint32_t tail = ring_tail_.load(std::memory_order_relaxed);
+    while (tail != ring_head_.load(std::memory_order_acquire)) {
+        ChildEvent event = ring_[tail % kRingSize];
+        ring_tail_.store(++tail, std::memory_order_release);
+        applyChildEvent(event.pid, event.status, event.usage, event.reaped_us);
+    }
+
+    if (own_children_only_) {
+        reapOwnChildren();
+        return;
+    }
 
+    // Anything the handler could not queue (ring full) is still a zombie
     int status;
+    struct rusage usage;
     pid_t pid;
+    while ((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &usage)) > 0) {
+        applyChildEvent(pid, status, usage, monotonicMicros());
+    }
+}
 
-    // WNOHANG means return immediately if no child has exited
-    // -1 means wait for any child process
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
-        JobStatus job_status;
-
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
-            // Process has terminated
-            job_status = WIFEXITED(status) ? JobStatus::DONE : JobStatus::TERMINATED;
-            updateJobStatus(pid, job_status);
-        } else if (WIFSTOPPED(status)) {
-            // Process was stopped (Ctrl+Z)
-            updateJobStatus(pid, JobStatus::STOPPED);
+void JobManager::applyChildEvent(pid_t pid, int wait_status, const struct rusage& usage,
+                                 long long reaped_us) {
+    // Children that are not jobs (yet) are kept for addJob(), within bounds
+    auto index = pid_index_.find(pid);
+    if (index == pid_index_.end()) {
+        if (WIFSTOPPED(wait_status)) return;
+        if (helpers_.erase(pid)) return;
+        if (unclaimed_.size() >= kRingSize) unclaimed_.clear();
+        unclaimed_[pid] = {wait_status, ResourceUsage::from(usage)};
+        return;
+    }
+    auto it = jobs.find(index->second);
+    if (it == jobs.end()) return;
+    Job& job = it->second;
+
+    if (WIFSTOPPED(wait_status)) {
+        // Process was stopped (Ctrl+Z)
+        job.status = JobStatus::STOPPED;
+        return;
+    }
+    for (size_t i = 0; i < job.pids.size(); ++i) {
+        if (job.pids[i] == pid) {
+            recordExit(job, i, wait_status, ResourceUsage::from(usage, reaped_us - job.started_us));
         }
     }
 }
 
-void JobManager::printAndCleanCompletedJobs() {
+int JobManager::findJob(pid_t pid) const {
+    auto index = pid_index_.find(pid);
+    return index == pid_index_.end() ? 0 : index->second;
+}
+
+template <typename Done>
+void JobManager::waitUntil(Done&& done) {
+    sigset_t block, saved;
+    sigemptyset(&block);
+    sigaddset(&block, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &block, &saved);
+    reapPending();
+    if (own_children_only_) {
+        struct timespec tick = {0, 1000000};
+        while (!done() && reapOwnChildren()) {
+            if (!done()) nanosleep(&tick, nullptr);
+        }
+        sigprocmask(SIG_SETMASK, &saved, nullptr);
+        return;
+    }
+    while (!done()) {
+        int status;
+        struct rusage usage;
+        pid_t pid = wait4(-1, &status, WUNTRACED, &usage);
+        if (pid == -1) {
+            if (errno == EINTR) continue;
+            break;  // No children left: nothing else will finish
+        }
+        applyChildEvent(pid, status, usage, monotonicMicros());
+    }
+    sigprocmask(SIG_SETMASK, &saved, nullptr);
+}
+
+bool JobManager::reapOwnChildren() {
+    // A snapshot: the index is not to be walked while jobs are updated
+    std::vector<pid_t> pids;
+    pids.reserve(pid_index_.size() + helpers_.size());
+    for (const auto& entry : pid_index_) {
+        if (entry.second != foreground_job_) pids.push_back(entry.first);
+    }
+    pids.insert(pids.end(), helpers_.begin(), helpers_.end());
+
+    bool running = false;
+    for (pid_t pid : pids) {
+        int status;
+        struct rusage usage;
+        pid_t r = wait4(pid, &status, WNOHANG | WUNTRACED, &usage);
+        if (r == pid) {
+            // Collected; a later pass gets ECHILD for it (or 0 while stopped)
+            applyChildEvent(pid, status, usage, monotonicMicros());
+        } else if (r == 0 || (r == -1 && errno == EINTR)) {
+            running = true;
+        }
+    }
+    return running;
+}
+
+int JobManager::takeStatus(std::map<int, Job>::iterator it) {
+    Job& job = it->second;
+    if (job.status == JobStatus::STOPPED) return 128 + SIGTSTP;
+    if (job.status == JobStatus::RUNNING) {
+        // Its exits were lost (collected by someone else's waitpid())
+        eraseJob(it);
+        return 127;
+    }
+    int status = job.stage_status.empty() ? 0 : job.stage_status.back();
+    eraseJob(it);
+    return status;
+}
+
+int JobManager::waitForJob(int job_id) {
+    if (jobs.find(job_id) == jobs.end()) return -1;
+    waitUntil([this, job_id] {
+        auto it = jobs.find(job_id);
+        return it == jobs.end() || it->second.status != JobStatus::RUNNING;
+    });
+    auto it = jobs.find(job_id);
+    return it == jobs.end() ? -1 : takeStatus(it);
+}
+
+int JobManager::waitForAnyJob(const std::vector<int>& job_ids, int& status) {
+    int found = 0;
+    auto finished = [this, &job_ids, &found] {
+        bool any = false;
+        for (int id : job_ids) {
+            auto it = jobs.find(id);
+            if (it == jobs.end()) continue;
+            any = true;
+            if (it->second.status != JobStatus::RUNNING) {
+                found = id;
+                return true;
+            }
+        }
+        return !any;
+    };
+    waitUntil(finished);
+    if (!found) {
+        // Children gone without a trace: report the first job still listed
+        for (int id : job_ids) {
+            if (jobs.count(id)) {
+                found = id;
+                break;
+            }
+        }
+        if (!found) return 0;
+    }
+    status = takeStatus(jobs.find(found));
+    return found;
+}
+
+void JobManager::printAndCleanCompletedJobs(std::ostream& out) {
     // Print notifications for completed jobs and remove them
     // This is called from main loop, so it's safe to use I/O
+    reapPending();
     for (auto it = jobs.begin(); it != jobs.end(); ) {
         const Job& job = it->second;
 
         if (job.status == JobStatus::DONE || job.status == JobStatus::TERMINATED) {
             // Print notification
-            std::cout << "[" << job.job_id << "] ";
-            if (job.status == JobStatus::DONE) {
-                std::cout << "Done";
-            } else {
-                std::cout << "Terminated";
-            }
-            std::cout << " " << job.command << "\n";
+            out << "[" << job.job_id << "] " << statusLabel(job) << " " << job.command << "\n";
 
             // Remove the completed job
-            it = jobs.erase(it);
+            it = eraseJob(it);
         } else {
             ++it;
         }
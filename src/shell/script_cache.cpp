@@ -0,0 +1,120 @@
+#include "shell/script_cache.h"
+#include <cerrno>
+#include <string_view>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// Scripts kept at most; loading one more flushes the cache
+constexpr size_t kMaxScripts = 256;
+
+// Chunk size for files that cannot be mapped
+constexpr size_t kReadChunk = 64 * 1024;
+
+struct timespec statMtime(const struct stat& st) {
+#ifdef __APPLE__
+    return st.st_mtimespec;
+#else
+    return st.st_mtim;
+#endif
+}
+
+bool sameTime(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Call fn with the contents of the open file fd (described by st): mapped
+// for a non-empty regular file, read in chunks otherwise
+template <typename Fn>
+bool withContents(int fd, const struct stat& st, Fn&& fn) {
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = static_cast<size_t>(st.st_size);
+        void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            fn(std::string_view(static_cast<const char*>(data), size));
+            munmap(data, size);
+            return true;
+        }
+    }
+    std::string text;
+    size_t used = 0;
+    for (;;) {
+        text.resize(used + kReadChunk);
+        ssize_t n = read(fd, text.data() + used, kReadChunk);
+        if (n > 0) used += static_cast<size_t>(n);
+        else if (n == 0) break;
+        else if (errno != EINTR) return false;
+    }
+    text.resize(used);
+    fn(std::string_view(text));
+    return true;
+}
+
+} // namespace
+
+ScriptCache& ScriptCache::global() {
+    static ScriptCache cache;
+    return cache;
+}
+
+bool ScriptCache::readFile(const std::string& path, std::string& out) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+    struct stat st;
+    bool ok = fstat(fd, &st) == 0 && !S_ISDIR(st.st_mode) &&
+              withContents(fd, st, [&out](std::string_view text) { out.assign(text); });
+    close(fd);
+    return ok;
+}
+
+ScriptCache::ScriptPtr ScriptCache::load(const std::string& path,
+                                         const std::map<std::string, std::string>* aliases) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || S_ISDIR(st.st_mode)) return nullptr;
+
+    auto it = entries_.find(path);
+    if (it != entries_.end() && it->second.device == st.st_dev && it->second.inode == st.st_ino &&
+        it->second.size == st.st_size && sameTime(it->second.mtime, statMtime(st))) {
+        ++stats_.hits;
+        return it->second.script;
+    }
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return nullptr;
+    // The file read is the one described by this fstat, not the stat above
+    auto script = std::make_shared<Script>();
+    bool used_aliases = false;
+    bool ok = fstat(fd, &st) == 0 && withContents(fd, st, [&](std::string_view text) {
+        auto result = parser_.parse(text, aliases);
+        script->status = result.status;
+        script->program = std::move(result.program);
+        script->error = std::move(result.error);
+        used_aliases = result.used_aliases;
+    });
+    close(fd);
+    if (!ok) return nullptr;
+    ++stats_.parsed;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    bool trusted = S_ISREG(st.st_mode) && now.tv_sec - statMtime(st).tv_sec > 1;
+    if (!trusted || used_aliases) {
+        if (it != entries_.end()) entries_.erase(it);
+        return script;
+    }
+
+    if (it == entries_.end() && entries_.size() >= kMaxScripts) entries_.clear();
+    entries_[path] = Entry{st.st_dev, st.st_ino, st.st_size, statMtime(st), script};
+    return script;
+}
+
+void ScriptCache::clear() {
+    entries_.clear();
+}
+
+} // namespace helix
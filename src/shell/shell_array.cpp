@@ -0,0 +1,119 @@
+#include "shell/shell_array.h"
+#include <functional>
+
+namespace helix {
+
+// ── IndexedArray ─────────────────────────────────────────────────────────────
+
+bool IndexedArray::set(size_t index, std::string value) {
+    if (index >= values_.size()) {
+        if (index - values_.size() > kMaxGap) return false;
+        values_.resize(index + 1);
+        present_.resize(index + 1, false);
+    }
+    values_[index] = std::move(value);
+    if (!present_[index]) {
+        present_[index] = true;
+        ++count_;
+    }
+    return true;
+}
+
+bool IndexedArray::unset(size_t index) {
+    if (index >= values_.size() || !present_[index]) return false;
+    present_[index] = false;
+    values_[index].clear();
+    --count_;
+    // Keep end() one past the last element
+    size_t end = values_.size();
+    while (end > 0 && !present_[end - 1]) --end;
+    values_.resize(end);
+    present_.resize(end);
+    return true;
+}
+
+void IndexedArray::clear() {
+    values_.clear();
+    present_.clear();
+    count_ = 0;
+}
+
+// ── AssocArray ───────────────────────────────────────────────────────────────
+
+size_t AssocArray::probe(std::string_view key, size_t hash) const {
+    size_t mask = slots_.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        uint32_t n = slots_[slot];
+        if (n == kEmpty) return slot;
+        const Entry& e = entries_[n - 1];
+        if (e.hash == hash && e.key == key) return slot;
+    }
+}
+
+const std::string* AssocArray::get(std::string_view key) const {
+    if (live_ == 0) return nullptr;
+    uint32_t n = slots_[probe(key, std::hash<std::string_view>{}(key))];
+    if (n == kEmpty || !entries_[n - 1].live) return nullptr;
+    return &entries_[n - 1].value;
+}
+
+void AssocArray::set(std::string_view key, std::string value) {
+    // Entries (dead ones included) fill at most 3/4 of the slots
+    if ((entries_.size() + 1) * 4 > slots_.size() * 3) rebuild(live_ + 1);
+
+    size_t hash = std::hash<std::string_view>{}(key);
+    size_t slot = probe(key, hash);
+    if (slots_[slot] != kEmpty) {
+        Entry& e = entries_[slots_[slot] - 1];
+        e.value = std::move(value);
+        if (!e.live) {
+            e.live = true;
+            ++live_;
+        }
+        return;
+    }
+    entries_.push_back({std::string(key), std::move(value), hash, true});
+    slots_[slot] = static_cast<uint32_t>(entries_.size());
+    ++live_;
+}
+
+bool AssocArray::unset(std::string_view key) {
+    if (live_ == 0) return false;
+    uint32_t n = slots_[probe(key, std::hash<std::string_view>{}(key))];
+    if (n == kEmpty || !entries_[n - 1].live) return false;
+    Entry& e = entries_[n - 1];
+    e.live = false;
+    e.value.clear();
+    e.value.shrink_to_fit();
+    --live_;
+    if (entries_.size() > 16 && entries_.size() - live_ > live_) rebuild(live_);
+    return true;
+}
+
+void AssocArray::rebuild(size_t n) {
+    if (live_ != entries_.size()) {
+        std::vector<Entry> compact;
+        compact.reserve(live_);
+        for (Entry& e : entries_) {
+            if (e.live) compact.push_back(std::move(e));
+        }
+        entries_ = std::move(compact);
+    }
+    size_t size = 16;
+    while (size * 3 < n * 4 * 2) size *= 2;  // Grown tables start half full
+    slots_.assign(size, kEmpty);
+    size_t mask = size - 1;
+    for (size_t i = 0; i < entries_.size(); ++i) {
+        size_t slot = entries_[i].hash & mask;
+        while (slots_[slot] != kEmpty) slot = (slot + 1) & mask;
+        slots_[slot] = static_cast<uint32_t>(i + 1);
+    }
+}
+
+void AssocArray::clear() {
+    entries_.clear();
+    slots_.clear();
+    live_ = 0;
+}
+
+} // namespace helix
@@ -0,0 +1,343 @@
+#include "shell/shell_server.h"
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <iterator>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+extern char** environ;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // SO_NOSIGPIPE is set on each socket instead
+#endif
+
+namespace helix {
+
+namespace {
+
+// "HLX1": first word of a request, so a stray client is told apart
+constexpr uint32_t kMagic = 0x484c5831;
+
+// Requests larger than this (a huge environment, or garbage) are refused
+constexpr uint32_t kMaxRequest = 64u << 20;
+
+// Signal the client is forwarding to the worker, 0 when none
+volatile std::sig_atomic_t g_forward = 0;
+
+void forwardSignal(int sig) {
+    g_forward = sig;
+}
+
+void setCloexec(int fd) {
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+}
+
+void noSigpipe(int fd) {
+#if defined(SO_NOSIGPIPE)
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof on);
+#else
+    (void)fd;
+#endif
+}
+
+bool fillAddress(const std::string& path, struct sockaddr_un& addr) {
+    std::memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof addr.sun_path) return false;
+    std::memcpy(addr.sun_path, path.data(), path.size());
+    return true;
+}
+
+bool sendAll(int fd, const void* data, size_t size) {
+    const char* p = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool recvAll(int fd, void* data, size_t size) {
+    char* p = static_cast<char*>(data);
+    while (size > 0) {
+        ssize_t n = recv(fd, p, size, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+void putField(std::string& out, std::string_view field) {
+    uint32_t size = static_cast<uint32_t>(field.size());
+    out.append(reinterpret_cast<const char*>(&size), sizeof size);
+    out.append(field);
+}
+
+// The peer runs as this user (where the OS can tell)
+bool fromOwner(int fd) {
+#if defined(SO_PEERCRED)
+    struct ucred cred;
+    socklen_t len = sizeof cred;
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) == 0 && cred.uid == geteuid();
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__NetBSD__)
+    uid_t uid;
+    gid_t gid;
+    return getpeereid(fd, &uid, &gid) == 0 && uid == geteuid();
+#else
+    (void)fd;
+    return true;  // The socket's owner-only mode is the only check
+#endif
+}
+
+// One 4-byte reply; while waiting, a signal caught for the worker is
+// passed on to it (pid 0: not known yet, kept for later)
+bool readReply(int fd, pid_t pid, int32_t& out) {
+    char* p = reinterpret_cast<char*>(&out);
+    size_t got = 0;
+    while (got < sizeof out) {
+        if (pid > 0 && g_forward) {
+            // To the worker's process group, unless it has none yet
+            if (kill(-pid, g_forward) == -1) kill(pid, g_forward);
+            g_forward = 0;
+        }
+        ssize_t n = read(fd, p + got, sizeof out - got);
+        if (n > 0) {
+            got += static_cast<size_t>(n);
+            continue;
+        }
+        if (n == 0 || errno != EINTR) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+// ── Server side ──────────────────────────────────────────────────────────────
+
+int ShellServer::listen(const std::string& path) {
+    struct sockaddr_un addr;
+    if (!fillAddress(path, addr)) {
+        std::cerr << "helix: --server: " << path << ": socket path too long\n";
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) {
+        std::cerr << "helix: --server: socket: " << std::strerror(errno) << "\n";
+        return -1;
+    }
+    setCloexec(fd);
+
+    // Owner-only from the start: nobody else may hand us commands
+    mode_t old_mask = umask(077);
+    int r = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+    if (r == -1 && errno == EADDRINUSE) {
+        // Left behind by a server that is gone, if nothing answers on it
+        struct stat st;
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        bool stale = probe != -1 && lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) &&
+                     connect(probe, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) == -1 &&
+                     errno == ECONNREFUSED;
+        if (probe != -1) close(probe);
+        if (stale && unlink(path.c_str()) == 0) {
+            r = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr);
+        } else {
+            errno = EADDRINUSE;
+        }
+    }
+    umask(old_mask);
+    if (r == -1 || ::listen(fd, SOMAXCONN) == -1) {
+        std::cerr << "helix: --server: " << path << ": " << std::strerror(errno) << "\n";
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+int ShellServer::accept(int listener) {
+    for (;;) {
+        int fd = ::accept(listener, nullptr, nullptr);
+        if (fd == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            return -1;
+        }
+        setCloexec(fd);
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        noSigpipe(fd);
+        if (fromOwner(fd)) return fd;
+        close(fd);
+    }
+}
+
+bool ShellServer::receive(int fd, Request& request) {
+    // A client that connects and then stalls must not hold the server up
+    struct timeval timeout = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+
+    // The descriptors ride on the header's bytes
+    uint32_t header[2];
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * 3)];
+    struct iovec iov = {header, sizeof header};
+    struct msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    int flags = 0;
+#if defined(MSG_CMSG_CLOEXEC)
+    flags |= MSG_CMSG_CLOEXEC;
+#endif
+    ssize_t n;
+    do n = recvmsg(fd, &msg, flags);
+    while (n < 0 && errno == EINTR);
+
+    size_t received = 0;
+    for (struct cmsghdr* c = n > 0 ? CMSG_FIRSTHDR(&msg) : nullptr; c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        const unsigned char* data = CMSG_DATA(c);
+        for (size_t i = 0; i < count; ++i) {
+            int passed;
+            std::memcpy(&passed, data + i * sizeof(int), sizeof passed);
+            if (received < 3) {
+                setCloexec(passed);
+                request.fds[received++] = passed;
+            } else {
+                close(passed);
+            }
+        }
+    }
+
+    auto fail = [&request] {
+        for (int& passed : request.fds) {
+            if (passed != -1) close(passed);
+            passed = -1;
+        }
+        return false;
+    };
+    if (n <= 0 || received != 3 || (msg.msg_flags & MSG_CTRUNC)) return fail();
+    if (static_cast<size_t>(n) < sizeof header &&
+        !recvAll(fd, reinterpret_cast<char*>(header) + n, sizeof header - static_cast<size_t>(n))) {
+        return fail();
+    }
+    if (header[0] != kMagic || header[1] > kMaxRequest) return fail();
+
+    std::string payload(header[1], '\0');
+    if (!recvAll(fd, payload.data(), payload.size())) return fail();
+
+    // cwd, command, then NAME=value entries, each as a length and bytes
+    std::vector<std::string> fields;
+    for (size_t pos = 0; pos < payload.size();) {
+        uint32_t size;
+        if (payload.size() - pos < sizeof size) return fail();
+        std::memcpy(&size, payload.data() + pos, sizeof size);
+        pos += sizeof size;
+        if (payload.size() - pos < size) return fail();
+        fields.emplace_back(payload, pos, size);
+        pos += size;
+    }
+    if (fields.size() < 2) return fail();
+    request.cwd = std::move(fields[0]);
+    request.command = std::move(fields[1]);
+    request.environment.assign(std::make_move_iterator(fields.begin() + 2), std::make_move_iterator(fields.end()));
+    return true;
+}
+
+bool ShellServer::sendPid(int fd, pid_t pid) {
+    int32_t value = static_cast<int32_t>(pid);
+    return sendAll(fd, &value, sizeof value);
+}
+
+bool ShellServer::sendStatus(int fd, int status) {
+    int32_t value = status;
+    return sendAll(fd, &value, sizeof value);
+}
+
+// ── Client side ──────────────────────────────────────────────────────────────
+
+std::optional<int> ShellServer::runClient(const std::string& path, const std::string& command) {
+    struct sockaddr_un addr;
+    char cwd[4096];
+    if (!fillAddress(path, addr) || !getcwd(cwd, sizeof cwd)) return std::nullopt;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd == -1) return std::nullopt;
+    setCloexec(fd);
+    noSigpipe(fd);
+    if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof addr) == -1) {
+        close(fd);
+        return std::nullopt;
+    }
+
+    std::string payload;
+    putField(payload, cwd);
+    putField(payload, command);
+    for (char** e = environ; e && *e; ++e) putField(payload, *e);
+    uint32_t header[2] = {kMagic, static_cast<uint32_t>(payload.size())};
+
+    // A closed standard descriptor is sent as /dev/null
+    int fds[3];
+    int null_fd = -1;
+    for (int i = 0; i < 3; ++i) {
+        if (fcntl(i, F_GETFD) != -1) {
+            fds[i] = i;
+            continue;
+        }
+        if (null_fd == -1) null_fd = open("/dev/null", O_RDWR | O_CLOEXEC);
+        fds[i] = null_fd;
+    }
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof fds)] = {};
+    struct iovec iov = {header, sizeof header};
+    struct msghdr msg {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof control;
+    struct cmsghdr* c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof fds);
+    std::memcpy(CMSG_DATA(c), fds, sizeof fds);
+
+    ssize_t n;
+    do n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+    while (n < 0 && errno == EINTR);
+    if (null_fd != -1) close(null_fd);
+    bool sent = n >= 0 && sendAll(fd, reinterpret_cast<char*>(header) + n, sizeof header - static_cast<size_t>(n)) &&
+                sendAll(fd, payload.data(), payload.size());
+
+    // Until the pid arrives nothing has run, and a refused request can
+    // still be run locally
+    constexpr int kForwarded[] = {SIGINT, SIGTERM, SIGHUP, SIGQUIT};
+    struct sigaction sa {};
+    struct sigaction saved[std::size(kForwarded)];
+    sa.sa_handler = forwardSignal;
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < std::size(kForwarded); ++i) sigaction(kForwarded[i], &sa, &saved[i]);
+    int32_t pid = 0;
+    int32_t status = 0;
+    bool started = sent && readReply(fd, 0, pid) && pid > 0;
+    bool done = started && readReply(fd, pid, status);
+    close(fd);
+    for (size_t i = 0; i < std::size(kForwarded); ++i) sigaction(kForwarded[i], &saved[i], nullptr);
+    if (!started) return std::nullopt;
+    if (!done) {
+        std::cerr << "helix: " << path << ": lost the connection to the server\n";
+        return 1;
+    }
+    return status;
+}
+
+} // namespace helix
@@ -0,0 +1,179 @@
+#include "shell/stream_copy.h"
+#include "executor/fd_utils.h"
+#include "shell/variable_store.h"
+#include <algorithm>
+#include <cerrno>
+#include <memory>
+#include <poll.h>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#endif
+
+namespace helix {
+
+namespace {
+
+constexpr size_t kBufferSize = 128 * 1024;
+// Per copy_file_range() / sendfile() call; the loop goes on to the end
+constexpr size_t kFileChunk = size_t(1) << 30;
+
+enum class Step { Done, Unsupported, Failed };
+
+// $HELIX_PIPE_SIZE, else the builtins' default
+int pipeSize() {
+    if (const std::string* size = VariableStore::global().find("HELIX_PIPE_SIZE")) {
+        if (int bytes = parsePipeSize(*size)) return bytes;
+    }
+    return StreamCopy::kPipeSize;
+}
+
+// For a descriptor someone left non-blocking
+bool waitReady(int in, int out) {
+    struct pollfd fds[2] = {{in, POLLIN, 0}, {out, POLLOUT, 0}};
+    for (struct pollfd& fd : fds) {
+        while (poll(&fd, 1, -1) == -1) {
+            if (errno != EINTR) return false;
+        }
+    }
+    return true;
+}
+
+// The kernel does not offer this path for these descriptors; nothing was
+// lost, and read()/write() carries on from the same offsets
+bool unsupported(int err) {
+    return err == EINVAL || err == ENOSYS || err == EXDEV || err == EOPNOTSUPP || err == EBADF;
+}
+
+[[maybe_unused]] bool isPipe(const struct stat& st) { return S_ISFIFO(st.st_mode); }
+
+// Repeat move() (bytes moved, 0 at the end, -1 with errno) to the end of
+// the input. A first call that moves nothing counts as unsupported: procfs
+// and sysfs files report size 0 to copy_file_range() and sendfile(), so
+// read() has the last word on whether there is anything to copy
+template <typename Move>
+Step transfer(int in, int out, Move&& move) {
+    for (bool first = true;; first = false) {
+        ssize_t n = move();
+        if (n > 0) continue;
+        if (n == 0) return first ? Step::Unsupported : Step::Done;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN && waitReady(in, out)) continue;
+        return unsupported(errno) ? Step::Unsupported : Step::Failed;
+    }
+}
+
+// Read up to size bytes, retrying EINTR and waiting out EAGAIN
+ssize_t readSome(int fd, char* buffer, size_t size) {
+    for (;;) {
+        ssize_t n = read(fd, buffer, size);
+        if (n >= 0) return n;
+        if (errno == EINTR) continue;
+        if (errno == EAGAIN) {
+            struct pollfd ready = {fd, POLLIN, 0};
+            if (poll(&ready, 1, -1) != -1 || errno == EINTR) continue;
+        }
+        return -1;
+    }
+}
+
+bool readWrite(int in, int out) {
+    std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+    for (;;) {
+        ssize_t n = readSome(in, buffer.get(), kBufferSize);
+        if (n == 0) return true;
+        if (n < 0 || !writeAll(out, std::string_view(buffer.get(), static_cast<size_t>(n)))) return false;
+    }
+}
+
+} // namespace
+
+bool StreamCopy::copy(int in, int out) {
+#if defined(__linux__)
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) == 0 && fstat(out, &out_st) == 0) {
+        Step step = Step::Unsupported;
+        if (S_ISREG(in_st.st_mode) && S_ISREG(out_st.st_mode)) {
+            step = transfer(in, out, [&] { return copy_file_range(in, nullptr, out, nullptr, kFileChunk, 0); });
+        }
+        if (step == Step::Unsupported && (isPipe(in_st) || isPipe(out_st))) {
+            int size = pipeSize();
+            if (isPipe(in_st)) setPipeSize(in, size);
+            if (isPipe(out_st)) setPipeSize(out, size);
+            step = transfer(in, out, [&] {
+                return splice(in, nullptr, out, nullptr, static_cast<size_t>(size), SPLICE_F_MOVE);
+            });
+        }
+        if (step == Step::Unsupported && S_ISREG(in_st.st_mode)) {
+            step = transfer(in, out, [&] { return sendfile(out, in, nullptr, kFileChunk); });
+        }
+        if (step != Step::Unsupported) return step == Step::Done;
+    }
+#endif
+    return readWrite(in, out);
+}
+
+bool StreamCopy::tee(int in, int out, const std::vector<int>& files, std::vector<int>& errors) {
+    errors.assign(files.size(), 0);
+    // Write data to every file still taking it
+    auto toFiles = [&](std::string_view data) {
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (errors[i] == 0 && !writeAll(files[i], data)) errors[i] = errno ? errno : EIO;
+        }
+    };
+    std::unique_ptr<char[]> buffer(new char[kBufferSize]);
+
+#if defined(__linux__)
+    // Pipe to pipe: tee() duplicates what is queued in into out without
+    // consuming it, then the same bytes are taken off in for the files
+    struct stat in_st, out_st;
+    if (fstat(in, &in_st) == 0 && fstat(out, &out_st) == 0 && isPipe(in_st) && isPipe(out_st)) {
+        int size = pipeSize();
+        setPipeSize(in, size);
+        setPipeSize(out, size);
+        bool splice_file = true;
+        for (;;) {
+            ssize_t n = ::tee(in, out, static_cast<size_t>(size), 0);
+            if (n == 0) return true;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno == EAGAIN && waitReady(in, out)) continue;
+                if (unsupported(errno)) break;
+                return false;
+            }
+            size_t left = static_cast<size_t>(n);
+            // One plain file: splice takes the bytes off in straight into it
+            while (left > 0 && files.size() == 1 && errors[0] == 0 && splice_file) {
+                ssize_t moved = splice(in, nullptr, files[0], nullptr, left, SPLICE_F_MOVE);
+                if (moved > 0) {
+                    left -= static_cast<size_t>(moved);
+                } else if (moved == 0 || errno != EINTR) {
+                    // O_APPEND, or a file system without splice: read() it is
+                    splice_file = false;
+                    if (moved < 0 && !unsupported(errno)) errors[0] = errno;
+                }
+            }
+            while (left > 0) {
+                ssize_t got = readSome(in, buffer.get(), std::min(left, kBufferSize));
+                if (got <= 0) return false;
+                toFiles(std::string_view(buffer.get(), static_cast<size_t>(got)));
+                left -= static_cast<size_t>(got);
+            }
+        }
+    }
+#endif
+
+    for (;;) {
+        ssize_t n = readSome(in, buffer.get(), kBufferSize);
+        if (n == 0) return true;
+        if (n < 0) return false;
+        std::string_view data(buffer.get(), static_cast<size_t>(n));
+        if (!writeAll(out, data)) return false;
+        toFiles(data);
+    }
+}
+
+} // namespace helix
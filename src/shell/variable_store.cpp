@@ -0,0 +1,173 @@
+#include "shell/variable_store.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+extern char** environ;
+
+namespace helix {
+
+VariableStore& VariableStore::global() {
+    static VariableStore store;
+    return store;
+}
+
+VariableStore::VariableStore() {
+    size_t count = 0;
+    for (char** e = environ; e && *e; ++e) ++count;
+    vars_.reserve(count + 64);
+    for (char** e = environ; e && *e; ++e) {
+        const char* eq = std::strchr(*e, '=');
+        if (!eq) continue;
+        vars_.try_emplace(std::string(*e, static_cast<size_t>(eq - *e)), Variable{eq + 1, true});
+    }
+}
+
+const std::string* VariableStore::find(std::string_view name) const {
+    auto it = vars_.find(name);
+    if (it == vars_.end()) return nullptr;
+    return it->second.array ? it->second.array->first() : &it->second.value;
+}
+
+const VariableStore::Variable* VariableStore::lookup(std::string_view name) const {
+    auto it = vars_.find(name);
+    return it == vars_.end() ? nullptr : &it->second;
+}
+
+void VariableStore::set(const std::string& name, std::string value) {
+    auto [it, inserted] = vars_.try_emplace(name);
+    if (ShellArray* array = it->second.array.get()) {
+        if (array->associative) array->assoc.set("0", std::move(value));
+        else array->indexed.set(0, std::move(value));
+        return;
+    }
+    it->second.value = std::move(value);
+    if (it->second.exported) touch(name);
+}
+
+void VariableStore::set(const std::string& name, std::string value, bool exported) {
+    auto [it, inserted] = vars_.try_emplace(name);
+    bool was_exported = it->second.exported;
+    it->second.exported = exported;
+    if (it->second.array) {
+        set(name, std::move(value));
+        return;
+    }
+    it->second.value = std::move(value);
+    if (exported || was_exported) touch(name);
+}
+
+const ShellArray* VariableStore::findArray(std::string_view name) const {
+    auto it = vars_.find(name);
+    return it == vars_.end() ? nullptr : it->second.array.get();
+}
+
+ShellArray* VariableStore::makeArray(const std::string& name, bool associative) {
+    auto [it, inserted] = vars_.try_emplace(name);
+    Variable& var = it->second;
+    if (var.array) return var.array->associative == associative ? var.array.get() : nullptr;
+    var.array = std::make_unique<ShellArray>(associative);
+    if (!inserted) {
+        if (associative) var.array->assoc.set("0", std::move(var.value));
+        else var.array->indexed.set(0, std::move(var.value));
+        var.value.clear();
+        if (var.exported) touch(name);  // Leaves the environment
+    }
+    return var.array.get();
+}
+
+void VariableStore::exportVariable(const std::string& name) {
+    auto [it, inserted] = vars_.try_emplace(name);
+    if (it->second.exported) return;
+    it->second.exported = true;
+    touch(name);
+}
+
+bool VariableStore::unset(std::string_view name) {
+    auto it = vars_.find(name);
+    if (it == vars_.end()) return false;
+    if (it->second.exported) touch(name);
+    vars_.erase(it);
+    ++removals_;
+    return true;
+}
+
+void VariableStore::replaceEnvironment(const std::vector<std::string>& entries) {
+    for (auto it = vars_.begin(); it != vars_.end();) {
+        if (!it->second.exported) {
+            ++it;
+            continue;
+        }
+        touch(it->first);
+        it = vars_.erase(it);
+        ++removals_;
+    }
+    for (const auto& entry : entries) {
+        size_t eq = entry.find('=');
+        if (eq == std::string::npos || eq == 0) continue;
+        set(entry.substr(0, eq), entry.substr(eq + 1), true);
+    }
+}
+
+std::optional<VariableStore::Variable> VariableStore::save(std::string_view name) const {
+    const Variable* var = lookup(name);
+    return var ? std::optional<Variable>(*var) : std::nullopt;
+}
+
+void VariableStore::restore(const std::string& name, std::optional<Variable> saved) {
+    if (!saved) {
+        unset(name);
+        return;
+    }
+    auto [it, inserted] = vars_.try_emplace(name);
+    bool exported = it->second.exported || saved->exported;
+    it->second = std::move(*saved);
+    if (exported) touch(name);
+}
+
+std::vector<std::pair<std::string, VariableStore::Variable>> VariableStore::sorted(bool exported_only) const {
+    std::vector<std::pair<std::string, Variable>> out;
+    out.reserve(vars_.size());
+    for (const auto& [name, var] : vars_) {
+        if (!exported_only || var.exported) out.emplace_back(name, var);
+    }
+    std::sort(out.begin(), out.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+    return out;
+}
+
+char* const* VariableStore::envp() {
+    if (envp_generation_ == generation_) return envp_.data();
+
+    env_strings_.clear();
+    for (const auto& [name, var] : vars_) {
+        if (!var.exported || var.array) continue;
+        std::string entry;
+        entry.reserve(name.size() + 1 + var.value.size());
+        entry.append(name).append(1, '=').append(var.value);
+        env_strings_.push_back(std::move(entry));
+    }
+    // Pointers are taken only once the vector has stopped growing
+    envp_.clear();
+    envp_.reserve(env_strings_.size() + 1);
+    for (auto& entry : env_strings_) envp_.push_back(entry.data());
+    envp_.push_back(nullptr);
+    envp_generation_ = generation_;
+    return envp_.data();
+}
+
+void VariableStore::syncProcessEnvironment() {
+    for (const auto& name : unsynced_) {
+        const Variable* var = lookup(name);
+        if (var && var->exported && !var->array) setenv(name.c_str(), var->value.c_str(), 1);
+        else unsetenv(name.c_str());
+    }
+    unsynced_.clear();
+}
+
+void VariableStore::touch(std::string_view name) {
+    ++generation_;
+    unsynced_.emplace(name);
+}
+
+} // namespace helix
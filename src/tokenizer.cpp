@@ -1,203 +1,574 @@
 #include "tokenizer.h"
-#include <iostream>
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
 
 namespace helix {
 
+namespace {
+
+// Character classes for the scanners' fast paths: a run of ordinary
+// characters is skipped with one table lookup per byte instead of a chain
+// of comparisons
+enum CharClass : uint8_t {
+    kCommandStop = 1,  // Ends a plain run in tokenize(): blanks | & ; < > " ' \ 2
+    kScriptMeta = 2,   // Ends a script word: blanks, newline | & ; < > ( )
+    kScriptSpecial = 4 // Needs a closer look inside a script word: \ ' " ` $
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> table{};
+    for (unsigned char c : std::string_view(" \t\n\v\f\r|&;<>\"'\\2")) table[c] |= kCommandStop;
+    for (unsigned char c : std::string_view(" \t\n|&;<>()")) table[c] |= kScriptMeta;
+    for (unsigned char c : std::string_view("\\'\"`$")) table[c] |= kScriptSpecial;
+    return table;
+}
+
+constexpr std::array<uint8_t, 256> kCharClasses = makeCharClasses();
+
+inline bool hasClass(char c, uint8_t mask) {
+    return (kCharClasses[static_cast<unsigned char>(c)] & mask) != 0;
+}
+
+// Word being assembled by tokenizeView(): a span of the input for as long
+// as the appended characters are contiguous, copied into scratch at the
+// first gap (a removed quote or backslash)
+class WordBuilder {
+public:
+    WordBuilder(std::string_view input, std::string& scratch) : input_(input), scratch_(scratch) {}
+
+    bool empty() const { return begin_ == std::string_view::npos; }
+    size_t offset() const { return begin_; }
+
+    void append(size_t pos, size_t len = 1) {
+        if (copied_ != std::string_view::npos) {
+            scratch_.append(input_.data() + pos, len);
+        } else if (empty()) {
+            begin_ = pos;
+            end_ = pos + len;
+        } else if (pos == end_) {
+            end_ += len;
+        } else {
+            copied_ = scratch_.size();
+            scratch_.append(input_.data() + begin_, end_ - begin_);
+            scratch_.append(input_.data() + pos, len);
+        }
+    }
+
+    std::string_view take() {
+        std::string_view word = copied_ == std::string_view::npos
+            ? input_.substr(begin_, end_ - begin_)
+            : std::string_view(scratch_).substr(copied_);
+        begin_ = copied_ = std::string_view::npos;
+        return word;
+    }
+
+private:
+    std::string_view input_;
+    std::string& scratch_;
+    size_t begin_ = std::string_view::npos;
+    size_t end_ = 0;
+    size_t copied_ = std::string_view::npos;  // Start of the copy in scratch
+};
+
+} // namespace
+
+std::string_view Tokenizer::keep(std::string_view text) {
+    size_t at = scratch_.size();
+    scratch_.append(text);
+    return std::string_view(scratch_).substr(at);
+}
+
 std::vector<Token> Tokenizer::tokenize(const std::string &input) {
+    const auto& views = tokenizeView(input);
     std::vector<Token> tokens;
-    std::string current;
-    TokenizerState state = TokenizerState::NORMAL;
+    tokens.reserve(views.size());
+    for (const auto& v : views) tokens.push_back({v.type, std::string(v.value), v.offset});
+    return tokens;
+}
+
+const std::vector<TokenView>& Tokenizer::tokenizeView(std::string_view input) {
+    const size_t n = input.size();
+    views_.clear();
+    scratch_.clear();
+    // Every copied word is at most as long as the input it came from, so
+    // this capacity keeps the views into scratch_ valid
+    scratch_.reserve(n);
+
+    WordBuilder word(input, scratch_);
+    auto flush = [&] {
+        if (!word.empty()) {
+            size_t at = word.offset();
+            views_.push_back({TokenType::WORD, word.take(), at});
+        }
+    };
+    auto emit = [&](size_t at, TokenType type, std::string_view text) {
+        flush();
+        views_.push_back({type, text, at});
+        return at + text.size();
+    };
+    auto at = [&](size_t k) { return k < n ? input[k] : '\0'; };
+
     size_t i = 0;
+    while (i < n) {
+        char c = input[i];
+        if (!hasClass(c, kCommandStop)) {
+            size_t j = i + 1;
+            while (j < n && !hasClass(input[j], kCommandStop)) ++j;
+            word.append(i, j - i);
+            i = j;
+            continue;
+        }
 
-    while (i < input.length()) {
-        switch (state) {
-        case TokenizerState::NORMAL:
-            i += processNormalState(input, i, tokens, current, state);
+        switch (c) {
+        case '"':
+            // A quote starts a new word; the closing quote does not end it
+            flush();
+            ++i;
+            while (i < n && input[i] != '"') {
+                char next = at(i + 1);
+                if (input[i] == '\\' && (next == '"' || next == '\\' || next == '$' || next == '`')) {
+                    word.append(i + 1);
+                    i += 2;
+                    continue;
+                }
+                size_t j = i + 1;
+                while (j < n && input[j] != '"' && input[j] != '\\') ++j;
+                word.append(i, j - i);
+                i = j;
+            }
+            if (i < n) ++i;
+            break;
+        case '\'': {
+            flush();
+            size_t close = input.find('\'', i + 1);
+            size_t end = close == std::string_view::npos ? n : close;
+            if (end > i + 1) word.append(i + 1, end - i - 1);
+            i = close == std::string_view::npos ? n : close + 1;
+            break;
+        }
+        case '\\':
+            if (i + 1 < n) word.append(i + 1);
+            i += 2;
+            break;
+        case '2':
+            if (at(i + 1) != '>') {
+                word.append(i);
+                ++i;
+            } else if (at(i + 2) == '>') {
+                i = emit(i, TokenType::REDIRECT_ERR_APPEND, "2>>");
+            } else if (at(i + 2) == '&' && at(i + 3) == '1') {
+                i = emit(i, TokenType::REDIRECT_ERR_TO_OUT, "2>&1");
+            } else {
+                i = emit(i, TokenType::REDIRECT_ERR, "2>");
+            }
+            break;
+        case '&':
+            if (at(i + 1) == '>') {
+                i = at(i + 2) == '>' ? emit(i, TokenType::REDIRECT_BOTH_APPEND, "&>>")
+                                     : emit(i, TokenType::REDIRECT_BOTH, "&>");
+            } else {
+                i = emit(i, TokenType::BACKGROUND, "&");
+            }
+            break;
+        case '<':
+            if (at(i + 1) != '<') i = emit(i, TokenType::REDIRECT_IN, "<");
+            else if (at(i + 2) == '<') i = emit(i, TokenType::HERESTRING, "<<<");
+            else if (at(i + 2) == '-') i = emit(i, TokenType::HEREDOC_STRIP, "<<-");
+            else i = emit(i, TokenType::HEREDOC, "<<");
+            break;
+        case '>':
+            i = at(i + 1) == '>' ? emit(i, TokenType::REDIRECT_OUT_APPEND, ">>")
+                                 : emit(i, TokenType::REDIRECT_OUT, ">");
+            break;
+        case '|':
+            i = emit(i, TokenType::PIPE, "|");
             break;
-        case TokenizerState::IN_DOUBLE_QUOTE:
-            i += processDoubleQuoteState(input, i, current, state);
+        case ';':
+            i = emit(i, TokenType::SEMICOLON, ";");
             break;
-        case TokenizerState::IN_SINGLE_QUOTE:
-            i += processSingleQuoteState(input, i, current, state);
+        case '\n':
+            i = emit(i, TokenType::NEWLINE, "\n");
+            break;
+        default:  // Other whitespace
+            flush();
+            ++i;
             break;
         }
     }
 
-    if (!current.empty()) {
-        tokens.push_back({TokenType::WORD, current});
-    }
+    flush();
+    views_.push_back({TokenType::END_OF_INPUT, "", n});
+    return views_;
+}
 
-    tokens.push_back({TokenType::END_OF_INPUT, ""});
-    return tokens;
+// ── Script tokenizer ─────────────────────────────────────────────────────────
+
+// `name=` or `name+=`: the start of a compound assignment when `(` follows
+static bool isArrayAssignment(std::string_view word) {
+    if (word.size() < 2 || word.back() != '=') return false;
+    word.remove_suffix(word.ends_with("+=") ? 2 : 1);
+    if (word.empty() || std::isdigit(static_cast<unsigned char>(word[0]))) return false;
+    return std::all_of(word.begin(), word.end(), [](char ch) {
+        return std::isalnum(static_cast<unsigned char>(ch)) || ch == '_';
+    });
 }
 
-size_t Tokenizer::processNormalState(const std::string &input, size_t i,
-                                     std::vector<Token> &tokens,
-                                     std::string &current,
-                                     TokenizerState &state) {
-    char c = input[i];
+size_t Tokenizer::findConstructEnd(std::string_view input, size_t i) {
+    const size_t n = input.size();
+    const char open = input[i];
 
-    if (std::isspace(c) && c != '\n') {
-        if (!current.empty()) {
-            tokens.push_back({TokenType::WORD, current});
-            current.clear();
-        }
-        return 1;
+    if (open == '\'') {
+        size_t close = input.find('\'', i + 1);
+        return close == std::string::npos ? close : close + 1;
     }
 
-    if (c == '\n') {
-        if (!current.empty()) {
-            tokens.push_back({TokenType::WORD, current});
-            current.clear();
+    if (open == '`') {
+        for (size_t j = i + 1; j < n; ++j) {
+            if (input[j] == '\\') { ++j; continue; }
+            if (input[j] == '`') return j + 1;
         }
-        tokens.push_back({TokenType::NEWLINE, "\n"});
-        return 1;
+        return std::string::npos;
     }
 
-    if (c == '"') {
-        if (!current.empty()) {
-            tokens.push_back({TokenType::WORD, current});
-            current.clear();
+    if (open == '"') {
+        size_t j = i + 1;
+        while (j < n) {
+            char c = input[j];
+            if (c == '\\') { j += 2; continue; }
+            if (c == '"') return j + 1;
+            if (c == '`' || (c == '$' && j + 1 < n && (input[j+1] == '(' || input[j+1] == '{'))) {
+                size_t end = findConstructEnd(input, c == '$' ? j + 1 : j);
+                if (end == std::string::npos) return end;
+                j = end;
+                continue;
+            }
+            ++j;
         }
-        state = TokenizerState::IN_DOUBLE_QUOTE;
-        return 1;
+        return std::string::npos;
     }
 
-    if (c == '\'') {
-        if (!current.empty()) {
-            tokens.push_back({TokenType::WORD, current});
-            current.clear();
+    // ( ... ) or { ... }
+    const char close = (open == '(') ? ')' : '}';
+    int depth = 0;
+    size_t j = i;
+    while (j < n) {
+        char c = input[j];
+        if (c == '\\') { j += 2; continue; }
+        if (c == '\'' || c == '"' || c == '`') {
+            size_t end = findConstructEnd(input, j);
+            if (end == std::string::npos) return end;
+            j = end;
+            continue;
         }
-        state = TokenizerState::IN_SINGLE_QUOTE;
-        return 1;
+        if (c == open) ++depth;
+        else if (c == close && --depth == 0) return j + 1;
+        ++j;
     }
+    return std::string::npos;
+}
 
-    if (c == '\\') {
-        if (i + 1 < input.length()) {
-            current += input[i + 1];
-            return 2;
+std::vector<std::string_view> Tokenizer::splitList(std::string_view list) {
+    std::vector<std::string_view> items;
+    size_t k = 0;
+    while (k < list.size()) {
+        char c = list[k];
+        if (c == ' ' || c == '\t' || c == '\n') { ++k; continue; }
+        if (c == '#') {
+            size_t eol = list.find('\n', k);
+            k = eol == std::string_view::npos ? list.size() : eol;
+            continue;
         }
-        return 1;
+        size_t start = k;
+        while (k < list.size() && list[k] != ' ' && list[k] != '\t' && list[k] != '\n') {
+            c = list[k];
+            size_t end = k + 1;
+            if (c == '\\') {
+                end = std::min(k + 2, list.size());
+            } else if (c == '\'' || c == '"' || c == '`') {
+                end = findConstructEnd(list, k);
+            } else if (c == '$' && k + 1 < list.size() && (list[k+1] == '(' || list[k+1] == '{' || list[k+1] == '\'')) {
+                end = findConstructEnd(list, k + 1);
+            }
+            k = end == std::string::npos ? list.size() : end;
+        }
+        items.push_back(list.substr(start, k - start));
+    }
+    return items;
+}
+
+std::vector<Token> Tokenizer::tokenizeScript(const std::string& input) {
+    std::vector<Token> tokens;
+    tokenizeScript(input, tokens);
+    return tokens;
+}
+
+void Tokenizer::tokenizeScript(std::string_view input, std::vector<Token>& out) {
+    const auto& views = tokenizeScriptView(input);
+    out.resize(views.size());
+    for (size_t k = 0; k < views.size(); ++k) {
+        out[k].type = views[k].type;
+        out[k].value.assign(views[k].value);
+        out[k].offset = views[k].offset;
     }
+}
 
-    // Multi-character special tokens
-    if (c == '2' && i + 1 < input.length() && input[i+1] == '>') {
-        if (!current.empty()) { tokens.push_back({TokenType::WORD, current}); current.clear(); }
-        if (i + 2 < input.length() && input[i+2] == '>') {
-            tokens.push_back({TokenType::REDIRECT_ERR_APPEND, "2>>"});
-            return 3;
-        }
-        // 2>&1
-        if (i + 3 < input.length() && input[i+2] == '&' && input[i+3] == '1') {
-            tokens.push_back({TokenType::REDIRECT_ERR_TO_OUT, "2>&1"});
-            return 4;
+const std::vector<TokenView>& Tokenizer::tokenizeScriptView(std::string_view input) {
+    views_.clear();
+    scratch_.clear();
+    scratch_.reserve(input.size());  // See tokenizeView()
+    pending_heredocs_.clear();
+    incomplete_ = false;
+
+    const size_t n = input.size();
+    size_t i = 0;
+    bool expect_delimiter = false;
+    bool strip_tabs = false;
+
+    while (i < n) {
+        char c = input[i];
+
+        if (c == ' ' || c == '\t') { ++i; continue; }
+
+        // Line continuation
+        if (c == '\\' && i + 1 < n && input[i+1] == '\n') { i += 2; continue; }
+        if (c == '\\' && i + 1 == n) { incomplete_ = true; break; }
+
+        // Comment to end of line (only at the start of a word)
+        if (c == '#') {
+            size_t eol = input.find('\n', i);
+            i = eol == std::string_view::npos ? n : eol;
+            continue;
         }
-        tokens.push_back({TokenType::REDIRECT_ERR, "2>"});
-        return 2;
-    }
 
-    if (c == '&') {
-        if (!current.empty()) { tokens.push_back({TokenType::WORD, current}); current.clear(); }
-        if (i + 1 < input.length() && input[i+1] == '>') {
-            if (i + 2 < input.length() && input[i+2] == '>') {
-                tokens.push_back({TokenType::REDIRECT_BOTH_APPEND, "&>>"});
-                return 3;
+        if (c == '\n') {
+            views_.push_back({TokenType::NEWLINE, "\n", i});
+            ++i;
+            if (!pending_heredocs_.empty()) {
+                i = readHeredocBodies(input, i);
+                if (incomplete_) break;
             }
-            tokens.push_back({TokenType::REDIRECT_BOTH, "&>"});
-            return 2;
+            continue;
         }
-        tokens.push_back({TokenType::BACKGROUND, "&"});
-        return 1;
-    }
 
-    if (c == '<') {
-        if (!current.empty()) { tokens.push_back({TokenType::WORD, current}); current.clear(); }
-        if (i + 1 < input.length() && input[i+1] == '<') {
-            if (i + 2 < input.length() && input[i+2] == '<') {
-                tokens.push_back({TokenType::HERESTRING, "<<<"});
-                return 3;
-            }
-            if (i + 2 < input.length() && input[i+2] == '-') {
-                tokens.push_back({TokenType::HEREDOC_STRIP, "<<-"});
-                return 3;
-            }
-            tokens.push_back({TokenType::HEREDOC, "<<"});
-            return 2;
+        // for ((init; cond; update)): the arithmetic is one word, so its
+        // ; < > are not taken as operators
+        if (c == '(' && i + 1 < n && input[i+1] == '(' && !views_.empty() &&
+            views_.back().type == TokenType::WORD && views_.back().value == "for") {
+            size_t end = findConstructEnd(input, i);
+            if (end == std::string::npos) { incomplete_ = true; break; }
+            views_.push_back({TokenType::WORD, input.substr(i, end - i), i});
+            i = end;
+            continue;
         }
-        tokens.push_back({TokenType::REDIRECT_IN, "<"});
-        return 1;
-    }
 
-    if (c == '>') {
-        if (!current.empty()) { tokens.push_back({TokenType::WORD, current}); current.clear(); }
-        if (i + 1 < input.length() && input[i+1] == '>') {
-            tokens.push_back({TokenType::REDIRECT_OUT_APPEND, ">>"});
-            return 2;
+        // <(cmd) and >(cmd) start a word (process substitution), not a
+        // redirection
+        bool process_subst = (c == '<' || c == '>') && i + 1 < n && input[i+1] == '(';
+
+        // fd-prefixed redirections: 2> 2>> 2>&1 1>&2
+        bool fd_redirect = (c == '2' || c == '1') && i + 1 < n && input[i+1] == '>';
+        if ((hasClass(c, kScriptMeta) && !process_subst) || fd_redirect) {
+            size_t next = scanScriptOperator(input, i);
+            TokenType t = views_.back().type;
+            if (t == TokenType::HEREDOC || t == TokenType::HEREDOC_STRIP) {
+                expect_delimiter = true;
+                strip_tabs = (t == TokenType::HEREDOC_STRIP);
+            }
+            i = next;
+            continue;
         }
-        tokens.push_back({TokenType::REDIRECT_OUT, ">"});
-        return 1;
-    }
 
-    if (c == '|') {
-        if (!current.empty()) { tokens.push_back({TokenType::WORD, current}); current.clear(); }
-        tokens.push_back({TokenType::PIPE, "|"});
-        return 1;
-    }
+        std::string_view word;
+        size_t start = i;
+        i = scanScriptWord(input, i, word);
+        if (i == std::string::npos) { incomplete_ = true; break; }
+        views_.push_back({TokenType::WORD, word, start});
 
-    if (c == ';') {
-        if (!current.empty()) { tokens.push_back({TokenType::WORD, current}); current.clear(); }
-        tokens.push_back({TokenType::SEMICOLON, ";"});
-        return 1;
+        if (expect_delimiter) {
+            // Quote removal on the delimiter; the raw word stays in the
+            // WORD token so the parser can tell a quoted delimiter apart
+            std::string delim;
+            for (size_t k = 0; k < word.size(); ++k) {
+                if (word[k] == '\'' || word[k] == '"') continue;
+                if (word[k] == '\\' && k + 1 < word.size()) { delim += word[++k]; continue; }
+                delim += word[k];
+            }
+            pending_heredocs_.push_back({views_.size(), delim, strip_tabs});
+            views_.push_back({TokenType::HEREDOC_BODY, "", start});
+            expect_delimiter = false;
+        }
     }
 
-    current += c;
-    return 1;
+    // A here-doc whose body never started is still waiting for input
+    if (!pending_heredocs_.empty()) incomplete_ = true;
+
+    views_.push_back({TokenType::END_OF_INPUT, "", n});
+    return views_;
 }
 
-size_t Tokenizer::processDoubleQuoteState(const std::string &input, size_t i,
-                                          std::string &current,
-                                          TokenizerState &state) {
-    char c = input[i];
+size_t Tokenizer::scanScriptWord(std::string_view input, size_t i, std::string_view& word) {
+    const size_t n = input.size();
+    const size_t start = i;
+    size_t copied = std::string_view::npos;  // Start in scratch_ once a continuation splits the word
 
-    if (c == '"') {
-        state = TokenizerState::NORMAL;
-        return 1;
-    }
+    auto take = [&](size_t from, size_t to) {
+        if (copied != std::string_view::npos) scratch_.append(input.data() + from, to - from);
+    };
 
-    if (c == '\\' && i + 1 < input.length()) {
-        char next = input[i + 1];
-        if (next == '"' || next == '\\' || next == '$' || next == '`') {
-            current += next;
-            return 2;
+    while (i < n) {
+        char c = input[i];
+        if (!hasClass(c, kScriptMeta | kScriptSpecial)) {
+            size_t j = i + 1;
+            while (j < n && !hasClass(input[j], kScriptMeta | kScriptSpecial)) ++j;
+            take(i, j);
+            i = j;
+            continue;
+        }
+        if (hasClass(c, kScriptMeta)) {
+            size_t end = std::string_view::npos;
+            if ((c == '<' || c == '>') && i + 1 < n && input[i+1] == '(') {
+                // <(cmd) and >(cmd), at the start of the word or inside it
+                end = findConstructEnd(input, i + 1);
+            } else if (c == '(' && copied == std::string_view::npos &&
+                       isArrayAssignment(input.substr(start, i - start))) {
+                // a=(...) and a+=(...): the compound value belongs to the word
+                end = findConstructEnd(input, i);
+            } else {
+                break;
+            }
+            if (end == std::string::npos) return end;
+            take(i, end);
+            i = end;
+            continue;
         }
-    }
 
-    current += c;
-    return 1;
-}
+        if (c == '\\') {
+            if (i + 1 >= n) return std::string::npos;
+            if (input[i+1] == '\n') {
+                if (copied == std::string_view::npos) {
+                    copied = scratch_.size();
+                    scratch_.append(input.data() + start, i - start);
+                }
+                i += 2;
+                continue;
+            }
+            take(i, i + 2);
+            i += 2;
+            continue;
+        }
+
+        size_t end = i + 1;
+        if (c == '\'' || c == '"' || c == '`') {
+            end = findConstructEnd(input, i);
+        } else if (c == '$' && i + 1 < n && (input[i+1] == '(' || input[i+1] == '{')) {
+            end = findConstructEnd(input, i + 1);
+        } else if (c == '$' && i + 1 < n && input[i+1] == '\'') {
+            end = findConstructEnd(input, i + 1);  // $'...' ANSI-C string
+        }
+        if (end == std::string::npos) return end;
 
-size_t Tokenizer::processSingleQuoteState(const std::string &input, size_t i,
-                                          std::string &current,
-                                          TokenizerState &state) {
-    if (input[i] == '\'') {
-        state = TokenizerState::NORMAL;
-        return 1;
+        take(i, end);
+        i = end;
     }
 
-    current += input[i];
-    return 1;
+    word = copied == std::string_view::npos ? input.substr(start, i - start)
+                                            : std::string_view(scratch_).substr(copied);
+    return i;
 }
 
-bool Tokenizer::handleSpecialTokens(const std::string &input, size_t i,
-                                    std::vector<Token> &tokens,
-                                    std::string &current) {
-    (void)input; (void)i; (void)tokens; (void)current;
-    return false;
+size_t Tokenizer::scanScriptOperator(std::string_view input, size_t i) {
+    auto at = [&](size_t k) { return k < input.size() ? input[k] : '\0'; };
+    auto emit = [&](TokenType type, std::string_view text) {
+        views_.push_back({type, text, i});
+        return i + text.size();
+    };
+
+    char c = input[i];
+    switch (c) {
+    case '1':
+        if (at(i+2) == '&' && at(i+3) == '2') return emit(TokenType::REDIRECT_OUT_TO_ERR, "1>&2");
+        return emit(TokenType::REDIRECT_OUT, "1>");
+    case '2':
+        if (at(i+2) == '>') return emit(TokenType::REDIRECT_ERR_APPEND, "2>>");
+        if (at(i+2) == '&' && at(i+3) == '1') return emit(TokenType::REDIRECT_ERR_TO_OUT, "2>&1");
+        return emit(TokenType::REDIRECT_ERR, "2>");
+    case '|':
+        if (at(i+1) == '|') return emit(TokenType::OR_IF, "||");
+        return emit(TokenType::PIPE, "|");
+    case '&':
+        if (at(i+1) == '&') return emit(TokenType::AND_IF, "&&");
+        if (at(i+1) == '>') {
+            if (at(i+2) == '>') return emit(TokenType::REDIRECT_BOTH_APPEND, "&>>");
+            return emit(TokenType::REDIRECT_BOTH, "&>");
+        }
+        return emit(TokenType::BACKGROUND, "&");
+    case ';':
+        if (at(i+1) == ';') return emit(TokenType::DSEMI, ";;");
+        return emit(TokenType::SEMICOLON, ";");
+    case '(':
+        return emit(TokenType::LPAREN, "(");
+    case ')':
+        return emit(TokenType::RPAREN, ")");
+    case '<':
+        if (at(i+1) == '<') {
+            if (at(i+2) == '<') return emit(TokenType::HERESTRING, "<<<");
+            if (at(i+2) == '-') return emit(TokenType::HEREDOC_STRIP, "<<-");
+            return emit(TokenType::HEREDOC, "<<");
+        }
+        if (at(i+1) == '&') return emit(TokenType::REDIRECT_IN_DUP, "<&");
+        return emit(TokenType::REDIRECT_IN, "<");
+    case '>':
+        if (at(i+1) == '>') return emit(TokenType::REDIRECT_OUT_APPEND, ">>");
+        if (at(i+1) == '&' && at(i+2) == '2' && !std::isdigit(static_cast<unsigned char>(at(i+3)))) {
+            return emit(TokenType::REDIRECT_OUT_TO_ERR, ">&2");
+        }
+        if (at(i+1) == '&') return emit(TokenType::REDIRECT_OUT_DUP, ">&");
+        if (at(i+1) == '|') return emit(TokenType::REDIRECT_OUT, ">|");
+        return emit(TokenType::REDIRECT_OUT, ">");
+    default:
+        return i + 1;
+    }
 }
 
-size_t Tokenizer::getTokenLength(const std::string &input, size_t i) {
-    (void)input; (void)i;
-    return 1;
+size_t Tokenizer::readHeredocBodies(std::string_view input, size_t i) {
+    const size_t n = input.size();
+    for (const auto& doc : pending_heredocs_) {
+        // A << body is the input up to the delimiter line; only <<- has
+        // to be reassembled without the leading tabs
+        const size_t body_start = i;
+        size_t body_end = i;
+        size_t copied = scratch_.size();
+        bool terminated = false;
+        while (i < n) {
+            size_t eol = input.find('\n', i);
+            size_t line_end = eol == std::string_view::npos ? n : eol;
+            size_t line_start = i;
+            if (doc.strip_tabs) {
+                while (line_start < line_end && input[line_start] == '\t') ++line_start;
+            }
+            i = eol == std::string_view::npos ? n : eol + 1;
+            if (input.substr(line_start, line_end - line_start) == doc.delimiter) {
+                terminated = true;
+                break;
+            }
+            body_end = i;
+            if (doc.strip_tabs) {
+                scratch_.append(input.data() + line_start, line_end - line_start);
+                scratch_ += '\n';
+            }
+        }
+        if (!terminated) {
+            incomplete_ = true;
+            return i;
+        }
+        views_[doc.body_index].value = doc.strip_tabs
+            ? std::string_view(scratch_).substr(copied)
+            : input.substr(body_start, body_end - body_start);
+    }
+    pending_heredocs_.clear();
+    return i;
 }
 
 } // namespace helix
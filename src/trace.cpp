@@ -0,0 +1,195 @@
+#include "trace.h"
+#include "executor/fd_utils.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace helix {
+
+namespace {
+
+// Events buffered before a write
+constexpr size_t kEvents = 4096;
+
+// Bytes of an event's detail kept (command text is cut there)
+constexpr size_t kDetail = 96;
+
+void appendEscaped(std::string& out, std::string_view text) {
+    for (char c : text) {
+        unsigned char u = static_cast<unsigned char>(c);
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (u < 0x20) {
+            char buf[8];
+            std::snprintf(buf, sizeof buf, "\\u%04x", u);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+}
+
+} // namespace
+
+struct Tracer::Event {
+    char phase;
+    pid_t pid;
+    const char* name;  // A string literal
+    long long ts;
+    long long dur;
+    TraceArgs args;
+    unsigned char detail_len;
+    char detail[kDetail];
+};
+
+Tracer& Tracer::global() {
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::~Tracer() {
+    close();
+}
+
+long long Tracer::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<long long>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+bool Tracer::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size == 0) writeAll(fd, "[\n");
+
+    static bool hooked = false;
+    if (!hooked) {
+        pthread_atfork(nullptr, nullptr, &Tracer::afterFork);
+        std::atexit(&Tracer::flushAtExit);
+        hooked = true;
+    }
+    fd_ = fd;
+    pid_ = getpid();
+    if (!events_) events_ = std::make_unique<Event[]>(kEvents);
+    used_ = 0;
+    enabled_ = true;
+    nameProcess(pid_, "helix");
+    return true;
+}
+
+void Tracer::close() {
+    if (fd_ < 0) return;
+    flush();
+    ::close(fd_);
+    fd_ = -1;
+    enabled_ = false;
+}
+
+void Tracer::flush() {
+    if (fd_ < 0 || used_ == 0) return;
+    std::string out;
+    out.reserve(used_ * 160);
+    for (size_t i = 0; i < used_; ++i) {
+        const Event& e = events_[i];
+        char head[160];
+        std::snprintf(head, sizeof head, "{\"ph\":\"%c\",\"pid\":%d,\"tid\":%d,\"ts\":%lld,",
+                      e.phase, static_cast<int>(e.pid), static_cast<int>(e.pid), e.ts);
+        out += head;
+        if (e.phase == 'X') out += "\"dur\":" + std::to_string(e.dur) + ",";
+        if (e.phase == 'i') out += "\"s\":\"t\",";
+        out += "\"name\":\"";
+        appendEscaped(out, e.name);
+        out += "\",\"cat\":\"helix\",\"args\":{";
+        bool first = true;
+        auto field = [&](const char* key) {
+            if (!first) out += ",";
+            first = false;
+            out += "\"";
+            out += key;
+            out += "\":";
+        };
+        if (e.detail_len > 0 || e.phase == 'M') {
+            field(e.phase == 'M' ? "name" : "detail");
+            out += "\"";
+            appendEscaped(out, std::string_view(e.detail, e.detail_len));
+            out += "\"";
+        }
+        if (e.args.child >= 0) {
+            field("pid");
+            out += std::to_string(e.args.child);
+        }
+        if (e.args.stage >= 0) {
+            field("stage");
+            out += std::to_string(e.args.stage);
+        }
+        if (e.args.status >= 0) {
+            field("status");
+            out += std::to_string(e.args.status);
+        }
+        if (e.args.parent >= 0) {
+            field("parent");
+            out += std::to_string(e.args.parent);
+        }
+        out += "}},\n";
+    }
+    used_ = 0;
+    writeAll(fd_, out);
+}
+
+void Tracer::push(char phase, pid_t pid, const char* name, long long ts, long long dur,
+                  std::string_view detail, const TraceArgs& args) {
+    if (!enabled_) return;
+    if (used_ == kEvents) flush();
+    Event& e = events_[used_++];
+    e.phase = phase;
+    e.pid = pid;
+    e.name = name;
+    e.ts = ts;
+    e.dur = dur;
+    e.args = args;
+    e.detail_len = static_cast<unsigned char>(std::min(detail.size(), kDetail));
+    std::memcpy(e.detail, detail.data(), e.detail_len);
+}
+
+void Tracer::complete(const char* name, long long begin_us, long long end_us,
+                      std::string_view detail, const TraceArgs& args) {
+    push('X', pid_, name, begin_us, end_us - begin_us, detail, args);
+}
+
+void Tracer::completeFor(pid_t pid, const char* name, long long begin_us, long long end_us,
+                         std::string_view detail, const TraceArgs& args) {
+    push('X', pid, name, begin_us, end_us - begin_us, detail, args);
+}
+
+void Tracer::instant(const char* name, std::string_view detail, const TraceArgs& args) {
+    push('i', pid_, name, now(), 0, detail, args);
+}
+
+void Tracer::nameProcess(pid_t pid, std::string_view name) {
+    push('M', pid, "process_name", 0, 0, name, {});
+}
+
+void Tracer::afterFork() {
+    Tracer& t = global();
+    if (!enabled_) return;
+    t.used_ = 0;
+    t.pid_ = getpid();
+    TraceArgs args;
+    args.parent = getppid();
+    t.push('i', t.pid_, "forked", now(), 0, {}, args);
+}
+
+void Tracer::flushAtExit() {
+    global().flush();
+}
+
+} // namespace helix
@@ -0,0 +1,338 @@
+#include "../include/ai_cache.h"
+#include "../include/ai_context.h"
+#include "../include/ai_provider.h"
+#include "../include/http_client.h"
+#include "../include/json.h"
+#include "../include/shell.h"
+#include "../include/shell/variable_store.h"
+#include <cppunit/TestAssert.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <netinet/in.h>
+#include <cstdlib>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+// Read one request (head plus Content-Length body) from fd; false at EOF
+bool readRequest(int fd) {
+  std::string data;
+  char buf[4096];
+  size_t head_end;
+  while ((head_end = data.find("\r\n\r\n")) == std::string::npos) {
+    ssize_t n = read(fd, buf, sizeof buf);
+    if (n <= 0) return false;
+    data.append(buf, static_cast<size_t>(n));
+  }
+  size_t length = 0;
+  size_t at = data.find("Content-Length: ");
+  if (at != std::string::npos) length = std::stoul(data.substr(at + 16));
+  while (data.size() < head_end + 4 + length) {
+    ssize_t n = read(fd, buf, sizeof buf);
+    if (n <= 0) return false;
+    data.append(buf, static_cast<size_t>(n));
+  }
+  return true;
+}
+
+void writeText(int fd, const std::string& text) {
+  size_t done = 0;
+  while (done < text.size()) {
+    ssize_t n = write(fd, text.data() + done, text.size() - done);
+    if (n <= 0) return;
+    done += static_cast<size_t>(n);
+  }
+}
+
+std::string chunk(const std::string& data) {
+  char size[16];
+  snprintf(size, sizeof size, "%zx\r\n", data.size());
+  return size + data + "\r\n";
+}
+
+// A listening socket on a free loopback port
+int listenLoopback(int& port) {
+  int listener = socket(AF_INET, SOCK_STREAM, 0);
+  struct sockaddr_in addr {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&addr), sizeof addr) != 0 ||
+      listen(listener, 4) != 0) {
+    return -1;
+  }
+  socklen_t len = sizeof addr;
+  getsockname(listener, reinterpret_cast<sockaddr*>(&addr), &len);
+  port = ntohs(addr.sin_port);
+  return listener;
+}
+
+// Backdate path's mtime by seconds
+void age(const std::string& path, time_t seconds) {
+  struct timespec times[2];
+  clock_gettime(CLOCK_REALTIME, &times[0]);
+  times[0].tv_sec -= seconds;
+  times[1] = times[0];
+  utimensat(AT_FDCWD, path.c_str(), times, 0);
+}
+
+} // namespace
+
+// Tests for the AI client: JSON, HTTP streaming and connection reuse
+class TestAiProvider : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestAiProvider);
+  CPPUNIT_TEST(testJsonParse);
+  CPPUNIT_TEST(testStreamedRepliesReuseConnection);
+  CPPUNIT_TEST(testResponseCacheAndContext);
+  CPPUNIT_TEST(testRepeatedQueryIsServedFromCache);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void testJsonParse() {
+    helix::JsonValue doc;
+    CPPUNIT_ASSERT(helix::JsonValue::parse(
+        R"({"choices":[{"delta":{"content":"a\"b\\c\né😀"}}],"n":-1.5e2,"ok":true,"x":null})", doc));
+    CPPUNIT_ASSERT_EQUAL(std::string("a\"b\\c\n\xc3\xa9\xf0\x9f\x98\x80"),
+                         doc.find({"choices", "0", "delta", "content"}));
+    CPPUNIT_ASSERT_EQUAL(-150.0, doc.get("n")->number());
+    CPPUNIT_ASSERT(doc.get("ok")->boolean());
+    CPPUNIT_ASSERT(doc.get("x")->isNull());
+    CPPUNIT_ASSERT(doc.find({"choices", "1", "delta"}).empty());
+    CPPUNIT_ASSERT(doc.find({"missing"}).empty());
+
+    // A key merely appearing inside a string is not a member
+    CPPUNIT_ASSERT(helix::JsonValue::parse(R"({"text":"\"content\":\"no\"","content":"yes"})", doc));
+    CPPUNIT_ASSERT_EQUAL(std::string("yes"), doc.find({"content"}));
+
+    // Truncated, trailing garbage, bad escapes
+    CPPUNIT_ASSERT(!helix::JsonValue::parse(R"({"a":"b")", doc));
+    CPPUNIT_ASSERT(doc.isNull());
+    CPPUNIT_ASSERT(!helix::JsonValue::parse(R"({"a":1} {"b":2})", doc));
+    CPPUNIT_ASSERT(!helix::JsonValue::parse(R"(["\q"])", doc));
+    CPPUNIT_ASSERT(!helix::JsonValue::parse("", doc));
+
+    std::string text = "quote \" slash \\ tab \t nl \n bell \a";
+    CPPUNIT_ASSERT(helix::JsonValue::parse("\"" + helix::JsonValue::escape(text) + "\"", doc));
+    CPPUNIT_ASSERT_EQUAL(text, doc.string());
+  }
+
+  void testStreamedRepliesReuseConnection() {
+    int port = 0;
+    int listener = listenLoopback(port);
+    CPPUNIT_ASSERT(listener >= 0);
+
+    // An ollama stand-in: every request on one connection, which it never
+    // closes early; a second connection would find nobody accepting
+    pid_t server = fork();
+    if (server == 0) {
+      int conn = accept(listener, nullptr, nullptr);
+      const char* ok = "HTTP/1.1 200 OK\r\nContent-Type: application/x-ndjson\r\nTransfer-Encoding: chunked\r\n\r\n";
+      if (readRequest(conn)) {
+        writeText(conn, ok);
+        // An event split across chunks, then two in one
+        writeText(conn, chunk("{\"message\":{\"content\":\"ls\"},\"do"));
+        writeText(conn, chunk("ne\":false}\n{\"message\":{\"content\":\" -la\"},\"done\":false}\n{\"done\":true}\n"));
+        writeText(conn, "0\r\n\r\n");
+      }
+      if (readRequest(conn)) {
+        std::string body = "{\"message\":{\"content\":\"pwd\"},\"done\":true}\n";
+        writeText(conn, "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+      }
+      if (readRequest(conn)) {
+        std::string body = "{\"error\":{\"message\":\"model not found\"}}";
+        writeText(conn, "HTTP/1.1 404 Not Found\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+      }
+      _exit(0);
+    }
+    close(listener);
+
+    // Proxies would route the request through curl
+    helix::VariableStore& vars = helix::VariableStore::global();
+    std::vector<std::pair<std::string, std::optional<helix::VariableStore::Variable>>> saved;
+    for (const char* name : {"http_proxy", "all_proxy", "ALL_PROXY", "HELIX_AI_URL"}) {
+      saved.emplace_back(name, vars.save(name));
+      vars.unset(name);
+    }
+
+    helix::AiProvider provider;
+    provider.name = "ollama";
+    provider.model = "test";
+    provider.base_url = "http://127.0.0.1:" + std::to_string(port) + "/api/chat";
+    helix::HttpClient::Stats before = helix::HttpClient::global().stats();
+
+    std::vector<std::string> pieces;
+    helix::AiResponse reply = helix::queryAiProvider(provider, "system", "list", 64,
+                                                     [&](std::string_view text) { pieces.emplace_back(text); });
+    CPPUNIT_ASSERT_EQUAL(std::string("ls -la"), reply.text);
+    CPPUNIT_ASSERT_EQUAL(size_t(2), pieces.size());
+    CPPUNIT_ASSERT(reply.error.empty());
+
+    reply = helix::queryAiProvider(provider, "system", "where", 64);
+    CPPUNIT_ASSERT_EQUAL(std::string("pwd"), reply.text);
+
+    reply = helix::queryAiProvider(provider, "system", "bad", 64);
+    CPPUNIT_ASSERT(reply.text.empty());
+    CPPUNIT_ASSERT_EQUAL(std::string("HTTP 404: model not found"), reply.error);
+
+    helix::HttpClient::Stats after = helix::HttpClient::global().stats();
+    CPPUNIT_ASSERT_EQUAL(1ul, after.connects - before.connects);
+    CPPUNIT_ASSERT_EQUAL(2ul, after.reuses - before.reuses);
+
+    helix::HttpClient::global().closeIdle();
+    int status = 0;
+    waitpid(server, &status, 0);
+    for (auto& [name, value] : saved) vars.restore(name, std::move(value));
+  }
+
+  void testResponseCacheAndContext() {
+    char dir_template[] = "/tmp/helix_t_aiXXXXXX";
+    std::string root = mkdtemp(dir_template);
+
+    helix::AiProvider provider;
+    provider.name = "ollama";
+    provider.model = "m";
+    std::string key = helix::AiResponseCache::keyFor(provider, "system", "list files", 128);
+    CPPUNIT_ASSERT_EQUAL(size_t(32), helix::AiResponseCache::digest(key).size());
+    provider.model = "other";
+    CPPUNIT_ASSERT(key != helix::AiResponseCache::keyFor(provider, "system", "list files", 128));
+
+    // Created on first store, private to the user
+    helix::AiResponseCache cache(root + "/cache", std::chrono::seconds(60));
+    CPPUNIT_ASSERT(!cache.lookup(key));
+    CPPUNIT_ASSERT(cache.store(key, "ls -la\nline two"));
+    struct stat st;
+    CPPUNIT_ASSERT(stat((root + "/cache").c_str(), &st) == 0);
+    CPPUNIT_ASSERT_EQUAL(0700u, static_cast<unsigned>(st.st_mode & 0777));
+    CPPUNIT_ASSERT_EQUAL(std::string("ls -la\nline two"), cache.lookup(key).value_or("<miss>"));
+    CPPUNIT_ASSERT(!cache.lookup(key + "x"));
+
+    // Another key landing on the same file is a miss, not its reply
+    std::string path = root + "/cache/" + helix::AiResponseCache::digest(key);
+    std::string other = key + "y";
+    CPPUNIT_ASSERT(cache.store(other, "pwd"));
+    CPPUNIT_ASSERT(rename((root + "/cache/" + helix::AiResponseCache::digest(other)).c_str(), path.c_str()) == 0);
+    CPPUNIT_ASSERT(!cache.lookup(key));
+
+    // Expired entries are misses and are swept
+    CPPUNIT_ASSERT(cache.store(key, "ls"));
+    CPPUNIT_ASSERT(cache.store(other, "pwd"));
+    age(path, 120);
+    CPPUNIT_ASSERT(!cache.lookup(key));
+    CPPUNIT_ASSERT(access(path.c_str(), F_OK) != 0);
+    age(root + "/cache/" + helix::AiResponseCache::digest(other), 120);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), cache.prune());
+    CPPUNIT_ASSERT(!helix::AiResponseCache(root + "/cache", std::chrono::seconds(0)).enabled());
+
+    // Context: sorted listing, branch from HEAD, revalidated on change
+    std::string work = root + "/work";
+    mkdir(work.c_str(), 0755);
+    mkdir((work + "/.git").c_str(), 0755);
+    mkdir((work + "/src").c_str(), 0755);
+    std::ofstream(work + "/.git/HEAD") << "ref: refs/heads/feature\n";
+    std::ofstream(work + "/b.txt") << "b";
+    std::ofstream(work + "/a.txt") << "a";
+
+    helix::AiContext context;
+    context.prefetch(work + "/src");  // No query yet: nothing happens
+    helix::AiContext::Snapshot snap = context.get(work);
+    CPPUNIT_ASSERT_EQUAL(std::string("feature"), snap.branch);
+    CPPUNIT_ASSERT_EQUAL(std::string("a.txt\nb.txt\nsrc/\n"), snap.listing);
+    CPPUNIT_ASSERT_EQUAL(std::string("feature"), context.get(work + "/src").branch);
+
+    std::string text = helix::AiContext::describe(snap, {"make", "make test"});
+    CPPUNIT_ASSERT(text.find("Current directory: " + work + "\n") == 0);
+    CPPUNIT_ASSERT(text.find("Git branch: feature\n") != std::string::npos);
+    CPPUNIT_ASSERT(text.find("Recent commands:\nmake\nmake test\n") != std::string::npos);
+
+    // A new entry (directory mtime) and a checkout (HEAD mtime) invalidate
+    age(work, 10);
+    age(work + "/.git/HEAD", 10);
+    context.prefetch(work);
+    std::ofstream(work + "/c.txt") << "c";
+    std::ofstream(work + "/.git/HEAD") << "ref: refs/heads/main\n";
+    context.prefetch(work);
+    snap = context.get(work);
+    CPPUNIT_ASSERT_EQUAL(std::string("main"), snap.branch);
+    CPPUNIT_ASSERT_EQUAL(std::string("a.txt\nb.txt\nc.txt\nsrc/\n"), snap.listing);
+
+    std::string cleanup = "rm -rf " + root;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testRepeatedQueryIsServedFromCache() {
+    char dir_template[] = "/tmp/helix_t_aiXXXXXX";
+    std::string root = mkdtemp(dir_template);
+    int port = 0;
+    int listener = listenLoopback(port);
+    CPPUNIT_ASSERT(listener >= 0);
+
+    // Answers one request, then goes away: a second query that reached the
+    // network would fail to connect
+    pid_t server = fork();
+    if (server == 0) {
+      int conn = accept(listener, nullptr, nullptr);
+      if (readRequest(conn)) {
+        std::string body = "{\"message\":{\"content\":\"Lists files.\"},\"done\":true}\n";
+        writeText(conn, "HTTP/1.1 200 OK\r\nContent-Length: " + std::to_string(body.size()) +
+                            "\r\nConnection: close\r\n\r\n" + body);
+      }
+      _exit(0);
+    }
+    close(listener);
+
+    helix::VariableStore& vars = helix::VariableStore::global();
+    std::vector<std::pair<std::string, std::optional<helix::VariableStore::Variable>>> saved;
+    for (const char* name : {"http_proxy", "all_proxy", "ALL_PROXY", "HELIX_AI_PROVIDER", "HELIX_AI_URL",
+                             "HELIX_AI_CACHE_DIR", "HELIX_AI_CACHE_TTL"}) {
+      saved.emplace_back(name, vars.save(name));
+      vars.unset(name);
+    }
+    vars.set("HELIX_AI_PROVIDER", "ollama");
+    vars.set("HELIX_AI_URL", "http://127.0.0.1:" + std::to_string(port) + "/api/chat");
+    vars.set("HELIX_AI_CACHE_DIR", root);
+
+    std::stringstream out;
+    std::streambuf* prev_cout = std::cout.rdbuf(out.rdbuf());
+    std::streambuf* prev_cerr = std::cerr.rdbuf(out.rdbuf());
+    {
+      helix::StartupOptions batch;
+      batch.interactive = false;
+      batch.load_rc = false;
+      helix::Shell shell(batch);
+      shell.processInputString("ai explain ls -la");
+      int status = 0;
+      waitpid(server, &status, 0);
+      shell.processInputString("ai explain ls -la");
+      shell.processInputString("ai --no-cache explain ls -la");
+    }
+    std::cout.rdbuf(prev_cout);
+    std::cerr.rdbuf(prev_cerr);
+
+    // The first two answered, the second from disk; --no-cache went out
+    std::string output = out.str();
+    size_t first = output.find("Lists files.");
+    CPPUNIT_ASSERT(first != std::string::npos);
+    size_t second = output.find("Lists files.", first + 1);
+    CPPUNIT_ASSERT(second != std::string::npos);
+    CPPUNIT_ASSERT(output.find("Lists files.", second + 1) == std::string::npos);
+    CPPUNIT_ASSERT(output.find("ai: ", second) != std::string::npos);
+
+    helix::HttpClient::global().closeIdle();
+    for (auto& [name, value] : saved) vars.restore(name, std::move(value));
+    std::string cleanup = "rm -rf " + root;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestAiProvider, "AiProvider");
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestAiProvider);
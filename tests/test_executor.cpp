@@ -2,14 +2,28 @@
 #include "../include/parser.h"
 #include "../include/tokenizer.h"
 #include "../include/types.h"
+#include "../include/executor/path_cache.h"
+#include "../include/shell/variable_store.h"
+#include "../include/executor/process_spawner.h"
+#include "../include/executor/fd_utils.h"
+#include "../include/executor/fd_manager.h"
+#include "../include/executor/glob_engine.h"
+#include "../include/executor/pattern.h"
 #include <cppunit/TestAssert.h>
 #include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <sstream>
 #include <fstream>
 #include <cstdio>
 #include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <fnmatch.h>
 
 // Unit tests for the Executor class specifically
 class TestExecutor : public CppUnit::TestFixture {
@@ -33,12 +47,22 @@ class TestExecutor : public CppUnit::TestFixture {
   CPPUNIT_TEST(testOutputRedirection);
   CPPUNIT_TEST(testErrorRedirection);
   CPPUNIT_TEST(testAppendMode);
-
-  // PATH and executable finding - tested indirectly through execution
-  // These are tested by command execution success/failure
+  CPPUNIT_TEST(testRedirectionsApplyInSourceOrder);
+
+  // PATH and executable finding - mostly tested indirectly through execution
+  CPPUNIT_TEST(testPathCacheRecordsHits);
+  CPPUNIT_TEST(testPathCacheInvalidation);
+  CPPUNIT_TEST(testPathCacheCommandNames);
+  CPPUNIT_TEST(testSpawnAppliesRedirections);
+  CPPUNIT_TEST(testInheritedFdsMarkedCloexec);
+  CPPUNIT_TEST(testLargeHeredocDoesNotBlock);
+  CPPUNIT_TEST(testGlobEngineCachesListings);
+  CPPUNIT_TEST(testPatternMatcherAgreesWithFnmatch);
 
   // Error conditions
   CPPUNIT_TEST(testBackgroundExecution);
+  CPPUNIT_TEST(testBackgroundPipelineProcessGroup);
+  CPPUNIT_TEST(testPipelineStageStatuses);
   CPPUNIT_TEST(testSetupRedirectionsFailedInput);
   CPPUNIT_TEST(testSetupRedirectionsFailedOutput);
 
@@ -138,6 +162,242 @@ public:
     assertCommandExitCode("definitely_not_a_real_command arg", 127);
   }
 
+  void testPathCacheRecordsHits() {
+    helix::PathCache& cache = helix::PathCache::global();
+    cache.clear();
+
+    assertCommandExitCode("true", 0);
+    assertCommandExitCode("true", 0);
+
+    const helix::PathCache::Entry* entry = cache.find("true");
+    CPPUNIT_ASSERT(entry != nullptr);
+    CPPUNIT_ASSERT_EQUAL(2UL, entry->hits);
+
+    // Lookups that don't execute leave the counter alone
+    CPPUNIT_ASSERT(!cache.lookup("true", false).empty());
+    CPPUNIT_ASSERT_EQUAL(2UL, cache.find("true")->hits);
+  }
+
+  void testPathCacheCommandNames() {
+    char dir_template[] = "/tmp/test_path_names_XXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::ofstream(dir + "/helix_names_tool") << "#!/bin/sh\n";
+    chmod((dir + "/helix_names_tool").c_str(), 0755);
+    std::ofstream(dir + "/helix_names_data") << "not a program\n";
+
+    helix::VariableStore& vars = helix::VariableStore::global();
+    std::string saved = *vars.find("PATH");
+    vars.set("PATH", dir + ":" + saved);
+
+    helix::PathCache& cache = helix::PathCache::global();
+    auto has = [&cache](const std::string& name) {
+      const auto& names = cache.commandNames();
+      return std::binary_search(names.begin(), names.end(), name);
+    };
+    CPPUNIT_ASSERT(has("helix_names_tool"));
+    CPPUNIT_ASSERT(!has("helix_names_data"));
+    CPPUNIT_ASSERT(has("sh"));
+
+    // A new program changes the directory mtime, so only that listing is re-read
+    std::ofstream(dir + "/helix_names_new") << "#!/bin/sh\n";
+    chmod((dir + "/helix_names_new").c_str(), 0755);
+    CPPUNIT_ASSERT(has("helix_names_new"));
+
+    vars.set("PATH", saved);
+    CPPUNIT_ASSERT(!has("helix_names_tool"));
+    for (const char* name : {"helix_names_tool", "helix_names_data", "helix_names_new"}) {
+      unlink((dir + "/" + name).c_str());
+    }
+    rmdir(dir.c_str());
+  }
+
+  void testPathCacheInvalidation() {
+    char dir_template[] = "/tmp/test_path_cache_XXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::string tool = dir + "/helix_cache_probe";
+    std::ofstream(tool) << "#!/bin/sh\nexit 0\n";
+    chmod(tool.c_str(), 0755);
+
+    helix::VariableStore& vars = helix::VariableStore::global();
+    const std::string* old_path = vars.find("PATH");
+    std::string saved = old_path ? *old_path : "";
+    vars.set("PATH", dir + ":" + saved);
+
+    helix::PathCache& cache = helix::PathCache::global();
+    CPPUNIT_ASSERT_EQUAL(tool, cache.lookup("helix_cache_probe"));
+
+    // Removing the file changes the directory mtime, so the entry is dropped
+    unlink(tool.c_str());
+    CPPUNIT_ASSERT_EQUAL(std::string(), cache.lookup("helix_cache_probe"));
+
+    // Assigning PATH discards every cached entry
+    CPPUNIT_ASSERT(!cache.lookup("true").empty());
+    vars.set("PATH", saved);
+    CPPUNIT_ASSERT(cache.find("true") == nullptr);
+
+    rmdir(dir.c_str());
+  }
+
+  void testSpawnAppliesRedirections() {
+    if (!helix::ProcessSpawner::supported()) return;
+
+    std::string out = createTempFile("");
+    helix::Command cmd;
+    cmd.args = {"/bin/sh", "-c", "cat; echo oops >&2"};
+    cmd.redirect(helix::Redirection::Kind::HERESTRING, "spawned");
+    cmd.redirect(helix::Redirection::Kind::OUTPUT, out);
+    cmd.redirect(helix::Redirection::Kind::ERR_TO_OUT);
+
+    helix::ProcessSpawner spawner;
+    pid_t pid = spawner.spawn("/bin/sh", cmd.args, cmd, -1, -1, -1);
+    CPPUNIT_ASSERT(pid > 0);
+    int status = 0;
+    CPPUNIT_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::ifstream in(out);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CPPUNIT_ASSERT_EQUAL(std::string("spawned\noops\n"), content);
+
+    // Bodies larger than a pipe buffer are spawned too (memfd-backed)
+    cmd.args = {"/bin/sh", "-c", "wc -c"};
+    cmd.redirections[0].target = std::string(300 * 1024, 'x');
+    pid = spawner.spawn("/bin/sh", cmd.args, cmd, -1, -1, -1);
+    CPPUNIT_ASSERT(pid > 0);
+    CPPUNIT_ASSERT_EQUAL(pid, waitpid(pid, &status, 0));
+    std::ifstream counted(out);
+    size_t bytes = 0;
+    counted >> bytes;
+    CPPUNIT_ASSERT_EQUAL(size_t(300 * 1024 + 1), bytes);
+    cleanupTempFile(out);
+  }
+
+  void testLargeHeredocDoesNotBlock() {
+    // Far beyond the 64 KiB pipe buffer: a single blocking write would hang
+    std::string body(2 * 1024 * 1024, 'q');
+    body += "\nend\n";
+    helix::Command cmd;
+    cmd.args = {"cat"};
+    cmd.redirect(helix::Redirection::Kind::HEREDOC, "EOF", body);
+
+    std::string read_back;
+    {
+      helix::FileDescriptorManager fds;
+      int input_fd = -1, output_fd = -1;
+      CPPUNIT_ASSERT(fds.setupRedirections(cmd, input_fd, output_fd));
+      CPPUNIT_ASSERT(fcntl(STDIN_FILENO, F_GETFD) != -1);
+      char buf[65536];
+      ssize_t n;
+      while ((n = read(STDIN_FILENO, buf, sizeof(buf))) > 0) read_back.append(buf, static_cast<size_t>(n));
+    }
+    CPPUNIT_ASSERT(read_back == body);
+
+    // Small bodies still take the inline pipe
+    int fd = helix::openInputFd("short\n");
+    CPPUNIT_ASSERT(fd != -1);
+    CPPUNIT_ASSERT_EQUAL(off_t(-1), lseek(fd, 0, SEEK_CUR));
+    CPPUNIT_ASSERT(fcntl(fd, F_GETFD) & FD_CLOEXEC);
+    close(fd);
+  }
+
+  void testGlobEngineCachesListings() {
+    char dir_template[] = "/tmp/test_glob_XXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::vector<std::string> dirs = {dir + "/sub", dir + "/sub/deep", dir + "/.hidden"};
+    for (const auto& d : dirs) mkdir(d.c_str(), 0755);
+    std::vector<std::string> files = {dir + "/a.txt", dir + "/b.log", dir + "/sub/c.log",
+                                      dir + "/sub/deep/e.log", dir + "/.hidden/x.log"};
+    for (const auto& f : files) std::ofstream(f) << "x";
+
+    helix::GlobEngine& glob = helix::GlobEngine::global();
+    auto expand = [&glob](const std::string& pattern) {
+      std::vector<std::string> out;
+      glob.expand(pattern, out);
+      return out;
+    };
+    using List = std::vector<std::string>;
+    CPPUNIT_ASSERT(expand(dir + "/*.log") == List{dir + "/b.log"});
+    CPPUNIT_ASSERT(expand(dir + "/**/*.log") ==
+                   (List{dir + "/b.log", dir + "/sub/c.log", dir + "/sub/deep/e.log"}));
+    CPPUNIT_ASSERT(expand(dir + "/*/") == List{dir + "/sub/"});
+    CPPUNIT_ASSERT(expand(dir + "/.h*/*") == List{dir + "/.hidden/x.log"});
+    CPPUNIT_ASSERT(expand(dir + "/*.none").empty());
+
+    // Directories older than a second are served from the cache
+    struct timeval old[2] = {{1000000000, 0}, {1000000000, 0}};
+    for (const auto& d : {dir, dirs[0], dirs[1]}) utimes(d.c_str(), old);
+    expand(dir + "/**/*.log");
+    helix::GlobEngine::Stats before = glob.stats();
+    expand(dir + "/**/*.log");
+    helix::GlobEngine::Stats after = glob.stats();
+    CPPUNIT_ASSERT_EQUAL(before.reads, after.reads);
+    CPPUNIT_ASSERT(after.hits >= before.hits + 3);
+
+    // A new file moves the mtime, so the listing is read again
+    std::string added = dir + "/sub/f.log";
+    std::ofstream(added) << "x";
+    CPPUNIT_ASSERT(expand(dir + "/sub/*.log") == (List{dir + "/sub/c.log", added}));
+
+    files.push_back(added);
+    for (const auto& f : files) unlink(f.c_str());
+    for (auto it = dirs.rbegin(); it != dirs.rend(); ++it) rmdir(it->c_str());
+    rmdir(dir.c_str());
+  }
+
+  void testPatternMatcherAgreesWithFnmatch() {
+    using helix::Pattern;
+    const char* patterns[] = {"abc", "ab*", "*bc", "*b*", "*", "", "a?c", "*.[ch]", "[!a-c]*",
+                              "[]x]*", "a\\*", "*[[:digit:]]?", "a*b*c", "[ab", "?*?", ".*", "x[^.]y"};
+    const char* subjects[] = {"abc", "ab", "bc", "xbx", "", "a.c", "main.c", "d.h", "]", "a*",
+                              "ab1z", "aXbYc", "[ab", ".hidden", "x.y", "xzy", "acb"};
+    for (const char* p : patterns) {
+      for (int flags : {0, FNM_PERIOD}) {
+        Pattern pattern(p, flags ? Pattern::kPeriod : Pattern::kNone);
+        for (const char* s : subjects) {
+          std::string what = std::string(p) + " ~ " + s;
+          CPPUNIT_ASSERT_EQUAL_MESSAGE(what, fnmatch(p, s, flags) == 0, pattern.matches(s));
+        }
+      }
+    }
+
+    // Shortest and longest prefixes and suffixes, as ${v#p} ${v##p} ${v%p} ${v%%p}
+    std::string path = "/usr/lib/libz.so.1";
+    CPPUNIT_ASSERT_EQUAL(size_t(1), Pattern("*/").matchPrefix(path, false));
+    CPPUNIT_ASSERT_EQUAL(size_t(9), Pattern("*/").matchPrefix(path, true));
+    CPPUNIT_ASSERT_EQUAL(size_t(16), Pattern(".*").matchSuffix(path, false));
+    CPPUNIT_ASSERT_EQUAL(size_t(13), Pattern(".*").matchSuffix(path, true));
+    CPPUNIT_ASSERT_EQUAL(size_t(13), Pattern(".[a-z][a-z].?").matchSuffix(path, true));
+    CPPUNIT_ASSERT_EQUAL(std::string::npos, Pattern("lib").matchPrefix(path, false));
+
+    // Each text is compiled once
+    helix::PatternMatcher& matcher = helix::PatternMatcher::global();
+    helix::PatternMatcher::Stats before = matcher.stats();
+    for (int i = 0; i < 3; ++i) CPPUNIT_ASSERT(matcher.matches("*test_pattern_[0-9]", "a_test_pattern_7"));
+    CPPUNIT_ASSERT(!matcher.matches("*test_pattern_[0-9]", ".test_pattern_7", Pattern::kPeriod));
+    helix::PatternMatcher::Stats after = matcher.stats();
+    CPPUNIT_ASSERT_EQUAL(before.compiled + 2, after.compiled);
+    CPPUNIT_ASSERT_EQUAL(before.hits + 2, after.hits);
+  }
+
+  void testInheritedFdsMarkedCloexec() {
+    int fds[2];
+    CPPUNIT_ASSERT(helix::makeCloexecPipe(fds));
+    CPPUNIT_ASSERT(fcntl(fds[0], F_GETFD) & FD_CLOEXEC);
+    CPPUNIT_ASSERT(fcntl(fds[1], F_GETFD) & FD_CLOEXEC);
+    close(fds[0]);
+    close(fds[1]);
+
+    // A plain descriptor above the old 1024 loop bound is still caught
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur <= 1100) return;
+    int high = fcntl(STDOUT_FILENO, F_DUPFD, 1100);
+    CPPUNIT_ASSERT(high >= 1100);
+    CPPUNIT_ASSERT(!(fcntl(high, F_GETFD) & FD_CLOEXEC));
+    helix::markInheritedFdsCloexec(high);
+    CPPUNIT_ASSERT(fcntl(high, F_GETFD) & FD_CLOEXEC);
+    close(high);
+  }
+
   void testEmptyCommand() {
     // Empty command should be handled
     assertCommandExitCode("", 0); // Parser should handle empty commands safely
@@ -273,6 +533,42 @@ public:
     CPPUNIT_ASSERT(bg_pid > 0); // Should have a valid PID
   }
 
+  void testBackgroundPipelineProcessGroup() {
+    helix::ParsedCommand cmd;
+    cmd.background = true;
+    helix::Command first, second;
+    first.args = {"sleep", "0.2"};
+    second.args = {"sh", "-c", "exit 3"};
+    cmd.pipeline.commands = {first, second};
+
+    CPPUNIT_ASSERT_EQUAL(0, executor->execute(cmd));
+    std::vector<pid_t> pids = executor->getLastBackgroundPids();
+    CPPUNIT_ASSERT_EQUAL(size_t(2), pids.size());
+
+    // Both stages live in a group led by the first one
+    pid_t pgid = executor->getLastBackgroundPid();
+    CPPUNIT_ASSERT_EQUAL(pids[0], pgid);
+    CPPUNIT_ASSERT_EQUAL(pgid, getpgid(pids[0]));
+    int status = 0;
+    if (getpgid(pids[1]) != -1) CPPUNIT_ASSERT_EQUAL(pgid, getpgid(pids[1]));
+    CPPUNIT_ASSERT_EQUAL(pids[1], waitpid(pids[1], &status, 0));
+    CPPUNIT_ASSERT_EQUAL(3, WEXITSTATUS(status));
+    waitpid(pids[0], &status, 0);
+  }
+
+  void testPipelineStageStatuses() {
+    helix::ParsedCommand cmd;
+    helix::Command a, b, c;
+    a.args = {"sh", "-c", "exit 2"};
+    b.args = {"sh", "-c", "cat >/dev/null; exit 0"};
+    c.args = {"sh", "-c", "exit 5"};
+    cmd.pipeline.commands = {a, b, c};
+
+    CPPUNIT_ASSERT_EQUAL(5, executor->execute(cmd));
+    std::vector<int> expected = {2, 0, 5};
+    CPPUNIT_ASSERT(expected == executor->getLastPipeStatus());
+  }
+
   void testSetupRedirectionsFailedInput() {
     // Test redirection with non-existent input file - should fail
     std::string cmd = "cat < /this/file/definitely/does/not/exist";
@@ -296,6 +592,22 @@ public:
     CPPUNIT_ASSERT(exit_code != 42); // Arbitrary success code that shouldn't happen
   }
 
+  void testRedirectionsApplyInSourceOrder() {
+    // 2>&1 copies stdout as it is at that point: err lands in a, not b
+    std::string a = createTempFile("");
+    std::string b = createTempFile("");
+    assertCommandExitCode("sh -c 'echo err >&2' > " + a + " 2>&1 > " + b, 0);
+
+    std::ifstream fa(a), fb(b);
+    std::string line;
+    CPPUNIT_ASSERT(std::getline(fa, line));
+    CPPUNIT_ASSERT_EQUAL(std::string("err"), line);
+    CPPUNIT_ASSERT(!std::getline(fb, line));
+
+    cleanupTempFile(a);
+    cleanupTempFile(b);
+  }
+
   void testErrorAppendRedirections() {
     // Test error append redirection (2>>)
     std::string error_file = "/tmp/test_error_append";
@@ -192,12 +192,13 @@ protected:
       }
     }
 
+    using Kind = helix::Redirection::Kind;
+    const helix::Redirection *input = cmd.findRedirection(Kind::INPUT);
+    const helix::Redirection *output = cmd.findRedirection(expected_append ? Kind::APPEND : Kind::OUTPUT);
     CPPUNIT_ASSERT_EQUAL_MESSAGE(msg.str() + " - input file", expected_input,
-                                 cmd.input_file);
+                                 input ? input->target : std::string());
     CPPUNIT_ASSERT_EQUAL_MESSAGE(msg.str() + " - output file", expected_output,
-                                 cmd.output_file);
-    CPPUNIT_ASSERT_EQUAL_MESSAGE(msg.str() + " - append mode", expected_append,
-                                 cmd.append_mode);
+                                 output ? output->target : std::string());
   }
 };
 
@@ -1,6 +1,7 @@
 #include "../include/parser.h" // Includes the Parser class definition, providing parse() method to convert token sequences into ParsedCommand structures.
 #include "../include/tokenizer.h" // Includes the Tokenizer class for generating tokens to test parsing.
 #include "../include/types.h" // Includes ParsedCommand, TokenType, and related type definitions.
+#include "../include/script_parser.h" // Includes ScriptParser and the AST node types it produces.
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
@@ -12,6 +13,10 @@ class ParserTest : public CppUnit::TestFixture {
     CPPUNIT_TEST(testBackgroundParsing);
     CPPUNIT_TEST(testComplexPipeline);
     CPPUNIT_TEST(testParserErrorRecovery);
+    CPPUNIT_TEST(testScriptParserCompoundCommands);
+    CPPUNIT_TEST(testScriptParserIncompleteAndErrors);
+    CPPUNIT_TEST(testForRangesAndArithmeticFor);
+    CPPUNIT_TEST(testCoprocAndDescriptorRedirections);
     CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -38,8 +43,7 @@ public:
         CPPUNIT_ASSERT_EQUAL(std::string("ls"), cmd.pipeline.commands[0].args[0]);
         CPPUNIT_ASSERT_EQUAL(std::string("-la"), cmd.pipeline.commands[0].args[1]);
         CPPUNIT_ASSERT_EQUAL(false, cmd.background);
-        CPPUNIT_ASSERT(cmd.pipeline.commands[0].input_file.empty());
-        CPPUNIT_ASSERT(cmd.pipeline.commands[0].output_file.empty());
+        CPPUNIT_ASSERT(cmd.pipeline.commands[0].redirections.empty());
     }
 
     void testPipelineParsing() {
@@ -64,35 +68,46 @@ public:
     }
 
     void testRedirectionParsing() {
+        using Kind = helix::Redirection::Kind;
+        auto only = [](const helix::ParsedCommand& cmd, Kind kind, const std::string& target) {
+            const auto& redirections = cmd.pipeline.commands[0].redirections;
+            return redirections.size() == 1 && redirections[0].kind == kind &&
+                   redirections[0].target == target;
+        };
+
         // Input redirection
         auto tokens = tokenizer->tokenize("cat < input.txt");
         helix::ParsedCommand cmd = parser->parse(tokens);
-        CPPUNIT_ASSERT_EQUAL(std::string("input.txt"), cmd.pipeline.commands[0].input_file);
-        CPPUNIT_ASSERT(cmd.pipeline.commands[0].output_file.empty());
+        CPPUNIT_ASSERT(only(cmd, Kind::INPUT, "input.txt"));
 
         // Output redirection
         tokens = tokenizer->tokenize("echo hello > output.txt");
         cmd = parser->parse(tokens);
-        CPPUNIT_ASSERT_EQUAL(std::string("output.txt"), cmd.pipeline.commands[0].output_file);
-        CPPUNIT_ASSERT_EQUAL(false, cmd.pipeline.commands[0].append_mode);
+        CPPUNIT_ASSERT(only(cmd, Kind::OUTPUT, "output.txt"));
 
         // Append redirection
         tokens = tokenizer->tokenize("echo hello >> output.txt");
         cmd = parser->parse(tokens);
-        CPPUNIT_ASSERT_EQUAL(std::string("output.txt"), cmd.pipeline.commands[0].output_file);
-        CPPUNIT_ASSERT_EQUAL(true, cmd.pipeline.commands[0].append_mode);
+        CPPUNIT_ASSERT(only(cmd, Kind::APPEND, "output.txt"));
 
         // Error redirection
         tokens = tokenizer->tokenize("command 2> error.log");
         cmd = parser->parse(tokens);
-        CPPUNIT_ASSERT_EQUAL(std::string("error.log"), cmd.pipeline.commands[0].error_file);
-        CPPUNIT_ASSERT_EQUAL(false, cmd.pipeline.commands[0].error_append_mode);
+        CPPUNIT_ASSERT(only(cmd, Kind::ERROR, "error.log"));
 
         // Error append
         tokens = tokenizer->tokenize("command 2>> error.log");
         cmd = parser->parse(tokens);
-        CPPUNIT_ASSERT_EQUAL(std::string("error.log"), cmd.pipeline.commands[0].error_file);
-        CPPUNIT_ASSERT_EQUAL(true, cmd.pipeline.commands[0].error_append_mode);
+        CPPUNIT_ASSERT(only(cmd, Kind::ERROR_APPEND, "error.log"));
+
+        // Several redirections are kept in source order
+        tokens = tokenizer->tokenize("cmd 2>&1 > out < in");
+        cmd = parser->parse(tokens);
+        const auto& list = cmd.pipeline.commands[0].redirections;
+        CPPUNIT_ASSERT_EQUAL(size_t(3), list.size());
+        CPPUNIT_ASSERT(list[0].kind == Kind::ERR_TO_OUT);
+        CPPUNIT_ASSERT(list[1].kind == Kind::OUTPUT && list[1].target == "out");
+        CPPUNIT_ASSERT(list[2].kind == Kind::INPUT && list[2].target == "in");
     }
 
     void testBackgroundParsing() {
@@ -117,7 +132,9 @@ public:
         // Second command with redirection
         CPPUNIT_ASSERT_EQUAL(std::string("grep"), cmd.pipeline.commands[1].args[0]);
         CPPUNIT_ASSERT_EQUAL(std::string("pattern"), cmd.pipeline.commands[1].args[1]);
-        CPPUNIT_ASSERT_EQUAL(std::string("results.txt"), cmd.pipeline.commands[1].output_file);
+        const auto* out = cmd.pipeline.commands[1].findRedirection(helix::Redirection::Kind::OUTPUT);
+        CPPUNIT_ASSERT(out);
+        CPPUNIT_ASSERT_EQUAL(std::string("results.txt"), out->target);
     }
 
     void testParserErrorRecovery() {
@@ -132,6 +149,144 @@ public:
         CPPUNIT_ASSERT_EQUAL(size_t(1), cmd.pipeline.commands.size());
         CPPUNIT_ASSERT_EQUAL(std::string("pwd"), cmd.pipeline.commands[0].args[0]);
     }
+
+    void testScriptParserCompoundCommands() {
+        helix::ScriptParser script;
+        auto result = script.parse("for f in a{1,2} \"$x\"; do\n  echo \"$f\" >> out.txt\ndone < in.txt");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), result.program->items.size());
+
+        // Words stay raw for per-iteration expansion; braces expand once
+        auto* loop = static_cast<helix::ForNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT(loop->kind == helix::NodeKind::FOR);
+        CPPUNIT_ASSERT_EQUAL(std::string("f"), loop->variable);
+        CPPUNIT_ASSERT_EQUAL(size_t(3), loop->words.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("a2"), loop->words[1]);
+        CPPUNIT_ASSERT_EQUAL(std::string("\"$x\""), loop->words[2]);
+        CPPUNIT_ASSERT(loop->redirects);
+        CPPUNIT_ASSERT_EQUAL(size_t(1), loop->redirects->redirections.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("in.txt"), loop->redirects->redirections[0].target);
+
+        auto* body = static_cast<helix::ListNode*>(loop->body.get());
+        auto* echo = static_cast<helix::SimpleCommandNode*>(body->items[0].node.get());
+        CPPUNIT_ASSERT(echo->kind == helix::NodeKind::SIMPLE);
+        CPPUNIT_ASSERT_EQUAL(std::string("\"$f\""), echo->command.args[1]);
+        const auto* append = echo->command.findRedirection(helix::Redirection::Kind::APPEND);
+        CPPUNIT_ASSERT(append);
+        CPPUNIT_ASSERT_EQUAL(std::string("out.txt"), append->target);
+
+        result = script.parse("if a && ! b; then c | d; elif e; then :; else f & fi");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+        auto* cond = static_cast<helix::IfNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT_EQUAL(size_t(2), cond->clauses.size());
+        CPPUNIT_ASSERT(cond->else_body);
+        auto* first = static_cast<helix::ListNode*>(cond->clauses[0].condition.get());
+        CPPUNIT_ASSERT(first->items[0].node->kind == helix::NodeKind::AND_OR);
+        auto* else_list = static_cast<helix::ListNode*>(cond->else_body.get());
+        CPPUNIT_ASSERT(else_list->items[0].background);
+
+        result = script.parse("greet() { echo hi; }\ncase $1 in\n  a|b) greet ;;\n  *) ;;\nesac");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+        CPPUNIT_ASSERT_EQUAL(size_t(2), result.program->items.size());
+        auto* def = static_cast<helix::FunctionDefNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT_EQUAL(std::string("greet"), def->name);
+        CPPUNIT_ASSERT_EQUAL(std::string("{ echo hi; }"), def->body_text);
+        auto* sw = static_cast<helix::CaseNode*>(result.program->items[1].node.get());
+        CPPUNIT_ASSERT_EQUAL(size_t(2), sw->arms.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(2), sw->arms[0].patterns.size());
+        CPPUNIT_ASSERT(!sw->arms[1].body);
+    }
+
+    void testCoprocAndDescriptorRedirections() {
+        helix::ScriptParser script;
+        // A NAME only in front of a compound command, as in bash
+        auto result = script.parse("coproc bc -l\ncoproc CALC { bc -l; } 2> err\ncoproc while read x; do :; done");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+        CPPUNIT_ASSERT_EQUAL(size_t(3), result.program->items.size());
+        auto* simple = static_cast<helix::CoprocNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT(simple->kind == helix::NodeKind::COPROC);
+        CPPUNIT_ASSERT_EQUAL(std::string("COPROC"), simple->name);
+        CPPUNIT_ASSERT(simple->body->kind == helix::NodeKind::SIMPLE);
+        CPPUNIT_ASSERT_EQUAL(std::string("bc -l"), simple->text);
+        auto* named = static_cast<helix::CoprocNode*>(result.program->items[1].node.get());
+        CPPUNIT_ASSERT_EQUAL(std::string("CALC"), named->name);
+        CPPUNIT_ASSERT(named->body->kind == helix::NodeKind::GROUP);
+        CPPUNIT_ASSERT(named->body->redirects);
+        auto* loop = static_cast<helix::CoprocNode*>(result.program->items[2].node.get());
+        CPPUNIT_ASSERT_EQUAL(std::string("COPROC"), loop->name);
+        CPPUNIT_ASSERT(loop->body->kind == helix::NodeKind::LOOP);
+
+        // >&N and <&N take the descriptor as a word; >&2 keeps its own token
+        result = script.parse("echo q >&${CALC[1]} <&\"$in\" >&2 >&20");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+        auto* echo = static_cast<helix::SimpleCommandNode*>(result.program->items[0].node.get());
+        const auto& redirections = echo->command.redirections;
+        CPPUNIT_ASSERT_EQUAL(size_t(4), redirections.size());
+        CPPUNIT_ASSERT(redirections[0].kind == helix::Redirection::Kind::DUP_OUT);
+        CPPUNIT_ASSERT_EQUAL(std::string("${CALC[1]}"), redirections[0].target);
+        CPPUNIT_ASSERT(redirections[1].kind == helix::Redirection::Kind::DUP_IN);
+        CPPUNIT_ASSERT(redirections[2].kind == helix::Redirection::Kind::OUT_TO_ERR);
+        CPPUNIT_ASSERT(redirections[3].kind == helix::Redirection::Kind::DUP_OUT);
+        CPPUNIT_ASSERT_EQUAL(std::string("20"), redirections[3].target);
+        CPPUNIT_ASSERT_EQUAL(size_t(2), echo->command.args.size());
+    }
+
+    void testForRangesAndArithmeticFor() {
+        helix::ScriptParser script;
+        auto result = script.parse("for n in a {1..1000000} f{001..100..3}.txt {x,y}; do :; done");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+
+        // Sequences among literal text are kept as ranges, not expanded
+        auto* loop = static_cast<helix::ForNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT_EQUAL(size_t(3), loop->words.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(2), loop->ranges.size());
+        CPPUNIT_ASSERT_EQUAL(size_t(1), loop->ranges[0].index);
+        CPPUNIT_ASSERT_EQUAL(size_t(1000000), loop->ranges[0].sequence.size());
+        const auto& files = loop->ranges[1];
+        CPPUNIT_ASSERT_EQUAL(size_t(34), files.sequence.size());
+        std::string term = files.prefix;
+        files.sequence.append(33, term);
+        CPPUNIT_ASSERT_EQUAL(std::string("f100"), term);
+        CPPUNIT_ASSERT_EQUAL(std::string(".txt"), files.suffix);
+
+        // An argument list is still expanded in full, padding and steps included
+        auto expanded = helix::ScriptParser::braceExpand("{-05..3..4}");
+        CPPUNIT_ASSERT_EQUAL(size_t(3), expanded.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("-05"), expanded[0]);
+        CPPUNIT_ASSERT_EQUAL(std::string("003"), expanded[2]);
+        CPPUNIT_ASSERT_EQUAL(std::string("{1..3..x}"), helix::ScriptParser::braceExpand("{1..3..x}")[0]);
+
+        result = script.parse("for ((i = 0; i < n; i++))\ndo echo $i >&2; done");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::OK);
+        loop = static_cast<helix::ForNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT(loop->arithmetic);
+        CPPUNIT_ASSERT_EQUAL(std::string("i = 0"), loop->init);
+        CPPUNIT_ASSERT_EQUAL(std::string(" i < n"), loop->condition);
+        CPPUNIT_ASSERT_EQUAL(std::string(" i++"), loop->update);
+
+        CPPUNIT_ASSERT(script.parse("for ((i = 0; i < 3)); do :; done").status == helix::ScriptParser::Status::ERROR);
+        CPPUNIT_ASSERT(script.parse("for ((i = 0;").status == helix::ScriptParser::Status::INCOMPLETE);
+    }
+
+    void testScriptParserIncompleteAndErrors() {
+        helix::ScriptParser script;
+        CPPUNIT_ASSERT(script.parse("while true; do").status == helix::ScriptParser::Status::INCOMPLETE);
+        CPPUNIT_ASSERT(script.parse("echo 'open").status == helix::ScriptParser::Status::INCOMPLETE);
+        CPPUNIT_ASSERT(script.parse("cat <<EOF\nbody").status == helix::ScriptParser::Status::INCOMPLETE);
+        CPPUNIT_ASSERT(script.parse("a &&").status == helix::ScriptParser::Status::INCOMPLETE);
+
+        auto result = script.parse("echo a; fi");
+        CPPUNIT_ASSERT(result.status == helix::ScriptParser::Status::ERROR);
+        CPPUNIT_ASSERT(result.error.find("`fi'") != std::string::npos);
+        CPPUNIT_ASSERT(script.parse("| grep x").status == helix::ScriptParser::Status::ERROR);
+
+        // Aliases are spliced in command position only
+        std::map<std::string, std::string> aliases = {{"ll", "ls -l"}};
+        result = script.parse("ll ll", &aliases);
+        auto* cmd = static_cast<helix::SimpleCommandNode*>(result.program->items[0].node.get());
+        CPPUNIT_ASSERT_EQUAL(size_t(3), cmd->command.args.size());
+        CPPUNIT_ASSERT_EQUAL(std::string("ll"), cmd->command.args[2]);
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(ParserTest);
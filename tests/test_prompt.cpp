@@ -0,0 +1,63 @@
+#include "../include/prompt.h"
+#include "../include/git_status_cache.h"
+#include <cppunit/TestAssert.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+// Tests for the prompt's git segment
+class TestPrompt : public CppUnit::TestFixture {
+  CPPUNIT_TEST_SUITE(TestPrompt);
+  CPPUNIT_TEST(testPorcelainMarkers);
+  CPPUNIT_TEST(testGitStatusCachedPerRepo);
+  CPPUNIT_TEST_SUITE_END();
+
+public:
+  void testPorcelainMarkers() {
+    auto markers = helix::GitStatusCache::parsePorcelain("M  staged.txt\n M dirty.txt\n");
+    CPPUNIT_ASSERT(markers.staged);
+    CPPUNIT_ASSERT(markers.dirty);
+    CPPUNIT_ASSERT(!markers.untracked);
+
+    markers = helix::GitStatusCache::parsePorcelain("?? new.txt\n");
+    CPPUNIT_ASSERT(!markers.staged && !markers.dirty && markers.untracked);
+
+    markers = helix::GitStatusCache::parsePorcelain("");
+    CPPUNIT_ASSERT(!markers.staged && !markers.dirty && !markers.untracked);
+  }
+
+  void testGitStatusCachedPerRepo() {
+    if (std::system("git --version >/dev/null 2>&1") != 0) return;
+
+    char dir_template[] = "/tmp/test_prompt_git_XXXXXX";
+    std::string root = mkdtemp(dir_template);
+    std::string init = "git init -q " + root + " >/dev/null 2>&1";
+    if (std::system(init.c_str()) != 0) return;
+    std::ofstream(root + "/new.txt") << "x\n";
+
+    helix::GitStatusCache cache;
+    // First sight of the repository: waits (within budget) for the worker
+    auto markers = cache.get(root, std::chrono::milliseconds(5000));
+    CPPUNIT_ASSERT(markers.has_value());
+    CPPUNIT_ASSERT(markers->untracked);
+
+    // Known now: answered immediately without a budget
+    CPPUNIT_ASSERT(cache.get(root, std::chrono::milliseconds(0)).has_value());
+
+    // The prompt finds the branch and renders the markers
+    helix::Prompt prompt;
+    prompt.setCurrentDirectory(root);
+    prompt.setGitStatusBudget(std::chrono::milliseconds(5000));
+    std::string info = prompt.getGitInfo();
+    CPPUNIT_ASSERT(info.find("●") != std::string::npos);
+
+    std::string cleanup = "rm -rf " + root;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+};
+
+CPPUNIT_TEST_SUITE_NAMED_REGISTRATION(TestPrompt, "Prompt");
+
+CPPUNIT_TEST_SUITE_REGISTRATION(TestPrompt);
@@ -2,11 +2,43 @@
 #include "../include/executor.h"
 #include "../include/parser.h"
 #include "../include/tokenizer.h"
+#include "../include/shell/job_manager.h"
+#include "../include/shell/variable_store.h"
+#include "../include/shell/history_store.h"
+#include "../include/shell/builtin_table.h"
+#include "../include/executor/arithmetic.h"
+#include "../include/shell/script_cache.h"
+#include "../include/shell/input_buffer.h"
+#include "../include/shell/shell_array.h"
+#include "../include/shell/shell_server.h"
+#include "../include/shell/stream_copy.h"
+#include "../include/executor/fd_utils.h"
+#include "../include/libhelix.h"
+#include "../include/trace.h"
+#include "../include/event_loop.h"
 #include <cppunit/TestAssert.h>
 #include <cppunit/extensions/HelperMacros.h>
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <optional>
 #include <sstream>
+#include <fstream>
+#include <unistd.h>
+#include <fcntl.h>
+#include <csignal>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Value of a shell variable ("<unset>" when it is not set)
+static std::string shellVar(const char* name) {
+  const std::string* value = helix::VariableStore::global().find(name);
+  return value ? *value : "<unset>";
+}
+
+static void unsetVar(const char* name) { helix::VariableStore::global().unset(name); }
 
 // Test Shell class to improve coverage
 class TestShell : public CppUnit::TestFixture {
@@ -14,6 +46,7 @@ class TestShell : public CppUnit::TestFixture {
 
   // Test shell construction and basic functionality
   CPPUNIT_TEST(testShellConstructor);
+  CPPUNIT_TEST(testBatchStartupSkipsInteractiveSetup);
   CPPUNIT_TEST(testProcessInputEmpty);
   CPPUNIT_TEST(testProcessInputExit);
   CPPUNIT_TEST(testProcessInputCd);
@@ -27,6 +60,42 @@ class TestShell : public CppUnit::TestFixture {
   CPPUNIT_TEST(testProcessInputPwd);
   CPPUNIT_TEST(testProcessInputExport);
   CPPUNIT_TEST(testProcessInputExportWithValue);
+  CPPUNIT_TEST(testProcessInputMultiLineBlock);
+  CPPUNIT_TEST(testErrexitAfterFailingSubshell);
+  CPPUNIT_TEST(testFunctionLocalsAndParams);
+  CPPUNIT_TEST(testSpecialParametersInBraces);
+  CPPUNIT_TEST(testCommandSubstitutionInProcess);
+  CPPUNIT_TEST(testPipeStatusVariable);
+  CPPUNIT_TEST(testArithmeticCompiledOnce);
+  CPPUNIT_TEST(testScriptsParsedWholeAndSourceCached);
+  CPPUNIT_TEST(testEnvpRebuiltOnlyForExports);
+  CPPUNIT_TEST(testOnlyExportedVariablesReachChildren);
+  CPPUNIT_TEST(testHistoryStoreIndexesAndAppends);
+  CPPUNIT_TEST(testCommandCompletionSources);
+  CPPUNIT_TEST(testBuiltinTableLookup);
+  CPPUNIT_TEST(testPipelineStagesRunShellCode);
+  CPPUNIT_TEST(testPipelineStagesKeepPrefixAssignments);
+  CPPUNIT_TEST(testJobEventsQueuedThenApplied);
+  CPPUNIT_TEST(testParallelForLoop);
+  CPPUNIT_TEST(testTimeKeywordAndStageUsage);
+  CPPUNIT_TEST(testBackgroundExitTimedDuringForegroundWait);
+  CPPUNIT_TEST(testBackgroundExitTimedDuringFg);
+  CPPUNIT_TEST(testTraceRecordsPhasesAndChildren);
+  CPPUNIT_TEST(testEventLoopWakesOnChildExit);
+  CPPUNIT_TEST(testBuiltinOutputGoesStraightToFiles);
+  CPPUNIT_TEST(testPatternsInCaseTestAndTrims);
+  CPPUNIT_TEST(testReadLeavesTheRestForChildren);
+  CPPUNIT_TEST(testArrayStorage);
+  CPPUNIT_TEST(testArraysDeclareAndMapfile);
+  CPPUNIT_TEST(testArrayElementSlices);
+  CPPUNIT_TEST(testLazyRangesAndArithmeticFor);
+  CPPUNIT_TEST(testServerRunsRequestsInWarmWorkers);
+  CPPUNIT_TEST(testEmbeddedInterpreter);
+  CPPUNIT_TEST(testCatAndTeeCopyInTheKernel);
+  CPPUNIT_TEST(testProcessSubstitution);
+  CPPUNIT_TEST(testCoprocessAnswersRepeatedly);
+  CPPUNIT_TEST(testKillJobSpecs);
+  CPPUNIT_TEST(testFinalCommandReplacesTheShell);
   // Add more tests as needed for 100% coverage
 
   CPPUNIT_TEST_SUITE_END();
@@ -67,6 +136,49 @@ public:
     }
   }
 
+  void testBatchStartupSkipsInteractiveSetup() {
+    char dir_template[] = "/tmp/helix_t_homeXXXXXX";
+    std::string home = mkdtemp(dir_template);
+    std::ofstream(home + "/.helixrc") << "HELIX_T_RC=1\n";
+    std::ofstream(home + "/env.sh") << "HELIX_T_ENV=1\n";
+    std::ofstream(home + "/.helix_history") << "old entry\n";
+
+    helix::VariableStore& vars = helix::VariableStore::global();
+    auto saved_home = vars.save("HOME");
+    vars.set("HOME", home);
+
+    helix::StartupOptions batch;
+    batch.interactive = false;
+    batch.load_rc = false;
+    {
+      // The history file and ~/.helixrc are left alone
+      helix::Shell shell(batch);
+      CPPUNIT_ASSERT_EQUAL(std::string("<unset>"), shellVar("HELIX_T_RC"));
+      std::string output;
+      captureOutput([&]() { shell.processInputString("history"); }, output);
+      CPPUNIT_ASSERT(output.find("old entry") == std::string::npos);
+    }
+    {
+      // $HELIX_ENV is the opt-in startup file for scripts
+      vars.set("HELIX_ENV", home + "/env.sh");
+      helix::Shell shell(batch);
+      CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_ENV"));
+      CPPUNIT_ASSERT_EQUAL(std::string("<unset>"), shellVar("HELIX_T_RC"));
+      unsetVar("HELIX_ENV");
+    }
+    {
+      batch.load_rc = true;
+      helix::Shell shell(batch);
+      CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_RC"));
+    }
+
+    vars.restore("HOME", saved_home);
+    unsetVar("HELIX_T_RC");
+    unsetVar("HELIX_T_ENV");
+    for (const char* name : {"/.helixrc", "/env.sh", "/.helix_history"}) unlink((home + name).c_str());
+    rmdir(home.c_str());
+  }
+
   void testProcessInputEmpty() {
     try {
       helix::Shell shell;
@@ -274,12 +386,13 @@ public:
       shell.processInputString("export TEST_VAR=test_value");
 
       // Verify the variable was set
-      const char* value = std::getenv("TEST_VAR");
-      CPPUNIT_ASSERT(value != nullptr);
-      CPPUNIT_ASSERT_EQUAL(std::string("test_value"), std::string(value));
+      const helix::VariableStore::Variable* var = helix::VariableStore::global().lookup("TEST_VAR");
+      CPPUNIT_ASSERT(var != nullptr);
+      CPPUNIT_ASSERT(var->exported);
+      CPPUNIT_ASSERT_EQUAL(std::string("test_value"), var->value);
 
       // Clean up
-      unsetenv("TEST_VAR");
+      unsetVar("TEST_VAR");
     } catch (const std::exception &e) {
       CPPUNIT_FAIL("Process export with value failed: " + std::string(e.what()));
     }
@@ -337,6 +450,1285 @@ public:
     }
   }
 
+  void testProcessInputMultiLineBlock() {
+    try {
+      helix::Shell shell;
+
+      std::string output;
+      captureOutput([&]() {
+        // Lines accumulate until the loop is complete, then run once
+        shell.processInputString("HELIX_T_SUM=");
+        shell.processInputString("for i in 1 2 3; do");
+        shell.processInputString("  if [ \"$i\" = 2 ]; then continue; fi");
+        CPPUNIT_ASSERT_EQUAL(std::string(), shellVar("HELIX_T_SUM"));
+        shell.processInputString("  HELIX_T_SUM=\"${HELIX_T_SUM}$i\"");
+        shell.processInputString("done");
+      }, output);
+
+      CPPUNIT_ASSERT_EQUAL(std::string("13"), shellVar("HELIX_T_SUM"));
+      unsetVar("HELIX_T_SUM");
+
+    } catch (const std::exception &e) {
+      CPPUNIT_FAIL("Process multi-line block failed: " + std::string(e.what()));
+    }
+  }
+
+  void testErrexitAfterFailingSubshell() {
+    std::string output;
+    captureOutput([&]() {
+      for (const char* subshell : {"(false)", "(exit 2)"}) {
+        helix::Shell shell;
+        CPPUNIT_ASSERT(!shell.processInputString(std::string("set -e; ") + subshell + "; HELIX_T_E=no"));
+      }
+      // Conditions are exempt, as for simple commands
+      helix::Shell shell;
+      CPPUNIT_ASSERT(shell.processInputString("set -e; if (false); then :; fi; (false) || HELIX_T_E=yes"));
+      shell.processInputString("set +e");
+    }, output);
+
+    CPPUNIT_ASSERT_EQUAL(std::string("yes"), shellVar("HELIX_T_E"));
+    unsetVar("HELIX_T_E");
+  }
+
+  void testFunctionLocalsAndParams() {
+    try {
+      helix::Shell shell;
+
+      std::string output;
+      captureOutput([&]() {
+        shell.processInputString("HELIX_T_V=outer");
+        shell.processInputString("helix_t_f() { local HELIX_T_V=$1; HELIX_T_V=\"$HELIX_T_V$#\"; HELIX_T_IN=$HELIX_T_V; }");
+        // Called repeatedly so pooled frames are reused
+        shell.processInputString("for i in 1 2 3; do helix_t_f x y; done");
+        shell.processInputString("HELIX_T_ARGS=\"$#\"");
+      }, output);
+
+      CPPUNIT_ASSERT_EQUAL(std::string("x2"), shellVar("HELIX_T_IN"));
+      CPPUNIT_ASSERT_EQUAL(std::string("outer"), shellVar("HELIX_T_V"));
+      CPPUNIT_ASSERT_EQUAL(std::string("0"), shellVar("HELIX_T_ARGS"));
+      unsetVar("HELIX_T_IN");
+      unsetVar("HELIX_T_V");
+      unsetVar("HELIX_T_ARGS");
+
+    } catch (const std::exception &e) {
+      CPPUNIT_FAIL("Function locals failed: " + std::string(e.what()));
+    }
+  }
+
+  void testSpecialParametersInBraces() {
+    helix::Shell shell;
+    std::string output;
+    captureOutput([&]() {
+      shell.processInputString("HELIX_T_TOP=\"${#} ${#:-x} ${?:-q} ${1-unset}\"");
+      // ${##} and ${#1} are lengths; ${#%0} and ${10:-x} take modifiers
+      shell.processInputString("helix_t_p() { HELIX_T_IN=\"${#} ${##} ${#%0} ${#1} ${10:-x} ${#@} ${#+y}\"; }");
+      shell.processInputString("helix_t_p abc 2 3 4 5 6 7 8 9 ten");
+    }, output);
+
+    CPPUNIT_ASSERT_EQUAL(std::string("0 0 0 unset"), shellVar("HELIX_T_TOP"));
+    CPPUNIT_ASSERT_EQUAL(std::string("10 2 1 3 ten 10 y"), shellVar("HELIX_T_IN"));
+    unsetVar("HELIX_T_TOP");
+    unsetVar("HELIX_T_IN");
+  }
+
+  void testCommandSubstitutionInProcess() {
+    try {
+      helix::Shell shell;
+
+      std::string output;
+      captureOutput([&]() {
+        // Functions and builtins are visible to $(...); /bin/sh would not know helix_t_g
+        shell.processInputString("helix_t_g() { echo \"g:$1\"; }");
+        shell.processInputString("HELIX_T_SUB=\"$(helix_t_g x)|$(echo  a  b)|`printf %s y`\"");
+        shell.processInputString("HELIX_T_ST=$(false)");
+        shell.processInputString("HELIX_T_RC=$?");
+      }, output);
+
+      CPPUNIT_ASSERT_EQUAL(std::string("g:x|a b|y"), shellVar("HELIX_T_SUB"));
+      CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_RC"));
+      unsetVar("HELIX_T_SUB");
+      unsetVar("HELIX_T_ST");
+      unsetVar("HELIX_T_RC");
+
+    } catch (const std::exception &e) {
+      CPPUNIT_FAIL("Command substitution failed: " + std::string(e.what()));
+    }
+  }
+
+  void testPipeStatusVariable() {
+    try {
+      helix::Shell shell;
+
+      std::string output;
+      captureOutput([&]() {
+        shell.processInputString("sh -c 'exit 1' | sh -c 'exit 0' | sh -c 'exit 4'");
+        shell.processInputString("HELIX_T_PS=\"$PIPESTATUS\"");
+        shell.processInputString("sh -c 'exit 2'");
+        shell.processInputString("HELIX_T_PS1=\"$PIPESTATUS\"");
+      }, output);
+
+      CPPUNIT_ASSERT_EQUAL(std::string("1 0 4"), shellVar("HELIX_T_PS"));
+      CPPUNIT_ASSERT_EQUAL(std::string("2"), shellVar("HELIX_T_PS1"));
+      unsetVar("HELIX_T_PS");
+      unsetVar("HELIX_T_PS1");
+
+    } catch (const std::exception &e) {
+      CPPUNIT_FAIL("PIPESTATUS failed: " + std::string(e.what()));
+    }
+  }
+
+  void testArithmeticCompiledOnce() {
+    helix::Shell shell;
+    std::string output;
+    captureOutput([&]() {
+      shell.processInputString("HELIX_T_A=$(( 2 ** 10 + (7 % 4) * -2 ))");
+      shell.processInputString("let 'HELIX_T_B = 5' 'HELIX_T_B <<= 2'");
+      shell.processInputString("HELIX_T_C=$(( HELIX_T_N++, HELIX_T_N > 0 ? 7 : 8 ))");
+      // $name pastes its text in (bash), a bare name evaluates its value
+      shell.processInputString("HELIX_T_V='1+2'");
+      shell.processInputString("HELIX_T_D=$(( $HELIX_T_V * 3 )),$(( HELIX_T_V * 3 ))");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("1018"), shellVar("HELIX_T_A"));
+    CPPUNIT_ASSERT_EQUAL(std::string("20"), shellVar("HELIX_T_B"));
+    CPPUNIT_ASSERT_EQUAL(std::string("7"), shellVar("HELIX_T_C"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_N"));
+    CPPUNIT_ASSERT_EQUAL(std::string("7,9"), shellVar("HELIX_T_D"));
+
+    // Re-evaluating the same text reuses its program and binding
+    helix::ArithmeticEngine& arith = helix::ArithmeticEngine::global();
+    helix::ArithmeticEngine::Stats before = arith.stats();
+    long value = 0;
+    for (int i = 0; i < 3; ++i) CPPUNIT_ASSERT(arith.evaluate("HELIX_T_I += 2", nullptr, value));
+    helix::ArithmeticEngine::Stats after = arith.stats();
+    CPPUNIT_ASSERT_EQUAL(6L, value);
+    CPPUNIT_ASSERT_EQUAL(before.compiled + 1, after.compiled);
+    CPPUNIT_ASSERT_EQUAL(before.hits + 2, after.hits);
+
+    // A removed variable is looked up again
+    unsetVar("HELIX_T_I");
+    CPPUNIT_ASSERT(arith.evaluate("HELIX_T_I += 2", nullptr, value));
+    CPPUNIT_ASSERT_EQUAL(2L, value);
+
+    captureOutput([&]() { CPPUNIT_ASSERT(!arith.evaluate("1 / (HELIX_T_I - 2)", nullptr, value)); }, output);
+    CPPUNIT_ASSERT_EQUAL(0L, value);
+
+    for (const char* name : {"HELIX_T_A", "HELIX_T_B", "HELIX_T_C", "HELIX_T_N", "HELIX_T_V", "HELIX_T_D", "HELIX_T_I"}) {
+      unsetVar(name);
+    }
+  }
+
+  void testScriptsParsedWholeAndSourceCached() {
+    char dir_template[] = "/tmp/helix_t_scriptXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::string lib = dir + "/lib.sh";
+    std::ofstream(lib) << "helix_t_add() {\n"
+                          "  HELIX_T_SUM=$(( HELIX_T_SUM + $1 ))\n"
+                          "}\n"
+                          "HELIX_T_LOADS=$(( HELIX_T_LOADS + 1 ))\n";
+    // Old enough for its mtime to be trusted
+    struct timespec old_times[2] = {{1000000000, 0}, {1000000000, 0}};
+    CPPUNIT_ASSERT_EQUAL(0, utimensat(AT_FDCWD, lib.c_str(), old_times, 0));
+
+    helix::ScriptCache& cache = helix::ScriptCache::global();
+    helix::ScriptCache::Stats before = cache.stats();
+    helix::Shell shell;
+    std::string output;
+    captureOutput([&]() {
+      shell.processInputString("source " + lib);
+      shell.processInputString(". " + lib);
+      shell.processInputString("helix_t_add 4; helix_t_add 5");
+    }, output);
+    helix::ScriptCache::Stats after = cache.stats();
+    CPPUNIT_ASSERT_EQUAL(std::string("2"), shellVar("HELIX_T_LOADS"));
+    CPPUNIT_ASSERT_EQUAL(std::string("9"), shellVar("HELIX_T_SUM"));
+    CPPUNIT_ASSERT_EQUAL(before.parsed + 1, after.parsed);
+    CPPUNIT_ASSERT_EQUAL(before.hits + 1, after.hits);
+
+    // A changed file is parsed again
+    std::ofstream(lib) << "HELIX_T_LOADS=changed\n";
+    CPPUNIT_ASSERT_EQUAL(0, utimensat(AT_FDCWD, lib.c_str(), old_times, 0));
+    captureOutput([&]() { shell.processInputString("source " + lib); }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("changed"), shellVar("HELIX_T_LOADS"));
+    CPPUNIT_ASSERT_EQUAL(before.parsed + 2, cache.stats().parsed);
+
+    // A script runs whole; one that does not parse still runs the
+    // commands before the error
+    std::string script = dir + "/script.sh";
+    std::ofstream(script) << "for i in 1 2; do\n  HELIX_T_SUM=$i$i\ndone\n";
+    std::ofstream(dir + "/bad.sh") << "HELIX_T_LOADS=before\nif then\n";
+    captureOutput([&]() {
+      shell.runScript(script.c_str(), 0, nullptr);
+      shell.runScript((dir + "/bad.sh").c_str(), 0, nullptr);
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("22"), shellVar("HELIX_T_SUM"));
+    CPPUNIT_ASSERT_EQUAL(std::string("before"), shellVar("HELIX_T_LOADS"));
+
+    for (const char* name : {"lib.sh", "script.sh", "bad.sh"}) unlink((dir + "/" + name).c_str());
+    rmdir(dir.c_str());
+    unsetVar("HELIX_T_LOADS");
+    unsetVar("HELIX_T_SUM");
+    unsetVar("i");
+  }
+
+  void testPipelineStagesRunShellCode() {
+    helix::Shell shell;
+    char path[] = "/tmp/helix_t_stagesXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    close(fd);
+    std::string out = path;
+
+    // Not captured: the forked stages write to the real descriptors
+    {
+      // Builtin head, function in the middle, compound command at the end
+      shell.processInputString("helix_t_up() { tr a-z A-Z; }");
+      shell.processInputString("printf '%s\\n' b a | helix_t_up | { sort; echo end; } > " + out);
+      shell.processInputString("HELIX_T_PS=\"$PIPESTATUS\"");
+      // Without lastpipe the loop runs in a child; with it, in the shell
+      shell.processInputString("HELIX_T_N=0; printf '1\\n2\\n3\\n' | while read x; do HELIX_T_N=$((HELIX_T_N+x)); done");
+      shell.processInputString("HELIX_T_SUB=$HELIX_T_N");
+      shell.processInputString("set -o lastpipe");
+      shell.processInputString("printf '1\\n2\\n3\\n' | while read x; do HELIX_T_N=$((HELIX_T_N+x)); done");
+      shell.processInputString("set +o lastpipe");
+    }
+
+    std::ifstream in(out);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CPPUNIT_ASSERT_EQUAL(std::string("A\nB\nend\n"), content);
+    CPPUNIT_ASSERT_EQUAL(std::string("0 0 0"), shellVar("HELIX_T_PS"));
+    CPPUNIT_ASSERT_EQUAL(std::string("0"), shellVar("HELIX_T_SUB"));
+    CPPUNIT_ASSERT_EQUAL(std::string("6"), shellVar("HELIX_T_N"));
+    unlink(path);
+    unsetVar("HELIX_T_PS");
+    unsetVar("HELIX_T_SUB");
+    unsetVar("HELIX_T_N");
+  }
+
+  void testPipelineStagesKeepPrefixAssignments() {
+    helix::Shell shell;
+    char path[] = "/tmp/helix_t_prefixXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    close(fd);
+    std::string out = path;
+
+    // Not captured: the programs write to the real descriptors
+    {
+      // First stage and a later stage; neither leaks into the shell
+      shell.processInputString("HELIX_T_PRE=first env | grep '^HELIX_T_PRE=' > " + out);
+      shell.processInputString("echo x | HELIX_T_PRE=later printenv HELIX_T_PRE >> " + out);
+      shell.processInputString("echo x | HELIX_T_PRE=last LC_ALL=C sort >> " + out);
+      shell.processInputString("HELIX_T_PS=\"${PIPESTATUS[*]}\"");
+    }
+
+    std::ifstream in(out);
+    std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CPPUNIT_ASSERT_EQUAL(std::string("HELIX_T_PRE=first\nlater\nx\n"), content);
+    CPPUNIT_ASSERT_EQUAL(std::string("0 0"), shellVar("HELIX_T_PS"));
+    CPPUNIT_ASSERT(!helix::VariableStore::global().find("HELIX_T_PRE"));
+    unlink(path);
+    unsetVar("HELIX_T_PS");
+  }
+
+  void testEnvpRebuiltOnlyForExports() {
+    helix::VariableStore& vars = helix::VariableStore::global();
+    auto inEnvp = [&vars](const std::string& entry) {
+      for (char* const* e = vars.envp(); *e; ++e) {
+        if (entry == *e) return true;
+      }
+      return false;
+    };
+
+    vars.set("HELIX_T_PLAIN", "1");
+    uint64_t generation = vars.generation();
+    char* const* envp = vars.envp();
+
+    // Plain shell variables leave the exported state alone
+    vars.set("HELIX_T_PLAIN", "2");
+    CPPUNIT_ASSERT_EQUAL(generation, vars.generation());
+    CPPUNIT_ASSERT(envp == vars.envp());
+    CPPUNIT_ASSERT(!inEnvp("HELIX_T_PLAIN=2"));
+
+    vars.exportVariable("HELIX_T_PLAIN");
+    CPPUNIT_ASSERT(vars.generation() > generation);
+    CPPUNIT_ASSERT(inEnvp("HELIX_T_PLAIN=2"));
+
+    vars.unset("HELIX_T_PLAIN");
+    CPPUNIT_ASSERT(!inEnvp("HELIX_T_PLAIN=2"));
+  }
+
+  void testOnlyExportedVariablesReachChildren() {
+    try {
+      helix::Shell shell;
+
+      std::string output;
+      captureOutput([&]() {
+        shell.processInputString("HELIX_T_LOCAL=a; export HELIX_T_EXP=b");
+        shell.processInputString("HELIX_T_SEEN=$(sh -c 'echo \"${HELIX_T_LOCAL:-none}-$HELIX_T_EXP\"')");
+        // A prefix assignment is exported to that command only
+        shell.processInputString("HELIX_T_PRE=c; HELIX_T_SEEN2=$(HELIX_T_PRE=e sh -c 'echo $HELIX_T_PRE')");
+        shell.processInputString("sh -c 'exit 3' & HELIX_T_BG=$!");
+      }, output);
+
+      CPPUNIT_ASSERT_EQUAL(std::string("none-b"), shellVar("HELIX_T_SEEN"));
+      CPPUNIT_ASSERT_EQUAL(std::string("e"), shellVar("HELIX_T_SEEN2"));
+      CPPUNIT_ASSERT_EQUAL(std::string("c"), shellVar("HELIX_T_PRE"));
+      CPPUNIT_ASSERT(!helix::VariableStore::global().lookup("HELIX_T_PRE")->exported);
+      CPPUNIT_ASSERT(std::atoi(shellVar("HELIX_T_BG").c_str()) > 0);
+      for (const char* name : {"HELIX_T_LOCAL", "HELIX_T_EXP", "HELIX_T_SEEN", "HELIX_T_PRE",
+                               "HELIX_T_SEEN2", "HELIX_T_BG"}) {
+        unsetVar(name);
+      }
+
+    } catch (const std::exception &e) {
+      CPPUNIT_FAIL("Exported variables failed: " + std::string(e.what()));
+    }
+  }
+
+  void testHistoryStoreIndexesAndAppends() {
+    char path[] = "/tmp/test_history_XXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    close(fd);
+    // Blank lines are skipped; the last line has no newline
+    std::ofstream(path) << "ls -l\ngit status\n\nmake\ngit log";
+
+    {
+      helix::HistoryStore history;
+      CPPUNIT_ASSERT(history.open(path));
+      CPPUNIT_ASSERT_EQUAL(std::string("git log"), std::string(*history.last()));
+      auto newest = history.tail(2);
+      CPPUNIT_ASSERT_EQUAL(size_t(2), newest.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("make"), std::string(newest[0]));
+      CPPUNIT_ASSERT_EQUAL(size_t(4), history.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("ls -l"), std::string(*history.at(1)));
+      CPPUNIT_ASSERT_EQUAL(std::string("git log"), std::string(*history.findPrefix("gi")));
+      CPPUNIT_ASSERT_EQUAL(std::string("make"), std::string(*history.findPrefix("m")));
+      CPPUNIT_ASSERT_EQUAL(std::string("git status"), std::string(*history.findSubstring("stat")));
+      CPPUNIT_ASSERT(!history.findPrefix("rm"));
+
+      // erasedups moves the entry to the end instead of adding a copy
+      CPPUNIT_ASSERT(history.add("make", "erasedups"));
+      CPPUNIT_ASSERT_EQUAL(size_t(4), history.size());
+      CPPUNIT_ASSERT_EQUAL(std::string("git log"), std::string(*history.at(3)));
+      CPPUNIT_ASSERT_EQUAL(std::string("make"), std::string(*history.at(4)));
+      CPPUNIT_ASSERT(!history.add("make", "ignoredups"));
+      CPPUNIT_ASSERT(!history.add(" secret", "ignoreboth"));
+      CPPUNIT_ASSERT(history.add("git push"));
+      CPPUNIT_ASSERT_EQUAL(std::string("git push"), std::string(*history.findPrefix("git")));
+    }
+
+    // Every entry was appended as it was added
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    CPPUNIT_ASSERT_EQUAL(std::string("ls -l\ngit status\n\nmake\ngit log\nmake\ngit push\n"), contents.str());
+
+    helix::HistoryStore reopened;
+    CPPUNIT_ASSERT(reopened.open(path));
+    CPPUNIT_ASSERT_EQUAL(size_t(6), reopened.size());
+    unlink(path);
+  }
+
+  void testCommandCompletionSources() {
+    helix::Shell shell;
+    std::string output;
+    captureOutput([&]() {
+      shell.processInputString("helix_t_complete_fn() { :; }");
+      shell.processInputString("alias helix_t_complete_al=ls");
+    }, output);
+
+    // Functions, aliases and builtins come from the shell; PATH from PathCache
+    auto found = helix::ReadlineSupport::commandCompletions("helix_t_complete");
+    CPPUNIT_ASSERT_EQUAL(size_t(2), found.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("helix_t_complete_al"), found[0]);
+    CPPUNIT_ASSERT_EQUAL(std::string("helix_t_complete_fn"), found[1]);
+
+    auto builtins = helix::ReadlineSupport::commandCompletions("getop");
+    CPPUNIT_ASSERT(std::find(builtins.begin(), builtins.end(), "getopts") != builtins.end());
+    auto programs = helix::ReadlineSupport::commandCompletions("s");
+    CPPUNIT_ASSERT(std::find(programs.begin(), programs.end(), "sh") != programs.end());
+    CPPUNIT_ASSERT(std::is_sorted(programs.begin(), programs.end()));
+  }
+
+  void testBuiltinTableLookup() {
+    // Every name hashes to its own entry; near misses are rejected
+    for (const auto& entry : helix::builtins::kTable) {
+      CPPUNIT_ASSERT(helix::builtins::find(entry.name) == &entry);
+    }
+    CPPUNIT_ASSERT(!helix::builtins::isBuiltin("cdx"));
+    CPPUNIT_ASSERT(!helix::builtins::isBuiltin("c"));
+    CPPUNIT_ASSERT(!helix::builtins::isBuiltin("ls"));
+
+    // Aliased names dispatch to the same handler; type and which see the table
+    helix::Shell shell;
+    std::string output;
+    captureOutput([&]() {
+      shell.processInputString("[ 1 -eq 1 ] && test 2 -eq 2 && type getopts && which typeset");
+    }, output);
+    CPPUNIT_ASSERT(output.find("getopts is a shell builtin") != std::string::npos);
+    CPPUNIT_ASSERT(output.find("typeset: shell built-in command") != std::string::npos);
+  }
+
+  void testJobEventsQueuedThenApplied() {
+    helix::JobManager jm;
+    std::vector<pid_t> pids;
+    for (int code = 0; code < 3; ++code) {
+      pid_t pid = fork();
+      if (pid == 0) _exit(code);
+      pids.push_back(pid);
+    }
+    jm.addJob(pids[0], pids, "a | b | c");
+    pid_t lone = fork();
+    if (lone == 0) _exit(7);
+    jm.addJob(lone, "lone");
+
+    // What the SIGCHLD handler does: only queue, the table is untouched
+    usleep(100000);
+    jm.onSigchld();
+    for (const auto& pair : jm.getJobs()) {
+      CPPUNIT_ASSERT(pair.second.status == helix::JobStatus::RUNNING);
+    }
+
+    jm.reapPending();
+    auto running = [&jm]() {
+      return jm.getJobs().at(1).status == helix::JobStatus::RUNNING ||
+             jm.getJobs().at(2).status == helix::JobStatus::RUNNING;
+    };
+    for (int tries = 0; tries < 100 && running(); ++tries) {
+      usleep(20000);  // A slow machine may not have run every child yet
+      jm.reapPending();
+    }
+    CPPUNIT_ASSERT_EQUAL(size_t(2), jm.getJobs().size());
+    const helix::Job& pipeline = jm.getJobs().at(1);
+    CPPUNIT_ASSERT(pipeline.status == helix::JobStatus::DONE);
+    std::vector<int> expected = {0, 1, 2};
+    CPPUNIT_ASSERT(expected == pipeline.stage_status);
+    CPPUNIT_ASSERT_EQUAL(7, jm.getJobs().at(2).stage_status.back());
+  }
+
+  void testParallelForLoop() {
+    char path[] = "/tmp/helix_t_parallelXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    close(fd);
+
+    helix::Shell shell;
+    std::string output;
+    auto start = std::chrono::steady_clock::now();
+    captureOutput([&]() {
+      shell.processInputString(std::string("{ for -P 3 n in 3 1 2; do sleep 0.$n; /bin/echo $n; exit $n; done; } > ") + path);
+      shell.processInputString("HELIX_T_PAR=$?");
+    }, output);
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    // Output in iteration order, the worst status, and the three sleeps
+    // overlapped (sequentially they take 0.6 s)
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    CPPUNIT_ASSERT_EQUAL(std::string("3\n1\n2\n"), text.str());
+    CPPUNIT_ASSERT_EQUAL(std::string("3"), shellVar("HELIX_T_PAR"));
+    CPPUNIT_ASSERT(elapsed < std::chrono::milliseconds(550));
+
+    // Iteration jobs were reaped and removed; wait goes through the job table
+    helix::JobManager jm;
+    pid_t pid = fork();
+    if (pid == 0) _exit(5);
+    int job = jm.addJob(pid, "five");
+    CPPUNIT_ASSERT_EQUAL(job, jm.findJob(pid));
+    CPPUNIT_ASSERT_EQUAL(5, jm.waitForJob(job));
+    CPPUNIT_ASSERT(jm.getJobs().empty());
+    CPPUNIT_ASSERT_EQUAL(-1, jm.waitForJob(job));
+
+    unlink(path);
+    unsetVar("n");
+    unsetVar("HELIX_T_PAR");
+  }
+
+  void testTimeKeywordAndStageUsage() {
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("time -p /bin/sleep 0.1 | /bin/cat");
+      shell.processInputString("HELIX_T_REAL=$HELIX_PIPE_REAL HELIX_T_RSS=$HELIX_PIPE_RSS");
+    }, output);
+
+    // POSIX report on stderr, covering the whole pipeline
+    CPPUNIT_ASSERT(output.find("real 0.1") != std::string::npos);
+    CPPUNIT_ASSERT(output.find("\nuser ") != std::string::npos);
+    CPPUNIT_ASSERT(output.find("\nsys ") != std::string::npos);
+
+    // One figure per stage, each from that stage's own wait4()
+    std::istringstream real(shellVar("HELIX_T_REAL"));
+    double sleep_s = 0, cat_s = 0;
+    CPPUNIT_ASSERT(real >> sleep_s >> cat_s);
+    CPPUNIT_ASSERT(sleep_s >= 0.1);
+    std::istringstream rss(shellVar("HELIX_T_RSS"));
+    long sleep_kb = 0, cat_kb = 0;
+    CPPUNIT_ASSERT(rss >> sleep_kb >> cat_kb);
+    CPPUNIT_ASSERT(sleep_kb > 0 && cat_kb > 0);
+
+    // Background jobs keep per-member usage for jobs -v (with the shell
+    // gone, its SIGCHLD handler no longer reaps the child first)
+    helix::JobManager jm;
+    pid_t pid = fork();
+    if (pid == 0) _exit(3);
+    jm.addJob(pid, "three");
+    for (int i = 0; i < 200 && jm.getJobs().at(1).status != helix::JobStatus::DONE; ++i) {
+      usleep(5000);
+      jm.reapPending();
+    }
+    const helix::Job& three = jm.getJobs().at(1);
+    CPPUNIT_ASSERT(three.status == helix::JobStatus::DONE);
+    CPPUNIT_ASSERT_EQUAL(size_t(1), three.stage_usage.size());
+    CPPUNIT_ASSERT(three.stage_usage[0].max_rss_kb > 0);
+    captureOutput([&]() { jm.printJobs(true); }, output);
+    CPPUNIT_ASSERT(output.find("exit 3") != std::string::npos);
+
+    unsetVar("HELIX_T_REAL");
+    unsetVar("HELIX_T_RSS");
+  }
+
+  void testBackgroundExitTimedDuringForegroundWait() {
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      // The job ends while SIGCHLD is held for the foreground sleep; its
+      // real time is still when it exited, not when the wait was over
+      shell.processInputString("/bin/sleep 0.1 | /bin/cat & /bin/sleep 0.5; jobs -v");
+    }, output);
+
+    size_t at = output.find("real ");
+    CPPUNIT_ASSERT(at != std::string::npos);
+    double real = std::stod(output.substr(at + 5));
+    CPPUNIT_ASSERT(real > 0.05);  // Timed from addJob(), just after the fork
+    CPPUNIT_ASSERT(real < 0.4);
+  }
+
+  void testBackgroundExitTimedDuringFg() {
+    char path[] = "/tmp/helix_t_fgXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    close(fd);
+    std::string out = path;
+
+    // fg hands the terminal over, so the shell runs in a child with a pty as
+    // its controlling terminal for stdin
+    pid_t pid = fork();
+    if (pid == 0) {
+      int master = posix_openpt(O_RDWR | O_NOCTTY);
+      if (setsid() == -1 || master == -1 || grantpt(master) != 0 || unlockpt(master) != 0) _exit(2);
+      int tty = open(ptsname(master), O_RDWR);
+      if (tty == -1 || dup2(tty, STDIN_FILENO) == -1) _exit(2);
+      signal(SIGTTOU, SIG_IGN);
+      {
+        helix::Shell shell;
+        shell.processInputString("/bin/sleep 0.1 | /bin/cat & /bin/sleep 0.5 & fg 2 > /dev/null; jobs -v > " + out);
+      }
+      _exit(0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    // Job 1 ended while fg waited for job 2: dated when it exited
+    std::ifstream in(out);
+    std::string report((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t at = report.find("real ");
+    CPPUNIT_ASSERT(at != std::string::npos);
+    double real = std::stod(report.substr(at + 5));
+    CPPUNIT_ASSERT(real > 0.05);  // Timed from addJob(), just after the fork
+    CPPUNIT_ASSERT(real < 0.4);
+    unlink(path);
+  }
+
+  void testPatternsInCaseTestAndTrims() {
+    helix::Shell shell;
+    std::string output;
+    captureOutput([&]() {
+      shell.processInputString("HELIX_T_P=/usr/lib/libz.so.1");
+      shell.processInputString("HELIX_T_A=\"${HELIX_T_P##*/} ${HELIX_T_P#*/} ${HELIX_T_P%%.*} ${HELIX_T_P%.[0-9]}\"");
+      // Quoted pattern characters are literal
+      shell.processInputString("HELIX_T_S='a*b'; HELIX_T_B=\"${HELIX_T_S#\"a*\"}|${HELIX_T_S#a*}\"");
+      shell.processInputString("for w in Upper 42 .dot 'two words'; do case $w in "
+                               "[A-Z]*) HELIX_T_C=\"$HELIX_T_C U\";; *[0-9]) HELIX_T_C=\"$HELIX_T_C D\";; "
+                               "'.'*) HELIX_T_C=\"$HELIX_T_C P\";; *\" \"*) HELIX_T_C=\"$HELIX_T_C S\";; esac; done");
+      shell.processInputString("[[ $HELIX_T_S == a* ]]; HELIX_T_D=$?");
+      shell.processInputString("[[ $HELIX_T_S == \"a?b\" ]]; HELIX_T_D=$HELIX_T_D$?");
+      shell.processInputString("[[ $HELIX_T_P != *.so.[0-9] ]]; HELIX_T_D=$HELIX_T_D$?");
+      // test and [ keep string equality
+      shell.processInputString("[ $HELIX_T_S = 'a*' ]; HELIX_T_D=$HELIX_T_D$?");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("libz.so.1 usr/lib/libz.so.1 /usr/lib/libz /usr/lib/libz.so"), shellVar("HELIX_T_A"));
+    CPPUNIT_ASSERT_EQUAL(std::string("b|*b"), shellVar("HELIX_T_B"));
+    CPPUNIT_ASSERT_EQUAL(std::string(" U D P S"), shellVar("HELIX_T_C"));
+    CPPUNIT_ASSERT_EQUAL(std::string("0111"), shellVar("HELIX_T_D"));
+    for (const char* name : {"HELIX_T_P", "HELIX_T_A", "HELIX_T_S", "HELIX_T_B", "HELIX_T_C", "HELIX_T_D"}) {
+      unsetVar(name);
+    }
+  }
+
+  void testReadLeavesTheRestForChildren() {
+    char path[] = "/tmp/helix_t_readXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    std::string body = "  one  two three  \nfour\\\nfive\nsix,seven,rest\n";
+    CPPUNIT_ASSERT_EQUAL(static_cast<ssize_t>(body.size()), write(fd, body.data(), body.size()));
+
+    // The descriptor offset ends right after each record
+    CPPUNIT_ASSERT_EQUAL(off_t(0), lseek(fd, 0, SEEK_SET));
+    helix::InputBuffer& input = helix::InputBuffer::forFd(fd);
+    std::string record;
+    CPPUNIT_ASSERT(input.read(record, '\n') == helix::InputBuffer::Status::Ok);
+    CPPUNIT_ASSERT_EQUAL(std::string("  one  two three  "), record);
+    CPPUNIT_ASSERT_EQUAL(off_t(19), lseek(fd, 0, SEEK_CUR));
+    record.clear();
+    CPPUNIT_ASSERT(input.read(record, '\n', 3) == helix::InputBuffer::Status::Full);
+    CPPUNIT_ASSERT_EQUAL(off_t(22), lseek(fd, 0, SEEK_CUR));
+    // Moved by someone else: the buffer starts over where the offset is
+    lseek(fd, 0, SEEK_SET);
+    record.clear();
+    CPPUNIT_ASSERT(input.read(record, 'e') == helix::InputBuffer::Status::Ok);
+    CPPUNIT_ASSERT_EQUAL(std::string("  on"), record);
+    helix::InputBuffer::discard(fd);
+    close(fd);
+
+    std::string out = std::string(path) + ".out";
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString(std::string("{ read HELIX_T_A HELIX_T_B; read HELIX_T_C; IFS=, read -d , -r HELIX_T_D; "
+                                           "cat > ") + out + "; } < " + path);
+      shell.processInputString(std::string("read -r HELIX_T_E < ") + path + "; read -n 5 HELIX_T_F < " + path);
+      shell.processInputString("read HELIX_T_G < /dev/null; HELIX_T_STATUS=$?");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("one"), shellVar("HELIX_T_A"));
+    CPPUNIT_ASSERT_EQUAL(std::string("two three"), shellVar("HELIX_T_B"));
+    CPPUNIT_ASSERT_EQUAL(std::string("fourfive"), shellVar("HELIX_T_C"));
+    CPPUNIT_ASSERT_EQUAL(std::string("six"), shellVar("HELIX_T_D"));
+    CPPUNIT_ASSERT_EQUAL(std::string("one  two three"), shellVar("HELIX_T_E"));
+    CPPUNIT_ASSERT_EQUAL(std::string("one"), shellVar("HELIX_T_F"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_STATUS"));
+    std::ifstream rest(out);
+    CPPUNIT_ASSERT_EQUAL(std::string("seven,rest\n"),
+                         std::string(std::istreambuf_iterator<char>(rest), std::istreambuf_iterator<char>()));
+
+    for (const char* name : {"HELIX_T_A", "HELIX_T_B", "HELIX_T_C", "HELIX_T_D", "HELIX_T_E", "HELIX_T_F",
+                             "HELIX_T_G", "HELIX_T_STATUS"}) {
+      unsetVar(name);
+    }
+    unlink(out.c_str());
+    unlink(path);
+  }
+
+  void testArrayStorage() {
+    // Indexed: holes are allowed, trailing ones trimmed, far jumps refused
+    helix::IndexedArray indexed;
+    indexed.append("a");
+    CPPUNIT_ASSERT(indexed.set(3, "d"));
+    CPPUNIT_ASSERT_EQUAL(size_t(2), indexed.size());
+    CPPUNIT_ASSERT_EQUAL(size_t(4), indexed.end());
+    CPPUNIT_ASSERT(indexed.get(1) == nullptr);
+    CPPUNIT_ASSERT(indexed.unset(3));
+    CPPUNIT_ASSERT_EQUAL(size_t(1), indexed.end());
+    CPPUNIT_ASSERT(!indexed.set(indexed.end() + helix::IndexedArray::kMaxGap + 1, "far"));
+
+    // Associative: survives growth, removals and compaction, in insertion order
+    helix::AssocArray assoc;
+    for (int i = 0; i < 1000; ++i) assoc.set("k" + std::to_string(i), std::to_string(i));
+    for (int i = 0; i < 1000; i += 2) CPPUNIT_ASSERT(assoc.unset("k" + std::to_string(i)));
+    CPPUNIT_ASSERT(!assoc.unset("k0"));
+    CPPUNIT_ASSERT_EQUAL(size_t(500), assoc.size());
+    for (int i = 0; i < 1000; ++i) {
+      const std::string* value = assoc.get("k" + std::to_string(i));
+      CPPUNIT_ASSERT_EQUAL(i % 2 == 1, value != nullptr);
+      if (value) CPPUNIT_ASSERT_EQUAL(std::to_string(i), *value);
+    }
+    assoc.set("k0", "back");  // Revived in its old place
+    std::string order;
+    assoc.forEach([&order](const std::string& key, const std::string&) {
+      if (order.size() < 8) order += key + " ";
+    });
+    CPPUNIT_ASSERT_EQUAL(std::string("k0 k1 "), order.substr(0, 6));
+    CPPUNIT_ASSERT_EQUAL(std::string("back"), *assoc.get("k0"));
+
+    // In the store: $a reads element 0, saving and restoring copies the elements
+    helix::VariableStore& vars = helix::VariableStore::global();
+    vars.set("HELIX_T_ARR", "zero");
+    helix::ShellArray* array = vars.makeArray("HELIX_T_ARR", false);
+    CPPUNIT_ASSERT(array && vars.makeArray("HELIX_T_ARR", true) == nullptr);
+    array->indexed.append("one");
+    auto saved = vars.save("HELIX_T_ARR");
+    vars.set("HELIX_T_ARR", "changed");
+    CPPUNIT_ASSERT_EQUAL(std::string("changed"), *vars.find("HELIX_T_ARR"));
+    vars.restore("HELIX_T_ARR", std::move(saved));
+    CPPUNIT_ASSERT_EQUAL(std::string("zero"), *vars.find("HELIX_T_ARR"));
+    CPPUNIT_ASSERT_EQUAL(size_t(2), vars.findArray("HELIX_T_ARR")->size());
+    unsetVar("HELIX_T_ARR");
+  }
+
+  void testArraysDeclareAndMapfile() {
+    char path[] = "/tmp/helix_t_mapXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    std::string body = "alpha\nbeta gamma\ndelta\n";
+    CPPUNIT_ASSERT_EQUAL(static_cast<ssize_t>(body.size()), write(fd, body.data(), body.size()));
+    close(fd);
+
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("a=(one \"two three\" x{1..2}); a+=(four); a[7]=seven; unset 'a[0]'");
+      shell.processInputString("n() { HELIX_T_N=$#; }; n \"${a[@]}\"; HELIX_T_COUNT=\"${#a[@]}\" HELIX_T_KEYS=\"${!a[*]}\"");
+      shell.processInputString("HELIX_T_N=$HELIX_T_N:$HELIX_T_COUNT:$HELIX_T_KEYS; HELIX_T_LAST=${a[-1]}");
+      shell.processInputString("declare -A m=([red]=1 [green]=2); k=green; m[blue]+=3; m[$k]+=0; unset 'm[red]'");
+      shell.processInputString("HELIX_T_M=\"${m[green]},${m[blue]},${#m[@]},${m[red]:-none}\"");
+      shell.processInputString("f() { local -a a=(inner); HELIX_T_IN=\"${a[*]}\"; }; f; HELIX_T_OUT=${a[1]}");
+      shell.processInputString(std::string("mapfile -t lines < ") + path + "; { readarray -n 1 -t head; cat > /dev/null; } < " + path);
+      shell.processInputString("HELIX_T_LINES=\"${#lines[@]}|${lines[1]}|${head[@]}\"");
+      shell.processInputString("declare -p a > /dev/null; declare -a m; HELIX_T_ST=$?");
+      shell.processInputString("true | false; HELIX_T_PS=\"${PIPESTATUS[1]}/${#PIPESTATUS[@]}\"");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("5:5:1 2 3 4 7"), shellVar("HELIX_T_N"));
+    CPPUNIT_ASSERT_EQUAL(std::string("seven"), shellVar("HELIX_T_LAST"));
+    CPPUNIT_ASSERT_EQUAL(std::string("20,3,2,none"), shellVar("HELIX_T_M"));
+    CPPUNIT_ASSERT_EQUAL(std::string("inner"), shellVar("HELIX_T_IN"));
+    CPPUNIT_ASSERT_EQUAL(std::string("two three"), shellVar("HELIX_T_OUT"));
+    CPPUNIT_ASSERT_EQUAL(std::string("3|beta gamma|alpha"), shellVar("HELIX_T_LINES"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_ST"));
+    CPPUNIT_ASSERT(output.find("cannot convert associative to indexed array") != std::string::npos);
+    CPPUNIT_ASSERT_EQUAL(std::string("1/2"), shellVar("HELIX_T_PS"));
+
+    for (const char* name : {"a", "m", "k", "lines", "head", "HELIX_T_N", "HELIX_T_COUNT", "HELIX_T_KEYS",
+                             "HELIX_T_LAST", "HELIX_T_M", "HELIX_T_IN", "HELIX_T_OUT", "HELIX_T_LINES",
+                             "HELIX_T_ST", "HELIX_T_PS"}) {
+      unsetVar(name);
+    }
+    unlink(path);
+  }
+
+  void testArrayElementSlices() {
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("a=(x y z) i=1; n() { HELIX_T_N=$#; }; n \"${a[@]:1}\"");
+      shell.processInputString("HELIX_T_S=\"${a[@]:1}|${a[@]:1:1}|${a[*]: -1}|${a[@]: -2:1}|${a[@]::2}|${a[@]:i+1}|${a[@]:5}\"");
+      // Offsets are indices: a sparse array's holes are skipped
+      shell.processInputString("b=([0]=a [5]=b [6]=c); HELIX_T_B=\"${b[@]:1}|${b[@]:5:1}|${b[@]: -1}\"");
+      shell.processInputString("HELIX_T_E=\"${a[@]:1:-1}\"");
+    }, output);
+
+    CPPUNIT_ASSERT_EQUAL(std::string("2"), shellVar("HELIX_T_N"));
+    CPPUNIT_ASSERT_EQUAL(std::string("y z|y|z|y|x y|z|"), shellVar("HELIX_T_S"));
+    CPPUNIT_ASSERT_EQUAL(std::string("b c|b|c"), shellVar("HELIX_T_B"));
+    CPPUNIT_ASSERT_EQUAL(std::string(), shellVar("HELIX_T_E"));
+    CPPUNIT_ASSERT(output.find("substring expression < 0") != std::string::npos);
+    for (const char* name : {"a", "b", "i", "HELIX_T_N", "HELIX_T_S", "HELIX_T_B", "HELIX_T_E"}) unsetVar(name);
+  }
+
+  void testLazyRangesAndArithmeticFor() {
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("HELIX_T_R=; for v in a {08..12..2} x{3..1}y b; do HELIX_T_R=\"$HELIX_T_R$v \"; done");
+      shell.processInputString("n=0; for v in {1..100000}; do n=$((n + v)); [ $v = 5000 ] && break; done; HELIX_T_SUM=$n:$v");
+      shell.processInputString("HELIX_T_C=; for ((i = 0, j = 10; i < j; i += 3, j--)); do "
+                               "[ $i = 3 ] && continue; HELIX_T_C=\"$HELIX_T_C$i/$j \"; done; HELIX_T_C=$HELIX_T_C$i");
+      shell.processInputString("for ((;;)); do for ((k = 0; k < 5; k++)); do [ $k = 2 ] && break 2; done; done; HELIX_T_K=$k");
+      shell.processInputString("for ((i = 0; i < 1 / 0; i++)); do :; done; HELIX_T_ST=$?");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("a 08 10 12 x3y x2y x1y b "), shellVar("HELIX_T_R"));
+    CPPUNIT_ASSERT_EQUAL(std::string("12502500:5000"), shellVar("HELIX_T_SUM"));
+    CPPUNIT_ASSERT_EQUAL(std::string("0/10 6/8 9"), shellVar("HELIX_T_C"));
+    CPPUNIT_ASSERT_EQUAL(std::string("2"), shellVar("HELIX_T_K"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_ST"));
+
+    for (const char* name : {"v", "n", "i", "j", "k", "HELIX_T_R", "HELIX_T_SUM", "HELIX_T_C", "HELIX_T_K", "HELIX_T_ST"}) {
+      unsetVar(name);
+    }
+  }
+
+  void testServerRunsRequestsInWarmWorkers() {
+    char dir_template[] = "/tmp/helix_t_srvXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::string socket_path = dir + "/s";
+
+    // The server defines a function once; each request finds it in its fork
+    pid_t server = fork();
+    if (server == 0) {
+      helix::StartupOptions batch;
+      batch.interactive = false;
+      batch.load_rc = false;
+      helix::Shell shell(batch);
+      shell.processInputString("helix_t_warm() { echo \"warm:$1:$HELIX_T_ENV:$(pwd)\"; }");
+      _exit(shell.serve(socket_path));
+    }
+    CPPUNIT_ASSERT(server > 0);
+
+    // The client's environment and directory go with the request
+    setenv("HELIX_T_ENV", "from-client", 1);
+    std::string command = "helix_t_warm x > " + dir + "/out; exit 3";
+    std::optional<int> status;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!status && std::chrono::steady_clock::now() < deadline) {
+      status = helix::ShellServer::runClient(socket_path, command);
+      if (!status) usleep(10000);
+    }
+    unsetenv("HELIX_T_ENV");
+    CPPUNIT_ASSERT(status.has_value());
+    CPPUNIT_ASSERT_EQUAL(3, *status);
+    char cwd[4096];
+    CPPUNIT_ASSERT(getcwd(cwd, sizeof cwd));
+    std::ifstream in(dir + "/out");
+    std::string line;
+    std::getline(in, line);
+    CPPUNIT_ASSERT_EQUAL("warm:x:from-client:" + std::string(cwd), line);
+
+    // A worker killed by a signal reports it like a shell would
+    CPPUNIT_ASSERT_EQUAL(std::optional<int>(143), helix::ShellServer::runClient(socket_path, "kill -TERM $$"));
+
+    // No server there: the caller runs the command itself
+    CPPUNIT_ASSERT(!helix::ShellServer::runClient(dir + "/none", "true").has_value());
+
+    // SIGTERM stops the server and takes the socket away
+    kill(server, SIGTERM);
+    int wait_status = 0;
+    CPPUNIT_ASSERT_EQUAL(server, waitpid(server, &wait_status, 0));
+    CPPUNIT_ASSERT(WIFEXITED(wait_status) && WEXITSTATUS(wait_status) == 0);
+    struct stat st;
+    CPPUNIT_ASSERT(stat(socket_path.c_str(), &st) == -1);
+
+    std::string cleanup = "rm -rf " + dir;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testEmbeddedInterpreter() {
+    struct sigaction host {}, previous {}, now {};
+    host.sa_handler = SIG_DFL;
+    sigaction(SIGCHLD, &host, &previous);
+    // A child of the host, which the interpreter must not reap
+    pid_t host_child = fork();
+    if (host_child == 0) _exit(7);
+
+    {
+      helix::Interpreter interp;
+      sigaction(SIGCHLD, nullptr, &now);
+      CPPUNIT_ASSERT(now.sa_handler == SIG_DFL);
+
+      std::string out, err;
+      CPPUNIT_ASSERT_EQUAL(0, interp.run("echo out; echo err >&2; /bin/echo child", &out, &err));
+      CPPUNIT_ASSERT_EQUAL(std::string("out\nchild\n"), out);
+      CPPUNIT_ASSERT_EQUAL(std::string("err\n"), err);
+      // One string for both keeps them in order
+      interp.run("echo 1; echo 2 >&2; echo 3", &out, &out);
+      CPPUNIT_ASSERT_EQUAL(std::string("1\n2\n3\n"), out);
+
+      interp.set("HELIX_T_IN", "v");
+      interp.run("HELIX_T_OUT=${HELIX_T_IN}x");
+      CPPUNIT_ASSERT_EQUAL(std::string("vx"), interp.get("HELIX_T_OUT").value_or(""));
+      CPPUNIT_ASSERT(interp.unset("HELIX_T_OUT"));
+      CPPUNIT_ASSERT(!interp.get("HELIX_T_OUT").has_value());
+
+      // Parsed once, run many times; state carries over between runs
+      helix::Interpreter::ScriptPtr script = interp.compile("helix_t_n=$((helix_t_n + 1)); echo $helix_t_n");
+      CPPUNIT_ASSERT(script);
+      for (int i = 0; i < 3; ++i) interp.run(*script, &out);
+      CPPUNIT_ASSERT_EQUAL(std::string("3\n"), out);
+
+      std::string error;
+      CPPUNIT_ASSERT(!interp.compile("if true; then", &error));
+      CPPUNIT_ASSERT_EQUAL(std::string("syntax error: unexpected end of file"), error);
+      CPPUNIT_ASSERT_EQUAL(2, interp.run("fi", &out, &err));
+      CPPUNIT_ASSERT(err.rfind("helix: ", 0) == 0);
+
+      // `exit` ends one run, not the interpreter
+      CPPUNIT_ASSERT_EQUAL(4, interp.run("exit 4; echo never", &out));
+      CPPUNIT_ASSERT_EQUAL(std::string(), out);
+      // Its own background job is still reaped, by pid
+      interp.run("sleep 0.05 & wait $!; echo \"status $?\"", &out);
+      CPPUNIT_ASSERT(out.find("status 0\n") != std::string::npos);
+      helix::VariableStore::global().unset("HELIX_T_IN");
+      helix::VariableStore::global().unset("helix_t_n");
+    }
+
+    int status = 0;
+    CPPUNIT_ASSERT_EQUAL(host_child, waitpid(host_child, &status, 0));
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 7);
+    sigaction(SIGCHLD, &previous, nullptr);
+  }
+
+  void testCatAndTeeCopyInTheKernel() {
+    CPPUNIT_ASSERT_EQUAL(4096, helix::parsePipeSize("4096"));
+    CPPUNIT_ASSERT_EQUAL(1 << 20, helix::parsePipeSize("1M"));
+    CPPUNIT_ASSERT_EQUAL(64 << 10, helix::parsePipeSize("64k"));
+    CPPUNIT_ASSERT_EQUAL(0, helix::parsePipeSize("big"));
+    CPPUNIT_ASSERT_EQUAL(0, helix::parsePipeSize("-1"));
+
+    char dir_template[] = "/tmp/helix_t_copyXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    std::string body(300000, 'x');
+    body += "tail\n";
+    { std::ofstream(dir + "/in") << "skip\n" << body; }
+    auto contents = [](const std::string& path) {
+      std::ifstream in(path);
+      return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+
+    // File to file from the current offset, which ends up at the end
+    int in = open((dir + "/in").c_str(), O_RDONLY);
+    int out = open((dir + "/out").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    lseek(in, 5, SEEK_SET);
+    CPPUNIT_ASSERT(helix::StreamCopy::copy(in, out));
+    CPPUNIT_ASSERT_EQUAL(static_cast<off_t>(5 + body.size()), lseek(in, 0, SEEK_CUR));
+    close(out);
+    CPPUNIT_ASSERT(contents(dir + "/out") == body);
+
+    // Pipe to pipe through tee(), with a copy for a file
+    int from[2], to[2];
+    CPPUNIT_ASSERT(pipe(from) == 0 && pipe(to) == 0);
+    pid_t writer = fork();
+    if (writer == 0) {
+      close(from[0]);
+      lseek(in, 5, SEEK_SET);
+      _exit(helix::StreamCopy::copy(in, from[1]) ? 0 : 1);
+    }
+    close(from[1]);
+    pid_t teer = fork();
+    if (teer == 0) {
+      close(to[0]);
+      int copy = open((dir + "/copy").c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      std::vector<int> errors;
+      _exit(helix::StreamCopy::tee(from[0], to[1], {copy}, errors) && errors[0] == 0 ? 0 : 1);
+    }
+    close(from[0]);
+    close(to[1]);
+    std::string piped;
+    char buf[65536];
+    for (ssize_t n; (n = read(to[0], buf, sizeof buf)) > 0;) piped.append(buf, static_cast<size_t>(n));
+    close(to[0]);
+    close(in);
+    int status = 0;
+    waitpid(writer, &status, 0);
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    waitpid(teer, &status, 0);
+    CPPUNIT_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    CPPUNIT_ASSERT(piped == body);
+    CPPUNIT_ASSERT(contents(dir + "/copy") == body);
+
+    // The builtins: offsets shared with read, -a, and options left to the programs
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("cd " + dir + " && { read HELIX_T_FIRST; cat > rest; } < in");
+      shell.processInputString("cat rest | tee t1 | cat > t2; echo more > m; tee -a t1 < m > /dev/null");
+      shell.processInputString("printf 'a\\nb\\n' > ab; cat -n ab > numbered; cat missing ab > both 2> /dev/null; HELIX_T_STATUS=$?");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("skip"), shellVar("HELIX_T_FIRST"));
+    CPPUNIT_ASSERT(contents(dir + "/rest") == body);
+    CPPUNIT_ASSERT(contents(dir + "/t2") == body);
+    CPPUNIT_ASSERT(contents(dir + "/t1") == body + "more\n");
+    CPPUNIT_ASSERT_EQUAL(std::string("     1\ta\n     2\tb\n"), contents(dir + "/numbered"));
+    // A missing file fails the status but not the files after it
+    CPPUNIT_ASSERT_EQUAL(std::string("a\nb\n"), contents(dir + "/both"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_STATUS"));
+    unsetVar("HELIX_T_FIRST");
+    unsetVar("HELIX_T_STATUS");
+
+    std::string cleanup = "rm -rf " + dir;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testProcessSubstitution() {
+    // <( and >( start a word, at its front or inside it; `< <(` stays a redirection
+    helix::Tokenizer tokenizer;
+    auto tokens = tokenizer.tokenizeScript("diff <(sort a) x>(tee b) < <(echo \")\")");
+    CPPUNIT_ASSERT_EQUAL(size_t(6), tokens.size());
+    CPPUNIT_ASSERT_EQUAL(std::string("<(sort a)"), tokens[1].value);
+    CPPUNIT_ASSERT_EQUAL(std::string("x>(tee b)"), tokens[2].value);
+    CPPUNIT_ASSERT(tokens[3].type == helix::TokenType::REDIRECT_IN);
+    CPPUNIT_ASSERT_EQUAL(std::string("<(echo \")\")"), tokens[4].value);
+
+    char dir_template[] = "/tmp/helix_t_psubXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    auto contents = [](const std::string& path) {
+      std::ifstream in(path);
+      return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("cd " + dir + " && printf 'b\\na\\n' > x && printf 'a\\nc\\n' > y");
+      shell.processInputString("diff <(sort x) <(sort y) > diffed; HELIX_T_DIFF=$?");
+      shell.processInputString("while read -r l; do HELIX_T_LAST=$l; done < <(sort -r x)");
+      shell.processInputString("HELIX_T_PATH=$(echo <(true))");
+      shell.processInputString("cat x | tee >(sort > sorted) > /dev/null; HELIX_T_QUOTED=\"<(true)\"");
+      // The pipes are closed with their command: nothing left open after it
+      shell.processInputString("HELIX_T_FDS=$(ls /proc/self/fd | wc -l); cat <(true) /dev/null; "
+                               "HELIX_T_AFTER=$(ls /proc/self/fd | wc -l)");
+      shell.processInputString("sleep 0.2");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_DIFF"));
+    CPPUNIT_ASSERT_EQUAL(std::string("2c2\n< b\n---\n> c\n"), contents(dir + "/diffed"));
+    CPPUNIT_ASSERT_EQUAL(std::string("a"), shellVar("HELIX_T_LAST"));
+    CPPUNIT_ASSERT(shellVar("HELIX_T_PATH").starts_with("/dev/fd/"));
+    CPPUNIT_ASSERT_EQUAL(std::string("a\nb\n"), contents(dir + "/sorted"));
+    CPPUNIT_ASSERT_EQUAL(std::string("<(true)"), shellVar("HELIX_T_QUOTED"));
+    CPPUNIT_ASSERT_EQUAL(shellVar("HELIX_T_FDS"), shellVar("HELIX_T_AFTER"));
+    CPPUNIT_ASSERT(!helix::hasInheritedFds());
+    for (const char* name : {"HELIX_T_DIFF", "HELIX_T_LAST", "HELIX_T_PATH", "HELIX_T_QUOTED", "HELIX_T_FDS",
+                             "HELIX_T_AFTER"}) {
+      unsetVar(name);
+    }
+
+    std::string cleanup = "rm -rf " + dir;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testCoprocessAnswersRepeatedly() {
+    char dir_template[] = "/tmp/helix_t_coprocXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    auto contents = [](const std::string& path) {
+      std::ifstream in(path);
+      return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    std::string output;
+    // Built outside the capture: the coprocess's echo must reach its pipe,
+    // not the test's string buffer
+    helix::Shell shell;
+    captureOutput([&]() {
+      shell.processInputString("cd " + dir);
+      // One helper answers every question; programs can write to it too
+      shell.processInputString("coproc DBL { while read -r x; do echo $((x * 2)); done; }");
+      shell.processInputString("for i in 1 2 3; do echo $i >&${DBL[1]}; read -r -u ${DBL[0]} y; "
+                               "HELIX_T_ANSWERS+=\"$y \"; done");
+      shell.processInputString("/bin/echo 50 | cat >&${DBL[1]}; head -n 1 <&${DBL[0]} > answer");
+      shell.processInputString("HELIX_T_FDS=\"${#DBL[@]} ${DBL_PID:+pid}\"");
+      shell.processInputString("echo x >&7 2> bad; HELIX_T_BAD=$?");
+      shell.processInputString("kill $DBL_PID; wait $DBL_PID; HELIX_T_WAIT=$?");
+      shell.processInputString("HELIX_T_GONE=${DBL[0]:-gone}");
+    }, output);
+    CPPUNIT_ASSERT_EQUAL(std::string("2 4 6 "), shellVar("HELIX_T_ANSWERS"));
+    CPPUNIT_ASSERT_EQUAL(std::string("100\n"), contents(dir + "/answer"));
+    CPPUNIT_ASSERT_EQUAL(std::string("2 pid"), shellVar("HELIX_T_FDS"));
+    // The shell's private descriptors are not the script's to name
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_BAD"));
+    CPPUNIT_ASSERT_EQUAL(std::string("143"), shellVar("HELIX_T_WAIT"));
+    CPPUNIT_ASSERT_EQUAL(std::string("gone"), shellVar("HELIX_T_GONE"));
+    for (const char* name : {"HELIX_T_ANSWERS", "HELIX_T_FDS", "HELIX_T_BAD", "HELIX_T_WAIT", "HELIX_T_GONE",
+                             "DBL_PID"}) {
+      unsetVar(name);
+    }
+
+    std::string cleanup = "rm -rf " + dir;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testKillJobSpecs() {
+    std::string output;
+    auto start = std::chrono::steady_clock::now();
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("coproc /bin/sleep 10; kill %1; wait $COPROC_PID; HELIX_T_CO=$?");
+      // %% is the latest job; the whole pipeline's group gets the signal
+      shell.processInputString("/bin/sleep 10 | /bin/sleep 10 & kill -INT %%; wait %1; HELIX_T_PIPE=$?");
+      shell.processInputString("kill %9; HELIX_T_NONE=$?");
+    }, output);
+
+    CPPUNIT_ASSERT_EQUAL(std::string("143"), shellVar("HELIX_T_CO"));
+    CPPUNIT_ASSERT_EQUAL(std::string("130"), shellVar("HELIX_T_PIPE"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_NONE"));
+    CPPUNIT_ASSERT(output.find("kill: %9: no such job") != std::string::npos);
+    CPPUNIT_ASSERT(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    unsetVar("HELIX_T_CO");
+    unsetVar("HELIX_T_PIPE");
+    unsetVar("HELIX_T_NONE");
+  }
+
+  void testFinalCommandReplacesTheShell() {
+    char dir_template[] = "/tmp/helix_t_execXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    auto contents = [](const std::string& path) {
+      std::ifstream in(path);
+      return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    };
+    // source run as `helix -c` runs it, in a child; pid is that child
+    auto runBatch = [](const std::string& source, pid_t& pid) {
+      pid = fork();
+      if (pid == 0) {
+        helix::StartupOptions batch;
+        batch.interactive = false;
+        batch.load_rc = false;
+        int status = 0;
+        {
+          helix::Shell shell(batch);  // Its destructor runs the EXIT trap
+          status = shell.runCommand(source);
+        }
+        _exit(status);
+      }
+      int status = 0;
+      waitpid(pid, &status, 0);
+      return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    };
+    std::string report = "sh -c 'echo $$ > pid; exit 4' < in > out";
+    std::ofstream(dir + "/in") << "x\n";
+
+    // The last program takes over the shell's process, redirections applied
+    pid_t pid = 0;
+    CPPUNIT_ASSERT_EQUAL(4, runBatch("cd " + dir + " && " + report, pid));
+    CPPUNIT_ASSERT_EQUAL(std::to_string(pid) + "\n", contents(dir + "/pid"));
+
+    // An EXIT trap, a job or a later command still needs the shell after it
+    for (const char* prefix : {"trap 'echo bye > trap' EXIT; ", "sleep 0.1 & "}) {
+      CPPUNIT_ASSERT_EQUAL(4, runBatch("cd " + dir + "; " + std::string(prefix) + report, pid));
+      CPPUNIT_ASSERT(contents(dir + "/pid") != std::to_string(pid) + "\n");
+    }
+    CPPUNIT_ASSERT_EQUAL(std::string("bye\n"), contents(dir + "/trap"));
+    CPPUNIT_ASSERT_EQUAL(5, runBatch("cd " + dir + "; " + report + "; exit 5", pid));
+    CPPUNIT_ASSERT(contents(dir + "/pid") != std::to_string(pid) + "\n");
+
+    std::string cleanup = "rm -rf " + dir;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testBuiltinOutputGoesStraightToFiles() {
+    char dir_template[] = "/tmp/helix_t_outXXXXXX";
+    std::string dir = mkdtemp(dir_template);
+    auto slurp = [](const std::string& path) {
+      std::ifstream file(path);
+      return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+
+    char cwd[4096];
+    CPPUNIT_ASSERT(getcwd(cwd, sizeof cwd));
+    struct stat before, after;
+    fstat(STDOUT_FILENO, &before);
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("cd " + dir);
+      shell.processInputString("i=0; while [ $i -lt 500 ]; do echo \"line $i\" >> log; i=$((i+1)); done");
+      // Larger than the buffer: written in one writev() with what is pending
+      helix::VariableStore::global().set("HELIX_T_BIG", std::string(70000, '0'));
+      shell.processInputString("printf 'a%sb' \"$HELIX_T_BIG\" > big");
+      // Left to right: stderr to the file, then stdout where stderr points
+      shell.processInputString("echo one 2> both >&2; echo two >> both 2>&1; echo stays 2>/dev/null");
+      shell.processInputString("echo full > /dev/full; HELIX_T_FULL=$?");
+      shell.processInputString("echo no > /nonexistent/dir/x; HELIX_T_MISSING=$?");
+    }, output);
+    fstat(STDOUT_FILENO, &after);
+
+    std::string log = slurp(dir + "/log");
+    CPPUNIT_ASSERT_EQUAL(size_t(500), static_cast<size_t>(std::count(log.begin(), log.end(), '\n')));
+    CPPUNIT_ASSERT(log.find("line 0\n") == 0);
+    CPPUNIT_ASSERT(log.find("line 499\n") != std::string::npos);
+    std::string big = slurp(dir + "/big");
+    CPPUNIT_ASSERT_EQUAL(size_t(70002), big.size());
+    CPPUNIT_ASSERT(big.front() == 'a' && big.back() == 'b');
+    CPPUNIT_ASSERT_EQUAL(std::string("one\ntwo\n"), slurp(dir + "/both"));
+
+    // Captured stdout still gets unredirected output; a failed write is
+    // status 1 and leaves the stream usable
+    CPPUNIT_ASSERT(output.find("stays") != std::string::npos);
+    CPPUNIT_ASSERT(output.find("write error") != std::string::npos);
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_FULL"));
+    CPPUNIT_ASSERT_EQUAL(std::string("1"), shellVar("HELIX_T_MISSING"));
+    CPPUNIT_ASSERT(before.st_ino == after.st_ino && before.st_dev == after.st_dev);
+
+    unsetVar("HELIX_T_BIG");
+    CPPUNIT_ASSERT(chdir(cwd) == 0);
+    std::string cleanup = "rm -rf " + dir;
+    CPPUNIT_ASSERT_EQUAL(0, std::system(cleanup.c_str()));
+  }
+
+  void testEventLoopWakesOnChildExit() {
+    helix::EventLoop& loop = helix::EventLoop::global();
+
+    // Readable descriptors run their handler
+    int fds[2];
+    CPPUNIT_ASSERT(pipe(fds) == 0);
+    std::string got;
+    CPPUNIT_ASSERT(loop.watch(fds[0], [&]() {
+      char buf[16];
+      ssize_t n = read(fds[0], buf, sizeof buf);
+      if (n > 0) got.append(buf, static_cast<size_t>(n));
+    }));
+    CPPUNIT_ASSERT(write(fds[1], "ab", 2) == 2);
+    CPPUNIT_ASSERT(loop.runOnce(1000));
+    CPPUNIT_ASSERT_EQUAL(std::string("ab"), got);
+    loop.unwatch(fds[0]);
+    close(fds[0]);
+    close(fds[1]);
+
+    // The shell's SIGCHLD handler wakes the wait; nothing polls
+    int wakes = 0;
+    int token = loop.onWake([&]() { ++wakes; });
+    CPPUNIT_ASSERT(loop.runOnce(0));
+    CPPUNIT_ASSERT_EQUAL(0, wakes);
+    {
+      helix::StartupOptions batch;
+      batch.interactive = false;
+      batch.load_rc = false;
+      helix::Shell shell(batch);
+      pid_t child = fork();
+      if (child == 0) _exit(0);
+      auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+      while (wakes == 0 && std::chrono::steady_clock::now() < deadline) loop.runOnce(100);
+      CPPUNIT_ASSERT(wakes > 0);
+    }
+
+    // A removed handler is not run again
+    int seen = wakes;
+    loop.removeWake(token);
+    helix::EventLoop::wake();
+    CPPUNIT_ASSERT(loop.runOnce(100));
+    CPPUNIT_ASSERT_EQUAL(seen, wakes);
+  }
+
+  void testTraceRecordsPhasesAndChildren() {
+    char path[] = "/tmp/helix_t_traceXXXXXX";
+    int fd = mkstemp(path);
+    CPPUNIT_ASSERT(fd != -1);
+    close(fd);
+
+    CPPUNIT_ASSERT(!helix::Tracer::enabled());
+    CPPUNIT_ASSERT(helix::Tracer::global().open(path));
+    std::string output;
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("/bin/echo traced | /bin/cat > /dev/null");
+      shell.processInputString("HELIX_T_TRACE=1");
+    }, output);
+    helix::Tracer::global().close();
+    CPPUNIT_ASSERT(!helix::Tracer::enabled());
+
+    std::ifstream in(path);
+    std::stringstream text;
+    text << in.rdbuf();
+    const std::string trace = text.str();
+    // A JSON array of events: shell phases on our pid, then each stage's
+    // launch, its program on the stage's own row, and the wait
+    CPPUNIT_ASSERT(trace.rfind("[\n", 0) == 0);
+    for (const char* name : {"parse", "tokenize", "expand", "pipeline", "spawn", "wait", "run"}) {
+      CPPUNIT_ASSERT(trace.find(std::string("\"name\":\"") + name + "\"") != std::string::npos);
+    }
+    CPPUNIT_ASSERT(trace.find("\"stage\":1") != std::string::npos);
+    CPPUNIT_ASSERT(trace.find("\"pid\":" + std::to_string(getpid()) + ",") != std::string::npos);
+    CPPUNIT_ASSERT(trace.find("/bin/echo traced | /bin/cat") != std::string::npos);
+
+    // Nothing is recorded once it is closed
+    captureOutput([&]() {
+      helix::Shell shell;
+      shell.processInputString("HELIX_T_TRACE=2");
+    }, output);
+    struct stat st;
+    CPPUNIT_ASSERT(stat(path, &st) == 0);
+    CPPUNIT_ASSERT_EQUAL(static_cast<off_t>(trace.size()), st.st_size);
+
+    unlink(path);
+    unsetVar("HELIX_T_TRACE");
+  }
+
   void testShellRun() {
     try {
       helix::Shell shell;
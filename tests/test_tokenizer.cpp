@@ -11,6 +11,7 @@ class TokenizerTest : public CppUnit::TestFixture {
     CPPUNIT_TEST(testQuoting);
     CPPUNIT_TEST(testEdgeCases);
     CPPUNIT_TEST(testComplexCommand);
+    CPPUNIT_TEST(testViewTokensShareInput);
     CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -108,6 +109,30 @@ public:
         CPPUNIT_ASSERT(tokens[7].type == helix::TokenType::WORD && tokens[7].value == "results.txt");
         CPPUNIT_ASSERT_EQUAL(helix::TokenType::BACKGROUND, tokens[8].type);
     }
+
+    void testViewTokensShareInput() {
+        auto inside = [](std::string_view view, const std::string& text) {
+            return view.data() >= text.data() && view.data() + view.size() <= text.data() + text.size();
+        };
+
+        // Plain words are spans of the input; unquoted ones are copied
+        std::string line = "grep -v \"a b\"c x\\ y > out";
+        const auto& views = tokenizer->tokenizeView(line);
+        CPPUNIT_ASSERT_EQUAL(size_t(7), views.size());
+        CPPUNIT_ASSERT(views[0].value == "grep" && inside(views[0].value, line));
+        CPPUNIT_ASSERT(views[2].value == "a bc" && !inside(views[2].value, line));
+        CPPUNIT_ASSERT(views[3].value == "x y" && !inside(views[3].value, line));
+        CPPUNIT_ASSERT_EQUAL(helix::TokenType::REDIRECT_OUT, views[4].type);
+        CPPUNIT_ASSERT(views[5].value == "out" && inside(views[5].value, line));
+
+        // Script words stay raw, so they and a << body are never copied
+        std::string script = "cat \"$x\"'y' <<EOF\nbody $x\nEOF\n";
+        const auto& sv = tokenizer->tokenizeScriptView(script);
+        CPPUNIT_ASSERT(sv[1].value == "\"$x\"'y'" && inside(sv[1].value, script));
+        CPPUNIT_ASSERT_EQUAL(helix::TokenType::HEREDOC_BODY, sv[4].type);
+        CPPUNIT_ASSERT(sv[4].value == "body $x\n" && inside(sv[4].value, script));
+        CPPUNIT_ASSERT(!tokenizer->incomplete());
+    }
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(TokenizerTest);